@@ -9,6 +9,7 @@
 
 #include "ssl_capable_socket.h"
 #include "authentication_provider.h"
+#include "dns_cache.h"
 
 class OAuth24DProvider : public sigslot::has_slots<>,
 	public MessageHandler,
@@ -41,6 +42,9 @@ public:
 
 	const State& state() const;
 
+	// Overrides the dns cache used to resolve the code and poll hosts, which defaults to RtcDnsResolver::SharedCache()
+	void SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache);
+
 	// emitted when we have the code response and are awaiting user interaction
 	sigslot::signal1<const CodeData&> SignalCodeComplete;
 
@@ -70,7 +74,10 @@ protected:
 	void SocketOpen(rtc::AsyncSocket* socket);
 	void SocketRead(rtc::AsyncSocket* socket);
 	void SocketClose(rtc::AsyncSocket* socket, int err);
-	void AddressResolve(rtc::AsyncResolverInterface* resolver);
+	void AddressResolve(const std::string& ip);
+
+	// Resolves |host| through the dns cache, moving to |resolvingState| until AddressResolve
+	void ResolveHost(const rtc::SocketAddress& host, State resolvingState);
 
 	std::string code_uri_;
 	std::string poll_uri_;
@@ -80,7 +87,8 @@ protected:
 	CodeData data_;
 	std::shared_ptr<rtc::Thread> signaling_thread_;
 	std::unique_ptr<SslCapableSocket> socket_;
-	std::unique_ptr<AsyncResolver> resolver_;
+	std::shared_ptr<DnsCache> dns_cache_;
+	int resolve_ticket_;
 
 private:
 	rtc::SocketAddress SocketAddressFromString(const std::string& str);
@@ -10,6 +10,7 @@
 
 #include "authentication_provider.h"
 #include "ssl_capable_socket.h"
+#include "dns_cache.h"
 
 class ServerAuthenticationProvider : public sigslot::has_slots<>,
 	public AuthenticationProvider
@@ -33,8 +34,13 @@ public:
 
 	ServerAuthenticationProvider(const ServerAuthInfo& authInfo);
 
+	~ServerAuthenticationProvider();
+
 	const State& state() const;
 
+	// Overrides the dns cache used to resolve the authority, which defaults to RtcDnsResolver::SharedCache()
+	void SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache);
+
 	// implement AuthenticationProvider
 	virtual bool Authenticate() override;
 
@@ -42,12 +48,13 @@ protected:
 	void SocketOpen(rtc::AsyncSocket* socket);
 	void SocketRead(rtc::AsyncSocket* socket);
 	void SocketClose(rtc::AsyncSocket* socket, int err);
-	void AddressResolve(rtc::AsyncResolverInterface* resolver);
+	void AddressResolve(const std::string& ip);
 
 	ServerAuthInfo auth_info_;
 	rtc::SocketAddress authority_host_;
 	State state_;
 	std::shared_ptr<rtc::Thread> signaling_thread_;
 	std::unique_ptr<SslCapableSocket> socket_;
-	std::unique_ptr<AsyncResolver> resolver_;
+	std::shared_ptr<DnsCache> dns_cache_;
+	int resolve_ticket_;
 };
\ No newline at end of file
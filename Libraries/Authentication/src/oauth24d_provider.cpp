@@ -1,4 +1,6 @@
 #include "oauth24d_provider.h"
+#include "rtc_dns_resolver.h"
+
 namespace
 {
 	// null deleter to conform rtc::Thread* to std::shared_ptr interface safely
@@ -6,7 +8,8 @@ namespace
 }
 
 OAuth24DProvider::OAuth24DProvider(const std::string& codeUri, const std::string& pollUri) :
-	code_uri_(codeUri), poll_uri_(pollUri), state_(State::NOT_ACTIVE)
+	code_uri_(codeUri), poll_uri_(pollUri), state_(State::NOT_ACTIVE),
+	dns_cache_(RtcDnsResolver::SharedCache()), resolve_ticket_(DnsCache::kNoTicket)
 {
 	// don't support empty values for these fields
 	if (codeUri.empty() || pollUri.empty())
@@ -18,6 +21,15 @@ OAuth24DProvider::OAuth24DProvider(const std::string& codeUri, const std::string
 	code_host_ = SocketAddressFromString(codeUri);
 	poll_host_ = SocketAddressFromString(pollUri);
 
+	// warm the cache now, so authenticating doesn't wait on dns
+	for (const auto& host : { code_host_, poll_host_ })
+	{
+		if (host.IsUnresolvedIP())
+		{
+			dns_cache_->Prefetch(host.hostname());
+		}
+	}
+
 	// configure the thread which will be used for socket signalling. it's just some representation of
 	// the current thread (wrapped or existing)
 	auto socketThread = rtc::Thread::Current();
@@ -28,15 +40,7 @@ OAuth24DProvider::OAuth24DProvider(const std::string& codeUri, const std::string
 
 OAuth24DProvider::~OAuth24DProvider()
 {
-	if (resolver_.get() != nullptr)
-	{
-		// release the resolver pointer and destroy the resolver
-		auto released = resolver_.release();
-		released->Destroy(true);
-
-		// reset the resolver pointer to nullptr
-		resolver_.reset(nullptr);
-	}
+	dns_cache_->Cancel(resolve_ticket_);
 }
 
 const OAuth24DProvider::State& OAuth24DProvider::state() const
@@ -44,6 +48,13 @@ const OAuth24DProvider::State& OAuth24DProvider::state() const
 	return state_;
 }
 
+void OAuth24DProvider::SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache)
+{
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
+	dns_cache_ = dnsCache;
+}
+
 rtc::SocketAddress OAuth24DProvider::SocketAddressFromString(const std::string& str)
 {
 	// take the hostname, <protocol>://<hostname>[:port]/ 
@@ -82,20 +93,14 @@ bool OAuth24DProvider::Authenticate()
 
 	if (code_host_.IsUnresolvedIP())
 	{
-		state_ = RESOLVING_CODE;
-		resolver_.reset(new rtc::AsyncResolver());
-		resolver_->SignalDone.connect(this, &OAuth24DProvider::AddressResolve);
-		resolver_->Start(code_host_);
+		ResolveHost(code_host_, RESOLVING_CODE);
 
 		return true;
 	}
 
 	if (poll_host_.IsUnresolvedIP())
 	{
-		state_ = RESOLVING_POLL;
-		resolver_.reset(new rtc::AsyncResolver());
-		resolver_->SignalDone.connect(this, &OAuth24DProvider::AddressResolve);
-		resolver_->Start(poll_host_);
+		ResolveHost(poll_host_, RESOLVING_POLL);
 
 		return true;
 	}
@@ -265,39 +270,51 @@ void OAuth24DProvider::SocketClose(rtc::AsyncSocket* socket, int err)
 	return;
 }
 
-void OAuth24DProvider::AddressResolve(rtc::AsyncResolverInterface* resolver)
+void OAuth24DProvider::ResolveHost(const rtc::SocketAddress& host, State resolvingState)
 {
-	// capture the result
-	auto tempHost = resolver->address();
+	state_ = resolvingState;
 
-	// release the resolver pointer and destroy the resolver
-	auto released = resolver_.release();
-	released->Destroy(true);
+	// on a cache hit this calls back (and may start resolving the next host) before Resolve
+	// returns, so only keep the ticket for a resolve that is actually outstanding
+	auto ticket = dns_cache_->Resolve(host.hostname(),
+		[this](const std::string& ip) { AddressResolve(ip); });
 
-	// reset the resolver pointer to nullptr
-	resolver_.reset(nullptr);
+	if (ticket != DnsCache::kNoTicket)
+	{
+		resolve_ticket_ = ticket;
+	}
+}
+
+void OAuth24DProvider::AddressResolve(const std::string& ip)
+{
+	resolve_ticket_ = DnsCache::kNoTicket;
 
 	if (state_ != State::RESOLVING_CODE && state_ != State::RESOLVING_POLL)
 	{
 		return;
 	}
 
-	if (state_ == State::RESOLVING_CODE)
+	auto& host = state_ == State::RESOLVING_CODE ? code_host_ : poll_host_;
+	if (!RtcDnsResolver::ApplyResolvedIp(ip, &host))
 	{
-		code_host_ = tempHost;
+		LOG(LS_ERROR) << __FUNCTION__ << ": unable to resolve " << host.hostname();
 
-		if (poll_host_.IsUnresolvedIP())
-		{
-			state_ = RESOLVING_POLL;
-			resolver_.reset(new rtc::AsyncResolver());
-			resolver_->SignalDone.connect(this, &OAuth24DProvider::AddressResolve);
-			resolver_->Start(poll_host_);
-			
-			return;
-		}
+		state_ = State::NOT_ACTIVE;
+
+		AuthenticationProviderResult completionData;
+		completionData.successFlag = false;
+		SignalAuthenticationComplete.emit(completionData);
+
+		return;
+	}
+
+	if (state_ == State::RESOLVING_CODE && poll_host_.IsUnresolvedIP())
+	{
+		ResolveHost(poll_host_, RESOLVING_POLL);
+
+		return;
 	}
 
-	poll_host_ = tempHost;
 	state_ = State::REQUEST_CODE;
 	
 	// connect the socket to code_host_ to REQUEST_CODE
@@ -1,4 +1,6 @@
 #include "server_authentication_provider.h"
+#include "rtc_dns_resolver.h"
+
 namespace
 {
 	// null deleter to conform rtc::Thread* to std::shared_ptr interface safely
@@ -6,7 +8,8 @@ namespace
 }
 
 ServerAuthenticationProvider::ServerAuthenticationProvider(const ServerAuthInfo& authInfo) :
-	AuthenticationProvider(), auth_info_(authInfo), state_(State::NOT_ACTIVE)
+	AuthenticationProvider(), auth_info_(authInfo), state_(State::NOT_ACTIVE),
+	dns_cache_(RtcDnsResolver::SharedCache()), resolve_ticket_(DnsCache::kNoTicket)
 {
 	// don't support empty values for these fields
 	if (authInfo.authority.empty() || authInfo.clientId.empty() || authInfo.clientSecret.empty())
@@ -25,6 +28,12 @@ ServerAuthenticationProvider::ServerAuthenticationProvider(const ServerAuthInfo&
 	auto authorityPort = std::string("https://").compare(authority.substr(0, 8)) == 0 ? 443 : 80;
 	authority_host_ = rtc::SocketAddress(tempAuthHost, authorityPort);
 
+	// warm the cache now, so authenticating doesn't wait on dns
+	if (authority_host_.IsUnresolvedIP())
+	{
+		dns_cache_->Prefetch(authority_host_.hostname());
+	}
+
 	// configure the thread which will be used for socket signalling. it's just some representation of
 	// the current thread (wrapped or existing)
 	auto socketThread = rtc::Thread::Current();
@@ -38,11 +47,23 @@ ServerAuthenticationProvider::ServerAuthenticationProvider(const ServerAuthInfo&
 	socket_->SignalCloseEvent.connect(this, &ServerAuthenticationProvider::SocketClose);
 }
 
+ServerAuthenticationProvider::~ServerAuthenticationProvider()
+{
+	dns_cache_->Cancel(resolve_ticket_);
+}
+
 const ServerAuthenticationProvider::State& ServerAuthenticationProvider::state() const
 {
 	return state_;
 }
 
+void ServerAuthenticationProvider::SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache)
+{
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
+	dns_cache_ = dnsCache;
+}
+
 bool ServerAuthenticationProvider::Authenticate()
 {
 	if (state_ != ServerAuthenticationProvider::State::NOT_ACTIVE)
@@ -61,10 +82,10 @@ bool ServerAuthenticationProvider::Authenticate()
 	// if we need to resolve the ip we do that before connecting
 	if (authority_host_.IsUnresolvedIP())
 	{
+		// note: on a cache hit this calls back before Resolve returns
 		state_ = RESOLVING;
-		resolver_.reset(new rtc::AsyncResolver());
-		resolver_->SignalDone.connect(this, &ServerAuthenticationProvider::AddressResolve);
-		resolver_->Start(authority_host_);
+		resolve_ticket_ = dns_cache_->Resolve(authority_host_.hostname(),
+			[this](const std::string& ip) { AddressResolve(ip); });
 
 		return true;
 	}
@@ -174,17 +195,9 @@ void ServerAuthenticationProvider::SocketClose(rtc::AsyncSocket* socket, int err
 	state_ = State::NOT_ACTIVE;
 }
 
-void ServerAuthenticationProvider::AddressResolve(rtc::AsyncResolverInterface* resolver)
+void ServerAuthenticationProvider::AddressResolve(const std::string& ip)
 {
-	// capture the result
-	auto tempHost = resolver->address();
-
-	// release the resolver pointer and destroy the resolver
-	auto released = resolver_.release();
-	released->Destroy(true);
-
-	// reset the resolver pointer to nullptr
-	resolver_.reset(nullptr);
+	resolve_ticket_ = DnsCache::kNoTicket;
 
 	if (state_ != State::RESOLVING)
 	{
@@ -192,7 +205,17 @@ void ServerAuthenticationProvider::AddressResolve(rtc::AsyncResolverInterface* r
 	}
 
 	state_ = State::NOT_ACTIVE;
-	authority_host_ = tempHost;
+
+	if (!RtcDnsResolver::ApplyResolvedIp(ip, &authority_host_))
+	{
+		LOG(LS_ERROR) << __FUNCTION__ << ": unable to resolve " << authority_host_.hostname();
+
+		AuthenticationProviderResult completionData;
+		completionData.successFlag = false;
+		SignalAuthenticationComplete.emit(completionData);
+
+		return;
+	}
 
 	// connect the socket 
 	int err = socket_->Connect(authority_host_);
@@ -51,6 +51,8 @@ TEST(ConfigParserTests, Config_Global_Allocation_Success)
 	ASSERT_STREQ("testUri", injectedWebRTCInstance->server_uri.c_str());
 	ASSERT_TRUE(((uint16_t)5678) == injectedWebRTCInstance->port);
 	ASSERT_TRUE(((uint32_t)91011) == injectedWebRTCInstance->heartbeat);
+	ASSERT_TRUE(injectedWebRTCInstance->reuse_connections);
+	ASSERT_TRUE(injectedWebRTCInstance->track_latency);
 	ASSERT_STREQ("test:test:1234", injectedWebRTCInstance->stun_server.uri.c_str());
 	ASSERT_STREQ("testUri://testUri", injectedWebRTCInstance->authentication.authority_uri.c_str());
 	ASSERT_STREQ("00000000-0000-0000-0000-000000000000", injectedWebRTCInstance->authentication.client_id.c_str());
@@ -67,6 +69,8 @@ TEST(ConfigParserTests, Config_Global_Allocation_Success)
 	ASSERT_STREQ("", defaultWebRTCInstance->server_uri.c_str());
 	ASSERT_TRUE(((uint16_t)0) == defaultWebRTCInstance->port);
 	ASSERT_TRUE(((uint32_t)0) == defaultWebRTCInstance->heartbeat);
+	ASSERT_FALSE(defaultWebRTCInstance->reuse_connections);
+	ASSERT_FALSE(defaultWebRTCInstance->track_latency);
 	ASSERT_STREQ("", defaultWebRTCInstance->stun_server.uri.c_str());
 	ASSERT_STREQ("", defaultWebRTCInstance->authentication.authority_uri.c_str());
 	ASSERT_STREQ("", defaultWebRTCInstance->authentication.client_id.c_str());
@@ -85,6 +89,7 @@ TEST(ConfigParserTests, Config_Global_Allocation_Success)
 	ASSERT_TRUE(((uint32_t)1234) == injectedServerInstance->server_config.height);
 	ASSERT_EQ(true, injectedServerInstance->server_config.system_service);
 	ASSERT_TRUE(((uint32_t)5678) == injectedServerInstance->server_config.width);
+	ASSERT_EQ(0, injectedServerInstance->server_config.hardware_encoder_sessions);
 	ASSERT_STREQ(L"test", injectedServerInstance->service_config.display_name.c_str());
 	ASSERT_STREQ(L"test", injectedServerInstance->service_config.name.c_str());
 	ASSERT_STREQ(L"test\\test", injectedServerInstance->service_config.service_account.c_str());
@@ -127,3 +132,37 @@ TEST(ConfigParserTests, Config_URI_Priority_Success)
 	ASSERT_STREQ("test", oldWebRTCInstance->server_uri.c_str());
 	ASSERT_STREQ("test://test", oldWebRTCInstance->authentication.authority_uri.c_str());
 }
+
+TEST(ConfigParserTests, Config_Multiple_Servers_Success)
+{
+	// get our directory path
+	TCHAR currentDirectory[MAX_PATH];
+	GetModuleFileName(GetModuleHandle("ConfigParser.Tests.dll"), currentDirectory, MAX_PATH);
+	auto wrappedCurrentDirectory = std::string(currentDirectory);
+
+	ConfigParser::ConfigureConfigFactories(wrappedCurrentDirectory.substr(0, wrappedCurrentDirectory.length() - 22), "multiServerWebrtcConfig.json");
+
+	auto multiWebRTCInstance = Object<WebRTCConfig>::Get();
+
+	// servers are kept in preference order, and entries without a port use the top level one
+	ASSERT_EQ(3u, multiWebRTCInstance->servers.size());
+	ASSERT_STREQ("https://test-a", multiWebRTCInstance->servers[0].uri.c_str());
+	ASSERT_TRUE(((uint16_t)443) == multiWebRTCInstance->servers[0].port);
+	ASSERT_STREQ("http://test-b", multiWebRTCInstance->servers[1].uri.c_str());
+	ASSERT_TRUE(((uint16_t)3000) == multiWebRTCInstance->servers[1].port);
+	ASSERT_STREQ("http://test-c", multiWebRTCInstance->servers[2].uri.c_str());
+	ASSERT_TRUE(((uint16_t)5678) == multiWebRTCInstance->servers[2].port);
+
+	// single server consumers see the preferred server
+	ASSERT_STREQ("https://test-a", multiWebRTCInstance->server_uri.c_str());
+	ASSERT_TRUE(((uint16_t)443) == multiWebRTCInstance->port);
+
+	ConfigParser::ConfigureConfigFactories(wrappedCurrentDirectory.substr(0, wrappedCurrentDirectory.length() - 22));
+
+	auto singleWebRTCInstance = Object<WebRTCConfig>::Get();
+
+	// a single server config is exposed as a one entry list
+	ASSERT_EQ(1u, singleWebRTCInstance->servers.size());
+	ASSERT_STREQ("testUri", singleWebRTCInstance->servers[0].uri.c_str());
+	ASSERT_TRUE(((uint16_t)5678) == singleWebRTCInstance->servers[0].port);
+}
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace StreamingToolkit
 {
@@ -27,6 +28,26 @@ namespace StreamingToolkit
 
 		/* Automatically onnect to the signaling server	*/
 		bool			auto_connect;
+
+		/* Records data channel input here, if set		*/
+		std::string		input_log_path;
+
+		/* Hardware encode sessions to use at most,		*/
+		/* or 0 to learn it from the device				*/
+		int				hardware_encoder_sessions;
+
+		/* Encodes with "nvenc", "software" or "auto",	*/
+		/* NVENC if the device supports it				*/
+		std::string		encoder_backend;
+
+		/* Records each peer's encoded video here, the	*/
+		/* later ones as eg. session-1.3dsr, if set,	*/
+		/* to replay later								*/
+		std::string		record_path;
+
+		/* Replays this stream recording to every peer,	*/
+		/* if set, instead of rendering				*/
+		std::string		replay_path;
 	} ServerAppConfig;
 
 	/*
@@ -86,6 +107,18 @@ namespace StreamingToolkit
 		std::string		uri;
 	} StunServer;
 
+	/*
+	 * Signaling server configuration
+	 */
+	typedef struct
+	{
+		/* The signaling server uri						*/
+		std::string		uri;
+
+		/* The signaling server port					*/
+		uint16_t		port;
+	} SignalingServer;
+
 	/*
 	 * Authentication configuration
 	 */
@@ -130,9 +163,20 @@ namespace StreamingToolkit
 		/* The signaling server port					*/
 		uint16_t		port;
 
+		/* All signaling servers, in preference order	*/
+		std::vector<SignalingServer> servers;
+
 		/* The heartbeat used to keep the app alive		*/
 		uint32_t		heartbeat;
 
+		/* Whether to reuse keep-alive connections		*/
+		/* to the signaling server between requests		*/
+		bool			reuse_connections;
+
+		/* Whether to measure motion to photon latency	*/
+		/* by stage, reporting it over the data channel	*/
+		bool			track_latency;
+
 		/* The authentication info						*/
 		Authentication	authentication;
 	} WebRTCConfig;
@@ -135,6 +135,44 @@ void ConfigParser::ParseWebRTCConfig(const std::string& path, StreamingToolkit::
 			webrtcConfig->heartbeat = root.get("heartbeat", NULL).asInt();
 		}
 
+		if (root.isMember("reuseConnections"))
+		{
+			webrtcConfig->reuse_connections = root.get("reuseConnections", NULL).asBool();
+		}
+
+		if (root.isMember("trackLatency"))
+		{
+			webrtcConfig->track_latency = root.get("trackLatency", NULL).asBool();
+		}
+
+		if (root.isMember("servers"))
+		{
+			// entries without their own port share the top level one
+			for (const auto& serverNode : root.get("servers", NULL))
+			{
+				StreamingToolkit::SignalingServer server;
+				server.uri = serverNode.get("uri", "").asString();
+				server.port = serverNode.isMember("port") ? serverNode.get("port", NULL).asInt() : webrtcConfig->port;
+
+				webrtcConfig->servers.push_back(server);
+			}
+
+			// older consumers only know about a single server, so give them the preferred one
+			if (webrtcConfig->server_uri.empty() && !webrtcConfig->servers.empty())
+			{
+				webrtcConfig->server_uri = webrtcConfig->servers[0].uri;
+				webrtcConfig->port = webrtcConfig->servers[0].port;
+			}
+		}
+		else if (!webrtcConfig->server_uri.empty())
+		{
+			StreamingToolkit::SignalingServer server;
+			server.uri = webrtcConfig->server_uri;
+			server.port = webrtcConfig->port;
+
+			webrtcConfig->servers.push_back(server);
+		}
+
 		if (root.isMember("authentication"))
 		{
 			auto authenticationNode = root.get("authentication", NULL);
@@ -181,6 +219,10 @@ void ConfigParser::ParseServerConfig(const std::string& path, StreamingToolkit::
 	// we want the systemCapacity default to be -1, which requires an explicit set operation
 	serverConfig->server_config.system_capacity = -1;
 
+	// no limit unless told one, so the encoders learn it from the sessions the device refuses
+	serverConfig->server_config.hardware_encoder_sessions = 0;
+	serverConfig->server_config.encoder_backend = "auto";
+
 	std::ifstream fileStream(path);
 	Json::Reader reader;
 	Json::Value root = NULL;
@@ -219,6 +261,31 @@ void ConfigParser::ParseServerConfig(const std::string& path, StreamingToolkit::
 			{
 				serverConfig->server_config.auto_connect = serverConfigNode.get("autoConnect", "").asBool();
 			}
+
+			if (serverConfigNode.isMember("inputLogPath"))
+			{
+				serverConfig->server_config.input_log_path = serverConfigNode.get("inputLogPath", "").asString();
+			}
+
+			if (serverConfigNode.isMember("hardwareEncoderSessions"))
+			{
+				serverConfig->server_config.hardware_encoder_sessions = serverConfigNode.get("hardwareEncoderSessions", "").asInt();
+			}
+
+			if (serverConfigNode.isMember("encoderBackend"))
+			{
+				serverConfig->server_config.encoder_backend = serverConfigNode.get("encoderBackend", "").asString();
+			}
+
+			if (serverConfigNode.isMember("recordPath"))
+			{
+				serverConfig->server_config.record_path = serverConfigNode.get("recordPath", "").asString();
+			}
+
+			if (serverConfigNode.isMember("replayPath"))
+			{
+				serverConfig->server_config.replay_path = serverConfigNode.get("replayPath", "").asString();
+			}
 		}
 
 		if (root.isMember("serviceConfig"))
@@ -0,0 +1,2392 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <functional>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <gtest\gtest.h>
+#include "frame_correlator.h"
+#include "frame_metadata.h"
+#include "input_channels.h"
+#include "input_coalescer.h"
+#include "input_dispatcher.h"
+#include "input_log.h"
+#include "input_message_codec.h"
+#include "input_replayer.h"
+#include "latency_recorder.h"
+#include "latest_mailbox.h"
+#include "pose_predictor.h"
+
+namespace
+{
+	/// <summary>
+	/// Builds a stereo transform with distinct, non trivial values in every matrix
+	/// </summary>
+	CameraTransform SampleTransform(CameraTransform::Kind kind)
+	{
+		CameraTransform transform;
+		transform.kind = kind;
+		transform.timestamp = kind == CameraTransform::STEREO_PREDICTION ? 131567894561234567LL : 0;
+
+		float* matrices[] = { transform.projection_left, transform.view_left, transform.projection_right, transform.view_right };
+		for (int m = 0; m < 4; m++)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				matrices[m][i] = (m + 1) * 0.123456789f + i * -1.5f + 1.0f / (i + 3);
+			}
+		}
+
+		return transform;
+	}
+
+	void ExpectMatricesEqual(const CameraTransform& expected, const CameraTransform& actual)
+	{
+		EXPECT_EQ(0, memcmp(expected.projection_left, actual.projection_left, sizeof(expected.projection_left)));
+		EXPECT_EQ(0, memcmp(expected.view_left, actual.view_left, sizeof(expected.view_left)));
+		EXPECT_EQ(0, memcmp(expected.projection_right, actual.projection_right, sizeof(expected.projection_right)));
+		EXPECT_EQ(0, memcmp(expected.view_right, actual.view_right, sizeof(expected.view_right)));
+	}
+
+	/// <summary>
+	/// Builds json the way AppCallbacks::SendInputData does, with a trailing comma after each float
+	/// </summary>
+	std::string ClientJson(const CameraTransform& transform)
+	{
+		std::ostringstream body;
+		for (auto matrix : { transform.projection_left, transform.view_left, transform.projection_right, transform.view_right })
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				body << matrix[i] << ",";
+			}
+		}
+
+		if (transform.kind == CameraTransform::STEREO_PREDICTION)
+		{
+			body << transform.timestamp;
+		}
+
+		return std::string("{\n   \"body\" : \"") + body.str() + "\",\n   \"type\" : \"" +
+			InputMessageCodec::TypeName(transform.kind) + "\"\n}\n";
+	}
+
+	/// <summary>
+	/// The body parsing the server samples did before InputMessageCodec, for comparison
+	/// </summary>
+	bool LegacyParse(const std::string& body, CameraTransform* transform)
+	{
+		std::istringstream datastream(body);
+		std::string token;
+		for (auto matrix : { transform->projection_left, transform->view_left, transform->projection_right, transform->view_right })
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				getline(datastream, token, ',');
+				matrix[i] = stof(token);
+			}
+		}
+
+		getline(datastream, token, ',');
+		transform->timestamp = stoll(token);
+		return true;
+	}
+}
+
+TEST(InputProtocolTests, BinaryRoundTrip)
+{
+	for (auto kind : { CameraTransform::STEREO, CameraTransform::STEREO_PREDICTION })
+	{
+		auto transform = SampleTransform(kind);
+		transform.sequence = 4242;
+
+		auto encoded = InputMessageCodec::Encode(transform);
+		ASSERT_EQ(InputMessageCodec::kCameraTransformSize, encoded.size());
+		ASSERT_TRUE(InputMessageCodec::IsBinary(encoded.data(), encoded.size()));
+
+		CameraTransform decoded;
+		ASSERT_TRUE(InputMessageCodec::Decode(encoded.data(), encoded.size(), &decoded));
+		EXPECT_EQ(kind, decoded.kind);
+		EXPECT_EQ(transform.timestamp, decoded.timestamp);
+		EXPECT_EQ(4242u, decoded.sequence);
+		ExpectMatricesEqual(transform, decoded);
+	}
+}
+
+TEST(InputProtocolTests, JsonRoundTrip)
+{
+	for (auto kind : { CameraTransform::STEREO, CameraTransform::STEREO_PREDICTION })
+	{
+		auto transform = SampleTransform(kind);
+		auto encoded = InputMessageCodec::EncodeJson(transform);
+		ASSERT_FALSE(InputMessageCodec::IsBinary(encoded.data(), encoded.size()));
+
+		// %.9g is enough digits for every float to survive exactly
+		CameraTransform decoded;
+		ASSERT_TRUE(InputMessageCodec::Decode(encoded.data(), encoded.size(), &decoded));
+		EXPECT_EQ(kind, decoded.kind);
+		EXPECT_EQ(transform.timestamp, decoded.timestamp);
+		EXPECT_EQ(0u, decoded.sequence);
+		ExpectMatricesEqual(transform, decoded);
+	}
+}
+
+TEST(InputProtocolTests, DecodesClientJson)
+{
+	for (auto kind : { CameraTransform::STEREO, CameraTransform::STEREO_PREDICTION })
+	{
+		auto transform = SampleTransform(kind);
+		auto json = ClientJson(transform);
+
+		CameraTransform decoded;
+		ASSERT_TRUE(InputMessageCodec::Decode(json.data(), json.size(), &decoded));
+		EXPECT_EQ(kind, decoded.kind);
+		EXPECT_EQ(transform.timestamp, decoded.timestamp);
+
+		// the client only sends six significant digits
+		EXPECT_NEAR(transform.projection_left[5], decoded.projection_left[5], 1e-4);
+		EXPECT_NEAR(transform.view_right[15], decoded.view_right[15], 1e-4);
+	}
+}
+
+TEST(InputProtocolTests, IgnoresTrailingBytesFromNewerVersions)
+{
+	auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+	auto encoded = InputMessageCodec::Encode(transform);
+	encoded[1] = InputMessageCodec::kVersion + 1;
+	encoded.append("future fields");
+
+	CameraTransform decoded;
+	ASSERT_TRUE(InputMessageCodec::Decode(encoded.data(), encoded.size(), &decoded));
+	EXPECT_EQ(transform.timestamp, decoded.timestamp);
+	ExpectMatricesEqual(transform, decoded);
+}
+
+TEST(InputProtocolTests, RejectsOtherMessages)
+{
+	CameraTransform decoded;
+	auto binary = InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO));
+
+	std::string truncated = binary.substr(0, binary.size() - 1);
+	ASSERT_FALSE(InputMessageCodec::Decode(truncated.data(), truncated.size(), &decoded));
+
+	std::string unknown_kind = binary;
+	unknown_kind[2] = 9;
+	ASSERT_FALSE(InputMessageCodec::Decode(unknown_kind.data(), unknown_kind.size(), &decoded));
+
+	std::string wrong_count = binary;
+	wrong_count[3] = 2;
+	ASSERT_FALSE(InputMessageCodec::Decode(wrong_count.data(), wrong_count.size(), &decoded));
+
+	for (std::string json : {
+		"",
+		"not json",
+		"{\"type\":\"stereo-rendering\",\"body\":\"1\"}",
+		"{\"type\":\"camera-transform-lookat\",\"body\":\"0,0,-1,0,0,0,0,1,0\"}",
+		"{\"type\":\"camera-transform-stereo\",\"body\":\"1,2,3\"}",
+		"{\"type\":\"camera-transform-stereo\"}",
+		"{\"type\":\"camera-transform-stereo\",\"body\":\"1,2,3" })
+	{
+		ASSERT_FALSE(InputMessageCodec::Decode(json.data(), json.size(), &decoded)) << json;
+	}
+
+	// a prediction must carry its timestamp
+	auto stereo = ClientJson(SampleTransform(CameraTransform::STEREO));
+	auto missing_timestamp = stereo.replace(stereo.find("camera-transform-stereo"), 23, "camera-transform-stereo-prediction");
+	ASSERT_FALSE(InputMessageCodec::Decode(missing_timestamp.data(), missing_timestamp.size(), &decoded));
+}
+
+TEST(InputProtocolTests, InputCodecBenchmark)
+{
+	const int kIterations = 20000;
+	auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+	auto binary = InputMessageCodec::Encode(transform);
+	auto json = ClientJson(transform);
+
+	// the body alone, as the samples copied it out of their parsed json
+	auto body_start = json.find("\"body\" : \"") + 10;
+	auto body = json.substr(body_start, json.find('"', body_start) - body_start);
+
+	CameraTransform decoded;
+	auto measure = [&](const char* name, size_t bytes, const std::function<bool()>& parse)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < kIterations; i++)
+		{
+			ASSERT_TRUE(parse());
+		}
+
+		auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		std::cout << "[ INPUT CODEC ] " << name << ": " << bytes << " bytes/msg, "
+			<< static_cast<double>(elapsed_us) / kIterations << " us/msg" << std::endl;
+	};
+
+	measure("binary", binary.size(), [&]() { return InputMessageCodec::Decode(binary.data(), binary.size(), &decoded); });
+	measure("json", json.size(), [&]() { return InputMessageCodec::Decode(json.data(), json.size(), &decoded); });
+	measure("legacy body", json.size(), [&]() { return LegacyParse(body, &decoded); });
+
+	ASSERT_LT(binary.size(), json.size());
+}
+
+TEST(InputProtocolTests, DispatchesByType)
+{
+	InputDispatcher dispatcher;
+	std::vector<std::string> received;
+
+	for (auto type : { "stereo-rendering", "camera-transform-lookat", "camera-transform-stereo" })
+	{
+		dispatcher.Register(type, [&](const InputMessage& message)
+		{
+			received.push_back(message.type.ToString() + "=" + message.body.ToString());
+		});
+	}
+
+	std::string rendering = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+	std::string lookat = "{ \"body\" : \"0,0,-1\", \"type\" : \"camera-transform-lookat\" }";
+	std::string unknown = "{\"type\":\"nobody-listens\",\"body\":\"\"}";
+
+	ASSERT_TRUE(dispatcher.Dispatch(7, rendering.data(), rendering.size()));
+	ASSERT_TRUE(dispatcher.Dispatch(7, lookat.data(), lookat.size()));
+	ASSERT_FALSE(dispatcher.Dispatch(7, unknown.data(), unknown.size()));
+	ASSERT_FALSE(dispatcher.Dispatch(7, "garbage", 7));
+
+	ASSERT_EQ(2u, received.size());
+	EXPECT_EQ("stereo-rendering=1", received[0]);
+	EXPECT_EQ("camera-transform-lookat=0,0,-1", received[1]);
+
+	auto stats = dispatcher.stats();
+	EXPECT_EQ(2u, stats.dispatched);
+	EXPECT_EQ(2u, stats.unhandled);
+}
+
+TEST(InputProtocolTests, DispatchesWithoutCopying)
+{
+	InputDispatcher dispatcher;
+	auto binary = InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO_PREDICTION));
+	auto json = InputMessageCodec::EncodeJson(SampleTransform(CameraTransform::STEREO));
+
+	InputMessage last;
+	auto handler = [&](const InputMessage& message) { last = message; };
+	dispatcher.Register(InputMessageCodec::TypeName(CameraTransform::STEREO), handler);
+	dispatcher.Register(InputMessageCodec::TypeName(CameraTransform::STEREO_PREDICTION), handler);
+
+	// binary transforms are typed by their kind, and the body is the whole record
+	ASSERT_TRUE(dispatcher.Dispatch(3, binary.data(), binary.size()));
+	EXPECT_EQ(3, last.peer_id);
+	EXPECT_TRUE(last.type.Equals("camera-transform-stereo-prediction"));
+	EXPECT_EQ(binary.data(), last.body.data);
+	EXPECT_EQ(binary.data(), last.data.data);
+	EXPECT_EQ(binary.size(), last.data.size);
+
+	ASSERT_TRUE(dispatcher.Dispatch(4, json.data(), json.size()));
+	EXPECT_TRUE(last.type.Equals("camera-transform-stereo"));
+	EXPECT_EQ(json.data(), last.data.data);
+	EXPECT_TRUE(last.body.data > json.data() && last.body.data + last.body.size < json.data() + json.size());
+
+	CameraTransform decoded;
+	ASSERT_TRUE(InputMessageCodec::Decode(last.data.data, last.data.size, &decoded));
+}
+
+TEST(InputProtocolTests, QueuedHandlersRunOnProcess)
+{
+	InputDispatcher dispatcher;
+	std::vector<std::string> bodies;
+	std::thread::id handler_thread;
+
+	dispatcher.Register("stereo-rendering", [&](const InputMessage& message)
+	{
+		bodies.push_back(message.body.ToString());
+		handler_thread = std::this_thread::get_id();
+	}, InputDispatcher::QUEUED);
+
+	// the network thread's buffer is gone by the time the handler runs
+	std::thread network([&]()
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			std::string message = "{\"type\":\"stereo-rendering\",\"body\":\"" + std::to_string(i) + "\"}";
+			ASSERT_TRUE(dispatcher.Dispatch(1, message.data(), message.size()));
+		}
+	});
+
+	network.join();
+	ASSERT_TRUE(bodies.empty());
+
+	ASSERT_EQ(3u, dispatcher.ProcessQueued());
+	ASSERT_EQ(3u, bodies.size());
+	EXPECT_EQ("0", bodies[0]);
+	EXPECT_EQ("2", bodies[2]);
+	EXPECT_EQ(std::this_thread::get_id(), handler_thread);
+
+	ASSERT_EQ(0u, dispatcher.ProcessQueued());
+	EXPECT_EQ(3u, dispatcher.stats().processed);
+}
+
+TEST(InputProtocolTests, ReregistersAndUnregisters)
+{
+	InputDispatcher dispatcher;
+	std::string calls;
+	std::string message = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+
+	dispatcher.Register("stereo-rendering", [&](const InputMessage&) { calls += "a"; }, InputDispatcher::QUEUED);
+	ASSERT_TRUE(dispatcher.Dispatch(1, message.data(), message.size()));
+
+	// a queued message keeps the handler it was queued for
+	dispatcher.Register("stereo-rendering", [&](const InputMessage&) { calls += "b"; });
+	ASSERT_EQ(1u, dispatcher.size());
+	ASSERT_TRUE(dispatcher.Dispatch(1, message.data(), message.size()));
+	dispatcher.ProcessQueued();
+	EXPECT_EQ("ba", calls);
+
+	dispatcher.Unregister("stereo-rendering");
+	ASSERT_EQ(0u, dispatcher.size());
+	ASSERT_FALSE(dispatcher.Dispatch(1, message.data(), message.size()));
+}
+
+TEST(InputProtocolTests, DispatchesManyTypes)
+{
+	InputDispatcher dispatcher;
+	std::vector<int> hits(500, 0);
+
+	for (int i = 0; i < 500; i++)
+	{
+		dispatcher.Register("type-" + std::to_string(i), [&hits, i](const InputMessage&) { hits[i]++; });
+	}
+
+	for (int i = 0; i < 500; i++)
+	{
+		auto message = "{\"type\":\"type-" + std::to_string(i) + "\",\"body\":\"\"}";
+		ASSERT_TRUE(dispatcher.Dispatch(1, message.data(), message.size()));
+	}
+
+	std::string near_miss = "{\"type\":\"type-500\",\"body\":\"\"}";
+	ASSERT_FALSE(dispatcher.Dispatch(1, near_miss.data(), near_miss.size()));
+
+	for (int i = 0; i < 500; i++)
+	{
+		ASSERT_EQ(1, hits[i]) << i;
+	}
+}
+
+TEST(InputProtocolTests, DispatchBenchmark)
+{
+	const int kIterations = 200000;
+	const char* kTypes[] =
+	{
+		"stereo-rendering", "camera-transform-lookat", "camera-transform-stereo",
+		"camera-transform-stereo-prediction", "keyboard-event", "mouse-event", "touch-event", "gamepad-event"
+	};
+
+	std::vector<std::string> messages;
+	for (auto type : kTypes)
+	{
+		messages.push_back(std::string("{\"type\":\"") + type + "\",\"body\":\"1,2,3\"}");
+	}
+
+	messages.push_back(InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO_PREDICTION)));
+
+	size_t handled = 0;
+	InputDispatcher dispatcher;
+	for (auto type : kTypes)
+	{
+		dispatcher.Register(type, [&](const InputMessage& message) { handled += message.body.size; });
+	}
+
+	// what the samples did: a strcmp chain over a copied type
+	auto legacy = [&](const std::string& type, const std::string& body)
+	{
+		char copied[256];
+		strcpy(copied, type.c_str());
+		for (auto candidate : kTypes)
+		{
+			if (strcmp(copied, candidate) == 0)
+			{
+				handled += body.size();
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kIterations; i++)
+	{
+		auto& message = messages[i % messages.size()];
+		ASSERT_TRUE(dispatcher.Dispatch(1, message.data(), message.size()));
+	}
+
+	auto dispatch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kIterations; i++)
+	{
+		auto& message = messages[i % messages.size()];
+		InputSpan type;
+		InputSpan body;
+		ASSERT_TRUE(InputMessageCodec::DecodeEnvelope(message.data(), message.size(), &type, &body));
+		ASSERT_TRUE(legacy(type.ToString(), body.ToString()));
+	}
+
+	auto legacy_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "[ INPUT DISPATCH ] dispatcher: " << static_cast<double>(dispatch_ns) / kIterations << " ns/msg, "
+		<< "strcmp chain: " << static_cast<double>(legacy_ns) / kIterations << " ns/msg" << std::endl;
+
+	ASSERT_GT(handled, 0u);
+}
+
+namespace
+{
+	/// <summary>
+	/// A pose whose every field is derived from |value|, so a torn read can't go unnoticed
+	/// </summary>
+	CameraTransform StampedPose(uint32_t value)
+	{
+		CameraTransform transform;
+		transform.kind = CameraTransform::STEREO_PREDICTION;
+		transform.sequence = value;
+		transform.timestamp = static_cast<int64_t>(value) * 3;
+
+		for (auto matrix : { transform.projection_left, transform.view_left, transform.projection_right, transform.view_right })
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				matrix[i] = static_cast<float>(value % 1000000 + i);
+			}
+		}
+
+		return transform;
+	}
+
+	bool IsIntact(const CameraTransform& transform)
+	{
+		if (transform.timestamp != static_cast<int64_t>(transform.sequence) * 3)
+		{
+			return false;
+		}
+
+		auto expected = StampedPose(transform.sequence);
+		return memcmp(expected.projection_left, transform.projection_left, 4 * sizeof(transform.projection_left)) == 0;
+	}
+}
+
+TEST(InputProtocolTests, MailboxKeepsTheNewestValue)
+{
+	PoseMailbox mailbox;
+	CameraTransform pose;
+
+	ASSERT_FALSE(mailbox.Consume(&pose));
+
+	mailbox.Publish(StampedPose(1));
+	mailbox.Publish(StampedPose(2));
+	mailbox.Publish(StampedPose(3));
+
+	ASSERT_TRUE(mailbox.Consume(&pose));
+	EXPECT_EQ(3u, pose.sequence);
+	ASSERT_FALSE(mailbox.Consume(&pose));
+
+	mailbox.Publish(StampedPose(4));
+	ASSERT_TRUE(mailbox.Consume(&pose));
+	EXPECT_EQ(4u, pose.sequence);
+
+	auto stats = mailbox.stats();
+	EXPECT_EQ(4u, stats.published);
+	EXPECT_EQ(2u, stats.consumed);
+	EXPECT_EQ(2u, stats.dropped);
+}
+
+TEST(InputProtocolTests, MailboxStress)
+{
+	const uint32_t kPublishes = 1000000;
+	const uint32_t kBurst = 1000;
+	PoseMailbox mailbox;
+	std::atomic_bool done(false);
+	std::atomic<uint32_t> seen(0);
+	std::atomic_bool stalled(false);
+
+	// publishes in bursts, waiting for each burst's newest pose to get through before the next, so the
+	// consumer makes progress alongside the publisher however few cpus there are to share
+	std::thread network([&]()
+	{
+		for (uint32_t i = 1; i <= kPublishes; i++)
+		{
+			mailbox.Publish(StampedPose(i));
+
+			if (i % kBurst == 0)
+			{
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+				while (seen.load() < i && !stalled.load())
+				{
+					stalled.store(std::chrono::steady_clock::now() > deadline);
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		done.store(true);
+	});
+
+	uint32_t last = 0;
+	uint64_t torn = 0;
+	uint64_t backwards = 0;
+	CameraTransform pose;
+
+	auto consume = [&]()
+	{
+		while (mailbox.Consume(&pose))
+		{
+			torn += IsIntact(pose) ? 0 : 1;
+			backwards += pose.sequence > last ? 0 : 1;
+			last = pose.sequence;
+			seen.store(last);
+		}
+	};
+
+	while (!done.load())
+	{
+		consume();
+	}
+
+	network.join();
+	consume();
+
+	auto stats = mailbox.stats();
+	std::cout << "[ POSE MAILBOX ] published " << stats.published << ", consumed " << stats.consumed
+		<< ", dropped " << stats.dropped << std::endl;
+
+	ASSERT_FALSE(stalled.load());
+	ASSERT_EQ(0u, torn);
+	ASSERT_EQ(0u, backwards);
+	ASSERT_EQ(kPublishes, last);
+	ASSERT_GE(stats.consumed, kPublishes / kBurst);
+	ASSERT_EQ(stats.published, stats.consumed + stats.dropped);
+}
+
+TEST(InputProtocolTests, MailboxStressWithSeveralPublishers)
+{
+	const uint32_t kPublishesPerThread = 200000;
+	PoseMailbox mailbox;
+	std::atomic_int running(4);
+	std::vector<std::thread> publishers;
+
+	for (uint32_t t = 0; t < 4; t++)
+	{
+		publishers.push_back(std::thread([&, t]()
+		{
+			for (uint32_t i = 1; i <= kPublishesPerThread; i++)
+			{
+				mailbox.Publish(StampedPose(t * kPublishesPerThread + i));
+			}
+
+			running--;
+		}));
+	}
+
+	uint64_t torn = 0;
+	CameraTransform pose;
+	do
+	{
+		while (mailbox.Consume(&pose))
+		{
+			torn += IsIntact(pose) ? 0 : 1;
+		}
+	} while (running.load() > 0);
+
+	for (auto& publisher : publishers)
+	{
+		publisher.join();
+	}
+
+	mailbox.Consume(&pose);
+
+	auto stats = mailbox.stats();
+	ASSERT_EQ(0u, torn);
+	ASSERT_EQ(4 * kPublishesPerThread, stats.published);
+	ASSERT_EQ(stats.published, stats.consumed + stats.dropped);
+}
+
+namespace
+{
+	/// <summary>
+	/// A head pose: a camera position and a yaw and pitch, in radians
+	/// </summary>
+	struct HeadPose
+	{
+		double position[3];
+		double yaw;
+		double pitch;
+	};
+
+	/// <summary>
+	/// Builds the camera transform a stereo client sends for |pose|, with eyes 64mm apart
+	/// </summary>
+	CameraTransform ToTransform(const HeadPose& pose, int64_t timestamp)
+	{
+		// the camera's rotation in the world, then its view as the inverse
+		double cy = cos(pose.yaw), sy = sin(pose.yaw), cp = cos(pose.pitch), sp = sin(pose.pitch);
+		double rotation[3][3] =
+		{
+			{ cy, sy * sp, sy * cp },
+			{ 0, cp, -sp },
+			{ -sy, cy * sp, cy * cp }
+		};
+
+		CameraTransform transform;
+		transform.kind = CameraTransform::STEREO_PREDICTION;
+		transform.timestamp = timestamp;
+
+		for (int eye = 0; eye < 2; eye++)
+		{
+			auto view = eye == 0 ? transform.view_left : transform.view_right;
+			auto projection = eye == 0 ? transform.projection_left : transform.projection_right;
+			double offset = eye == 0 ? -0.032 : 0.032;
+
+			double position[3];
+			for (int j = 0; j < 3; j++)
+			{
+				position[j] = pose.position[j] + offset * rotation[0][j];
+			}
+
+			for (int i = 0; i < 3; i++)
+			{
+				double translation = 0;
+				for (int j = 0; j < 3; j++)
+				{
+					view[i * 4 + j] = static_cast<float>(rotation[j][i]);
+					translation -= position[j] * rotation[i][j];
+				}
+
+				view[12 + i] = static_cast<float>(translation);
+			}
+
+			view[15] = 1;
+			projection[0] = projection[5] = 1.5f;
+			projection[10] = projection[14] = 1.0f;
+			projection[11] = -0.1f;
+		}
+
+		return transform;
+	}
+
+	/// <summary>
+	/// The angle between the rotations of two views in degrees, and the distance between their
+	/// cameras in millimetres
+	/// </summary>
+	void ViewError(const float* expected, const float* actual, double* degrees, double* millimetres)
+	{
+		double trace = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				trace += static_cast<double>(expected[i * 4 + j]) * actual[i * 4 + j];
+			}
+		}
+
+		double cosine = (trace - 1) / 2;
+		*degrees = acos(cosine > 1 ? 1 : cosine < -1 ? -1 : cosine) * 180 / 3.14159265358979;
+
+		double distance = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			double expected_position = 0;
+			double actual_position = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				expected_position -= static_cast<double>(expected[12 + k]) * expected[j * 4 + k];
+				actual_position -= static_cast<double>(actual[12 + k]) * actual[j * 4 + k];
+			}
+
+			distance += (expected_position - actual_position) * (expected_position - actual_position);
+		}
+
+		*millimetres = sqrt(distance) * 1000;
+	}
+
+	/// <summary>
+	/// A deterministic head trace: looking around and swaying while walking slowly forward
+	/// </summary>
+	HeadPose TracePose(double seconds)
+	{
+		const double kTwoPi = 6.28318530717959;
+		HeadPose pose;
+		pose.yaw = 0.6 * sin(kTwoPi * 0.5 * seconds);
+		pose.pitch = 0.2 * sin(kTwoPi * 0.3 * seconds);
+		pose.position[0] = 0.05 * sin(kTwoPi * 0.4 * seconds);
+		pose.position[1] = 1.7 + 0.01 * sin(kTwoPi * 1.8 * seconds);
+		pose.position[2] = 0.3 * seconds;
+		return pose;
+	}
+}
+
+TEST(InputProtocolTests, PredictorExtrapolatesConstantVelocity)
+{
+	PosePredictor predictor;
+	HeadPose pose = {};
+
+	// turning at a steady rate about a single axis, while looking slightly down
+	pose.pitch = -0.1;
+	for (int i = 0; i <= 5; i++)
+	{
+		pose.yaw = 0.02 * i;
+		pose.position[0] = 0.001 * i;
+		pose.position[2] = 0.003 * i;
+		predictor.Add(ToTransform(pose, 1000 + i * 100), i * 10);
+	}
+
+	// 50ms on from the newest is another five steps
+	pose.yaw = 0.2;
+	pose.position[0] = 0.01;
+	pose.position[2] = 0.03;
+	auto expected = ToTransform(pose, 2000);
+
+	CameraTransform predicted;
+	ASSERT_TRUE(predictor.Predict(100, &predicted));
+	EXPECT_EQ(1500, predicted.timestamp);
+
+	// each eye swings on an arc as the head turns, which linear extrapolation cuts across by a
+	// fraction of a millimetre
+	double degrees = 0;
+	double millimetres = 0;
+	ViewError(expected.view_left, predicted.view_left, &degrees, &millimetres);
+	EXPECT_LT(degrees, 0.01);
+	EXPECT_LT(millimetres, 0.5);
+
+	ViewError(expected.view_right, predicted.view_right, &degrees, &millimetres);
+	EXPECT_LT(degrees, 0.01);
+	EXPECT_LT(millimetres, 0.5);
+
+	EXPECT_EQ(0, memcmp(expected.projection_left, predicted.projection_left, sizeof(predicted.projection_left)));
+}
+
+TEST(InputProtocolTests, PredictorHoldsAndGivesUp)
+{
+	PosePredictor predictor;
+	CameraTransform predicted;
+	ASSERT_FALSE(predictor.Predict(0, &predicted));
+	ASSERT_EQ(-1, predictor.LastReceived());
+
+	auto only = ToTransform(TracePose(0), 77);
+	predictor.Add(only, 1000);
+	ASSERT_EQ(1000, predictor.LastReceived());
+
+	// with nothing to measure velocity from, the newest pose holds
+	ASSERT_TRUE(predictor.Predict(1050, &predicted));
+	EXPECT_EQ(77, predicted.timestamp);
+	EXPECT_EQ(0, memcmp(only.view_left, predicted.view_left, sizeof(only.view_left)));
+
+	// late arrivals are ignored rather than bending the history backwards
+	predictor.Add(ToTransform(TracePose(1), 1), 900);
+	ASSERT_TRUE(predictor.Predict(1050, &predicted));
+	EXPECT_EQ(77, predicted.timestamp);
+
+	ASSERT_TRUE(predictor.Predict(1200, &predicted));
+	ASSERT_FALSE(predictor.Predict(1201, &predicted));
+
+	predictor.Reset();
+	ASSERT_FALSE(predictor.Predict(1000, &predicted));
+}
+
+TEST(InputProtocolTests, PredictorErrorByLatency)
+{
+	// a 90Hz client, with its packets arriving up to 3ms late
+	const double kIntervalMs = 1000.0 / 90;
+	const int kSamples = 900;
+	std::mt19937 random(42);
+
+	std::cout << "[ POSE PREDICTOR ] latency, hold error, predicted error (mean deg / mm)" << std::endl;
+
+	for (int latency : { 11, 22, 33, 50, 100 })
+	{
+		PosePredictor predictor;
+		double hold_degrees = 0, hold_millimetres = 0;
+		double predicted_degrees = 0, predicted_millimetres = 0;
+		int count = 0;
+
+		for (int i = 0; i < kSamples; i++)
+		{
+			auto sent_ms = i * kIntervalMs;
+			auto received_ms = static_cast<int64_t>(sent_ms) + 20 + static_cast<int64_t>(random() % 4);
+			auto transform = ToTransform(TracePose(sent_ms / 1000), i);
+			predictor.Add(transform, received_ms);
+
+			if (i < 10)
+			{
+				continue;
+			}
+
+			auto expected = ToTransform(TracePose((sent_ms + latency) / 1000), 0);
+			CameraTransform predicted;
+			ASSERT_TRUE(predictor.Predict(received_ms + latency, &predicted));
+
+			double degrees = 0;
+			double millimetres = 0;
+			ViewError(expected.view_left, transform.view_left, &degrees, &millimetres);
+			hold_degrees += degrees;
+			hold_millimetres += millimetres;
+
+			ViewError(expected.view_left, predicted.view_left, &degrees, &millimetres);
+			predicted_degrees += degrees;
+			predicted_millimetres += millimetres;
+			count++;
+		}
+
+		std::cout << "[ POSE PREDICTOR ] " << latency << "ms, "
+			<< hold_degrees / count << " / " << hold_millimetres / count << ", "
+			<< predicted_degrees / count << " / " << predicted_millimetres / count << std::endl;
+
+		EXPECT_LT(predicted_degrees, hold_degrees / 2) << latency;
+		EXPECT_LT(predicted_millimetres, hold_millimetres / 2) << latency;
+	}
+}
+
+namespace
+{
+	std::string LookAt(int sequence)
+	{
+		return "{\"type\":\"camera-transform-lookat\",\"body\":\"" + std::to_string(sequence) + ",0,-1\"}";
+	}
+
+	int LookAtSequence(const char* data, size_t size)
+	{
+		InputSpan type;
+		InputSpan body;
+		InputMessageCodec::DecodeEnvelope(data, size, &type, &body);
+		return atoi(body.ToString().c_str());
+	}
+}
+
+TEST(InputProtocolTests, CoalescesBurstsToTheNewest)
+{
+	InputCoalescer coalescer;
+	coalescer.Coalesce("camera-transform-lookat");
+	coalescer.Coalesce("camera-transform-stereo");
+
+	// a burst from two peers, with control messages in between
+	std::string rendering = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+	for (int i = 0; i < 10; i++)
+	{
+		ASSERT_TRUE(coalescer.Push(1, LookAt(i).data(), LookAt(i).size()));
+		if (i < 5)
+		{
+			ASSERT_TRUE(coalescer.Push(2, LookAt(100 + i).data(), LookAt(100 + i).size()));
+		}
+
+		ASSERT_FALSE(coalescer.Push(1, rendering.data(), rendering.size()));
+	}
+
+	auto transform = InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO));
+	ASSERT_TRUE(coalescer.Push(2, transform.data(), transform.size()));
+	ASSERT_FALSE(coalescer.Push(2, "garbage", 7));
+
+	std::vector<std::pair<int, std::string>> delivered;
+	auto deliver = [&](int peer_id, const char* data, size_t size)
+	{
+		delivered.push_back(std::make_pair(peer_id, std::string(data, size)));
+	};
+
+	ASSERT_EQ(3u, coalescer.Drain(0, deliver));
+	ASSERT_EQ(3u, delivered.size());
+
+	// in the order each peer's burst began
+	EXPECT_EQ(1, delivered[0].first);
+	EXPECT_EQ(LookAt(9), delivered[0].second);
+	EXPECT_EQ(2, delivered[1].first);
+	EXPECT_EQ(LookAt(104), delivered[1].second);
+	EXPECT_EQ(2, delivered[2].first);
+	EXPECT_EQ(transform, delivered[2].second);
+
+	ASSERT_EQ(0u, coalescer.Drain(0, deliver));
+	ASSERT_EQ(-1, coalescer.NextDue());
+
+	auto stats = coalescer.stats();
+	EXPECT_EQ(16u, stats.received);
+	EXPECT_EQ(3u, stats.delivered);
+	EXPECT_EQ(13u, stats.superseded);
+}
+
+TEST(InputProtocolTests, CoalescerRateLimits)
+{
+	InputCoalescer coalescer;
+	coalescer.Coalesce("camera-transform-lookat", 10);
+
+	int newest = -1;
+	auto deliver = [&](int peer_id, const char* data, size_t size)
+	{
+		newest = LookAtSequence(data, size);
+	};
+
+	// the first message goes straight through
+	coalescer.Push(1, LookAt(0).data(), LookAt(0).size());
+	ASSERT_EQ(0, coalescer.NextDue());
+	ASSERT_EQ(1u, coalescer.Drain(100, deliver));
+	ASSERT_EQ(0, newest);
+
+	// the next ones wait for the interval, and only the newest is delivered
+	for (int i = 1; i <= 3; i++)
+	{
+		coalescer.Push(1, LookAt(i).data(), LookAt(i).size());
+		ASSERT_EQ(0u, coalescer.Drain(100 + i, deliver));
+	}
+
+	ASSERT_EQ(110, coalescer.NextDue());
+	ASSERT_EQ(1u, coalescer.Drain(110, deliver));
+	ASSERT_EQ(3, newest);
+
+	// gone peers are forgotten
+	coalescer.Push(1, LookAt(4).data(), LookAt(4).size());
+	coalescer.Push(2, LookAt(5).data(), LookAt(5).size());
+	coalescer.RemovePeer(1);
+	ASSERT_EQ(1u, coalescer.Drain(200, deliver));
+	ASSERT_EQ(5, newest);
+	ASSERT_EQ(-1, coalescer.NextDue());
+
+	auto stats = coalescer.stats();
+	EXPECT_EQ(6u, stats.received);
+	EXPECT_EQ(3u, stats.delivered);
+	EXPECT_EQ(2u, stats.superseded);
+}
+
+TEST(InputProtocolTests, CoalescerStress)
+{
+	// a network thread pushing as fast as it can, while a render loop drains
+	const int kMessages = 200000;
+	InputCoalescer coalescer;
+	coalescer.Coalesce("camera-transform-lookat");
+
+	std::vector<std::string> messages;
+	for (int i = 0; i < kMessages; i++)
+	{
+		messages.push_back(LookAt(i));
+	}
+
+	std::atomic<bool> done(false);
+	std::thread network([&]()
+	{
+		for (const auto& message : messages)
+		{
+			coalescer.Push(3, message.data(), message.size());
+		}
+
+		done = true;
+	});
+
+	int newest = -1;
+	bool ordered = true;
+	auto deliver = [&](int peer_id, const char* data, size_t size)
+	{
+		auto sequence = LookAtSequence(data, size);
+		ordered = ordered && peer_id == 3 && sequence > newest;
+		newest = sequence;
+	};
+
+	while (!done)
+	{
+		coalescer.Drain(0, deliver);
+	}
+
+	coalescer.Drain(0, deliver);
+	network.join();
+
+	ASSERT_TRUE(ordered);
+	ASSERT_EQ(kMessages - 1, newest);
+
+	auto stats = coalescer.stats();
+	EXPECT_EQ(static_cast<uint64_t>(kMessages), stats.received);
+	EXPECT_EQ(stats.received, stats.delivered + stats.superseded);
+
+	std::cout << "[ COALESCER ] delivered " << stats.delivered << " of " << stats.received << std::endl;
+}
+
+TEST(InputProtocolTests, CorrelatesFramesByTimestamp)
+{
+	// 60Hz frames, in 100ns ticks, remembered for up to half a second
+	const int64_t kFrame = 166667;
+	FrameCorrelator<int> correlator(64, kFrame * 30);
+	ASSERT_EQ(64u, correlator.capacity());
+
+	for (int i = 1; i <= 10; i++)
+	{
+		correlator.Insert(i * kFrame, i);
+	}
+
+	int frame = 0;
+	ASSERT_TRUE(correlator.Take(3 * kFrame, &frame));
+	ASSERT_EQ(3, frame);
+	ASSERT_FALSE(correlator.Take(3 * kFrame, &frame));
+	ASSERT_FALSE(correlator.Take(3 * kFrame + 1, &frame));
+
+	// frames 1 and 2 were skipped, and are only dropped once they're too old
+	ASSERT_TRUE(correlator.Take(5 * kFrame, &frame));
+	ASSERT_TRUE(correlator.Take(4 * kFrame, &frame));
+	ASSERT_EQ(4, frame);
+	ASSERT_EQ(10u, correlator.size());
+
+	correlator.Insert(32 * kFrame, 32);
+	ASSERT_FALSE(correlator.Take(1 * kFrame, &frame));
+	ASSERT_TRUE(correlator.Take(2 * kFrame, &frame));
+	ASSERT_EQ(2, frame);
+
+	auto stats = correlator.stats();
+	EXPECT_EQ(11u, stats.inserted);
+	EXPECT_EQ(4u, stats.matched);
+	EXPECT_EQ(2u, stats.late);
+	EXPECT_EQ(3u, stats.missed);
+	EXPECT_EQ(1u, stats.evicted);
+}
+
+TEST(InputProtocolTests, CorrelatesPredictedFrames)
+{
+	// a client at 60Hz, in 100ns ticks, and the server that renders for it, in ms
+	const int64_t kFrame = 166667;
+	FrameCorrelator<int> client(64, kFrame * 30);
+	PosePredictor server;
+	std::vector<int> presented;
+
+	auto render = [&](const CameraTransform& transform)
+	{
+		int frame = 0;
+		if (client.TakeNearest(transform.timestamp, &frame))
+		{
+			presented.push_back(frame);
+		}
+	};
+
+	for (int i = 1; i <= 6; i++)
+	{
+		auto sent = ToTransform(TracePose(i / 60.0), i * kFrame);
+		client.Insert(sent.timestamp, i);
+
+		// the poses for frames 4 and 5 are late, so the server renders from a prediction instead
+		int64_t now_ms = i * 1000 / 60;
+		CameraTransform transform;
+		if (i == 4 || i == 5)
+		{
+			ASSERT_TRUE(server.Predict(now_ms, &transform));
+			EXPECT_EQ(3 * kFrame, transform.timestamp);
+
+			// and close to the pose that was late
+			double degrees = 0;
+			double millimetres = 0;
+			ViewError(sent.view_left, transform.view_left, &degrees, &millimetres);
+			EXPECT_LT(degrees, 0.5);
+			EXPECT_LT(millimetres, 1.0);
+		}
+		else
+		{
+			server.Add(sent, now_ms);
+			transform = sent;
+		}
+
+		render(transform);
+	}
+
+	// every frame is presented once, the predicted ones in place of the frames whose poses were late
+	ASSERT_EQ(std::vector<int>({ 1, 2, 3, 4, 5, 6 }), presented);
+
+	auto stats = client.stats();
+	EXPECT_EQ(6u, stats.matched);
+	EXPECT_EQ(2u, stats.substituted);
+	EXPECT_EQ(0u, stats.missed);
+	EXPECT_EQ(0u, stats.late);
+}
+
+TEST(InputProtocolTests, CorrelatorStaysBounded)
+{
+	// a client that sends far more poses than the server renders, so most frames never match
+	const int64_t kFrame = 166667;
+	FrameCorrelator<std::shared_ptr<int>> correlator(32, kFrame * 1000);
+	std::mt19937 random(7);
+	std::vector<std::weak_ptr<int>> frames;
+	int matched = 0;
+
+	for (int i = 0; i < 100000; i++)
+	{
+		std::shared_ptr<int> frame(new int(i));
+		frames.push_back(frame);
+		correlator.Insert(i * kFrame, frame);
+		ASSERT_LE(correlator.size(), 32u);
+
+		// the server renders a recent pose every so often
+		if (random() % 4 == 0)
+		{
+			auto rendered = i - static_cast<int>(random() % 8);
+			std::shared_ptr<int> found;
+			if (correlator.Take(rendered * kFrame, &found))
+			{
+				ASSERT_EQ(rendered, *found);
+				matched++;
+			}
+		}
+	}
+
+	// evicted and matched frames aren't kept alive
+	size_t alive = 0;
+	for (const auto& frame : frames)
+	{
+		alive += frame.expired() ? 0 : 1;
+	}
+
+	ASSERT_LE(alive, 32u);
+
+	auto stats = correlator.stats();
+	EXPECT_EQ(100000u, stats.inserted);
+	EXPECT_EQ(static_cast<uint64_t>(matched), stats.matched);
+	EXPECT_EQ(stats.inserted, stats.matched + stats.evicted + alive);
+	EXPECT_GT(matched, 20000);
+}
+
+namespace
+{
+	int64_t NowUs()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/// <summary>
+	/// A blocking queue, standing in for the network between the loopback client and server
+	/// </summary>
+	class LoopbackLink
+	{
+	public:
+		LoopbackLink() : closed_(false) {}
+
+		void Send(const std::string& packet)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			packets_.push_back(packet);
+			ready_.notify_one();
+		}
+
+		// Waits up to |timeout_us| for a packet, returning false if there wasn't one
+		bool Receive(std::string* packet, int64_t timeout_us)
+		{
+			std::unique_lock<std::mutex> lock(lock_);
+			ready_.wait_for(lock, std::chrono::microseconds(timeout_us), [this]() { return closed_ || !packets_.empty(); });
+			if (packets_.empty())
+			{
+				return false;
+			}
+
+			packet->swap(packets_.front());
+			packets_.pop_front();
+			return true;
+		}
+
+		bool IsDone()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return closed_ && packets_.empty();
+		}
+
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			closed_ = true;
+			ready_.notify_all();
+		}
+
+	private:
+		std::mutex lock_;
+		std::condition_variable ready_;
+		std::deque<std::string> packets_;
+		bool closed_;
+	};
+
+	/// <summary>
+	/// A software stand in for the encoder: run length coded pixels, after the frame's
+	/// prediction timestamp
+	/// </summary>
+	std::string EncodeFrame(const std::vector<uint32_t>& pixels, int64_t prediction_timestamp)
+	{
+		std::string encoded(reinterpret_cast<const char*>(&prediction_timestamp), sizeof(prediction_timestamp));
+		for (size_t i = 0; i < pixels.size();)
+		{
+			uint32_t run = 1;
+			while (i + run < pixels.size() && pixels[i + run] == pixels[i] && run < 0xFFFF)
+			{
+				run++;
+			}
+
+			encoded.append(reinterpret_cast<const char*>(&run), sizeof(run));
+			encoded.append(reinterpret_cast<const char*>(&pixels[i]), sizeof(pixels[i]));
+			i += run;
+		}
+
+		return encoded;
+	}
+
+	std::vector<uint32_t> DecodeFrame(const std::string& encoded, int64_t* prediction_timestamp)
+	{
+		memcpy(prediction_timestamp, encoded.data(), sizeof(*prediction_timestamp));
+
+		std::vector<uint32_t> pixels;
+		for (size_t i = sizeof(*prediction_timestamp); i + 8 <= encoded.size(); i += 8)
+		{
+			uint32_t run;
+			uint32_t pixel;
+			memcpy(&run, encoded.data() + i, sizeof(run));
+			memcpy(&pixel, encoded.data() + i + 4, sizeof(pixel));
+			pixels.insert(pixels.end(), run, pixel);
+		}
+
+		return pixels;
+	}
+
+	/// <summary>
+	/// A synthetic frame: horizontal bands whose colours depend on the pose being rendered
+	/// </summary>
+	std::vector<uint32_t> RenderFrame(uint32_t sequence, int width, int height)
+	{
+		std::vector<uint32_t> pixels(width * height);
+		for (int y = 0; y < height; y++)
+		{
+			auto colour = 0xFF000000u | ((sequence * 2654435761u) >> (y / 8 % 8));
+			std::fill(pixels.begin() + y * width, pixels.begin() + (y + 1) * width, colour);
+		}
+
+		return pixels;
+	}
+}
+
+TEST(InputProtocolTests, LatencyHistogramPercentiles)
+{
+	LatencyHistogram histogram;
+	ASSERT_EQ(0, histogram.Percentile(50));
+
+	for (int i = 1; i <= 10000; i++)
+	{
+		histogram.Add(i);
+	}
+
+	EXPECT_EQ(10000u, histogram.count());
+	EXPECT_EQ(1, histogram.min());
+	EXPECT_EQ(10000, histogram.max());
+	EXPECT_DOUBLE_EQ(5000.5, histogram.mean());
+	EXPECT_NEAR(5000, histogram.Percentile(50), 5000 * 0.07);
+	EXPECT_NEAR(9000, histogram.Percentile(90), 9000 * 0.07);
+	EXPECT_NEAR(9900, histogram.Percentile(99), 9900 * 0.07);
+	EXPECT_NEAR(10000, histogram.Percentile(100), 10000 * 0.07);
+
+	// small values are exact
+	histogram.Reset();
+	for (int i = 0; i < 10; i++)
+	{
+		histogram.Add(i < 9 ? 3 : 20);
+	}
+
+	EXPECT_EQ(3, histogram.Percentile(50));
+	EXPECT_EQ(20, histogram.Percentile(100));
+}
+
+TEST(InputProtocolTests, LatencyRecorderFollowsInputs)
+{
+	LatencyRecorder recorder(4);
+
+	// an input that makes it all the way
+	int64_t times[] = { 1000, 3000, 3500, 8500, 10500, 11000 };
+	for (int stage = 0; stage < LatencyRecorder::STAGE_COUNT; stage++)
+	{
+		recorder.Record(1, static_cast<LatencyRecorder::Stage>(stage), times[stage]);
+	}
+
+	// and one the server coalesced away, which is forgotten once its slot is reused
+	recorder.Record(2, LatencyRecorder::INPUT_SENT, 2000);
+	recorder.Record(2, LatencyRecorder::SERVER_RECEIVED, 3000);
+	ASSERT_EQ(1u, recorder.incomplete());
+
+	recorder.Record(6, LatencyRecorder::INPUT_SENT, 4000);
+	recorder.Record(6, LatencyRecorder::PRESENTED, 9000);
+
+	ASSERT_EQ(2u, recorder.completed());
+	ASSERT_EQ(1u, recorder.incomplete());
+
+	EXPECT_EQ(2000, recorder.Segment(LatencyRecorder::SERVER_RECEIVED).max());
+	EXPECT_EQ(5000, recorder.Segment(LatencyRecorder::ENCODE_DONE).max());
+
+	// the stages 6 skipped are folded into its last segment
+	auto presented = recorder.Segment(LatencyRecorder::PRESENTED);
+	EXPECT_EQ(2u, presented.count());
+	EXPECT_EQ(500, presented.min());
+	EXPECT_EQ(5000, presented.max());
+
+	auto motionToPhoton = recorder.MotionToPhoton();
+	EXPECT_EQ(5000, motionToPhoton.min());
+	EXPECT_EQ(10000, motionToPhoton.max());
+}
+
+TEST(InputProtocolTests, LatencyRecorderPlacesServerStages)
+{
+	LatencyRecorder recorder(4);
+
+	// sent at 1ms and decoded at 31ms, and the server took 10ms from receiving it to encoding it,
+	// so the remaining 20ms are split evenly between the network each way
+	recorder.Record(1, LatencyRecorder::INPUT_SENT, 1000);
+	recorder.RecordServer(1, 4000, 10000);
+	recorder.Record(1, LatencyRecorder::CLIENT_DECODED, 31000);
+	recorder.Record(1, LatencyRecorder::PRESENTED, 32000);
+
+	EXPECT_EQ(10000, recorder.Segment(LatencyRecorder::SERVER_RECEIVED).max());
+	EXPECT_EQ(4000, recorder.Segment(LatencyRecorder::RENDER_STARTED).max());
+	EXPECT_EQ(6000, recorder.Segment(LatencyRecorder::ENCODE_DONE).max());
+	EXPECT_EQ(10000, recorder.Segment(LatencyRecorder::CLIENT_DECODED).max());
+	EXPECT_EQ(31000, recorder.MotionToPhoton().max());
+
+	// stages recorded on the client's clock aren't mixed with the server's
+	recorder.Record(2, LatencyRecorder::INPUT_SENT, 1000);
+	recorder.Record(2, LatencyRecorder::SERVER_RECEIVED, 2000);
+	recorder.RecordServer(2, 4000, 10000);
+	recorder.Record(2, LatencyRecorder::CLIENT_DECODED, 31000);
+	recorder.Record(2, LatencyRecorder::PRESENTED, 32000);
+	EXPECT_EQ(1000, recorder.Segment(LatencyRecorder::SERVER_RECEIVED).min());
+	EXPECT_EQ(1u, recorder.Segment(LatencyRecorder::ENCODE_DONE).count());
+	EXPECT_EQ(29000, recorder.Segment(LatencyRecorder::CLIENT_DECODED).max());
+}
+
+TEST(InputProtocolTests, LatencyReportRoundTrip)
+{
+	ServerLatency latency;
+	latency.sequence = 77;
+	latency.timestamp = 131567894561234567LL;
+	latency.render_us = 1500;
+	latency.encode_us = 9000;
+
+	auto encoded = LatencyReport::Encode(latency);
+	ASSERT_EQ(LatencyReport::kSize, encoded.size());
+	ASSERT_TRUE(LatencyReport::IsLatencyReport(encoded.data(), encoded.size()));
+	ASSERT_FALSE(FrameMetadata::IsFrameMetadata(encoded.data(), encoded.size()));
+
+	// older peers see a binary message that isn't input
+	InputSpan type;
+	InputSpan body;
+	ASSERT_FALSE(InputMessageCodec::DecodeEnvelope(encoded.data(), encoded.size(), &type, &body));
+	ASSERT_EQ(InputChannels::RELIABLE, InputChannels::Classify(encoded.data(), encoded.size()));
+
+	ServerLatency decoded;
+	ASSERT_TRUE(LatencyReport::Decode(encoded.data(), encoded.size(), &decoded));
+	EXPECT_EQ(77u, decoded.sequence);
+	EXPECT_EQ(latency.timestamp, decoded.timestamp);
+	EXPECT_EQ(1500, decoded.render_us);
+	EXPECT_EQ(9000, decoded.encode_us);
+
+	ASSERT_FALSE(LatencyReport::Decode(encoded.data(), encoded.size() - 1, &decoded));
+}
+
+TEST(InputProtocolTests, DecodesInputSequence)
+{
+	auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+	transform.sequence = 4242;
+
+	uint32_t sequence = 0;
+	auto binary = InputMessageCodec::Encode(transform);
+	ASSERT_TRUE(InputMessageCodec::DecodeSequence(binary.data(), binary.size(), &sequence));
+	EXPECT_EQ(4242u, sequence);
+
+	// json messages carry it as a top level number, wherever it is
+	std::string lookAt = "{\"sequence\": 17, \"type\":\"camera-transform-lookat\",\"body\":\"0,0,0\"}";
+	ASSERT_TRUE(InputMessageCodec::DecodeSequence(lookAt.data(), lookAt.size(), &sequence));
+	EXPECT_EQ(17u, sequence);
+
+	auto json = InputMessageCodec::EncodeJson(transform);
+	json.insert(json.size() - 1, ",\"sequence\":9");
+	CameraTransform decoded;
+	ASSERT_TRUE(InputMessageCodec::Decode(json.data(), json.size(), &decoded));
+	EXPECT_EQ(9u, decoded.sequence);
+	EXPECT_EQ(transform.timestamp, decoded.timestamp);
+
+	// or don't carry one at all
+	std::string keyboard = "{\"type\":\"keyboard-event\",\"body\":\"a\"}";
+	EXPECT_FALSE(InputMessageCodec::DecodeSequence(keyboard.data(), keyboard.size(), &sequence));
+	auto metadata = FrameMetadata::Encode(1, "x", 1);
+	EXPECT_FALSE(InputMessageCodec::DecodeSequence(metadata.data(), metadata.size(), &sequence));
+}
+
+TEST(InputProtocolTests, ServerLatencyTrackerReportsRenderedInputs)
+{
+	ServerLatencyTracker tracker(4);
+
+	// 1 is superseded by 2 before the renderer takes it, and 3 is never rendered at all
+	tracker.Received(1, 1000);
+	tracker.Received(2, 2000);
+	tracker.RenderStarted(2, 5000);
+	tracker.Received(3, 6000);
+	tracker.FrameSent(700);
+
+	// a frame sent with no new input shows nothing new
+	tracker.FrameSent(800);
+
+	ServerLatency latency;
+	ASSERT_FALSE(tracker.EncodeDone(800, 9000, &latency));
+	ASSERT_TRUE(tracker.EncodeDone(700, 12000, &latency));
+	EXPECT_EQ(2u, latency.sequence);
+	EXPECT_EQ(700, latency.timestamp);
+	EXPECT_EQ(3000, latency.render_us);
+	EXPECT_EQ(10000, latency.encode_us);
+
+	// each frame is reported once
+	ASSERT_FALSE(tracker.EncodeDone(700, 13000, &latency));
+}
+
+TEST(InputProtocolTests, ClientLatencyTrackerJoinsReports)
+{
+	ClientLatencyTracker tracker;
+	ServerLatency latency;
+	latency.render_us = 2000;
+	latency.encode_us = 8000;
+
+	// the report arrives first
+	tracker.InputSent(1, 0);
+	latency.sequence = 1;
+	latency.timestamp = 500;
+	tracker.AddReport(latency);
+	tracker.FrameDecoded(500, 20000);
+	ASSERT_EQ(0u, tracker.recorder().completed());
+	tracker.FramePresented(500, 21000);
+	ASSERT_EQ(1u, tracker.recorder().completed());
+
+	// or after the frame was decoded, or even presented
+	tracker.InputSent(2, 30000);
+	tracker.FrameDecoded(600, 50000);
+	tracker.FramePresented(600, 52000);
+	ASSERT_EQ(1u, tracker.recorder().completed());
+	latency.sequence = 2;
+	latency.timestamp = 600;
+	tracker.AddReport(latency);
+	ASSERT_EQ(2u, tracker.recorder().completed());
+
+	// the frame is forgotten once presented, so a repaint counts nothing
+	tracker.FramePresented(600, 60000);
+	ASSERT_EQ(2u, tracker.recorder().completed());
+
+	auto motionToPhoton = tracker.recorder().MotionToPhoton();
+	EXPECT_EQ(21000, motionToPhoton.min());
+	EXPECT_EQ(22000, motionToPhoton.max());
+	EXPECT_EQ(6000, tracker.recorder().Segment(LatencyRecorder::SERVER_RECEIVED).min());
+	EXPECT_EQ(2000, tracker.recorder().Segment(LatencyRecorder::PRESENTED).max());
+}
+
+TEST(InputProtocolTests, LatencyHarnessLoopback)
+{
+	// a client sending a pose every 2ms to a server rendering and encoding synthetic frames, all
+	// in one process. The server reports its stages on a control link beside the video, and the
+	// client places them by itself, as it would with a server on another clock.
+	const int kInputs = 400;
+	const int kWidth = 160;
+	const int kHeight = 90;
+	auto type = InputMessageCodec::TypeName(CameraTransform::STEREO_PREDICTION);
+
+	ClientLatencyTracker tracker(kInputs);
+	LoopbackLink uplink;
+	LoopbackLink downlink;
+	LoopbackLink control;
+
+	std::thread server([&]()
+	{
+		ServerLatencyTracker latency;
+		InputCoalescer coalescer;
+		coalescer.Coalesce(type);
+
+		PoseMailbox mailbox;
+		InputDispatcher dispatcher;
+		dispatcher.Register(type, [&](const InputMessage& message)
+		{
+			CameraTransform transform;
+			ASSERT_TRUE(InputMessageCodec::Decode(message.data.data, message.data.size, &transform));
+			latency.RenderStarted(transform.sequence, NowUs());
+			mailbox.Publish(transform);
+		});
+
+		std::string packet;
+		while (!uplink.IsDone())
+		{
+			// everything that arrived while we were rendering is one burst
+			for (auto timeout = 1000; uplink.Receive(&packet, timeout); timeout = 0)
+			{
+				uint32_t sequence;
+				ASSERT_TRUE(InputMessageCodec::DecodeSequence(packet.data(), packet.size(), &sequence));
+				latency.Received(sequence, NowUs());
+				coalescer.Push(1, packet.data(), packet.size());
+			}
+
+			coalescer.Drain(0, [&](int peer_id, const char* data, size_t size)
+			{
+				dispatcher.Dispatch(peer_id, data, size);
+			});
+
+			CameraTransform transform;
+			if (mailbox.Consume(&transform))
+			{
+				latency.FrameSent(transform.timestamp);
+				auto encoded = EncodeFrame(RenderFrame(transform.sequence, kWidth, kHeight), transform.timestamp);
+				downlink.Send(encoded);
+
+				ServerLatency report;
+				ASSERT_TRUE(latency.EncodeDone(transform.timestamp, NowUs(), &report));
+				control.Send(LatencyReport::Encode(report));
+			}
+		}
+
+		downlink.Close();
+		control.Close();
+	});
+
+	int presented = 0;
+	int reported = 0;
+	bool intact = true;
+	std::thread client([&]()
+	{
+		std::string packet;
+		while (!downlink.IsDone() || !control.IsDone())
+		{
+			while (control.Receive(&packet, 0))
+			{
+				ServerLatency report;
+				if (LatencyReport::Decode(packet.data(), packet.size(), &report))
+				{
+					tracker.AddReport(report);
+					reported++;
+				}
+			}
+
+			if (!downlink.Receive(&packet, 1000))
+			{
+				continue;
+			}
+
+			// the prediction timestamp is the client's own, so it's all the frame tells us
+			int64_t timestamp = 0;
+			auto pixels = DecodeFrame(packet, &timestamp);
+			tracker.FrameDecoded(timestamp, NowUs());
+
+			auto sequence = static_cast<uint32_t>((timestamp - 5000000) / 16);
+			intact = intact && pixels == RenderFrame(sequence, kWidth, kHeight);
+			tracker.FramePresented(timestamp, NowUs());
+			presented++;
+		}
+	});
+
+	auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+	for (int i = 0; i < kInputs; i++)
+	{
+		transform.sequence = i;
+		transform.timestamp = 5000000 + i * 16;
+		auto message = InputMessageCodec::Encode(transform);
+
+		tracker.InputSent(i, NowUs());
+		uplink.Send(message);
+		std::this_thread::sleep_for(std::chrono::microseconds(2000));
+	}
+
+	uplink.Close();
+	server.join();
+	client.join();
+
+	auto& recorder = tracker.recorder();
+	ASSERT_TRUE(intact);
+	ASSERT_GT(presented, 0);
+	ASSERT_EQ(presented, reported);
+	ASSERT_EQ(static_cast<uint64_t>(presented), recorder.completed());
+	ASSERT_EQ(static_cast<uint64_t>(kInputs), recorder.completed() + recorder.incomplete());
+
+	// every presented input had all its stages placed
+	for (int stage = LatencyRecorder::SERVER_RECEIVED; stage < LatencyRecorder::STAGE_COUNT; stage++)
+	{
+		EXPECT_EQ(static_cast<uint64_t>(presented), recorder.Segment(static_cast<LatencyRecorder::Stage>(stage)).count());
+	}
+
+	auto motionToPhoton = recorder.MotionToPhoton();
+	EXPECT_LE(motionToPhoton.min(), motionToPhoton.Percentile(50));
+	EXPECT_LE(motionToPhoton.Percentile(50), motionToPhoton.Percentile(99));
+	EXPECT_LE(motionToPhoton.Percentile(99), motionToPhoton.max());
+
+	std::cout << "[ LATENCY ] " << presented << " of " << kInputs << " inputs presented" << std::endl;
+	std::cout << recorder.Report();
+}
+
+namespace
+{
+	/// <summary>
+	/// One data channel over a lossy link, in simulated milliseconds
+	/// </summary>
+	/// <remarks>
+	/// An unreliable channel simply loses packets. A reliable one retransmits a lost packet after
+	/// a timeout, and holds back everything sent after it until it arrives, as an ordered SCTP
+	/// stream does.
+	/// </remarks>
+	class SimulatedChannel
+	{
+	public:
+		SimulatedChannel(bool reliable, double loss, int64_t delay_ms, int64_t retransmit_ms, uint32_t seed) :
+			reliable_(reliable),
+			loss_(loss),
+			delay_ms_(delay_ms),
+			retransmit_ms_(retransmit_ms),
+			last_arrival_ms_(0),
+			random_(seed)
+		{
+		}
+
+		void Send(int64_t now_ms, const char* data, size_t size)
+		{
+			auto sent_ms = now_ms;
+			while (Lost())
+			{
+				if (!reliable_)
+				{
+					return;
+				}
+
+				sent_ms += retransmit_ms_;
+			}
+
+			auto arrival_ms = sent_ms + delay_ms_;
+			if (reliable_)
+			{
+				arrival_ms = arrival_ms < last_arrival_ms_ ? last_arrival_ms_ : arrival_ms;
+				last_arrival_ms_ = arrival_ms;
+			}
+
+			in_flight_.insert(std::make_pair(arrival_ms, std::string(data, size)));
+		}
+
+		// Hands over everything that has arrived by |now_ms|
+		template <typename Callback>
+		void Deliver(int64_t now_ms, const Callback& callback)
+		{
+			while (!in_flight_.empty() && in_flight_.begin()->first <= now_ms)
+			{
+				callback(in_flight_.begin()->second);
+				in_flight_.erase(in_flight_.begin());
+			}
+		}
+
+	private:
+		bool Lost()
+		{
+			return (random_() % 10000) < loss_ * 10000;
+		}
+
+		bool reliable_;
+		double loss_;
+		int64_t delay_ms_;
+		int64_t retransmit_ms_;
+		int64_t last_arrival_ms_;
+		std::mt19937 random_;
+		std::multimap<int64_t, std::string> in_flight_;
+	};
+
+	struct LayoutResult
+	{
+		LatencyHistogram pose_latency;
+		int controls_sent;
+		int controls_received;
+		bool controls_ordered;
+	};
+
+	/// <summary>
+	/// Streams 90Hz poses and a control message every 100ms for ten simulated seconds, over
+	/// whichever of the two channels are open
+	/// </summary>
+	LayoutResult RunLayout(bool unreliable_open, bool reliable_open)
+	{
+		const double kLoss = 0.2;
+		const int64_t kDelayMs = 20;
+		const int64_t kRetransmitMs = 60;
+
+		int64_t now_ms = 0;
+		SimulatedChannel channels[] =
+		{
+			SimulatedChannel(false, kLoss, kDelayMs, kRetransmitMs, 1),
+			SimulatedChannel(true, kLoss, kDelayMs, kRetransmitMs, 2)
+		};
+
+		InputChannels sender;
+		for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+		{
+			if (i == InputChannels::UNRELIABLE ? unreliable_open : reliable_open)
+			{
+				auto channel = &channels[i];
+				sender.Attach(static_cast<InputChannels::Channel>(i), [channel, &now_ms](const char* data, size_t size)
+				{
+					channel->Send(now_ms, data, size);
+					return true;
+				});
+			}
+		}
+
+		LayoutResult result;
+		result.controls_sent = 0;
+		result.controls_received = 0;
+		result.controls_ordered = true;
+
+		InputDispatcher receiver;
+		receiver.Register(InputMessageCodec::TypeName(CameraTransform::STEREO_PREDICTION), [&](const InputMessage& message)
+		{
+			CameraTransform transform;
+			InputMessageCodec::Decode(message.data.data, message.data.size, &transform);
+			result.pose_latency.Add(now_ms - transform.timestamp);
+		});
+
+		receiver.Register("keyboard-event", [&](const InputMessage& message)
+		{
+			result.controls_ordered = result.controls_ordered && atoi(message.body.ToString().c_str()) == result.controls_received;
+			result.controls_received++;
+		});
+
+		auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+		for (; now_ms < 10000; now_ms++)
+		{
+			if (now_ms % 11 == 0)
+			{
+				transform.timestamp = now_ms;
+				EXPECT_TRUE(sender.Send(InputMessageCodec::Encode(transform)));
+			}
+
+			if (now_ms % 100 == 50)
+			{
+				EXPECT_TRUE(sender.Send("{\"type\":\"keyboard-event\",\"body\":\"" + std::to_string(result.controls_sent++) + "\"}"));
+			}
+
+			for (auto& channel : channels)
+			{
+				channel.Deliver(now_ms, [&](const std::string& message)
+				{
+					receiver.Dispatch(1, message.data(), message.size());
+				});
+			}
+		}
+
+		return result;
+	}
+}
+
+TEST(InputProtocolTests, InputChannelsClassifyMessages)
+{
+	auto binary = InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO));
+	auto json = ClientJson(SampleTransform(CameraTransform::STEREO_PREDICTION));
+	std::string lookat = "{\"type\":\"camera-transform-lookat\",\"body\":\"0,0,-1\"}";
+	std::string rendering = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+	std::string keyboard = "{\"type\":\"keyboard-event\",\"body\":\"w\"}";
+
+	EXPECT_EQ(InputChannels::UNRELIABLE, InputChannels::Classify(binary.data(), binary.size()));
+	EXPECT_EQ(InputChannels::UNRELIABLE, InputChannels::Classify(json.data(), json.size()));
+	EXPECT_EQ(InputChannels::UNRELIABLE, InputChannels::Classify(lookat.data(), lookat.size()));
+	EXPECT_EQ(InputChannels::RELIABLE, InputChannels::Classify(rendering.data(), rendering.size()));
+	EXPECT_EQ(InputChannels::RELIABLE, InputChannels::Classify(keyboard.data(), keyboard.size()));
+	EXPECT_EQ(InputChannels::RELIABLE, InputChannels::Classify("garbage", 7));
+
+	for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+	{
+		auto channel = static_cast<InputChannels::Channel>(i);
+		InputChannels::Channel found;
+		ASSERT_TRUE(InputChannels::FromLabel(InputChannels::Label(channel), &found));
+		EXPECT_EQ(channel, found);
+	}
+
+	InputChannels::Channel found;
+	ASSERT_FALSE(InputChannels::FromLabel("SendDataChannel", &found));
+
+	EXPECT_FALSE(InputChannels::IsOrdered(InputChannels::UNRELIABLE));
+	EXPECT_EQ(0, InputChannels::MaxRetransmits(InputChannels::UNRELIABLE));
+	EXPECT_TRUE(InputChannels::IsOrdered(InputChannels::RELIABLE));
+	EXPECT_EQ(-1, InputChannels::MaxRetransmits(InputChannels::RELIABLE));
+}
+
+TEST(InputProtocolTests, InputChannelsFallBack)
+{
+	InputChannels channels;
+	std::string rendering = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+	ASSERT_FALSE(channels.Send(rendering));
+
+	// an older peer, with only the one channel
+	std::vector<std::string> sent;
+	channels.Attach(InputChannels::UNRELIABLE, [&](const char* data, size_t size)
+	{
+		sent.push_back(std::string(data, size));
+		return true;
+	});
+
+	ASSERT_TRUE(channels.IsAttached(InputChannels::UNRELIABLE));
+	ASSERT_FALSE(channels.IsAttached(InputChannels::RELIABLE));
+	ASSERT_TRUE(channels.Send(rendering));
+	ASSERT_TRUE(channels.Send(InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO))));
+	ASSERT_EQ(2u, sent.size());
+
+	// a channel that's attached but can't send yet, as one still connecting, falls back too
+	channels.Attach(InputChannels::RELIABLE, [](const char* data, size_t size) { return false; });
+	ASSERT_TRUE(channels.Send(rendering));
+	ASSERT_EQ(3u, sent.size());
+
+	channels.Detach(InputChannels::UNRELIABLE);
+	ASSERT_FALSE(channels.IsAttached(InputChannels::UNRELIABLE));
+	ASSERT_FALSE(channels.Send(rendering));
+
+	auto stats = channels.stats();
+	EXPECT_EQ(3u, stats.sent[InputChannels::UNRELIABLE]);
+	EXPECT_EQ(0u, stats.sent[InputChannels::RELIABLE]);
+	EXPECT_EQ(2u, stats.fallbacks);
+	EXPECT_EQ(2u, stats.failed);
+}
+
+TEST(InputProtocolTests, InputChannelsUnderLoss)
+{
+	// with 20% loss, 20ms each way and a 60ms retransmit timeout
+	auto split = RunLayout(true, true);
+	auto reliable = RunLayout(false, true);
+	auto unreliable = RunLayout(true, false);
+
+	std::cout << "[ CHANNELS ] layout, pose latency p50 / p99 / max (ms), control messages received" << std::endl;
+	for (auto result : { std::make_pair("split", &split), std::make_pair("reliable only", &reliable), std::make_pair("unreliable only", &unreliable) })
+	{
+		std::cout << "[ CHANNELS ] " << result.first << ", "
+			<< result.second->pose_latency.Percentile(50) << " / "
+			<< result.second->pose_latency.Percentile(99) << " / "
+			<< result.second->pose_latency.max() << ", "
+			<< result.second->controls_received << " of " << result.second->controls_sent << std::endl;
+	}
+
+	// poses never wait behind a retransmit, and control is never lost
+	EXPECT_EQ(20, split.pose_latency.max());
+	EXPECT_EQ(split.controls_sent, split.controls_received);
+	EXPECT_TRUE(split.controls_ordered);
+
+	// whereas one reliable channel holds poses back, and one unreliable channel loses control
+	EXPECT_GT(reliable.pose_latency.Percentile(99), 60);
+	EXPECT_EQ(reliable.controls_sent, reliable.controls_received);
+	EXPECT_LT(unreliable.controls_received, unreliable.controls_sent);
+}
+
+TEST(InputProtocolTests, FrameMetadataRoundTrips)
+{
+	const char raw[] = "{\"depth\":[0.1,20]}\0tail";
+	std::string payload(raw, sizeof(raw) - 1);
+	auto message = FrameMetadata::Encode(131567894561234567LL, payload.data(), payload.size());
+	ASSERT_EQ(FrameMetadata::kHeaderSize + payload.size(), message.size());
+	ASSERT_TRUE(InputMessageCodec::IsBinary(message.data(), message.size()));
+	ASSERT_TRUE(FrameMetadata::IsFrameMetadata(message.data(), message.size()));
+
+	int64_t timestamp;
+	InputSpan decoded;
+	ASSERT_TRUE(FrameMetadata::Decode(message.data(), message.size(), &timestamp, &decoded));
+	EXPECT_EQ(131567894561234567LL, timestamp);
+	EXPECT_EQ(payload, decoded.ToString());
+
+	// it isn't input, and must arrive
+	CameraTransform transform;
+	InputSpan type;
+	InputSpan body;
+	EXPECT_FALSE(InputMessageCodec::Decode(message.data(), message.size(), &transform));
+	EXPECT_FALSE(InputMessageCodec::DecodeEnvelope(message.data(), message.size(), &type, &body));
+	EXPECT_EQ(InputChannels::RELIABLE, InputChannels::Classify(message.data(), message.size()));
+
+	// and camera transforms aren't metadata
+	auto binary = InputMessageCodec::Encode(SampleTransform(CameraTransform::STEREO));
+	EXPECT_FALSE(FrameMetadata::IsFrameMetadata(binary.data(), binary.size()));
+	EXPECT_FALSE(FrameMetadata::Decode(message.data(), message.size() - 1, &timestamp, &decoded));
+	EXPECT_FALSE(FrameMetadata::Decode(message.data(), FrameMetadata::kHeaderSize - 1, &timestamp, &decoded));
+}
+
+TEST(InputProtocolTests, FrameMetadataQueueIsBounded)
+{
+	FrameMetadataQueue queue(16);
+
+	// nothing goes while the channel is closed, and only the newest are kept
+	for (int i = 0; i < 100; i++)
+	{
+		queue.Push(i, std::to_string(i));
+	}
+
+	ASSERT_EQ(0u, queue.Drain([](const std::string&) { return false; }));
+	ASSERT_EQ(16u, queue.size());
+
+	std::vector<int64_t> sent;
+	auto send = [&sent](const std::string& message)
+	{
+		int64_t timestamp;
+		InputSpan payload;
+		EXPECT_TRUE(FrameMetadata::Decode(message.data(), message.size(), &timestamp, &payload));
+		EXPECT_EQ(std::to_string(timestamp), payload.ToString());
+		sent.push_back(timestamp);
+		return sent.size() != 4;
+	};
+
+	// the fourth is refused, and kept for next time
+	ASSERT_EQ(3u, queue.Drain(send));
+	ASSERT_EQ(13u, queue.size());
+	ASSERT_EQ(13u, queue.Drain(send));
+	ASSERT_EQ(0u, queue.size());
+
+	ASSERT_EQ(17u, sent.size());
+	EXPECT_EQ(84, sent[0]);
+	EXPECT_EQ(87, sent[3]);
+	EXPECT_EQ(87, sent[4]);
+	EXPECT_EQ(99, sent.back());
+
+	auto stats = queue.stats();
+	EXPECT_EQ(100u, stats.queued);
+	EXPECT_EQ(16u, stats.sent);
+	EXPECT_EQ(84u, stats.dropped);
+}
+
+TEST(InputProtocolTests, FrameMetadataStaysAlignedUnderLoss)
+{
+	// 60fps for ten simulated seconds. Metadata goes on the reliable channel with 20% loss, and
+	// video takes 35ms and loses 10% of frames. The server has nothing to say for every 7th frame.
+	const int kFrames = 600;
+	const int64_t kFrameMs = 16;
+	const int64_t kVideoMs = 35;
+
+	SimulatedChannel channel(true, 0.2, 20, 60, 7);
+	std::mt19937 random(8);
+	std::multimap<int64_t, int> video;
+
+	std::vector<int> delivered;
+	int joined = 0;
+	int misaligned = 0;
+	int unjoined_with_metadata = 0;
+	size_t most_pending = 0;
+
+	FrameMetadataJoiner<int>::Options options;
+	options.capacity = 64;
+	options.max_age = 1000;
+	options.max_wait = 250;
+	FrameMetadataJoiner<int> joiner([&](const int& frame, const std::string* metadata)
+	{
+		delivered.push_back(frame);
+		if (metadata == nullptr)
+		{
+			unjoined_with_metadata += frame % 7 != 0 ? 1 : 0;
+			return;
+		}
+
+		joined++;
+		misaligned += *metadata != "frame " + std::to_string(frame) ? 1 : 0;
+	}, options);
+
+	FrameMetadataQueue queue;
+	int video_received = 0;
+	for (int64_t now_ms = 0; now_ms < kFrames * kFrameMs + 1000; now_ms++)
+	{
+		if (now_ms % kFrameMs == 0 && now_ms / kFrameMs < kFrames)
+		{
+			// timestamps are the frame number, so they're easy to check
+			auto frame = static_cast<int>(now_ms / kFrameMs);
+			if (frame % 7 != 0)
+			{
+				queue.Push(frame, "frame " + std::to_string(frame));
+			}
+
+			queue.Drain([&](const std::string& message)
+			{
+				channel.Send(now_ms, message.data(), message.size());
+				return true;
+			});
+
+			if (random() % 10 != 0)
+			{
+				video.insert(std::make_pair(now_ms + kVideoMs, frame));
+			}
+		}
+
+		channel.Deliver(now_ms, [&](const std::string& message)
+		{
+			ASSERT_TRUE(joiner.AddMetadataMessage(message.data(), message.size(), now_ms));
+		});
+
+		while (!video.empty() && video.begin()->first <= now_ms)
+		{
+			video_received++;
+			joiner.AddFrame(video.begin()->second, video.begin()->second, now_ms);
+			video.erase(video.begin());
+		}
+
+		joiner.Expire(now_ms);
+		most_pending = std::max(most_pending, joiner.pending());
+	}
+
+	ASSERT_EQ(static_cast<size_t>(video_received), delivered.size());
+	for (size_t i = 1; i < delivered.size(); i++)
+	{
+		ASSERT_LT(delivered[i - 1], delivered[i]);
+	}
+
+	auto stats = joiner.stats();
+	std::cout << "[ METADATA ] " << video_received << " frames received, " << stats.joined << " joined, "
+		<< unjoined_with_metadata << " gave up waiting, " << joiner.metadata_stats().evicted
+		<< " metadata evicted, at most " << most_pending << " frames held" << std::endl;
+
+	// metadata never lands on the wrong frame, and very rarely misses its own
+	EXPECT_EQ(0, misaligned);
+	EXPECT_LT(unjoined_with_metadata, video_received / 100);
+	EXPECT_GT(joined, video_received * 8 / 10);
+	EXPECT_EQ(static_cast<uint64_t>(joined), stats.joined);
+
+	// metadata for lost frames was let go, and frames were only held while it was retransmitted
+	EXPECT_GT(joiner.metadata_stats().evicted, 0u);
+	EXPECT_LT(most_pending, 20u);
+}
+
+TEST(InputProtocolTests, FrameInputsRecordPoseAndMetadata)
+{
+	FrameInputs inputs(8);
+	auto pose = SampleTransform(CameraTransform::STEREO_PREDICTION);
+	const auto timestamp = pose.timestamp;
+
+	// in either order, as input and frames arrive on their own threads
+	inputs.AddMetadata(timestamp, "frame 1");
+	inputs.AddPose(pose);
+	auto record = inputs.Take(timestamp);
+	EXPECT_EQ(InputMessageCodec::kCameraTransformSize + FrameMetadata::kHeaderSize + 7, record.size());
+	EXPECT_TRUE(inputs.Take(timestamp).empty());
+
+	CameraTransform split;
+	bool has_pose = false;
+	std::string metadata;
+	ASSERT_TRUE(FrameInputs::Split(record.data(), record.size(), &split, &has_pose, &metadata));
+	EXPECT_TRUE(has_pose);
+	EXPECT_EQ(timestamp, split.timestamp);
+	ExpectMatricesEqual(pose, split);
+	EXPECT_EQ("frame 1", metadata);
+
+	// either may be missing
+	pose.timestamp = timestamp + 1;
+	inputs.AddPose(pose);
+	inputs.AddMetadata(timestamp + 2, "frame 3");
+	record = inputs.Take(timestamp + 1);
+	ASSERT_TRUE(FrameInputs::Split(record.data(), record.size(), &split, &has_pose, &metadata));
+	EXPECT_TRUE(has_pose);
+	EXPECT_TRUE(metadata.empty());
+	record = inputs.Take(timestamp + 2);
+	ASSERT_TRUE(FrameInputs::Split(record.data(), record.size(), &split, &has_pose, &metadata));
+	EXPECT_FALSE(has_pose);
+	EXPECT_EQ("frame 3", metadata);
+	ASSERT_TRUE(FrameInputs::Split(nullptr, 0, &split, &has_pose, &metadata));
+	EXPECT_FALSE(has_pose);
+
+	// poses without a prediction can't be matched to a frame, and what isn't a record is refused
+	inputs.AddPose(SampleTransform(CameraTransform::STEREO));
+	EXPECT_TRUE(inputs.Take(0).empty());
+	const std::string other = "not a record";
+	EXPECT_FALSE(FrameInputs::Split(other.data(), other.size(), &split, &has_pose, &metadata));
+
+	// frames that are never encoded make room for newer ones
+	for (int64_t i = 0; i < 20; i++)
+	{
+		inputs.AddMetadata(i, "frame");
+	}
+
+	EXPECT_TRUE(inputs.Take(0).empty());
+	EXPECT_FALSE(inputs.Take(19).empty());
+}
+
+namespace
+{
+	/// <summary>
+	/// Records a session of two headsets sending 90Hz transforms, one of them for half as long,
+	/// and a control message
+	/// </summary>
+	std::string RecordSession()
+	{
+		std::ostringstream out;
+		InputLogWriter writer;
+		writer.Open(&out);
+
+		std::string rendering = "{\"type\":\"stereo-rendering\",\"body\":\"1\"}";
+		writer.Write(7, 1000000, rendering.data(), rendering.size());
+
+		for (int i = 0; i < 90; i++)
+		{
+			auto transform = SampleTransform(CameraTransform::STEREO_PREDICTION);
+			transform.sequence = i;
+			auto message = InputMessageCodec::Encode(transform);
+			writer.Write(7, 1000000 + i * 11111, message.data(), message.size());
+
+			if (i < 45)
+			{
+				auto json = ClientJson(transform);
+				writer.Write(3, 1000000 + i * 11111 + 500, json.data(), json.size());
+			}
+		}
+
+		writer.Close();
+		return out.str();
+	}
+}
+
+TEST(InputProtocolTests, InputLogRoundTrips)
+{
+	auto log = RecordSession();
+
+	std::istringstream in(log);
+	std::vector<InputLogRecord> records;
+	ASSERT_TRUE(InputLogReader::Read(in, &records));
+	ASSERT_EQ(136u, records.size());
+
+	// times are relative to the first message
+	EXPECT_EQ(7, records[0].peer_id);
+	EXPECT_EQ(0, records[0].time_us);
+	EXPECT_EQ("{\"type\":\"stereo-rendering\",\"body\":\"1\"}", records[0].data);
+
+	CameraTransform transform;
+	ASSERT_TRUE(InputMessageCodec::Decode(records[1].data.data(), records[1].data.size(), &transform));
+	EXPECT_EQ(0u, transform.sequence);
+	EXPECT_EQ(3, records[2].peer_id);
+	EXPECT_EQ(500, records[2].time_us);
+	EXPECT_EQ(ClientJson(SampleTransform(CameraTransform::STEREO_PREDICTION)), records[2].data);
+	EXPECT_EQ(89 * 11111, records.back().time_us);
+
+	// the framing costs a few bytes a message
+	size_t payload = 0;
+	for (const auto& record : records)
+	{
+		payload += record.data.size();
+	}
+
+	EXPECT_LE(log.size(), 8 + payload + records.size() * 6);
+
+	// a log cut short keeps every complete record
+	std::istringstream truncated(log.substr(0, log.size() - 10));
+	std::vector<InputLogRecord> partial;
+	ASSERT_TRUE(InputLogReader::Read(truncated, &partial));
+	EXPECT_EQ(records.size() - 1, partial.size());
+
+	std::istringstream garbage("not a log");
+	EXPECT_FALSE(InputLogReader::Read(garbage, &partial));
+}
+
+namespace
+{
+	/// <summary>
+	/// Collects what's written through it, and which thread wrote it, safely across threads
+	/// </summary>
+	class RecordingStreamBuf : public std::streambuf
+	{
+	public:
+		std::string contents()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return contents_;
+		}
+
+		std::thread::id writer()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return writer_;
+		}
+
+	protected:
+		std::streamsize xsputn(const char* data, std::streamsize size) override
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			contents_.append(data, static_cast<size_t>(size));
+			writer_ = std::this_thread::get_id();
+			return size;
+		}
+
+		int_type overflow(int_type c) override
+		{
+			if (c != traits_type::eof())
+			{
+				char byte = static_cast<char>(c);
+				xsputn(&byte, 1);
+			}
+
+			return traits_type::not_eof(c);
+		}
+
+	private:
+		std::mutex lock_;
+		std::string contents_;
+		std::thread::id writer_;
+	};
+}
+
+TEST(InputProtocolTests, InputLogWritesOffTheCallersThread)
+{
+	RecordingStreamBuf buffer;
+	std::ostream out(&buffer);
+
+	InputLogWriter::Options options;
+	options.flush_interval_ms = 60000;
+	options.flush_bytes = 256;
+	InputLogWriter writer(options);
+	writer.Open(&out);
+	ASSERT_EQ(8u, buffer.contents().size());
+
+	// a few messages are only buffered
+	const std::string message = "{\"type\":\"camera-transform-lookat\"}";
+	for (int i = 0; i < 3; i++)
+	{
+		writer.Write(1, i * 1000, message.data(), message.size());
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_EQ(8u, buffer.contents().size());
+
+	// until enough have built up to wake the writer thread
+	while (writer.stats().bytes < 8 + options.flush_bytes)
+	{
+		writer.Write(1, 0, message.data(), message.size());
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (buffer.contents().size() == 8 && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	ASSERT_GT(buffer.contents().size(), 8u);
+	ASSERT_NE(std::this_thread::get_id(), buffer.writer());
+
+	// and closing writes out the rest
+	writer.Write(2, 5000, message.data(), message.size());
+	writer.Close();
+	ASSERT_EQ(writer.stats().bytes, buffer.contents().size());
+
+	std::istringstream in(buffer.contents());
+	std::vector<InputLogRecord> records;
+	ASSERT_TRUE(InputLogReader::Read(in, &records));
+	ASSERT_EQ(writer.stats().records, records.size());
+	EXPECT_EQ(2, records.back().peer_id);
+}
+
+TEST(InputProtocolTests, ReplayFansOutToSyntheticPeers)
+{
+	std::istringstream in(RecordSession());
+	std::vector<InputLogRecord> records;
+	ASSERT_TRUE(InputLogReader::Read(in, &records));
+
+	InputReplayer::Options options;
+	options.peers = 5;
+	options.first_peer_id = 100;
+	options.stagger_us = 1000;
+	InputReplayer replayer(records, options);
+
+	// peers 100, 102 and 104 replay recorded peer 3, and 101 and 103 replay peer 7
+	ASSERT_EQ(3u * 45 + 2u * 91, replayer.size());
+	ASSERT_EQ(89 * 11111 + 3000, replayer.duration_us());
+
+	std::map<int, std::vector<std::string>> received;
+	auto deliver = [&received](int peer_id, const char* data, size_t size)
+	{
+		received[peer_id].push_back(std::string(data, size));
+	};
+
+	// each starts a millisecond after the one before
+	ASSERT_EQ(500, replayer.NextDue());
+	ASSERT_EQ(1u, replayer.Advance(999, deliver));
+	ASSERT_EQ(1000, replayer.NextDue());
+	ASSERT_EQ(2u, replayer.Advance(1000, deliver));
+	ASSERT_EQ(1u, received[100].size());
+	ASSERT_EQ(2u, received[101].size());
+	ASSERT_EQ(2500, replayer.NextDue());
+
+	ASSERT_EQ(replayer.size() - 3, replayer.Advance(replayer.duration_us(), deliver));
+	ASSERT_EQ(-1, replayer.NextDue());
+
+	for (int peer = 100; peer < 105; peer++)
+	{
+		auto recorded = peer % 2 == 0 ? 3 : 7;
+		std::vector<std::string> expected;
+		for (const auto& record : records)
+		{
+			if (record.peer_id == recorded)
+			{
+				expected.push_back(record.data);
+			}
+		}
+
+		EXPECT_EQ(expected, received[peer]) << "peer " << peer;
+	}
+
+	// replaying into the input pipeline gives the same result every time
+	auto dispatch = [&replayer]()
+	{
+		InputDispatcher dispatcher;
+		std::ostringstream trace;
+		dispatcher.Register("camera-transform-stereo-prediction", [&trace](const InputMessage& message)
+		{
+			CameraTransform transform;
+			InputMessageCodec::Decode(message.data.data, message.data.size, &transform);
+			trace << message.peer_id << ":" << transform.sequence << " ";
+		});
+
+		replayer.Rewind();
+		replayer.Advance(replayer.duration_us(), [&dispatcher](int peer_id, const char* data, size_t size)
+		{
+			dispatcher.Dispatch(peer_id, data, size);
+		});
+
+		return trace.str();
+	};
+
+	auto first = dispatch();
+	EXPECT_FALSE(first.empty());
+	EXPECT_EQ(first, dispatch());
+}
+
+TEST(InputProtocolTests, ReplayPacesRealTime)
+{
+	std::istringstream in(RecordSession());
+	std::vector<InputLogRecord> records;
+	ASSERT_TRUE(InputLogReader::Read(in, &records));
+
+	auto run = [&records](double speed)
+	{
+		InputReplayer::Options options;
+		options.peers = 4;
+		options.speed = speed;
+		InputReplayer replayer(records, options);
+
+		size_t delivered = 0;
+		auto start = std::chrono::steady_clock::now();
+		replayer.Run([&delivered](int, const char*, size_t) { delivered++; });
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+		EXPECT_EQ(replayer.size(), delivered);
+		return elapsed;
+	};
+
+	// the session lasts about a second
+	auto accelerated = run(4);
+	auto unpaced = run(0);
+	std::cout << "[ REPLAY   ] 1s session at 4x in " << accelerated << "ms, unpaced in " << unpaced << "ms" << std::endl;
+
+	EXPECT_GE(accelerated, 240);
+	EXPECT_LT(accelerated, 1000);
+	EXPECT_LT(unpaced, accelerated);
+
+	// and can be stopped part way through
+	InputReplayer::Options options;
+	options.speed = 1;
+	InputReplayer replayer(records, options);
+	std::atomic_bool stop(false);
+	size_t delivered = 0;
+	replayer.Run([&](int, const char*, size_t)
+	{
+		if (++delivered == 10)
+		{
+			stop = true;
+		}
+	}, &stop);
+
+	// the one synthetic peer replays peer 3, whose eleventh message is next
+	EXPECT_EQ(10u, delivered);
+	EXPECT_EQ(500 + 10 * 11111, replayer.NextDue());
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// <summary>
+/// Matches decoded video frames to the frames a client predicted them for, by prediction
+/// timestamp, in bounded memory
+/// </summary>
+/// <remarks>
+/// Pending frames are kept in a ring, in the order they were inserted, and indexed by an open
+/// addressing table twice the ring's size, so inserting and taking are both constant time.
+/// A frame is evicted unmatched when the ring is full, or when it's older than the newest
+/// inserted timestamp by more than the maximum age. The server skips frames when it coalesces
+/// input, so some frames are never matched and eviction is what stops them from piling up.
+///
+/// A frame the server rendered from a predicted pose, because the client's input was late, carries
+/// the newest timestamp the server actually received, which has usually been matched already.
+/// TakeNearest matches it to the oldest frame still waiting after that timestamp instead.
+///
+/// Timestamps only need to be in consistent units, eg. the 100ns ticks of a HolographicFrame's
+/// target time. Not synchronized.
+/// </remarks>
+template <typename T>
+class FrameCorrelator
+{
+public:
+	struct Stats
+	{
+		uint64_t inserted;
+		uint64_t matched;
+
+		// Matches for a frame older than one already matched, ie. video arriving out of order
+		uint64_t late;
+
+		// Lookups for a timestamp that isn't pending, because it was never inserted or was evicted
+		uint64_t missed;
+
+		// Matches TakeNearest made to a newer frame, as the timestamp asked for wasn't pending
+		uint64_t substituted;
+
+		// Frames dropped unmatched, for their age or to make room
+		uint64_t evicted;
+	};
+
+	FrameCorrelator(size_t capacity, int64_t max_age) :
+		max_age_(max_age),
+		head_(0),
+		tail_(0),
+		newest_inserted_(INT64_MIN),
+		newest_matched_(INT64_MIN)
+	{
+		size_t size = 1;
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+
+		slots_.resize(size);
+		index_.resize(size * 2, 0);
+		stats_ = Stats();
+	}
+
+	// Remembers |context| for the frame predicted for |timestamp|, replacing any it already has
+	void Insert(int64_t timestamp, const T& context)
+	{
+		stats_.inserted++;
+
+		auto position = Find(timestamp);
+		if (index_[position] != 0)
+		{
+			auto& slot = SlotAt(index_[position] - 1);
+			slot.context = context;
+			return;
+		}
+
+		if (tail_ - head_ == slots_.size())
+		{
+			// which may shift the index, so look again
+			EvictHead();
+			position = Find(timestamp);
+		}
+
+		auto& slot = SlotAt(tail_);
+		slot.timestamp = timestamp;
+		slot.context = context;
+		slot.pending = true;
+		index_[position] = ++tail_;
+
+		if (timestamp > newest_inserted_)
+		{
+			newest_inserted_ = timestamp;
+			while (head_ != tail_ && (!SlotAt(head_).pending || newest_inserted_ - SlotAt(head_).timestamp > max_age_))
+			{
+				EvictHead();
+			}
+		}
+	}
+
+	// Takes the context for the frame predicted for |timestamp|, returning false if there isn't one
+	bool Take(int64_t timestamp, T* context)
+	{
+		auto position = Find(timestamp);
+		if (index_[position] == 0)
+		{
+			stats_.missed++;
+			return false;
+		}
+
+		Match(position, timestamp, context);
+		return true;
+	}
+
+	// Takes the context for the frame predicted for |timestamp| or, if that isn't pending, for the
+	// oldest pending frame after it, returning false if there's neither
+	bool TakeNearest(int64_t timestamp, T* context)
+	{
+		auto position = Find(timestamp);
+		if (index_[position] != 0)
+		{
+			Match(position, timestamp, context);
+			return true;
+		}
+
+		// the ring is small, so a scan is cheap next to decoding the frame we're matching
+		const Slot* nearest = nullptr;
+		for (auto sequence = head_; sequence != tail_; sequence++)
+		{
+			const auto& slot = SlotAt(sequence);
+			if (slot.pending && slot.timestamp > timestamp && (nearest == nullptr || slot.timestamp < nearest->timestamp))
+			{
+				nearest = &slot;
+			}
+		}
+
+		if (nearest == nullptr)
+		{
+			stats_.missed++;
+			return false;
+		}
+
+		stats_.substituted++;
+		auto nearest_timestamp = nearest->timestamp;
+		Match(Find(nearest_timestamp), nearest_timestamp, context);
+		return true;
+	}
+
+	// The number of pending frames, plus any matched ones the ring hasn't moved past yet
+	size_t size() const
+	{
+		return static_cast<size_t>(tail_ - head_);
+	}
+
+	size_t capacity() const
+	{
+		return slots_.size();
+	}
+
+	Stats stats() const
+	{
+		return stats_;
+	}
+
+private:
+	struct Slot
+	{
+		int64_t timestamp;
+		T context;
+		bool pending;
+
+		Slot() : timestamp(0), context(), pending(false) {}
+	};
+
+	Slot& SlotAt(uint64_t sequence)
+	{
+		return slots_[sequence & (slots_.size() - 1)];
+	}
+
+	size_t Home(int64_t timestamp) const
+	{
+		// timestamps are usually evenly spaced, so mix them before taking the low bits
+		auto hash = static_cast<uint64_t>(timestamp) * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(hash >> 32) & (index_.size() - 1);
+	}
+
+	// The index position holding |timestamp|, or the empty one where it would go
+	size_t Find(int64_t timestamp)
+	{
+		auto mask = index_.size() - 1;
+		auto position = Home(timestamp);
+		while (index_[position] != 0 && SlotAt(index_[position] - 1).timestamp != timestamp)
+		{
+			position = (position + 1) & mask;
+		}
+
+		return position;
+	}
+
+	// Takes the pending frame for |timestamp|, at index |position|
+	void Match(size_t position, int64_t timestamp, T* context)
+	{
+		auto& slot = SlotAt(index_[position] - 1);
+		*context = slot.context;
+		Release(slot);
+		Erase(position);
+
+		stats_.matched++;
+		if (timestamp < newest_matched_)
+		{
+			stats_.late++;
+		}
+		else
+		{
+			newest_matched_ = timestamp;
+		}
+
+		// matched frames at the head no longer take up room
+		while (head_ != tail_ && !SlotAt(head_).pending)
+		{
+			head_++;
+		}
+	}
+
+	// Removes an index entry, shifting back the entries after it so lookups still find them
+	void Erase(size_t position)
+	{
+		auto mask = index_.size() - 1;
+		auto next = (position + 1) & mask;
+		while (index_[next] != 0)
+		{
+			auto home = Home(SlotAt(index_[next] - 1).timestamp);
+
+			// move the entry back unless its home lies cyclically in (position, next]
+			if (((next - home) & mask) >= ((next - position) & mask))
+			{
+				index_[position] = index_[next];
+				position = next;
+			}
+
+			next = (next + 1) & mask;
+		}
+
+		index_[position] = 0;
+	}
+
+	void Release(Slot& slot)
+	{
+		// let go of the context, which may hold on to a frame
+		slot.context = T();
+		slot.pending = false;
+	}
+
+	void EvictHead()
+	{
+		auto& slot = SlotAt(head_++);
+		if (slot.pending)
+		{
+			Erase(Find(slot.timestamp));
+			Release(slot);
+			stats_.evicted++;
+		}
+	}
+
+	std::vector<Slot> slots_;
+
+	// Sequence numbers plus one into slots_, or 0 for an empty position
+	std::vector<uint64_t> index_;
+
+	int64_t max_age_;
+
+	// Sequence numbers of the oldest slot still in the ring, and of the next to be inserted
+	uint64_t head_;
+	uint64_t tail_;
+
+	int64_t newest_inserted_;
+	int64_t newest_matched_;
+	Stats stats_;
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "frame_correlator.h"
+#include "input_message_codec.h"
+
+/// <summary>
+/// Encodes and decodes the data a server attaches to a video frame, for the data channel
+/// </summary>
+/// <remarks>
+/// Metadata is keyed by the frame's prediction timestamp, which reaches the client along with
+/// the decoded frame. It's a binary message sharing InputMessageCodec::kMagic, little endian:
+///
+///   offset  size  field
+///   0       1     InputMessageCodec::kMagic
+///   1       1     version, currently InputMessageCodec::kVersion
+///   2       1     kKind
+///   3       1     reserved, 0
+///   4       4     payload size
+///   8       8     prediction timestamp
+///   16      ...   payload, opaque to us
+///
+/// kKind isn't a CameraTransform::Kind, so older peers decode it as nothing and it's sent on
+/// the reliable channel.
+/// </remarks>
+class FrameMetadata
+{
+public:
+	static const uint8_t kKind = 0x80;
+
+	static const size_t kHeaderSize = 16;
+
+	static std::string Encode(int64_t timestamp, const char* data, size_t size);
+
+	// Returns true if |data| is a frame metadata message
+	static bool IsFrameMetadata(const char* data, size_t size);
+
+	// Decodes a metadata message, with |payload| pointing into |data|
+	static bool Decode(const char* data, size_t size, int64_t* timestamp, InputSpan* payload);
+};
+
+/// <summary>
+/// Holds the metadata a server has attached to frames until the data channel can take it
+/// </summary>
+/// <remarks>
+/// Frames are captured on the render thread, but the data channel may not be open yet, or may
+/// be backed up. The queue keeps the newest messages up to its capacity and drops the oldest,
+/// whose frames the client will have shown by the time they'd arrive. Push may be called from
+/// any thread, and Drain from one thread at a time.
+/// </remarks>
+class FrameMetadataQueue
+{
+public:
+	// Sends an encoded message, returning false if it couldn't be sent yet
+	typedef std::function<bool(const std::string& message)> Sender;
+
+	struct Stats
+	{
+		uint64_t queued;
+		uint64_t sent;
+
+		// Messages dropped to make room for newer ones
+		uint64_t dropped;
+	};
+
+	explicit FrameMetadataQueue(size_t capacity = 16);
+
+	// Queues |metadata| for the frame with prediction timestamp |timestamp|
+	void Push(int64_t timestamp, const std::string& metadata);
+
+	// Sends queued messages, oldest first, until |send| fails, returning how many were sent
+	size_t Drain(const Sender& send);
+
+	size_t size() const;
+
+	Stats stats() const;
+
+private:
+	mutable std::mutex lock_;
+	std::deque<std::string> messages_;
+	size_t capacity_;
+	Stats stats_;
+};
+
+/// <summary>
+/// Holds what a server's frames were rendered for until they're encoded, to record with them
+/// </summary>
+/// <remarks>
+/// A frame's input pose arrives with the peer's input and its metadata with the frame, and the
+/// frame leaves the encoder later on another thread, so both are kept by prediction timestamp
+/// in a FrameCorrelator of |capacity| frames. Frames that are never encoded are evicted to make
+/// room. Only poses with a prediction timestamp can be matched to a frame. Thread safe.
+///
+/// A frame's record is its pose as a binary camera transform message, if it had one, followed
+/// by its metadata as a FrameMetadata message, if it had any.
+/// </remarks>
+class FrameInputs
+{
+public:
+	explicit FrameInputs(size_t capacity = 64);
+
+	// Remembers |pose| for the frame predicted for its timestamp, ignoring poses without one
+	void AddPose(const CameraTransform& pose);
+
+	// Remembers |metadata| for the frame predicted for |timestamp|
+	void AddMetadata(int64_t timestamp, const std::string& metadata);
+
+	// Takes the record for the frame predicted for |timestamp|, empty if nothing was added for it
+	std::string Take(int64_t timestamp);
+
+	// Splits a record Take returned into the pose, setting |has_pose| if there was one, and the
+	// metadata, returning false if |data| isn't a record
+	static bool Split(const char* data, size_t size, CameraTransform* pose, bool* has_pose, std::string* metadata);
+
+private:
+	struct Inputs
+	{
+		std::string pose;
+		std::string metadata;
+	};
+
+	std::mutex lock_;
+	FrameCorrelator<Inputs> inputs_;
+};
+
+/// <summary>
+/// Pairs decoded video frames with the metadata the server sent for them, on the client
+/// </summary>
+/// <remarks>
+/// Metadata goes over the reliable data channel and usually arrives before its frame, in which
+/// case it's remembered, in bounded memory, until the frame does. A frame that arrives first is
+/// held until its metadata turns up, or until it has waited |max_wait|, and is then delivered
+/// without. Since metadata arrives in order, metadata for a later frame means none is coming for
+/// the frames held before it, so those are let go straight away. Frames are always delivered in
+/// the order they were added.
+///
+/// Frames the video stream lost leave their metadata behind, which is evicted by age like any
+/// other unmatched entry in a FrameCorrelator. Not synchronized.
+/// </remarks>
+template <typename T>
+class FrameMetadataJoiner
+{
+public:
+	// Receives a frame, and its metadata or nullptr if it has none
+	typedef std::function<void(const T& frame, const std::string* metadata)> Deliver;
+
+	struct Options
+	{
+		// The most metadata entries to remember for frames that haven't arrived
+		size_t capacity;
+
+		// How far, in timestamp units, metadata may lag the newest before it's given up on
+		int64_t max_age;
+
+		// How long, in the units passed as |now|, a frame may wait for its metadata
+		int64_t max_wait;
+
+		Options() : capacity(64), max_age(1000), max_wait(50) {}
+	};
+
+	struct Stats
+	{
+		// Frames delivered with their metadata, and without
+		uint64_t joined;
+		uint64_t unjoined;
+	};
+
+	explicit FrameMetadataJoiner(const Deliver& deliver, const Options& options = Options()) :
+		deliver_(deliver),
+		options_(options),
+		metadata_(options.capacity, options.max_age),
+		newest_metadata_(INT64_MIN)
+	{
+		stats_ = Stats();
+	}
+
+	void AddMetadata(int64_t timestamp, const std::string& metadata, int64_t now)
+	{
+		metadata_.Insert(timestamp, metadata);
+		if (timestamp > newest_metadata_)
+		{
+			newest_metadata_ = timestamp;
+		}
+
+		Pump(now);
+	}
+
+	// Decodes and adds a metadata message, returning false if it isn't one
+	bool AddMetadataMessage(const char* data, size_t size, int64_t now)
+	{
+		int64_t timestamp;
+		InputSpan payload;
+		if (!FrameMetadata::Decode(data, size, &timestamp, &payload))
+		{
+			return false;
+		}
+
+		AddMetadata(timestamp, payload.ToString(), now);
+		return true;
+	}
+
+	void AddFrame(int64_t timestamp, const T& frame, int64_t now)
+	{
+		Pending pending = { timestamp, frame, now };
+		frames_.push_back(pending);
+		Pump(now);
+	}
+
+	// Lets go of frames that have waited too long, which the caller does every so often in case
+	// nothing else arrives
+	void Expire(int64_t now)
+	{
+		Pump(now);
+	}
+
+	// Frames held waiting for their metadata
+	size_t pending() const
+	{
+		return frames_.size();
+	}
+
+	Stats stats() const
+	{
+		return stats_;
+	}
+
+	typename FrameCorrelator<std::string>::Stats metadata_stats() const
+	{
+		return metadata_.stats();
+	}
+
+private:
+	struct Pending
+	{
+		int64_t timestamp;
+		T frame;
+		int64_t added;
+	};
+
+	void Pump(int64_t now)
+	{
+		while (!frames_.empty())
+		{
+			auto& front = frames_.front();
+
+			std::string metadata;
+			if (metadata_.Take(front.timestamp, &metadata))
+			{
+				stats_.joined++;
+				deliver_(front.frame, &metadata);
+			}
+			else if (front.timestamp <= newest_metadata_ || now - front.added >= options_.max_wait)
+			{
+				stats_.unjoined++;
+				deliver_(front.frame, nullptr);
+			}
+			else
+			{
+				break;
+			}
+
+			frames_.pop_front();
+		}
+	}
+
+	Deliver deliver_;
+	Options options_;
+	FrameCorrelator<std::string> metadata_;
+	std::deque<Pending> frames_;
+	int64_t newest_metadata_;
+	Stats stats_;
+};
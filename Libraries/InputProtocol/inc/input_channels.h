@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+/// <summary>
+/// Splits data channel messages between an unreliable channel for high rate input and a
+/// reliable one for control
+/// </summary>
+/// <remarks>
+/// Camera transforms are sent many times a second and each supersedes the last, so losing one
+/// costs nothing, but waiting for one to be retransmitted delays every transform behind it.
+/// Everything else, eg. stereo-rendering or keyboard events, is sent once and must arrive, in
+/// order. Each side negotiates both channels and sends through this, which picks the channel
+/// by message type.
+///
+/// Older peers open a single channel, labelled like our unreliable one. Messages meant for a
+/// channel that isn't open go on the other one instead, so they still arrive, if less reliably.
+/// </remarks>
+class InputChannels
+{
+public:
+	enum Channel
+	{
+		// Unordered and never retransmitted, for camera transforms
+		UNRELIABLE,
+
+		// Ordered and retransmitted until delivered, for control and state sync
+		RELIABLE,
+
+		CHANNEL_COUNT
+	};
+
+	// Sends a message on an open channel, returning false if it couldn't, as when the channel is
+	// attached but not yet open
+	typedef std::function<bool(const char* data, size_t size)> Sender;
+
+	struct Stats
+	{
+		uint64_t sent[CHANNEL_COUNT];
+
+		// Messages sent on the other channel, because theirs wasn't attached or couldn't send
+		uint64_t fallbacks;
+
+		// Messages that couldn't be sent at all
+		uint64_t failed;
+	};
+
+	InputChannels();
+
+	// The label each channel is negotiated with
+	static const char* Label(Channel channel);
+
+	// Finds the channel negotiated as |label|, returning false if it isn't one of ours
+	static bool FromLabel(const std::string& label, Channel* channel);
+
+	static bool IsOrdered(Channel channel);
+
+	// The most times a message is retransmitted, or -1 for as many times as it takes
+	static int MaxRetransmits(Channel channel);
+
+	// The channel a message belongs on, by its type
+	static Channel Classify(const char* data, size_t size);
+
+	// Sends messages for |channel| through |sender|, once it's open
+	void Attach(Channel channel, const Sender& sender);
+
+	void Detach(Channel channel);
+
+	bool IsAttached(Channel channel) const;
+
+	// Sends a message on the channel it belongs on, or the other if that one isn't attached or
+	// can't send it
+	bool Send(const char* data, size_t size);
+
+	bool Send(const std::string& message);
+
+	Stats stats() const;
+
+private:
+	mutable std::mutex lock_;
+	Sender senders_[CHANNEL_COUNT];
+	Stats stats_;
+};
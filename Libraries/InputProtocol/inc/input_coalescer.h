@@ -0,0 +1,108 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "input_message_codec.h"
+
+/// <summary>
+/// Collapses bursts of input messages that supersede each other, before they're dispatched
+/// </summary>
+/// <remarks>
+/// Only the types passed to Coalesce are held back, eg. camera transforms, where only the newest
+/// one matters. Each peer has one slot per coalesced type: a message that arrives while the slot
+/// still holds an undelivered one replaces it, and is counted as superseded. Push returns false
+/// for every other type, which the caller dispatches straight away, so control messages are
+/// never dropped or reordered among themselves.
+///
+/// A coalesced type may also be given a minimum interval, in which case a peer's messages of
+/// that type are delivered at most once per interval, and the newest one waits for the next.
+///
+/// Push may be called from any thread, and Drain from one thread at a time. Coalesce isn't
+/// synchronized with either, so types should be set up before messages start to arrive.
+/// </remarks>
+class InputCoalescer
+{
+public:
+	typedef std::function<void(int peer_id, const char* data, size_t size)> Deliver;
+
+	struct Stats
+	{
+		// Messages of a coalesced type that were pushed
+		uint64_t received;
+
+		// Messages handed to Drain's callback
+		uint64_t delivered;
+
+		// Messages replaced by a newer one before they could be delivered
+		uint64_t superseded;
+	};
+
+	InputCoalescer();
+
+	// Coalesces messages of |type|, delivering at most one per peer every |min_interval_ms|
+	void Coalesce(const std::string& type, int64_t min_interval_ms = 0);
+
+	// Holds a message received from |peer_id|, returning false if its type isn't coalesced
+	bool Push(int peer_id, const char* data, size_t size);
+
+	// Delivers the held messages that are due at |now_ms|, oldest first, returning how many
+	size_t Drain(int64_t now_ms, const Deliver& deliver);
+
+	// The earliest time a held message will be due, or -1 if none are held
+	int64_t NextDue() const;
+
+	// Forgets the messages held for a peer that has gone
+	void RemovePeer(int peer_id);
+
+	Stats stats() const;
+
+private:
+	struct CoalescedType
+	{
+		std::string name;
+		int64_t min_interval_ms;
+	};
+
+	struct Slot
+	{
+		std::string data;
+		bool pending;
+
+		// When the slot first became pending, so bursts are delivered in the order they began
+		uint64_t order;
+		int64_t last_delivered_ms;
+	};
+
+	struct Delivery
+	{
+		int peer_id;
+		uint64_t order;
+		std::string data;
+	};
+
+	// The index of |type| in types_, or -1
+	int Find(const InputSpan& type) const;
+
+	// Whether |slot| of |type| may be delivered at |now_ms|, or else when
+	bool IsDue(const Slot& slot, int type, int64_t now_ms, int64_t* due_ms) const;
+
+	std::vector<CoalescedType> types_;
+
+	mutable std::mutex lock_;
+	std::map<std::pair<int, int>, Slot> slots_;
+	uint64_t next_order_;
+	size_t pending_;
+
+	// Kept between drains, so a steady stream of messages doesn't allocate
+	std::vector<Delivery> draining_;
+
+	uint64_t received_;
+	uint64_t delivered_;
+	uint64_t superseded_;
+};
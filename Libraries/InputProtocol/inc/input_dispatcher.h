@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "input_message_codec.h"
+
+/// <summary>
+/// An input message, as handed to a handler
+/// </summary>
+/// <remarks>
+/// The spans point into the received buffer for inline handlers, and into the dispatcher's own
+/// copy for queued ones. Either way they're only valid for the duration of the call.
+/// </remarks>
+struct InputMessage
+{
+	int peer_id;
+
+	// The message type, eg. camera-transform-stereo
+	InputSpan type;
+
+	// The json body, still escaped, or the whole record for a binary message
+	InputSpan body;
+
+	// The message as it was received
+	InputSpan data;
+};
+
+/// <summary>
+/// Routes data channel input messages to handlers registered by message type
+/// </summary>
+/// <remarks>
+/// Registered types are kept in a perfect hash table, rebuilt on each registration, so a lookup
+/// is one hash and one compare regardless of how many types there are. Handlers are either run
+/// inline on the thread that received the message, or queued until the owning thread (usually
+/// the render loop) calls ProcessQueued.
+///
+/// Register and Unregister aren't synchronized with Dispatch, so handlers should be registered
+/// before messages start to arrive.
+/// </remarks>
+class InputDispatcher
+{
+public:
+	enum DispatchMode
+	{
+		// Run on the thread that called Dispatch, without copying the message
+		INLINE,
+
+		// Copied and run by the next call to ProcessQueued
+		QUEUED
+	};
+
+	typedef std::function<void(const InputMessage&)> Handler;
+
+	struct Stats
+	{
+		// Messages handed to an inline handler, or queued for one
+		uint64_t dispatched;
+
+		// Messages run by ProcessQueued
+		uint64_t processed;
+
+		// Messages with no registered handler
+		uint64_t unhandled;
+	};
+
+	InputDispatcher();
+
+	// Registers |handler| for messages of |type|, replacing any handler it already has
+	void Register(const std::string& type, const Handler& handler, DispatchMode mode = INLINE);
+
+	void Unregister(const std::string& type);
+
+	// Routes a message received from |peer_id|, returning false if no handler wants it
+	bool Dispatch(int peer_id, const char* data, size_t size);
+
+	// Runs the handlers queued since the last call, returning how many ran
+	size_t ProcessQueued();
+
+	// The number of registered types
+	size_t size() const;
+
+	Stats stats() const;
+
+private:
+	struct Entry
+	{
+		std::string type;
+		Handler handler;
+		DispatchMode mode;
+	};
+
+	struct QueuedMessage
+	{
+		int peer_id;
+		std::shared_ptr<const Entry> entry;
+		std::string data;
+	};
+
+	static uint32_t Hash(uint32_t seed, const char* data, size_t size);
+
+	// Returns the registered entry for |type|, or null
+	const std::shared_ptr<const Entry>* Find(const InputSpan& type) const;
+
+	// Finds a seed and table size with no collisions between the registered types
+	void Rebuild();
+
+	std::vector<std::shared_ptr<const Entry>> entries_;
+
+	// Indexes into entries_, or -1 for an empty slot
+	std::vector<int> table_;
+	uint32_t seed_;
+	uint32_t mask_;
+
+	std::mutex queue_lock_;
+	std::vector<QueuedMessage> queue_;
+	std::vector<QueuedMessage> processing_;
+
+	std::atomic<uint64_t> dispatched_;
+	std::atomic<uint64_t> processed_;
+	std::atomic<uint64_t> unhandled_;
+};
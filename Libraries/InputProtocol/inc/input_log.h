@@ -0,0 +1,121 @@
+#pragma once
+
+#include <condition_variable>
+#include <fstream>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// A data channel message read back from an input log
+/// </summary>
+struct InputLogRecord
+{
+	int peer_id;
+
+	// Microseconds since the first message in the log
+	int64_t time_us;
+
+	std::string data;
+};
+
+/// <summary>
+/// Records every data channel message a server receives, with its timing, to replay later
+/// </summary>
+/// <remarks>
+/// A log is an 8 byte header, "3DIL" then a version byte and 3 reserved ones, followed by one
+/// record per message:
+///
+///   varint  microseconds since the previous record, or 0 for the first
+///   varint  peer id, zigzag encoded
+///   varint  message size
+///   bytes   the message, as received
+///
+/// Varints are little endian base 128, as in protobuf, so a camera transform costs 3 or 4 bytes
+/// on top of the message. Write only appends to a buffer, so recording never waits on the disk;
+/// a thread of the writer's own writes and flushes the buffer every flush_interval_ms, or sooner
+/// once it fills, so a log cut short by a crash loses at most that long's records. Thread safe.
+/// </remarks>
+class InputLogWriter
+{
+public:
+	struct Options
+	{
+		// The most time a record waits before it's flushed
+		int flush_interval_ms;
+
+		// How many bytes of records wake the writer thread before the interval is up
+		size_t flush_bytes;
+
+		Options() :
+			flush_interval_ms(100),
+			flush_bytes(64 * 1024)
+		{
+		}
+	};
+
+	struct Stats
+	{
+		uint64_t records;
+
+		// Bytes written, including the header
+		uint64_t bytes;
+	};
+
+	InputLogWriter(const Options& options = Options());
+
+	~InputLogWriter();
+
+	// Starts a log at |path|, replacing any file there, returning false if it can't be created
+	bool Open(const std::string& path);
+
+	// Starts a log on |stream|, which must outlive the writer or the next Close
+	void Open(std::ostream* stream);
+
+	// Writes out everything recorded so far, and closes the log
+	void Close();
+
+	bool IsOpen() const;
+
+	// Records a message received from |peer_id| at |time_us|, if a log is open
+	void Write(int peer_id, int64_t time_us, const char* data, size_t size);
+
+	Stats stats() const;
+
+private:
+	void Start(std::ostream* stream);
+
+	void FlushLoop();
+
+	Options options_;
+	mutable std::mutex lock_;
+	std::condition_variable wake_;
+	std::unique_ptr<std::ofstream> file_;
+	std::ostream* out_;
+	int64_t last_time_us_;
+	bool started_;
+	bool stopping_;
+
+	// Records not yet written, swapped with writing_ by the writer thread, so neither allocates per message
+	std::string pending_;
+	std::string writing_;
+	std::thread thread_;
+	Stats stats_;
+};
+
+/// <summary>
+/// Reads back a log written by InputLogWriter
+/// </summary>
+class InputLogReader
+{
+public:
+	// Reads every complete record in |in|, returning false if it isn't an input log. A record
+	// cut short at the end of the log is ignored.
+	static bool Read(std::istream& in, std::vector<InputLogRecord>* records);
+
+	static bool Read(const std::string& path, std::vector<InputLogRecord>* records);
+};
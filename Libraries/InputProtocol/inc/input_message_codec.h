@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/// <summary>
+/// A view into a received message, which is never copied
+/// </summary>
+struct InputSpan
+{
+	const char* data;
+	size_t size;
+
+	InputSpan() : data(nullptr), size(0) {}
+
+	InputSpan(const char* data, size_t size) : data(data), size(size) {}
+
+	bool Equals(const char* value) const;
+
+	std::string ToString() const { return std::string(data, size); }
+};
+
+/// <summary>
+/// A stereo camera transform, sent by a client every frame
+/// </summary>
+struct CameraTransform
+{
+	enum Kind
+	{
+		// camera-transform-stereo
+		STEREO = 1,
+
+		// camera-transform-stereo-prediction
+		STEREO_PREDICTION = 2
+	};
+
+	Kind kind;
+
+	// 4x4 matrices in row major order, laid out like DirectX::XMFLOAT4X4::m
+	float projection_left[16];
+	float view_left[16];
+	float projection_right[16];
+	float view_right[16];
+
+	// The client's prediction timestamp, only meaningful for STEREO_PREDICTION
+	int64_t timestamp;
+
+	// Increases by one with each message from a client, or 0 for json messages without one
+	uint32_t sequence;
+
+	CameraTransform();
+};
+
+/// <summary>
+/// Encodes and decodes camera transform input messages, in binary or the json they replace
+/// </summary>
+/// <remarks>
+/// A binary message is a fixed layout, little endian record:
+///
+///   offset  size  field
+///   0       1     kMagic
+///   1       1     version, currently kVersion
+///   2       1     CameraTransform::Kind
+///   3       1     the number of matrices that follow, currently 4
+///   4       4     sequence number
+///   8       8     prediction timestamp
+///   16      256   left projection, left view, right projection, right view, 16 floats each
+///
+/// Later versions may only append fields, so a decoder reads the fields it knows and ignores
+/// any trailing bytes. A data channel message starting with kMagic can't be json, which is
+/// how the two are told apart.
+///
+/// The json form is {"type":"camera-transform-stereo[-prediction]","body":"<64 floats>[,<timestamp>]"},
+/// as older clients send. It is decoded without building a json document. Any json input message
+/// may also carry a top level "sequence" number, for clients that measure latency.
+/// </remarks>
+class InputMessageCodec
+{
+public:
+	static const uint8_t kMagic = 0xC7;
+
+	static const uint8_t kVersion = 1;
+
+	// The size of a version 1 binary camera transform message, in bytes
+	static const size_t kCameraTransformSize = 16 + 4 * 16 * sizeof(float);
+
+	// Encodes |transform| in binary
+	static std::string Encode(const CameraTransform& transform);
+
+	// Encodes |transform| as json, for peers that don't understand binary
+	static std::string EncodeJson(const CameraTransform& transform);
+
+	// Returns true if |data| is a binary input message
+	static bool IsBinary(const char* data, size_t size);
+
+	// Decodes a camera transform in either form, returning false for anything else
+	static bool Decode(const char* data, size_t size, CameraTransform* transform);
+
+	// Finds the type and body of any input message without decoding it. A binary message is typed
+	// by its kind and its body is the whole record. The spans point into |data|, and json bodies
+	// are left escaped.
+	static bool DecodeEnvelope(const char* data, size_t size, InputSpan* type, InputSpan* body);
+
+	// Finds the sequence number of any input message, returning false if it doesn't carry one
+	static bool DecodeSequence(const char* data, size_t size, uint32_t* sequence);
+
+	// Returns the json message type used for |kind|
+	static const char* TypeName(CameraTransform::Kind kind);
+
+private:
+	static bool DecodeBinary(const char* data, size_t size, CameraTransform* transform);
+
+	static bool DecodeJson(const char* data, size_t size, CameraTransform* transform);
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "input_log.h"
+
+/// <summary>
+/// Feeds a recorded input session back to any number of synthetic peers
+/// </summary>
+/// <remarks>
+/// Each synthetic peer replays one recorded peer's messages, going round the recorded peers in
+/// order of id, so recording two headsets and replaying to ten gives five copies of each. Each
+/// synthetic peer starts |stagger_us| after the one before, so copies don't move in lockstep.
+///
+/// Advance delivers by session time, which a test can step through, and Run paces the same
+/// thing against a clock, at real time or faster. Either way the messages, and the order they're
+/// delivered in, are the same every time. Not synchronized.
+/// </remarks>
+class InputReplayer
+{
+public:
+	typedef std::function<void(int peer_id, const char* data, size_t size)> Deliver;
+
+	struct Options
+	{
+		// The number of synthetic peers
+		int peers;
+
+		// The id of the first synthetic peer, the rest following on
+		int first_peer_id;
+
+		// How much later each synthetic peer starts than the one before, in session time
+		int64_t stagger_us;
+
+		// How many times faster than recorded Run replays, or 0 for as fast as it can
+		double speed;
+
+		Options() : peers(1), first_peer_id(1), stagger_us(0), speed(1.0) {}
+	};
+
+	InputReplayer(const std::vector<InputLogRecord>& records, const Options& options = Options());
+
+	// Delivers every message due by |session_us| into the replay, returning how many
+	size_t Advance(int64_t session_us, const Deliver& deliver);
+
+	// The session time the next message is due at, or -1 once every message has been delivered
+	int64_t NextDue() const;
+
+	// Replays the rest of the session at the configured speed, blocking until it's done or
+	// |stop| is set, and returning how many messages were delivered
+	size_t Run(const Deliver& deliver, const std::atomic_bool* stop = nullptr);
+
+	// Starts again from the beginning
+	void Rewind();
+
+	// The session time of the last message
+	int64_t duration_us() const;
+
+	// The number of messages the whole replay delivers
+	size_t size() const;
+
+	const Options& options() const;
+
+private:
+	struct Cursor
+	{
+		int peer_id;
+		int64_t offset_us;
+
+		// The recorded peer it replays, and the index of the next of its messages to deliver
+		size_t recorded_peer;
+		size_t next;
+	};
+
+	int64_t DueAt(const Cursor& cursor) const;
+
+	// Orders the heap so the cursor due first, or with the lowest peer id among those due at
+	// once, is on top
+	bool DueAfter(const Cursor& a, const Cursor& b) const;
+
+	std::vector<InputLogRecord> records_;
+	Options options_;
+
+	// Each recorded peer's messages, in the order they were received
+	std::vector<std::vector<size_t>> recorded_peers_;
+
+	// The cursors with messages left, as a min heap by when their next one is due
+	std::vector<Cursor> heap_;
+
+	// The session time delivered up to
+	int64_t position_us_;
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "frame_correlator.h"
+#include "input_message_codec.h"
+
+/// <summary>
+/// Counts latencies in buckets of roughly 6% precision, from a microsecond to days
+/// </summary>
+/// <remarks>
+/// Values under 32 get a bucket each, and every power of two above that is split into 16
+/// buckets, so memory is fixed and adding is a few shifts.
+/// </remarks>
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void Add(int64_t value);
+
+	// The value below which |percentile| percent of those added fall, or 0 if there are none
+	int64_t Percentile(double percentile) const;
+
+	uint64_t count() const { return count_; }
+	int64_t min() const { return count_ == 0 ? 0 : min_; }
+	int64_t max() const { return max_; }
+	double mean() const { return count_ == 0 ? 0 : static_cast<double>(sum_) / count_; }
+
+	void Reset();
+
+private:
+	static const int kLinearBuckets = 32;
+	static const int kSubBuckets = 16;
+	static const int kBuckets = 640;
+
+	static int BucketOf(int64_t value);
+
+	// The middle of the values in |bucket|
+	static int64_t ValueOf(int bucket);
+
+	uint64_t buckets_[kBuckets];
+	uint64_t count_;
+	int64_t sum_;
+	int64_t min_;
+	int64_t max_;
+};
+
+/// <summary>
+/// Follows input messages through the streaming pipeline, to measure motion to photon latency
+/// </summary>
+/// <remarks>
+/// Each input is identified by the sequence number the client stamps it with, which is carried
+/// in the input message and in the server's ServerLatency report, never in the frame's prediction
+/// timestamp. Each stage records the time it saw the sequence number, and when one is presented,
+/// the time spent between each pair of stages is added to a histogram. Inputs the server coalesced
+/// away, or frames that were lost, never get presented and are counted as incomplete once their
+/// slot is reused.
+///
+/// Times are in microseconds on one clock. When the server doesn't share the client's, as it only
+/// does in a loopback test, it reports its stages as spans from receiving the input instead, and
+/// RecordServer places them assuming the network took as long each way. Stages may record from
+/// any thread.
+/// </remarks>
+class LatencyRecorder
+{
+public:
+	enum Stage
+	{
+		INPUT_SENT,
+		SERVER_RECEIVED,
+		RENDER_STARTED,
+		ENCODE_DONE,
+		CLIENT_DECODED,
+		PRESENTED,
+		STAGE_COUNT
+	};
+
+	// Remembers up to |capacity| inputs in flight
+	LatencyRecorder(size_t capacity = 1024);
+
+	void Record(uint32_t sequence, Stage stage, int64_t time_us);
+
+	// Records the server's stages for |sequence| as the microseconds from SERVER_RECEIVED to
+	// RENDER_STARTED and to ENCODE_DONE, measured on the server's clock. They're placed between
+	// INPUT_SENT and CLIENT_DECODED once the input is presented, unless they were recorded directly.
+	void RecordServer(uint32_t sequence, int64_t render_us, int64_t encode_us);
+
+	// The time spent reaching |stage| from the stage before it, or from INPUT_SENT to PRESENTED
+	// for the motion to photon latency
+	LatencyHistogram Segment(Stage stage) const;
+	LatencyHistogram MotionToPhoton() const;
+
+	// Inputs that were presented, and those that weren't before their slot was reused
+	uint64_t completed() const;
+	uint64_t incomplete() const;
+
+	// A percentile table of every segment, in milliseconds
+	std::string Report() const;
+
+	static const char* StageName(Stage stage);
+
+private:
+	struct Entry
+	{
+		uint32_t sequence;
+		bool used;
+
+		// Presented, after which only a new INPUT_SENT starts it again
+		bool done;
+		int64_t times[STAGE_COUNT];
+
+		// From RecordServer, or -1
+		int64_t render_us;
+		int64_t encode_us;
+	};
+
+	// The entry for |sequence|, started afresh if its slot held another input
+	Entry& Find(uint32_t sequence, Stage stage);
+
+	void Complete(Entry entry);
+
+	mutable std::mutex lock_;
+	std::vector<Entry> entries_;
+	LatencyHistogram segments_[STAGE_COUNT];
+	LatencyHistogram motion_to_photon_;
+	uint64_t completed_;
+	uint64_t incomplete_;
+};
+
+/// <summary>
+/// The time a server spent on one input, sent to the client when the frame showing it is encoded
+/// </summary>
+struct ServerLatency
+{
+	// The input's sequence number
+	uint32_t sequence;
+
+	// The prediction timestamp of the frame showing the input
+	int64_t timestamp;
+
+	// Microseconds from receiving the input to handing it to the renderer, and to the frame's
+	// encode finishing, on the server's clock
+	int32_t render_us;
+	int32_t encode_us;
+
+	ServerLatency() : sequence(0), timestamp(0), render_us(0), encode_us(0) {}
+};
+
+/// <summary>
+/// Encodes and decodes ServerLatency reports, for the data channel
+/// </summary>
+/// <remarks>
+/// A binary message sharing InputMessageCodec::kMagic, little endian:
+///
+///   offset  size  field
+///   0       1     InputMessageCodec::kMagic
+///   1       1     version, currently InputMessageCodec::kVersion
+///   2       1     kKind
+///   3       1     reserved, 0
+///   4       4     input sequence number
+///   8       8     frame prediction timestamp
+///   16      4     render span, in microseconds
+///   20      4     encode span, in microseconds
+///
+/// Like FrameMetadata, kKind isn't a CameraTransform::Kind, so it's sent on the reliable channel.
+/// </remarks>
+class LatencyReport
+{
+public:
+	static const uint8_t kKind = 0x81;
+
+	static const size_t kSize = 24;
+
+	static std::string Encode(const ServerLatency& latency);
+
+	// Returns true if |data| is a latency report
+	static bool IsLatencyReport(const char* data, size_t size);
+
+	static bool Decode(const char* data, size_t size, ServerLatency* latency);
+};
+
+/// <summary>
+/// Times a peer's inputs through a server, reporting each once the frame showing it is encoded
+/// </summary>
+/// <remarks>
+/// An input is received, then handed to the renderer unless a newer one superseded it first. The
+/// next frame sent shows the newest input handed over since the frame before, and is followed by
+/// its prediction timestamp to the encoder. Inputs no frame showed, and frames no encode finished
+/// for, are forgotten as newer ones take their place. May be called from any thread.
+/// </remarks>
+class ServerLatencyTracker
+{
+public:
+	// Follows up to |capacity| inputs, and as many frames
+	explicit ServerLatencyTracker(size_t capacity = 16);
+
+	void Received(uint32_t sequence, int64_t time_us);
+
+	void RenderStarted(uint32_t sequence, int64_t time_us);
+
+	// A frame with prediction timestamp |timestamp| was sent to the encoder
+	void FrameSent(int64_t timestamp);
+
+	// The frame with |timestamp| was encoded, returning true with the report of the input it
+	// shows, if there is one
+	bool EncodeDone(int64_t timestamp, int64_t time_us, ServerLatency* latency);
+
+private:
+	struct Input
+	{
+		uint32_t sequence;
+		int64_t received_us;
+		int64_t render_us;
+
+		Input() : sequence(0), received_us(-1), render_us(-1) {}
+	};
+
+	std::mutex lock_;
+	std::vector<Input> inputs_;
+	size_t next_input_;
+
+	// The newest input handed to the renderer since the last frame, if render_us isn't -1
+	Input rendered_;
+
+	FrameCorrelator<Input> frames_;
+};
+
+/// <summary>
+/// Measures motion to photon latency on a client, from its own stages and the server's reports
+/// </summary>
+/// <remarks>
+/// The client numbers its inputs as it sends them. Frames are known by their prediction timestamp
+/// until the server's report says which input each shows, which may arrive before or after the
+/// frame is decoded, so whichever comes first waits, in bounded memory, for the other. May be
+/// called from any thread.
+/// </remarks>
+class ClientLatencyTracker
+{
+public:
+	// Follows up to |capacity| inputs, and 64 frames waiting for their report
+	explicit ClientLatencyTracker(size_t capacity = 1024);
+
+	void InputSent(uint32_t sequence, int64_t time_us);
+
+	void AddReport(const ServerLatency& latency);
+
+	void FrameDecoded(int64_t timestamp, int64_t time_us);
+
+	void FramePresented(int64_t timestamp, int64_t time_us);
+
+	const LatencyRecorder& recorder() const { return recorder_; }
+
+private:
+	struct Frame
+	{
+		bool reported;
+		uint32_t sequence;
+		int64_t decoded_us;
+		int64_t presented_us;
+
+		Frame() : reported(false), sequence(0), decoded_us(-1), presented_us(-1) {}
+	};
+
+	// Records what's known of |frame|, keeping it until it's been reported and presented
+	void Update(int64_t timestamp, const Frame& frame);
+
+	std::mutex lock_;
+	LatencyRecorder recorder_;
+	FrameCorrelator<Frame> frames_;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "input_message_codec.h"
+
+/// <summary>
+/// Hands the newest value from a network thread to a render thread, without locks
+/// </summary>
+/// <remarks>
+/// A triple buffer: the publisher fills its back slot and swaps it with the middle one, and the
+/// consumer swaps its front slot with the middle one when that holds something new. Neither side
+/// ever waits for the other or sees a half written value. Values published in between two
+/// consumes are superseded, and counted as dropped.
+///
+/// Publishers are serialized with a flag, so several threads may publish, although each peer's
+/// data channel only ever publishes from one. Only one thread may consume.
+/// </remarks>
+template <typename T>
+class LatestMailbox
+{
+public:
+	struct Stats
+	{
+		uint64_t published;
+		uint64_t consumed;
+
+		// Values that were superseded before they could be consumed
+		uint64_t dropped;
+	};
+
+	LatestMailbox() :
+		middle_(1),
+		back_(0),
+		generation_(0),
+		front_(2),
+		last_consumed_(0),
+		published_(0),
+		consumed_(0),
+		dropped_(0)
+	{
+		publishing_.clear();
+		for (auto& slot : slots_)
+		{
+			slot.generation = 0;
+		}
+	}
+
+	// Replaces any value that hasn't been consumed yet with |value|
+	void Publish(const T& value)
+	{
+		while (publishing_.test_and_set(std::memory_order_acquire))
+		{
+		}
+
+		slots_[back_].value = value;
+		slots_[back_].generation = ++generation_;
+		back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+
+		publishing_.clear(std::memory_order_release);
+		published_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Takes the newest value published since the last call, returning false if there isn't one
+	bool Consume(T* value)
+	{
+		if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0)
+		{
+			return false;
+		}
+
+		front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+
+		const auto& slot = slots_[front_];
+		*value = slot.value;
+
+		dropped_.fetch_add(slot.generation - last_consumed_ - 1, std::memory_order_relaxed);
+		consumed_.fetch_add(1, std::memory_order_relaxed);
+		last_consumed_ = slot.generation;
+		return true;
+	}
+
+	Stats stats() const
+	{
+		Stats stats;
+		stats.published = published_.load(std::memory_order_relaxed);
+		stats.consumed = consumed_.load(std::memory_order_relaxed);
+		stats.dropped = dropped_.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+private:
+	// Set on the middle index when it holds a value the consumer hasn't seen
+	static const uint32_t kFresh = 4;
+	static const uint32_t kIndexMask = 3;
+
+	struct Slot
+	{
+		T value;
+
+		// Counts up from 1 with each publish, so the consumer can tell how many it missed
+		uint64_t generation;
+	};
+
+	Slot slots_[3];
+	std::atomic<uint32_t> middle_;
+
+	// Only touched while publishing_ is held
+	uint32_t back_;
+	uint64_t generation_;
+	std::atomic_flag publishing_;
+
+	// Only touched by the consumer
+	uint32_t front_;
+	uint64_t last_consumed_;
+
+	std::atomic<uint64_t> published_;
+	std::atomic<uint64_t> consumed_;
+	std::atomic<uint64_t> dropped_;
+};
+
+// The newest camera transform received from a peer
+typedef LatestMailbox<CameraTransform> PoseMailbox;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+
+#include "input_message_codec.h"
+
+/// <summary>
+/// Predicts where a peer's head will be, from the camera transforms it recently sent
+/// </summary>
+/// <remarks>
+/// Each eye's view matrix is split into a rotation and a camera position. Both are extrapolated
+/// at the velocity measured over the recent history: the position linearly, and the rotation by
+/// repeating the measured rotation about the same axis. Projections are taken from the newest
+/// transform as they are.
+///
+/// Times are in milliseconds on the server's clock, and only differences between them matter.
+/// </remarks>
+class PosePredictor
+{
+public:
+	struct Options
+	{
+		// How many transforms to remember
+		size_t history;
+
+		// Velocity is measured between the newest transform and the oldest one within this window
+		int64_t velocity_window_ms;
+
+		// How far past the newest transform we'll predict, after which the peer is considered gone
+		int64_t max_extrapolation_ms;
+
+		Options() :
+			history(8),
+			velocity_window_ms(50),
+			max_extrapolation_ms(200)
+		{
+		}
+	};
+
+	PosePredictor(const Options& options = Options());
+
+	// Records a transform received at |received_ms|. Transforms received out of order are ignored.
+	void Add(const CameraTransform& transform, int64_t received_ms);
+
+	// Predicts the transform at |time_ms|, returning false if there's nothing to predict from or
+	// the newest transform is too old. Only the pose is extrapolated: the timestamp stays the
+	// newest one the peer sent, as that's the only one it can match a frame to.
+	bool Predict(int64_t time_ms, CameraTransform* transform) const;
+
+	// The time the newest transform was received, or -1 if there isn't one
+	int64_t LastReceived() const;
+
+	void Reset();
+
+private:
+	struct Sample
+	{
+		CameraTransform transform;
+		int64_t received_ms;
+	};
+
+	Options options_;
+	std::deque<Sample> history_;
+};
@@ -0,0 +1,226 @@
+#include "frame_metadata.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+	template <typename T>
+	void Write(char* out, T value)
+	{
+		// little endian, like the rest of our binary messages
+		memcpy(out, &value, sizeof(T));
+	}
+
+	template <typename T>
+	T Read(const char* in)
+	{
+		T value;
+		memcpy(&value, in, sizeof(T));
+		return value;
+	}
+}
+
+const uint8_t FrameMetadata::kKind;
+const size_t FrameMetadata::kHeaderSize;
+
+std::string FrameMetadata::Encode(int64_t timestamp, const char* data, size_t size)
+{
+	std::string out(kHeaderSize + size, '\0');
+	auto p = &out[0];
+
+	Write<uint8_t>(p, InputMessageCodec::kMagic);
+	Write<uint8_t>(p + 1, InputMessageCodec::kVersion);
+	Write<uint8_t>(p + 2, kKind);
+	Write<uint32_t>(p + 4, static_cast<uint32_t>(size));
+	Write<int64_t>(p + 8, timestamp);
+
+	if (size > 0)
+	{
+		memcpy(p + kHeaderSize, data, size);
+	}
+
+	return out;
+}
+
+bool FrameMetadata::IsFrameMetadata(const char* data, size_t size)
+{
+	return size >= kHeaderSize &&
+		InputMessageCodec::IsBinary(data, size) &&
+		Read<uint8_t>(data + 2) == kKind;
+}
+
+bool FrameMetadata::Decode(const char* data, size_t size, int64_t* timestamp, InputSpan* payload)
+{
+	if (!IsFrameMetadata(data, size) || Read<uint8_t>(data + 1) < 1)
+	{
+		return false;
+	}
+
+	auto payload_size = Read<uint32_t>(data + 4);
+	if (payload_size > size - kHeaderSize)
+	{
+		return false;
+	}
+
+	*timestamp = Read<int64_t>(data + 8);
+	*payload = InputSpan(data + kHeaderSize, payload_size);
+	return true;
+}
+
+FrameMetadataQueue::FrameMetadataQueue(size_t capacity) :
+	capacity_(capacity > 0 ? capacity : 1)
+{
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+void FrameMetadataQueue::Push(int64_t timestamp, const std::string& metadata)
+{
+	auto message = FrameMetadata::Encode(timestamp, metadata.data(), metadata.size());
+
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.queued++;
+	while (messages_.size() >= capacity_)
+	{
+		messages_.pop_front();
+		stats_.dropped++;
+	}
+
+	messages_.push_back(std::move(message));
+}
+
+size_t FrameMetadataQueue::Drain(const Sender& send)
+{
+	size_t sent = 0;
+	for (;;)
+	{
+		// sending may block, so don't hold the lock over it
+		std::string message;
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			if (messages_.empty())
+			{
+				break;
+			}
+
+			message = std::move(messages_.front());
+			messages_.pop_front();
+		}
+
+		if (!send(message))
+		{
+			// put it back to try again later, unless newer messages have filled the queue meanwhile
+			std::lock_guard<std::mutex> lock(lock_);
+			if (messages_.size() < capacity_)
+			{
+				messages_.push_front(std::move(message));
+			}
+			else
+			{
+				stats_.dropped++;
+			}
+
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(lock_);
+		stats_.sent++;
+		sent++;
+	}
+
+	return sent;
+}
+
+size_t FrameMetadataQueue::size() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return messages_.size();
+}
+
+FrameMetadataQueue::Stats FrameMetadataQueue::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+FrameInputs::FrameInputs(size_t capacity) :
+	// frames are only evicted to make room, as prediction timestamps come in the client's units
+	inputs_(capacity, INT64_MAX)
+{
+}
+
+void FrameInputs::AddPose(const CameraTransform& pose)
+{
+	if (pose.kind != CameraTransform::STEREO_PREDICTION)
+	{
+		return;
+	}
+
+	auto message = InputMessageCodec::Encode(pose);
+
+	std::lock_guard<std::mutex> lock(lock_);
+	Inputs inputs;
+	inputs_.Take(pose.timestamp, &inputs);
+	inputs.pose = std::move(message);
+	inputs_.Insert(pose.timestamp, inputs);
+}
+
+void FrameInputs::AddMetadata(int64_t timestamp, const std::string& metadata)
+{
+	auto message = FrameMetadata::Encode(timestamp, metadata.data(), metadata.size());
+
+	std::lock_guard<std::mutex> lock(lock_);
+	Inputs inputs;
+	inputs_.Take(timestamp, &inputs);
+	inputs.metadata = std::move(message);
+	inputs_.Insert(timestamp, inputs);
+}
+
+std::string FrameInputs::Take(int64_t timestamp)
+{
+	Inputs inputs;
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		if (!inputs_.Take(timestamp, &inputs))
+		{
+			return std::string();
+		}
+	}
+
+	return inputs.pose + inputs.metadata;
+}
+
+bool FrameInputs::Split(const char* data, size_t size, CameraTransform* pose, bool* has_pose, std::string* metadata)
+{
+	*has_pose = false;
+	metadata->clear();
+
+	// the pose, if there is one, is a whole version 1 message
+	if (size >= InputMessageCodec::kCameraTransformSize && !FrameMetadata::IsFrameMetadata(data, size))
+	{
+		if (!InputMessageCodec::Decode(data, InputMessageCodec::kCameraTransformSize, pose))
+		{
+			return false;
+		}
+
+		*has_pose = true;
+		data += InputMessageCodec::kCameraTransformSize;
+		size -= InputMessageCodec::kCameraTransformSize;
+	}
+
+	if (size == 0)
+	{
+		return true;
+	}
+
+	int64_t timestamp;
+	InputSpan payload;
+	if (!FrameMetadata::Decode(data, size, &timestamp, &payload) ||
+		FrameMetadata::kHeaderSize + payload.size != size)
+	{
+		return false;
+	}
+
+	*metadata = payload.ToString();
+	return true;
+}
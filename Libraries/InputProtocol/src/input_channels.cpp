@@ -0,0 +1,115 @@
+#include "input_channels.h"
+
+#include <string.h>
+
+#include "input_message_codec.h"
+
+namespace
+{
+	// The unreliable channel keeps the label older peers give their single channel
+	const char* kLabels[] = { "inputDataChannel", "controlDataChannel" };
+
+	// Message types that are superseded by the next one, and so can be lost
+	const char kUnreliablePrefix[] = "camera-transform";
+}
+
+InputChannels::InputChannels()
+{
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+const char* InputChannels::Label(Channel channel)
+{
+	return kLabels[channel];
+}
+
+bool InputChannels::FromLabel(const std::string& label, Channel* channel)
+{
+	for (int i = 0; i < CHANNEL_COUNT; i++)
+	{
+		if (label == kLabels[i])
+		{
+			*channel = static_cast<Channel>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool InputChannels::IsOrdered(Channel channel)
+{
+	return channel == RELIABLE;
+}
+
+int InputChannels::MaxRetransmits(Channel channel)
+{
+	return channel == RELIABLE ? -1 : 0;
+}
+
+InputChannels::Channel InputChannels::Classify(const char* data, size_t size)
+{
+	InputSpan type;
+	InputSpan body;
+	if (!InputMessageCodec::DecodeEnvelope(data, size, &type, &body))
+	{
+		return RELIABLE;
+	}
+
+	auto prefix = sizeof(kUnreliablePrefix) - 1;
+	return type.size >= prefix && memcmp(type.data, kUnreliablePrefix, prefix) == 0 ?
+		UNRELIABLE : RELIABLE;
+}
+
+void InputChannels::Attach(Channel channel, const Sender& sender)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	senders_[channel] = sender;
+}
+
+void InputChannels::Detach(Channel channel)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	senders_[channel] = nullptr;
+}
+
+bool InputChannels::IsAttached(Channel channel) const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return static_cast<bool>(senders_[channel]);
+}
+
+bool InputChannels::Send(const char* data, size_t size)
+{
+	auto channel = Classify(data, size);
+	auto other = channel == RELIABLE ? UNRELIABLE : RELIABLE;
+
+	std::lock_guard<std::mutex> lock(lock_);
+	if (senders_[channel] && senders_[channel](data, size))
+	{
+		stats_.sent[channel]++;
+		return true;
+	}
+
+	// the channel isn't attached, or hasn't opened yet
+	if (senders_[other] && senders_[other](data, size))
+	{
+		stats_.fallbacks++;
+		stats_.sent[other]++;
+		return true;
+	}
+
+	stats_.failed++;
+	return false;
+}
+
+bool InputChannels::Send(const std::string& message)
+{
+	return Send(message.data(), message.size());
+}
+
+InputChannels::Stats InputChannels::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
@@ -0,0 +1,195 @@
+#include "input_coalescer.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+InputCoalescer::InputCoalescer() :
+	next_order_(0),
+	pending_(0),
+	received_(0),
+	delivered_(0),
+	superseded_(0)
+{
+}
+
+void InputCoalescer::Coalesce(const std::string& type, int64_t min_interval_ms)
+{
+	for (auto& existing : types_)
+	{
+		if (existing.name == type)
+		{
+			existing.min_interval_ms = min_interval_ms;
+			return;
+		}
+	}
+
+	CoalescedType coalesced;
+	coalesced.name = type;
+	coalesced.min_interval_ms = min_interval_ms;
+	types_.push_back(coalesced);
+}
+
+bool InputCoalescer::Push(int peer_id, const char* data, size_t size)
+{
+	if (types_.empty())
+	{
+		return false;
+	}
+
+	InputSpan type;
+	InputSpan body;
+	if (!InputMessageCodec::DecodeEnvelope(data, size, &type, &body))
+	{
+		return false;
+	}
+
+	auto index = Find(type);
+	if (index < 0)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	received_++;
+
+	auto inserted = slots_.insert(std::make_pair(std::make_pair(peer_id, index), Slot()));
+	auto& slot = inserted.first->second;
+	if (inserted.second)
+	{
+		slot.pending = false;
+		slot.last_delivered_ms = INT64_MIN;
+	}
+
+	if (slot.pending)
+	{
+		superseded_++;
+	}
+	else
+	{
+		slot.pending = true;
+		slot.order = next_order_++;
+		pending_++;
+	}
+
+	slot.data.assign(data, size);
+	return true;
+}
+
+size_t InputCoalescer::Drain(int64_t now_ms, const Deliver& deliver)
+{
+	size_t count = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		if (pending_ == 0)
+		{
+			return 0;
+		}
+
+		for (auto& pair : slots_)
+		{
+			auto& slot = pair.second;
+			int64_t due_ms = 0;
+			if (!slot.pending || !IsDue(slot, pair.first.second, now_ms, &due_ms))
+			{
+				continue;
+			}
+
+			if (count == draining_.size())
+			{
+				draining_.push_back(Delivery());
+			}
+
+			// swapping hands the slot the buffer we delivered from last time
+			auto& delivery = draining_[count++];
+			delivery.peer_id = pair.first.first;
+			delivery.order = slot.order;
+			delivery.data.swap(slot.data);
+
+			slot.pending = false;
+			slot.last_delivered_ms = now_ms;
+		}
+
+		pending_ -= count;
+		delivered_ += count;
+	}
+
+	std::sort(draining_.begin(), draining_.begin() + count, [](const Delivery& a, const Delivery& b)
+	{
+		return a.order < b.order;
+	});
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& delivery = draining_[i];
+		deliver(delivery.peer_id, delivery.data.data(), delivery.data.size());
+	}
+
+	return count;
+}
+
+int64_t InputCoalescer::NextDue() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	int64_t next = -1;
+	for (const auto& pair : slots_)
+	{
+		int64_t due_ms = 0;
+		if (pair.second.pending)
+		{
+			IsDue(pair.second, pair.first.second, INT64_MIN, &due_ms);
+			next = next < 0 || due_ms < next ? due_ms : next;
+		}
+	}
+
+	return next;
+}
+
+void InputCoalescer::RemovePeer(int peer_id)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto it = slots_.lower_bound(std::make_pair(peer_id, INT_MIN));
+	while (it != slots_.end() && it->first.first == peer_id)
+	{
+		pending_ -= it->second.pending ? 1 : 0;
+		it = slots_.erase(it);
+	}
+}
+
+InputCoalescer::Stats InputCoalescer::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	Stats stats;
+	stats.received = received_;
+	stats.delivered = delivered_;
+	stats.superseded = superseded_;
+	return stats;
+}
+
+int InputCoalescer::Find(const InputSpan& type) const
+{
+	for (size_t i = 0; i < types_.size(); i++)
+	{
+		const auto& name = types_[i].name;
+		if (name.size() == type.size && memcmp(name.data(), type.data, type.size) == 0)
+		{
+			return static_cast<int>(i);
+		}
+	}
+
+	return -1;
+}
+
+bool InputCoalescer::IsDue(const Slot& slot, int type, int64_t now_ms, int64_t* due_ms) const
+{
+	auto min_interval_ms = types_[type].min_interval_ms;
+	if (min_interval_ms <= 0 || slot.last_delivered_ms == INT64_MIN)
+	{
+		*due_ms = 0;
+		return true;
+	}
+
+	*due_ms = slot.last_delivered_ms + min_interval_ms;
+	return now_ms >= *due_ms;
+}
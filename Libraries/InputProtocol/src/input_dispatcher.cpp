@@ -0,0 +1,199 @@
+#include "input_dispatcher.h"
+
+#include <string.h>
+
+namespace
+{
+	// How many seeds we try at one table size before doubling it
+	const uint32_t kSeedsPerSize = 32;
+}
+
+InputDispatcher::InputDispatcher() :
+	table_(1, -1),
+	seed_(0),
+	mask_(0),
+	dispatched_(0),
+	processed_(0),
+	unhandled_(0)
+{
+}
+
+void InputDispatcher::Register(const std::string& type, const Handler& handler, DispatchMode mode)
+{
+	std::shared_ptr<Entry> entry(new Entry());
+	entry->type = type;
+	entry->handler = handler;
+	entry->mode = mode;
+
+	// messages already queued keep the handler they were queued for
+	for (auto& existing : entries_)
+	{
+		if (existing->type == type)
+		{
+			existing = entry;
+			Rebuild();
+			return;
+		}
+	}
+
+	entries_.push_back(entry);
+	Rebuild();
+}
+
+void InputDispatcher::Unregister(const std::string& type)
+{
+	for (auto it = entries_.begin(); it != entries_.end(); ++it)
+	{
+		if ((*it)->type == type)
+		{
+			entries_.erase(it);
+			Rebuild();
+			return;
+		}
+	}
+}
+
+bool InputDispatcher::Dispatch(int peer_id, const char* data, size_t size)
+{
+	InputSpan type;
+	InputSpan body;
+	const std::shared_ptr<const Entry>* entry = nullptr;
+	if (InputMessageCodec::DecodeEnvelope(data, size, &type, &body))
+	{
+		entry = Find(type);
+	}
+
+	if (entry == nullptr)
+	{
+		unhandled_++;
+		return false;
+	}
+
+	dispatched_++;
+
+	if ((*entry)->mode == QUEUED)
+	{
+		QueuedMessage queued;
+		queued.peer_id = peer_id;
+		queued.entry = *entry;
+		queued.data.assign(data, size);
+
+		std::lock_guard<std::mutex> lock(queue_lock_);
+		queue_.push_back(std::move(queued));
+		return true;
+	}
+
+	InputMessage message;
+	message.peer_id = peer_id;
+	message.type = type;
+	message.body = body;
+	message.data = InputSpan(data, size);
+
+	(*entry)->handler(message);
+	return true;
+}
+
+size_t InputDispatcher::ProcessQueued()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_lock_);
+		processing_.swap(queue_);
+	}
+
+	for (const auto& queued : processing_)
+	{
+		InputMessage message;
+		message.peer_id = queued.peer_id;
+		message.data = InputSpan(queued.data.data(), queued.data.size());
+
+		// the copy parses exactly as the original did
+		InputMessageCodec::DecodeEnvelope(message.data.data, message.data.size, &message.type, &message.body);
+		queued.entry->handler(message);
+	}
+
+	auto count = processing_.size();
+
+	// keep the capacity, so a steady stream of messages doesn't allocate
+	processing_.clear();
+
+	processed_ += count;
+	return count;
+}
+
+size_t InputDispatcher::size() const
+{
+	return entries_.size();
+}
+
+InputDispatcher::Stats InputDispatcher::stats() const
+{
+	Stats stats;
+	stats.dispatched = dispatched_.load();
+	stats.processed = processed_.load();
+	stats.unhandled = unhandled_.load();
+	return stats;
+}
+
+uint32_t InputDispatcher::Hash(uint32_t seed, const char* data, size_t size)
+{
+	// fnv-1a, with the seed mixed into the offset basis
+	uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 16777619u;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+const std::shared_ptr<const InputDispatcher::Entry>* InputDispatcher::Find(const InputSpan& type) const
+{
+	auto index = table_[Hash(seed_, type.data, type.size) & mask_];
+	if (index < 0)
+	{
+		return nullptr;
+	}
+
+	const auto& entry = entries_[index];
+	if (entry->type.size() != type.size || memcmp(entry->type.data(), type.data, type.size) != 0)
+	{
+		return nullptr;
+	}
+
+	return &entry;
+}
+
+void InputDispatcher::Rebuild()
+{
+	size_t size = 1;
+	while (size < entries_.size() * 2)
+	{
+		size *= 2;
+	}
+
+	for (;; size *= 2)
+	{
+		for (uint32_t seed = 0; seed < kSeedsPerSize; seed++)
+		{
+			std::vector<int> table(size, -1);
+			bool collided = false;
+
+			for (size_t i = 0; i < entries_.size() && !collided; i++)
+			{
+				const auto& type = entries_[i]->type;
+				auto& slot = table[Hash(seed, type.data(), type.size()) & (size - 1)];
+				collided = slot != -1;
+				slot = static_cast<int>(i);
+			}
+
+			if (!collided)
+			{
+				table_.swap(table);
+				seed_ = seed;
+				mask_ = static_cast<uint32_t>(size - 1);
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,258 @@
+#include "input_log.h"
+
+#include <chrono>
+#include <istream>
+#include <ostream>
+#include <string.h>
+
+namespace
+{
+	const char kMagic[] = { '3', 'D', 'I', 'L' };
+
+	const uint8_t kVersion = 1;
+
+	const size_t kHeaderSize = 8;
+
+	// Far bigger than any data channel message, so a bigger size means the log is corrupt
+	const uint64_t kMaxMessageSize = 1 << 24;
+
+	void AppendVarint(uint64_t value, std::string* out)
+	{
+		while (value >= 0x80)
+		{
+			out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+
+		out->push_back(static_cast<char>(value));
+	}
+
+	// Returns false at the end of |in|, or for a varint longer than 64 bits
+	bool ReadVarint(std::istream& in, uint64_t* value)
+	{
+		*value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			auto byte = in.get();
+			if (byte == std::char_traits<char>::eof())
+			{
+				return false;
+			}
+
+			*value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint64_t ZigZag(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t UnZigZag(uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+}
+
+InputLogWriter::InputLogWriter(const Options& options) :
+	options_(options),
+	out_(nullptr),
+	last_time_us_(0),
+	started_(false),
+	stopping_(false)
+{
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+InputLogWriter::~InputLogWriter()
+{
+	Close();
+}
+
+bool InputLogWriter::Open(const std::string& path)
+{
+	Close();
+
+	std::unique_ptr<std::ofstream> file(new std::ofstream(path, std::ios::binary | std::ios::trunc));
+	if (!file->good())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	file_ = std::move(file);
+	Start(file_.get());
+	return true;
+}
+
+void InputLogWriter::Open(std::ostream* stream)
+{
+	Close();
+
+	std::lock_guard<std::mutex> lock(lock_);
+	Start(stream);
+}
+
+void InputLogWriter::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stopping_ = true;
+		wake_.notify_all();
+	}
+
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+
+	// the writer thread is gone, so anything recorded since it last woke is ours to write
+	std::lock_guard<std::mutex> lock(lock_);
+	if (out_ != nullptr)
+	{
+		out_->write(pending_.data(), pending_.size());
+		out_->flush();
+	}
+
+	pending_.clear();
+	stopping_ = false;
+	out_ = nullptr;
+	file_.reset();
+}
+
+bool InputLogWriter::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return out_ != nullptr;
+}
+
+void InputLogWriter::Write(int peer_id, int64_t time_us, const char* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (out_ == nullptr)
+	{
+		return;
+	}
+
+	// messages from different threads may be timed slightly out of order
+	auto delta_us = started_ && time_us > last_time_us_ ? time_us - last_time_us_ : 0;
+	if (!started_ || time_us > last_time_us_)
+	{
+		last_time_us_ = time_us;
+	}
+
+	started_ = true;
+
+	auto before = pending_.size();
+	AppendVarint(static_cast<uint64_t>(delta_us), &pending_);
+	AppendVarint(ZigZag(peer_id), &pending_);
+	AppendVarint(size, &pending_);
+	pending_.append(data, size);
+
+	stats_.records++;
+	stats_.bytes += pending_.size() - before;
+
+	if (before < options_.flush_bytes && pending_.size() >= options_.flush_bytes)
+	{
+		wake_.notify_one();
+	}
+}
+
+InputLogWriter::Stats InputLogWriter::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+void InputLogWriter::Start(std::ostream* stream)
+{
+	out_ = stream;
+	started_ = false;
+	last_time_us_ = 0;
+	memset(&stats_, 0, sizeof(stats_));
+
+	char header[kHeaderSize] = { 0 };
+	memcpy(header, kMagic, sizeof(kMagic));
+	header[4] = static_cast<char>(kVersion);
+
+	out_->write(header, kHeaderSize);
+	out_->flush();
+	stats_.bytes += kHeaderSize;
+
+	thread_ = std::thread(&InputLogWriter::FlushLoop, this);
+}
+
+void InputLogWriter::FlushLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (!stopping_)
+	{
+		wake_.wait_for(lock, std::chrono::milliseconds(options_.flush_interval_ms),
+			[this]() { return stopping_ || pending_.size() >= options_.flush_bytes; });
+
+		if (stopping_ || pending_.empty())
+		{
+			continue;
+		}
+
+		// only this thread writes until Close has joined it, so the stream is safe to use unlocked
+		writing_.swap(pending_);
+		auto out = out_;
+		lock.unlock();
+
+		out->write(writing_.data(), writing_.size());
+		out->flush();
+		writing_.clear();
+
+		lock.lock();
+	}
+}
+
+bool InputLogReader::Read(std::istream& in, std::vector<InputLogRecord>* records)
+{
+	char header[kHeaderSize];
+	if (!in.read(header, kHeaderSize) || memcmp(header, kMagic, sizeof(kMagic)) != 0 ||
+		static_cast<uint8_t>(header[4]) < 1)
+	{
+		return false;
+	}
+
+	int64_t time_us = 0;
+	for (;;)
+	{
+		uint64_t delta_us;
+		uint64_t peer_id;
+		uint64_t size;
+		if (!ReadVarint(in, &delta_us) || !ReadVarint(in, &peer_id) || !ReadVarint(in, &size) ||
+			size > kMaxMessageSize)
+		{
+			break;
+		}
+
+		InputLogRecord record;
+		record.data.resize(static_cast<size_t>(size));
+		if (size > 0 && !in.read(&record.data[0], static_cast<std::streamsize>(size)))
+		{
+			break;
+		}
+
+		time_us += static_cast<int64_t>(delta_us);
+		record.peer_id = static_cast<int>(UnZigZag(peer_id));
+		record.time_us = time_us;
+		records->push_back(std::move(record));
+	}
+
+	return true;
+}
+
+bool InputLogReader::Read(const std::string& path, std::vector<InputLogRecord>* records)
+{
+	std::ifstream file(path, std::ios::binary);
+	return file.good() && Read(file, records);
+}
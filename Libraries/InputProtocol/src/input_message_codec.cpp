@@ -0,0 +1,572 @@
+#include "input_message_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+	const char kStereoTypeName[] = "camera-transform-stereo";
+	const char kStereoPredictionTypeName[] = "camera-transform-stereo-prediction";
+
+	// The number of matrices in a stereo camera transform
+	const int kMatrixCount = 4;
+
+	// The size of the fixed binary header, in bytes
+	const size_t kHeaderSize = 16;
+
+	// A view into |data|, which we never copy
+	struct Span
+	{
+		const char* begin;
+		const char* end;
+
+		bool Equals(const char* value) const
+		{
+			auto length = strlen(value);
+			return static_cast<size_t>(end - begin) == length && memcmp(begin, value, length) == 0;
+		}
+	};
+
+	const char* SkipWhitespace(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		{
+			p++;
+		}
+
+		return p;
+	}
+
+	// Reads the raw contents of the string starting at |p|, without unescaping them. Our message
+	// types and bodies never contain escapes, so anything that does simply won't match.
+	const char* ReadString(const char* p, const char* end, Span* value)
+	{
+		if (p >= end || *p != '"')
+		{
+			return nullptr;
+		}
+
+		value->begin = ++p;
+		while (p < end && *p != '"')
+		{
+			p += *p == '\\' ? 2 : 1;
+		}
+
+		if (p >= end)
+		{
+			return nullptr;
+		}
+
+		value->end = p;
+		return p + 1;
+	}
+
+	// Skips over any json value, including nested objects and arrays
+	const char* SkipValue(const char* p, const char* end)
+	{
+		Span ignored;
+		if (p < end && *p == '"')
+		{
+			return ReadString(p, end, &ignored);
+		}
+
+		int depth = 0;
+		while (p < end)
+		{
+			if (*p == '"')
+			{
+				p = ReadString(p, end, &ignored);
+				if (p == nullptr)
+				{
+					return nullptr;
+				}
+
+				continue;
+			}
+
+			if (*p == '{' || *p == '[')
+			{
+				depth++;
+			}
+			else if (*p == '}' || *p == ']')
+			{
+				if (depth == 0)
+				{
+					return p;
+				}
+
+				depth--;
+			}
+			else if (*p == ',' && depth == 0)
+			{
+				return p;
+			}
+
+			p++;
+		}
+
+		return depth == 0 ? p : nullptr;
+	}
+
+	// Reads the digits of the unsigned number starting at |p|
+	const char* ReadDigits(const char* p, const char* end, Span* value)
+	{
+		value->begin = p;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			p++;
+		}
+
+		value->end = p;
+		return p == value->begin ? nullptr : p;
+	}
+
+	// Parses digits read by ReadDigits, which needn't be followed by anything in the message
+	uint32_t ParseDigits(const Span& digits)
+	{
+		uint32_t value = 0;
+		for (auto p = digits.begin; p < digits.end; p++)
+		{
+			value = value * 10 + (*p - '0');
+		}
+
+		return value;
+	}
+
+	// Finds the top level "type" and "body" string fields of a json object, and its "sequence"
+	// number if |sequence| isn't null, which is left empty if there's none
+	bool FindTypeAndBody(const char* data, size_t size, Span* type, Span* body, Span* sequence = nullptr)
+	{
+		auto end = data + size;
+		auto p = SkipWhitespace(data, end);
+		bool has_type = false;
+		bool has_body = false;
+
+		if (p >= end || *p != '{')
+		{
+			return false;
+		}
+
+		p = SkipWhitespace(p + 1, end);
+		while (p != nullptr && p < end && *p != '}')
+		{
+			Span name;
+			p = ReadString(p, end, &name);
+			if (p == nullptr)
+			{
+				return false;
+			}
+
+			p = SkipWhitespace(p, end);
+			if (p >= end || *p != ':')
+			{
+				return false;
+			}
+
+			p = SkipWhitespace(p + 1, end);
+			if (name.Equals("type") && p < end && *p == '"')
+			{
+				p = ReadString(p, end, type);
+				has_type = p != nullptr;
+			}
+			else if (name.Equals("body") && p < end && *p == '"')
+			{
+				p = ReadString(p, end, body);
+				has_body = p != nullptr;
+			}
+			else if (sequence != nullptr && name.Equals("sequence") && p < end && *p >= '0' && *p <= '9')
+			{
+				p = ReadDigits(p, end, sequence);
+			}
+			else
+			{
+				p = SkipValue(p, end);
+			}
+
+			if (p == nullptr)
+			{
+				return false;
+			}
+
+			p = SkipWhitespace(p, end);
+			if (p < end && *p == ',')
+			{
+				p = SkipWhitespace(p + 1, end);
+			}
+		}
+
+		return has_type && has_body;
+	}
+
+	// Powers of ten that a double holds exactly
+	const double kExactPowersOfTen[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// Parses a plain decimal with at most 15 significant digits, which covers everything clients
+	// send. Both the mantissa and the power of ten are exact doubles, so a single multiply or divide
+	// rounds correctly. Returns nullptr for anything else, leaving it to strtof.
+	const char* ParseShortDecimal(const char* p, const char* end, double* value)
+	{
+		bool negative = p < end && *p == '-';
+		if (negative || (p < end && *p == '+'))
+		{
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+
+		for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+		{
+			if (mantissa != 0 || *p != '0')
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits++;
+			}
+		}
+
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+			{
+				if (mantissa != 0 || *p != '0')
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits++;
+				}
+
+				exponent--;
+			}
+		}
+
+		if (!any || digits > 15)
+		{
+			return nullptr;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			auto q = p + 1;
+			bool negative_exponent = q < end && *q == '-';
+			if (negative_exponent || (q < end && *q == '+'))
+			{
+				q++;
+			}
+
+			int written = 0;
+			auto start = q;
+			for (; q < end && *q >= '0' && *q <= '9' && written < 1000; q++)
+			{
+				written = written * 10 + (*q - '0');
+			}
+
+			if (q == start || (q < end && *q >= '0' && *q <= '9'))
+			{
+				return nullptr;
+			}
+
+			exponent += negative_exponent ? -written : written;
+			p = q;
+		}
+
+		if (exponent < -22 || exponent > 22)
+		{
+			return nullptr;
+		}
+
+		*value = exponent < 0 ?
+			mantissa / kExactPowersOfTen[-exponent] :
+			mantissa * kExactPowersOfTen[exponent];
+
+		if (negative)
+		{
+			*value = -*value;
+		}
+
+		return p;
+	}
+
+	// Parses the next comma separated float in |body|, advancing |p| past it
+	bool ParseFloat(const char*& p, const Span& body, float* value)
+	{
+		double fast = 0;
+		const char* parsed = ParseShortDecimal(p, body.end, &fast);
+		if (parsed != nullptr)
+		{
+			*value = static_cast<float>(fast);
+		}
+		else
+		{
+			char* slow = nullptr;
+			*value = strtof(p, &slow);
+			parsed = slow;
+		}
+
+		if (parsed == p || parsed > body.end)
+		{
+			return false;
+		}
+
+		p = parsed < body.end && *parsed == ',' ? parsed + 1 : parsed;
+		return true;
+	}
+
+	void AppendFloats(const float* values, int count, std::string* out)
+	{
+		char buffer[32];
+		for (int i = 0; i < count; i++)
+		{
+			auto length = snprintf(buffer, sizeof(buffer), "%.9g,", values[i]);
+			out->append(buffer, length);
+		}
+	}
+
+	template <typename T>
+	void Write(char* out, T value)
+	{
+		// every platform we ship on is little endian, so this matches the wire format
+		memcpy(out, &value, sizeof(T));
+	}
+
+	template <typename T>
+	T Read(const char* in)
+	{
+		T value;
+		memcpy(&value, in, sizeof(T));
+		return value;
+	}
+}
+
+bool InputSpan::Equals(const char* value) const
+{
+	auto length = strlen(value);
+	return size == length && memcmp(data, value, length) == 0;
+}
+
+CameraTransform::CameraTransform() :
+	kind(STEREO),
+	timestamp(0),
+	sequence(0)
+{
+	memset(projection_left, 0, sizeof(projection_left));
+	memset(view_left, 0, sizeof(view_left));
+	memset(projection_right, 0, sizeof(projection_right));
+	memset(view_right, 0, sizeof(view_right));
+}
+
+const uint8_t InputMessageCodec::kMagic;
+const uint8_t InputMessageCodec::kVersion;
+const size_t InputMessageCodec::kCameraTransformSize;
+
+std::string InputMessageCodec::Encode(const CameraTransform& transform)
+{
+	std::string out(kCameraTransformSize, '\0');
+	auto p = &out[0];
+
+	Write<uint8_t>(p, kMagic);
+	Write<uint8_t>(p + 1, kVersion);
+	Write<uint8_t>(p + 2, static_cast<uint8_t>(transform.kind));
+	Write<uint8_t>(p + 3, kMatrixCount);
+	Write<uint32_t>(p + 4, transform.sequence);
+	Write<int64_t>(p + 8, transform.timestamp);
+
+	p += kHeaderSize;
+	for (auto matrix : { transform.projection_left, transform.view_left, transform.projection_right, transform.view_right })
+	{
+		memcpy(p, matrix, 16 * sizeof(float));
+		p += 16 * sizeof(float);
+	}
+
+	return out;
+}
+
+std::string InputMessageCodec::EncodeJson(const CameraTransform& transform)
+{
+	std::string out;
+	out.reserve(1024);
+
+	out.append("{\"type\":\"");
+	out.append(TypeName(transform.kind));
+	out.append("\",\"body\":\"");
+
+	AppendFloats(transform.projection_left, 16, &out);
+	AppendFloats(transform.view_left, 16, &out);
+	AppendFloats(transform.projection_right, 16, &out);
+	AppendFloats(transform.view_right, 16, &out);
+
+	if (transform.kind == CameraTransform::STEREO_PREDICTION)
+	{
+		out.append(std::to_string(transform.timestamp));
+	}
+
+	out.append("\"}");
+
+	return out;
+}
+
+bool InputMessageCodec::IsBinary(const char* data, size_t size)
+{
+	return size > 0 && static_cast<uint8_t>(data[0]) == kMagic;
+}
+
+bool InputMessageCodec::Decode(const char* data, size_t size, CameraTransform* transform)
+{
+	return IsBinary(data, size) ? DecodeBinary(data, size, transform) : DecodeJson(data, size, transform);
+}
+
+bool InputMessageCodec::DecodeEnvelope(const char* data, size_t size, InputSpan* type, InputSpan* body)
+{
+	if (IsBinary(data, size))
+	{
+		if (size < 3)
+		{
+			return false;
+		}
+
+		auto kind = Read<uint8_t>(data + 2);
+		if (kind != CameraTransform::STEREO && kind != CameraTransform::STEREO_PREDICTION)
+		{
+			return false;
+		}
+
+		auto name = TypeName(static_cast<CameraTransform::Kind>(kind));
+		*type = InputSpan(name, strlen(name));
+		*body = InputSpan(data, size);
+		return true;
+	}
+
+	Span type_span = { nullptr, nullptr };
+	Span body_span = { nullptr, nullptr };
+	if (!FindTypeAndBody(data, size, &type_span, &body_span))
+	{
+		return false;
+	}
+
+	*type = InputSpan(type_span.begin, type_span.end - type_span.begin);
+	*body = InputSpan(body_span.begin, body_span.end - body_span.begin);
+	return true;
+}
+
+bool InputMessageCodec::DecodeSequence(const char* data, size_t size, uint32_t* sequence)
+{
+	if (IsBinary(data, size))
+	{
+		// every binary message has the fixed header, but only camera transforms number it
+		if (size < kHeaderSize)
+		{
+			return false;
+		}
+
+		auto kind = Read<uint8_t>(data + 2);
+		if (kind != CameraTransform::STEREO && kind != CameraTransform::STEREO_PREDICTION)
+		{
+			return false;
+		}
+
+		*sequence = Read<uint32_t>(data + 4);
+		return true;
+	}
+
+	Span type = { nullptr, nullptr };
+	Span body = { nullptr, nullptr };
+	Span digits = { nullptr, nullptr };
+	if (!FindTypeAndBody(data, size, &type, &body, &digits) || digits.begin == nullptr)
+	{
+		return false;
+	}
+
+	*sequence = ParseDigits(digits);
+	return true;
+}
+
+const char* InputMessageCodec::TypeName(CameraTransform::Kind kind)
+{
+	return kind == CameraTransform::STEREO_PREDICTION ? kStereoPredictionTypeName : kStereoTypeName;
+}
+
+bool InputMessageCodec::DecodeBinary(const char* data, size_t size, CameraTransform* transform)
+{
+	if (size < kCameraTransformSize ||
+		Read<uint8_t>(data + 1) < 1 ||
+		Read<uint8_t>(data + 3) != kMatrixCount)
+	{
+		return false;
+	}
+
+	auto kind = Read<uint8_t>(data + 2);
+	if (kind != CameraTransform::STEREO && kind != CameraTransform::STEREO_PREDICTION)
+	{
+		return false;
+	}
+
+	transform->kind = static_cast<CameraTransform::Kind>(kind);
+	transform->sequence = Read<uint32_t>(data + 4);
+	transform->timestamp = Read<int64_t>(data + 8);
+
+	auto p = data + kHeaderSize;
+	for (auto matrix : { transform->projection_left, transform->view_left, transform->projection_right, transform->view_right })
+	{
+		memcpy(matrix, p, 16 * sizeof(float));
+		p += 16 * sizeof(float);
+	}
+
+	return true;
+}
+
+bool InputMessageCodec::DecodeJson(const char* data, size_t size, CameraTransform* transform)
+{
+	Span type = { nullptr, nullptr };
+	Span body = { nullptr, nullptr };
+	Span sequence = { nullptr, nullptr };
+	if (!FindTypeAndBody(data, size, &type, &body, &sequence))
+	{
+		return false;
+	}
+
+	if (type.Equals(kStereoPredictionTypeName))
+	{
+		transform->kind = CameraTransform::STEREO_PREDICTION;
+	}
+	else if (type.Equals(kStereoTypeName))
+	{
+		transform->kind = CameraTransform::STEREO;
+	}
+	else
+	{
+		return false;
+	}
+
+	// the body always ends at a quote, so the number parsers can't run past it
+	auto p = body.begin;
+	for (auto matrix : { transform->projection_left, transform->view_left, transform->projection_right, transform->view_right })
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			if (!ParseFloat(p, body, &matrix[i]))
+			{
+				return false;
+			}
+		}
+	}
+
+	transform->sequence = sequence.begin != nullptr ? ParseDigits(sequence) : 0;
+	transform->timestamp = 0;
+
+	if (transform->kind == CameraTransform::STEREO_PREDICTION)
+	{
+		char* parsed = nullptr;
+		transform->timestamp = strtoll(p, &parsed, 10);
+		if (parsed == p || parsed > body.end)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,149 @@
+#include "input_replayer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+
+InputReplayer::InputReplayer(const std::vector<InputLogRecord>& records, const Options& options) :
+	records_(records),
+	options_(options),
+	position_us_(0)
+{
+	std::map<int, size_t> peer_indexes;
+	for (size_t i = 0; i < records_.size(); i++)
+	{
+		peer_indexes.insert(std::make_pair(records_[i].peer_id, 0));
+	}
+
+	// number the recorded peers in order of id, however their first messages were ordered
+	size_t index = 0;
+	for (auto& peer : peer_indexes)
+	{
+		peer.second = index++;
+	}
+
+	recorded_peers_.resize(peer_indexes.size());
+	for (size_t i = 0; i < records_.size(); i++)
+	{
+		recorded_peers_[peer_indexes[records_[i].peer_id]].push_back(i);
+	}
+
+	Rewind();
+}
+
+size_t InputReplayer::Advance(int64_t session_us, const Deliver& deliver)
+{
+	auto after = [this](const Cursor& a, const Cursor& b) { return DueAfter(a, b); };
+
+	size_t delivered = 0;
+	while (!heap_.empty() && DueAt(heap_.front()) <= session_us)
+	{
+		std::pop_heap(heap_.begin(), heap_.end(), after);
+		auto& cursor = heap_.back();
+		const auto& messages = recorded_peers_[cursor.recorded_peer];
+		const auto& record = records_[messages[cursor.next++]];
+		deliver(cursor.peer_id, record.data.data(), record.data.size());
+		delivered++;
+
+		if (cursor.next < messages.size())
+		{
+			std::push_heap(heap_.begin(), heap_.end(), after);
+		}
+		else
+		{
+			heap_.pop_back();
+		}
+	}
+
+	position_us_ = std::max(position_us_, session_us);
+	return delivered;
+}
+
+int64_t InputReplayer::NextDue() const
+{
+	return heap_.empty() ? -1 : DueAt(heap_.front());
+}
+
+size_t InputReplayer::Run(const Deliver& deliver, const std::atomic_bool* stop)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto start_us = position_us_;
+
+	size_t delivered = 0;
+	while (!heap_.empty() && (stop == nullptr || !stop->load()))
+	{
+		auto due_us = NextDue();
+		if (options_.speed > 0)
+		{
+			auto wait_us = static_cast<int64_t>((due_us - start_us) / options_.speed);
+			std::this_thread::sleep_until(start + std::chrono::microseconds(wait_us));
+		}
+
+		delivered += Advance(due_us, deliver);
+	}
+
+	return delivered;
+}
+
+void InputReplayer::Rewind()
+{
+	heap_.clear();
+	position_us_ = 0;
+	if (recorded_peers_.empty())
+	{
+		return;
+	}
+
+	for (int i = 0; i < options_.peers; i++)
+	{
+		Cursor cursor;
+		cursor.peer_id = options_.first_peer_id + i;
+		cursor.offset_us = options_.stagger_us * i;
+		cursor.recorded_peer = i % recorded_peers_.size();
+		cursor.next = 0;
+		heap_.push_back(cursor);
+	}
+
+	std::make_heap(heap_.begin(), heap_.end(), [this](const Cursor& a, const Cursor& b) { return DueAfter(a, b); });
+}
+
+int64_t InputReplayer::duration_us() const
+{
+	int64_t duration_us = 0;
+	for (int i = 0; i < options_.peers && !recorded_peers_.empty(); i++)
+	{
+		const auto& messages = recorded_peers_[i % recorded_peers_.size()];
+		duration_us = std::max(duration_us, records_[messages.back()].time_us + options_.stagger_us * i);
+	}
+
+	return duration_us;
+}
+
+size_t InputReplayer::size() const
+{
+	size_t size = 0;
+	for (int i = 0; i < options_.peers && !recorded_peers_.empty(); i++)
+	{
+		size += recorded_peers_[i % recorded_peers_.size()].size();
+	}
+
+	return size;
+}
+
+const InputReplayer::Options& InputReplayer::options() const
+{
+	return options_;
+}
+
+int64_t InputReplayer::DueAt(const Cursor& cursor) const
+{
+	return records_[recorded_peers_[cursor.recorded_peer][cursor.next]].time_us + cursor.offset_us;
+}
+
+bool InputReplayer::DueAfter(const Cursor& a, const Cursor& b) const
+{
+	auto a_us = DueAt(a);
+	auto b_us = DueAt(b);
+	return a_us != b_us ? a_us > b_us : a.peer_id > b.peer_id;
+}
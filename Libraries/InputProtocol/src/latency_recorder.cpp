@@ -0,0 +1,469 @@
+#include "latency_recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	template <typename T>
+	void Write(char* out, T value)
+	{
+		// little endian, like the rest of our binary messages
+		memcpy(out, &value, sizeof(T));
+	}
+
+	template <typename T>
+	T Read(const char* in)
+	{
+		T value;
+		memcpy(&value, in, sizeof(T));
+		return value;
+	}
+
+	// Frames are only forgotten to make room, since we don't know the units of their timestamps
+	const int64_t kNoMaxAge = INT64_MAX;
+}
+
+const int LatencyHistogram::kLinearBuckets;
+const int LatencyHistogram::kSubBuckets;
+const int LatencyHistogram::kBuckets;
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+void LatencyHistogram::Add(int64_t value)
+{
+	value = value < 0 ? 0 : value;
+	buckets_[BucketOf(value)]++;
+	min_ = count_ == 0 || value < min_ ? value : min_;
+	max_ = value > max_ ? value : max_;
+	sum_ += value;
+	count_++;
+}
+
+int64_t LatencyHistogram::Percentile(double percentile) const
+{
+	if (count_ == 0)
+	{
+		return 0;
+	}
+
+	auto rank = static_cast<uint64_t>(percentile / 100 * count_ + 0.5);
+	rank = rank < 1 ? 1 : rank > count_ ? count_ : rank;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < kBuckets; i++)
+	{
+		seen += buckets_[i];
+		if (seen >= rank)
+		{
+			// a bucket's middle can lie outside what was actually added
+			auto value = ValueOf(i);
+			return value < min_ ? min_ : value > max_ ? max_ : value;
+		}
+	}
+
+	return max_;
+}
+
+void LatencyHistogram::Reset()
+{
+	memset(buckets_, 0, sizeof(buckets_));
+	count_ = 0;
+	sum_ = 0;
+	min_ = 0;
+	max_ = 0;
+}
+
+int LatencyHistogram::BucketOf(int64_t value)
+{
+	if (value < kLinearBuckets)
+	{
+		return static_cast<int>(value);
+	}
+
+	int msb = 0;
+	while ((value >> (msb + 1)) != 0)
+	{
+		msb++;
+	}
+
+	// the top five bits pick a bucket within the power of two
+	auto bucket = (msb - 4) * kSubBuckets + static_cast<int>(value >> (msb - 4));
+	return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+int64_t LatencyHistogram::ValueOf(int bucket)
+{
+	if (bucket < kLinearBuckets)
+	{
+		return bucket;
+	}
+
+	auto shift = bucket / kSubBuckets - 1;
+	auto lower = static_cast<int64_t>(bucket % kSubBuckets + kSubBuckets) << shift;
+	return lower + (static_cast<int64_t>(1) << shift) / 2;
+}
+
+LatencyRecorder::LatencyRecorder(size_t capacity) :
+	entries_(capacity),
+	completed_(0),
+	incomplete_(0)
+{
+	for (auto& entry : entries_)
+	{
+		entry.sequence = 0;
+		entry.used = false;
+		entry.done = true;
+		entry.render_us = -1;
+		entry.encode_us = -1;
+	}
+}
+
+void LatencyRecorder::Record(uint32_t sequence, Stage stage, int64_t time_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto& entry = Find(sequence, stage);
+	if (entry.done)
+	{
+		return;
+	}
+
+	entry.times[stage] = time_us;
+	if (stage == PRESENTED)
+	{
+		entry.done = true;
+		Complete(entry);
+	}
+}
+
+void LatencyRecorder::RecordServer(uint32_t sequence, int64_t render_us, int64_t encode_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto& entry = Find(sequence, SERVER_RECEIVED);
+	if (!entry.done)
+	{
+		entry.render_us = render_us;
+		entry.encode_us = encode_us;
+	}
+}
+
+LatencyHistogram LatencyRecorder::Segment(Stage stage) const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return segments_[stage];
+}
+
+LatencyHistogram LatencyRecorder::MotionToPhoton() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return motion_to_photon_;
+}
+
+uint64_t LatencyRecorder::completed() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return completed_;
+}
+
+uint64_t LatencyRecorder::incomplete() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	uint64_t pending = 0;
+	for (const auto& entry : entries_)
+	{
+		pending += entry.done ? 0 : 1;
+	}
+
+	return incomplete_ + pending;
+}
+
+std::string LatencyRecorder::Report() const
+{
+	auto row = [](std::string* report, const std::string& name, const LatencyHistogram& histogram)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "%-34s %8llu %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+			name.c_str(),
+			static_cast<unsigned long long>(histogram.count()),
+			histogram.Percentile(50) / 1000.0,
+			histogram.Percentile(90) / 1000.0,
+			histogram.Percentile(99) / 1000.0,
+			histogram.Percentile(99.9) / 1000.0,
+			histogram.max() / 1000.0);
+
+		report->append(line);
+	};
+
+	std::string report;
+	char header[256];
+	snprintf(header, sizeof(header), "%-34s %8s %8s %8s %8s %8s %8s\n",
+		"segment (ms)", "count", "p50", "p90", "p99", "p99.9", "max");
+	report.append(header);
+
+	std::lock_guard<std::mutex> lock(lock_);
+	for (int stage = SERVER_RECEIVED; stage < STAGE_COUNT; stage++)
+	{
+		row(&report, std::string(StageName(static_cast<Stage>(stage - 1))) + " -> " +
+			StageName(static_cast<Stage>(stage)), segments_[stage]);
+	}
+
+	row(&report, "motion to photon", motion_to_photon_);
+	return report;
+}
+
+const char* LatencyRecorder::StageName(Stage stage)
+{
+	switch (stage)
+	{
+	case INPUT_SENT:
+		return "input sent";
+	case SERVER_RECEIVED:
+		return "server received";
+	case RENDER_STARTED:
+		return "render started";
+	case ENCODE_DONE:
+		return "encode done";
+	case CLIENT_DECODED:
+		return "client decoded";
+	case PRESENTED:
+		return "presented";
+	default:
+		return "unknown";
+	}
+}
+
+LatencyRecorder::Entry& LatencyRecorder::Find(uint32_t sequence, Stage stage)
+{
+	auto& entry = entries_[sequence % entries_.size()];
+	if (!entry.used || entry.sequence != sequence || (entry.done && stage == INPUT_SENT))
+	{
+		if (!entry.done)
+		{
+			incomplete_++;
+		}
+
+		entry.sequence = sequence;
+		entry.used = true;
+		entry.done = false;
+		entry.render_us = -1;
+		entry.encode_us = -1;
+		for (auto& time : entry.times)
+		{
+			time = -1;
+		}
+	}
+
+	return entry;
+}
+
+void LatencyRecorder::Complete(Entry entry)
+{
+	completed_++;
+
+	// the server's stages are on its own clock, so they're placed halfway along the round trip
+	// that's left once its span is taken out, as if the network took as long each way
+	if (entry.encode_us >= 0 && entry.times[SERVER_RECEIVED] < 0 &&
+		entry.times[INPUT_SENT] >= 0 && entry.times[CLIENT_DECODED] >= 0)
+	{
+		auto network = (entry.times[CLIENT_DECODED] - entry.times[INPUT_SENT] - entry.encode_us) / 2;
+		auto received = entry.times[INPUT_SENT] + (network > 0 ? network : 0);
+		entry.times[SERVER_RECEIVED] = received;
+		entry.times[RENDER_STARTED] = entry.render_us >= 0 ? received + entry.render_us : -1;
+		entry.times[ENCODE_DONE] = received + entry.encode_us;
+	}
+
+	// a stage that wasn't recorded is folded into the segment after it
+	auto previous = entry.times[INPUT_SENT] >= 0 ? INPUT_SENT : STAGE_COUNT;
+	for (int stage = SERVER_RECEIVED; stage < STAGE_COUNT; stage++)
+	{
+		if (entry.times[stage] < 0)
+		{
+			continue;
+		}
+
+		if (previous != STAGE_COUNT)
+		{
+			segments_[stage].Add(entry.times[stage] - entry.times[previous]);
+		}
+
+		previous = static_cast<Stage>(stage);
+	}
+
+	if (entry.times[INPUT_SENT] >= 0)
+	{
+		motion_to_photon_.Add(entry.times[PRESENTED] - entry.times[INPUT_SENT]);
+	}
+}
+
+const uint8_t LatencyReport::kKind;
+const size_t LatencyReport::kSize;
+
+std::string LatencyReport::Encode(const ServerLatency& latency)
+{
+	std::string out(kSize, '\0');
+	auto p = &out[0];
+
+	Write<uint8_t>(p, InputMessageCodec::kMagic);
+	Write<uint8_t>(p + 1, InputMessageCodec::kVersion);
+	Write<uint8_t>(p + 2, kKind);
+	Write<uint32_t>(p + 4, latency.sequence);
+	Write<int64_t>(p + 8, latency.timestamp);
+	Write<int32_t>(p + 16, latency.render_us);
+	Write<int32_t>(p + 20, latency.encode_us);
+	return out;
+}
+
+bool LatencyReport::IsLatencyReport(const char* data, size_t size)
+{
+	return size >= kSize &&
+		InputMessageCodec::IsBinary(data, size) &&
+		Read<uint8_t>(data + 2) == kKind;
+}
+
+bool LatencyReport::Decode(const char* data, size_t size, ServerLatency* latency)
+{
+	if (!IsLatencyReport(data, size) || Read<uint8_t>(data + 1) < 1)
+	{
+		return false;
+	}
+
+	latency->sequence = Read<uint32_t>(data + 4);
+	latency->timestamp = Read<int64_t>(data + 8);
+	latency->render_us = Read<int32_t>(data + 16);
+	latency->encode_us = Read<int32_t>(data + 20);
+	return true;
+}
+
+ServerLatencyTracker::ServerLatencyTracker(size_t capacity) :
+	inputs_(capacity > 0 ? capacity : 1),
+	next_input_(0),
+	frames_(capacity, kNoMaxAge)
+{
+}
+
+void ServerLatencyTracker::Received(uint32_t sequence, int64_t time_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto& input = inputs_[next_input_];
+	next_input_ = (next_input_ + 1) % inputs_.size();
+
+	input.sequence = sequence;
+	input.received_us = time_us;
+	input.render_us = -1;
+}
+
+void ServerLatencyTracker::RenderStarted(uint32_t sequence, int64_t time_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	for (auto& input : inputs_)
+	{
+		if (input.received_us >= 0 && input.sequence == sequence)
+		{
+			input.render_us = time_us;
+			rendered_ = input;
+
+			// the same sequence number may come round again
+			input.received_us = -1;
+			return;
+		}
+	}
+}
+
+void ServerLatencyTracker::FrameSent(int64_t timestamp)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (rendered_.render_us < 0)
+	{
+		return;
+	}
+
+	frames_.Insert(timestamp, rendered_);
+	rendered_ = Input();
+}
+
+bool ServerLatencyTracker::EncodeDone(int64_t timestamp, int64_t time_us, ServerLatency* latency)
+{
+	Input input;
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		if (!frames_.Take(timestamp, &input))
+		{
+			return false;
+		}
+	}
+
+	latency->sequence = input.sequence;
+	latency->timestamp = timestamp;
+	latency->render_us = static_cast<int32_t>(input.render_us - input.received_us);
+	latency->encode_us = static_cast<int32_t>(time_us - input.received_us);
+	return true;
+}
+
+ClientLatencyTracker::ClientLatencyTracker(size_t capacity) :
+	recorder_(capacity),
+	frames_(64, kNoMaxAge)
+{
+}
+
+void ClientLatencyTracker::InputSent(uint32_t sequence, int64_t time_us)
+{
+	recorder_.Record(sequence, LatencyRecorder::INPUT_SENT, time_us);
+}
+
+void ClientLatencyTracker::AddReport(const ServerLatency& latency)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	Frame frame;
+	frames_.Take(latency.timestamp, &frame);
+	frame.reported = true;
+	frame.sequence = latency.sequence;
+	recorder_.RecordServer(latency.sequence, latency.render_us, latency.encode_us);
+	Update(latency.timestamp, frame);
+}
+
+void ClientLatencyTracker::FrameDecoded(int64_t timestamp, int64_t time_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	Frame frame;
+	frames_.Take(timestamp, &frame);
+	frame.decoded_us = time_us;
+	Update(timestamp, frame);
+}
+
+void ClientLatencyTracker::FramePresented(int64_t timestamp, int64_t time_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	Frame frame;
+	frames_.Take(timestamp, &frame);
+	frame.presented_us = time_us;
+	Update(timestamp, frame);
+}
+
+void ClientLatencyTracker::Update(int64_t timestamp, const Frame& frame)
+{
+	if (!frame.reported)
+	{
+		frames_.Insert(timestamp, frame);
+		return;
+	}
+
+	if (frame.decoded_us >= 0)
+	{
+		recorder_.Record(frame.sequence, LatencyRecorder::CLIENT_DECODED, frame.decoded_us);
+	}
+
+	// presenting completes the input, so the frame is done with
+	if (frame.presented_us >= 0)
+	{
+		recorder_.Record(frame.sequence, LatencyRecorder::PRESENTED, frame.presented_us);
+		return;
+	}
+
+	// decoding is recorded, but the frame still waits to be presented
+	auto waiting = frame;
+	waiting.decoded_us = -1;
+	frames_.Insert(timestamp, waiting);
+}
@@ -0,0 +1,233 @@
+#include "pose_predictor.h"
+
+#include <math.h>
+
+namespace
+{
+	// A rotation, matching the upper 3x3 of a row major matrix
+	struct Quaternion
+	{
+		double w;
+		double x;
+		double y;
+		double z;
+	};
+
+	Quaternion Multiply(const Quaternion& a, const Quaternion& b)
+	{
+		Quaternion q;
+		q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+		q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+		q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+		q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+		return q;
+	}
+
+	Quaternion Conjugate(const Quaternion& q)
+	{
+		Quaternion conjugate = { q.w, -q.x, -q.y, -q.z };
+		return conjugate;
+	}
+
+	Quaternion Normalize(const Quaternion& q)
+	{
+		auto length = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+		Quaternion normalized = { q.w / length, q.x / length, q.y / length, q.z / length };
+		return normalized;
+	}
+
+	Quaternion FromMatrix(const float* m)
+	{
+		auto r = [m](int row, int column) { return static_cast<double>(m[row * 4 + column]); };
+
+		Quaternion q;
+		auto trace = r(0, 0) + r(1, 1) + r(2, 2);
+		if (trace > 0)
+		{
+			auto s = sqrt(trace + 1.0) * 2;
+			q.w = 0.25 * s;
+			q.x = (r(2, 1) - r(1, 2)) / s;
+			q.y = (r(0, 2) - r(2, 0)) / s;
+			q.z = (r(1, 0) - r(0, 1)) / s;
+		}
+		else if (r(0, 0) > r(1, 1) && r(0, 0) > r(2, 2))
+		{
+			auto s = sqrt(1.0 + r(0, 0) - r(1, 1) - r(2, 2)) * 2;
+			q.w = (r(2, 1) - r(1, 2)) / s;
+			q.x = 0.25 * s;
+			q.y = (r(0, 1) + r(1, 0)) / s;
+			q.z = (r(0, 2) + r(2, 0)) / s;
+		}
+		else if (r(1, 1) > r(2, 2))
+		{
+			auto s = sqrt(1.0 + r(1, 1) - r(0, 0) - r(2, 2)) * 2;
+			q.w = (r(0, 2) - r(2, 0)) / s;
+			q.x = (r(0, 1) + r(1, 0)) / s;
+			q.y = 0.25 * s;
+			q.z = (r(1, 2) + r(2, 1)) / s;
+		}
+		else
+		{
+			auto s = sqrt(1.0 + r(2, 2) - r(0, 0) - r(1, 1)) * 2;
+			q.w = (r(1, 0) - r(0, 1)) / s;
+			q.x = (r(0, 2) + r(2, 0)) / s;
+			q.y = (r(1, 2) + r(2, 1)) / s;
+			q.z = 0.25 * s;
+		}
+
+		return Normalize(q);
+	}
+
+	void ToMatrix(const Quaternion& q, float* m)
+	{
+		m[0] = static_cast<float>(1 - 2 * (q.y * q.y + q.z * q.z));
+		m[1] = static_cast<float>(2 * (q.x * q.y - q.z * q.w));
+		m[2] = static_cast<float>(2 * (q.x * q.z + q.y * q.w));
+		m[4] = static_cast<float>(2 * (q.x * q.y + q.z * q.w));
+		m[5] = static_cast<float>(1 - 2 * (q.x * q.x + q.z * q.z));
+		m[6] = static_cast<float>(2 * (q.y * q.z - q.x * q.w));
+		m[8] = static_cast<float>(2 * (q.x * q.z - q.y * q.w));
+		m[9] = static_cast<float>(2 * (q.y * q.z + q.x * q.w));
+		m[10] = static_cast<float>(1 - 2 * (q.x * q.x + q.y * q.y));
+	}
+
+	// Repeats the rotation |q| |times| times, which needn't be whole, about the same axis
+	Quaternion Power(Quaternion q, double times)
+	{
+		// take the short way round
+		if (q.w < 0)
+		{
+			q = { -q.w, -q.x, -q.y, -q.z };
+		}
+
+		auto half_angle = acos(q.w > 1.0 ? 1.0 : q.w);
+		auto sine = sin(half_angle);
+		if (sine < 1e-9)
+		{
+			Quaternion identity = { 1, 0, 0, 0 };
+			return identity;
+		}
+
+		auto scaled = half_angle * times;
+		auto axis_scale = sin(scaled) / sine;
+		Quaternion result = { cos(scaled), q.x * axis_scale, q.y * axis_scale, q.z * axis_scale };
+		return result;
+	}
+
+	// Views are row major, for row vectors, so the translation row is the camera position
+	// multiplied by the negated rotation
+	void CameraPosition(const float* view, double* position)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			position[j] = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				position[j] -= static_cast<double>(view[12 + k]) * view[j * 4 + k];
+			}
+		}
+	}
+
+	void ExtrapolateView(const float* older, const float* newer, double times, float* out)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			out[i] = newer[i];
+		}
+
+		auto from = FromMatrix(older);
+		auto to = FromMatrix(newer);
+		auto rotation = Normalize(Multiply(Power(Multiply(to, Conjugate(from)), times), to));
+		ToMatrix(rotation, out);
+
+		double older_position[3];
+		double newer_position[3];
+		CameraPosition(older, older_position);
+		CameraPosition(newer, newer_position);
+
+		double position[3];
+		for (int j = 0; j < 3; j++)
+		{
+			position[j] = newer_position[j] + (newer_position[j] - older_position[j]) * times;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			double translation = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				translation -= position[j] * out[j * 4 + k];
+			}
+
+			out[12 + k] = static_cast<float>(translation);
+		}
+	}
+}
+
+PosePredictor::PosePredictor(const Options& options) :
+	options_(options)
+{
+}
+
+void PosePredictor::Add(const CameraTransform& transform, int64_t received_ms)
+{
+	if (!history_.empty() && received_ms < history_.back().received_ms)
+	{
+		return;
+	}
+
+	Sample sample;
+	sample.transform = transform;
+	sample.received_ms = received_ms;
+	history_.push_back(sample);
+
+	while (history_.size() > options_.history)
+	{
+		history_.pop_front();
+	}
+}
+
+bool PosePredictor::Predict(int64_t time_ms, CameraTransform* transform) const
+{
+	if (history_.empty() || time_ms - history_.back().received_ms > options_.max_extrapolation_ms)
+	{
+		return false;
+	}
+
+	const auto& newest = history_.back();
+	*transform = newest.transform;
+
+	// measure velocity against the oldest transform in the window, or failing that the one before
+	// the newest, so a single late packet doesn't leave us with nothing
+	const Sample* oldest = nullptr;
+	for (auto it = history_.rbegin() + 1; it != history_.rend(); ++it)
+	{
+		if (oldest != nullptr && newest.received_ms - it->received_ms > options_.velocity_window_ms)
+		{
+			break;
+		}
+
+		oldest = &*it;
+	}
+
+	if (oldest == nullptr || oldest->received_ms == newest.received_ms || time_ms <= newest.received_ms)
+	{
+		return true;
+	}
+
+	auto times = static_cast<double>(time_ms - newest.received_ms) / (newest.received_ms - oldest->received_ms);
+
+	ExtrapolateView(oldest->transform.view_left, newest.transform.view_left, times, transform->view_left);
+	ExtrapolateView(oldest->transform.view_right, newest.transform.view_right, times, transform->view_right);
+	return true;
+}
+
+int64_t PosePredictor::LastReceived() const
+{
+	return history_.empty() ? -1 : history_.back().received_ms;
+}
+
+void PosePredictor::Reset()
+{
+	history_.clear();
+}
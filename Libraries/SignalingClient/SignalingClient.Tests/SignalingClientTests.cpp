@@ -1,7 +1,22 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
 #include <gtest\gtest.h>
 #include <gmock\gmock.h>
 
+#include "connection_pool.h"
+#include "dns_cache.h"
 #include "peer_connection_client.h"
+#include "reconnect_policy.h"
+#include "signaling_codec.h"
+#include "signaling_endpoint_selector.h"
 #include "turn_credential_provider.h"
 
 #include "RtcEventLoop.h"
@@ -479,3 +494,1062 @@ TEST(SignalingClient, TurnCredentialProviderSuccess)
 		// rely on RAII to kill the loop
 	}
 }
+
+/// <summary>
+/// A manually advanced clock, so reconnect timing can be asserted deterministically
+/// </summary>
+struct FakeClock
+{
+	int64_t now_ms = 0;
+
+	ReconnectPolicy::Clock AsClock()
+	{
+		return [this]() { return now_ms; };
+	}
+};
+
+/// <summary>
+/// Validate that reconnect_policy backs off exponentially, within the jitter bounds, up to the cap
+/// </summary>
+TEST(SignalingClient, ReconnectPolicyExponentialBackoff)
+{
+	FakeClock clock;
+	ReconnectPolicy::Options options;
+	options.initial_delay_ms = 100;
+	options.max_delay_ms = 1000;
+	options.multiplier = 2.0;
+	options.jitter = 0.5;
+	options.failure_threshold = 0;
+
+	// lowest possible jitter sample gives the lower bound of each delay
+	ReconnectPolicy low(options, clock.AsClock(), []() { return 0.0; });
+
+	// highest possible jitter sample gives the upper bound of each delay
+	ReconnectPolicy high(options, clock.AsClock(), []() { return 0.999999; });
+
+	const int expected_base[] = { 100, 200, 400, 800, 1000, 1000 };
+	for (auto base : expected_base)
+	{
+		ASSERT_EQ(low.OnFailure(), base / 2);
+		ASSERT_NEAR(high.OnFailure(), base, 1);
+	}
+
+	ASSERT_EQ(low.state(), ReconnectPolicy::BACKING_OFF);
+	ASSERT_EQ(low.consecutive_failures(), 6);
+
+	// success resets the backoff
+	low.OnSuccess();
+	ASSERT_EQ(low.state(), ReconnectPolicy::CONNECTED);
+	ASSERT_EQ(low.OnFailure(), 50);
+}
+
+/// <summary>
+/// Validate that reconnect_policy only allows an attempt once the backoff delay has elapsed
+/// </summary>
+TEST(SignalingClient, ReconnectPolicyRespectsInjectedClock)
+{
+	FakeClock clock;
+	ReconnectPolicy::Options options;
+	options.initial_delay_ms = 200;
+	options.jitter = 0;
+
+	ReconnectPolicy policy(options, clock.AsClock(), []() { return 0.5; });
+
+	ASSERT_TRUE(policy.CanAttempt());
+	ASSERT_EQ(policy.OnFailure(), 200);
+	ASSERT_FALSE(policy.CanAttempt());
+
+	clock.now_ms += 150;
+	ASSERT_EQ(policy.TimeUntilNextAttempt(), 50);
+	ASSERT_FALSE(policy.CanAttempt());
+
+	clock.now_ms += 50;
+	ASSERT_TRUE(policy.CanAttempt());
+}
+
+/// <summary>
+/// Validate that reconnect_policy opens its circuit after repeated failures and half-opens after the cooldown
+/// </summary>
+TEST(SignalingClient, ReconnectPolicyCircuitBreaker)
+{
+	FakeClock clock;
+	ReconnectPolicy::Options options;
+	options.initial_delay_ms = 10;
+	options.jitter = 0;
+	options.failure_threshold = 3;
+	options.circuit_open_ms = 5000;
+
+	ReconnectPolicy policy(options, clock.AsClock(), []() { return 0.0; });
+
+	policy.OnFailure();
+	policy.OnFailure();
+	ASSERT_EQ(policy.state(), ReconnectPolicy::BACKING_OFF);
+
+	// third failure trips the breaker
+	ASSERT_EQ(policy.OnFailure(), 5000);
+	ASSERT_EQ(policy.state(), ReconnectPolicy::CIRCUIT_OPEN);
+
+	clock.now_ms += 4999;
+	ASSERT_FALSE(policy.CanAttempt());
+
+	// half-open probe is allowed once the cooldown passes, and a failed probe re-opens
+	clock.now_ms += 1;
+	ASSERT_TRUE(policy.CanAttempt());
+	policy.OnAttempt();
+	ASSERT_EQ(policy.OnFailure(), 5000);
+	ASSERT_EQ(policy.state(), ReconnectPolicy::CIRCUIT_OPEN);
+
+	// a successful probe closes the circuit
+	clock.now_ms += 5000;
+	policy.OnAttempt();
+	policy.OnSuccess();
+	ASSERT_EQ(policy.state(), ReconnectPolicy::CONNECTED);
+	ASSERT_EQ(policy.OnFailure(), 10);
+}
+
+/// <summary>
+/// Validate that a fleet of clients reconnecting to a flapping server spread their attempts out
+/// </summary>
+TEST(SignalingClient, ReconnectPolicyFlappingServerSpreadsLoad)
+{
+	const int kClients = 100;
+	const int64_t kServerDownUntilMs = 3000;
+
+	FakeClock clock;
+	ReconnectPolicy::Options options;
+	options.initial_delay_ms = 250;
+	options.max_delay_ms = 4000;
+	options.failure_threshold = 0;
+
+	// stand-in server: refuses everything until it comes back, counting attempts per tick
+	std::map<int64_t, int> attempts_per_tick;
+	auto serverAccepts = [&](int64_t now_ms)
+	{
+		attempts_per_tick[now_ms]++;
+		return now_ms >= kServerDownUntilMs;
+	};
+
+	std::mt19937 seed_engine(1234);
+	std::vector<ReconnectPolicy> policies;
+	std::vector<int64_t> next_attempt(kClients, 0);
+	for (int i = 0; i < kClients; i++)
+	{
+		auto engine = std::make_shared<std::mt19937>(seed_engine());
+		policies.emplace_back(options, clock.AsClock(), [engine]() { return std::uniform_real_distribution<double>(0.0, 1.0)(*engine); });
+	}
+
+	// step the simulation in 10ms ticks until everyone is back
+	int connected = 0;
+	while (connected < kClients && clock.now_ms < 60000)
+	{
+		for (int i = 0; i < kClients; i++)
+		{
+			auto& policy = policies[i];
+			if (policy.state() == ReconnectPolicy::CONNECTED || clock.now_ms < next_attempt[i])
+			{
+				continue;
+			}
+
+			policy.OnAttempt();
+			if (serverAccepts(clock.now_ms))
+			{
+				policy.OnSuccess();
+				connected++;
+			}
+			else
+			{
+				next_attempt[i] = clock.now_ms + policy.OnFailure();
+			}
+		}
+
+		clock.now_ms += 10;
+	}
+
+	ASSERT_EQ(connected, kClients);
+
+	// after the initial stampede, the fleet never retries in lockstep (a fixed delay would put all of them in one tick)
+	for (auto& tick : attempts_per_tick)
+	{
+		if (tick.first > 0)
+		{
+			EXPECT_LT(tick.second, kClients / 5) << "at " << tick.first << "ms";
+		}
+	}
+}
+
+/// <summary>
+/// A stand-in signaling server, answering the requests ScriptedSslCapableSocket sends it
+/// </summary>
+struct ScriptedSignalingServer
+{
+	ScriptedSignalingServer(int listen_port = 0) : port(listen_port), message_received(true, false) {}
+
+	// The port the server is reached on, where there's more than one
+	int port;
+
+	// Connects to refuse before taking connections again
+	int refuse_connects = 0;
+
+	// Statuses to answer waits with in turn, after which waits hang as they do with nothing to say
+	std::deque<int> wait_statuses;
+
+	int sign_ins = 0;
+	int waits = 0;
+	std::vector<string> messages;
+	rtc::Event message_received;
+
+	string Respond(const string& request)
+	{
+		if (request.find(" /sign_in") != string::npos)
+		{
+			sign_ins++;
+			return Response(200, "test,2,1\nother,1,1\n");
+		}
+		else if (request.find(" /wait") != string::npos)
+		{
+			waits++;
+			if (wait_statuses.empty())
+			{
+				return "";
+			}
+
+			// a notification that another peer signed in
+			auto status = wait_statuses.front();
+			wait_statuses.pop_front();
+			return Response(status, status == 200 ? "third,3,1\n" : "");
+		}
+		else if (request.find(" /message") != string::npos)
+		{
+			messages.push_back(request.substr(request.find("\r\n\r\n") + 4));
+			message_received.Set();
+			return Response(200, "");
+		}
+
+		return Response(404, "");
+	}
+
+	static string Response(int status, const string& body)
+	{
+		return "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error") +
+			"\r\nPragma: 2\r\nContent-Length: " + std::to_string(body.length()) +
+			"\r\nConnection: close\r\n\r\n" + body;
+	}
+};
+
+/// <summary>
+/// A fake socket that answers each request from a ScriptedSignalingServer, and can be refused
+/// </summary>
+class ScriptedSslCapableSocket : public FakeSslCapableSocket
+{
+public:
+	ScriptedSslCapableSocket(const std::vector<ScriptedSignalingServer*>& servers, const int& family, const bool& useSsl, std::weak_ptr<Thread> signalingThread) :
+		FakeSslCapableSocket("", family, useSsl, signalingThread),
+		servers_(servers),
+		server_(servers.front()),
+		refused_(false) {}
+
+	int Connect(const SocketAddress& addr) override
+	{
+		// the server on the port connected to, or the only one
+		server_ = servers_.front();
+		for (auto server : servers_)
+		{
+			if (server->port == addr.port())
+			{
+				server_ = server;
+			}
+		}
+
+		if (server_->refuse_connects == 0)
+		{
+			return FakeSslCapableSocket::Connect(addr);
+		}
+
+		// stays closed, and says why shortly after
+		server_->refuse_connects--;
+		refused_ = true;
+		if (auto marshalledThread = signaling_thread_.lock())
+		{
+			marshalledThread->PostDelayed(RTC_FROM_HERE, 10, this);
+		}
+
+		return 0;
+	}
+
+	int Send(const void* pv, size_t cb) override
+	{
+		data_str_ = server_->Respond(string(static_cast<const char*>(pv), cb));
+		data_pos_ = 0;
+		return FakeSslCapableSocket::Send(pv, cb);
+	}
+
+	void OnMessage(rtc::Message* msg) override
+	{
+		if (refused_)
+		{
+			refused_ = false;
+			RefireCloseEvent(this, WSAECONNREFUSED);
+			return;
+		}
+
+		FakeSslCapableSocket::OnMessage(msg);
+	}
+
+private:
+	std::vector<ScriptedSignalingServer*> servers_;
+	ScriptedSignalingServer* server_;
+	bool refused_;
+};
+
+class ScriptedSocketFactory : public SslCapableSocket::Factory
+{
+public:
+	ScriptedSocketFactory(ScriptedSignalingServer* server) : servers_({ server }) {}
+
+	ScriptedSocketFactory(const std::vector<ScriptedSignalingServer*>& servers) : servers_(servers) {}
+
+	unique_ptr<SslCapableSocket> Allocate(const int& family, const bool& useSsl, weak_ptr<Thread> signalingThread) override
+	{
+		families.push_back(family);
+		return make_unique<ScriptedSslCapableSocket>(servers_, family, useSsl, signalingThread);
+	}
+
+	// The address family of every socket allocated, in order
+	std::vector<int> families;
+
+private:
+	std::vector<ScriptedSignalingServer*> servers_;
+};
+
+/// <summary>
+/// A reconnect policy that retries quickly and opens its circuit after three failures in a row
+/// </summary>
+ReconnectPolicy FastReconnectPolicy()
+{
+	ReconnectPolicy::Options options;
+	options.initial_delay_ms = 10;
+	options.max_delay_ms = 50;
+	options.jitter = 0;
+	options.failure_threshold = 3;
+	options.circuit_open_ms = 60000;
+	return ReconnectPolicy(options);
+}
+
+/// <summary>
+/// Validate that a message sent while the server refuses us is delivered once we've signed back in
+/// </summary>
+TEST(SignalingClient, QueuedMessageResumesAfterReconnect)
+{
+	ScriptedSignalingServer server;
+	auto factory = make_shared<ScriptedSocketFactory>(&server);
+	ConnectionObserver obs;
+
+	// scope for loop guard
+	{
+		// tie client lifetime to loop guard
+		shared_ptr<PeerConnectionClient> client;
+		rtc::Thread* signaling_thread = nullptr;
+		RtcEventLoop loop([&]()
+		{
+			signaling_thread = rtc::Thread::Current();
+			client = make_shared<PeerConnectionClient>(factory);
+			client->SetReconnectPolicy(FastReconnectPolicy());
+			client->RegisterObserver(&obs);
+			client->Connect("localhost", 1, "test");
+		});
+
+		EXPECT_TRUE(obs.Wait());
+
+		// let the fake deliver the sign_in socket's late close first
+		std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+		// the server goes away as we send, then comes back
+		ASSERT_TRUE(signaling_thread->Invoke<bool>(RTC_FROM_HERE, [&]()
+		{
+			server.refuse_connects = 1;
+			return client->SendToPeer(1, "hello");
+		}));
+
+		ASSERT_TRUE(server.message_received.Wait(30000));
+		ASSERT_EQ(server.sign_ins, 2);
+		ASSERT_EQ(server.messages, std::vector<string>({ "hello" }));
+
+		signaling_thread->Invoke<void>(RTC_FROM_HERE, [&]() { client->Close(); });
+	}
+}
+
+/// <summary>
+/// Validate that occasional 500s on the hanging get, with successes in between, never open the circuit
+/// </summary>
+TEST(SignalingClient, IntermittentServerErrorsDontTripBreaker)
+{
+	ScriptedSignalingServer server;
+	server.wait_statuses = { 500, 200, 500, 200, 500, 200, 500, 200, 500, 200 };
+	auto factory = make_shared<ScriptedSocketFactory>(&server);
+	ConnectionObserver obs;
+
+	// scope for loop guard
+	{
+		// tie client lifetime to loop guard
+		shared_ptr<PeerConnectionClient> client;
+		rtc::Thread* signaling_thread = nullptr;
+		RtcEventLoop loop([&]()
+		{
+			signaling_thread = rtc::Thread::Current();
+			client = make_shared<PeerConnectionClient>(factory);
+			client->SetReconnectPolicy(FastReconnectPolicy());
+			client->RegisterObserver(&obs);
+			client->Connect("localhost", 1, "test");
+		});
+
+		EXPECT_TRUE(obs.Wait());
+
+		// every scripted wait is answered well within the time an open circuit would hold us back
+		auto drained = [&]()
+		{
+			return signaling_thread->Invoke<bool>(RTC_FROM_HERE, [&]() { return server.wait_statuses.empty(); });
+		};
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+		while (!drained() && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		ASSERT_TRUE(drained());
+		signaling_thread->Invoke<void>(RTC_FROM_HERE, [&]()
+		{
+			EXPECT_NE(client->reconnect_policy().state(), ReconnectPolicy::CIRCUIT_OPEN);
+			EXPECT_LT(client->reconnect_policy().consecutive_failures(), 3);
+			EXPECT_EQ(client->peers().count(3), 1u);
+			EXPECT_EQ(server.sign_ins, 1);
+			client->Close();
+		});
+	}
+}
+
+/// <summary>
+/// Validate that the client signs in to a stand-in ipv6 server when the preferred ipv4 one is down,
+/// probing each endpoint with a socket of its own address family
+/// </summary>
+TEST(SignalingClient, FailsOverToStandInServer)
+{
+	ScriptedSignalingServer down(3001);
+	ScriptedSignalingServer up(3002);
+	down.refuse_connects = INT_MAX;
+	auto factory = make_shared<ScriptedSocketFactory>(std::vector<ScriptedSignalingServer*>({ &down, &up }));
+	ConnectionObserver obs;
+
+	// scope for loop guard
+	{
+		// tie client lifetime to loop guard
+		shared_ptr<PeerConnectionClient> client;
+		rtc::Thread* signaling_thread = nullptr;
+		RtcEventLoop loop([&]()
+		{
+			signaling_thread = rtc::Thread::Current();
+			client = make_shared<PeerConnectionClient>(factory);
+			client->SetReconnectPolicy(FastReconnectPolicy());
+			client->RegisterObserver(&obs);
+			client->Connect({ SignalingEndpoint("http://127.0.0.1", 3001), SignalingEndpoint("http://::1", 3002) }, "test");
+		});
+
+		EXPECT_TRUE(obs.Wait());
+
+		signaling_thread->Invoke<void>(RTC_FROM_HERE, [&]()
+		{
+			EXPECT_EQ(client->current_endpoint(), 1);
+			EXPECT_EQ(down.sign_ins, 0);
+			EXPECT_EQ(up.sign_ins, 1);
+
+			// four sockets per sign in attempt, then the ipv6 endpoint's probes on top of those
+			auto ipv6 = std::count(factory->families.begin(), factory->families.end(), AF_INET6);
+			EXPECT_GE(ipv6, 5);
+			client->Close();
+		});
+	}
+}
+
+/// <summary>
+/// A stand-in signaling server, with a fixed round trip time that can be taken down
+/// </summary>
+struct StandInServer
+{
+	SignalingEndpoint endpoint;
+	int64_t rtt_ms;
+	bool up;
+};
+
+/// <summary>
+/// Probes every stand-in server once, the way PeerConnectionClient does each probe interval
+/// </summary>
+void ProbeStandInServers(SignalingEndpointSelector& selector, const std::vector<StandInServer>& servers)
+{
+	for (int i = 0; i < static_cast<int>(servers.size()); i++)
+	{
+		if (servers[i].up)
+		{
+			selector.RecordRtt(i, servers[i].rtt_ms);
+		}
+		else
+		{
+			selector.RecordFailure(i);
+		}
+	}
+}
+
+/// <summary>
+/// Validate that the endpoint selector prefers configuration order until it has measurements, then the fastest server
+/// </summary>
+TEST(SignalingClientTests, SignalingEndpointSelectorPrefersFastest)
+{
+	std::vector<StandInServer> servers =
+	{
+		{ SignalingEndpoint("http://us-west.test", 3000), 80, true },
+		{ SignalingEndpoint("http://eu-north.test", 3000), 20, true },
+		{ SignalingEndpoint("https://ap-east.test", 443), 45, true }
+	};
+
+	std::vector<SignalingEndpoint> endpoints;
+	for (auto& server : servers)
+	{
+		endpoints.push_back(server.endpoint);
+	}
+
+	FakeClock clock;
+	SignalingEndpointSelector selector(endpoints, SignalingEndpointSelector::Options(), clock.AsClock());
+
+	// nothing measured yet, so the first configured server wins
+	ASSERT_EQ(selector.Select(), 0);
+
+	ProbeStandInServers(selector, servers);
+	ASSERT_EQ(selector.Select(), 1);
+	ASSERT_EQ(selector.SmoothedRtt(1), 20);
+
+	// a single slow sample is smoothed out, rather than flipping the selection
+	selector.RecordRtt(1, 100);
+	ASSERT_EQ(selector.Select(), 1);
+	ASSERT_EQ(selector.SmoothedRtt(1), 40);
+}
+
+/// <summary>
+/// Validate that the endpoint selector fails over when a server dies, and picks it back up once it recovers
+/// </summary>
+TEST(SignalingClientTests, SignalingEndpointSelectorFailover)
+{
+	std::vector<StandInServer> servers =
+	{
+		{ SignalingEndpoint("localhost", 3001), 30, true },
+		{ SignalingEndpoint("localhost", 3002), 10, true },
+		{ SignalingEndpoint("localhost", 3003), 50, true }
+	};
+
+	std::vector<SignalingEndpoint> endpoints;
+	for (auto& server : servers)
+	{
+		endpoints.push_back(server.endpoint);
+	}
+
+	FakeClock clock;
+	SignalingEndpointSelector::Options options;
+	options.failure_threshold = 2;
+	options.down_retry_ms = 10000;
+	SignalingEndpointSelector selector(endpoints, options, clock.AsClock());
+
+	ProbeStandInServers(selector, servers);
+	int current = selector.Select();
+	ASSERT_EQ(current, 1);
+
+	// the session's server dies; the reconnect moves to the next fastest
+	servers[1].up = false;
+	selector.RecordFailure(current);
+	current = selector.SelectFailover(current);
+	ASSERT_EQ(current, 0);
+
+	// probes keep failing, so the dead server is skipped even though it was fastest
+	ProbeStandInServers(selector, servers);
+	ASSERT_FALSE(selector.IsHealthy(1));
+	ASSERT_EQ(selector.Select(), 0);
+
+	// if everything else dies too, we keep cycling rather than giving up
+	servers[0].up = false;
+	servers[2].up = false;
+	ProbeStandInServers(selector, servers);
+	ProbeStandInServers(selector, servers);
+	ASSERT_NE(selector.SelectFailover(current), SignalingEndpointSelector::kNoEndpoint);
+
+	// once the fast server is back and has been probed, it's preferred again
+	servers[1].up = true;
+	clock.now_ms += options.down_retry_ms;
+	ProbeStandInServers(selector, servers);
+	ASSERT_TRUE(selector.IsHealthy(1));
+	ASSERT_EQ(selector.Select(), 1);
+}
+
+/// <summary>
+/// A stand-in resolver that records lookups and completes them on demand, so no network is needed
+/// </summary>
+struct FakeResolver
+{
+	std::vector<std::pair<std::string, DnsCache::ResolveCallback>> pending;
+	int lookups = 0;
+
+	DnsCache::Resolver AsResolver()
+	{
+		return [this](const std::string& hostname, const DnsCache::ResolveCallback& callback)
+		{
+			lookups++;
+			pending.emplace_back(hostname, callback);
+		};
+	}
+
+	// Completes the oldest outstanding lookup with |ip|
+	void Complete(const std::string& ip)
+	{
+		auto next = pending.front();
+		pending.erase(pending.begin());
+		next.second(ip);
+	}
+};
+
+/// <summary>
+/// Validate that dns_cache coalesces concurrent lookups and serves hits until the ttl expires
+/// </summary>
+TEST(SignalingClientTests, DnsCacheCoalescesAndExpires)
+{
+	FakeClock clock;
+	FakeResolver resolver;
+	DnsCache::Options options;
+	options.ttl_ms = 1000;
+	options.refresh_ahead_ms = 100;
+	DnsCache cache(resolver.AsResolver(), options, [&]() { return clock.now_ms; });
+
+	std::vector<std::string> results;
+	auto record = [&](const std::string& ip) { results.push_back(ip); };
+
+	// two callers, one lookup
+	ASSERT_NE(cache.Resolve("signaling.test", record), DnsCache::kNoTicket);
+	ASSERT_NE(cache.Resolve("signaling.test", record), DnsCache::kNoTicket);
+	ASSERT_EQ(resolver.lookups, 1);
+
+	resolver.Complete("10.0.0.1");
+	ASSERT_EQ(results, std::vector<std::string>({ "10.0.0.1", "10.0.0.1" }));
+
+	// hits are delivered synchronously, without touching the resolver
+	ASSERT_EQ(cache.Resolve("signaling.test", record), DnsCache::kNoTicket);
+	ASSERT_EQ(results.size(), 3);
+	ASSERT_EQ(resolver.lookups, 1);
+
+	std::string ip;
+	ASSERT_TRUE(cache.Lookup("signaling.test", &ip));
+	ASSERT_EQ(ip, "10.0.0.1");
+	ASSERT_FALSE(cache.Lookup("other.test", &ip));
+
+	// once expired, the next caller waits on a fresh lookup
+	clock.now_ms += options.ttl_ms;
+	ASSERT_FALSE(cache.Lookup("signaling.test", &ip));
+	ASSERT_NE(cache.Resolve("signaling.test", record), DnsCache::kNoTicket);
+	ASSERT_EQ(resolver.lookups, 2);
+
+	resolver.Complete("10.0.0.2");
+	ASSERT_EQ(results.back(), "10.0.0.2");
+}
+
+/// <summary>
+/// Validate that dns_cache remembers failures briefly, and that a failed refresh keeps the last good address
+/// </summary>
+TEST(SignalingClientTests, DnsCacheFailures)
+{
+	FakeClock clock;
+	FakeResolver resolver;
+	DnsCache::Options options;
+	options.ttl_ms = 1000;
+	options.negative_ttl_ms = 200;
+	options.refresh_ahead_ms = 100;
+	DnsCache cache(resolver.AsResolver(), options, [&]() { return clock.now_ms; });
+
+	std::string last = "unset";
+	auto record = [&](const std::string& ip) { last = ip; };
+
+	cache.Resolve("missing.test", record);
+	resolver.Complete("");
+	ASSERT_EQ(last, "");
+
+	// the failure is served from the cache until the negative ttl runs out
+	last = "unset";
+	ASSERT_EQ(cache.Resolve("missing.test", record), DnsCache::kNoTicket);
+	ASSERT_EQ(last, "");
+	ASSERT_EQ(resolver.lookups, 1);
+
+	clock.now_ms += options.negative_ttl_ms;
+	cache.Resolve("missing.test", record);
+	ASSERT_EQ(resolver.lookups, 2);
+	resolver.Complete("10.0.0.3");
+	ASSERT_EQ(last, "10.0.0.3");
+
+	// a lookup close to expiry refreshes in the background, and a failed refresh doesn't lose the address
+	clock.now_ms += options.ttl_ms - options.refresh_ahead_ms;
+	std::string ip;
+	ASSERT_TRUE(cache.Lookup("missing.test", &ip));
+	ASSERT_EQ(resolver.lookups, 3);
+	resolver.Complete("");
+	ASSERT_TRUE(cache.Lookup("missing.test", &ip));
+	ASSERT_EQ(ip, "10.0.0.3");
+}
+
+/// <summary>
+/// Validate that dns_cache keeps prefetched hosts refreshed, and that cancelled callers aren't called
+/// </summary>
+TEST(SignalingClientTests, DnsCachePrefetchAndRefresh)
+{
+	FakeClock clock;
+	FakeResolver resolver;
+	DnsCache::Options options;
+	options.ttl_ms = 1000;
+	options.refresh_ahead_ms = 100;
+	DnsCache cache(resolver.AsResolver(), options, [&]() { return clock.now_ms; });
+
+	ASSERT_EQ(cache.RefreshExpiring(), -1);
+
+	cache.Prefetch("turn.test");
+	ASSERT_EQ(resolver.lookups, 1);
+
+	// a caller that goes away before the lookup completes is never called
+	bool called = false;
+	auto ticket = cache.Resolve("turn.test", [&](const std::string&) { called = true; });
+	cache.Cancel(ticket);
+	resolver.Complete("10.0.0.4");
+	ASSERT_FALSE(called);
+
+	// the next refresh is due refresh_ahead_ms before expiry
+	ASSERT_EQ(cache.RefreshExpiring(), 900);
+	ASSERT_EQ(resolver.lookups, 1);
+
+	clock.now_ms += 900;
+	ASSERT_EQ(cache.RefreshExpiring(), 0);
+	ASSERT_EQ(resolver.lookups, 2);
+
+	// the old address keeps being served while the refresh is in flight
+	std::string ip;
+	ASSERT_TRUE(cache.Lookup("turn.test", &ip));
+	ASSERT_EQ(ip, "10.0.0.4");
+
+	resolver.Complete("10.0.0.5");
+	ASSERT_TRUE(cache.Lookup("turn.test", &ip));
+	ASSERT_EQ(ip, "10.0.0.5");
+	ASSERT_EQ(cache.RefreshExpiring(), 900);
+}
+
+/// <summary>
+/// Validate that dns_cache hands callbacks to the dispatcher their caller was on, and drops ones cancelled on the way
+/// </summary>
+TEST(SignalingClientTests, DnsCacheDispatchesToCaller)
+{
+	FakeClock clock;
+	FakeResolver resolver;
+	DnsCache cache(resolver.AsResolver(), DnsCache::Options(), [&]() { return clock.now_ms; });
+
+	// stands in for the caller's thread, running tasks only when asked
+	std::vector<std::function<void()>> posted;
+	cache.SetDispatcher([&]()
+	{
+		return [&](const std::function<void()>& task) { posted.push_back(task); };
+	});
+
+	std::vector<std::string> results;
+	cache.Resolve("signaling.test", [&](const std::string& ip) { results.push_back(ip); });
+	auto cancelled = cache.Resolve("signaling.test", [&](const std::string& ip) { results.push_back("cancelled"); });
+
+	// the resolve completes elsewhere, so nothing is called until the caller's thread runs
+	resolver.Complete("10.0.0.6");
+	ASSERT_EQ(posted.size(), 2u);
+	ASSERT_TRUE(results.empty());
+
+	cache.Cancel(cancelled);
+	for (const auto& task : posted)
+	{
+		task();
+	}
+
+	ASSERT_EQ(results, std::vector<std::string>({ "10.0.0.6" }));
+}
+
+/// <summary>
+/// Validate that dns_cache can be destroyed while resolves finish on other threads, and that a
+/// callback may destroy it
+/// </summary>
+TEST(SignalingClientTests, DnsCacheDestroyedWhileResolving)
+{
+	std::atomic<int> delivered(0);
+	for (int round = 0; round < 200; round++)
+	{
+		std::vector<std::thread> resolves;
+		{
+			DnsCache cache([&](const std::string& hostname, const DnsCache::ResolveCallback& callback)
+			{
+				resolves.emplace_back([callback]() { callback("10.0.0.7"); });
+			});
+
+			cache.Resolve("signaling.test", [&](const std::string& ip) { delivered++; });
+		}
+
+		for (auto& resolve : resolves)
+		{
+			resolve.join();
+		}
+	}
+
+	// each was either delivered before the cache was destroyed or dropped with it, never after
+	ASSERT_LE(delivered.load(), 200);
+
+	std::unique_ptr<DnsCache> owned;
+	FakeResolver resolver;
+	owned.reset(new DnsCache(resolver.AsResolver()));
+	owned->Resolve("signaling.test", [&](const std::string& ip) { owned.reset(); });
+	resolver.Complete("10.0.0.8");
+	ASSERT_FALSE(owned);
+}
+
+/// <summary>
+/// Validate that dns_cache extracts hostnames from the uri forms used in our configs
+/// </summary>
+TEST(SignalingClientTests, DnsCacheHostFromUri)
+{
+	ASSERT_EQ(DnsCache::HostFromUri("https://signaling.test:3000/sign_in?peer_name=x"), "signaling.test");
+	ASSERT_EQ(DnsCache::HostFromUri("http://signaling.test"), "signaling.test");
+	ASSERT_EQ(DnsCache::HostFromUri("signaling.test:443"), "signaling.test");
+	ASSERT_EQ(DnsCache::HostFromUri("signaling.test"), "signaling.test");
+	ASSERT_EQ(DnsCache::HostFromUri("https://[::1]:443/"), "::1");
+}
+
+/// <summary>
+/// A connection standing in for an established (tls) socket, counting handshakes
+/// </summary>
+struct FakeConnection : public PooledConnection
+{
+	bool open;
+
+	FakeConnection() : open(true) {}
+
+	bool IsOpen() const override
+	{
+		return open;
+	}
+};
+
+/// <summary>
+/// Validate that connection_pool hands finished connections to the next request for the same server,
+/// so a session of requests over several channels only pays for one full handshake
+/// </summary>
+TEST(SignalingClientTests, ConnectionPoolReusesConnections)
+{
+	FakeClock clock;
+	ConnectionPool pool(ConnectionPool::Options(), [&]() { return clock.now_ms; });
+	auto key = ConnectionPool::Key("signaling.test", 443, true);
+	int full_handshakes = 0;
+	int resumed = 0;
+
+	// sign_in, then heartbeats, messages and capacity updates, each on its own channel, one after another
+	for (int i = 0; i < 20; i++)
+	{
+		auto connection = pool.Take(key);
+		if (connection == nullptr)
+		{
+			connection.reset(new FakeConnection());
+			full_handshakes++;
+		}
+		else
+		{
+			resumed++;
+		}
+
+		clock.now_ms += 50;
+		pool.Park(key, std::move(connection));
+	}
+
+	ASSERT_EQ(full_handshakes, 1);
+	ASSERT_EQ(resumed, 19);
+	ASSERT_EQ(pool.stats().reused, 19);
+	ASSERT_EQ(pool.stats().missed, 1);
+
+	// a different server, or plain http to the same one, never shares the connection
+	ASSERT_EQ(pool.Take(ConnectionPool::Key("signaling.test", 443, false)), nullptr);
+	ASSERT_EQ(pool.Take(ConnectionPool::Key("other.test", 443, true)), nullptr);
+	ASSERT_EQ(pool.IdleCount(key), 1u);
+}
+
+/// <summary>
+/// Validate that connection_pool drops idle connections that have expired, closed, or don't fit
+/// </summary>
+TEST(SignalingClientTests, ConnectionPoolDropsStaleConnections)
+{
+	FakeClock clock;
+	ConnectionPool::Options options;
+	options.max_idle_ms = 1000;
+	options.max_idle_per_key = 2;
+	ConnectionPool pool(options, [&]() { return clock.now_ms; });
+	auto key = ConnectionPool::Key("signaling.test", 443, true);
+
+	// only the newest connections are kept
+	for (int i = 0; i < 3; i++)
+	{
+		pool.Park(key, std::unique_ptr<PooledConnection>(new FakeConnection()));
+	}
+
+	ASSERT_EQ(pool.IdleCount(key), 2u);
+	ASSERT_EQ(pool.stats().dropped, 1);
+
+	// connections the server has closed are never handed out
+	auto closed = new FakeConnection();
+	pool.Park(key, std::unique_ptr<PooledConnection>(closed));
+	closed->open = false;
+	auto connection = pool.Take(key);
+	ASSERT_NE(connection, nullptr);
+	ASSERT_NE(connection.get(), closed);
+	ASSERT_EQ(pool.IdleCount(key), 0u);
+
+	// nor are connections the server may have timed out
+	pool.Park(key, std::move(connection));
+	clock.now_ms += 1000;
+	ASSERT_EQ(pool.Take(key), nullptr);
+	ASSERT_EQ(pool.stats().reused, 1);
+	ASSERT_EQ(pool.stats().missed, 1);
+	ASSERT_EQ(pool.stats().dropped, 4);
+
+	// and a connection that is already closed isn't taken at all
+	auto already_closed = new FakeConnection();
+	already_closed->open = false;
+	pool.Park(key, std::unique_ptr<PooledConnection>(already_closed));
+	ASSERT_EQ(pool.IdleCount(key), 0u);
+}
+
+/// <summary>
+/// A representative offer and candidate, as exchanged while a peer connects
+/// </summary>
+struct SampleSignalingMessages
+{
+	SignalingMessage offer;
+	SignalingMessage candidate;
+
+	SampleSignalingMessages()
+	{
+		offer.kind = SignalingMessage::SESSION_DESCRIPTION;
+		offer.type = "offer";
+		offer.sdp = "v=0\r\no=- 4489647023841143573 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+			"a=group:BUNDLE video data\r\na=msid-semantic: WMS stream_label\r\n"
+			"m=video 9 UDP/TLS/RTP/SAVPF 100 101 116 117 96\r\nc=IN IP4 0.0.0.0\r\n"
+			"a=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:fKSq\r\na=ice-pwd:\"quoted\\pwd\"\r\n"
+			"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43\r\n"
+			"a=setup:actpass\r\na=mid:video\r\na=sendrecv\r\na=rtcp-mux\r\na=rtpmap:100 H264/90000\r\n";
+		offer.turn_uri = "turn:turn.test:5349";
+		offer.turn_username = "user";
+		offer.turn_password = "p\u00e4ss";
+
+		candidate.kind = SignalingMessage::ICE_CANDIDATE;
+		candidate.sdp_mid = "video";
+		candidate.sdp_mline_index = 1;
+		candidate.candidate = "candidate:4029998969 1 udp 41361151 40.69.184.50 50017 typ relay raddr 0.0.0.0 rport 0 generation 0 ufrag fKSq network-id 1 network-cost 50";
+	}
+};
+
+/// <summary>
+/// Validate that signaling_codec round trips messages through compact json and binary
+/// </summary>
+TEST(SignalingClientTests, SignalingCodecRoundTrip)
+{
+	SampleSignalingMessages samples;
+
+	for (auto format : { SignalingCodec::JSON, SignalingCodec::BINARY })
+	{
+		SignalingMessage decoded;
+		auto encoded = SignalingCodec::Encode(samples.offer, format);
+		ASSERT_EQ(SignalingCodec::Detect(encoded), format);
+		ASSERT_TRUE(SignalingCodec::Decode(encoded, &decoded));
+		ASSERT_EQ(decoded.kind, SignalingMessage::SESSION_DESCRIPTION);
+		ASSERT_EQ(decoded.type, samples.offer.type);
+		ASSERT_EQ(decoded.sdp, samples.offer.sdp);
+		ASSERT_EQ(decoded.turn_uri, samples.offer.turn_uri);
+		ASSERT_EQ(decoded.turn_password, samples.offer.turn_password);
+
+		encoded = SignalingCodec::Encode(samples.candidate, format);
+		ASSERT_TRUE(SignalingCodec::Decode(encoded, &decoded));
+		ASSERT_EQ(decoded.kind, SignalingMessage::ICE_CANDIDATE);
+		ASSERT_EQ(decoded.sdp_mid, samples.candidate.sdp_mid);
+		ASSERT_EQ(decoded.sdp_mline_index, samples.candidate.sdp_mline_index);
+		ASSERT_EQ(decoded.candidate, samples.candidate.candidate);
+	}
+
+	// json is written without whitespace
+	ASSERT_EQ(SignalingCodec::Encode(samples.candidate, SignalingCodec::JSON),
+		"{\"sdpMid\":\"video\",\"sdpMLineIndex\":1,\"candidate\":\"" + samples.candidate.candidate + "\"}");
+}
+
+/// <summary>
+/// Validate that signaling_codec reads the json other peers write, and rejects incomplete messages
+/// </summary>
+TEST(SignalingClientTests, SignalingCodecParsesPeerJson)
+{
+	SignalingMessage decoded;
+
+	// styled, with unknown and nested fields, escapes and a stringified index
+	ASSERT_TRUE(SignalingCodec::Decode("{\n   \"candidate\" : \"a\\\"b\\u00e4\\ud83d\\ude00\",\n"
+		"   \"extra\" : { \"nested\" : [1, \"}\", null] },\n   \"sdpMLineIndex\" : \"2\",\n   \"sdpMid\" : \"\"\n}\n", &decoded));
+	ASSERT_EQ(decoded.kind, SignalingMessage::ICE_CANDIDATE);
+	ASSERT_EQ(decoded.candidate, "a\"b\xc3\xa4\xf0\x9f\x98\x80");
+	ASSERT_EQ(decoded.sdp_mline_index, 2);
+
+	// unescaped newlines in sdp are tolerated, as jsoncpp does
+	ASSERT_TRUE(SignalingCodec::Decode("{\"sdp\":\"v=0\no=-\n\",\"type\":\"offer\"}", &decoded));
+	ASSERT_EQ(decoded.kind, SignalingMessage::SESSION_DESCRIPTION);
+	ASSERT_EQ(decoded.sdp, "v=0\no=-\n");
+
+	// a session description needs sdp, and a candidate needs all of its fields
+	ASSERT_FALSE(SignalingCodec::Decode("{\"type\":\"offer\"}", &decoded));
+	ASSERT_FALSE(SignalingCodec::Decode("{\"sdpMid\":\"\",\"candidate\":\"c\"}", &decoded));
+	ASSERT_FALSE(SignalingCodec::Decode("{\"sdpMid\":\"\",\"sdpMLineIndex\":0,\"candidate\":\"c\"", &decoded));
+	ASSERT_FALSE(SignalingCodec::Decode("BYE", &decoded));
+	ASSERT_FALSE(SignalingCodec::Decode("", &decoded));
+
+	// truncated binary is rejected
+	SampleSignalingMessages samples;
+	auto binary = SignalingCodec::Encode(samples.candidate, SignalingCodec::BINARY);
+	ASSERT_FALSE(SignalingCodec::Decode(binary.substr(0, binary.size() - 1), &decoded));
+}
+
+/// <summary>
+/// Reports the size, and encode plus decode time, of each signaling format
+/// </summary>
+TEST(SignalingClientTests, SignalingCodecBenchmark)
+{
+	const int kIterations = 20000;
+	SampleSignalingMessages samples;
+
+	for (auto format : { SignalingCodec::JSON, SignalingCodec::BINARY })
+	{
+		size_t bytes = 0;
+		SignalingMessage decoded;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < kIterations; i++)
+		{
+			auto& message = i % 2 == 0 ? samples.offer : samples.candidate;
+			auto encoded = SignalingCodec::Encode(message, format);
+			bytes += encoded.size();
+			ASSERT_TRUE(SignalingCodec::Decode(encoded, &decoded));
+		}
+
+		auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		auto name = format == SignalingCodec::JSON ? "json" : "binary";
+		std::cout << "[ SIGNALING CODEC ] " << name << ": "
+			<< static_cast<double>(bytes) / kIterations << " bytes/msg, "
+			<< static_cast<double>(elapsed_us) / kIterations << " us/msg" << std::endl;
+	}
+
+	// the binary form is never larger than the compact json
+	ASSERT_LT(SignalingCodec::Encode(samples.offer, SignalingCodec::BINARY).size(),
+		SignalingCodec::Encode(samples.offer, SignalingCodec::JSON).size());
+	ASSERT_LT(SignalingCodec::Encode(samples.candidate, SignalingCodec::BINARY).size(),
+		SignalingCodec::Encode(samples.candidate, SignalingCodec::JSON).size());
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// A connection that has finished a request and can carry another one
+/// </summary>
+class PooledConnection
+{
+public:
+	virtual ~PooledConnection() {}
+
+	// Returns true if the connection is still established
+	virtual bool IsOpen() const = 0;
+};
+
+/// <summary>
+/// Holds idle, already established (and, for https, already handshaken) connections for reuse
+/// </summary>
+/// <remarks>
+/// Connections are keyed by host, port and transport, so any socket connecting to the same
+/// server can pick up a connection another socket finished with. This is what lets the
+/// control, capacity and heartbeat channels share a single tls connection rather than paying
+/// for a full handshake per request. Connections idle for longer than max_idle_ms are dropped,
+/// which should be kept below the server's keep-alive timeout.
+/// </remarks>
+class ConnectionPool
+{
+public:
+	struct Options
+	{
+		// How long an idle connection may be reused for, in milliseconds
+		int max_idle_ms;
+
+		// The most idle connections kept per key
+		int max_idle_per_key;
+
+		Options() :
+			max_idle_ms(4000),
+			max_idle_per_key(2)
+		{}
+	};
+
+	struct Stats
+	{
+		// Connections handed back out instead of establishing a new one
+		int reused;
+
+		// Requests for a connection the pool couldn't satisfy
+		int missed;
+
+		// Idle connections dropped because they expired, closed, or didn't fit
+		int dropped;
+	};
+
+	// Returns the current time in milliseconds
+	typedef std::function<int64_t()> Clock;
+
+	// Returns the pool shared by every SslCapableSocket that has reuse enabled
+	static std::shared_ptr<ConnectionPool> Shared();
+
+	// Builds the key a connection to |host|:|port| is pooled under
+	static std::string Key(const std::string& host, int port, bool ssl);
+
+	ConnectionPool();
+
+	ConnectionPool(const Options& options, const Clock& clock);
+
+	// Takes ownership of an idle |connection|
+	void Park(const std::string& key, std::unique_ptr<PooledConnection> connection);
+
+	// Returns the most recently parked open connection for |key|, or nullptr
+	std::unique_ptr<PooledConnection> Take(const std::string& key);
+
+	// Drops every expired or closed idle connection
+	void Purge();
+
+	// The number of idle connections held for |key|
+	size_t IdleCount(const std::string& key);
+
+	Stats stats();
+
+private:
+	struct IdleConnection
+	{
+		std::unique_ptr<PooledConnection> connection;
+		int64_t parked_ms;
+	};
+
+	// Drops expired or closed connections for a single key, requires mutex_
+	void PurgeLocked(std::vector<IdleConnection>& idle, int64_t now_ms);
+
+	Options options_;
+	Clock clock_;
+	std::mutex mutex_;
+	std::map<std::string, std::vector<IdleConnection>> idle_;
+	Stats stats_;
+};
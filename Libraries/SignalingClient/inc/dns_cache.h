@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// A TTL-aware hostname resolution cache shared by everything that talks to our servers
+/// </summary>
+/// <remarks>
+/// Concurrent lookups of the same hostname are coalesced into a single resolve. Successful
+/// results are kept for ttl_ms, and failures for negative_ttl_ms so that a dead name can't
+/// turn every retry into a DNS round trip. Prefetched hostnames are pinned: RefreshExpiring()
+/// re-resolves them shortly before they expire, and a failed refresh keeps serving the last
+/// good address until it expires, so lookups on the reconnect path stay off the network.
+///
+/// The resolver, and the clock, are injected so the cache can be tested without a network.
+/// see RtcDnsResolver for the implementation used at runtime. Callbacks run on whichever thread
+/// the resolver calls back on, unless a dispatcher is set to return them to the caller's thread.
+/// </remarks>
+class DnsCache
+{
+public:
+	struct Options
+	{
+		// How long a successful resolve is cached, in milliseconds
+		int ttl_ms;
+
+		// How long a failed resolve is cached, in milliseconds
+		int negative_ttl_ms;
+
+		// How long before expiry a pinned or recently used entry is refreshed, in milliseconds
+		int refresh_ahead_ms;
+
+		Options() :
+			ttl_ms(300000),
+			negative_ttl_ms(5000),
+			refresh_ahead_ms(30000)
+		{}
+	};
+
+	// Receives the resolved ip in string form, or an empty string if resolution failed
+	typedef std::function<void(const std::string& ip)> ResolveCallback;
+
+	// Starts resolving |hostname| and invokes |callback| (exactly once) when done
+	typedef std::function<void(const std::string& hostname, const ResolveCallback& callback)> Resolver;
+
+	// Returns the current time in milliseconds
+	typedef std::function<int64_t()> Clock;
+
+	// Runs |task| on the thread a lookup was made on
+	typedef std::function<void(const std::function<void()>& task)> Dispatch;
+
+	// Returns a Dispatch for the calling thread, or null to call back on whichever thread resolves
+	typedef std::function<Dispatch()> Dispatcher;
+
+	// Returned by Resolve() when the result was delivered synchronously
+	static const int kNoTicket = 0;
+
+	DnsCache(const Resolver& resolver);
+
+	DnsCache(const Resolver& resolver, const Options& options, const Clock& clock);
+
+	~DnsCache();
+
+	// Routes every later lookup's callback back to the thread it was made on, through |dispatcher|
+	void SetDispatcher(const Dispatcher& dispatcher);
+
+	/// <summary>
+	/// Resolves |hostname|, invoking |callback| synchronously on a cache hit
+	/// </summary>
+	/// <returns>a ticket that can be passed to Cancel(), or kNoTicket if already completed</returns>
+	int Resolve(const std::string& hostname, const ResolveCallback& callback);
+
+	// Drops the callback registered with |ticket|, if it hasn't been invoked yet
+	void Cancel(int ticket);
+
+	// Returns true and fills |ip| if a fresh address for |hostname| is cached
+	bool Lookup(const std::string& hostname, std::string* ip);
+
+	// Starts resolving |hostname| if needed, and keeps it refreshed from now on
+	void Prefetch(const std::string& hostname);
+
+	/// <summary>
+	/// Re-resolves pinned entries that are close to expiring
+	/// </summary>
+	/// <returns>the time (ms) until this should be called again, or -1 if nothing is pinned</returns>
+	int64_t RefreshExpiring();
+
+	// Returns the hostname portion of <scheme>://<hostname>[:port][/path], or of a bare hostname
+	static std::string HostFromUri(const std::string& uri);
+
+private:
+	struct Waiter
+	{
+		int ticket;
+		ResolveCallback callback;
+		Dispatch dispatch;
+
+		Waiter(int ticket_id, const ResolveCallback& resolve_callback, const Dispatch& caller_dispatch) :
+			ticket(ticket_id), callback(resolve_callback), dispatch(caller_dispatch) {}
+	};
+
+	struct Entry
+	{
+		std::string ip;
+		bool has_result;
+		bool resolving;
+		bool pinned;
+		int64_t expires_ms;
+		std::vector<Waiter> waiters;
+
+		Entry() : has_result(false), resolving(false), pinned(false), expires_ms(0) {}
+	};
+
+	// Marks |entry| as resolving and returns true if a resolve should be started for it
+	bool ShouldStartResolve(Entry& entry, int64_t now_ms, bool refresh_ahead) const;
+
+	void StartResolve(const std::string& hostname);
+
+	// Records the result for |hostname| and takes the waiters for it, returning the address to give them
+	std::string OnResolved(const std::string& hostname, const std::string& ip, std::vector<Waiter>* waiters);
+
+	// Calls back |waiters| with |ip|, or dispatches them back to their caller's thread. This doesn't
+	// hold |cache| alive while calling back, since a callback may destroy it.
+	static void Deliver(DnsCache* cache, const std::weak_ptr<bool>& alive, const std::vector<Waiter>& waiters, const std::string& ip);
+
+	// Takes the dispatched waiter |ticket|'s callback, or null if it was cancelled on the way
+	ResolveCallback TakeDispatched(int ticket);
+
+	Resolver resolver_;
+	Options options_;
+	Clock clock_;
+	Dispatcher dispatcher_;
+	std::mutex mutex_;
+	std::map<std::string, Entry> entries_;
+
+	// resolved waiters on their way back to their caller's thread, by ticket
+	std::map<int, ResolveCallback> dispatched_;
+	int next_ticket_;
+
+	// lets resolves that outlive us know not to call back into a destroyed cache. Callbacks hold it
+	// while they use the cache, and the destructor waits for them to let go.
+	std::shared_ptr<bool> alive_;
+};
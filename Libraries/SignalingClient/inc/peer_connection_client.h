@@ -11,6 +11,7 @@
 #ifndef WEBRTC_PEER_CONNECTION_CLIENT_H_
 #define WEBRTC_PEER_CONNECTION_CLIENT_H_
 
+#include <deque>
 #include <map>
 #include <memory>
 #include <string>
@@ -23,6 +24,9 @@
 #include "webrtc/rtc_base/signalthread.h"
 #include "webrtc/rtc_base/sigslot.h"
 
+#include "dns_cache.h"
+#include "reconnect_policy.h"
+#include "signaling_endpoint_selector.h"
 #include "ssl_capable_socket.h"
 
 typedef std::map<int, std::string> Peers;
@@ -85,6 +89,20 @@ public:
 	void Connect(const std::string& server, int port,
 				 const std::string& client_name);
 
+	/// <summary>
+	/// Connects to the fastest healthy server in |endpoints|, failing over between them
+	/// </summary>
+	/// <remarks>
+	/// When more than one endpoint is given, every endpoint is periodically probed to measure
+	/// its round trip time. If the server we're signed in to stops accepting connections, the
+	/// next reconnect attempt signs in to the best remaining endpoint instead, and any messages
+	/// queued while reconnecting are delivered there.
+	/// </remarks>
+	/// <param name="endpoints">the candidate signaling servers, in order of preference</param>
+	/// <param name="client_name">the name to sign in with</param>
+	void Connect(const std::vector<SignalingEndpoint>& endpoints,
+				 const std::string& client_name);
+
 	/// <summary>
 	/// Updates the capacity data on the signaling server
 	/// </summary>
@@ -119,9 +137,48 @@ public:
 
 	void UpdateConnectionState(int id, webrtc::PeerConnectionInterface::IceConnectionState state);
 
+	// The policy used to pace reconnects and retries to the signaling server, which any
+	// successful response resets
+	ReconnectPolicy& reconnect_policy();
+
+	void SetReconnectPolicy(const ReconnectPolicy& policy);
+
+	// The health and rtt of the signaling servers we were asked to connect to
+	const SignalingEndpointSelector& endpoint_selector() const;
+
+	// The index of the endpoint we're using, or SignalingEndpointSelector::kNoEndpoint
+	int current_endpoint() const;
+
+	// Overrides the dns cache used to resolve signaling servers, which defaults to RtcDnsResolver::SharedCache()
+	void SetDnsCache(const std::shared_ptr<DnsCache>& dns_cache);
+
+	/// <summary>
+	/// Enables keep-alive connection reuse across our signaling requests through |pool|, or disables it if null
+	/// </summary>
+	/// <remarks>
+	/// Reuse is disabled by default. ConnectionPool::Shared() lets every client in the process share connections.
+	/// </remarks>
+	void SetConnectionPool(const std::shared_ptr<ConnectionPool>& pool);
+
 protected:
 	void DoConnect();
 
+	// Points server_address_ at |index| and connects, resolving first if needed
+	void ConnectToEndpoint(int index);
+
+	// Starts a connect-time probe against each endpoint, recording the previous round's stragglers as failures
+	void ProbeEndpoints();
+
+	void OnProbeConnect(rtc::AsyncSocket* socket);
+
+	void OnProbeClose(rtc::AsyncSocket* socket, int err);
+
+	// Schedules |message_id| on the signaling thread after the next backoff delay
+	void ScheduleRetry(uint32_t message_id);
+
+	// Sends the next message queued while we were reconnecting, if the control socket is free
+	void SendScheduledMessage();
+
 	void Close();
 
 	void InitSocketSignals();
@@ -170,7 +227,10 @@ protected:
 
 	void OnHeartbeatGetClose(rtc::AsyncSocket* socket, int err);
 
-	void OnResolveResult(rtc::AsyncResolverInterface* resolver);
+	void OnResolveResult(const std::string& ip);
+
+	// Returns the member socket that emitted signals as |socket|, or nullptr
+	SslCapableSocket* FindOwningSocket(rtc::AsyncSocket* socket) const;
 
 	std::string PrepareRequest(const std::string& method, const std::string& fragment, std::map<std::string, std::string> headers);
 
@@ -178,7 +238,9 @@ protected:
 	std::vector<PeerConnectionClientObserver*> callbacks_;
 	bool server_address_ssl_;
 	rtc::SocketAddress server_address_;
-	rtc::AsyncResolver* resolver_;
+	std::shared_ptr<DnsCache> dns_cache_;
+	int resolve_ticket_;
+	std::shared_ptr<ConnectionPool> connection_pool_;
 	std::shared_ptr<rtc::Thread> signaling_thread_;
 	std::unique_ptr<SslCapableSocket> control_socket_;
 	std::unique_ptr<SslCapableSocket> capacity_socket_;
@@ -194,6 +256,26 @@ protected:
 	State state_;
 	int my_id_;
 	int heartbeat_tick_ms_;
+	ReconnectPolicy reconnect_policy_;
+	bool reconnect_pending_;
+	std::string last_control_request_;
+
+	// Whether a retry of last_control_request_ is scheduled and still wanted
+	bool control_retry_pending_;
+	SignalingEndpointSelector endpoint_selector_;
+	int current_endpoint_;
+	bool probe_scheduled_;
+
+	struct EndpointProbe
+	{
+		int endpoint;
+		int64_t started_ms;
+		bool finished;
+		std::unique_ptr<SslCapableSocket> socket;
+	};
+
+	// The current round of rtt probes, released when the next round starts
+	std::vector<std::unique_ptr<EndpointProbe>> probes_;
 
 	struct ScheduledPeerMessage
 	{
@@ -205,7 +287,11 @@ protected:
 		{}
 	};
 
-	std::queue<ScheduledPeerMessage> scheduled_messages_;
+	// Messages to deliver once a reconnect completes, oldest first
+	std::deque<ScheduledPeerMessage> scheduled_messages_;
+
+	// The message currently being delivered over the control socket, if any
+	std::unique_ptr<ScheduledPeerMessage> in_flight_message_;
 };
 
 #endif  // WEBRTC_PEER_CONNECTION_CLIENT_H_
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+/// <summary>
+/// Decides when a signaling connection may be retried
+/// </summary>
+/// <remarks>
+/// Implements jittered exponential backoff plus a circuit breaker. After
+/// failure_threshold consecutive failures the circuit opens and no attempt is allowed
+/// for circuit_open_ms; the next attempt is a single half-open probe that either closes
+/// the circuit (success) or re-opens it (failure).
+///
+/// The policy holds no sockets and no threads. Time and randomness are injected so that
+/// it can be driven deterministically from unit tests.
+/// </remarks>
+class ReconnectPolicy
+{
+public:
+	enum State
+	{
+		IDLE = 0,
+		CONNECTING,
+		CONNECTED,
+		BACKING_OFF,
+		CIRCUIT_OPEN
+	};
+
+	struct Options
+	{
+		// Delay before the first retry, in milliseconds
+		int initial_delay_ms;
+
+		// Upper bound for a single backoff delay, in milliseconds
+		int max_delay_ms;
+
+		// Growth factor applied per consecutive failure
+		double multiplier;
+
+		// Fraction of the delay that is randomized, in [0, 1]
+		double jitter;
+
+		// Consecutive failures before the circuit opens (0 disables the breaker)
+		int failure_threshold;
+
+		// How long the circuit stays open, in milliseconds
+		int circuit_open_ms;
+
+		Options() :
+			initial_delay_ms(500),
+			max_delay_ms(30000),
+			multiplier(2.0),
+			jitter(0.5),
+			failure_threshold(8),
+			circuit_open_ms(60000)
+		{}
+	};
+
+	// Returns the current time in milliseconds
+	typedef std::function<int64_t()> Clock;
+
+	// Returns a uniformly distributed value in [0, 1)
+	typedef std::function<double()> RandomSource;
+
+	ReconnectPolicy();
+
+	ReconnectPolicy(const Options& options);
+
+	ReconnectPolicy(const Options& options, const Clock& clock, const RandomSource& random);
+
+	// Records that a connection attempt is starting
+	void OnAttempt();
+
+	// Records a successful connection, closing the circuit and resetting the backoff
+	void OnSuccess();
+
+	// Records a failed attempt and returns the delay (ms) before the next attempt is allowed
+	int OnFailure();
+
+	// Returns true if an attempt may be made now
+	bool CanAttempt() const;
+
+	// Returns the time (ms) until an attempt is allowed, 0 if one is allowed now
+	int64_t TimeUntilNextAttempt() const;
+
+	// Resets to the initial IDLE state
+	void Reset();
+
+	State state() const;
+
+	int consecutive_failures() const;
+
+	const Options& options() const;
+
+private:
+	// Computes the jittered delay for the current failure count
+	int NextBackoffDelay();
+
+	Options options_;
+	Clock clock_;
+	RandomSource random_;
+	State state_;
+	int consecutive_failures_;
+	int64_t next_attempt_ms_;
+};
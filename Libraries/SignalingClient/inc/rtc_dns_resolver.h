@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "webrtc/rtc_base/messagehandler.h"
+#include "webrtc/rtc_base/nethelpers.h"
+#include "webrtc/rtc_base/thread.h"
+
+#include "dns_cache.h"
+
+/// <summary>
+/// Backs DnsCache with rtc::AsyncResolver, and keeps a cache's pinned entries refreshed on an rtc thread
+/// </summary>
+class RtcDnsResolver : public rtc::MessageHandler
+{
+public:
+	/// <summary>
+	/// Returns the cache shared by the signaling client and the credential and authentication providers
+	/// </summary>
+	/// <remarks>
+	/// The first call creates the cache, and a thread of its own on which pinned entries are
+	/// refreshed in the background from then on. Lookups still resolve on the thread they're made on.
+	/// </remarks>
+	static std::shared_ptr<DnsCache> SharedCache();
+
+	// Creates a resolver that resolves with rtc::AsyncResolver, calling back on the calling thread
+	static DnsCache::Resolver Create();
+
+	// Returns a dispatch onto the calling rtc thread, for DnsCache::SetDispatcher, or null off one
+	static DnsCache::Dispatch CurrentThreadDispatch();
+
+	// Points |address| at |ip| (as produced by a DnsCache), keeping its hostname. Returns false if |ip| is unusable
+	static bool ApplyResolvedIp(const std::string& ip, rtc::SocketAddress* address);
+
+	RtcDnsResolver(const std::shared_ptr<DnsCache>& cache, rtc::Thread* thread);
+
+	~RtcDnsResolver();
+
+	// implements the MessageHandler interface
+	void OnMessage(rtc::Message* msg) override;
+
+private:
+	void ScheduleRefresh(int64_t delay_ms);
+
+	std::weak_ptr<DnsCache> cache_;
+	rtc::Thread* thread_;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+/// <summary>
+/// A session description or ice candidate exchanged with a peer over signaling
+/// </summary>
+struct SignalingMessage
+{
+	enum Kind
+	{
+		SESSION_DESCRIPTION,
+		ICE_CANDIDATE
+	};
+
+	Kind kind;
+
+	// Session description fields
+	std::string type;
+	std::string sdp;
+
+	// Ice candidate fields
+	std::string sdp_mid;
+	int sdp_mline_index;
+	std::string candidate;
+
+	// Turn credentials, sent alongside our session descriptions
+	std::string turn_uri;
+	std::string turn_username;
+	std::string turn_password;
+
+	SignalingMessage() : kind(SESSION_DESCRIPTION), sdp_mline_index(0) {}
+};
+
+/// <summary>
+/// Encodes and decodes the signaling envelope without building a json document
+/// </summary>
+/// <remarks>
+/// JSON is written compactly, with no whitespace, using the same field names as before
+/// ("type", "sdp", "uri", "username", "password" and "sdpMid", "sdpMLineIndex", "candidate"),
+/// so existing peers can read it. The decoder scans the top level object once, copying out
+/// only the fields we know, and skips anything else, including nested values.
+///
+/// The binary form starts with kBinaryMagic, followed by a sequence of fields, each a one byte
+/// tag, a varint length and that many bytes of value. Unknown tags are skipped, so fields can be
+/// added later. It can't be mistaken for json, which never starts with kBinaryMagic, so
+/// Decode() accepts either.
+/// </remarks>
+class SignalingCodec
+{
+public:
+	enum Format
+	{
+		JSON,
+		BINARY
+	};
+
+	// The first byte of every binary encoded message
+	static const uint8_t kBinaryMagic = 0xB1;
+
+	// Encodes |message| in |format|
+	static std::string Encode(const SignalingMessage& message, Format format);
+
+	// Decodes |data| in either format, returning false if it isn't a complete, valid message
+	static bool Decode(const std::string& data, SignalingMessage* message);
+
+	// Returns the format |data| was encoded in
+	static Format Detect(const std::string& data);
+
+private:
+	static std::string EncodeJson(const SignalingMessage& message);
+
+	static std::string EncodeBinary(const SignalingMessage& message);
+
+	static bool DecodeJson(const std::string& data, SignalingMessage* message);
+
+	static bool DecodeBinary(const std::string& data, SignalingMessage* message);
+};
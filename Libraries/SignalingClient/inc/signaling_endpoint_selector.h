@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// A single signaling server we may register with
+/// </summary>
+struct SignalingEndpoint
+{
+	// The server uri, optionally prefixed with http:// or https://
+	std::string uri;
+
+	// The server port
+	int port;
+
+	SignalingEndpoint() : port(0) {}
+
+	SignalingEndpoint(const std::string& endpoint_uri, int endpoint_port) :
+		uri(endpoint_uri), port(endpoint_port)
+	{}
+};
+
+/// <summary>
+/// Tracks the health and round trip time of a set of signaling servers and picks which one to use
+/// </summary>
+/// <remarks>
+/// Round trip times are smoothed with an exponentially weighted moving average. An endpoint
+/// is considered down after failure_threshold consecutive failures, and becomes eligible
+/// again after down_retry_ms so that a recovered server is eventually picked back up.
+///
+/// Endpoints that have never been measured are treated as slower than any measured endpoint,
+/// and ties are broken by configuration order, so the first configured server is the default.
+///
+/// Like ReconnectPolicy, this holds no sockets and no threads, and the clock is injectable.
+/// </remarks>
+class SignalingEndpointSelector
+{
+public:
+	struct Options
+	{
+		// Weight given to a new rtt sample, in (0, 1]
+		double rtt_smoothing;
+
+		// Consecutive failures before an endpoint is considered down
+		int failure_threshold;
+
+		// How long a down endpoint is skipped before it may be tried again, in milliseconds
+		int down_retry_ms;
+
+		Options() :
+			rtt_smoothing(0.25),
+			failure_threshold(2),
+			down_retry_ms(30000)
+		{}
+	};
+
+	// Returns the current time in milliseconds
+	typedef std::function<int64_t()> Clock;
+
+	// Indicates no endpoint is available
+	static const int kNoEndpoint = -1;
+
+	SignalingEndpointSelector();
+
+	SignalingEndpointSelector(const std::vector<SignalingEndpoint>& endpoints);
+
+	SignalingEndpointSelector(const std::vector<SignalingEndpoint>& endpoints,
+		const Options& options, const Clock& clock);
+
+	const std::vector<SignalingEndpoint>& endpoints() const;
+
+	// Records a round trip time sample (ms) for |index|, which also counts as a success
+	void RecordRtt(int index, int64_t rtt_ms);
+
+	// Records a successful exchange with |index|
+	void RecordSuccess(int index);
+
+	// Records a failed exchange with |index|
+	void RecordFailure(int index);
+
+	// Returns true if |index| is not currently considered down
+	bool IsHealthy(int index) const;
+
+	// Returns the smoothed rtt (ms) for |index|, or -1 if it has not been measured
+	int64_t SmoothedRtt(int index) const;
+
+	// Returns the index of the fastest healthy endpoint. If every endpoint is down, returns
+	// the one that becomes eligible soonest. Returns kNoEndpoint only if there are no endpoints.
+	int Select() const;
+
+	// Returns the endpoint to fail over to from |current|, which is |current| itself only
+	// when no other endpoint is usable
+	int SelectFailover(int current) const;
+
+private:
+	struct EndpointState
+	{
+		int64_t smoothed_rtt_ms;
+		int consecutive_failures;
+		int64_t down_until_ms;
+	};
+
+	// Returns the best candidate, skipping |excluded|
+	int SelectExcluding(int excluded) const;
+
+	bool IsValidIndex(int index) const;
+
+	std::vector<SignalingEndpoint> endpoints_;
+	std::vector<EndpointState> states_;
+	Options options_;
+	Clock clock_;
+};
@@ -1,11 +1,14 @@
 #ifndef WEBRTC_SSL_CAPABLE_SOCKET_H_
 #define WEBRTC_SSL_CAPABLE_SOCKET_H_
 
+#include "webrtc/rtc_base/asyncinvoker.h"
 #include "webrtc/rtc_base/ssladapter.h"
 #include "webrtc/rtc_base/sslidentity.h"
 
 #include "CppFactory.hpp"
 
+#include "connection_pool.h"
+
 using namespace rtc;
 
 class SslCapableSocket : public AsyncSocket, public sigslot::has_slots<>
@@ -39,11 +42,66 @@ public:
 	virtual int GetOption(AsyncSocket::Option opt, int* value);
 	virtual int SetOption(AsyncSocket::Option opt, int value);
 
+	/// <summary>
+	/// Enables connection reuse through |pool|, or disables it if |pool| is null
+	/// </summary>
+	/// <remarks>
+	/// With reuse enabled, Connect() picks up an idle connection to the same server from the pool
+	/// when there is one, skipping the tcp connect and tls handshake, and Park() hands a finished
+	/// connection back to the pool instead of closing it. The server may have closed an idle
+	/// connection by the time we use it, so if a reused connection fails before anything is read
+	/// from it, what was sent is sent again, once, over a fresh connection.
+	/// </remarks>
+	virtual void SetConnectionPool(const std::shared_ptr<ConnectionPool>& pool);
+
+	/// <summary>
+	/// Returns the established connection to the pool, leaving this socket closed and ready to Connect() again
+	/// </summary>
+	/// <remarks>
+	/// Only call this between requests, once a response has been fully read. Falls back to Close()
+	/// if reuse is disabled or the connection isn't established.
+	/// </remarks>
+	/// <returns>true if the connection was pooled</returns>
+	virtual bool Park();
+
+	// Returns true if |socket| is this socket, or the socket it wraps, as seen in our signals
+	virtual bool Wraps(const AsyncSocket* socket) const;
+
 	typedef CppFactory::Factory<SslCapableSocket, const int&, const bool&, std::weak_ptr<Thread>> Factory;
 protected:
 	std::weak_ptr<rtc::Thread> signaling_thread_;
 	std::unique_ptr<AsyncSocket> socket_;
 	std::unique_ptr<SSLAdapter> ssl_adapter_;
+	std::shared_ptr<ConnectionPool> connection_pool_;
+
+	// The address family we create sockets with, AF_UNSPEC when given a socket to wrap
+	int family_;
+
+	// The pool key for our current connection
+	std::string pool_key_;
+
+	// The address we were last asked to connect to
+	SocketAddress remote_address_;
+
+	// Whether our connection came from the pool and nothing has been read from it yet
+	bool reused_;
+
+	// What was sent over a reused connection that hasn't answered yet
+	std::string unanswered_;
+
+	// Whether to resend unanswered_ once our fresh connection is up, rather than signal the connect
+	bool resend_pending_;
+
+	rtc::AsyncInvoker invoker_;
+
+	// Returns the socket our signals are mapped from
+	AsyncSocket* Provider() const;
+
+	// Connects without going through the pool
+	int ConnectDirect(const SocketAddress& addr);
+
+	// Swaps a reused connection that failed for a fresh one to the same server, to resend over
+	void RetryOnFreshConnection();
 
 	void MapUnderlyingEvents(AsyncSocket* provider, AsyncSocket* oldProvider = nullptr);
 
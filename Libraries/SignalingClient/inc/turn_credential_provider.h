@@ -6,6 +6,7 @@
 #include "webrtc/rtc_base/json.h"
 
 #include "authentication_provider.h"
+#include "dns_cache.h"
 #include "ssl_capable_socket.h"
 
 // forward decl
@@ -56,6 +57,9 @@ public:
 
 	void SetAuthenticationProvider(AuthenticationProvider* authProvider);
 
+	// Overrides the dns cache used to resolve the credential host, which defaults to RtcDnsResolver::SharedCache()
+	void SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache);
+
 	bool RequestCredentials();
 	
 	const State& state() const;
@@ -66,7 +70,7 @@ protected:
 	void SocketOpen(rtc::AsyncSocket* socket);
 	void SocketRead(rtc::AsyncSocket* socket);
 	void SocketClose(rtc::AsyncSocket* socket, int err);
-	void AddressResolve(rtc::AsyncResolverInterface* resolver);
+	void AddressResolve(const std::string& ip);
 
 	std::shared_ptr<SslCapableSocket::Factory> async_socket_factory_;
 	std::shared_ptr<rtc::Thread> signaling_thread_;
@@ -75,6 +79,7 @@ protected:
 	std::string auth_token_;
 	State state_;
 	std::unique_ptr<SslCapableSocket> socket_;
-	std::unique_ptr<AsyncResolver> resolver_;
+	std::shared_ptr<DnsCache> dns_cache_;
+	int resolve_ticket_;
 	AuthenticationProvider* auth_provider_;
 };
@@ -0,0 +1,119 @@
+#include "connection_pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	int64_t SteadyClockMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+std::shared_ptr<ConnectionPool> ConnectionPool::Shared()
+{
+	static std::shared_ptr<ConnectionPool> pool = std::make_shared<ConnectionPool>();
+
+	return pool;
+}
+
+std::string ConnectionPool::Key(const std::string& host, int port, bool ssl)
+{
+	return (ssl ? "https://" : "http://") + host + ":" + std::to_string(port);
+}
+
+ConnectionPool::ConnectionPool() :
+	ConnectionPool(Options(), &SteadyClockMs)
+{
+}
+
+ConnectionPool::ConnectionPool(const Options& options, const Clock& clock) :
+	options_(options),
+	clock_(clock),
+	stats_({ 0, 0, 0 })
+{
+}
+
+void ConnectionPool::Park(const std::string& key, std::unique_ptr<PooledConnection> connection)
+{
+	if (connection == nullptr || !connection->IsOpen())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto& idle = idle_[key];
+	PurgeLocked(idle, clock_());
+
+	idle.push_back(IdleConnection{ std::move(connection), clock_() });
+
+	// keep the newest, since they have the longest left before the server times them out
+	while (static_cast<int>(idle.size()) > options_.max_idle_per_key)
+	{
+		idle.erase(idle.begin());
+		stats_.dropped++;
+	}
+}
+
+std::unique_ptr<PooledConnection> ConnectionPool::Take(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = idle_.find(key);
+	if (it != idle_.end())
+	{
+		PurgeLocked(it->second, clock_());
+
+		if (!it->second.empty())
+		{
+			auto connection = std::move(it->second.back().connection);
+			it->second.pop_back();
+			stats_.reused++;
+
+			return connection;
+		}
+	}
+
+	stats_.missed++;
+	return nullptr;
+}
+
+void ConnectionPool::Purge()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto now = clock_();
+	for (auto& it : idle_)
+	{
+		PurgeLocked(it.second, now);
+	}
+}
+
+size_t ConnectionPool::IdleCount(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = idle_.find(key);
+	return it == idle_.end() ? 0 : it->second.size();
+}
+
+ConnectionPool::Stats ConnectionPool::stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return stats_;
+}
+
+void ConnectionPool::PurgeLocked(std::vector<IdleConnection>& idle, int64_t now_ms)
+{
+	auto stale = std::remove_if(idle.begin(), idle.end(), [&](const IdleConnection& entry)
+	{
+		return now_ms - entry.parked_ms >= options_.max_idle_ms || !entry.connection->IsOpen();
+	});
+
+	stats_.dropped += static_cast<int>(std::distance(stale, idle.end()));
+	idle.erase(stale, idle.end());
+}
@@ -0,0 +1,333 @@
+#include "dns_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	int64_t SteadyClockMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+const int DnsCache::kNoTicket;
+
+DnsCache::DnsCache(const Resolver& resolver) :
+	DnsCache(resolver, Options(), &SteadyClockMs)
+{
+}
+
+DnsCache::DnsCache(const Resolver& resolver, const Options& options, const Clock& clock) :
+	resolver_(resolver),
+	options_(options),
+	clock_(clock),
+	next_ticket_(kNoTicket),
+	alive_(std::make_shared<bool>(true))
+{
+}
+
+DnsCache::~DnsCache()
+{
+	// a resolve finishing on another thread may be using the cache right now
+	std::weak_ptr<bool> alive = alive_;
+	alive_.reset();
+	while (!alive.expired())
+	{
+		std::this_thread::yield();
+	}
+}
+
+void DnsCache::SetDispatcher(const Dispatcher& dispatcher)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	dispatcher_ = dispatcher;
+}
+
+int DnsCache::Resolve(const std::string& hostname, const ResolveCallback& callback)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	auto now = clock_();
+	auto& entry = entries_[hostname];
+
+	if (entry.has_result && now < entry.expires_ms)
+	{
+		auto ip = entry.ip;
+		bool refresh = ShouldStartResolve(entry, now, true);
+		lock.unlock();
+
+		if (refresh)
+		{
+			StartResolve(hostname);
+		}
+
+		callback(ip);
+		return kNoTicket;
+	}
+
+	int ticket = ++next_ticket_;
+	entry.waiters.emplace_back(ticket, callback, dispatcher_ ? dispatcher_() : Dispatch());
+	bool start = ShouldStartResolve(entry, now, false);
+	lock.unlock();
+
+	if (start)
+	{
+		StartResolve(hostname);
+	}
+
+	return ticket;
+}
+
+void DnsCache::Cancel(int ticket)
+{
+	if (ticket == kNoTicket)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto& it : entries_)
+	{
+		auto& waiters = it.second.waiters;
+		waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+			[ticket](const Waiter& waiter) { return waiter.ticket == ticket; }),
+			waiters.end());
+	}
+
+	dispatched_.erase(ticket);
+}
+
+bool DnsCache::Lookup(const std::string& hostname, std::string* ip)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	auto it = entries_.find(hostname);
+	auto now = clock_();
+	if (it == entries_.end() || !it->second.has_result ||
+		it->second.ip.empty() || now >= it->second.expires_ms)
+	{
+		return false;
+	}
+
+	*ip = it->second.ip;
+	bool refresh = ShouldStartResolve(it->second, now, true);
+	lock.unlock();
+
+	if (refresh)
+	{
+		StartResolve(hostname);
+	}
+
+	return true;
+}
+
+void DnsCache::Prefetch(const std::string& hostname)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	auto& entry = entries_[hostname];
+	entry.pinned = true;
+	bool start = ShouldStartResolve(entry, clock_(), true);
+	lock.unlock();
+
+	if (start)
+	{
+		StartResolve(hostname);
+	}
+}
+
+int64_t DnsCache::RefreshExpiring()
+{
+	std::vector<std::string> to_refresh;
+	int64_t next_ms = -1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto now = clock_();
+		for (auto& it : entries_)
+		{
+			auto& entry = it.second;
+			if (!entry.pinned)
+			{
+				continue;
+			}
+
+			if (ShouldStartResolve(entry, now, true))
+			{
+				to_refresh.push_back(it.first);
+			}
+
+			// a failed entry is retried once its negative ttl runs out, a good one ahead of expiry
+			auto due_ms = entry.ip.empty() ?
+				entry.expires_ms - now :
+				entry.expires_ms - options_.refresh_ahead_ms - now;
+
+			due_ms = std::max<int64_t>(due_ms, 0);
+			next_ms = next_ms < 0 ? due_ms : std::min(next_ms, due_ms);
+		}
+	}
+
+	for (const auto& hostname : to_refresh)
+	{
+		StartResolve(hostname);
+	}
+
+	return next_ms;
+}
+
+std::string DnsCache::HostFromUri(const std::string& uri)
+{
+	auto host = uri;
+
+	auto scheme = host.find("://");
+	if (scheme != std::string::npos)
+	{
+		host = host.substr(scheme + 3);
+	}
+
+	host = host.substr(0, host.find_first_of("/?#"));
+
+	// bracketed ipv6 literals contain colons of their own
+	if (!host.empty() && host[0] == '[')
+	{
+		return host.substr(1, host.find(']') - 1);
+	}
+
+	return host.substr(0, host.find(':'));
+}
+
+bool DnsCache::ShouldStartResolve(Entry& entry, int64_t now_ms, bool refresh_ahead) const
+{
+	if (entry.resolving)
+	{
+		return false;
+	}
+
+	bool fresh = entry.has_result && now_ms < entry.expires_ms;
+	bool expiring = refresh_ahead && entry.has_result && !entry.ip.empty() &&
+		now_ms >= entry.expires_ms - options_.refresh_ahead_ms;
+
+	if (fresh && !expiring)
+	{
+		return false;
+	}
+
+	entry.resolving = true;
+	return true;
+}
+
+void DnsCache::StartResolve(const std::string& hostname)
+{
+	std::weak_ptr<bool> alive = alive_;
+
+	resolver_(hostname, [this, alive, hostname](const std::string& ip)
+	{
+		std::vector<Waiter> waiters;
+		std::string result;
+
+		{
+			auto self = alive.lock();
+			if (!self)
+			{
+				return;
+			}
+
+			result = OnResolved(hostname, ip, &waiters);
+		}
+
+		Deliver(this, alive, waiters, result);
+	});
+}
+
+std::string DnsCache::OnResolved(const std::string& hostname, const std::string& ip, std::vector<Waiter>* waiters)
+{
+	std::string result;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto now = clock_();
+		auto& entry = entries_[hostname];
+		entry.resolving = false;
+
+		if (!ip.empty())
+		{
+			entry.ip = ip;
+			entry.has_result = true;
+			entry.expires_ms = now + options_.ttl_ms;
+		}
+		else if (!(entry.has_result && !entry.ip.empty() && now < entry.expires_ms))
+		{
+			// only remember the failure if we have nothing better; a failed refresh keeps the last good address
+			entry.ip.clear();
+			entry.has_result = true;
+			entry.expires_ms = now + options_.negative_ttl_ms;
+		}
+
+		result = entry.ip;
+		waiters->swap(entry.waiters);
+
+		// a dispatched waiter can still be cancelled until it reaches its thread
+		for (const auto& waiter : *waiters)
+		{
+			if (waiter.dispatch)
+			{
+				dispatched_[waiter.ticket] = waiter.callback;
+			}
+		}
+	}
+
+	return result;
+}
+
+void DnsCache::Deliver(DnsCache* cache, const std::weak_ptr<bool>& alive, const std::vector<Waiter>& waiters, const std::string& ip)
+{
+	for (const auto& waiter : waiters)
+	{
+		if (!waiter.dispatch)
+		{
+			waiter.callback(ip);
+			continue;
+		}
+
+		auto ticket = waiter.ticket;
+		waiter.dispatch([cache, alive, ticket, ip]()
+		{
+			ResolveCallback callback;
+			{
+				auto self = alive.lock();
+				if (!self)
+				{
+					return;
+				}
+
+				callback = cache->TakeDispatched(ticket);
+			}
+
+			if (callback)
+			{
+				callback(ip);
+			}
+		});
+	}
+}
+
+DnsCache::ResolveCallback DnsCache::TakeDispatched(int ticket)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = dispatched_.find(ticket);
+	if (it == dispatched_.end())
+	{
+		return ResolveCallback();
+	}
+
+	auto callback = it->second;
+	dispatched_.erase(it);
+	return callback;
+}
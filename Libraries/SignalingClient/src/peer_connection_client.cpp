@@ -9,10 +9,12 @@
 */
 
 #include "peer_connection_client.h"
+#include "rtc_dns_resolver.h"
 #include "webrtc/rtc_base/checks.h"
 #include "webrtc/rtc_base/logging.h"
 #include "webrtc/rtc_base/nethelpers.h"
 #include "webrtc/rtc_base/stringutils.h"
+#include "webrtc/rtc_base/timeutils.h"
 
 #ifdef WIN32
 #include "webrtc/rtc_base/win32socketserver.h"
@@ -25,17 +27,47 @@ namespace
 	// This is our magical hangup signal.
 	const char kByeMessage[] = "BYE";
 
-	// Delay between server connection retries, in milliseconds
-	const int kReconnectDelay = 2000;
+	// The message id we use when scheduling a full reconnect (sign_in)
+	const int kReconnectScheduleId = 0U;
 
 	// The message id we use when scheduling a heartbeat operation
 	const int kHeartbeatScheduleId = 1523U;
 
+	// The message id we use when scheduling a control socket retry
+	const int kControlRetryScheduleId = 1524U;
+
+	// The message id we use when scheduling a hanging get retry
+	const int kHangingGetRetryScheduleId = 1525U;
+
+	// The message id we use when scheduling a round of endpoint rtt probes
+	const int kEndpointProbeScheduleId = 1526U;
+
+	// How often we probe endpoints when we have more than one, in milliseconds
+	const int kEndpointProbeIntervalMs = 15000;
+
 	// The default value for the tick heartbeat, used to disable the heartbeat
 	const int kHeartbeatDefault = -1;
 
 	// null deleter to conform rtc::Thread* to std::shared_ptr interface safely
 	struct NullDeleter { template<typename T> void operator()(T*) {} };
+
+	// Strips the http:// or https:// prefix from |uri|, noting whether it was https
+	std::string ParseServerUri(const std::string& uri, bool* ssl)
+	{
+		*ssl = false;
+
+		if (uri.substr(0, 8).compare("https://") == 0)
+		{
+			*ssl = true;
+			return uri.substr(8);
+		}
+		else if (uri.substr(0, 7).compare("http://") == 0)
+		{
+			return uri.substr(7);
+		}
+
+		return uri;
+	}
 }
 
 PeerConnectionClient::PeerConnectionClient() :
@@ -44,10 +76,15 @@ PeerConnectionClient::PeerConnectionClient() :
 }
 
 PeerConnectionClient::PeerConnectionClient(std::shared_ptr<SslCapableSocket::Factory> async_socket_factory) :
-	resolver_(NULL),
+	dns_cache_(RtcDnsResolver::SharedCache()),
+	resolve_ticket_(DnsCache::kNoTicket),
 	state_(NOT_CONNECTED),
 	my_id_(-1),
 	heartbeat_tick_ms_(kHeartbeatDefault),
+	reconnect_pending_(false),
+	control_retry_pending_(false),
+	current_endpoint_(SignalingEndpointSelector::kNoEndpoint),
+	probe_scheduled_(false),
 	server_address_ssl_(false),
 	async_socket_factory_(async_socket_factory)
 {
@@ -63,6 +100,7 @@ PeerConnectionClient::PeerConnectionClient(std::shared_ptr<SslCapableSocket::Fac
 
 PeerConnectionClient::~PeerConnectionClient()
 {
+	dns_cache_->Cancel(resolve_ticket_);
 }
 
 void PeerConnectionClient::InitSocketSignals()
@@ -109,6 +147,14 @@ void PeerConnectionClient::Connect(const std::string& server, int port,
 	const std::string& client_name)
 {
 	RTC_DCHECK(!server.empty());
+
+	Connect(std::vector<SignalingEndpoint>{ SignalingEndpoint(server, port) }, client_name);
+}
+
+void PeerConnectionClient::Connect(const std::vector<SignalingEndpoint>& endpoints,
+	const std::string& client_name)
+{
+	RTC_DCHECK(!endpoints.empty());
 	RTC_DCHECK(!client_name.empty());
 
 	if (state_ != NOT_CONNECTED)
@@ -118,41 +164,63 @@ void PeerConnectionClient::Connect(const std::string& server, int port,
 		return;
 	}
 
-	if (server.empty() || client_name.empty())
+	if (endpoints.empty() || client_name.empty())
 	{
 		std::for_each(callbacks_.rbegin(), callbacks_.rend(), [](PeerConnectionClientObserver* o) { o->OnServerConnectionFailure(); });
 		return;
 	}
 
-	if (port <= 0)
+	for (const auto& endpoint : endpoints)
 	{
-		std::for_each(callbacks_.rbegin(), callbacks_.rend(), [](PeerConnectionClientObserver* o) { o->OnServerConnectionFailure(); });
-		return;
+		if (endpoint.uri.empty() || endpoint.port <= 0)
+		{
+			std::for_each(callbacks_.rbegin(), callbacks_.rend(), [](PeerConnectionClientObserver* o) { o->OnServerConnectionFailure(); });
+			return;
+		}
 	}
 
-	std::string parsedServer = server;
+	client_name_ = client_name;
+	std::replace(client_name_.begin(), client_name_.end(), ' ', '-');
 
-	if (parsedServer.substr(0, 8).compare("https://") == 0)
+	// resolve every endpoint up front, and keep them fresh, so reconnects and failovers don't wait on dns
+	for (const auto& endpoint : endpoints)
 	{
-		server_address_ssl_ = true;
-		parsedServer = parsedServer.substr(8);
+		bool ssl = false;
+		if (rtc::SocketAddress(ParseServerUri(endpoint.uri, &ssl), endpoint.port).IsUnresolvedIP())
+		{
+			dns_cache_->Prefetch(DnsCache::HostFromUri(endpoint.uri));
+		}
 	}
-	else if (parsedServer.substr(0, 7).compare("http://") == 0)
+
+	endpoint_selector_ = SignalingEndpointSelector(endpoints);
+	ConnectToEndpoint(endpoint_selector_.Select());
+
+	// with a single endpoint there's nothing to choose between, so don't bother probing
+	if (endpoints.size() > 1 && !probe_scheduled_)
 	{
-		parsedServer = parsedServer.substr(7);
+		probe_scheduled_ = true;
+		ProbeEndpoints();
+		rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kEndpointProbeIntervalMs, this, kEndpointProbeScheduleId);
 	}
+}
 
-	server_address_.SetIP(parsedServer);
-	server_address_.SetPort(port);
-	client_name_ = client_name;
-	std::replace(client_name_.begin(), client_name_.end(), ' ', '-');
+void PeerConnectionClient::ConnectToEndpoint(int index)
+{
+	const auto& endpoint = endpoint_selector_.endpoints()[index];
+	current_endpoint_ = index;
+
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
+
+	server_address_.SetIP(ParseServerUri(endpoint.uri, &server_address_ssl_));
+	server_address_.SetPort(endpoint.port);
 
 	if (server_address_.IsUnresolvedIP())
 	{
+		// note: on a cache hit this calls back before Resolve returns
 		state_ = RESOLVING;
-		resolver_ = new rtc::AsyncResolver();
-		resolver_->SignalDone.connect(this, &PeerConnectionClient::OnResolveResult);
-		resolver_->Start(server_address_);
+		resolve_ticket_ = dns_cache_->Resolve(server_address_.hostname(),
+			[this](const std::string& ip) { OnResolveResult(ip); });
 	}
 	else
 	{
@@ -160,18 +228,26 @@ void PeerConnectionClient::Connect(const std::string& server, int port,
 	}
 }
 
-void PeerConnectionClient::OnResolveResult(rtc::AsyncResolverInterface* resolver)
+void PeerConnectionClient::OnResolveResult(const std::string& ip)
 {
-	if (resolver_->GetError() != 0)
+	resolve_ticket_ = DnsCache::kNoTicket;
+
+	if (!RtcDnsResolver::ApplyResolvedIp(ip, &server_address_) && endpoint_selector_.endpoints().size() > 1)
+	{
+		// let the reconnect pick another endpoint, paced like any other failed attempt
+		LOG(WARNING) << "Unable to resolve signaling server " << endpoint_selector_.endpoints()[current_endpoint_].uri;
+		endpoint_selector_.RecordFailure(current_endpoint_);
+		state_ = NOT_CONNECTED;
+		reconnect_pending_ = true;
+		ScheduleRetry(kReconnectScheduleId);
+	}
+	else if (server_address_.IsUnresolvedIP())
 	{
 		std::for_each(callbacks_.rbegin(), callbacks_.rend(), [](PeerConnectionClientObserver* o) { o->OnServerConnectionFailure(); });
-		resolver_->Destroy(false);
-		resolver_ = NULL;
 		state_ = NOT_CONNECTED;
 	}
 	else
 	{
-		server_address_ = resolver_->address();
 		DoConnect();
 	}
 }
@@ -197,6 +273,12 @@ std::string PeerConnectionClient::PrepareRequest(const std::string& method, cons
 		result += "Authorization: " + authorization_header_ + "\r\n";
 	}
 
+	// we speak http/1.0, so the connection is only kept open if we ask
+	if (connection_pool_.get() != nullptr && headers.find("Connection") == headers.end())
+	{
+		result += "Connection: keep-alive\r\n";
+	}
+
 	result += "\r\n";
 
 	return result;
@@ -209,7 +291,17 @@ void PeerConnectionClient::DoConnect()
 	heartbeat_get_ = async_socket_factory_->Allocate(server_address_.ipaddr().family(), server_address_ssl_, signaling_thread_);
 	capacity_socket_ = async_socket_factory_->Allocate(server_address_.ipaddr().family(), server_address_ssl_, signaling_thread_);
 
+	for (auto socket : { control_socket_.get(), hanging_get_.get(), heartbeat_get_.get(), capacity_socket_.get() })
+	{
+		socket->SetConnectionPool(connection_pool_);
+	}
+
 	InitSocketSignals();
+	reconnect_policy_.OnAttempt();
+
+	// a retry of a request on the sockets we just replaced is no longer wanted
+	control_retry_pending_ = false;
+
 	std::string clientName = client_name_;
 	std::string hostName = server_address_.hostname();
 
@@ -258,6 +350,13 @@ bool PeerConnectionClient::SendToPeer(int peer_id, const std::string& message)
 {
 	if (state_ != CONNECTED)
 	{
+		// hold on to the message and deliver it once we've signed back in
+		if (reconnect_pending_ && peer_id != -1)
+		{
+			scheduled_messages_.emplace_back(peer_id, message);
+			return true;
+		}
+
 		return false;
 	}
 
@@ -281,6 +380,8 @@ bool PeerConnectionClient::SendToPeer(int peer_id, const std::string& message)
 		});
 
 	onconnect_data_ += message;
+	in_flight_message_.reset(new ScheduledPeerMessage(peer_id, message));
+
 	return ConnectControlSocket();
 }
 
@@ -331,6 +432,9 @@ bool PeerConnectionClient::SignOut()
 
 bool PeerConnectionClient::Shutdown()
 {
+	// drop any reconnect that is still waiting on its backoff
+	reconnect_pending_ = false;
+
 	if (heartbeat_get_.get() != nullptr)
 	{
 		heartbeat_get_->Close();
@@ -374,12 +478,16 @@ void PeerConnectionClient::Close()
 	capacity_socket_->Close();
 	capacity_data_.clear();
 	onconnect_data_.clear();
+	last_control_request_.clear();
+	in_flight_message_.reset();
+	scheduled_messages_.clear();
+	reconnect_pending_ = false;
+	control_retry_pending_ = false;
 	peers_.clear();
-	if (resolver_ != NULL)
-	{
-		resolver_->Destroy(false);
-		resolver_ = NULL;
-	}
+	signaling_thread_->Clear(this, kControlRetryScheduleId);
+	signaling_thread_->Clear(this, kHangingGetRetryScheduleId);
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
 
 	my_id_ = -1;
 	state_ = NOT_CONNECTED;
@@ -408,6 +516,9 @@ void PeerConnectionClient::OnConnect(rtc::AsyncSocket* socket)
 	RTC_DCHECK(!onconnect_data_.empty());
 	size_t sent = socket->Send(onconnect_data_.c_str(), onconnect_data_.length());
 	RTC_DCHECK(sent == onconnect_data_.length());
+
+	// keep a copy so the request can be replayed if the server asks us to retry
+	last_control_request_ = onconnect_data_;
 	onconnect_data_.clear();
 }
 
@@ -511,6 +622,16 @@ bool PeerConnectionClient::ReadIntoBuffer(rtc::AsyncSocket* socket, std::string*
 					// to us.  Compensate by letting ourselves know.
 					OnClose(socket, 0);
 				}
+				else if (connection_pool_.get() != nullptr)
+				{
+					// hand the connection back for the next request, then carry on as if it had been closed
+					auto owner = FindOwningSocket(socket);
+					if (owner != nullptr)
+					{
+						owner->Park();
+						OnClose(owner, 0);
+					}
+				}
 			}
 			else
 			{
@@ -535,6 +656,9 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 		int status = ParseServerResponse(control_data_, content_length, &peer_id, &eoh);
 		if (status == 200)
 		{
+			// the server is answering, so earlier failures shouldn't count towards the breaker
+			reconnect_policy_.OnSuccess();
+
 			if (my_id_ == -1)
 			{
 				// First response.  Let's store our server assigned ID.
@@ -569,6 +693,7 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 				}
 
 				RTC_DCHECK(is_connected());
+				endpoint_selector_.RecordSuccess(current_endpoint_);
 				std::for_each(callbacks_.rbegin(), callbacks_.rend(), [](PeerConnectionClientObserver* o) { o->OnSignedIn(); });
 			}
 			else if (state_ == SIGNING_OUT)
@@ -580,6 +705,11 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 			{
 				SignOut();
 			}
+			else
+			{
+				// the in flight message was delivered
+				in_flight_message_.reset();
+			}
 
 			control_data_.clear();
 		}
@@ -591,8 +721,11 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 			// see https://github.com/CatalystCode/3DStreamingToolkit/issues/45
 			if (status == 500)
 			{
+				// retry the same request, but paced so we don't hammer a struggling server
 				control_socket_->Close();
-				control_socket_->Connect(server_address_);
+				control_data_.clear();
+				control_retry_pending_ = true;
+				ScheduleRetry(kControlRetryScheduleId);
 			}
 			else
 			{
@@ -602,7 +735,8 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 			}
 		}
 
-		if (state_ == SIGNING_IN)
+		// note: a retried (500) sign_in leaves us without an id, so we keep waiting
+		if (state_ == SIGNING_IN && is_connected())
 		{
 			RTC_DCHECK(hanging_get_->GetState() == rtc::Socket::CS_CLOSED);
 			state_ = CONNECTED;
@@ -613,7 +747,10 @@ void PeerConnectionClient::OnRead(rtc::AsyncSocket* socket)
 				heartbeat_get_->Connect(server_address_);
 			}
 
+			reconnect_pending_ = false;
 			SignalConnected.emit();
+
+			SendScheduledMessage();
 		}
 	}
 }
@@ -629,6 +766,8 @@ void PeerConnectionClient::OnHangingGetRead(rtc::AsyncSocket* socket)
 
 		if (status == 200)
 		{
+			reconnect_policy_.OnSuccess();
+
 			// Store the position where the body begins.
 			size_t pos = eoh + 4;
 
@@ -670,7 +809,9 @@ void PeerConnectionClient::OnHangingGetRead(rtc::AsyncSocket* socket)
 			if (status == 500)
 			{
 				hanging_get_->Close();
-				hanging_get_->Connect(server_address_);
+				notification_data_.clear();
+				ScheduleRetry(kHangingGetRetryScheduleId);
+				return;
 			}
 			else
 			{
@@ -799,14 +940,27 @@ void PeerConnectionClient::OnClose(rtc::AsyncSocket* socket, int err)
 		else
 		{
 			std::for_each(callbacks_.rbegin(), callbacks_.rend(), [&](PeerConnectionClientObserver* o) { o->OnMessageSent(err); });
+
+			if (socket == control_socket_.get())
+			{
+				SendScheduledMessage();
+			}
 		}
 	}
 	else
 	{
 		if (socket == control_socket_.get())
 		{
-			LOG(WARNING) << "Connection refused; retrying in 2 seconds";
-			rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kReconnectDelay, this, 0);
+			// if we lost a message mid-flight, resend it first once we're back
+			if (in_flight_message_)
+			{
+				scheduled_messages_.push_front(*in_flight_message_);
+				in_flight_message_.reset();
+			}
+
+			endpoint_selector_.RecordFailure(current_endpoint_);
+			reconnect_pending_ = true;
+			ScheduleRetry(kReconnectScheduleId);
 		}
 		else
 		{
@@ -835,13 +989,216 @@ void PeerConnectionClient::OnMessage(rtc::Message* msg)
 
 		heartbeat_get_->Connect(server_address_);
 	}
+	else if (msg->message_id == kControlRetryScheduleId)
+	{
+		// the request may have been dropped by a sign out, close or reconnect since
+		if (!control_retry_pending_ || state_ == State::NOT_CONNECTED || last_control_request_.empty())
+		{
+			return;
+		}
+
+		control_retry_pending_ = false;
+		if (control_socket_->GetState() != rtc::Socket::CS_CLOSED)
+		{
+			control_socket_->Close();
+		}
+
+		onconnect_data_ = last_control_request_;
+		ConnectControlSocket();
+	}
+	else if (msg->message_id == kHangingGetRetryScheduleId)
+	{
+		if (state_ == State::CONNECTED && hanging_get_->GetState() == rtc::Socket::CS_CLOSED)
+		{
+			hanging_get_->Connect(server_address_);
+		}
+	}
+	else if (msg->message_id == kEndpointProbeScheduleId)
+	{
+		// stop probing once we've given up on signaling altogether
+		if (state_ == State::NOT_CONNECTED && !reconnect_pending_)
+		{
+			probe_scheduled_ = false;
+			probes_.clear();
+			return;
+		}
+
+		ProbeEndpoints();
+		rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, kEndpointProbeIntervalMs, this, kEndpointProbeScheduleId);
+	}
 	else
 	{
-		// default case - other than the heartbeat message, there is only one other message ("retry")
-		DoConnect();
+		// a reconnect may have been cancelled by a sign out or shutdown in the meantime
+		if (!reconnect_pending_)
+		{
+			return;
+		}
+
+		// we're signing in from scratch, so the server will hand us a new id and peer list
+		my_id_ = -1;
+		peers_.clear();
+
+		int next = endpoint_selector_.SelectFailover(current_endpoint_);
+		if (next != current_endpoint_)
+		{
+			LOG(WARNING) << "Failing over to signaling server " << endpoint_selector_.endpoints()[next].uri
+				<< ":" << endpoint_selector_.endpoints()[next].port;
+		}
+
+		// goes through the dns cache, which is normally warm, so this picks up address changes without a lookup
+		ConnectToEndpoint(next);
 	}
 }
 
+void PeerConnectionClient::ProbeEndpoints()
+{
+	// anything still outstanding from the last round never connected
+	for (const auto& probe : probes_)
+	{
+		if (!probe->finished)
+		{
+			endpoint_selector_.RecordFailure(probe->endpoint);
+		}
+	}
+
+	probes_.clear();
+
+	const auto& endpoints = endpoint_selector_.endpoints();
+	for (int i = 0; i < static_cast<int>(endpoints.size()); i++)
+	{
+		bool ssl = false;
+		rtc::SocketAddress address(ParseServerUri(endpoints[i].uri, &ssl), endpoints[i].port);
+
+		std::string ip;
+		if (address.IsUnresolvedIP() && dns_cache_->Lookup(address.hostname(), &ip))
+		{
+			RtcDnsResolver::ApplyResolvedIp(ip, &address);
+		}
+
+		// a plain tcp connect is a single round trip, regardless of whether the endpoint uses tls.
+		// probe with the endpoint's own address family, falling back to ipv4 while it's unresolved
+		std::unique_ptr<EndpointProbe> probe(new EndpointProbe());
+		probe->endpoint = i;
+		probe->finished = false;
+		probe->socket = async_socket_factory_->Allocate(address.IsUnresolvedIP() ? AF_INET : address.ipaddr().family(),
+			false, signaling_thread_);
+		probe->socket->SignalConnectEvent.connect(this, &PeerConnectionClient::OnProbeConnect);
+		probe->socket->SignalCloseEvent.connect(this, &PeerConnectionClient::OnProbeClose);
+		probe->started_ms = rtc::TimeMillis();
+
+		if (probe->socket->Connect(address) == SOCKET_ERROR)
+		{
+			endpoint_selector_.RecordFailure(i);
+			continue;
+		}
+
+		probes_.push_back(std::move(probe));
+	}
+}
+
+void PeerConnectionClient::OnProbeConnect(rtc::AsyncSocket* socket)
+{
+	for (const auto& probe : probes_)
+	{
+		if (probe->socket.get() == socket && !probe->finished)
+		{
+			probe->finished = true;
+			endpoint_selector_.RecordRtt(probe->endpoint, rtc::TimeMillis() - probe->started_ms);
+
+			// the socket is released with the next round, since we're inside its signal
+			socket->Close();
+			break;
+		}
+	}
+}
+
+void PeerConnectionClient::OnProbeClose(rtc::AsyncSocket* socket, int err)
+{
+	for (const auto& probe : probes_)
+	{
+		if (probe->socket.get() == socket && !probe->finished)
+		{
+			probe->finished = true;
+			endpoint_selector_.RecordFailure(probe->endpoint);
+			break;
+		}
+	}
+}
+
+void PeerConnectionClient::ScheduleRetry(uint32_t message_id)
+{
+	int delay = reconnect_policy_.OnFailure();
+
+	LOG(WARNING) << "Signaling request failed (" << reconnect_policy_.consecutive_failures() << " in a row"
+		<< (reconnect_policy_.state() == ReconnectPolicy::CIRCUIT_OPEN ? ", circuit open" : "")
+		<< "); retrying in " << delay << "ms";
+
+	rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay, this, message_id);
+}
+
+void PeerConnectionClient::SendScheduledMessage()
+{
+	if (state_ != CONNECTED ||
+		scheduled_messages_.empty() ||
+		control_socket_->GetState() != rtc::Socket::CS_CLOSED)
+	{
+		return;
+	}
+
+	auto next = scheduled_messages_.front();
+	scheduled_messages_.pop_front();
+
+	if (!SendToPeer(next.peer, next.message))
+	{
+		scheduled_messages_.push_front(next);
+	}
+}
+
+ReconnectPolicy& PeerConnectionClient::reconnect_policy()
+{
+	return reconnect_policy_;
+}
+
+void PeerConnectionClient::SetReconnectPolicy(const ReconnectPolicy& policy)
+{
+	reconnect_policy_ = policy;
+}
+
+const SignalingEndpointSelector& PeerConnectionClient::endpoint_selector() const
+{
+	return endpoint_selector_;
+}
+
+int PeerConnectionClient::current_endpoint() const
+{
+	return current_endpoint_;
+}
+
+void PeerConnectionClient::SetDnsCache(const std::shared_ptr<DnsCache>& dns_cache)
+{
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
+	dns_cache_ = dns_cache;
+}
+
+void PeerConnectionClient::SetConnectionPool(const std::shared_ptr<ConnectionPool>& pool)
+{
+	connection_pool_ = pool;
+}
+
+SslCapableSocket* PeerConnectionClient::FindOwningSocket(rtc::AsyncSocket* socket) const
+{
+	for (auto owner : { control_socket_.get(), hanging_get_.get(), heartbeat_get_.get(), capacity_socket_.get() })
+	{
+		if (owner != nullptr && owner->Wraps(socket))
+		{
+			return owner;
+		}
+	}
+
+	return nullptr;
+}
+
 const std::string& PeerConnectionClient::authorization_header() const
 {
 	return authorization_header_;
@@ -0,0 +1,134 @@
+#include "reconnect_policy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+
+namespace
+{
+	int64_t SteadyClockMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	ReconnectPolicy::RandomSource DefaultRandomSource()
+	{
+		// every node seeds differently so that a fleet reconnecting at once spreads out
+		auto engine = std::make_shared<std::mt19937>(std::random_device()());
+		auto dist = std::make_shared<std::uniform_real_distribution<double>>(0.0, 1.0);
+
+		return [engine, dist]() { return (*dist)(*engine); };
+	}
+}
+
+ReconnectPolicy::ReconnectPolicy() :
+	ReconnectPolicy(Options())
+{
+}
+
+ReconnectPolicy::ReconnectPolicy(const Options& options) :
+	ReconnectPolicy(options, &SteadyClockMs, DefaultRandomSource())
+{
+}
+
+ReconnectPolicy::ReconnectPolicy(const Options& options, const Clock& clock, const RandomSource& random) :
+	options_(options),
+	clock_(clock),
+	random_(random),
+	state_(State::IDLE),
+	consecutive_failures_(0),
+	next_attempt_ms_(0)
+{
+}
+
+void ReconnectPolicy::OnAttempt()
+{
+	state_ = State::CONNECTING;
+}
+
+void ReconnectPolicy::OnSuccess()
+{
+	state_ = State::CONNECTED;
+	consecutive_failures_ = 0;
+	next_attempt_ms_ = 0;
+}
+
+int ReconnectPolicy::OnFailure()
+{
+	++consecutive_failures_;
+
+	int delay = 0;
+
+	if (options_.failure_threshold > 0 &&
+		consecutive_failures_ >= options_.failure_threshold)
+	{
+		// open (or re-open, after a failed half-open probe) the circuit
+		state_ = State::CIRCUIT_OPEN;
+		delay = options_.circuit_open_ms;
+	}
+	else
+	{
+		state_ = State::BACKING_OFF;
+		delay = NextBackoffDelay();
+	}
+
+	next_attempt_ms_ = clock_() + delay;
+
+	return delay;
+}
+
+bool ReconnectPolicy::CanAttempt() const
+{
+	return TimeUntilNextAttempt() == 0;
+}
+
+int64_t ReconnectPolicy::TimeUntilNextAttempt() const
+{
+	if (state_ != State::BACKING_OFF && state_ != State::CIRCUIT_OPEN)
+	{
+		return 0;
+	}
+
+	return std::max<int64_t>(0, next_attempt_ms_ - clock_());
+}
+
+void ReconnectPolicy::Reset()
+{
+	state_ = State::IDLE;
+	consecutive_failures_ = 0;
+	next_attempt_ms_ = 0;
+}
+
+ReconnectPolicy::State ReconnectPolicy::state() const
+{
+	return state_;
+}
+
+int ReconnectPolicy::consecutive_failures() const
+{
+	return consecutive_failures_;
+}
+
+const ReconnectPolicy::Options& ReconnectPolicy::options() const
+{
+	return options_;
+}
+
+int ReconnectPolicy::NextBackoffDelay()
+{
+	// base = initial * multiplier^(failures - 1), capped at max
+	double base = options_.initial_delay_ms *
+		std::pow(options_.multiplier, consecutive_failures_ - 1);
+
+	base = std::min<double>(base, options_.max_delay_ms);
+
+	// take the top (1 - jitter) of the delay as fixed, and randomize the remainder
+	// so that nodes which failed together don't retry together
+	double jitter = std::min(std::max(options_.jitter, 0.0), 1.0);
+	double delay = base * (1.0 - jitter) + base * jitter * random_();
+
+	return static_cast<int>(delay);
+}
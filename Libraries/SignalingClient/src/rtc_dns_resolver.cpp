@@ -0,0 +1,166 @@
+#include "rtc_dns_resolver.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "webrtc/rtc_base/sigslot.h"
+
+namespace
+{
+	// The message id we use when scheduling a background refresh
+	const int kRefreshScheduleId = 2101U;
+
+	// Lower bound on how often we refresh, so a burst of expiring entries can't spin the thread
+	const int kMinRefreshIntervalMs = 1000;
+
+	// How often we check back when nothing is pinned yet
+	const int kIdleRefreshIntervalMs = 10000;
+
+	// Owns a single rtc::AsyncResolver for the lifetime of one lookup
+	class ResolveRequest : public sigslot::has_slots<>
+	{
+	public:
+		ResolveRequest(const std::string& hostname, const DnsCache::ResolveCallback& callback) :
+			callback_(callback),
+			resolver_(new rtc::AsyncResolver())
+		{
+			resolver_->SignalDone.connect(this, &ResolveRequest::OnDone);
+			resolver_->Start(rtc::SocketAddress(hostname, 0));
+		}
+
+		void OnDone(rtc::AsyncResolverInterface* resolver)
+		{
+			std::string ip;
+			if (resolver->GetError() == 0)
+			{
+				ip = resolver->address().ipaddr().ToString();
+			}
+
+			resolver_->Destroy(false);
+			resolver_ = nullptr;
+
+			callback_(ip);
+
+			// we're inside our own signal, so defer the delete
+			rtc::Thread::Current()->Dispose(this);
+		}
+
+	private:
+		DnsCache::ResolveCallback callback_;
+		rtc::AsyncResolver* resolver_;
+	};
+
+	// Runs a task once on the thread it's posted to, then deletes itself
+	class DispatchTask : public rtc::MessageHandler
+	{
+	public:
+		DispatchTask(const std::function<void()>& task) : task_(task) {}
+
+		void OnMessage(rtc::Message* msg) override
+		{
+			task_();
+			delete this;
+		}
+
+	private:
+		std::function<void()> task_;
+	};
+}
+
+std::shared_ptr<DnsCache> RtcDnsResolver::SharedCache()
+{
+	static std::once_flag once;
+	static std::shared_ptr<DnsCache> cache;
+
+	std::call_once(once, []()
+	{
+		cache = std::make_shared<DnsCache>(RtcDnsResolver::Create());
+		cache->SetDispatcher(&RtcDnsResolver::CurrentThreadDispatch);
+
+		// refresh on a thread of our own, since whichever thread asks first may well stop before
+		// the process does. both live as long as the process, as static destruction order is unknown
+		auto thread = new rtc::Thread();
+		thread->SetName("DnsCacheRefresh", nullptr);
+		thread->Start();
+		new RtcDnsResolver(cache, thread);
+	});
+
+	return cache;
+}
+
+DnsCache::Resolver RtcDnsResolver::Create()
+{
+	return [](const std::string& hostname, const DnsCache::ResolveCallback& callback)
+	{
+		// deletes itself once done
+		new ResolveRequest(hostname, callback);
+	};
+}
+
+DnsCache::Dispatch RtcDnsResolver::CurrentThreadDispatch()
+{
+	auto thread = rtc::Thread::Current();
+	if (thread == nullptr)
+	{
+		return nullptr;
+	}
+
+	return [thread](const std::function<void()>& task)
+	{
+		if (thread->IsCurrent())
+		{
+			task();
+		}
+		else
+		{
+			thread->Post(RTC_FROM_HERE, new DispatchTask(task));
+		}
+	};
+}
+
+bool RtcDnsResolver::ApplyResolvedIp(const std::string& ip, rtc::SocketAddress* address)
+{
+	rtc::IPAddress resolved;
+	if (ip.empty() || !rtc::IPFromString(ip, &resolved))
+	{
+		return false;
+	}
+
+	address->SetResolvedIP(resolved);
+	return true;
+}
+
+RtcDnsResolver::RtcDnsResolver(const std::shared_ptr<DnsCache>& cache, rtc::Thread* thread) :
+	cache_(cache),
+	thread_(thread)
+{
+	ScheduleRefresh(kIdleRefreshIntervalMs);
+}
+
+RtcDnsResolver::~RtcDnsResolver()
+{
+	thread_->Clear(this);
+}
+
+void RtcDnsResolver::OnMessage(rtc::Message* msg)
+{
+	if (msg->message_id != kRefreshScheduleId)
+	{
+		return;
+	}
+
+	auto cache = cache_.lock();
+	if (!cache)
+	{
+		return;
+	}
+
+	auto next = cache->RefreshExpiring();
+	ScheduleRefresh(next < 0 ? kIdleRefreshIntervalMs : next);
+}
+
+void RtcDnsResolver::ScheduleRefresh(int64_t delay_ms)
+{
+	auto delay = static_cast<int>(std::max<int64_t>(delay_ms, kMinRefreshIntervalMs));
+	thread_->PostDelayed(RTC_FROM_HERE, delay, this, kRefreshScheduleId);
+}
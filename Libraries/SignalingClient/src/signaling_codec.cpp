@@ -0,0 +1,601 @@
+#include "signaling_codec.h"
+
+#include <stdlib.h>
+
+namespace
+{
+	// Names used for a SessionDescription JSON object.
+	const char kSessionDescriptionTypeName[] = "type";
+	const char kSessionDescriptionSdpName[] = "sdp";
+
+	// Names used for a IceCandidate JSON object.
+	const char kCandidateSdpMidName[] = "sdpMid";
+	const char kCandidateSdpMlineIndexName[] = "sdpMLineIndex";
+	const char kCandidateSdpName[] = "candidate";
+
+	// Credentials for Turn Server.
+	const char kTurnServerUri[] = "uri";
+	const char kTurnServerUsername[] = "username";
+	const char kTurnServerPassword[] = "password";
+
+	// Tags used for binary encoded fields
+	enum FieldTag
+	{
+		TAG_TYPE = 1,
+		TAG_SDP = 2,
+		TAG_TURN_URI = 3,
+		TAG_TURN_USERNAME = 4,
+		TAG_TURN_PASSWORD = 5,
+		TAG_SDP_MID = 6,
+		TAG_SDP_MLINE_INDEX = 7,
+		TAG_CANDIDATE = 8
+	};
+
+	// The fields we found while decoding, before we know what kind of message it is
+	struct DecodedFields
+	{
+		bool has_sdp;
+		bool has_sdp_mid;
+		bool has_sdp_mline_index;
+		bool has_candidate;
+
+		DecodedFields() : has_sdp(false), has_sdp_mid(false), has_sdp_mline_index(false), has_candidate(false) {}
+	};
+
+	// Decides what kind of message we decoded, the same way we always have: anything with a type
+	// is a session description, and anything else must be a complete ice candidate
+	bool Finish(const DecodedFields& fields, SignalingMessage* message)
+	{
+		if (!message->type.empty())
+		{
+			message->kind = SignalingMessage::SESSION_DESCRIPTION;
+			return fields.has_sdp;
+		}
+
+		message->kind = SignalingMessage::ICE_CANDIDATE;
+		return fields.has_sdp_mid && fields.has_sdp_mline_index && fields.has_candidate;
+	}
+
+	void AppendJsonString(const std::string& value, std::string* out)
+	{
+		static const char kHex[] = "0123456789abcdef";
+
+		out->push_back('"');
+
+		for (auto c : value)
+		{
+			switch (c)
+			{
+			case '"': out->append("\\\""); break;
+			case '\\': out->append("\\\\"); break;
+			case '\b': out->append("\\b"); break;
+			case '\f': out->append("\\f"); break;
+			case '\n': out->append("\\n"); break;
+			case '\r': out->append("\\r"); break;
+			case '\t': out->append("\\t"); break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					out->append("\\u00");
+					out->push_back(kHex[(c >> 4) & 0xf]);
+					out->push_back(kHex[c & 0xf]);
+				}
+				else
+				{
+					out->push_back(c);
+				}
+			}
+		}
+
+		out->push_back('"');
+	}
+
+	void AppendJsonField(const char* name, const std::string& value, std::string* out)
+	{
+		out->push_back(out->empty() ? '{' : ',');
+		AppendJsonString(name, out);
+		out->push_back(':');
+		AppendJsonString(value, out);
+	}
+
+	void AppendUtf8(uint32_t code_point, std::string* out)
+	{
+		if (code_point < 0x80)
+		{
+			out->push_back(static_cast<char>(code_point));
+		}
+		else if (code_point < 0x800)
+		{
+			out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+			out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		}
+		else if (code_point < 0x10000)
+		{
+			out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+			out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+			out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		}
+		else
+		{
+			out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+			out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+			out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+			out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+		}
+	}
+
+	// A single pass reader over a json document, which never builds a tree
+	class JsonScanner
+	{
+	public:
+		JsonScanner(const std::string& data) : data_(data), pos_(0) {}
+
+		bool AtEnd()
+		{
+			SkipWhitespace();
+			return pos_ >= data_.size();
+		}
+
+		// Consumes |c| if it's the next non whitespace character
+		bool Consume(char c)
+		{
+			SkipWhitespace();
+			if (pos_ < data_.size() && data_[pos_] == c)
+			{
+				pos_++;
+				return true;
+			}
+
+			return false;
+		}
+
+		char Peek()
+		{
+			SkipWhitespace();
+			return pos_ < data_.size() ? data_[pos_] : '\0';
+		}
+
+		// Reads a string into |out|, which may be null to skip it. Like jsoncpp, raw control
+		// characters are tolerated inside strings, since some peers send unescaped sdp.
+		bool ReadString(std::string* out)
+		{
+			if (!Consume('"'))
+			{
+				return false;
+			}
+
+			while (pos_ < data_.size())
+			{
+				auto c = data_[pos_++];
+				if (c == '"')
+				{
+					return true;
+				}
+
+				if (c != '\\')
+				{
+					if (out != nullptr)
+					{
+						out->push_back(c);
+					}
+
+					continue;
+				}
+
+				if (pos_ >= data_.size())
+				{
+					return false;
+				}
+
+				auto escaped = data_[pos_++];
+				char decoded = '\0';
+				switch (escaped)
+				{
+				case '"': decoded = '"'; break;
+				case '\\': decoded = '\\'; break;
+				case '/': decoded = '/'; break;
+				case 'b': decoded = '\b'; break;
+				case 'f': decoded = '\f'; break;
+				case 'n': decoded = '\n'; break;
+				case 'r': decoded = '\r'; break;
+				case 't': decoded = '\t'; break;
+				case 'u':
+				{
+					uint32_t code_point = 0;
+					if (!ReadHex4(&code_point))
+					{
+						return false;
+					}
+
+					// combine surrogate pairs, leaving unpaired ones as they are
+					if (code_point >= 0xD800 && code_point <= 0xDBFF &&
+						data_.compare(pos_, 2, "\\u") == 0)
+					{
+						auto resume = pos_;
+						uint32_t low = 0;
+						pos_ += 2;
+						if (ReadHex4(&low) && low >= 0xDC00 && low <= 0xDFFF)
+						{
+							code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+						}
+						else
+						{
+							pos_ = resume;
+						}
+					}
+
+					if (out != nullptr)
+					{
+						AppendUtf8(code_point, out);
+					}
+
+					continue;
+				}
+				default:
+					return false;
+				}
+
+				if (out != nullptr)
+				{
+					out->push_back(decoded);
+				}
+			}
+
+			return false;
+		}
+
+		// Reads an integer, accepting the numeric strings some peers send too
+		bool ReadInt(int* out)
+		{
+			std::string token;
+			if (Peek() == '"')
+			{
+				if (!ReadString(&token))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				token = ReadLiteral();
+			}
+
+			if (token.empty())
+			{
+				return false;
+			}
+
+			char* end = nullptr;
+			auto value = strtol(token.c_str(), &end, 10);
+			if (*end != '\0' && *end != '.' && *end != 'e' && *end != 'E')
+			{
+				return false;
+			}
+
+			*out = static_cast<int>(value);
+			return true;
+		}
+
+		// Skips over any value, including nested objects and arrays
+		bool SkipValue()
+		{
+			auto c = Peek();
+			if (c == '"')
+			{
+				return ReadString(nullptr);
+			}
+
+			if (c != '{' && c != '[')
+			{
+				return !ReadLiteral().empty();
+			}
+
+			int depth = 0;
+			while (pos_ < data_.size())
+			{
+				c = data_[pos_];
+				if (c == '"')
+				{
+					if (!ReadString(nullptr))
+					{
+						return false;
+					}
+
+					continue;
+				}
+
+				pos_++;
+				if (c == '{' || c == '[')
+				{
+					depth++;
+				}
+				else if ((c == '}' || c == ']') && --depth == 0)
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		void SkipWhitespace()
+		{
+			while (pos_ < data_.size() &&
+				(data_[pos_] == ' ' || data_[pos_] == '\t' || data_[pos_] == '\r' || data_[pos_] == '\n'))
+			{
+				pos_++;
+			}
+		}
+
+		// Reads a number, true, false or null
+		std::string ReadLiteral()
+		{
+			SkipWhitespace();
+
+			auto start = pos_;
+			while (pos_ < data_.size() && data_[pos_] != ',' && data_[pos_] != '}' && data_[pos_] != ']' &&
+				data_[pos_] != ' ' && data_[pos_] != '\t' && data_[pos_] != '\r' && data_[pos_] != '\n')
+			{
+				pos_++;
+			}
+
+			return data_.substr(start, pos_ - start);
+		}
+
+		bool ReadHex4(uint32_t* out)
+		{
+			if (pos_ + 4 > data_.size())
+			{
+				return false;
+			}
+
+			*out = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				auto c = data_[pos_++];
+				*out <<= 4;
+				if (c >= '0' && c <= '9') *out |= c - '0';
+				else if (c >= 'a' && c <= 'f') *out |= c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') *out |= c - 'A' + 10;
+				else return false;
+			}
+
+			return true;
+		}
+
+		const std::string& data_;
+		size_t pos_;
+	};
+
+	void AppendVarint(uint32_t value, std::string* out)
+	{
+		while (value >= 0x80)
+		{
+			out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+
+		out->push_back(static_cast<char>(value));
+	}
+
+	bool ReadVarint(const std::string& data, size_t* pos, uint32_t* value)
+	{
+		*value = 0;
+		for (int shift = 0; shift < 35 && *pos < data.size(); shift += 7)
+		{
+			auto byte = static_cast<uint8_t>(data[(*pos)++]);
+			*value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void AppendBinaryField(FieldTag tag, const std::string& value, std::string* out)
+	{
+		out->push_back(static_cast<char>(tag));
+		AppendVarint(static_cast<uint32_t>(value.size()), out);
+		out->append(value);
+	}
+}
+
+const uint8_t SignalingCodec::kBinaryMagic;
+
+std::string SignalingCodec::Encode(const SignalingMessage& message, Format format)
+{
+	return format == BINARY ? EncodeBinary(message) : EncodeJson(message);
+}
+
+bool SignalingCodec::Decode(const std::string& data, SignalingMessage* message)
+{
+	*message = SignalingMessage();
+
+	return Detect(data) == BINARY ? DecodeBinary(data, message) : DecodeJson(data, message);
+}
+
+SignalingCodec::Format SignalingCodec::Detect(const std::string& data)
+{
+	return !data.empty() && static_cast<uint8_t>(data[0]) == kBinaryMagic ? BINARY : JSON;
+}
+
+std::string SignalingCodec::EncodeJson(const SignalingMessage& message)
+{
+	std::string out;
+	out.reserve(message.sdp.size() + message.candidate.size() + 128);
+
+	if (message.kind == SignalingMessage::SESSION_DESCRIPTION)
+	{
+		AppendJsonField(kSessionDescriptionTypeName, message.type, &out);
+		AppendJsonField(kSessionDescriptionSdpName, message.sdp, &out);
+		AppendJsonField(kTurnServerUri, message.turn_uri, &out);
+		AppendJsonField(kTurnServerUsername, message.turn_username, &out);
+		AppendJsonField(kTurnServerPassword, message.turn_password, &out);
+	}
+	else
+	{
+		AppendJsonField(kCandidateSdpMidName, message.sdp_mid, &out);
+
+		out.append(",\"");
+		out.append(kCandidateSdpMlineIndexName);
+		out.append("\":");
+		out.append(std::to_string(message.sdp_mline_index));
+
+		AppendJsonField(kCandidateSdpName, message.candidate, &out);
+	}
+
+	out.push_back('}');
+
+	return out;
+}
+
+std::string SignalingCodec::EncodeBinary(const SignalingMessage& message)
+{
+	std::string out;
+	out.reserve(message.sdp.size() + message.candidate.size() + 32);
+	out.push_back(static_cast<char>(kBinaryMagic));
+
+	if (message.kind == SignalingMessage::SESSION_DESCRIPTION)
+	{
+		AppendBinaryField(TAG_TYPE, message.type, &out);
+		AppendBinaryField(TAG_SDP, message.sdp, &out);
+
+		// unlike json, absent fields read back as empty, so we needn't send them
+		if (!message.turn_uri.empty())
+		{
+			AppendBinaryField(TAG_TURN_URI, message.turn_uri, &out);
+			AppendBinaryField(TAG_TURN_USERNAME, message.turn_username, &out);
+			AppendBinaryField(TAG_TURN_PASSWORD, message.turn_password, &out);
+		}
+	}
+	else
+	{
+		std::string index;
+		AppendVarint(static_cast<uint32_t>(message.sdp_mline_index), &index);
+
+		AppendBinaryField(TAG_SDP_MID, message.sdp_mid, &out);
+		AppendBinaryField(TAG_SDP_MLINE_INDEX, index, &out);
+		AppendBinaryField(TAG_CANDIDATE, message.candidate, &out);
+	}
+
+	return out;
+}
+
+bool SignalingCodec::DecodeJson(const std::string& data, SignalingMessage* message)
+{
+	JsonScanner scanner(data);
+	DecodedFields fields;
+
+	if (!scanner.Consume('{'))
+	{
+		return false;
+	}
+
+	if (!scanner.Consume('}'))
+	{
+		do
+		{
+			std::string name;
+			if (!scanner.ReadString(&name) || !scanner.Consume(':'))
+			{
+				return false;
+			}
+
+			// only string values count, as with rtc::GetStringFromJsonObject
+			std::string* target = nullptr;
+			bool* found = nullptr;
+
+			if (name == kSessionDescriptionTypeName) target = &message->type;
+			else if (name == kSessionDescriptionSdpName) target = &message->sdp, found = &fields.has_sdp;
+			else if (name == kTurnServerUri) target = &message->turn_uri;
+			else if (name == kTurnServerUsername) target = &message->turn_username;
+			else if (name == kTurnServerPassword) target = &message->turn_password;
+			else if (name == kCandidateSdpMidName) target = &message->sdp_mid, found = &fields.has_sdp_mid;
+			else if (name == kCandidateSdpName) target = &message->candidate, found = &fields.has_candidate;
+
+			bool ok = false;
+			if (name == kCandidateSdpMlineIndexName && scanner.Peek() != '{' && scanner.Peek() != '[')
+			{
+				ok = scanner.ReadInt(&message->sdp_mline_index);
+				fields.has_sdp_mline_index = ok;
+			}
+			else if (target != nullptr && scanner.Peek() == '"')
+			{
+				target->clear();
+				ok = scanner.ReadString(target);
+				if (found != nullptr)
+				{
+					*found = ok;
+				}
+			}
+			else
+			{
+				ok = scanner.SkipValue();
+			}
+
+			if (!ok)
+			{
+				return false;
+			}
+		} while (scanner.Consume(','));
+
+		if (!scanner.Consume('}'))
+		{
+			return false;
+		}
+	}
+
+	return scanner.AtEnd() && Finish(fields, message);
+}
+
+bool SignalingCodec::DecodeBinary(const std::string& data, SignalingMessage* message)
+{
+	DecodedFields fields;
+	size_t pos = 1;
+
+	while (pos < data.size())
+	{
+		auto tag = static_cast<uint8_t>(data[pos++]);
+
+		uint32_t length = 0;
+		if (!ReadVarint(data, &pos, &length) || length > data.size() - pos)
+		{
+			return false;
+		}
+
+		auto value = data.substr(pos, length);
+		pos += length;
+
+		switch (tag)
+		{
+		case TAG_TYPE: message->type = value; break;
+		case TAG_SDP: message->sdp = value; fields.has_sdp = true; break;
+		case TAG_TURN_URI: message->turn_uri = value; break;
+		case TAG_TURN_USERNAME: message->turn_username = value; break;
+		case TAG_TURN_PASSWORD: message->turn_password = value; break;
+		case TAG_SDP_MID: message->sdp_mid = value; fields.has_sdp_mid = true; break;
+		case TAG_CANDIDATE: message->candidate = value; fields.has_candidate = true; break;
+		case TAG_SDP_MLINE_INDEX:
+		{
+			size_t index_pos = 0;
+			uint32_t index = 0;
+			if (!ReadVarint(value, &index_pos, &index) || index_pos != value.size())
+			{
+				return false;
+			}
+
+			message->sdp_mline_index = static_cast<int>(index);
+			fields.has_sdp_mline_index = true;
+			break;
+		}
+		default:
+			// a field from a newer peer, which we can safely ignore
+			break;
+		}
+	}
+
+	return Finish(fields, message);
+}
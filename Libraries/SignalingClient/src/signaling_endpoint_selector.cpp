@@ -0,0 +1,162 @@
+#include "signaling_endpoint_selector.h"
+
+#include <chrono>
+
+namespace
+{
+	int64_t SteadyClockMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+const int SignalingEndpointSelector::kNoEndpoint;
+
+SignalingEndpointSelector::SignalingEndpointSelector() :
+	SignalingEndpointSelector(std::vector<SignalingEndpoint>())
+{
+}
+
+SignalingEndpointSelector::SignalingEndpointSelector(const std::vector<SignalingEndpoint>& endpoints) :
+	SignalingEndpointSelector(endpoints, Options(), &SteadyClockMs)
+{
+}
+
+SignalingEndpointSelector::SignalingEndpointSelector(const std::vector<SignalingEndpoint>& endpoints,
+	const Options& options, const Clock& clock) :
+	endpoints_(endpoints),
+	states_(endpoints.size(), EndpointState{ -1, 0, 0 }),
+	options_(options),
+	clock_(clock)
+{
+}
+
+const std::vector<SignalingEndpoint>& SignalingEndpointSelector::endpoints() const
+{
+	return endpoints_;
+}
+
+void SignalingEndpointSelector::RecordRtt(int index, int64_t rtt_ms)
+{
+	if (!IsValidIndex(index) || rtt_ms < 0)
+	{
+		return;
+	}
+
+	auto& state = states_[index];
+	if (state.smoothed_rtt_ms < 0)
+	{
+		state.smoothed_rtt_ms = rtt_ms;
+	}
+	else
+	{
+		state.smoothed_rtt_ms = static_cast<int64_t>(
+			options_.rtt_smoothing * rtt_ms + (1.0 - options_.rtt_smoothing) * state.smoothed_rtt_ms);
+	}
+
+	RecordSuccess(index);
+}
+
+void SignalingEndpointSelector::RecordSuccess(int index)
+{
+	if (!IsValidIndex(index))
+	{
+		return;
+	}
+
+	states_[index].consecutive_failures = 0;
+	states_[index].down_until_ms = 0;
+}
+
+void SignalingEndpointSelector::RecordFailure(int index)
+{
+	if (!IsValidIndex(index))
+	{
+		return;
+	}
+
+	auto& state = states_[index];
+	state.consecutive_failures++;
+
+	if (state.consecutive_failures >= options_.failure_threshold)
+	{
+		state.down_until_ms = clock_() + options_.down_retry_ms;
+	}
+}
+
+bool SignalingEndpointSelector::IsHealthy(int index) const
+{
+	return IsValidIndex(index) &&
+		(states_[index].consecutive_failures < options_.failure_threshold ||
+		clock_() >= states_[index].down_until_ms);
+}
+
+int64_t SignalingEndpointSelector::SmoothedRtt(int index) const
+{
+	return IsValidIndex(index) ? states_[index].smoothed_rtt_ms : -1;
+}
+
+int SignalingEndpointSelector::Select() const
+{
+	return SelectExcluding(kNoEndpoint);
+}
+
+int SignalingEndpointSelector::SelectFailover(int current) const
+{
+	int other = SelectExcluding(current);
+
+	// only stay put if nothing else is usable and we aren't considered down ourselves
+	if (other == kNoEndpoint || (!IsHealthy(other) && IsHealthy(current)))
+	{
+		return SelectExcluding(kNoEndpoint);
+	}
+
+	return other;
+}
+
+int SignalingEndpointSelector::SelectExcluding(int excluded) const
+{
+	int best = kNoEndpoint;
+	int soonest = kNoEndpoint;
+
+	for (int i = 0; i < static_cast<int>(endpoints_.size()); i++)
+	{
+		if (i == excluded)
+		{
+			continue;
+		}
+
+		if (!IsHealthy(i))
+		{
+			// remember which down endpoint comes back first, in case everything is down
+			if (soonest == kNoEndpoint || states_[i].down_until_ms < states_[soonest].down_until_ms)
+			{
+				soonest = i;
+			}
+
+			continue;
+		}
+
+		if (best == kNoEndpoint)
+		{
+			best = i;
+			continue;
+		}
+
+		// measured beats unmeasured, then lower rtt wins, then configuration order
+		auto rtt = states_[i].smoothed_rtt_ms;
+		auto best_rtt = states_[best].smoothed_rtt_ms;
+		if (rtt >= 0 && (best_rtt < 0 || rtt < best_rtt))
+		{
+			best = i;
+		}
+	}
+
+	return best != kNoEndpoint ? best : soonest;
+}
+
+bool SignalingEndpointSelector::IsValidIndex(int index) const
+{
+	return index >= 0 && index < static_cast<int>(endpoints_.size());
+}
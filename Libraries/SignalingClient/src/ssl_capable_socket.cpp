@@ -2,6 +2,8 @@
 
 #include <chrono>
 
+#include "webrtc/rtc_base/logging.h"
+
 #ifdef WIN32
 #include "webrtc/rtc_base/win32socketserver.h"
 #endif
@@ -22,17 +24,49 @@ namespace
 #error Platform not supported.
 #endif // WIN32
 	}
+
+	// An idle connection, along with the tls session running over it
+	class SocketConnection : public PooledConnection
+	{
+	public:
+		SocketConnection(std::unique_ptr<AsyncSocket> socket, std::unique_ptr<SSLAdapter> ssl_adapter) :
+			socket_(std::move(socket)),
+			ssl_adapter_(std::move(ssl_adapter))
+		{}
+
+		~SocketConnection()
+		{
+			// the adapter owns the socket it wraps
+			if (ssl_adapter_.get() != nullptr)
+			{
+				socket_.release();
+			}
+		}
+
+		bool IsOpen() const override
+		{
+			auto provider = ssl_adapter_.get() != nullptr ? static_cast<AsyncSocket*>(ssl_adapter_.get()) : socket_.get();
+			return provider->GetState() == Socket::CS_CONNECTED;
+		}
+
+		std::unique_ptr<AsyncSocket> socket_;
+		std::unique_ptr<SSLAdapter> ssl_adapter_;
+	};
 }
 
 SslCapableSocket::SslCapableSocket(const int& family, const bool& use_ssl, std::weak_ptr<Thread> signaling_thread) :
 	SslCapableSocket(std::unique_ptr<AsyncSocket>(CreateClientSocket(family)), use_ssl, signaling_thread)
 {
+	family_ = family;
 }
 
 SslCapableSocket::SslCapableSocket(std::unique_ptr<AsyncSocket> wrapped_socket, const bool& use_ssl, std::weak_ptr<Thread> signaling_thread) :
 	socket_(std::move(wrapped_socket)),
 	ssl_adapter_(nullptr),
-	signaling_thread_(signaling_thread)
+	family_(AF_UNSPEC),
+	signaling_thread_(signaling_thread),
+	reused_(false),
+	resend_pending_(false)
 {
 	MapUnderlyingEvents(socket_.get());
 	SetUseSsl(use_ssl);
@@ -85,6 +119,64 @@ int SslCapableSocket::Connect(const SocketAddress& addr)
 {
 	LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
+	remote_address_ = addr;
+	reused_ = false;
+	resend_pending_ = false;
+	unanswered_.clear();
+
+	if (connection_pool_.get() != nullptr)
+	{
+		pool_key_ = ConnectionPool::Key(addr.hostname().empty() ? addr.ipaddr().ToString() : addr.hostname(),
+			addr.port(), ssl_adapter_.get() != nullptr);
+
+		auto pooled = connection_pool_->Take(pool_key_);
+		if (pooled.get() != nullptr)
+		{
+			auto connection = static_cast<SocketConnection*>(pooled.get());
+
+			// swap our unconnected socket for the established one
+			Provider()->SignalReadEvent.disconnect(this);
+			Provider()->SignalWriteEvent.disconnect(this);
+			Provider()->SignalConnectEvent.disconnect(this);
+			Provider()->SignalCloseEvent.disconnect(this);
+
+			if (ssl_adapter_.get() != nullptr)
+			{
+				socket_.release();
+			}
+
+			ssl_adapter_ = std::move(connection->ssl_adapter_);
+			socket_ = std::move(connection->socket_);
+			MapUnderlyingEvents(Provider());
+			reused_ = true;
+
+			LOG(INFO) << __FUNCTION__ << ": reusing connection to " << pool_key_;
+
+			// callers expect the connect event after Connect returns, as with a real connect
+			if (auto marshaled_thread = signaling_thread_.lock())
+			{
+				invoker_.AsyncInvoke<void>(RTC_FROM_HERE, marshaled_thread.get(), [this]
+				{
+					if (GetState() == Socket::CS_CONNECTED)
+					{
+						this->SignalConnectEvent.emit(Provider());
+					}
+					else if (reused_)
+					{
+						RetryOnFreshConnection();
+					}
+				});
+			}
+
+			return 0;
+		}
+	}
+
+	return ConnectDirect(addr);
+}
+
+int SslCapableSocket::ConnectDirect(const SocketAddress& addr)
+{
 	if (ssl_adapter_.get() == nullptr)
 	{
 		return socket_->Connect(addr);
@@ -106,7 +198,36 @@ int SslCapableSocket::Send(const void* pv, size_t cb)
 {
 	LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
-	return ssl_adapter_.get() == nullptr ? socket_->Send(pv, cb) : ssl_adapter_->Send(pv, cb);
+	int sent = ssl_adapter_.get() == nullptr ? socket_->Send(pv, cb) : ssl_adapter_->Send(pv, cb);
+	if (!reused_)
+	{
+		return sent;
+	}
+
+	// a reused connection that can't be sent on is retried fresh, so as far as the caller knows, this went out
+	if (sent < 0 && !IsBlockingError(GetError()))
+	{
+		unanswered_.append(static_cast<const char*>(pv), cb);
+		if (auto marshaled_thread = signaling_thread_.lock())
+		{
+			invoker_.AsyncInvoke<void>(RTC_FROM_HERE, marshaled_thread.get(), [this]
+			{
+				if (reused_)
+				{
+					RetryOnFreshConnection();
+				}
+			});
+		}
+
+		return static_cast<int>(cb);
+	}
+
+	if (sent > 0)
+	{
+		unanswered_.append(static_cast<const char*>(pv), sent);
+	}
+
+	return sent;
 }
 
 int SslCapableSocket::SendTo(const void* pv, size_t cb, const SocketAddress& addr)
@@ -120,7 +241,16 @@ int SslCapableSocket::Recv(void* pv, size_t cb, int64_t* timestamp)
 {
 	LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
-	return ssl_adapter_.get() == nullptr ? socket_->Recv(pv, cb, timestamp) : ssl_adapter_->Recv(pv, cb, timestamp);
+	int read = ssl_adapter_.get() == nullptr ? socket_->Recv(pv, cb, timestamp) : ssl_adapter_->Recv(pv, cb, timestamp);
+
+	// once the server answers, the connection is known to be good
+	if (read > 0 && reused_)
+	{
+		reused_ = false;
+		unanswered_.clear();
+	}
+
+	return read;
 }
 
 int SslCapableSocket::RecvFrom(void* pv,
@@ -147,6 +277,10 @@ int SslCapableSocket::Close()
 {
 	LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
+	reused_ = false;
+	resend_pending_ = false;
+	unanswered_.clear();
+
 	return ssl_adapter_.get() == nullptr ? socket_->Close() : ssl_adapter_->Close();
 }
 
@@ -175,6 +309,81 @@ int SslCapableSocket::SetOption(AsyncSocket::Option opt, int value)
 	return ssl_adapter_.get() == nullptr ? socket_->SetOption(opt, value) : ssl_adapter_->SetOption(opt, value);
 }
 
+void SslCapableSocket::SetConnectionPool(const std::shared_ptr<ConnectionPool>& pool)
+{
+	connection_pool_ = pool;
+}
+
+bool SslCapableSocket::Park()
+{
+	if (connection_pool_.get() == nullptr || family_ == AF_UNSPEC ||
+		pool_key_.empty() || GetState() != Socket::CS_CONNECTED)
+	{
+		Close();
+		return false;
+	}
+
+	auto provider = Provider();
+	provider->SignalReadEvent.disconnect(this);
+	provider->SignalWriteEvent.disconnect(this);
+	provider->SignalConnectEvent.disconnect(this);
+	provider->SignalCloseEvent.disconnect(this);
+
+	bool use_ssl = ssl_adapter_.get() != nullptr;
+	connection_pool_->Park(pool_key_, std::unique_ptr<PooledConnection>(
+		new SocketConnection(std::move(socket_), std::move(ssl_adapter_))));
+
+	// carry on with a fresh, unconnected socket, exactly as if we'd closed
+	socket_.reset(CreateClientSocket(family_));
+	MapUnderlyingEvents(socket_.get());
+	SetUseSsl(use_ssl);
+
+	return true;
+}
+
+bool SslCapableSocket::Wraps(const AsyncSocket* socket) const
+{
+	return socket == this || socket == socket_.get() || socket == ssl_adapter_.get();
+}
+
+AsyncSocket* SslCapableSocket::Provider() const
+{
+	return ssl_adapter_.get() != nullptr ? static_cast<AsyncSocket*>(ssl_adapter_.get()) : socket_.get();
+}
+
+void SslCapableSocket::RetryOnFreshConnection()
+{
+	LOG(WARNING) << __FUNCTION__ << ": reused connection to " << pool_key_ << " failed, retrying on a fresh one";
+
+	reused_ = false;
+	resend_pending_ = true;
+
+	auto provider = Provider();
+	provider->SignalReadEvent.disconnect(this);
+	provider->SignalWriteEvent.disconnect(this);
+	provider->SignalConnectEvent.disconnect(this);
+	provider->SignalCloseEvent.disconnect(this);
+
+	// the adapter owns the socket it wraps
+	bool use_ssl = ssl_adapter_.get() != nullptr;
+	if (use_ssl)
+	{
+		socket_.release();
+	}
+
+	ssl_adapter_.reset(nullptr);
+	socket_.reset(CreateClientSocket(family_));
+	MapUnderlyingEvents(socket_.get());
+	SetUseSsl(use_ssl);
+
+	if (ConnectDirect(remote_address_) != 0 && !IsBlockingError(GetError()))
+	{
+		resend_pending_ = false;
+		unanswered_.clear();
+		SignalCloseEvent.emit(this, GetError());
+	}
+}
+
 void SslCapableSocket::MapUnderlyingEvents(AsyncSocket* provider, AsyncSocket* oldProvider)
 {
 	if (oldProvider != nullptr)
@@ -225,6 +434,16 @@ void SslCapableSocket::RefireConnectEvent(AsyncSocket* socket)
 		{
 			LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
+			// the caller already saw a connect, and sent its request, on the connection this replaced
+			if (resend_pending_)
+			{
+				resend_pending_ = false;
+				auto request = std::move(unanswered_);
+				unanswered_.clear();
+				Send(request.data(), request.size());
+				return;
+			}
+
 			this->SignalConnectEvent.emit(socket);
 		});
 	}
@@ -238,6 +457,20 @@ void SslCapableSocket::RefireCloseEvent(AsyncSocket* socket, int err)
 		{
 			LOG(INFO) << __FUNCTION__ << "@" << std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
+			// the server closed a connection we reused before answering; retry once we're out of its signal
+			if (reused_)
+			{
+				invoker_.AsyncInvoke<void>(RTC_FROM_HERE, marshaled_thread.get(), [this]
+				{
+					if (reused_)
+					{
+						RetryOnFreshConnection();
+					}
+				});
+
+				return;
+			}
+
 			this->SignalCloseEvent.emit(socket, err);
 		});
 	}
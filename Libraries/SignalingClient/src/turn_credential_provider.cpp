@@ -1,4 +1,6 @@
 #include "turn_credential_provider.h"
+#include "rtc_dns_resolver.h"
+#include "webrtc/rtc_base/logging.h"
 
 namespace
 {
@@ -13,7 +15,9 @@ TurnCredentialProvider::TurnCredentialProvider(const std::string& uri) :
 
 TurnCredentialProvider::TurnCredentialProvider(const std::string& uri, std::shared_ptr<SslCapableSocket::Factory> async_socket_factory) :
 	state_(State::NOT_ACTIVE),
-	async_socket_factory_(async_socket_factory)
+	async_socket_factory_(async_socket_factory),
+	dns_cache_(RtcDnsResolver::SharedCache()),
+	resolve_ticket_(DnsCache::kNoTicket)
 {
 	// take the hostname, <protocol>://<hostname>[:port]/ 
 	auto tempAuthHost = uri.substr(uri.find_first_of("://") + 3);
@@ -33,6 +37,11 @@ TurnCredentialProvider::TurnCredentialProvider(const std::string& uri, std::shar
 	auto authorityPort = std::string("https://").compare(uri.substr(0, 8)) == 0 ? 443 : 80;
 	host_ = rtc::SocketAddress(tempAuthHost, authorityPort);
 
+	if (host_.IsUnresolvedIP())
+	{
+		dns_cache_->Prefetch(host_.hostname());
+	}
+
 	// configure the thread which will be used for socket signalling. it's just some representation of
 	// the current thread (wrapped or existing)
 	auto socketThread = rtc::Thread::Current();
@@ -48,6 +57,8 @@ TurnCredentialProvider::TurnCredentialProvider(const std::string& uri, std::shar
 
 TurnCredentialProvider::~TurnCredentialProvider()
 {
+	dns_cache_->Cancel(resolve_ticket_);
+
 	if (auth_provider_ != nullptr)
 	{
 		auth_provider_->SignalAuthenticationComplete.disconnect(this);
@@ -60,6 +71,13 @@ void TurnCredentialProvider::SetAuthenticationProvider(AuthenticationProvider* a
 	auth_provider_->SignalAuthenticationComplete.connect(this, &TurnCredentialProvider::OnAuthenticationComplete);
 }
 
+void TurnCredentialProvider::SetDnsCache(const std::shared_ptr<DnsCache>& dnsCache)
+{
+	dns_cache_->Cancel(resolve_ticket_);
+	resolve_ticket_ = DnsCache::kNoTicket;
+	dns_cache_ = dnsCache;
+}
+
 bool TurnCredentialProvider::RequestCredentials()
 {
 	if (state_ != State::NOT_ACTIVE)
@@ -78,10 +96,10 @@ bool TurnCredentialProvider::RequestCredentials()
 	// if we need to resolve the ip we do that before connecting
 	if (host_.IsUnresolvedIP())
 	{
+		// note: on a cache hit this calls back before Resolve returns
 		state_ = RESOLVING;
-		resolver_.reset(new rtc::AsyncResolver());
-		resolver_->SignalDone.connect(this, &TurnCredentialProvider::AddressResolve);
-		resolver_->Start(host_);
+		resolve_ticket_ = dns_cache_->Resolve(host_.hostname(),
+			[this](const std::string& ip) { AddressResolve(ip); });
 
 		return true;
 	}
@@ -197,24 +215,28 @@ void TurnCredentialProvider::SocketClose(rtc::AsyncSocket* socket, int err)
 	state_ = State::NOT_ACTIVE;
 }
 
-void TurnCredentialProvider::AddressResolve(rtc::AsyncResolverInterface* resolver)
+void TurnCredentialProvider::AddressResolve(const std::string& ip)
 {
-	// capture the result
-	auto tempHost = resolver->address();
-
-	// release the resolver pointer and destroy the resolver
-	auto released = resolver_.release();
-	released->Destroy(true);
-
-	// reset the resolver pointer to nullptr
-	resolver_.reset(nullptr);
+	resolve_ticket_ = DnsCache::kNoTicket;
 
 	if (state_ != State::RESOLVING)
 	{
 		return;
 	}
 
-	host_ = tempHost;
+	if (!RtcDnsResolver::ApplyResolvedIp(ip, &host_))
+	{
+		LOG(LS_ERROR) << __FUNCTION__ << ": unable to resolve " << host_.hostname();
+
+		// let the caller know this request is over, so it can retry
+		state_ = State::NOT_ACTIVE;
+
+		TurnCredentials completionData;
+		completionData.successFlag = false;
+		SignalCredentialsRetrieved.emit(completionData);
+
+		return;
+	}
 
 	if (auth_token_.empty())
 	{
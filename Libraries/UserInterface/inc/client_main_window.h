@@ -66,6 +66,9 @@ public:
 
 	sigslot::signal3<UINT, WPARAM, LPARAM> SignalClientWindowMessage;
 
+	// Emitted on the UI thread with the prediction timestamp of each new frame painted
+	sigslot::signal1<int64_t> SignalFramePresented;
+
 	bool PreTranslateMessage(MSG* msg);
 
 	virtual bool Create() override;
@@ -127,6 +130,12 @@ public:
 			return latency_;
 		}
 
+		// The prediction timestamp of the frame in image()
+		int64_t prediction_timestamp() const
+		{
+			return prediction_timestamp_;
+		}
+
 	protected:
 		void SetSize(int width, int height);
 
@@ -146,6 +155,7 @@ public:
 		int fps_;
 		int latency_total_;
 		int latency_;
+		int64_t prediction_timestamp_;
 	};
 
 	// A little helper class to make sure we always to proper locking and
@@ -213,6 +223,9 @@ private:
 	bool connect_button_state_;
 	WCHAR fps_text_[64];
 
+	// The prediction timestamp of the frame painted last
+	int64_t presented_timestamp_;
+
 	int width_;
 	int height_;
 
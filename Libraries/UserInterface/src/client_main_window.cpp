@@ -102,7 +102,8 @@ ClientMainWindow::ClientMainWindow(
 		auto_call_(auto_call),
 		width_(width),
 		height_(height),
-		connect_button_state_(true)
+		connect_button_state_(true),
+		presented_timestamp_(-1)
 {
 	SignalWindowMessage.connect(this, &ClientMainWindow::OnMessage);
 
@@ -308,6 +309,7 @@ void ClientMainWindow::OnPaint()
 		int width = bmi.bmiHeader.biWidth;
 		const uint8_t* image = remote_renderer->image();
 		const int fps = ((ClientVideoRenderer*)remote_renderer)->fps();
+		const int64_t prediction_timestamp = ((ClientVideoRenderer*)remote_renderer)->prediction_timestamp();
 		if (image != NULL)
 		{
 			// Initializes the bitmap properties.
@@ -357,6 +359,13 @@ void ClientMainWindow::OnPaint()
 
 			// Releases the bitmap.
 			SAFE_RELEASE(bitmap);
+
+			// Repaints of the same frame aren't presenting anything new.
+			if (prediction_timestamp != presented_timestamp_)
+			{
+				presented_timestamp_ = prediction_timestamp;
+				SignalFramePresented.emit(prediction_timestamp);
+			}
 		}
 		else
 		{
@@ -768,7 +777,8 @@ ClientMainWindow::ClientVideoRenderer::ClientVideoRenderer(HWND wnd, int width,
 		rendered_track_(track_to_render),
 		time_tick_(0),
 		frame_counter_(0),
-		latency_total_(0)
+		latency_total_(0),
+		prediction_timestamp_(-1)
 {
 	::InitializeCriticalSection(&buffer_lock_);
 	ZeroMemory(&bmi_, sizeof(bmi_));
@@ -826,6 +836,7 @@ void ClientMainWindow::ClientVideoRenderer::OnFrame(const webrtc::VideoFrame& vi
 		bmi_.bmiHeader.biBitCount / 8,
 		buffer->width(), buffer->height());
 
+	prediction_timestamp_ = video_frame.prediction_timestamp();
 	InvalidateRect(wnd_, NULL, TRUE);
 
 	// Updates FPS and latency. We use the prediction timestamp here to
@@ -0,0 +1,2164 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <math.h>
+#include <memory>
+#include <sstream>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <gtest\gtest.h>
+#include "content_adapter.h"
+#include "content_classifier.h"
+#include "encode_pipeline.h"
+#include "encoder_control.h"
+#include "encoder_factory.h"
+#include "encoder_session_pool.h"
+#include "encoder_sweep.h"
+#include "frame_source.h"
+#include "loss_recovery.h"
+#include "mock_nvenc.h"
+#include "nvenc_encoder.h"
+#include "openh264_encoder.h"
+#include "quality_metrics.h"
+#include "quality_sampler.h"
+#include "stream_recording.h"
+#include "stream_replayer.h"
+#include "video_frame.h"
+
+namespace
+{
+	// A gradient with a bright square moving across it, so consecutive frames mostly match, or
+	// with the gradient scrolling too when |busy|, so no block can be skipped
+	I420Frame MakeFrame(int width, int height, int index, bool busy = false)
+	{
+		I420Frame frame(width, height);
+		for (int plane = 0; plane < 3; plane++)
+		{
+			auto data = frame.data(plane);
+			auto plane_width = frame.PlaneWidth(plane);
+			auto plane_height = frame.PlaneHeight(plane);
+			auto scale = plane == 0 ? 1 : 2;
+			for (int y = 0; y < plane_height; y++)
+			{
+				for (int x = 0; x < plane_width; x++)
+				{
+					auto value = plane == 0 ? (x * 2 + y + (busy ? index * 7 : 0)) % 200 + 20 : 128 + (plane == 1 ? x - y : y - x) % 32;
+					auto square_x = (index * 4) % width;
+					if (x * scale >= square_x && x * scale < square_x + 32 && y * scale >= 16 && y * scale < 48)
+					{
+						value = plane == 0 ? 235 : 90;
+					}
+
+					data[y * plane_width + x] = static_cast<uint8_t>(value);
+				}
+			}
+		}
+
+		return frame;
+	}
+
+	double LumaPsnr(const I420Frame& a, const I420Frame& b)
+	{
+		double error = 0;
+		auto size = a.PlaneWidth(0) * a.PlaneHeight(0);
+		for (int i = 0; i < size; i++)
+		{
+			double difference = a.data(0)[i] - b.data(0)[i];
+			error += difference * difference;
+		}
+
+		if (error == 0)
+		{
+			return 100;
+		}
+
+		return 10 * log10(255.0 * 255.0 * size / error);
+	}
+
+	EncoderConfig MakeConfig(int width, int height)
+	{
+		EncoderConfig config;
+		config.width = width;
+		config.height = height;
+		config.fps = 60;
+		config.bitrate_bps = 2000000;
+		return config;
+	}
+
+	// Cisco's OpenH264 library, which has to be beside the tests
+	const OpenH264Functions& OpenH264()
+	{
+		static OpenH264Functions functions = {};
+		static bool loaded = OpenH264Encoder::LoadFunctions(&functions);
+		EXPECT_TRUE(loaded) << "openh264.dll, from Cisco's OpenH264 releases, has to be beside the tests";
+		return functions;
+	}
+
+	// Each backend behind the common interface, the NVENC one driving a mock
+	class Backend
+	{
+	public:
+		explicit Backend(const std::string& name)
+		{
+			if (name == "nvenc")
+			{
+				mock_.reset(new MockNvenc());
+				encoder_.reset(new NvencEncoder(mock_->functions(), mock_->device(), NV_ENC_DEVICE_TYPE_CUDA));
+			}
+			else
+			{
+				encoder_.reset(new OpenH264Encoder(OpenH264()));
+			}
+		}
+
+		EncoderBackend* operator->() { return encoder_.get(); }
+
+	private:
+		std::unique_ptr<MockNvenc> mock_;
+		std::unique_ptr<EncoderBackend> encoder_;
+	};
+
+	// |frame| with noise of up to +-|amplitude| added, the same each time
+	I420Frame AddNoise(const I420Frame& frame, int amplitude, uint32_t seed)
+	{
+		SyntheticFrameSource noise(frame.width(), frame.height(), 1, SyntheticPattern::kNoise, 60, seed);
+		I420Frame noisy;
+		noise.Read(&noisy);
+		for (size_t i = 0; i < frame.size(); i++)
+		{
+			auto value = frame.data(0)[i] + (noisy.data(0)[i] % (2 * amplitude + 1)) - amplitude;
+			noisy.data(0)[i] = static_cast<uint8_t>(std::min(255, std::max(0, value)));
+		}
+
+		return noisy;
+	}
+
+	void ExpectSameScores(const QualityScores& expected, const QualityScores& actual)
+	{
+		EXPECT_EQ(expected.psnr_y, actual.psnr_y);
+		EXPECT_EQ(expected.psnr_u, actual.psnr_u);
+		EXPECT_EQ(expected.psnr_v, actual.psnr_v);
+		EXPECT_EQ(expected.psnr, actual.psnr);
+		EXPECT_EQ(expected.ssim_y, actual.ssim_y);
+		EXPECT_EQ(expected.ssim_u, actual.ssim_u);
+		EXPECT_EQ(expected.ssim_v, actual.ssim_v);
+		EXPECT_EQ(expected.ssim, actual.ssim);
+		EXPECT_EQ(expected.ms_ssim, actual.ms_ssim);
+	}
+
+	int64_t ElapsedUs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+TEST(VideoEncoderTests, FramePlanesArePacked)
+{
+	I420Frame frame(33, 17);
+	EXPECT_EQ(17, frame.PlaneWidth(1));
+	EXPECT_EQ(9, frame.PlaneHeight(2));
+	EXPECT_EQ(33u * 17 + 2 * 17 * 9, frame.size());
+	EXPECT_EQ(frame.data(0) + 33 * 17, frame.data(1));
+	EXPECT_EQ(frame.data(1) + 17 * 9, frame.data(2));
+	EXPECT_TRUE(I420Frame().empty());
+}
+
+TEST(VideoEncoderTests, OpenH264RoundTrips)
+{
+	OpenH264Encoder encoder(OpenH264());
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(128, 96)));
+
+	OpenH264Decoder decoder(OpenH264());
+	for (int i = 0; i < 10; i++)
+	{
+		auto frame = MakeFrame(128, 96, i);
+		EncodeParams params;
+		params.timestamp_us = i * 16667;
+
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(frame, params, &encoded));
+		EXPECT_EQ(i == 0, encoded.keyframe);
+		EXPECT_EQ(static_cast<uint32_t>(i), encoded.frame_number);
+		EXPECT_EQ(params.timestamp_us, encoded.timestamp_us);
+
+		// Annex B, with parameter sets leading each IDR
+		ASSERT_GT(encoded.data.size(), 5u);
+		EXPECT_EQ(1, encoded.data[3]);
+		EXPECT_EQ(encoded.keyframe ? 7 : 1, encoded.data[4] & 0x1f);
+
+		I420Frame decoded;
+		ASSERT_TRUE(decoder.Decode(encoded.data.data(), encoded.data.size(), &decoded));
+		EXPECT_GT(LumaPsnr(frame, decoded), 30);
+	}
+}
+
+TEST(VideoEncoderTests, OpenH264RefusesWhatItCantDo)
+{
+	OpenH264Encoder encoder(OpenH264());
+	auto config = MakeConfig(64, 48);
+	config.preset = EncoderPreset::kLossless;
+	EXPECT_EQ(EncoderStatus::kUnsupported, encoder.Initialize(config));
+
+	// nor invalidate a frame it hasn't sent, or one with no frame before it to go back to
+	EXPECT_EQ(EncoderStatus::kNotInitialized, encoder.InvalidateFrame(0));
+	config.preset = EncoderPreset::kLowLatencyHighQuality;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+	EXPECT_EQ(EncoderStatus::kInvalidParam, encoder.InvalidateFrame(0));
+
+	// and the quantizer isn't reported
+	EncodedFrame encoded;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(MakeFrame(64, 48, 0), EncodeParams(), &encoded));
+	EXPECT_EQ(-1, encoded.qp);
+	EXPECT_EQ(EncoderStatus::kInvalidParam, encoder.InvalidateFrame(0));
+}
+
+TEST(VideoEncoderTests, OpenH264RateControlTracksBitrate)
+{
+	auto config = MakeConfig(160, 120);
+	config.bitrate_bps = 250000;
+	config.fps = 30;
+
+	OpenH264Encoder encoder(OpenH264());
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	size_t bytes = 0;
+	const int kFrames = 120;
+	for (int i = 0; i < kFrames; i++)
+	{
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(MakeFrame(160, 120, i, true), EncodeParams(), &encoded));
+
+		// the first second lets the quantizer settle
+		if (i >= config.fps)
+		{
+			bytes += encoded.data.size();
+		}
+	}
+
+	auto bitrate = bytes * 8.0 * config.fps / (kFrames - config.fps);
+	EXPECT_NEAR(config.bitrate_bps, bitrate, config.bitrate_bps * 0.2);
+}
+
+TEST(VideoEncoderTests, OpenH264RateControlTracksBitrateAcrossSizes)
+{
+	struct Case
+	{
+		int width;
+		int height;
+		SyntheticPattern pattern;
+		int bitrate_bps;
+	};
+
+	// every block changing, text and noise, at rates each can reach. OpenH264 doesn't pad, so
+	// content easier than its rate undershoots it, and content harder than its highest qp overshoots
+	const Case kCases[] =
+	{
+		{ 160, 120, SyntheticPattern::kScrolling, 100000 },
+		{ 160, 120, SyntheticPattern::kScrolling, 300000 },
+		{ 320, 180, SyntheticPattern::kScrolling, 300000 },
+		{ 320, 180, SyntheticPattern::kScrolling, 1000000 },
+		{ 640, 360, SyntheticPattern::kScrolling, 600000 },
+		{ 640, 360, SyntheticPattern::kScrolling, 2000000 },
+		{ 160, 120, SyntheticPattern::kText, 100000 },
+		{ 160, 120, SyntheticPattern::kNoise, 2000000 },
+	};
+
+	// a scroll every half second moves the quantizer only so far, so text takes a few seconds to settle
+	const int kFrames = 240;
+	const int kSettleFrames = 90;
+	for (const auto& test : kCases)
+	{
+		auto config = MakeConfig(test.width, test.height);
+		config.bitrate_bps = test.bitrate_bps;
+		config.fps = 30;
+
+		OpenH264Encoder encoder(OpenH264());
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+		SyntheticFrameSource source(test.width, test.height, kFrames, test.pattern, config.fps);
+		I420Frame frame;
+		size_t bytes = 0;
+		for (int i = 0; source.Read(&frame); i++)
+		{
+			EncodedFrame encoded;
+			ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(frame, EncodeParams(), &encoded));
+			if (i >= kSettleFrames)
+			{
+				bytes += encoded.data.size();
+			}
+		}
+
+		auto bitrate = bytes * 8.0 * config.fps / (kFrames - kSettleFrames);
+		EXPECT_NEAR(config.bitrate_bps, bitrate, config.bitrate_bps * 0.1) << test.width << "x" << test.height <<
+			" pattern " << static_cast<int>(test.pattern);
+	}
+}
+
+TEST(VideoEncoderTests, MockNvencEncodesThroughTheFunctionTable)
+{
+	MockNvenc mock;
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+
+	auto config = MakeConfig(64, 48);
+	config.gop_length = 4;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	for (int i = 0; i < 6; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = 1000 + i;
+		params.force_idr = i == 5;
+
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(MakeFrame(64, 48, i), params, &encoded));
+		EXPECT_EQ(i == 0 || i == 4 || i == 5, encoded.keyframe);
+		EXPECT_EQ(params.timestamp_us, encoded.timestamp_us);
+		EXPECT_EQ(static_cast<uint32_t>(i), encoded.frame_number);
+
+		// Annex B, with parameter sets leading each IDR
+		ASSERT_GT(encoded.data.size(), 5u);
+		EXPECT_EQ(1, encoded.data[3]);
+		EXPECT_EQ(encoded.keyframe ? 0x67 : 0x41, encoded.data[4]);
+	}
+
+	auto stats = mock.stats();
+	EXPECT_EQ(1, stats.sessions_open);
+	EXPECT_EQ(6u, stats.pictures);
+	EXPECT_EQ(3u, stats.keyframes);
+
+	encoder.Shutdown();
+	EXPECT_EQ(0, mock.stats().sessions_open);
+}
+
+TEST(VideoEncoderTests, NvencQueueDepthLimitsFramesInFlight)
+{
+	MockNvenc::Options options;
+	options.encode_latency_us = 20000;
+
+	MockNvenc mock(options);
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+
+	auto config = MakeConfig(64, 48);
+	config.queue_depth = 2;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	auto frame = MakeFrame(64, 48, 0);
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kBusy, encoder.Submit(frame, EncodeParams()));
+	EXPECT_EQ(2u, encoder.pending());
+
+	// the first picture isn't done for 20ms
+	EncodedFrame encoded;
+	EXPECT_EQ(EncoderStatus::kTimeout, encoder.Retrieve(&encoded, 0));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, -1));
+	EXPECT_EQ(0u, encoded.frame_number);
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, 1000));
+	EXPECT_EQ(1u, encoded.frame_number);
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, -1));
+	EXPECT_EQ(2u, encoded.frame_number);
+	EXPECT_EQ(EncoderStatus::kTimeout, encoder.Retrieve(&encoded, 5));
+}
+
+TEST(VideoEncoderTests, NvencAsyncWaitsOnCompletionEvents)
+{
+	MockNvenc::Options options;
+	options.encode_latency_us = 20000;
+
+	MockNvenc mock(options);
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA, true);
+
+	auto config = MakeConfig(64, 48);
+	config.queue_depth = 2;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+	EXPECT_TRUE(encoder.async());
+	EXPECT_EQ(2, mock.stats().async_events);
+
+	auto frame = MakeFrame(64, 48, 0);
+	for (int i = 0; i < 2; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Submit(frame, params));
+	}
+
+	// nothing is locked until its event is set
+	EncodedFrame encoded;
+	EXPECT_EQ(EncoderStatus::kTimeout, encoder.Retrieve(&encoded, 0));
+	EXPECT_EQ(EncoderStatus::kTimeout, encoder.Retrieve(&encoded, 5));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, -1));
+	EXPECT_EQ(0u, encoded.frame_number);
+	EXPECT_TRUE(encoded.keyframe);
+
+	// the slot's event is reset for the picture submitted to it next
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, 1000));
+	EXPECT_EQ(1u, encoded.frame_number);
+	EXPECT_EQ(EncoderStatus::kTimeout, encoder.Retrieve(&encoded, 0));
+	EXPECT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, 1000));
+	EXPECT_EQ(2u, encoded.frame_number);
+	EXPECT_EQ(0u, mock.stats().early_locks);
+
+	// a picture still encoding when the session goes doesn't set an event that's gone
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Submit(frame, EncodeParams()));
+	encoder.Shutdown();
+	EXPECT_EQ(0, mock.stats().async_events);
+	EXPECT_EQ(0, mock.stats().sessions_open);
+
+	// a session whose events can't all be registered isn't left open
+	mock.FailNext("nvEncRegisterAsyncEvent", NV_ENC_ERR_INVALID_PARAM);
+	EXPECT_EQ(EncoderStatus::kInvalidParam, encoder.Initialize(config));
+	EXPECT_EQ(0, mock.stats().async_events);
+	EXPECT_EQ(0, mock.stats().sessions_open);
+
+	// nor are synchronous sessions given events
+	NvencEncoder synchronous(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, synchronous.Initialize(config));
+	EXPECT_FALSE(synchronous.async());
+	EXPECT_EQ(0, mock.stats().async_events);
+}
+
+TEST(VideoEncoderTests, PipelineRetrievesAsyncPictures)
+{
+	const int kFrames = 30;
+
+	MockNvenc::Options options;
+	options.encode_latency_us = 2000;
+	options.engines = 2;
+
+	MockNvenc mock(options);
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA, true);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	std::vector<uint32_t> delivered;
+	EncodePipeline pipeline(&encoder, [&](const EncodedFrame& frame, int64_t)
+	{
+		delivered.push_back(frame.frame_number);
+	});
+
+	pipeline.Start();
+	auto frame = MakeFrame(64, 48, 0);
+	for (int i = 0; i < kFrames; i++)
+	{
+		ASSERT_TRUE(pipeline.Push(frame, EncodeParams(), -1));
+	}
+
+	pipeline.Flush();
+	ASSERT_EQ(static_cast<size_t>(kFrames), delivered.size());
+	for (int i = 0; i < kFrames; i++)
+	{
+		EXPECT_EQ(static_cast<uint32_t>(i), delivered[i]);
+	}
+
+	// the retrieval thread only locked bitstreams whose event it had seen set
+	EXPECT_EQ(0u, mock.stats().early_locks);
+	EXPECT_EQ(static_cast<uint64_t>(kFrames), mock.stats().pictures);
+}
+
+TEST(VideoEncoderTests, NvencFailuresMapToStatuses)
+{
+	MockNvenc::Options options;
+	options.max_sessions = 1;
+
+	MockNvenc mock(options);
+	NvencEncoder first(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	NvencEncoder second(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+
+	auto config = MakeConfig(64, 48);
+	ASSERT_EQ(EncoderStatus::kOk, first.Initialize(config));
+	EXPECT_EQ(EncoderStatus::kSessionLimit, second.Initialize(config));
+	EXPECT_EQ(NV_ENC_ERR_OUT_OF_MEMORY, second.last_status());
+
+	auto frame = MakeFrame(64, 48, 0);
+	mock.FailNext("nvEncEncodePicture", NV_ENC_ERR_GENERIC);
+	EXPECT_EQ(EncoderStatus::kDeviceError, first.Submit(frame, EncodeParams()));
+	EXPECT_EQ(0u, first.pending());
+	EXPECT_EQ(EncoderStatus::kOk, first.Submit(frame, EncodeParams()));
+
+	mock.FailNext("nvEncLockBitstream", NV_ENC_ERR_INVALID_PARAM);
+	EncodedFrame encoded;
+	EXPECT_EQ(EncoderStatus::kInvalidParam, first.Retrieve(&encoded, -1));
+	EXPECT_EQ(0u, first.pending());
+	EXPECT_EQ(EncoderStatus::kOk, first.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kOk, first.Retrieve(&encoded, -1));
+	EXPECT_EQ(1u, encoded.frame_number);
+
+	// a failed initialization leaves no session behind
+	first.Shutdown();
+	mock.FailNext("nvEncInitializeEncoder", NV_ENC_ERR_UNSUPPORTED_PARAM);
+	EXPECT_EQ(EncoderStatus::kUnsupported, second.Initialize(config));
+	EXPECT_EQ(0, mock.stats().sessions_open);
+	EXPECT_EQ(EncoderStatus::kNotInitialized, second.Submit(frame, EncodeParams()));
+	EXPECT_EQ(EncoderStatus::kOk, second.Initialize(config));
+}
+
+TEST(VideoEncoderTests, BackendsShareTheContract)
+{
+	for (auto name : { "openh264", "nvenc" })
+	{
+		SCOPED_TRACE(name);
+		Backend backend(name);
+		EXPECT_EQ(EncoderStatus::kNotInitialized, backend->Submit(MakeFrame(64, 48, 0), EncodeParams()));
+
+		auto config = MakeConfig(64, 48);
+		config.queue_depth = 3;
+		EXPECT_EQ(EncoderStatus::kInvalidParam, backend->Initialize(EncoderConfig()));
+		ASSERT_EQ(EncoderStatus::kOk, backend->Initialize(config));
+		EXPECT_EQ(EncoderStatus::kInvalidParam, backend->Submit(MakeFrame(32, 32, 0), EncodeParams()));
+
+		// frames come out in the order they went in, pipelined up to the queue depth
+		for (int i = 0; i < 3; i++)
+		{
+			EncodeParams params;
+			params.timestamp_us = i * 100;
+			params.force_idr = i == 2;
+			ASSERT_EQ(EncoderStatus::kOk, backend->Submit(MakeFrame(64, 48, i), params));
+		}
+
+		EXPECT_EQ(EncoderStatus::kBusy, backend->Submit(MakeFrame(64, 48, 3), EncodeParams()));
+		EXPECT_EQ(3u, backend->pending());
+		for (int i = 0; i < 3; i++)
+		{
+			EncodedFrame encoded;
+			ASSERT_EQ(EncoderStatus::kOk, backend->Retrieve(&encoded, 1000));
+			EXPECT_EQ(static_cast<uint32_t>(i), encoded.frame_number);
+			EXPECT_EQ(i * 100, encoded.timestamp_us);
+			EXPECT_EQ(i != 1, encoded.keyframe);
+			EXPECT_EQ(64, encoded.width);
+			EXPECT_FALSE(encoded.data.empty());
+		}
+
+		EncodedFrame encoded;
+		EXPECT_EQ(EncoderStatus::kTimeout, backend->Retrieve(&encoded, 0));
+		backend->Shutdown();
+	}
+}
+
+TEST(VideoEncoderTests, FactoryFallsBackToSoftware)
+{
+	EncoderBackendType type;
+	ASSERT_TRUE(ParseEncoderBackendType("software", &type));
+	EXPECT_EQ(EncoderBackendType::kSoftware, type);
+	EXPECT_FALSE(ParseEncoderBackendType("x264", &type));
+
+	// without a device there's nothing to open an NVENC session on
+	auto encoder = CreateEncoderBackend(EncoderBackendType::kAuto);
+	ASSERT_NE(nullptr, encoder);
+	EXPECT_STREQ("openh264", encoder->name());
+	EXPECT_EQ(nullptr, CreateEncoderBackend(EncoderBackendType::kNvenc));
+}
+
+TEST(VideoEncoderTests, PipelineDeliversInOrder)
+{
+	OpenH264Encoder encoder(OpenH264());
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	std::vector<EncodedFrame> delivered;
+	EncodePipeline pipeline(&encoder, [&](const EncodedFrame& frame, int64_t latency_us)
+	{
+		EXPECT_GE(latency_us, 0);
+		delivered.push_back(frame);
+	});
+
+	pipeline.Start();
+	const int kFrames = 20;
+	for (int i = 0; i < kFrames; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 10;
+		ASSERT_TRUE(pipeline.Push(MakeFrame(64, 48, i), params, -1));
+	}
+
+	pipeline.Flush();
+	ASSERT_EQ(static_cast<size_t>(kFrames), delivered.size());
+	for (int i = 0; i < kFrames; i++)
+	{
+		EXPECT_EQ(static_cast<uint32_t>(i), delivered[i].frame_number);
+		EXPECT_EQ(i * 10, delivered[i].timestamp_us);
+	}
+
+	auto stats = pipeline.stats();
+	EXPECT_EQ(static_cast<uint64_t>(kFrames), stats.pushed);
+	EXPECT_EQ(static_cast<uint64_t>(kFrames), stats.delivered);
+	EXPECT_EQ(0u, stats.failed);
+	EXPECT_LE(stats.peak_input, 2u);
+	EXPECT_LE(stats.peak_in_flight, static_cast<size_t>(encoder.config().queue_depth));
+	pipeline.Stop();
+	EXPECT_EQ(0u, encoder.pending());
+}
+
+TEST(VideoEncoderTests, PipelineSkipsFailedFrames)
+{
+	MockNvenc mock;
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	std::vector<int64_t> timestamps;
+	EncodePipeline pipeline(&encoder, [&](const EncodedFrame& frame, int64_t)
+	{
+		timestamps.push_back(frame.timestamp_us);
+	});
+
+	mock.FailNext("nvEncEncodePicture", NV_ENC_ERR_GENERIC);
+	pipeline.Start();
+	for (int i = 0; i < 4; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i;
+		ASSERT_TRUE(pipeline.Push(MakeFrame(64, 48, i), params, -1));
+	}
+
+	pipeline.Flush();
+	EXPECT_EQ(std::vector<int64_t>({ 1, 2, 3 }), timestamps);
+	EXPECT_EQ(1u, pipeline.stats().failed);
+	EXPECT_EQ(EncoderStatus::kDeviceError, pipeline.last_error());
+
+	// a full input queue drops frames rather than stalling the caller
+	mock.FailNext("nvEncLockBitstream", NV_ENC_ERR_GENERIC);
+	MockNvenc::Options slow;
+	slow.encode_latency_us = 50000;
+	mock.set_options(slow);
+
+	auto dropped = 0;
+	for (int i = 0; i < 12; i++)
+	{
+		dropped += pipeline.Push(MakeFrame(64, 48, i), EncodeParams(), 0) ? 0 : 1;
+	}
+
+	EXPECT_GT(dropped, 0);
+	EXPECT_EQ(static_cast<uint64_t>(dropped), pipeline.stats().dropped);
+	pipeline.Stop();
+	EXPECT_EQ(0u, encoder.pending());
+}
+
+TEST(VideoEncoderTests, PipelineOverlapsRenderAndEncode)
+{
+	// each frame takes as long to render as it does to encode
+	const int kFrames = 30;
+	const auto kRender = std::chrono::microseconds(4000);
+
+	MockNvenc::Options options;
+	options.encode_latency_us = 4000;
+
+	MockNvenc lockstep_mock(options);
+	NvencEncoder lockstep(lockstep_mock.functions(), lockstep_mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, lockstep.Initialize(MakeConfig(64, 48)));
+
+	auto frame = MakeFrame(64, 48, 0);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kFrames; i++)
+	{
+		std::this_thread::sleep_for(kRender);
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, lockstep.Encode(frame, EncodeParams(), &encoded));
+	}
+
+	auto lockstep_us = ElapsedUs(start);
+
+	MockNvenc pipelined_mock(options);
+	NvencEncoder pipelined(pipelined_mock.functions(), pipelined_mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, pipelined.Initialize(MakeConfig(64, 48)));
+
+	EncodePipeline pipeline(&pipelined, [](const EncodedFrame&, int64_t) {});
+	pipeline.Start();
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kFrames; i++)
+	{
+		std::this_thread::sleep_for(kRender);
+		ASSERT_TRUE(pipeline.Push(frame, EncodeParams(), -1));
+	}
+
+	pipeline.Flush();
+	auto pipelined_us = ElapsedUs(start);
+
+	std::cout << "[ ENCODE PIPELINE ] lockstep " << lockstep_us / 1000 << "ms, pipelined " << pipelined_us / 1000
+		<< "ms for " << kFrames << " frames" << std::endl;
+	EXPECT_LT(pipelined_us, lockstep_us * 0.8);
+}
+
+TEST(VideoEncoderTests, PipelineQueueDepthSweep)
+{
+	// two engines, as on most GeForce cards, and frames pushed as fast as they're taken
+	const int kFrames = 40;
+	MockNvenc::Options options;
+	options.encode_latency_us = 5000;
+	options.engines = 2;
+
+	std::cout << "[ ENCODE PIPELINE ] queue depth, frames/s, added latency mean / max (ms)" << std::endl;
+	std::vector<double> throughput;
+	for (int depth = 1; depth <= 4; depth++)
+	{
+		MockNvenc mock(options);
+		NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+		auto config = MakeConfig(64, 48);
+		config.queue_depth = depth;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+		EncodePipeline pipeline(&encoder, [](const EncodedFrame&, int64_t) {});
+		auto frame = MakeFrame(64, 48, 0);
+		pipeline.Start();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < kFrames; i++)
+		{
+			ASSERT_TRUE(pipeline.Push(frame, EncodeParams(), -1));
+		}
+
+		pipeline.Flush();
+		auto elapsed_us = ElapsedUs(start);
+		auto stats = pipeline.stats();
+		throughput.push_back(kFrames * 1e6 / elapsed_us);
+
+		std::cout << "[ ENCODE PIPELINE ] " << depth << ", " << static_cast<int>(throughput.back()) << ", "
+			<< stats.mean_latency_us() / 1000 << " / " << stats.max_latency_us / 1000.0 << std::endl;
+		EXPECT_EQ(static_cast<uint64_t>(kFrames), stats.delivered);
+		EXPECT_LE(stats.peak_in_flight, static_cast<size_t>(depth));
+	}
+
+	// a second frame in flight keeps the second engine busy
+	EXPECT_GT(throughput[1], throughput[0] * 1.5);
+}
+
+TEST(VideoEncoderTests, ReconfigureBitrateKeepsTheStream)
+{
+	for (auto name : { "openh264", "nvenc" })
+	{
+		SCOPED_TRACE(name);
+		Backend backend(name);
+		auto config = MakeConfig(160, 120);
+		config.bitrate_bps = 300000;
+		config.fps = 30;
+		ASSERT_EQ(EncoderStatus::kOk, backend->Initialize(config));
+
+		// two seconds at each bitrate, the second of each measured once the rate has settled
+		const int kTargets[2] = { 300000, 150000 };
+		size_t bytes[2] = { 0, 0 };
+		for (int i = 0; i < 4 * config.fps; i++)
+		{
+			if (i == 2 * config.fps)
+			{
+				config.bitrate_bps = kTargets[1];
+				ASSERT_EQ(EncoderStatus::kOk, backend->Reconfigure(config));
+			}
+
+			EncodedFrame encoded;
+			ASSERT_EQ(EncoderStatus::kOk, backend->Encode(MakeFrame(160, 120, i, true), EncodeParams(), &encoded));
+			EXPECT_EQ(i == 0, encoded.keyframe);
+			if ((i / config.fps) % 2 == 1)
+			{
+				bytes[i / (2 * config.fps)] += encoded.data.size();
+			}
+		}
+
+		EXPECT_EQ(kTargets[1], backend->config().bitrate_bps);
+		for (int i = 0; i < 2; i++)
+		{
+			EXPECT_NEAR(kTargets[i], bytes[i] * 8.0, kTargets[i] * 0.2);
+		}
+	}
+}
+
+TEST(VideoEncoderTests, ReconfigureResolutionForcesOneIdr)
+{
+	for (auto name : { "openh264", "nvenc" })
+	{
+		SCOPED_TRACE(name);
+		Backend backend(name);
+		auto config = MakeConfig(64, 48);
+		config.max_width = 128;
+		config.max_height = 96;
+		ASSERT_EQ(EncoderStatus::kOk, backend->Initialize(config));
+
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, backend->Encode(MakeFrame(64, 48, 0), EncodeParams(), &encoded));
+		ASSERT_EQ(EncoderStatus::kOk, backend->Encode(MakeFrame(64, 48, 1), EncodeParams(), &encoded));
+		EXPECT_FALSE(encoded.keyframe);
+
+		config.width = 128;
+		config.height = 96;
+		ASSERT_EQ(EncoderStatus::kOk, backend->Reconfigure(config));
+		EXPECT_EQ(EncoderStatus::kInvalidParam, backend->Submit(MakeFrame(64, 48, 2), EncodeParams()));
+		for (int i = 2; i < 5; i++)
+		{
+			ASSERT_EQ(EncoderStatus::kOk, backend->Encode(MakeFrame(128, 96, i), EncodeParams(), &encoded));
+			EXPECT_EQ(i == 2, encoded.keyframe);
+			EXPECT_EQ(128, encoded.width);
+			EXPECT_EQ(96, encoded.height);
+		}
+
+		// the maximum can only be raised by initializing again
+		config.width = 160;
+		config.height = 120;
+		EXPECT_EQ(EncoderStatus::kUnsupported, backend->Reconfigure(config));
+		config.width = 128;
+		config.height = 96;
+		config.queue_depth = 2;
+		EXPECT_EQ(EncoderStatus::kUnsupported, backend->Reconfigure(config));
+		EXPECT_EQ(128, backend->config().width);
+	}
+}
+
+TEST(VideoEncoderTests, EncoderControlReinitializesOnlyWhenItMust)
+{
+	MockNvenc mock;
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	auto config = MakeConfig(64, 48);
+	config.max_width = 96;
+	config.max_height = 72;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	EncoderControl control;
+	EXPECT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	EXPECT_EQ(0u, control.stats().applied);
+
+	control.SetBitrate(1000000);
+	control.SetFramerate(30);
+	EXPECT_TRUE(control.pending());
+	EXPECT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	EXPECT_FALSE(control.pending());
+	EXPECT_EQ(1000000, encoder.config().bitrate_bps);
+	EXPECT_EQ(30, encoder.config().fps);
+	EXPECT_EQ(1u, mock.stats().reconfigures);
+
+	// frames of a new size resize the session, within the maximum in place
+	EXPECT_EQ(EncoderStatus::kOk, control.Apply(&encoder, 96, 72));
+	EXPECT_EQ(96, encoder.config().width);
+	EXPECT_EQ(2u, mock.stats().reconfigures);
+	EXPECT_EQ(0u, control.stats().reinitialized);
+
+	// and beyond it by starting again, but not while frames are in flight
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Submit(MakeFrame(96, 72, 0), EncodeParams()));
+	control.SetResolution(128, 96);
+	EXPECT_EQ(EncoderStatus::kBusy, control.Apply(&encoder));
+	EXPECT_TRUE(control.pending());
+
+	EncodedFrame encoded;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Retrieve(&encoded, -1));
+	EXPECT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	EXPECT_EQ(128, encoder.config().width);
+	EXPECT_EQ(1000000, encoder.config().bitrate_bps);
+	EXPECT_EQ(1, mock.stats().sessions_open);
+
+	int width, height;
+	ASSERT_TRUE(control.resolution(&width, &height));
+	EXPECT_EQ(128, width);
+
+	auto stats = control.stats();
+	EXPECT_EQ(3u, stats.applied);
+	EXPECT_EQ(1u, stats.reinitialized);
+	EXPECT_EQ(0u, stats.failed);
+}
+
+TEST(VideoEncoderTests, EncoderControlPacesFrames)
+{
+	EncoderControl control;
+	int admitted = 0;
+	for (int i = 0; i < 60; i++)
+	{
+		admitted += control.AdmitFrame(i * 16667) ? 1 : 0;
+	}
+
+	EXPECT_EQ(60, admitted);
+
+	// a second of 60fps content at 45fps, and again after a pause
+	control.SetFramerate(45);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		admitted = 0;
+		auto start_us = 1000000 + pass * 5000000;
+		for (int i = 0; i < 60; i++)
+		{
+			admitted += control.AdmitFrame(start_us + i * 16667) ? 1 : 0;
+		}
+
+		EXPECT_NEAR(45, admitted, 1);
+	}
+}
+
+TEST(VideoEncoderTests, EncoderControlParsesTargets)
+{
+	EncoderControl::Targets targets;
+	ASSERT_TRUE(EncoderControl::ParseTargets("2500000,45,1280,720", 19, &targets));
+	EXPECT_EQ(2500000, targets.bitrate_bps);
+	EXPECT_EQ(45, targets.fps);
+	EXPECT_EQ(1280, targets.width);
+	EXPECT_EQ(720, targets.height);
+
+	// trailing targets left out, or 0, are left as they are
+	ASSERT_TRUE(EncoderControl::ParseTargets("0,30", 4, &targets));
+	EXPECT_EQ(0, targets.bitrate_bps);
+	EXPECT_EQ(30, targets.fps);
+	EXPECT_EQ(0, targets.width);
+	EXPECT_EQ(0, targets.height);
+
+	EXPECT_FALSE(EncoderControl::ParseTargets("", 0, &targets));
+	EXPECT_FALSE(EncoderControl::ParseTargets("1,,3", 4, &targets));
+	EXPECT_FALSE(EncoderControl::ParseTargets("1,2,3,4,5", 9, &targets));
+	EXPECT_FALSE(EncoderControl::ParseTargets("-1", 2, &targets));
+	EXPECT_FALSE(EncoderControl::ParseTargets("1,2,640", 7, &targets));
+	EXPECT_FALSE(EncoderControl::ParseTargets("9999999999", 10, &targets));
+}
+
+TEST(VideoEncoderTests, PipelineAppliesControlBetweenFrames)
+{
+	MockNvenc::Options options;
+	options.encode_latency_us = 2000;
+
+	MockNvenc mock(options);
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	std::vector<EncodedFrame> delivered;
+	EncoderControl control;
+	EncodePipeline::Options pipeline_options;
+	pipeline_options.control = &control;
+	EncodePipeline pipeline(&encoder, [&](const EncodedFrame& frame, int64_t)
+	{
+		delivered.push_back(frame);
+	}, pipeline_options);
+
+	// the renderer changes size mid-stream, past what the session was opened for
+	pipeline.Start();
+	for (int i = 0; i < 12; i++)
+	{
+		if (i == 4)
+		{
+			control.SetBitrate(1000000);
+		}
+
+		auto size = i < 8 ? 1 : 2;
+		ASSERT_TRUE(pipeline.Push(MakeFrame(64 * size, 48 * size, i), EncodeParams(), -1));
+	}
+
+	pipeline.Flush();
+	pipeline.Stop();
+
+	EXPECT_EQ(EncoderStatus::kOk, pipeline.last_error());
+	ASSERT_EQ(12u, delivered.size());
+	for (int i = 0; i < 12; i++)
+	{
+		EXPECT_EQ(i == 0 || i == 8, delivered[i].keyframe);
+		EXPECT_EQ(i < 8 ? 64 : 128, delivered[i].width);
+	}
+
+	EXPECT_EQ(1000000, encoder.config().bitrate_bps);
+	EXPECT_EQ(1u, control.stats().reinitialized);
+}
+
+TEST(VideoEncoderTests, LossRecoveryRestoresAPeerWithoutAnIdr)
+{
+	auto config = MakeConfig(160, 120);
+	config.fps = 30;
+
+	OpenH264Encoder encoder(OpenH264());
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	// frame 40 is dropped in transit, well past the IDR, and the peer's report reaches us three
+	// frames after it fails to decode the next
+	const int kLost = 40;
+	const int kReportDelay = 3;
+	OpenH264Decoder decoder(OpenH264());
+	LossRecovery recovery;
+	int64_t last_good_us = -1;
+	int report_at = -1;
+	int undecodable = 0;
+	for (int i = 0; i < 60; i++)
+	{
+		if (i == report_at)
+		{
+			recovery.OnLastGoodFrame(last_good_us);
+		}
+
+		auto frame = MakeFrame(160, 120, i);
+		EncodeParams params;
+		params.timestamp_us = i * 33333;
+		recovery.Apply(&encoder, &params);
+
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(frame, params, &encoded));
+		recovery.OnSubmitted(params);
+		recovery.OnEncoded(encoded);
+		EXPECT_EQ(i == 0, encoded.keyframe);
+		if (i == kLost)
+		{
+			continue;
+		}
+
+		I420Frame decoded;
+		if (!decoder.Decode(encoded.data.data(), encoded.data.size(), &decoded))
+		{
+			undecodable++;
+			report_at = report_at < 0 ? i + kReportDelay : report_at;
+			continue;
+		}
+
+		last_good_us = encoded.timestamp_us;
+		EXPECT_GT(LumaPsnr(frame, decoded), 30);
+	}
+
+	// only the frames after the loss up to the recovery, which is a P frame predicted from a
+	// long-term reference the peer has
+	EXPECT_EQ(kReportDelay, undecodable);
+	EXPECT_EQ(59 * 33333, last_good_us);
+
+	auto stats = recovery.stats();
+	EXPECT_EQ(1u, stats.reports);
+	EXPECT_EQ(1u, stats.recovered);
+	EXPECT_EQ(static_cast<uint64_t>(kReportDelay + 1), stats.invalidated);
+	EXPECT_EQ(0u, stats.keyframes);
+}
+
+TEST(VideoEncoderTests, LossRecoveryFallsBackToKeyframes)
+{
+	MockNvenc mock;
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	LossRecovery::Options options;
+	options.grace_frames = 5;
+	LossRecovery recovery(options);
+
+	// encodes the next frame, its timestamp 1000 times its number, returning whether it's an IDR
+	int frame_number = 0;
+	auto encode = [&]()
+	{
+		EncodeParams params;
+		params.timestamp_us = 1000 * frame_number;
+		recovery.Apply(&encoder, &params);
+
+		EncodedFrame encoded;
+		EXPECT_EQ(EncoderStatus::kOk, encoder.Encode(MakeFrame(64, 48, frame_number++), params, &encoded));
+		recovery.OnSubmitted(params);
+		recovery.OnEncoded(encoded);
+		return encoded.keyframe;
+	};
+
+	for (int i = 0; i < 20; i++)
+	{
+		encode();
+	}
+
+	// a loss a few frames back is recovered from in place
+	recovery.OnFrameLost(17000);
+	EXPECT_FALSE(encode());
+	EXPECT_EQ((std::vector<uint64_t>{ 17000, 18000, 19000 }), mock.invalidated());
+
+	// a report the recovery covers is taken to have crossed it, until the grace runs out
+	recovery.OnLastGoodFrame(16000);
+	EXPECT_FALSE(encode());
+	EXPECT_EQ(3u, mock.invalidated().size());
+	for (int i = 0; i < 4; i++)
+	{
+		encode();
+	}
+
+	recovery.OnLastGoodFrame(16000);
+	EXPECT_FALSE(encode());
+	EXPECT_EQ(9u, mock.invalidated().size());
+	EXPECT_EQ(20000u, mock.invalidated()[3]);
+
+	// a frame the DPB no longer holds takes an IDR, which later reports of older frames cross
+	for (int i = 0; i < 20; i++)
+	{
+		encode();
+	}
+
+	recovery.OnLastGoodFrame(26000);
+	EXPECT_TRUE(encode());
+	recovery.OnLastGoodFrame(46000);
+	EXPECT_FALSE(encode());
+
+	recovery.RequestKeyframe();
+	EXPECT_TRUE(encode());
+	recovery.OnLastGoodFrame(-1);
+	EXPECT_TRUE(encode());
+	EXPECT_EQ(9u, mock.invalidated().size());
+
+	auto stats = recovery.stats();
+	EXPECT_EQ(7u, stats.reports);
+	EXPECT_EQ(2u, stats.recovered);
+	EXPECT_EQ(9u, stats.invalidated);
+	EXPECT_EQ(3u, stats.keyframes);
+	EXPECT_EQ(2u, stats.ignored);
+	EXPECT_EQ(4u, mock.stats().keyframes);
+
+	int64_t last_good_us;
+	ASSERT_TRUE(LossRecovery::ParseReport("123456", 6, &last_good_us));
+	EXPECT_EQ(123456, last_good_us);
+	ASSERT_TRUE(LossRecovery::ParseReport("-1", 2, &last_good_us));
+	EXPECT_EQ(-1, last_good_us);
+	EXPECT_FALSE(LossRecovery::ParseReport("12a", 3, &last_good_us));
+	EXPECT_FALSE(LossRecovery::ParseReport("-", 1, &last_good_us));
+}
+
+TEST(VideoEncoderTests, PipelineRecoversFromLoss)
+{
+	MockNvenc mock;
+	NvencEncoder encoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(MakeConfig(64, 48)));
+
+	LossRecovery recovery;
+	EncodePipeline::Options options;
+	options.recovery = &recovery;
+	std::vector<EncodedFrame> delivered;
+	EncodePipeline pipeline(&encoder, [&](const EncodedFrame& frame, int64_t)
+	{
+		delivered.push_back(frame);
+	}, options);
+
+	pipeline.Start();
+	auto push = [&](int i)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 1000;
+		ASSERT_TRUE(pipeline.Push(MakeFrame(64, 48, i), params, -1));
+	};
+
+	for (int i = 0; i < 10; i++)
+	{
+		push(i);
+	}
+
+	pipeline.Flush();
+	recovery.OnLastGoodFrame(7000);
+	push(10);
+	pipeline.Flush();
+	pipeline.Stop();
+
+	ASSERT_EQ(11u, delivered.size());
+	EXPECT_FALSE(delivered.back().keyframe);
+	EXPECT_EQ((std::vector<uint64_t>{ 8000, 9000 }), mock.invalidated());
+	EXPECT_EQ(1u, recovery.stats().recovered);
+}
+
+TEST(VideoEncoderTests, SessionPoolFallsBackAtTheSessionLimit)
+{
+	// a consumer card, allowing two sessions
+	MockNvenc::Options options;
+	options.max_sessions = 2;
+	MockNvenc mock(options);
+
+	int hardware_attempts = 0;
+	EncoderSessionPool pool([&]()
+	{
+		hardware_attempts++;
+		return std::unique_ptr<EncoderBackend>(new NvencEncoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA));
+	}, []()
+	{
+		return std::unique_ptr<EncoderBackend>(new OpenH264Encoder(OpenH264()));
+	});
+
+	auto config = MakeConfig(64, 48);
+	std::vector<EncoderSessionPool::Lease> leases;
+	for (int peer = 0; peer < 4; peer++)
+	{
+		leases.push_back(pool.Acquire(peer, config));
+		ASSERT_EQ(EncoderStatus::kOk, leases.back().status);
+		ASSERT_NE(nullptr, leases.back().encoder);
+		EXPECT_EQ(peer < 2, leases.back().hardware);
+		EXPECT_STREQ(peer < 2 ? "nvenc" : "openh264", leases.back().encoder->name());
+
+		EncodedFrame encoded;
+		EXPECT_EQ(EncoderStatus::kOk, leases.back().encoder->Encode(MakeFrame(64, 48, 0), EncodeParams(), &encoded));
+	}
+
+	// the third peer found the limit, so the fourth didn't try
+	EXPECT_EQ(3, hardware_attempts);
+	auto utilization = pool.utilization();
+	std::cout << "[ SESSION POOL ] hardware " << utilization.hardware_sessions << "/" << utilization.hardware_limit
+		<< ", software " << utilization.software_sessions << ", fallbacks " << utilization.fallbacks << std::endl;
+	EXPECT_EQ(2, utilization.hardware_sessions);
+	EXPECT_EQ(2, utilization.hardware_limit);
+	EXPECT_EQ(2, utilization.software_sessions);
+	EXPECT_EQ(2u, utilization.fallbacks);
+	EXPECT_EQ(1u, utilization.limit_reached);
+	EXPECT_DOUBLE_EQ(1.0, utilization.hardware_utilization());
+
+	// a freed session goes to a peer on software that asks again
+	EXPECT_FALSE(pool.CanUpgrade(2));
+	pool.Release(0);
+	EXPECT_EQ(1, mock.stats().sessions_open);
+	EXPECT_TRUE(pool.CanUpgrade(2));
+	EXPECT_FALSE(pool.CanUpgrade(1));
+
+	auto upgraded = pool.Acquire(2, config);
+	EXPECT_TRUE(upgraded.hardware);
+	EXPECT_EQ(2, mock.stats().sessions_open);
+	EXPECT_FALSE(pool.CanUpgrade(3));
+
+	utilization = pool.utilization();
+	EXPECT_EQ(2, utilization.hardware_sessions);
+	EXPECT_EQ(1, utilization.software_sessions);
+	EXPECT_EQ(3, utilization.peers);
+}
+
+TEST(VideoEncoderTests, SessionPoolSharesSessionsByKey)
+{
+	MockNvenc mock;
+	EncoderSessionPool::Options options;
+	options.max_hardware_sessions = 1;
+	EncoderSessionPool pool([&]()
+	{
+		return std::unique_ptr<EncoderBackend>(new NvencEncoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA));
+	}, []()
+	{
+		return std::unique_ptr<EncoderBackend>(new OpenH264Encoder(OpenH264()));
+	}, options);
+
+	// spectators of one stream share its session, past the limit
+	auto first = pool.Acquire(1, MakeConfig(64, 48), "lobby");
+	auto second = pool.Acquire(2, MakeConfig(128, 96), "lobby");
+	auto third = pool.Acquire(3, MakeConfig(64, 48), "arena");
+	EXPECT_TRUE(first.hardware);
+	EXPECT_FALSE(first.shared);
+	EXPECT_TRUE(second.hardware);
+	EXPECT_TRUE(second.shared);
+	EXPECT_EQ(first.encoder, second.encoder);
+	EXPECT_EQ(64, second.encoder->config().width);
+	EXPECT_FALSE(third.hardware);
+
+	auto utilization = pool.utilization();
+	EXPECT_EQ(1, utilization.hardware_sessions);
+	EXPECT_EQ(1, utilization.hardware_limit);
+	EXPECT_EQ(3, utilization.peers);
+	EXPECT_EQ(1, utilization.shared_peers);
+	EXPECT_EQ(0u, utilization.limit_reached);
+
+	// the session outlives all but the last of its peers
+	pool.Release(1);
+	EXPECT_EQ(1, mock.stats().sessions_open);
+	pool.Release(2);
+	EXPECT_EQ(0, mock.stats().sessions_open);
+	EXPECT_EQ(0, pool.utilization().shared_peers);
+}
+
+TEST(VideoEncoderTests, SessionPoolAccountsForEncodersElsewhere)
+{
+	// webrtc creates its own encoders, so the pool only decides which kind each peer gets
+	EncoderSessionPool::Options options;
+	options.max_hardware_sessions = 1;
+	EncoderSessionPool pool(nullptr, nullptr, options);
+	auto first = pool.Acquire(1, EncoderConfig());
+	auto second = pool.Acquire(2, EncoderConfig());
+	EXPECT_TRUE(first.hardware);
+	EXPECT_EQ(nullptr, first.encoder);
+	EXPECT_FALSE(second.hardware);
+	EXPECT_EQ(EncoderStatus::kOk, second.status);
+	EXPECT_EQ(1u, pool.utilization().fallbacks);
+
+	// or refuses those it can't give hardware
+	options.software_fallback = false;
+	EncoderSessionPool strict(nullptr, nullptr, options);
+	EXPECT_TRUE(strict.Acquire(1, EncoderConfig()).hardware);
+	EXPECT_EQ(EncoderStatus::kSessionLimit, strict.Acquire(2, EncoderConfig()).status);
+	EXPECT_EQ(1, strict.utilization().peers);
+	EXPECT_EQ(1u, strict.utilization().refused);
+
+	// without a configured limit, it's learned from the sessions the device refuses
+	EncoderSessionPool learning(nullptr, nullptr);
+	EXPECT_TRUE(learning.Acquire(1, EncoderConfig()).hardware);
+	EXPECT_TRUE(learning.Acquire(2, EncoderConfig()).hardware);
+	EXPECT_TRUE(learning.Acquire(3, EncoderConfig()).hardware);
+	learning.Downgrade(3);
+	EXPECT_FALSE(learning.Acquire(4, EncoderConfig()).hardware);
+
+	auto utilization = learning.utilization();
+	EXPECT_EQ(2, utilization.hardware_sessions);
+	EXPECT_EQ(2, utilization.software_sessions);
+	EXPECT_EQ(2, utilization.hardware_limit);
+	EXPECT_EQ(1u, utilization.limit_reached);
+	EXPECT_EQ(2u, utilization.fallbacks);
+
+	// and a session that closes makes room again
+	learning.Release(1);
+	EXPECT_TRUE(learning.CanUpgrade(4));
+}
+
+TEST(VideoEncoderTests, QualityMetricsMatchKnownValues)
+{
+	I420Frame reference(64, 48);
+	memset(reference.data(0), 100, reference.PlaneWidth(0) * reference.PlaneHeight(0));
+	memset(reference.data(1), 128, reference.PlaneWidth(1) * reference.PlaneHeight(1) * 2);
+
+	auto same = MeasureQuality(reference, reference);
+	EXPECT_EQ(kMaxPsnr, same.psnr);
+	EXPECT_DOUBLE_EQ(1, same.ssim);
+
+	// a flat offset of 5 in luma has an MSE of 25 there, and only SSIM's luminance term is off
+	auto brighter = reference;
+	memset(brighter.data(0), 105, brighter.PlaneWidth(0) * brighter.PlaneHeight(0));
+	auto scores = MeasureQuality(reference, brighter);
+	EXPECT_NEAR(10 * log10(255.0 * 255.0 / 25), scores.psnr_y, 1e-9);
+	EXPECT_EQ(kMaxPsnr, scores.psnr_u);
+	EXPECT_NEAR(10 * log10(255.0 * 255.0 * 1.5 / 25), scores.psnr, 1e-9);
+
+	auto luminance = (2 * 100.0 * 105 + 6.5025) / (100.0 * 100 + 105.0 * 105 + 6.5025);
+	EXPECT_NEAR(luminance, scores.ssim_y, 1e-12);
+	EXPECT_NEAR((4 * luminance + 2) / 6, scores.ssim, 1e-12);
+
+	// unrelated noise has next to no structure in common
+	SyntheticFrameSource first(64, 48, 1, SyntheticPattern::kNoise, 60, 1);
+	SyntheticFrameSource second(64, 48, 1, SyntheticPattern::kNoise, 60, 2);
+	I420Frame a;
+	I420Frame b;
+	ASSERT_TRUE(first.Read(&a));
+	ASSERT_TRUE(second.Read(&b));
+	EXPECT_LT(fabs(PlaneSsim(a.data(0), 64, b.data(0), 64, 64, 48)), 0.1);
+	EXPECT_LT(MeasureQuality(a, b).psnr_y, 10);
+}
+
+TEST(VideoEncoderTests, FrameSourcesAreDeterministic)
+{
+	SyntheticFrameSource source(64, 48, 3, SyntheticPattern::kScrolling);
+	SyntheticFrameSource again(64, 48, 3, SyntheticPattern::kScrolling);
+	std::vector<I420Frame> frames;
+	I420Frame frame;
+	I420Frame other;
+	while (source.Read(&frame))
+	{
+		ASSERT_TRUE(again.Read(&other));
+		EXPECT_EQ(0, memcmp(frame.data(0), other.data(0), frame.size()));
+		frames.push_back(frame);
+	}
+
+	ASSERT_EQ(3u, frames.size());
+	EXPECT_NE(0, memcmp(frames[0].data(0), frames[1].data(0), frames[0].size()));
+	source.Rewind();
+	ASSERT_TRUE(source.Read(&frame));
+	EXPECT_EQ(0, memcmp(frames[0].data(0), frame.data(0), frame.size()));
+
+	// the same frames recorded to YUV4MPEG2 read back as they were
+	std::string y4m = "YUV4MPEG2 W64 H48 F30000:1001 It A1:1 C420jpeg XYSCSS=420JPEG\n";
+	for (const auto& recorded : frames)
+	{
+		y4m += "FRAME\n";
+		y4m.append(reinterpret_cast<const char*>(recorded.data(0)), recorded.size());
+	}
+
+	std::istringstream in(y4m);
+	Y4mFrameSource recording;
+	ASSERT_TRUE(recording.Open(&in));
+	EXPECT_EQ(64, recording.width());
+	EXPECT_EQ(48, recording.height());
+	EXPECT_EQ(30, recording.fps());
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (const auto& recorded : frames)
+		{
+			ASSERT_TRUE(recording.Read(&frame));
+			EXPECT_EQ(0, memcmp(recorded.data(0), frame.data(0), frame.size()));
+		}
+
+		EXPECT_FALSE(recording.Read(&frame));
+		recording.Rewind();
+	}
+
+	std::istringstream chroma444("YUV4MPEG2 W64 H48 F30:1 C444\n");
+	std::istringstream deep("YUV4MPEG2 W64 H48 F30:1 C420p10\n");
+	std::istringstream garbage("RIFF....WAVE");
+	EXPECT_FALSE(recording.Open(&chroma444));
+	EXPECT_FALSE(recording.Open(&deep));
+	EXPECT_FALSE(recording.Open(&garbage));
+	EXPECT_FALSE(recording.Read(&frame));
+}
+
+TEST(VideoEncoderTests, SweepMeasuresEachConfig)
+{
+	SyntheticFrameSource source(160, 120, 30, SyntheticPattern::kScrolling, 30);
+	EncoderSweep::Options options;
+	options.bitrates_bps = { 100000, 300000 };
+	options.gop_lengths = { 0, 10 };
+	options.frames = 20;
+	EncoderSweep sweep(&source, []() { return std::unique_ptr<EncoderBackend>(new OpenH264Encoder(OpenH264())); }, options);
+
+	std::ostringstream csv;
+	auto results = sweep.RunAll(&csv);
+	ASSERT_EQ(4u, results.size());
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& result = results[i];
+		std::cout << "[ SWEEP ] gop " << result.config.gop_length << " at " << result.config.bitrate_bps / 1000 <<
+			" kbps: " << result.bitrate_bps / 1000 << " kbps, " << result.quality.psnr_y << " dB, ssim " <<
+			result.quality.ssim << ", " << result.encode_ms << " ms" << std::endl;
+
+		EXPECT_EQ(EncoderStatus::kOk, result.status);
+		EXPECT_EQ("openh264", result.backend);
+		EXPECT_EQ(160, result.config.width);
+		EXPECT_EQ(30, result.config.fps);
+		EXPECT_EQ(i < 2 ? 0 : 10, result.config.gop_length);
+		EXPECT_EQ(i % 2 == 0 ? 100000 : 300000, result.config.bitrate_bps);
+		EXPECT_EQ(20, result.frames);
+		EXPECT_EQ(i < 2 ? 1 : 2, result.keyframes);
+		EXPECT_TRUE(result.measured);
+		EXPECT_EQ(-1, result.average_qp);
+		EXPECT_LE(result.min_psnr_y, result.quality.psnr_y);
+	}
+
+	// more bits buy quality
+	EXPECT_GT(results[1].quality.psnr_y, results[0].quality.psnr_y);
+	EXPECT_GT(results[3].quality.psnr_y, results[2].quality.psnr_y);
+	EXPECT_GT(results[1].bitrate_bps, results[0].bitrate_bps);
+
+	std::string line;
+	std::istringstream rows(csv.str());
+	std::vector<std::string> lines;
+	while (std::getline(rows, line))
+	{
+		lines.push_back(line);
+	}
+
+	ASSERT_EQ(5u, lines.size());
+	EXPECT_EQ(0u, lines[0].find("backend,width,height"));
+	EXPECT_EQ(0u, lines[1].find("openh264,160,120,30,cbr,low-latency-hq,0,0,0,100,ok,20,1,0,"));
+
+	// backends that can't be decoded here are measured for rate and speed alone
+	MockNvenc mock;
+	EncoderSweep nvenc(&source, [&mock]()
+	{
+		return std::unique_ptr<EncoderBackend>(new NvencEncoder(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA));
+	}, options);
+
+	auto result = nvenc.Run(nvenc.Configs()[0]);
+	EXPECT_EQ(EncoderStatus::kOk, result.status);
+	EXPECT_EQ(20, result.frames);
+	EXPECT_FALSE(result.measured);
+	EXPECT_GT(result.bytes, 0u);
+
+	std::ostringstream row;
+	EncoderSweep::WriteCsvRow(row, result);
+	EXPECT_NE(std::string::npos, row.str().find(",,,,,,,,,,\n"));
+}
+
+TEST(VideoEncoderTests, QualityKernelsMatchAcrossThreadsAndSimd)
+{
+	QualityMeter::Options scalar;
+	scalar.threads = 1;
+	scalar.simd = false;
+	QualityMeter::Options threaded;
+	threaded.threads = 4;
+	QualityMeter reference_meter(scalar);
+	QualityMeter meter(threaded);
+	EXPECT_EQ(4, meter.threads());
+
+	// an odd size leaves a tail after the vector loops in every plane
+	SyntheticFrameSource source(333, 197, 1, SyntheticPattern::kScrolling);
+	I420Frame frame;
+	ASSERT_TRUE(source.Read(&frame));
+	auto noisy = AddNoise(frame, 6, 3);
+
+	auto expected = reference_meter.Measure(frame, noisy);
+	EXPECT_GT(expected.psnr_y, 30);
+	EXPECT_LT(expected.psnr_y, 45);
+	EXPECT_LT(expected.ssim_y, 0.99);
+	EXPECT_GT(expected.ms_ssim, expected.ssim_y);
+	ExpectSameScores(expected, meter.Measure(frame, noisy));
+	ExpectSameScores(expected, MeasureQuality(frame, noisy));
+	EXPECT_EQ(expected.ssim_y, PlaneSsim(frame.data(0), 333, noisy.data(0), 333, 333, 197));
+	EXPECT_EQ(expected.ms_ssim, PlaneMsSsim(frame.data(0), 333, noisy.data(0), 333, 333, 197));
+
+	SyntheticFrameSource hd(1920, 1080, 1, SyntheticPattern::kScrolling);
+	ASSERT_TRUE(hd.Read(&frame));
+	noisy = AddNoise(frame, 6, 5);
+	QualityMeter::Options simd;
+	simd.threads = 1;
+	QualityMeter simd_meter(simd);
+	QualityMeter pool_meter;
+	QualityMeter* meters[] = { &reference_meter, &simd_meter, &pool_meter };
+	const char* names[] = { "scalar", "simd", "simd on every core" };
+	std::cout << "[ QUALITY ] 1920x1080 PSNR, SSIM and MS-SSIM, ms per frame" << std::endl;
+	for (int i = 0; i < 3; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		QualityScores scores;
+		for (int repeat = 0; repeat < 5; repeat++)
+		{
+			scores = meters[i]->Measure(frame, noisy);
+		}
+
+		std::cout << "[ QUALITY ] " << names[i] << " (" << meters[i]->threads() << " threads): " << ElapsedUs(start) / 5000.0 << std::endl;
+		ExpectSameScores(reference_meter.Measure(frame, noisy), scores);
+	}
+}
+
+TEST(VideoEncoderTests, MsSsimMatchesKnownValues)
+{
+	// 256x256 has all five scales, down to 16x16
+	I420Frame reference(256, 256);
+	memset(reference.data(0), 100, reference.size());
+	auto brighter = reference;
+	memset(brighter.data(0), 105, 256 * 256);
+
+	EXPECT_DOUBLE_EQ(1, MeasureQuality(reference, reference).ms_ssim);
+
+	// flat planes have no contrast or structure to lose, so only the last scale's luminance
+	// term counts, weighted by its share of the weights
+	auto luminance = (2 * 100.0 * 105 + 6.5025) / (100.0 * 100 + 105.0 * 105 + 6.5025);
+	auto weights = 0.0448 + 0.2856 + 0.3001 + 0.2363 + 0.1333;
+	EXPECT_NEAR(pow(luminance, 0.1333 / weights), MeasureQuality(reference, brighter).ms_ssim, 1e-12);
+
+	// at 40x40 the scales stop at 10x10, so only the first three count
+	EXPECT_NEAR(pow(luminance, 0.3001 / (0.0448 + 0.2856 + 0.3001)), PlaneMsSsim(reference.data(0), 256, brighter.data(0), 256, 40, 40), 1e-12);
+
+	// noise is lost at the fine scales, but at coarse ones the picture is still there
+	SyntheticFrameSource source(256, 256, 1, SyntheticPattern::kMovingSquare);
+	I420Frame frame;
+	ASSERT_TRUE(source.Read(&frame));
+	auto scores = MeasureQuality(frame, AddNoise(frame, 20, 7));
+	EXPECT_LT(scores.ssim_y, 0.6);
+	EXPECT_GT(scores.ms_ssim, scores.ssim_y + 0.2);
+
+	// unrelated pictures have nothing in common at any scale
+	SyntheticFrameSource first(256, 256, 1, SyntheticPattern::kNoise, 60, 1);
+	SyntheticFrameSource second(256, 256, 1, SyntheticPattern::kNoise, 60, 2);
+	I420Frame a;
+	I420Frame b;
+	ASSERT_TRUE(first.Read(&a));
+	ASSERT_TRUE(second.Read(&b));
+	EXPECT_LT(MeasureQuality(a, b).ms_ssim, 0.1);
+}
+
+TEST(VideoEncoderTests, PipelineSamplesQuality)
+{
+	OpenH264Encoder encoder(OpenH264());
+	auto config = MakeConfig(160, 120);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	QualitySampler::Options sampling;
+	sampling.interval = 5;
+	QualitySampler sampler(QualitySampler::Decoder(), sampling);
+	EncodePipeline::Options options;
+	options.quality = &sampler;
+	EncodePipeline pipeline(&encoder, [](const EncodedFrame&, int64_t) {}, options);
+	pipeline.Start();
+
+	std::vector<I420Frame> frames;
+	for (int i = 0; i < 30; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 16667;
+		frames.push_back(MakeFrame(160, 120, i));
+		ASSERT_TRUE(pipeline.Push(frames.back(), params, -1));
+	}
+
+	pipeline.Flush();
+	sampler.Flush();
+	pipeline.Stop();
+
+	// every fifth frame from the first, scored as MeasureQuality would
+	auto stats = sampler.stats();
+	EXPECT_EQ(6u, stats.sampled);
+	EXPECT_EQ(6u, stats.scored);
+	EXPECT_EQ(0u, stats.skipped);
+	EXPECT_EQ(0u, stats.undecodable);
+	EXPECT_GT(stats.mean.psnr_y, 30);
+	EXPECT_LE(stats.min_psnr_y, stats.mean.psnr_y);
+	EXPECT_GT(stats.mean.ms_ssim, 0.9);
+
+	OpenH264Encoder check(OpenH264());
+	ASSERT_EQ(EncoderStatus::kOk, check.Initialize(config));
+	OpenH264Decoder decoder(OpenH264());
+	I420Frame decoded;
+	for (int i = 0; i <= 25; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 16667;
+		EncodedFrame encoded;
+		ASSERT_EQ(EncoderStatus::kOk, check.Encode(frames[i], params, &encoded));
+		ASSERT_TRUE(decoder.Decode(encoded.data.data(), encoded.data.size(), &decoded));
+	}
+
+	ExpectSameScores(MeasureQuality(frames[25], decoded), stats.last);
+
+	// a bitstream it can't decode is counted, not scored
+	QualitySampler broken([](const EncodedFrame&, I420Frame*) { return false; }, sampling);
+	EncodeParams params;
+	broken.OnSubmitted(frames[0], params);
+	EncodedFrame encoded;
+	broken.OnEncoded(encoded);
+	broken.Flush();
+	EXPECT_EQ(1u, broken.stats().undecodable);
+	EXPECT_EQ(1u, broken.stats().skipped);
+	EXPECT_EQ(0u, broken.stats().scored);
+}
+
+TEST(VideoEncoderTests, ContentClassifierSortsScenes)
+{
+	const struct
+	{
+		SyntheticPattern pattern;
+		ContentClass expected;
+	} scenes[] =
+	{
+		{ SyntheticPattern::kText, ContentClass::kText },
+		{ SyntheticPattern::kMovingSquare, ContentClass::kNatural },
+		{ SyntheticPattern::kScrolling, ContentClass::kMotion },
+		{ SyntheticPattern::kNoise, ContentClass::kNoisy },
+	};
+
+	for (const auto& scene : scenes)
+	{
+		SCOPED_TRACE(SyntheticPatternName(scene.pattern));
+		SyntheticFrameSource source(320, 180, 40, scene.pattern, 30);
+		ContentClassifier classifier;
+		I420Frame frame;
+		ContentStats stats;
+		while (source.Read(&frame))
+		{
+			classifier.Update(frame, &stats);
+		}
+
+		// the first frame has nothing to move from, so motion takes a while to show
+		EXPECT_EQ(scene.expected, classifier.current());
+		EXPECT_EQ(scene.expected, classifier.Classify(stats));
+
+		std::cout << "[ CONTENT ] " << SyntheticPatternName(scene.pattern) << ": spatial " << stats.spatial <<
+			", temporal " << stats.temporal << ", edges " << stats.edge_density << ", flat " << stats.flat_fraction << std::endl;
+	}
+
+	// another class only takes over once it has held for a while, and a scene cut doesn't count
+	ContentClassifier::Options options;
+	options.switch_frames = 5;
+	ContentClassifier classifier(options);
+	SyntheticFrameSource text(320, 180, 10, SyntheticPattern::kText, 30);
+	SyntheticFrameSource natural(320, 180, 10, SyntheticPattern::kMovingSquare, 30);
+	I420Frame frame;
+	while (text.Read(&frame))
+	{
+		classifier.Update(frame);
+	}
+
+	ContentStats stats;
+	ASSERT_TRUE(natural.Read(&frame));
+	EXPECT_EQ(ContentClass::kText, classifier.Update(frame, &stats));
+	EXPECT_EQ(ContentClass::kMotion, classifier.Classify(stats));
+	for (int i = 1; i < 6; i++)
+	{
+		ASSERT_TRUE(natural.Read(&frame));
+		EXPECT_EQ(i < 5 ? ContentClass::kText : ContentClass::kNatural, classifier.Update(frame));
+	}
+
+	// after a reset the next frame is classified on its own
+	classifier.Reset();
+	EXPECT_EQ(ContentClass::kNatural, classifier.current());
+	auto content = classifier.Update(frame, &stats);
+	EXPECT_EQ(0, stats.temporal);
+	EXPECT_EQ(classifier.Classify(stats), content);
+
+	// cheap enough to run on every frame
+	SyntheticFrameSource large(1920, 1080, 1, SyntheticPattern::kScrolling);
+	ASSERT_TRUE(large.Read(&frame));
+	const int kRuns = 20;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kRuns; i++)
+	{
+		classifier.Analyze(frame);
+	}
+
+	auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kRuns;
+	std::cout << "[ CONTENT ] 1080p analyzed in " << ms << " ms" << std::endl;
+}
+
+TEST(VideoEncoderTests, ContentAdapterSteersEncoder)
+{
+	OpenH264Encoder encoder(OpenH264());
+	auto config = MakeConfig(320, 180);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	EncoderControl control;
+	ContentAdapter::Options options;
+	options.classifier.switch_frames = 3;
+	ContentAdapter adapter(&control, options);
+	adapter.SetBitrate(2000000);
+	EXPECT_FALSE(control.pending());
+
+	// the first frame picks a profile straight away
+	SyntheticFrameSource text(320, 180, 5, SyntheticPattern::kText, 30);
+	I420Frame frame;
+	ASSERT_TRUE(text.Read(&frame));
+	EXPECT_EQ(ContentClass::kText, adapter.OnFrame(frame));
+	EXPECT_TRUE(control.pending());
+	ASSERT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	const auto& text_profile = options.profiles[static_cast<int>(ContentClass::kText)];
+	EXPECT_EQ(text_profile.preset, encoder.config().preset);
+	EXPECT_EQ(text_profile.adaptive_quantization, encoder.config().adaptive_quantization);
+	EXPECT_EQ(static_cast<int>(2000000 * text_profile.bitrate_scale), encoder.config().bitrate_bps);
+	EncodedFrame encoded;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(frame, EncodeParams(), &encoded));
+	EXPECT_TRUE(encoded.keyframe);
+
+	while (text.Read(&frame))
+	{
+		adapter.OnFrame(frame);
+	}
+
+	EXPECT_FALSE(control.pending());
+
+	SyntheticFrameSource noise(320, 180, 3, SyntheticPattern::kNoise, 30);
+	while (noise.Read(&frame))
+	{
+		adapter.OnFrame(frame);
+	}
+
+	EXPECT_EQ(ContentClass::kNoisy, adapter.current());
+	ASSERT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	const auto& noisy_profile = options.profiles[static_cast<int>(ContentClass::kNoisy)];
+	EXPECT_EQ(noisy_profile.preset, encoder.config().preset);
+	EXPECT_EQ(noisy_profile.adaptive_quantization, encoder.config().adaptive_quantization);
+
+	// a new bitrate is shared out as the current class's profile says
+	adapter.SetBitrate(4000000, 6000000);
+	ASSERT_EQ(EncoderStatus::kOk, control.Apply(&encoder));
+	EXPECT_EQ(static_cast<int>(4000000 * noisy_profile.bitrate_scale), encoder.config().bitrate_bps);
+	EXPECT_EQ(static_cast<int>(6000000 * noisy_profile.bitrate_scale), encoder.config().max_bitrate_bps);
+
+	// OpenH264 changes presets in place, without a keyframe
+	EXPECT_EQ(0u, control.stats().reinitialized);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(frame, EncodeParams(), &encoded));
+	EXPECT_FALSE(encoded.keyframe);
+
+	auto stats = adapter.stats();
+	EXPECT_EQ(8u, stats.frames);
+	EXPECT_EQ(1u, stats.switches);
+	EXPECT_EQ(7u, stats.frames_by_class[static_cast<int>(ContentClass::kText)]);
+	EXPECT_EQ(1u, stats.frames_by_class[static_cast<int>(ContentClass::kNoisy)]);
+
+	// NVENC has to start a new session for another preset
+	MockNvenc mock;
+	NvencEncoder nvenc(mock.functions(), mock.device(), NV_ENC_DEVICE_TYPE_CUDA);
+	ASSERT_EQ(EncoderStatus::kOk, nvenc.Initialize(config));
+	EncoderControl nvenc_control;
+	ContentAdapter nvenc_adapter(&nvenc_control, options);
+	nvenc_adapter.OnFrame(frame);
+	ASSERT_EQ(EncoderStatus::kOk, nvenc_control.Apply(&nvenc));
+	EXPECT_EQ(noisy_profile.preset, nvenc.config().preset);
+	EXPECT_EQ(1u, nvenc_control.stats().reinitialized);
+}
+
+TEST(VideoEncoderTests, ContentAdaptiveSweepSavesBits)
+{
+	// text, then a mostly still scene, then a pan, as a session might show them, recorded to
+	// YUV4MPEG2 and swept from the recording as EncoderSweep --input does
+	std::vector<std::unique_ptr<FrameSource>> scenes;
+	for (auto pattern : { SyntheticPattern::kText, SyntheticPattern::kMovingSquare, SyntheticPattern::kScrolling })
+	{
+		scenes.emplace_back(new SyntheticFrameSource(320, 180, 120, pattern, 30));
+	}
+
+	SequenceFrameSource session(std::move(scenes));
+	std::string y4m = "YUV4MPEG2 W320 H180 F30:1 Ip A1:1 C420jpeg\n";
+	I420Frame frame;
+	while (session.Read(&frame))
+	{
+		y4m += "FRAME\n";
+		y4m.append(reinterpret_cast<const char*>(frame.data(0)), frame.size());
+	}
+
+	std::istringstream recorded(y4m);
+	Y4mFrameSource source;
+	ASSERT_TRUE(source.Open(&recorded));
+
+	// the whole curve, declared before anything is encoded; none of it is dropped after
+	const std::vector<int> kBitratesBps = { 100000, 200000, 300000, 400000, 500000 };
+	EncoderSweep::Options options;
+	options.bitrates_bps = kBitratesBps;
+	options.quality.ms_ssim = false;
+	auto factory = []() { return std::unique_ptr<EncoderBackend>(new OpenH264Encoder(OpenH264())); };
+	EncoderSweep fixed(&source, factory, options);
+	options.content_adaptive = true;
+	EncoderSweep adaptive(&source, factory, options);
+
+	auto fixed_results = fixed.RunAll();
+	auto adaptive_results = adaptive.RunAll();
+	ASSERT_EQ(kBitratesBps.size(), fixed_results.size());
+	ASSERT_EQ(kBitratesBps.size(), adaptive_results.size());
+	for (size_t i = 0; i < adaptive_results.size(); i++)
+	{
+		const auto& result = adaptive_results[i];
+		std::cout << "[ CONTENT ] " << result.config.bitrate_bps / 1000 << " kbps: fixed " <<
+			fixed_results[i].bitrate_bps / 1000 << " kbps at " << fixed_results[i].quality.psnr_y << " dB, ssim " <<
+			fixed_results[i].quality.ssim_y << ", adaptive " << result.bitrate_bps / 1000 << " kbps at " <<
+			result.quality.psnr_y << " dB, ssim " << result.quality.ssim_y << std::endl;
+
+		EXPECT_EQ("openh264", result.backend);
+		EXPECT_EQ(EncoderStatus::kOk, result.status);
+		EXPECT_EQ(kBitratesBps[i], result.config.bitrate_bps);
+		EXPECT_TRUE(result.content_adaptive);
+		EXPECT_FALSE(fixed_results[i].content_adaptive);
+		EXPECT_EQ(360, result.frames);
+		EXPECT_EQ(2, result.content_switches);
+		EXPECT_EQ(1, result.keyframes);
+	}
+
+	// the Bjontegaard delta rate over every point, at equal luma PSNR and at equal luma SSIM
+	double psnr_savings = 0;
+	ASSERT_TRUE(EncoderSweep::BitrateSavings(fixed_results, adaptive_results, EncoderSweep::Distortion::kPsnrY, &psnr_savings));
+	double ssim_savings = 0;
+	ASSERT_TRUE(EncoderSweep::BitrateSavings(fixed_results, adaptive_results, EncoderSweep::Distortion::kSsimY, &ssim_savings));
+	std::cout << "[ CONTENT ] adapting saves " << psnr_savings * 100 << "% of the bits at equal luma PSNR and " <<
+		ssim_savings * 100 << "% at equal luma SSIM" << std::endl;
+	EXPECT_GT(psnr_savings, 0);
+	EXPECT_GT(ssim_savings, 0);
+
+	// a curve saves nothing against itself, and curves that don't overlap can't be compared
+	double savings = 0;
+	for (auto distortion : { EncoderSweep::Distortion::kPsnrY, EncoderSweep::Distortion::kSsimY })
+	{
+		ASSERT_TRUE(EncoderSweep::BitrateSavings(fixed_results, fixed_results, distortion, &savings));
+		EXPECT_NEAR(0, savings, 1e-9);
+		std::vector<EncoderSweep::Result> low(1, fixed_results.front());
+		std::vector<EncoderSweep::Result> high(1, fixed_results.back());
+		EXPECT_FALSE(EncoderSweep::BitrateSavings(low, high, distortion, &savings));
+	}
+}
+
+TEST(VideoEncoderTests, StreamRecordingSeeksAndReplays)
+{
+	OpenH264Encoder encoder(OpenH264());
+	auto config = MakeConfig(160, 120);
+	config.gop_length = 10;
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	// small batches, so frames straddle them
+	const std::string path = "stream_recording_test.3dsr";
+	StreamRecorder::Options options;
+	options.batch_bytes = 5000;
+	options.max_batches = 64;
+	StreamRecorder recorder;
+	ASSERT_TRUE(recorder.Open(path, 160, 120, 60, options));
+	EXPECT_TRUE(recorder.IsOpen());
+
+	std::vector<EncodedFrame> encoded(40);
+	for (int i = 0; i < 40; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 16667;
+		ASSERT_EQ(EncoderStatus::kOk, encoder.Encode(MakeFrame(160, 120, i), params, &encoded[i]));
+		recorder.Write(encoded[i], 1000 + i, "pose " + std::to_string(i));
+	}
+
+	ASSERT_TRUE(recorder.Close());
+	EXPECT_FALSE(recorder.IsOpen());
+	auto stats = recorder.stats();
+	EXPECT_EQ(40u, stats.frames);
+	EXPECT_EQ(4u, stats.keyframes);
+	EXPECT_EQ(0u, stats.dropped);
+	EXPECT_EQ(0u, stats.write_errors);
+	EXPECT_GT(stats.batches, 1u);
+	std::cout << "[ RECORDING ] " << stats.bytes << " bytes in " << stats.batches << " batches, " <<
+		(stats.direct ? "direct" : "cached") << std::endl;
+
+	std::ifstream file(path, std::ios::binary);
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	file.close();
+	EXPECT_EQ(0u, bytes.size() % StreamRecorder::kBlockSize);
+
+	StreamRecording recording;
+	ASSERT_TRUE(recording.Open(path));
+	EXPECT_FALSE(recording.recovered());
+	EXPECT_EQ(160, recording.width());
+	EXPECT_EQ(120, recording.height());
+	EXPECT_EQ(60, recording.fps());
+	ASSERT_EQ(40u, recording.frames());
+	EXPECT_EQ(std::vector<uint32_t>({ 0, 10, 20, 30 }), recording.keyframes());
+	for (size_t i = 0; i < recording.frames(); i++)
+	{
+		const auto& frame = recording.frame(i);
+		ASSERT_EQ(encoded[i].data.size(), frame.size);
+		EXPECT_EQ(0, memcmp(encoded[i].data.data(), frame.data, frame.size));
+		EXPECT_EQ("pose " + std::to_string(i), std::string(reinterpret_cast<const char*>(frame.metadata), frame.metadata_size));
+		EXPECT_EQ(encoded[i].timestamp_us, frame.timestamp_us);
+		EXPECT_EQ(static_cast<int64_t>(1000 + i), frame.prediction_timestamp);
+		EXPECT_EQ(encoded[i].keyframe, frame.keyframe);
+		EXPECT_EQ(encoded[i].qp, frame.qp);
+		EXPECT_EQ(160, frame.width);
+	}
+
+	// seeking lands on the keyframe to decode from
+	size_t index;
+	ASSERT_TRUE(recording.Seek(25 * 16667, &index));
+	EXPECT_EQ(20u, index);
+	ASSERT_TRUE(recording.Seek(20 * 16667, &index));
+	EXPECT_EQ(20u, index);
+	ASSERT_TRUE(recording.Seek(-1, &index));
+	EXPECT_EQ(0u, index);
+
+	OpenH264Decoder decoder(OpenH264());
+	I420Frame decoded;
+	for (; index <= 25; index++)
+	{
+		ASSERT_TRUE(decoder.Decode(recording.frame(index).data, recording.frame(index).size, &decoded));
+	}
+
+	OpenH264Decoder reference(OpenH264());
+	I420Frame expected;
+	for (int i = 0; i <= 25; i++)
+	{
+		ASSERT_TRUE(reference.Decode(encoded[i].data.data(), encoded[i].data.size(), &expected));
+	}
+
+	EXPECT_EQ(0, memcmp(expected.data(0), decoded.data(0), expected.size()));
+
+	std::ostringstream stream;
+	ASSERT_TRUE(recording.WriteElementaryStream(stream));
+	size_t total = 0;
+	for (const auto& frame : encoded)
+	{
+		total += frame.data.size();
+	}
+
+	EXPECT_EQ(total, stream.str().size());
+
+	// a recording that was never closed is read by walking its records, up to one cut short
+	recording.Close();
+	remove(path.c_str());
+	auto unclosed = bytes;
+	memset(unclosed.data() + 32, 0, 32);
+	ASSERT_TRUE(recording.Open(unclosed.data(), unclosed.size()));
+	EXPECT_TRUE(recording.recovered());
+	EXPECT_EQ(40u, recording.frames());
+	EXPECT_EQ(4u, recording.keyframes().size());
+
+	auto cut = StreamRecorder::kBlockSize + 10 * 40 + total / 2;
+	ASSERT_TRUE(recording.Open(unclosed.data(), cut));
+	EXPECT_GT(recording.frames(), 0u);
+	EXPECT_LT(recording.frames(), 40u);
+
+	unclosed[0] = 'X';
+	EXPECT_FALSE(recording.Open(unclosed.data(), unclosed.size()));
+	EXPECT_FALSE(recording.Open("no_such_recording.3dsr"));
+}
+
+TEST(VideoEncoderTests, StreamRecorderDropsToKeyframes)
+{
+	// one batch waiting, so a burst outruns the disk, and what's kept must still decode
+	const std::string path = "stream_recorder_drops.3dsr";
+	StreamRecorder::Options options;
+	options.batch_bytes = StreamRecorder::kBlockSize;
+	options.max_batches = 1;
+	StreamRecorder recorder;
+	ASSERT_TRUE(recorder.Open(path, 64, 48, 60, options));
+
+	EncodedFrame frame;
+	frame.data.assign(3000, 0x5A);
+	for (int i = 0; i < 200; i++)
+	{
+		frame.timestamp_us = i;
+		frame.keyframe = i % 20 == 0;
+		recorder.Write(frame);
+	}
+
+	ASSERT_TRUE(recorder.Close());
+	auto stats = recorder.stats();
+	EXPECT_EQ(200u, stats.frames + stats.dropped);
+
+	StreamRecording recording;
+	ASSERT_TRUE(recording.Open(path));
+	ASSERT_EQ(stats.frames, recording.frames());
+	for (size_t i = 0; i < recording.frames(); i++)
+	{
+		const auto& recorded = recording.frame(i);
+		if (!recorded.keyframe)
+		{
+			ASSERT_GT(i, 0u);
+			EXPECT_EQ(recorded.timestamp_us - 1, recording.frame(i - 1).timestamp_us);
+		}
+	}
+
+	recording.Close();
+	remove(path.c_str());
+
+	// frames too big for every batch are always dropped
+	ASSERT_TRUE(recorder.Open(path, 64, 48, 60, options));
+	frame.data.assign(3 * StreamRecorder::kBlockSize, 0);
+	frame.keyframe = true;
+	recorder.Write(frame);
+	EXPECT_EQ(1u, recorder.stats().dropped);
+	ASSERT_TRUE(recorder.Close());
+	remove(path.c_str());
+}
+
+TEST(VideoEncoderTests, PipelineRecordsFrames)
+{
+	OpenH264Encoder encoder(OpenH264());
+	auto config = MakeConfig(160, 120);
+	ASSERT_EQ(EncoderStatus::kOk, encoder.Initialize(config));
+
+	const std::string path = "pipeline_recording.3dsr";
+	StreamRecorder recorder;
+	ASSERT_TRUE(recorder.Open(path, 160, 120, 60));
+	EncodePipeline::Options options;
+	options.recorder = &recorder;
+	std::vector<EncodedFrame> delivered;
+	EncodePipeline pipeline(&encoder, [&delivered](const EncodedFrame& frame, int64_t) { delivered.push_back(frame); }, options);
+	pipeline.Start();
+
+	for (int i = 0; i < 12; i++)
+	{
+		EncodeParams params;
+		params.timestamp_us = i * 16667;
+		params.prediction_timestamp = 500 + i;
+		params.metadata = std::string(i, 'p');
+		ASSERT_TRUE(pipeline.Push(MakeFrame(160, 120, i), params, -1));
+	}
+
+	pipeline.Flush();
+	pipeline.Stop();
+	ASSERT_TRUE(recorder.Close());
+
+	StreamRecording recording;
+	ASSERT_TRUE(recording.Open(path));
+	ASSERT_EQ(12u, recording.frames());
+	ASSERT_EQ(12u, delivered.size());
+	for (size_t i = 0; i < recording.frames(); i++)
+	{
+		const auto& frame = recording.frame(i);
+		EXPECT_EQ(delivered[i].timestamp_us, frame.timestamp_us);
+		EXPECT_EQ(static_cast<int64_t>(500 + i), frame.prediction_timestamp);
+		EXPECT_EQ(i, frame.metadata_size);
+		ASSERT_EQ(delivered[i].data.size(), frame.size);
+		EXPECT_EQ(0, memcmp(delivered[i].data.data(), frame.data, frame.size));
+	}
+
+	recording.Close();
+	remove(path.c_str());
+}
+
+namespace
+{
+	// Records |frames| software-encoded frames at 60 fps with a keyframe every |gop_length|
+	bool RecordTestStream(const std::string& path, int frames, int gop_length)
+	{
+		OpenH264Encoder encoder(OpenH264());
+		auto config = MakeConfig(160, 120);
+		config.gop_length = gop_length;
+		StreamRecorder recorder;
+		if (encoder.Initialize(config) != EncoderStatus::kOk || !recorder.Open(path, 160, 120, 60))
+		{
+			return false;
+		}
+
+		for (int i = 0; i < frames; i++)
+		{
+			EncodeParams params;
+			params.timestamp_us = 5000000 + i * 16667;
+			EncodedFrame encoded;
+			if (encoder.Encode(MakeFrame(160, 120, i), params, &encoded) != EncoderStatus::kOk)
+			{
+				return false;
+			}
+
+			recorder.Write(encoded, i);
+		}
+
+		return recorder.Close();
+	}
+}
+
+TEST(VideoEncoderTests, StreamReplayerKeepsRecordedPace)
+{
+	const std::string path = "stream_replayer_pace.3dsr";
+	ASSERT_TRUE(RecordTestStream(path, 30, 10));
+	StreamRecording recording;
+	ASSERT_TRUE(recording.Open(path));
+
+	std::vector<int64_t> predictions;
+	std::vector<int64_t> timestamps;
+	std::vector<std::chrono::steady_clock::time_point> arrivals;
+	StreamReplayer::Options options;
+	options.loop = false;
+	options.speed = 4;
+	StreamReplayer replayer(&recording, [&](const RecordedFrame& frame, int64_t timestamp_us)
+	{
+		predictions.push_back(frame.prediction_timestamp);
+		timestamps.push_back(timestamp_us);
+		arrivals.push_back(std::chrono::steady_clock::now());
+	}, options);
+
+	ASSERT_TRUE(replayer.Start());
+	replayer.Wait();
+	EXPECT_FALSE(replayer.IsRunning());
+
+	ASSERT_EQ(30u, timestamps.size());
+	for (int i = 0; i < 30; i++)
+	{
+		EXPECT_EQ(i, predictions[i]);
+		EXPECT_EQ(i * 16667, timestamps[i]);
+	}
+
+	// 29 intervals at four times the recorded pace
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(arrivals.back() - arrivals.front()).count();
+	EXPECT_GE(elapsed, 29 * 16667 / 4 - 1000);
+	auto stats = replayer.stats();
+	EXPECT_EQ(30u, stats.frames);
+	EXPECT_EQ(3u, stats.keyframes);
+	EXPECT_EQ(0u, stats.loops);
+	std::cout << "[ REPLAY ] " << elapsed << " us for 30 frames, at most " << stats.max_lateness_us << " us late" << std::endl;
+
+	replayer.Stop();
+	recording.Close();
+	remove(path.c_str());
+}
+
+TEST(VideoEncoderTests, StreamReplayerLoopsAndSkipsToKeyframes)
+{
+	const std::string path = "stream_replayer_loop.3dsr";
+	ASSERT_TRUE(RecordTestStream(path, 25, 10));
+	StreamRecording recording;
+	ASSERT_TRUE(recording.Open(path));
+
+	std::mutex lock;
+	std::condition_variable delivered;
+	std::vector<int64_t> predictions;
+	std::vector<int64_t> timestamps;
+	StreamReplayer* playing = nullptr;
+	StreamReplayer::Options options;
+	options.speed = 0;
+	StreamReplayer replayer(&recording, [&](const RecordedFrame& frame, int64_t timestamp_us)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (predictions.size() == 3)
+		{
+			playing->RequestKeyframe();
+		}
+
+		predictions.push_back(frame.prediction_timestamp);
+		timestamps.push_back(timestamp_us);
+		delivered.notify_all();
+	}, options);
+	playing = &replayer;
+
+	ASSERT_TRUE(replayer.Start());
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		delivered.wait(guard, [&]() { return predictions.size() >= 60; });
+	}
+
+	replayer.Stop();
+	EXPECT_FALSE(replayer.IsRunning());
+
+	// frames 0 to 3, the keyframe asked for at 10, then the rest and over again from 0
+	EXPECT_EQ(std::vector<int64_t>({ 0, 1, 2, 3, 10, 11 }), std::vector<int64_t>(predictions.begin(), predictions.begin() + 6));
+	EXPECT_EQ(24, predictions[18]);
+	EXPECT_EQ(0, predictions[19]);
+	for (size_t i = 1; i < timestamps.size(); i++)
+	{
+		// a frame's worth at 60 fps where it starts over
+		ASSERT_NEAR(16667, timestamps[i] - timestamps[i - 1], 1);
+	}
+
+	auto stats = replayer.stats();
+	EXPECT_GE(stats.loops, 2u);
+	EXPECT_EQ(1u, stats.keyframe_requests);
+	EXPECT_EQ(0, stats.max_lateness_us);
+
+	// nothing to start from
+	StreamRecording empty;
+	StreamReplayer idle(&empty, [](const RecordedFrame&, int64_t) {});
+	EXPECT_FALSE(idle.Start());
+
+	recording.Close();
+	remove(path.c_str());
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#if !defined(_WIN32)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/// <summary>
+/// An event NVENC sets when a picture of an asynchronous session has been encoded
+/// </summary>
+/// <remarks>
+/// On Windows it's a Win32 event, which the driver is handed and sets itself. The driver only
+/// encodes asynchronously on Windows, so elsewhere the handle is the object itself, for
+/// MockNvenc to set with Signal. The event stays set until it's reset, so every wait sees it.
+/// </remarks>
+class CompletionEvent
+{
+public:
+	CompletionEvent();
+
+	~CompletionEvent();
+
+	// What to register with nvEncRegisterAsyncEvent and pass as a picture's completionEvent
+	void* handle() const;
+
+	void Reset();
+
+	// Waits up to |timeout_ms| for the event to be set, or as long as it takes if negative,
+	// returning false if it wasn't
+	bool Wait(int timeout_ms);
+
+	// Sets the event |handle| came from, as the driver does
+	static void Signal(void* handle);
+
+private:
+	CompletionEvent(const CompletionEvent&) = delete;
+	CompletionEvent& operator=(const CompletionEvent&) = delete;
+
+#if defined(_WIN32)
+	void* event_;
+#else
+	std::mutex lock_;
+	std::condition_variable set_cv_;
+	bool set_;
+#endif
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+#include "content_classifier.h"
+#include "encoder_backend.h"
+#include "encoder_control.h"
+#include "video_frame.h"
+
+/// <summary>
+/// Picks the encoder preset, adaptive quantization and share of the bitrate for the content
+/// being streamed, as a ContentClassifier sees it
+/// </summary>
+/// <remarks>
+/// Changes are asked of an EncoderControl, so they're applied between frames like any other.
+/// The bitrate a session may use, from congestion control or the config, is given to the adapter
+/// rather than the control, and each class's profile spends a share of it: text needs few bits
+/// once it's been sent, and noise gains little from more. OnFrame is called on the thread that
+/// encodes, before the control is applied; SetBitrate from any thread.
+/// </remarks>
+class ContentAdapter
+{
+public:
+	struct Profile
+	{
+		EncoderPreset preset;
+		bool adaptive_quantization;
+
+		// The share of the bitrate to use
+		double bitrate_scale;
+	};
+
+	struct Options
+	{
+		ContentClassifier::Options classifier;
+
+		// Indexed by ContentClass
+		Profile profiles[kContentClasses];
+
+		Options();
+	};
+
+	struct Stats
+	{
+		uint64_t frames;
+
+		// Times the current class changed after the first
+		uint64_t switches;
+
+		uint64_t frames_by_class[kContentClasses];
+
+		ContentStats last;
+	};
+
+	// |control| must outlive the adapter
+	explicit ContentAdapter(EncoderControl* control, const Options& options = Options());
+
+	// The bitrate to share out, or 0 to leave the encoder's as it is
+	void SetBitrate(int bitrate_bps, int max_bitrate_bps = 0);
+
+	// Classifies |frame|, asking the control for the profile of a class that's taken over
+	ContentClass OnFrame(const I420Frame& frame);
+
+	ContentClass current() const;
+
+	Stats stats() const;
+
+private:
+	// Asks the control for the current class's bitrate share, with the lock held
+	void ApplyBitrate();
+
+	EncoderControl* control_;
+	Options options_;
+	ContentClassifier classifier_;
+
+	mutable std::mutex lock_;
+	bool classified_;
+	ContentClass current_;
+	int bitrate_bps_;
+	int max_bitrate_bps_;
+	Stats stats_;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "video_frame.h"
+
+enum class ContentClass
+{
+	// Sharp edges on flat areas, such as text, UI or CAD drawings
+	kText,
+
+	// Smooth detail that mostly holds still from one frame to the next
+	kNatural,
+
+	// Detail that moves across most of the frame, such as a camera pan
+	kMotion,
+
+	// Fine texture everywhere, such as particles or fractal terrain, which no encoder predicts well
+	kNoisy
+};
+
+const int kContentClasses = 4;
+
+const char* ContentClassName(ContentClass content);
+
+/// <summary>
+/// What a frame's luma looks like to an encoder, measured cheaply enough to run on every frame
+/// </summary>
+struct ContentStats
+{
+	// Mean absolute difference between neighbouring pixels, the spatial complexity
+	double spatial;
+
+	// Mean absolute difference from the last frame, the temporal complexity, 0 for the first
+	double temporal;
+
+	// Fractions of pixels whose gradient is past the edge threshold, and of those with almost
+	// none, which text has many of both of and noise few of either
+	double edge_density;
+	double flat_fraction;
+
+	ContentStats() : spatial(0), temporal(0), edge_density(0), flat_fraction(0) {}
+};
+
+/// <summary>
+/// Sorts frames into the kinds of content encoders do best with differently
+/// </summary>
+/// <remarks>
+/// Only one pixel in every |subsample| rows and columns is measured, so at the default of 2 a
+/// 1080p frame costs a couple of milliseconds. A frame that looks like another class only
+/// changes the current one once |switch_frames| in a row have, since on most backends switching
+/// a preset costs a keyframe. Not thread-safe; frames are given to it in the order they're
+/// encoded.
+/// </remarks>
+class ContentClassifier
+{
+public:
+	struct Options
+	{
+		int subsample;
+
+		// Sum of the horizontal and vertical gradient past which a pixel is on an edge, and up
+		// to which it's flat
+		int edge_threshold;
+		int flat_threshold;
+
+		// Frames that must agree before the current class changes
+		int switch_frames;
+
+		// Past this flat fraction with edges, frames are text
+		double text_flat_fraction;
+		double text_edge_density;
+
+		// Below this flat fraction, and past this spatial complexity, frames are noisy
+		double noisy_flat_fraction;
+		double noisy_spatial;
+
+		// Past this temporal complexity, frames that aren't text or noise are motion
+		double motion_temporal;
+
+		Options() :
+			subsample(2),
+			edge_threshold(48),
+			flat_threshold(2),
+			switch_frames(30),
+			text_flat_fraction(0.5),
+			text_edge_density(0.02),
+			noisy_flat_fraction(0.1),
+			noisy_spatial(24),
+			motion_temporal(4)
+		{
+		}
+	};
+
+	explicit ContentClassifier(const Options& options = Options());
+
+	// Measures |frame|, against the last frame measured if it was the same size
+	ContentStats Analyze(const I420Frame& frame);
+
+	// The class one frame's stats look like
+	ContentClass Classify(const ContentStats& stats) const;
+
+	// Analyzes and classifies |frame|, returning the current class, and |stats| if not null
+	ContentClass Update(const I420Frame& frame, ContentStats* stats = nullptr);
+
+	ContentClass current() const;
+
+	// Forgets the last frame and the current class, as for a new scene
+	void Reset();
+
+private:
+	Options options_;
+
+	// The last frame's measured pixels
+	std::vector<uint8_t> previous_;
+	int previous_width_;
+	int previous_height_;
+
+	bool classified_;
+	ContentClass current_;
+	ContentClass candidate_;
+	int candidate_frames_;
+};
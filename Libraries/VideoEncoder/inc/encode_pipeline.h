@@ -0,0 +1,187 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+#include "content_adapter.h"
+#include "encoder_backend.h"
+#include "encoder_control.h"
+#include "loss_recovery.h"
+#include "quality_sampler.h"
+#include "stream_recording.h"
+#include "video_frame.h"
+
+/// <summary>
+/// Runs an encoder backend on its own threads, so rendering the next frame overlaps encoding
+/// the last
+/// </summary>
+/// <remarks>
+/// Frames pass through three stages, each on its own thread and joined by bounded queues: one
+/// submits pushed frames to the backend, retrying while it's busy, one waits for each frame to
+/// complete and copies its bitstream out, and one delivers the bitstreams. For an asynchronous
+/// NVENC session the waiting is on each output buffer's completion event, inside Retrieve. A slow consumer or
+/// encoder holds the stages before it back rather than growing a queue, until Push times out.
+/// Frames come out in the order they were pushed. With an EncoderControl, changes are applied on
+/// the submitting thread between frames, waiting for the frames in flight only if the backend
+/// has to be reinitialized. With a LossRecovery, a peer's loss reports are acted on there too,
+/// and every frame submitted and retrieved is recorded for it. A QualitySampler is shown every
+/// frame the same way. A ContentAdapter sees each frame before the control is applied, so a
+/// profile it picks takes effect from that frame. A StreamRecorder is given each bitstream on
+/// the delivery thread, with the prediction timestamp and metadata it was pushed with.
+/// </remarks>
+class EncodePipeline
+{
+public:
+	// Called on the delivery thread, with the time from Push to delivery
+	typedef std::function<void(const EncodedFrame& frame, int64_t latency_us)> Deliver;
+
+	struct Options
+	{
+		// Frames pushed and not yet submitted to the backend
+		size_t input_capacity;
+
+		// Bitstreams retrieved and not yet delivered
+		size_t output_capacity;
+
+		// Changes to apply before each frame, and to resize the encoder to frames of another
+		// size, or null
+		EncoderControl* control;
+
+		// Recovers peers from lost frames, or null
+		LossRecovery* recovery;
+
+		// Scores some of the frames encoded, or null
+		QualitySampler* quality;
+
+		// Adapts the encoder to the content through control, which it must have been made with,
+		// or null
+		ContentAdapter* content;
+
+		// Records every frame delivered, or null
+		StreamRecorder* recorder;
+
+		Options() :
+			input_capacity(2),
+			output_capacity(4),
+			control(nullptr),
+			recovery(nullptr),
+			quality(nullptr),
+			content(nullptr),
+			recorder(nullptr)
+		{
+		}
+	};
+
+	struct Stats
+	{
+		uint64_t pushed;
+
+		// Pushes that timed out with the input queue full
+		uint64_t dropped;
+
+		// Frames the backend refused or failed to encode
+		uint64_t failed;
+
+		uint64_t delivered;
+
+		// Times the backend had every slot in flight when a frame was ready for it
+		uint64_t busy;
+
+		int64_t total_latency_us;
+		int64_t max_latency_us;
+
+		size_t peak_input;
+		size_t peak_in_flight;
+		size_t peak_output;
+
+		double mean_latency_us() const { return delivered == 0 ? 0 : static_cast<double>(total_latency_us) / delivered; }
+	};
+
+	// |encoder| must be initialized, and isn't used by anything else until Stop returns
+	EncodePipeline(EncoderBackend* encoder, const Deliver& deliver, const Options& options = Options());
+
+	~EncodePipeline();
+
+	void Start();
+
+	// Queues |frame|, waiting up to |timeout_ms| for room, or as long as it takes if negative.
+	// Returns false, and counts the frame as dropped, if there was none.
+	bool Push(I420Frame frame, const EncodeParams& params, int timeout_ms);
+
+	// Waits until every frame pushed so far has been delivered or has failed
+	void Flush();
+
+	// Stops the threads, dropping frames not yet delivered, and retrieves any the backend
+	// still has in flight so it can be used again
+	void Stop();
+
+	Stats stats() const;
+
+	// The last error the backend returned, or kOk
+	EncoderStatus last_error() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Input
+	{
+		I420Frame frame;
+		EncodeParams params;
+		Clock::time_point pushed_at;
+	};
+
+	// What a frame was pushed with, kept while the backend has it
+	struct Submitted
+	{
+		Clock::time_point pushed_at;
+		int64_t prediction_timestamp;
+		std::string metadata;
+	};
+
+	struct Output
+	{
+		EncodedFrame frame;
+		Submitted submitted;
+	};
+
+	void SubmitLoop();
+	void RetrieveLoop();
+	void DeliverLoop();
+
+	// Counts a frame that won't be delivered, for Flush
+	void FrameFailed(EncoderStatus status);
+
+	EncoderBackend* encoder_;
+	Deliver deliver_;
+	Options options_;
+
+	mutable std::mutex lock_;
+	std::condition_variable changed_;
+	bool running_;
+
+	std::deque<Input> input_;
+
+	// Each frame submitted to the backend and not yet retrieved, oldest first
+	std::deque<Submitted> in_flight_;
+
+	std::deque<Output> output_;
+
+	// Frames pushed and not yet delivered or failed
+	uint64_t outstanding_;
+
+	// Frames the backend may have in flight at once, from its config when started
+	size_t queue_depth_;
+
+	EncoderStatus last_error_;
+	Stats stats_;
+
+	std::thread submit_thread_;
+	std::thread retrieve_thread_;
+	std::thread deliver_thread_;
+};
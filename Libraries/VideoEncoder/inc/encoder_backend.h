@@ -0,0 +1,199 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "video_frame.h"
+
+enum class EncoderStatus
+{
+	kOk,
+
+	// Every frame the backend can hold is in flight, so one has to be retrieved first
+	kBusy,
+
+	// Nothing was ready within the timeout
+	kTimeout,
+
+	kInvalidParam,
+	kUnsupported,
+	kNotInitialized,
+
+	// The device won't open another encode session, as consumer GPUs do past a few
+	kSessionLimit,
+
+	kDeviceError
+};
+
+const char* EncoderStatusName(EncoderStatus status);
+
+enum class RateControl
+{
+	kConstantQp,
+	kCbr,
+	kVbr
+};
+
+const char* RateControlName(RateControl rate_control);
+
+enum class EncoderPreset
+{
+	kLowLatencyHighQuality,
+	kLowLatencyHighPerformance,
+	kHighQuality,
+	kHighPerformance,
+	kLossless
+};
+
+const char* EncoderPresetName(EncoderPreset preset);
+
+// Parses a name EncoderPresetName returns, returning false for anything else
+bool ParseEncoderPreset(const std::string& name, EncoderPreset* preset);
+
+struct EncoderConfig
+{
+	int width;
+	int height;
+	int fps;
+
+	// The average bitrate for kCbr and kVbr, and the peak for kVbr, 0 meaning the average
+	int bitrate_bps;
+	int max_bitrate_bps;
+
+	RateControl rate_control;
+
+	// The quantizer for kConstantQp, 0 to 51 as in H.264
+	int qp;
+
+	// Frames from one IDR to the next, or 0 for only the first and those asked for
+	int gop_length;
+
+	EncoderPreset preset;
+	bool adaptive_quantization;
+
+	// Frames that may be submitted before the oldest is retrieved
+	int queue_depth;
+
+	// The largest size Reconfigure may change to without reinitializing, 0 meaning the size
+	// initialized with
+	int max_width;
+	int max_height;
+
+	EncoderConfig() :
+		width(0),
+		height(0),
+		fps(60),
+		bitrate_bps(5000000),
+		max_bitrate_bps(0),
+		rate_control(RateControl::kCbr),
+		qp(26),
+		gop_length(0),
+		preset(EncoderPreset::kLowLatencyHighQuality),
+		adaptive_quantization(false),
+		queue_depth(4),
+		max_width(0),
+		max_height(0)
+	{
+	}
+};
+
+struct EncoderCaps
+{
+	bool hardware;
+	int max_width;
+	int max_height;
+
+	// The largest EncoderConfig::queue_depth the backend accepts
+	int max_queue_depth;
+
+	// Frames kept to predict from, so how many frames after the last one a peer decoded
+	// InvalidateFrame can still recover to it
+	int max_references;
+};
+
+struct EncodeParams
+{
+	// Carried through to the EncodedFrame
+	int64_t timestamp_us;
+
+	bool force_idr;
+
+	// What the frame was rendered for, such as the input pose, which backends ignore and
+	// EncodePipeline records with the bitstream
+	int64_t prediction_timestamp;
+	std::string metadata;
+
+	EncodeParams() : timestamp_us(0), force_idr(false), prediction_timestamp(-1) {}
+};
+
+struct EncodedFrame
+{
+	std::vector<uint8_t> data;
+	int64_t timestamp_us;
+
+	// The order the frame was submitted in, from 0
+	uint32_t frame_number;
+
+	bool keyframe;
+	int width;
+	int height;
+
+	// The frame's average quantizer, or -1 if the backend doesn't say
+	int qp;
+
+	EncodedFrame() : timestamp_us(0), frame_number(0), keyframe(false), width(0), height(0), qp(-1) {}
+};
+
+/// <summary>
+/// An H.264-style encoder that frames are submitted to and retrieved from in order
+/// </summary>
+/// <remarks>
+/// Submit queues a frame and returns as soon as the backend has taken it, and Retrieve waits for
+/// the oldest submitted frame's bitstream. Up to EncoderConfig::queue_depth frames may be in
+/// flight, so a caller can submit the next frame while the last is still encoding. Submit and
+/// Retrieve may be called from different threads, but each only from one at a time.
+/// </remarks>
+class EncoderBackend
+{
+public:
+	virtual ~EncoderBackend() {}
+
+	virtual const char* name() const = 0;
+
+	virtual EncoderCaps caps() const = 0;
+
+	virtual EncoderStatus Initialize(const EncoderConfig& config) = 0;
+
+	// Drops any frames in flight and releases the session
+	virtual void Shutdown() = 0;
+
+	// Changes the bitrate, framerate, rate control or resolution of the running session, from the
+	// thread that submits. Frames in flight are unaffected, and an IDR is only forced when the
+	// resolution changes. Returns kUnsupported for anything the backend needs Initialize for, like
+	// another queue depth, a size beyond max_width and max_height, or on most backends another
+	// preset.
+	virtual EncoderStatus Reconfigure(const EncoderConfig& config) = 0;
+
+	virtual EncoderStatus Submit(const I420Frame& frame, const EncodeParams& params) = 0;
+
+	// Stops the frame submitted with |timestamp_us| being predicted from, because a peer lost it
+	// or something that depends on it, from the thread that submits. Frames after it predict from
+	// the newest frame still valid, or are IDRs if there's none. Returns kInvalidParam if the
+	// backend knows the frame is no longer a reference.
+	virtual EncoderStatus InvalidateFrame(int64_t timestamp_us) = 0;
+
+	// Waits up to |timeout_ms| for the oldest frame in flight, or as long as it takes if negative.
+	// Anything but kOk or kTimeout means the frame was lost, and the next call waits for the one
+	// after it.
+	virtual EncoderStatus Retrieve(EncodedFrame* frame, int timeout_ms) = 0;
+
+	// The number of frames submitted and not yet retrieved
+	virtual size_t pending() const = 0;
+
+	virtual const EncoderConfig& config() const = 0;
+
+	// Submits |frame| and waits for its bitstream, for callers that don't pipeline
+	EncoderStatus Encode(const I420Frame& frame, const EncodeParams& params, EncodedFrame* encoded);
+};
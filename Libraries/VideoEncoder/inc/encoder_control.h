@@ -0,0 +1,102 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "encoder_backend.h"
+
+/// <summary>
+/// Carries bitrate, framerate, resolution and profile changes from whatever decides them to the
+/// thread that encodes
+/// </summary>
+/// <remarks>
+/// Changes can be asked for from any thread, and the latest of each wins. The encoding thread
+/// calls Apply between frames, which reconfigures the session in place when the backend can,
+/// so only a resolution or preset change costs an IDR, and reinitializes it when it can't.
+/// </remarks>
+class EncoderControl
+{
+public:
+	// The data channel message a peer asks for video targets with, whose body is
+	// "bitrate_bps,fps,width,height", trailing values optional and 0 leaving a target as it is
+	static const char* const kMessageType;
+
+	struct Targets
+	{
+		int bitrate_bps;
+		int fps;
+		int width;
+		int height;
+	};
+
+	struct Stats
+	{
+		// Calls to Apply that changed something
+		uint64_t applied;
+
+		// Of those, the ones the backend couldn't make in place
+		uint64_t reinitialized;
+
+		// Changes the backend rejected, which are dropped
+		uint64_t failed;
+	};
+
+	EncoderControl();
+
+	// Parses a kMessageType message's body, returning false if it isn't up to four numbers or
+	// gives only one of the width and height
+	static bool ParseTargets(const char* body, size_t size, Targets* targets);
+
+	// Changes the average bitrate, and the peak for VBR, 0 meaning the average
+	void SetBitrate(int bitrate_bps, int max_bitrate_bps = 0);
+
+	void SetFramerate(int fps);
+
+	// Whether a frame produced at |now_us| should be sent, for producers that render faster
+	// than the framerate asked for. Frames are let through at that rate on average, so 60fps
+	// content asked for at 45 keeps three frames in four.
+	bool AdmitFrame(int64_t now_us);
+
+	// Asks for frames of this size, which whoever produces them can read with resolution
+	void SetResolution(int width, int height);
+
+	// The size last asked for, returning false if none was
+	bool resolution(int* width, int* height) const;
+
+	// Changing the preset reinitializes the session on most backends
+	void SetPreset(EncoderPreset preset);
+
+	void SetAdaptiveQuantization(bool enabled);
+
+	// Whether there are changes Apply hasn't made yet
+	bool pending() const;
+
+	/// <summary>
+	/// Applies the changes asked for since the last call to |encoder|
+	/// </summary>
+	/// <remarks>
+	/// |width| and |height| are the size of the next frame, if known, which the encoder is
+	/// resized to whatever was asked for. Reinitializing drops frames in flight, so when the
+	/// backend can't make a change in place and has frames in flight, this returns kBusy and
+	/// keeps the changes for the next call. Returns kOk when there was nothing to do.
+	/// </remarks>
+	EncoderStatus Apply(EncoderBackend* encoder, int width = 0, int height = 0);
+
+	Stats stats() const;
+
+private:
+	mutable std::mutex lock_;
+	bool pending_;
+	int bitrate_bps_;
+	int max_bitrate_bps_;
+	int fps_;
+	int64_t next_frame_us_;
+	int width_;
+	int height_;
+	bool preset_set_;
+	EncoderPreset preset_;
+	bool adaptive_quantization_set_;
+	bool adaptive_quantization_;
+	Stats stats_;
+};
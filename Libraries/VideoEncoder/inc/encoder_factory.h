@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "encoder_backend.h"
+#include "nvEncodeAPI.h"
+
+enum class EncoderBackendType
+{
+	// NVENC if the driver loads, and OpenH264 otherwise
+	kAuto,
+
+	kNvenc,
+
+	// OpenH264
+	kSoftware
+};
+
+const char* EncoderBackendTypeName(EncoderBackendType type);
+
+// Parses "auto", "nvenc" or "software", returning false for anything else
+bool ParseEncoderBackendType(const std::string& name, EncoderBackendType* type);
+
+/// <summary>
+/// Creates an uninitialized encoder backend of |type|
+/// </summary>
+/// <remarks>
+/// NVENC sessions are opened on |device|, of |device_type|. Returns null if there's no device or
+/// driver for kNvenc, or no OpenH264 library for kSoftware, or neither for kAuto.
+/// </remarks>
+std::unique_ptr<EncoderBackend> CreateEncoderBackend(
+	EncoderBackendType type,
+	void* device = nullptr,
+	NV_ENC_DEVICE_TYPE device_type = NV_ENC_DEVICE_TYPE_DIRECTX);
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+#include "encoder_backend.h"
+
+/// <summary>
+/// Hands peers encoders, within the hardware encode sessions the device allows
+/// </summary>
+/// <remarks>
+/// Consumer NVIDIA GPUs refuse encode sessions past a few, counted across every process. The
+/// pool counts the hardware sessions it has open, and learns the device's limit the first time
+/// opening one fails with kSessionLimit, so later peers don't pay for a failed attempt. Peers
+/// that ask with the same share key are watching the same stream, and share one session
+/// whatever the limit. Beyond the limit a peer falls back to software, and can acquire again
+/// once CanUpgrade says a hardware session is free.
+///
+/// Sessions hold the references their stream predicts from, so the pool doesn't time slice one
+/// between different streams, which would cost an IDR at every switch.
+///
+/// Without factories the pool only does the accounting, for encoders created elsewhere such as
+/// webrtc's. It relies on Options::max_hardware_sessions for the limit, or learns it when told
+/// with Downgrade that the device refused a session. Thread safe.
+/// </remarks>
+class EncoderSessionPool
+{
+public:
+	typedef std::function<std::unique_ptr<EncoderBackend>()> Factory;
+
+	struct Options
+	{
+		// Hardware sessions to open at most, or 0 to find out from the device
+		int max_hardware_sessions;
+
+		// Whether a peer that can't have hardware gets software, rather than nothing
+		bool software_fallback;
+
+		Options() : max_hardware_sessions(0), software_fallback(true) {}
+	};
+
+	/// <summary>
+	/// The encoder a peer was given
+	/// </summary>
+	struct Lease
+	{
+		// Initialized with the config the session was first acquired with, or null when only
+		// accounting or if the peer was refused
+		std::shared_ptr<EncoderBackend> encoder;
+
+		bool hardware;
+
+		// Whether another peer had the session first
+		bool shared;
+
+		// kSessionLimit if the peer was refused, or why its encoder wouldn't initialize
+		EncoderStatus status;
+
+		Lease() : hardware(false), shared(false), status(EncoderStatus::kOk) {}
+	};
+
+	struct Utilization
+	{
+		int hardware_sessions;
+		int software_sessions;
+
+		// The most hardware sessions there can be, as configured or learned, or 0 while unknown
+		int hardware_limit;
+
+		// Peers holding a lease, and of those, the ones sharing a session another peer opened
+		int peers;
+		int shared_peers;
+
+		// Peers given software because hardware was full, and peers refused altogether
+		uint64_t fallbacks;
+		uint64_t refused;
+
+		// Times the device refused a session
+		uint64_t limit_reached;
+
+		// The fraction of the hardware limit in use, or 0 while it's unknown
+		double hardware_utilization() const;
+	};
+
+	EncoderSessionPool(const Factory& hardware, const Factory& software, const Options& options = Options());
+
+	~EncoderSessionPool();
+
+	/// <summary>
+	/// Gives |peer_id| an encoder for a stream of |config|, releasing any it already has
+	/// </summary>
+	/// <remarks>
+	/// A peer asking with the |share_key| of a session already open joins it, and the session
+	/// keeps the config it was opened with. Otherwise a hardware session is opened if there's
+	/// room, and a software one if not.
+	/// </remarks>
+	Lease Acquire(int peer_id, const EncoderConfig& config, const std::string& share_key = std::string());
+
+	// Releases |peer_id|'s lease, shutting its session down once no peer shares it
+	void Release(int peer_id);
+
+	// Counts |peer_id|'s hardware session as software, for an encoder created elsewhere whose
+	// session the device refused, and learns the limit as the hardware sessions still open
+	void Downgrade(int peer_id);
+
+	// Whether |peer_id| is on software and a hardware session is free for it to acquire again
+	bool CanUpgrade(int peer_id) const;
+
+	Utilization utilization() const;
+
+private:
+	struct Session
+	{
+		std::shared_ptr<EncoderBackend> encoder;
+		bool hardware;
+		std::string share_key;
+		int peers;
+	};
+
+	// Whether another hardware session may be tried
+	bool HardwareAvailable() const;
+
+	// Opens a session on hardware if it can, and on software if not, or returns null
+	std::shared_ptr<Session> Open(const EncoderConfig& config, EncoderStatus* status);
+
+	void ReleaseLocked(int peer_id);
+
+	Factory hardware_;
+	Factory software_;
+	Options options_;
+
+	mutable std::mutex lock_;
+	std::map<int, std::shared_ptr<Session>> peers_;
+	std::map<std::string, std::shared_ptr<Session>> shared_;
+	int hardware_sessions_;
+	int software_sessions_;
+
+	// The most sessions the device has allowed, once it's refused one, or 0
+	int learned_limit_;
+
+	uint64_t fallbacks_;
+	uint64_t refused_;
+	uint64_t limit_reached_;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "content_adapter.h"
+#include "encoder_backend.h"
+#include "frame_source.h"
+#include "quality_metrics.h"
+
+/// <summary>
+/// Encodes the same frames with every combination of a set of encoder parameters, and measures
+/// the rate, speed and quality of each
+/// </summary>
+/// <remarks>
+/// Nothing is rendered or shown, so a sweep runs wherever its backend does, which for OpenH264
+/// is anywhere. Frames come from a FrameSource, which is rewound for each config, so every config
+/// sees the same frames. Output is decoded with OpenH264 and scored against the frames that were
+/// encoded; output it can't decode is only measured for rate and speed.
+///
+/// Frames are encoded one at a time, so encode_ms is each frame's latency rather than what a
+/// pipeline would sustain. A content-adaptive sweep lets a ContentAdapter change each config's
+/// preset, adaptive quantization and bitrate as the frames change, the config being what it
+/// starts from and the bitrate what it shares out.
+/// </remarks>
+class EncoderSweep
+{
+public:
+	// Creates an uninitialized backend, for each config
+	typedef std::function<std::unique_ptr<EncoderBackend>()> Factory;
+
+	// The score rate-distortion curves are compared at
+	enum class Distortion
+	{
+		kPsnrY,
+		kSsimY
+	};
+
+	struct Options
+	{
+		// The rest of each config, whose size and framerate are taken from the source
+		EncoderConfig base;
+
+		// The values swept, each config taking one of each, and only base's if left as they are
+		std::vector<int> bitrates_bps;
+		std::vector<EncoderPreset> presets;
+		std::vector<int> gop_lengths;
+		std::vector<bool> adaptive_quantization;
+
+		// Frames encoded with each config, or 0 for as many as the source has
+		int frames;
+
+		// How decoded frames are scored
+		QualityMeter::Options quality;
+
+		// Whether to adapt each config to the content, and how
+		bool content_adaptive;
+		ContentAdapter::Options content;
+
+		Options();
+	};
+
+	struct Result
+	{
+		EncoderConfig config;
+		std::string backend;
+
+		// Why the backend wouldn't initialize or stopped encoding, if it did
+		EncoderStatus status;
+
+		int frames;
+		int keyframes;
+		uint64_t bytes;
+
+		// Whether the config was adapted to the content, and how many times its class changed
+		bool content_adaptive;
+		int content_switches;
+
+		// What the frames came to at the config's framerate
+		double bitrate_bps;
+
+		// The mean of the frames' quantizers, or -1 if the backend doesn't say
+		double average_qp;
+
+		// The mean and longest time a frame took to encode
+		double encode_ms;
+		double max_encode_ms;
+
+		// Whether the frames were decoded and scored, and if so their mean scores and the worst
+		// frame's luma PSNR
+		bool measured;
+		QualityScores quality;
+		double min_psnr_y;
+
+		Result();
+	};
+
+	EncoderSweep(FrameSource* source, const Factory& factory, const Options& options = Options());
+
+	// Every config the options describe, in the order they're run
+	std::vector<EncoderConfig> Configs() const;
+
+	// Encodes the source's frames from the first with |config|
+	Result Run(const EncoderConfig& config);
+
+	// Runs every config, writing each result to |csv| as it's done if it isn't null
+	std::vector<Result> RunAll(std::ostream* csv = nullptr);
+
+	static void WriteCsvHeader(std::ostream& csv);
+
+	static void WriteCsvRow(std::ostream& csv, const Result& result);
+
+	// Sets |savings| to the fraction of |reference|'s bitrate |test| saves at equal |distortion|,
+	// or costs if negative, as the Bjontegaard delta rate does but with the rate-distortion curves
+	// interpolated linearly. Only the range of scores both cover is compared; returns false if
+	// there's none. Each is one curve, such as a run of configs differing only in bitrate.
+	static bool BitrateSavings(
+		const std::vector<Result>& reference,
+		const std::vector<Result>& test,
+		Distortion distortion,
+		double* savings);
+
+private:
+	FrameSource* source_;
+	Factory factory_;
+	Options options_;
+	QualityMeter meter_;
+};
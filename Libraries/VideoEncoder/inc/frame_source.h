@@ -0,0 +1,145 @@
+#pragma once
+
+#include <fstream>
+#include <iosfwd>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "video_frame.h"
+
+/// <summary>
+/// Frames to encode without rendering them, the same ones each time it's rewound
+/// </summary>
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	virtual int width() const = 0;
+
+	virtual int height() const = 0;
+
+	virtual int fps() const = 0;
+
+	// Reads the next frame into |frame|, returning false after the last
+	virtual bool Read(I420Frame* frame) = 0;
+
+	// Starts again from the first frame
+	virtual void Rewind() = 0;
+};
+
+enum class SyntheticPattern
+{
+	// A gradient with a bright square moving across it, so most blocks match the last frame
+	kMovingSquare,
+
+	// The gradient scrolling under the square too, so no block does
+	kScrolling,
+
+	// Noise that's different every frame, which nothing predicts
+	kNoise,
+
+	// Dark glyphs on a flat page, scrolled a line every half second, like a document or a
+	// CAD drawing
+	kText
+};
+
+const char* SyntheticPatternName(SyntheticPattern pattern);
+
+// Parses a name SyntheticPatternName returns, returning false for anything else
+bool ParseSyntheticPattern(const std::string& name, SyntheticPattern* pattern);
+
+/// <summary>
+/// Generates |frames| frames of a pattern, which depend only on the pattern, size and seed
+/// </summary>
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	SyntheticFrameSource(int width, int height, int frames, SyntheticPattern pattern, int fps = 60, uint32_t seed = 1);
+
+	virtual int width() const override;
+
+	virtual int height() const override;
+
+	virtual int fps() const override;
+
+	virtual bool Read(I420Frame* frame) override;
+
+	virtual void Rewind() override;
+
+private:
+	int width_;
+	int height_;
+	int frames_;
+	SyntheticPattern pattern_;
+	int fps_;
+	uint32_t seed_;
+	int index_;
+};
+
+/// <summary>
+/// Plays other sources one after another, as scenes of a longer sequence
+/// </summary>
+/// <remarks>
+/// Every scene must have the first's size; its framerate is the sequence's.
+/// </remarks>
+class SequenceFrameSource : public FrameSource
+{
+public:
+	explicit SequenceFrameSource(std::vector<std::unique_ptr<FrameSource>> scenes);
+
+	virtual int width() const override;
+
+	virtual int height() const override;
+
+	virtual int fps() const override;
+
+	virtual bool Read(I420Frame* frame) override;
+
+	virtual void Rewind() override;
+
+private:
+	std::vector<std::unique_ptr<FrameSource>> scenes_;
+	size_t scene_;
+};
+
+/// <summary>
+/// Reads recorded frames from a YUV4MPEG2 file, as ffmpeg writes with -f yuv4mpegpipe
+/// </summary>
+/// <remarks>
+/// Only 4:2:0 files are read. The framerate is rounded to whole frames per second.
+/// </remarks>
+class Y4mFrameSource : public FrameSource
+{
+public:
+	Y4mFrameSource();
+
+	// Opens |path|, returning false if it can't be read or isn't 4:2:0 YUV4MPEG2
+	bool Open(const std::string& path);
+
+	// Reads from |stream|, which must be seekable and outlive the source or the next Open
+	bool Open(std::istream* stream);
+
+	virtual int width() const override;
+
+	virtual int height() const override;
+
+	virtual int fps() const override;
+
+	virtual bool Read(I420Frame* frame) override;
+
+	virtual void Rewind() override;
+
+private:
+	// Parses the stream header, leaving the stream at the first frame
+	bool ReadHeader();
+
+	std::unique_ptr<std::ifstream> file_;
+	std::istream* in_;
+	std::streampos first_frame_;
+	int width_;
+	int height_;
+	int fps_;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "encoder_backend.h"
+
+/// <summary>
+/// Recovers a peer from lost frames by invalidating the references that depend on them, rather
+/// than with an IDR
+/// </summary>
+/// <remarks>
+/// A peer that can't decode a frame reports the last one it could, and Apply then invalidates
+/// every frame sent after that one before the next is submitted. The encoder predicts from the
+/// last good frame again, so the peer carries on from what it has at about the cost of a P frame.
+/// When the last good frame has left the encoder's references, an IDR came after it, or the
+/// backend won't invalidate, Apply forces an IDR instead.
+///
+/// Frames are named by the timestamps they were submitted with, which must increase. Reports can
+/// be made from any thread, Apply and OnSubmitted are called from the thread that submits, and
+/// OnEncoded from the one that retrieves.
+/// </remarks>
+class LossRecovery
+{
+public:
+	// The data channel message a peer reports loss with, whose body is the timestamp of the last
+	// frame it decoded, or -1 if it has nothing to predict from
+	static const char* const kMessageType;
+
+	struct Options
+	{
+		// Frames sent after a recovery during which a report it already covers is taken to have
+		// crossed it in flight, and ignored. After that the recovery was lost too, and it's redone.
+		int grace_frames;
+
+		Options() : grace_frames(30) {}
+	};
+
+	struct Stats
+	{
+		// Reports and keyframe requests received
+		uint64_t reports;
+
+		// Reports recovered from by invalidating references
+		uint64_t recovered;
+
+		// Frames invalidated doing so
+		uint64_t invalidated;
+
+		// IDRs forced, for reports that couldn't be recovered from or keyframe requests
+		uint64_t keyframes;
+
+		// Reports already covered by a recovery in flight
+		uint64_t ignored;
+	};
+
+	explicit LossRecovery(const Options& options = Options());
+
+	// Parses a kMessageType message's body, returning false if it isn't a timestamp
+	static bool ParseReport(const char* body, size_t size, int64_t* last_good_us);
+
+	// The peer decoded the frame sent with |timestamp_us| and lost one after it, or has nothing
+	// to predict from if |timestamp_us| is negative
+	void OnLastGoodFrame(int64_t timestamp_us);
+
+	// The frame sent with |timestamp_us| won't arrive, eg. one NACKed too late to retransmit
+	void OnFrameLost(int64_t timestamp_us);
+
+	// Asks for an IDR, as for a PLI or FIR
+	void RequestKeyframe();
+
+	// Acts on the reports made since the last call, before the frame submitted with |params|,
+	// by invalidating frames in |encoder| or setting params->force_idr
+	void Apply(EncoderBackend* encoder, EncodeParams* params);
+
+	// Records a frame the encoder took, with the params it was submitted with
+	void OnSubmitted(const EncodeParams& params);
+
+	// Records a retrieved frame, to learn of the IDRs the encoder chose itself
+	void OnEncoded(const EncodedFrame& frame);
+
+	Stats stats() const;
+
+private:
+	struct Sent
+	{
+		int64_t timestamp_us;
+		bool keyframe;
+		bool invalidated;
+	};
+
+	// Invalidates the frames sent after |last_good_us|, returning false if only an IDR will do
+	bool Recover(EncoderBackend* encoder, int64_t last_good_us);
+
+	// Queues a report of |last_good_us|, keeping the oldest if one is already queued
+	void QueueReport(int64_t last_good_us);
+
+	std::deque<Sent>::iterator Find(int64_t timestamp_us);
+
+	Options options_;
+	mutable std::mutex lock_;
+
+	// The frames sent, oldest first, from the last IDR or as many as could be references
+	std::deque<Sent> sent_;
+
+	bool keyframe_requested_;
+	bool report_pending_;
+	int64_t report_us_;
+
+	// What the last recovery recovered to, its IDR's timestamp if it sent one, or -1 if there
+	// hasn't been one, and the frames sent since
+	int64_t recovered_to_us_;
+	int frames_since_recovery_;
+
+	Stats stats_;
+};
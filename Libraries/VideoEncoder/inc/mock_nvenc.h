@@ -0,0 +1,177 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvEncodeAPI.h"
+
+/// <summary>
+/// A scriptable stand in for the NVENC driver's function table, for testing without a GPU
+/// </summary>
+/// <remarks>
+/// functions() is filled in the way NvEncodeAPICreateInstance fills the driver's, so anything
+/// written against NV_ENCODE_API_FUNCTION_LIST can be pointed at it. Sessions must be opened on
+/// device(). The functions an encoder needs to open a session, encode system memory frames,
+/// reconfigure, invalidate reference frames and encode asynchronously are implemented, and the
+/// rest are left null.
+///
+/// Like the hardware, pictures are encoded one at a time on each of a few engines shared by
+/// every session, each taking Options::encode_latency_us, and nvEncLockBitstream waits for its
+/// picture, or returns NV_ENC_ERR_LOCK_BUSY if asked not to. Bitstreams are Annex B NAL units of
+/// the size the configured bitrate implies, with parameter sets before each IDR. Any function
+/// can be made to fail with FailNext, and a picture whose nvEncLockBitstream fails is lost.
+///
+/// An asynchronous session's pictures must each carry a completion event registered with
+/// nvEncRegisterAsyncEvent, which a thread of the mock's own sets with CompletionEvent::Signal
+/// once the picture is encoded. Locking a picture's bitstream before then is counted in
+/// Stats::early_locks, as the driver expects the event to be waited on first. Thread safe.
+/// </remarks>
+class MockNvenc
+{
+public:
+	struct Options
+	{
+		// How long each picture takes to encode
+		int64_t encode_latency_us;
+
+		// Engines encoding pictures at once, across all sessions
+		int engines;
+
+		// Pictures a session may have submitted and not yet unlocked, beyond which
+		// nvEncEncodePicture returns NV_ENC_ERR_ENCODER_BUSY
+		uint32_t max_in_flight;
+
+		// Sessions that may be open at once, beyond which opening one returns
+		// NV_ENC_ERR_OUT_OF_MEMORY as consumer GPUs do, or 0 for no limit
+		int max_sessions;
+
+		Options() : encode_latency_us(0), engines(1), max_in_flight(16), max_sessions(0) {}
+	};
+
+	struct Stats
+	{
+		int sessions_open;
+		int peak_sessions;
+		uint64_t pictures;
+		uint64_t keyframes;
+		uint64_t busy;
+		uint64_t reconfigures;
+		uint64_t invalidations;
+		uint64_t failures;
+
+		// Completion events registered, across sessions
+		int async_events;
+
+		// Bitstreams of asynchronous sessions locked before their event was set
+		uint64_t early_locks;
+	};
+
+	/// <summary>
+	/// A picture the mock encoded, for tests to inspect
+	/// </summary>
+	struct Picture
+	{
+		int session;
+		uint32_t frame_index;
+		uint64_t timestamp;
+		bool keyframe;
+		uint32_t width;
+		uint32_t height;
+		uint32_t size;
+	};
+
+	explicit MockNvenc(const Options& options = Options());
+
+	~MockNvenc();
+
+	const NV_ENCODE_API_FUNCTION_LIST& functions() const;
+
+	// The device to open sessions on
+	void* device();
+
+	// Changes the options, for pictures submitted from now on
+	void set_options(const Options& options);
+
+	// Makes the next |count| calls of |function|, named as in the function table, eg.
+	// "nvEncEncodePicture", return |status| without doing anything
+	void FailNext(const std::string& function, NVENCSTATUS status, int count = 1);
+
+	Stats stats() const;
+
+	std::vector<Picture> pictures() const;
+
+	// Timestamps passed to nvEncInvalidateRefFrames, in order
+	std::vector<uint64_t> invalidated() const;
+
+private:
+	struct Session;
+	struct InputBuffer;
+	struct Bitstream;
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Returns true, and the status to fail with, if a failure of |function| was scripted
+	bool Fail(const char* function, NVENCSTATUS* status);
+
+	NVENCSTATUS OpenSession(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS* params, void** encoder);
+	NVENCSTATUS DestroySession(Session* session);
+	NVENCSTATUS InitializeSession(Session* session, const NV_ENC_INITIALIZE_PARAMS* params);
+	NVENCSTATUS EncodePicture(Session* session, NV_ENC_PIC_PARAMS* params);
+	NVENCSTATUS LockBitstream(Session* session, NV_ENC_LOCK_BITSTREAM* params);
+	NVENCSTATUS UnlockBitstream(Session* session, Bitstream* bitstream);
+	NVENCSTATUS Reconfigure(Session* session, NV_ENC_RECONFIGURE_PARAMS* params);
+	NVENCSTATUS InvalidateRefFrames(Session* session, uint64_t timestamp);
+	NVENCSTATUS RegisterEvent(Session* session, NV_ENC_EVENT_PARAMS* params);
+	NVENCSTATUS UnregisterEvent(Session* session, NV_ENC_EVENT_PARAMS* params);
+
+	// Drops the signals waiting for |session|'s events, or just for |event| if it isn't null
+	void CancelSignals(Session* session, void* event);
+
+	// Sets each completion event once its picture is encoded, until the mock is destroyed
+	void SignalLoop();
+
+	// The function table's entries, which find the mock through the session
+	static NVENCSTATUS NVENCAPI OpenEncodeSessionEx(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS* params, void** encoder);
+	static NVENCSTATUS NVENCAPI GetEncodePresetConfig(void* encoder, GUID encode_guid, GUID preset_guid, NV_ENC_PRESET_CONFIG* config);
+	static NVENCSTATUS NVENCAPI InitializeEncoder(void* encoder, NV_ENC_INITIALIZE_PARAMS* params);
+	static NVENCSTATUS NVENCAPI CreateInputBuffer(void* encoder, NV_ENC_CREATE_INPUT_BUFFER* params);
+	static NVENCSTATUS NVENCAPI DestroyInputBuffer(void* encoder, NV_ENC_INPUT_PTR buffer);
+	static NVENCSTATUS NVENCAPI CreateBitstreamBuffer(void* encoder, NV_ENC_CREATE_BITSTREAM_BUFFER* params);
+	static NVENCSTATUS NVENCAPI DestroyBitstreamBuffer(void* encoder, NV_ENC_OUTPUT_PTR buffer);
+	static NVENCSTATUS NVENCAPI LockInputBuffer(void* encoder, NV_ENC_LOCK_INPUT_BUFFER* params);
+	static NVENCSTATUS NVENCAPI UnlockInputBuffer(void* encoder, NV_ENC_INPUT_PTR buffer);
+	static NVENCSTATUS NVENCAPI EncodePictureEntry(void* encoder, NV_ENC_PIC_PARAMS* params);
+	static NVENCSTATUS NVENCAPI LockBitstreamEntry(void* encoder, NV_ENC_LOCK_BITSTREAM* params);
+	static NVENCSTATUS NVENCAPI UnlockBitstreamEntry(void* encoder, NV_ENC_OUTPUT_PTR buffer);
+	static NVENCSTATUS NVENCAPI DestroyEncoder(void* encoder);
+	static NVENCSTATUS NVENCAPI ReconfigureEncoder(void* encoder, NV_ENC_RECONFIGURE_PARAMS* params);
+	static NVENCSTATUS NVENCAPI InvalidateRefFramesEntry(void* encoder, uint64_t timestamp);
+	static NVENCSTATUS NVENCAPI RegisterAsyncEvent(void* encoder, NV_ENC_EVENT_PARAMS* params);
+	static NVENCSTATUS NVENCAPI UnregisterAsyncEvent(void* encoder, NV_ENC_EVENT_PARAMS* params);
+
+	NV_ENCODE_API_FUNCTION_LIST functions_;
+
+	mutable std::mutex lock_;
+	Options options_;
+	std::vector<Clock::time_point> engines_free_;
+	std::map<std::string, std::pair<NVENCSTATUS, int>> failures_;
+	std::set<Session*> sessions_;
+	int next_session_;
+	Stats stats_;
+	std::vector<Picture> pictures_;
+	std::vector<uint64_t> invalidated_;
+
+	// Completion events to set, by when their picture is encoded, and the thread setting them,
+	// started by the first asynchronous picture
+	std::multimap<Clock::time_point, std::pair<Session*, void*>> signals_;
+	std::condition_variable signals_cv_;
+	std::thread signaler_;
+	bool stopping_;
+};
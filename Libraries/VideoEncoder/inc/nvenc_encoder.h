@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "completion_event.h"
+#include "encoder_backend.h"
+#include "nvEncodeAPI.h"
+
+/// <summary>
+/// Encodes on an NVIDIA GPU through an NVENC function table
+/// </summary>
+/// <remarks>
+/// The table is usually the driver's, from LoadFunctions, but anything that fills one in the
+/// same way works, which is how MockNvenc stands in for it in tests. Frames are copied into
+/// system memory input buffers, one per queue slot, and each slot has its own bitstream buffer,
+/// so up to EncoderConfig::queue_depth frames are encoding while the oldest is retrieved. Input
+/// buffers are allocated at the maximum size, so the session can be resized in place.
+///
+/// An asynchronous session also gives each slot a completion event, registered with the
+/// driver, and Retrieve waits on the oldest slot's event before locking its bitstream, rather
+/// than blocking in nvEncLockBitstream or polling it. Sessions are only asynchronous if the
+/// device says it can be, and the driver only supports it on Windows.
+/// </remarks>
+class NvencEncoder : public EncoderBackend
+{
+public:
+	// Loads the driver's function table, returning false if there's no NVIDIA driver
+	static bool LoadFunctions(NV_ENCODE_API_FUNCTION_LIST* functions);
+
+	// Maps a failed NVENC call to what it means for the caller
+	static EncoderStatus ToEncoderStatus(NVENCSTATUS status);
+
+	NvencEncoder(const NV_ENCODE_API_FUNCTION_LIST& functions,
+		void* device,
+		NV_ENC_DEVICE_TYPE device_type,
+		bool async = false);
+
+	virtual ~NvencEncoder();
+
+	virtual const char* name() const override;
+
+	virtual EncoderCaps caps() const override;
+
+	virtual EncoderStatus Initialize(const EncoderConfig& config) override;
+
+	virtual void Shutdown() override;
+
+	virtual EncoderStatus Reconfigure(const EncoderConfig& config) override;
+
+	virtual EncoderStatus Submit(const I420Frame& frame, const EncodeParams& params) override;
+
+	virtual EncoderStatus InvalidateFrame(int64_t timestamp_us) override;
+
+	virtual EncoderStatus Retrieve(EncodedFrame* frame, int timeout_ms) override;
+
+	virtual size_t pending() const override;
+
+	virtual const EncoderConfig& config() const override;
+
+	// The status of the last NVENC call that failed, for logging
+	NVENCSTATUS last_status() const;
+
+	// Whether the session was initialized in asynchronous mode
+	bool async() const;
+
+private:
+	struct Slot
+	{
+		NV_ENC_INPUT_PTR input;
+		NV_ENC_OUTPUT_PTR bitstream;
+
+		// Set by the driver once the slot's picture is encoded, in asynchronous mode
+		std::unique_ptr<CompletionEvent> event;
+
+		uint32_t frame_number;
+		int width;
+		int height;
+		int64_t timestamp_us;
+	};
+
+	// Records |status| if it's a failure, and returns what it maps to
+	EncoderStatus Check(NVENCSTATUS status);
+
+	bool IsValid(const EncoderConfig& config) const;
+
+	// Whether the device can encode asynchronously, assuming it can if the table can't say
+	bool SupportsAsync();
+
+	// Fills the session's configuration in from |config|, starting from its preset
+	EncoderStatus Configure(const EncoderConfig& config, NV_ENC_INITIALIZE_PARAMS* params, NV_ENC_CONFIG* encode_config);
+
+	NV_ENCODE_API_FUNCTION_LIST functions_;
+	void* device_;
+	NV_ENC_DEVICE_TYPE device_type_;
+	bool async_;
+	bool async_session_;
+	void* encoder_;
+	EncoderConfig config_;
+	NVENCSTATUS last_status_;
+	std::vector<Slot> slots_;
+
+	mutable std::mutex lock_;
+	std::condition_variable submitted_cv_;
+
+	// Frames submitted and retrieved so far, each a position in slots_ modulo its size
+	uint32_t submitted_;
+	uint32_t retrieved_;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "encoder_backend.h"
+#include "video_frame.h"
+
+class ISVCEncoder;
+class ISVCDecoder;
+struct TagEncParamExt;
+
+/// <summary>
+/// The entry points of Cisco's OpenH264 library
+/// </summary>
+struct OpenH264Functions
+{
+	int (*create_encoder)(ISVCEncoder** encoder);
+	void (*destroy_encoder)(ISVCEncoder* encoder);
+	long (*create_decoder)(ISVCDecoder** decoder);
+	void (*destroy_decoder)(ISVCDecoder* decoder);
+};
+
+/// <summary>
+/// Encodes H.264 in software with OpenH264, for machines without a hardware encoder
+/// </summary>
+/// <remarks>
+/// The API is the one WebRTC bundles, under third_party/openh264, but WebRTC's build only links
+/// the encoder it uses itself, so the library is loaded at runtime from Cisco's prebuilt binary,
+/// as NvencEncoder loads the NVIDIA driver. Its major version has to be the one WebRTC's headers
+/// declare, which LoadFunctions checks.
+///
+/// The stream is constrained baseline with a single slice, as webrtc's own H.264 encoder writes
+/// it. Frames are encoded on the submitting thread.
+///
+/// Long-term references let InvalidateFrame take the encoder back to a frame a peer has. OpenH264
+/// only marks a new one once the last is acknowledged, and it's acknowledged max_references
+/// frames later, so a peer can't lose one InvalidateFrame recovers to: LossRecovery doesn't
+/// invalidate further back than that, and forces an IDR instead.
+/// </remarks>
+class OpenH264Encoder : public EncoderBackend
+{
+public:
+	// Loads Cisco's OpenH264 library, returning false if it isn't there or is a version whose
+	// API isn't the one built against
+	static bool LoadFunctions(OpenH264Functions* functions);
+
+	explicit OpenH264Encoder(const OpenH264Functions& functions);
+
+	virtual ~OpenH264Encoder();
+
+	virtual const char* name() const override;
+
+	virtual EncoderCaps caps() const override;
+
+	virtual EncoderStatus Initialize(const EncoderConfig& config) override;
+
+	virtual void Shutdown() override;
+
+	virtual EncoderStatus Reconfigure(const EncoderConfig& config) override;
+
+	virtual EncoderStatus Submit(const I420Frame& frame, const EncodeParams& params) override;
+
+	virtual EncoderStatus InvalidateFrame(int64_t timestamp_us) override;
+
+	virtual EncoderStatus Retrieve(EncodedFrame* frame, int timeout_ms) override;
+
+	virtual size_t pending() const override;
+
+	virtual const EncoderConfig& config() const override;
+
+private:
+	bool IsValid(const EncoderConfig& config) const;
+
+	// Tracks the frame_num the frame submitted with |timestamp_us| was given, and acknowledges
+	// the long-term reference it pushes out of reach
+	void Sent(int64_t timestamp_us, bool keyframe);
+
+	// Fills the session's parameters in from |config|, starting from OpenH264's defaults
+	void Configure(const EncoderConfig& config, TagEncParamExt* params) const;
+
+	// A frame sent since the last IDR, by the frame_num in its slice header
+	struct Reference
+	{
+		int64_t timestamp_us;
+		int frame_num;
+	};
+
+	OpenH264Functions functions_;
+	ISVCEncoder* encoder_;
+	EncoderConfig config_;
+	uint32_t frame_number_;
+
+	// The newest frames since the last IDR, up to max_references of them
+	std::deque<Reference> references_;
+	int idr_count_;
+	int next_frame_num_;
+
+	// The last good frame the next one is predicted from, or -1
+	int64_t recover_to_us_;
+
+	mutable std::mutex lock_;
+	std::condition_variable ready_;
+	std::deque<EncodedFrame> output_;
+};
+
+/// <summary>
+/// Decodes H.264 with OpenH264, for measuring what an encoder's peers see
+/// </summary>
+class OpenH264Decoder
+{
+public:
+	// Loads the library itself, decoding nothing if it isn't there
+	OpenH264Decoder();
+
+	explicit OpenH264Decoder(const OpenH264Functions& functions);
+
+	~OpenH264Decoder();
+
+	// Decodes one frame of Annex B, returning false if it's corrupt, its reference is missing or
+	// it didn't complete a picture
+	bool Decode(const uint8_t* data, size_t size, I420Frame* frame);
+
+private:
+	void Create();
+
+	OpenH264Functions functions_;
+	ISVCDecoder* decoder_;
+};
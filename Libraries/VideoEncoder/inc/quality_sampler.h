@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+#include "encoder_backend.h"
+#include "quality_metrics.h"
+#include "video_frame.h"
+
+/// <summary>
+/// Scores one in every few frames of a live stream against what was encoded, so the quality
+/// sessions are getting can be watched
+/// </summary>
+/// <remarks>
+/// Every frame's bitstream has to be decoded, since the sampled ones predict from the rest, but
+/// the sampled frames are scored on a thread of the sampler's own, so neither the submitting nor
+/// the retrieving thread waits on a QualityMeter. When scoring falls behind, samples are
+/// skipped rather than queued. Frames are matched by their timestamps, which must increase.
+/// OnSubmitted is called from the thread that submits and OnEncoded from the one that
+/// retrieves, with every frame in order.
+/// </remarks>
+class QualitySampler
+{
+public:
+	// Decodes |frame| into |decoded|, returning false if it can't be decoded
+	typedef std::function<bool(const EncodedFrame& frame, I420Frame* decoded)> Decoder;
+
+	struct Options
+	{
+		// Scores one frame in this many
+		int interval;
+
+		// Samples decoded and waiting to be scored, past which more are skipped
+		size_t max_pending;
+
+		// One thread by default, so scoring doesn't compete with encoding
+		QualityMeter::Options meter;
+
+		Options() : interval(60), max_pending(2)
+		{
+			meter.threads = 1;
+		}
+	};
+
+	struct Stats
+	{
+		// Frames kept to be scored, and of those, the ones scored
+		uint64_t sampled;
+		uint64_t scored;
+
+		// Samples dropped because scoring had fallen behind, or whose frame wasn't encoded
+		uint64_t skipped;
+
+		// Frames the decoder couldn't decode
+		uint64_t undecodable;
+
+		QualityScores last;
+
+		// Means over the frames scored, and the worst frame's luma PSNR
+		QualityScores mean;
+		double min_psnr_y;
+	};
+
+	// Decodes with |decoder|, or with OpenH264 if it's empty
+	explicit QualitySampler(const Decoder& decoder = Decoder(), const Options& options = Options());
+
+	~QualitySampler();
+
+	// Keeps a copy of |frame| if it's to be scored
+	void OnSubmitted(const I420Frame& frame, const EncodeParams& params);
+
+	// Decodes |frame|, queueing it to be scored if it was kept
+	void OnEncoded(const EncodedFrame& frame);
+
+	// Waits for the queued samples to be scored
+	void Flush();
+
+	Stats stats() const;
+
+private:
+	struct Sample
+	{
+		int64_t timestamp_us;
+		I420Frame reference;
+		I420Frame decoded;
+	};
+
+	void ScoreLoop();
+
+	Decoder decoder_;
+	Options options_;
+	QualityMeter meter_;
+
+	// Counts frames submitted, on the submitting thread
+	uint64_t submitted_;
+
+	mutable std::mutex lock_;
+	std::condition_variable changed_;
+
+	// Frames kept and not yet encoded, oldest first
+	std::deque<std::unique_ptr<Sample>> kept_;
+
+	std::deque<std::unique_ptr<Sample>> pending_;
+	bool scoring_;
+	bool stopping_;
+	Stats stats_;
+
+	I420Frame decoded_;
+	std::thread thread_;
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encoder_backend.h"
+
+/// <summary>
+/// A frame read back from a stream recording, pointing into the recording's memory
+/// </summary>
+struct RecordedFrame
+{
+	// The H.264 bitstream, as the encoder produced it
+	const uint8_t* data;
+	size_t size;
+
+	// What was recorded with the frame, such as the input pose it was rendered for
+	const uint8_t* metadata;
+	size_t metadata_size;
+
+	int64_t timestamp_us;
+
+	// -1 if the frame had none
+	int64_t prediction_timestamp;
+
+	bool keyframe;
+	int width;
+	int height;
+
+	// -1 if the encoder didn't say
+	int qp;
+};
+
+/// <summary>
+/// Records a peer's encoded video, with what each frame was rendered for, to seek and replay
+/// later
+/// </summary>
+/// <remarks>
+/// A recording is a sequence of 4 KiB blocks, so it can be written with O_DIRECT or
+/// FILE_FLAG_NO_BUFFERING and mapped straight into memory to read:
+///
+///   block 0      header, rewritten on Close
+///   blocks 1..   one record per frame, back to back: a 40 byte record header, the bitstream,
+///                then the metadata
+///   after them   the frame index, 48 bytes a frame, then the keyframe index, 4 bytes a
+///                keyframe, written on Close
+///
+/// Everything is little endian. The header is "3DSR", a version byte and 3 reserved ones, then
+/// width, height and fps as uint32, a reserved uint32, and as uint64 the data offset, the data
+/// size, the frame index offset, the keyframe index offset, then the frame and keyframe counts
+/// as uint32. Each frame index entry is the record's offset as uint64 followed by a copy of its
+/// record header: "FRM1", bitstream and metadata sizes and flags (1 for a keyframe) as uint32,
+/// timestamp_us and prediction_timestamp as int64, width and height as uint16, qp as int8 and 3
+/// reserved bytes.
+///
+/// Write copies the frame into the current batch and returns; full batches are written on a
+/// thread of the recorder's own. When every batch is still being written, the frame is dropped,
+/// and so is every frame after it up to the next keyframe, so what's recorded stays decodable.
+/// A recording that wasn't closed has no index, but its records can still be read. Write may be
+/// called from one thread at a time, and the rest from any.
+/// </remarks>
+class StreamRecorder
+{
+public:
+	struct Options
+	{
+		// Bytes written at once, rounded up to whole blocks
+		size_t batch_bytes;
+
+		// Batches that may be waiting to be written, past which frames are dropped
+		size_t max_batches;
+
+		// Whether to bypass the OS cache, if the file system allows it
+		bool direct;
+
+		Options() : batch_bytes(1 << 20), max_batches(4), direct(true) {}
+	};
+
+	struct Stats
+	{
+		uint64_t frames;
+		uint64_t keyframes;
+
+		// Frames dropped because the disk was behind, or after a failed write
+		uint64_t dropped;
+
+		// Bytes of records written, excluding padding
+		uint64_t bytes;
+
+		uint64_t batches;
+		uint64_t write_errors;
+
+		// Whether the file is being written without the OS cache
+		bool direct;
+	};
+
+	static const size_t kBlockSize = 4096;
+
+	StreamRecorder();
+
+	~StreamRecorder();
+
+	// Starts a recording at |path| of video |width| by |height| at |fps|, replacing any file
+	// there, returning false if it can't be created
+	bool Open(const std::string& path, int width, int height, int fps, const Options& options = Options());
+
+	// Writes what's left and the index, returning false if anything couldn't be written
+	bool Close();
+
+	bool IsOpen() const;
+
+	// Records |frame|, rendered for |prediction_timestamp| with |metadata|, if a recording is open
+	void Write(const EncodedFrame& frame, int64_t prediction_timestamp = -1, const std::string& metadata = std::string());
+
+	Stats stats() const;
+
+private:
+	class File;
+	class Buffer;
+
+	struct Batch
+	{
+		std::unique_ptr<Buffer> buffer;
+		size_t size;
+		uint64_t offset;
+	};
+
+	void WriteLoop();
+
+	// Appends |size| bytes at |data| to the current batch, queueing it when it's full, with the
+	// lock held. Returns false if no batch was free.
+	bool Append(const uint8_t* data, size_t size);
+
+	// Queues the current batch and takes a free one, with the lock held
+	bool Rotate();
+
+	// Writes the last batch, then the index and header once every batch is written
+	bool Finish(std::unique_lock<std::mutex>& lock);
+
+	mutable std::mutex lock_;
+	std::condition_variable changed_;
+	std::unique_ptr<File> file_;
+	Options options_;
+	int width_;
+	int height_;
+	int fps_;
+
+	// The batch being filled, or null once closing
+	std::unique_ptr<Batch> current_;
+	std::deque<std::unique_ptr<Batch>> queued_;
+	std::vector<std::unique_ptr<Buffer>> free_;
+	bool writing_;
+	bool stopping_;
+
+	// Dropping frames until the next keyframe
+	bool dropping_;
+
+	// The frame index so far, and the keyframes in it
+	std::vector<uint8_t> index_;
+	std::vector<uint32_t> keyframes_;
+
+	// Kept between writes, so recording doesn't allocate per frame
+	std::vector<uint8_t> record_;
+	Stats stats_;
+	std::thread thread_;
+};
+
+/// <summary>
+/// Reads a recording StreamRecorder wrote, mapped into memory so seeking costs nothing
+/// </summary>
+/// <remarks>
+/// The index is read when the recording is opened. A recording that wasn't closed is indexed
+/// by walking its records up to the first incomplete one, and reports that it was recovered.
+/// Frames point into the mapping, so they're valid until the next Open or Close.
+/// </remarks>
+class StreamRecording
+{
+public:
+	StreamRecording();
+
+	~StreamRecording();
+
+	// Maps |path|, returning false if it can't be read or isn't a recording
+	bool Open(const std::string& path);
+
+	// Reads a recording in memory, which must outlive the reader or the next Open
+	bool Open(const uint8_t* data, size_t size);
+
+	void Close();
+
+	int width() const;
+
+	int height() const;
+
+	int fps() const;
+
+	size_t frames() const;
+
+	// Frame |index|, in the order they were recorded
+	const RecordedFrame& frame(size_t index) const;
+
+	// Indices of the keyframes, in order
+	const std::vector<uint32_t>& keyframes() const;
+
+	// The keyframe to start decoding from to show the frame at |timestamp_us|: the last one at
+	// or before it, or the first if there's none. Returns false for a recording without any.
+	bool Seek(int64_t timestamp_us, size_t* index) const;
+
+	// Whether the recording wasn't closed, and was indexed by reading its records
+	bool recovered() const;
+
+	// Writes the frames' bitstreams one after another, as a raw .h264 file holds them
+	bool WriteElementaryStream(std::ostream& out) const;
+
+private:
+	class Mapping;
+
+	bool Parse();
+
+	// Reads the record header at |offset|, returning false if there isn't a whole record there
+	bool ReadRecord(uint64_t offset, const uint8_t* header, RecordedFrame* frame) const;
+
+	std::unique_ptr<Mapping> mapping_;
+	const uint8_t* data_;
+	size_t size_;
+	int width_;
+	int height_;
+	int fps_;
+	bool recovered_;
+	std::vector<RecordedFrame> frames_;
+	std::vector<uint32_t> keyframes_;
+};
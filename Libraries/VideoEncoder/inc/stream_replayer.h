@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "stream_recording.h"
+
+/// <summary>
+/// Plays a recording's frames back at the pace they were recorded, without decoding or
+/// encoding them, to load the network path as a real stream would
+/// </summary>
+/// <remarks>
+/// Playback starts at the first keyframe and, when looping, starts over from it after the last
+/// frame. Frames are delivered on a thread of the replayer's own, with a timestamp that counts
+/// up from 0 across loops by the recorded intervals, so a looped stream looks like one long one.
+/// A keyframe request skips ahead to the next keyframe, as a new or recovering peer needs one.
+/// Many replayers can share one recording, which is only read.
+/// </remarks>
+class StreamReplayer
+{
+public:
+	// Called on the replayer's thread with each frame, which points into the recording
+	typedef std::function<void(const RecordedFrame& frame, int64_t timestamp_us)> Deliver;
+
+	struct Options
+	{
+		// Whether to start over after the last frame, rather than stop
+		bool loop;
+
+		// Multiple of the recorded pace to play at, or 0 or less to play as fast as possible
+		double speed;
+
+		Options() : loop(true), speed(1.0) {}
+	};
+
+	struct Stats
+	{
+		uint64_t frames;
+		uint64_t keyframes;
+
+		// Times playback started over, including to reach a keyframe
+		uint64_t loops;
+
+		uint64_t keyframe_requests;
+
+		// Most a frame was delivered after it was due, when paced
+		int64_t max_lateness_us;
+	};
+
+	// |recording| must stay open until Stop returns
+	StreamReplayer(const StreamRecording* recording, const Deliver& deliver, const Options& options = Options());
+
+	~StreamReplayer();
+
+	// Starts playing, returning false for a recording without a keyframe to start from
+	bool Start();
+
+	void Stop();
+
+	bool IsRunning() const;
+
+	// Waits until a recording that doesn't loop has played through, or Stop is called
+	void Wait();
+
+	// Makes the next frame delivered a keyframe
+	void RequestKeyframe();
+
+	Stats stats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	void PlayLoop();
+
+	// The next keyframe after frame |index|, starting over if there are none
+	size_t NextKeyframe(size_t index);
+
+	const StreamRecording* recording_;
+	Deliver deliver_;
+	Options options_;
+
+	mutable std::mutex lock_;
+	std::condition_variable changed_;
+	bool running_;
+	bool stopping_;
+	bool keyframe_requested_;
+	Stats stats_;
+	std::thread thread_;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// <summary>
+/// An I420 picture that owns its planes
+/// </summary>
+/// <remarks>
+/// Plane 0 is luma and planes 1 and 2 are chroma, at half the resolution rounded up. Each plane
+/// is tightly packed, so a plane's stride is its width.
+/// </remarks>
+class I420Frame
+{
+public:
+	I420Frame();
+
+	I420Frame(int width, int height);
+
+	// Resizes the planes, leaving their contents undefined
+	void Allocate(int width, int height);
+
+	int width() const;
+
+	int height() const;
+
+	int PlaneWidth(int plane) const;
+
+	int PlaneHeight(int plane) const;
+
+	uint8_t* data(int plane);
+
+	const uint8_t* data(int plane) const;
+
+	// The size of all three planes, in bytes
+	size_t size() const;
+
+	bool empty() const;
+
+private:
+	std::vector<uint8_t> buffer_;
+	int width_;
+	int height_;
+	size_t offsets_[3];
+};
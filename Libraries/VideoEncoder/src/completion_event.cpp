@@ -0,0 +1,84 @@
+#include "completion_event.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+CompletionEvent::CompletionEvent() :
+	event_(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+{
+}
+
+CompletionEvent::~CompletionEvent()
+{
+	if (event_ != nullptr)
+	{
+		CloseHandle(event_);
+	}
+}
+
+void* CompletionEvent::handle() const
+{
+	return event_;
+}
+
+void CompletionEvent::Reset()
+{
+	ResetEvent(event_);
+}
+
+bool CompletionEvent::Wait(int timeout_ms)
+{
+	return WaitForSingleObject(event_, timeout_ms < 0 ? INFINITE : static_cast<DWORD>(timeout_ms)) == WAIT_OBJECT_0;
+}
+
+void CompletionEvent::Signal(void* handle)
+{
+	SetEvent(handle);
+}
+#else
+#include <chrono>
+
+CompletionEvent::CompletionEvent() :
+	set_(false)
+{
+}
+
+CompletionEvent::~CompletionEvent()
+{
+}
+
+void* CompletionEvent::handle() const
+{
+	return const_cast<CompletionEvent*>(this);
+}
+
+void CompletionEvent::Reset()
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	set_ = false;
+}
+
+bool CompletionEvent::Wait(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	auto set = [this]() { return set_; };
+	if (timeout_ms < 0)
+	{
+		set_cv_.wait(lock, set);
+		return true;
+	}
+
+	return set_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), set);
+}
+
+void CompletionEvent::Signal(void* handle)
+{
+	auto event = static_cast<CompletionEvent*>(handle);
+	{
+		std::lock_guard<std::mutex> lock(event->lock_);
+		event->set_ = true;
+	}
+
+	event->set_cv_.notify_all();
+}
+#endif
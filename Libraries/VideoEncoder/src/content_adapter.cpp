@@ -0,0 +1,80 @@
+#include "content_adapter.h"
+
+ContentAdapter::Options::Options()
+{
+	profiles[static_cast<int>(ContentClass::kText)] = { EncoderPreset::kHighQuality, false, 1.0 };
+	profiles[static_cast<int>(ContentClass::kNatural)] = { EncoderPreset::kLowLatencyHighQuality, false, 1.0 };
+	profiles[static_cast<int>(ContentClass::kMotion)] = { EncoderPreset::kLowLatencyHighQuality, false, 0.6 };
+	profiles[static_cast<int>(ContentClass::kNoisy)] = { EncoderPreset::kLowLatencyHighPerformance, true, 0.5 };
+}
+
+ContentAdapter::ContentAdapter(EncoderControl* control, const Options& options) :
+	control_(control),
+	options_(options),
+	classifier_(options.classifier),
+	classified_(false),
+	current_(ContentClass::kNatural),
+	bitrate_bps_(0),
+	max_bitrate_bps_(0)
+{
+	stats_ = Stats();
+}
+
+void ContentAdapter::SetBitrate(int bitrate_bps, int max_bitrate_bps)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	bitrate_bps_ = bitrate_bps;
+	max_bitrate_bps_ = max_bitrate_bps;
+	if (classified_)
+	{
+		ApplyBitrate();
+	}
+}
+
+ContentClass ContentAdapter::OnFrame(const I420Frame& frame)
+{
+	ContentStats stats;
+	auto content = classifier_.Update(frame, &stats);
+
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.frames++;
+	stats_.frames_by_class[static_cast<int>(content)]++;
+	stats_.last = stats;
+	if (classified_ && content == current_)
+	{
+		return content;
+	}
+
+	stats_.switches += classified_ ? 1 : 0;
+	classified_ = true;
+	current_ = content;
+
+	const auto& profile = options_.profiles[static_cast<int>(content)];
+	control_->SetPreset(profile.preset);
+	control_->SetAdaptiveQuantization(profile.adaptive_quantization);
+	ApplyBitrate();
+	return content;
+}
+
+ContentClass ContentAdapter::current() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return current_;
+}
+
+ContentAdapter::Stats ContentAdapter::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+void ContentAdapter::ApplyBitrate()
+{
+	if (bitrate_bps_ <= 0)
+	{
+		return;
+	}
+
+	auto scale = options_.profiles[static_cast<int>(current_)].bitrate_scale;
+	control_->SetBitrate(static_cast<int>(bitrate_bps_ * scale), static_cast<int>(max_bitrate_bps_ * scale));
+}
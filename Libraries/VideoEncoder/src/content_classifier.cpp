@@ -0,0 +1,146 @@
+#include "content_classifier.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+const char* ContentClassName(ContentClass content)
+{
+	switch (content)
+	{
+	case ContentClass::kText:
+		return "text";
+	case ContentClass::kNatural:
+		return "natural";
+	case ContentClass::kMotion:
+		return "motion";
+	case ContentClass::kNoisy:
+		return "noisy";
+	}
+
+	return "unknown";
+}
+
+ContentClassifier::ContentClassifier(const Options& options) :
+	options_(options),
+	previous_width_(0),
+	previous_height_(0),
+	classified_(false),
+	current_(ContentClass::kNatural),
+	candidate_(ContentClass::kNatural),
+	candidate_frames_(0)
+{
+	options_.subsample = std::max(1, options_.subsample);
+	options_.switch_frames = std::max(1, options_.switch_frames);
+}
+
+ContentStats ContentClassifier::Analyze(const I420Frame& frame)
+{
+	ContentStats stats;
+	auto width = frame.width();
+	auto height = frame.height();
+	if (width < 2 || height < 2)
+	{
+		return stats;
+	}
+
+	auto step = options_.subsample;
+	auto columns = (width - 2) / step + 1;
+	auto rows = (height - 2) / step + 1;
+	auto compare = previous_width_ == width && previous_height_ == height;
+	previous_.resize(static_cast<size_t>(columns) * rows);
+	previous_width_ = width;
+	previous_height_ = height;
+
+	auto luma = frame.data(0);
+	int64_t spatial = 0;
+	int64_t temporal = 0;
+	int64_t edges = 0;
+	int64_t flat = 0;
+	auto sample = previous_.data();
+	for (int row = 0; row < rows; row++)
+	{
+		auto line = luma + static_cast<size_t>(row) * step * width;
+		for (int column = 0; column < columns; column++, sample++)
+		{
+			auto pixel = line + column * step;
+			int value = pixel[0];
+			auto gradient = abs(pixel[1] - value) + abs(pixel[width] - value);
+			spatial += gradient;
+			edges += gradient > options_.edge_threshold ? 1 : 0;
+			flat += gradient <= options_.flat_threshold ? 1 : 0;
+			temporal += abs(value - *sample);
+			*sample = static_cast<uint8_t>(value);
+		}
+	}
+
+	double samples = static_cast<double>(columns) * rows;
+	stats.spatial = spatial / samples / 2;
+	stats.temporal = compare ? temporal / samples : 0;
+	stats.edge_density = edges / samples;
+	stats.flat_fraction = flat / samples;
+	return stats;
+}
+
+ContentClass ContentClassifier::Classify(const ContentStats& stats) const
+{
+	if (stats.flat_fraction < options_.noisy_flat_fraction && stats.spatial > options_.noisy_spatial)
+	{
+		return ContentClass::kNoisy;
+	}
+
+	if (stats.flat_fraction > options_.text_flat_fraction && stats.edge_density > options_.text_edge_density)
+	{
+		return ContentClass::kText;
+	}
+
+	return stats.temporal > options_.motion_temporal ? ContentClass::kMotion : ContentClass::kNatural;
+}
+
+ContentClass ContentClassifier::Update(const I420Frame& frame, ContentStats* stats)
+{
+	auto measured = Analyze(frame);
+	auto content = Classify(measured);
+	if (stats != nullptr)
+	{
+		*stats = measured;
+	}
+
+	if (!classified_)
+	{
+		classified_ = true;
+		current_ = content;
+		candidate_frames_ = 0;
+		return current_;
+	}
+
+	if (content == current_)
+	{
+		candidate_frames_ = 0;
+		return current_;
+	}
+
+	// another class only takes over once it has held for switch_frames in a row
+	candidate_frames_ = content == candidate_ ? candidate_frames_ + 1 : 1;
+	candidate_ = content;
+	if (candidate_frames_ >= options_.switch_frames)
+	{
+		current_ = content;
+		candidate_frames_ = 0;
+	}
+
+	return current_;
+}
+
+ContentClass ContentClassifier::current() const
+{
+	return current_;
+}
+
+void ContentClassifier::Reset()
+{
+	previous_width_ = 0;
+	previous_height_ = 0;
+	classified_ = false;
+	current_ = ContentClass::kNatural;
+	candidate_frames_ = 0;
+}
@@ -0,0 +1,332 @@
+#include "encode_pipeline.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	// How long the retrieval thread waits on the backend before checking whether it should stop
+	const int kRetrieveTimeoutMs = 50;
+
+	// How long to wait before resubmitting a frame the backend was too busy for, in case a slot
+	// frees up without the retrieval thread seeing it
+	const std::chrono::milliseconds kBusyRetryInterval(1);
+
+	// How long Stop waits for each frame still in the backend
+	const int kStopTimeoutMs = 1000;
+}
+
+EncodePipeline::EncodePipeline(EncoderBackend* encoder, const Deliver& deliver, const Options& options) :
+	encoder_(encoder),
+	deliver_(deliver),
+	options_(options),
+	running_(false),
+	outstanding_(0),
+	queue_depth_(0),
+	last_error_(EncoderStatus::kOk)
+{
+	memset(&stats_, 0, sizeof(stats_));
+	options_.input_capacity = std::max<size_t>(1, options_.input_capacity);
+	options_.output_capacity = std::max<size_t>(1, options_.output_capacity);
+}
+
+EncodePipeline::~EncodePipeline()
+{
+	Stop();
+}
+
+void EncodePipeline::Start()
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (running_)
+	{
+		return;
+	}
+
+	running_ = true;
+	queue_depth_ = std::max(1, encoder_->config().queue_depth);
+	submit_thread_ = std::thread(&EncodePipeline::SubmitLoop, this);
+	retrieve_thread_ = std::thread(&EncodePipeline::RetrieveLoop, this);
+	deliver_thread_ = std::thread(&EncodePipeline::DeliverLoop, this);
+}
+
+bool EncodePipeline::Push(I420Frame frame, const EncodeParams& params, int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	auto room = [this]() { return input_.size() < options_.input_capacity; };
+	if (timeout_ms < 0)
+	{
+		changed_.wait(lock, room);
+	}
+	else if (!changed_.wait_for(lock, std::chrono::milliseconds(timeout_ms), room))
+	{
+		stats_.dropped++;
+		return false;
+	}
+
+	Input input;
+	input.frame = std::move(frame);
+	input.params = params;
+	input.pushed_at = Clock::now();
+	input_.push_back(std::move(input));
+
+	stats_.pushed++;
+	stats_.peak_input = std::max(stats_.peak_input, input_.size());
+	outstanding_++;
+	changed_.notify_all();
+	return true;
+}
+
+void EncodePipeline::Flush()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	changed_.wait(lock, [this]() { return outstanding_ == 0 || !running_; });
+}
+
+void EncodePipeline::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		running_ = false;
+	}
+
+	changed_.notify_all();
+	if (submit_thread_.joinable())
+	{
+		submit_thread_.join();
+	}
+
+	if (retrieve_thread_.joinable())
+	{
+		retrieve_thread_.join();
+	}
+
+	if (deliver_thread_.joinable())
+	{
+		deliver_thread_.join();
+	}
+
+	// the threads are gone, so the backend is ours to drain
+	std::lock_guard<std::mutex> lock(lock_);
+	while (!in_flight_.empty())
+	{
+		EncodedFrame frame;
+		if (encoder_->Retrieve(&frame, kStopTimeoutMs) == EncoderStatus::kTimeout)
+		{
+			break;
+		}
+
+		in_flight_.pop_front();
+	}
+
+	input_.clear();
+	in_flight_.clear();
+	output_.clear();
+	outstanding_ = 0;
+}
+
+EncodePipeline::Stats EncodePipeline::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+EncoderStatus EncodePipeline::last_error() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return last_error_;
+}
+
+void EncodePipeline::SubmitLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		changed_.wait(lock, [this]() { return !running_ || !input_.empty(); });
+		if (!running_)
+		{
+			return;
+		}
+
+		auto input = std::move(input_.front());
+		input_.pop_front();
+		changed_.notify_all();
+
+		if (options_.content != nullptr)
+		{
+			lock.unlock();
+			options_.content->OnFrame(input.frame);
+			lock.lock();
+		}
+
+		while (options_.control != nullptr)
+		{
+			lock.unlock();
+			auto status = options_.control->Apply(encoder_, input.frame.width(), input.frame.height());
+			lock.lock();
+
+			if (status != EncoderStatus::kBusy)
+			{
+				last_error_ = status != EncoderStatus::kOk ? status : last_error_;
+				break;
+			}
+
+			// the backend is being reinitialized, which would drop what's in flight
+			changed_.wait(lock, [this]() { return !running_ || in_flight_.empty(); });
+			if (!running_)
+			{
+				return;
+			}
+		}
+
+		if (options_.recovery != nullptr)
+		{
+			lock.unlock();
+			options_.recovery->Apply(encoder_, &input.params);
+			lock.lock();
+		}
+
+		// waiting for a slot here, rather than on the backend, lets the retrieval thread wake us
+		if (in_flight_.size() >= queue_depth_)
+		{
+			stats_.busy++;
+			changed_.wait(lock, [this]() { return !running_ || in_flight_.size() < queue_depth_; });
+			if (!running_)
+			{
+				return;
+			}
+		}
+
+		while (true)
+		{
+			lock.unlock();
+			auto status = encoder_->Submit(input.frame, input.params);
+			if (status == EncoderStatus::kOk && options_.recovery != nullptr)
+			{
+				options_.recovery->OnSubmitted(input.params);
+			}
+
+			if (status == EncoderStatus::kOk && options_.quality != nullptr)
+			{
+				options_.quality->OnSubmitted(input.frame, input.params);
+			}
+
+			lock.lock();
+
+			if (status == EncoderStatus::kOk)
+			{
+				Submitted submitted = { input.pushed_at, input.params.prediction_timestamp, std::move(input.params.metadata) };
+				in_flight_.push_back(std::move(submitted));
+				stats_.peak_in_flight = std::max(stats_.peak_in_flight, in_flight_.size());
+				changed_.notify_all();
+				break;
+			}
+
+			if (status != EncoderStatus::kBusy)
+			{
+				FrameFailed(status);
+				break;
+			}
+
+			stats_.busy++;
+			changed_.wait_for(lock, kBusyRetryInterval);
+			if (!running_)
+			{
+				return;
+			}
+		}
+	}
+}
+
+void EncodePipeline::RetrieveLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		changed_.wait(lock, [this]() { return !running_ || !in_flight_.empty(); });
+		if (!running_)
+		{
+			return;
+		}
+
+		lock.unlock();
+		Output output;
+		auto status = encoder_->Retrieve(&output.frame, kRetrieveTimeoutMs);
+		if (status == EncoderStatus::kOk && options_.recovery != nullptr)
+		{
+			options_.recovery->OnEncoded(output.frame);
+		}
+
+		if (status == EncoderStatus::kOk && options_.quality != nullptr)
+		{
+			options_.quality->OnEncoded(output.frame);
+		}
+
+		lock.lock();
+
+		if (status == EncoderStatus::kTimeout)
+		{
+			continue;
+		}
+
+		output.submitted = std::move(in_flight_.front());
+		in_flight_.pop_front();
+		changed_.notify_all();
+		if (status != EncoderStatus::kOk)
+		{
+			FrameFailed(status);
+			continue;
+		}
+
+		changed_.wait(lock, [this]() { return !running_ || output_.size() < options_.output_capacity; });
+		if (!running_)
+		{
+			return;
+		}
+
+		output_.push_back(std::move(output));
+		stats_.peak_output = std::max(stats_.peak_output, output_.size());
+		changed_.notify_all();
+	}
+}
+
+void EncodePipeline::DeliverLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		changed_.wait(lock, [this]() { return !running_ || !output_.empty(); });
+		if (!running_)
+		{
+			return;
+		}
+
+		auto output = std::move(output_.front());
+		output_.pop_front();
+		changed_.notify_all();
+
+		lock.unlock();
+		if (options_.recorder != nullptr)
+		{
+			options_.recorder->Write(output.frame, output.submitted.prediction_timestamp, output.submitted.metadata);
+		}
+
+		auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - output.submitted.pushed_at).count();
+		deliver_(output.frame, latency_us);
+		lock.lock();
+
+		stats_.delivered++;
+		stats_.total_latency_us += latency_us;
+		stats_.max_latency_us = std::max<int64_t>(stats_.max_latency_us, latency_us);
+		outstanding_--;
+		changed_.notify_all();
+	}
+}
+
+void EncodePipeline::FrameFailed(EncoderStatus status)
+{
+	last_error_ = status;
+	stats_.failed++;
+	outstanding_--;
+	changed_.notify_all();
+}
@@ -0,0 +1,86 @@
+#include "encoder_backend.h"
+
+const char* EncoderStatusName(EncoderStatus status)
+{
+	switch (status)
+	{
+	case EncoderStatus::kOk:
+		return "ok";
+	case EncoderStatus::kBusy:
+		return "busy";
+	case EncoderStatus::kTimeout:
+		return "timeout";
+	case EncoderStatus::kInvalidParam:
+		return "invalid parameter";
+	case EncoderStatus::kUnsupported:
+		return "unsupported";
+	case EncoderStatus::kNotInitialized:
+		return "not initialized";
+	case EncoderStatus::kSessionLimit:
+		return "session limit";
+	case EncoderStatus::kDeviceError:
+		return "device error";
+	}
+
+	return "unknown";
+}
+
+const char* RateControlName(RateControl rate_control)
+{
+	switch (rate_control)
+	{
+	case RateControl::kConstantQp:
+		return "cqp";
+	case RateControl::kCbr:
+		return "cbr";
+	case RateControl::kVbr:
+		return "vbr";
+	}
+
+	return "unknown";
+}
+
+const char* EncoderPresetName(EncoderPreset preset)
+{
+	switch (preset)
+	{
+	case EncoderPreset::kLowLatencyHighQuality:
+		return "low-latency-hq";
+	case EncoderPreset::kLowLatencyHighPerformance:
+		return "low-latency-hp";
+	case EncoderPreset::kHighQuality:
+		return "hq";
+	case EncoderPreset::kHighPerformance:
+		return "hp";
+	case EncoderPreset::kLossless:
+		return "lossless";
+	}
+
+	return "unknown";
+}
+
+bool ParseEncoderPreset(const std::string& name, EncoderPreset* preset)
+{
+	for (auto candidate : { EncoderPreset::kLowLatencyHighQuality, EncoderPreset::kLowLatencyHighPerformance,
+		EncoderPreset::kHighQuality, EncoderPreset::kHighPerformance, EncoderPreset::kLossless })
+	{
+		if (name == EncoderPresetName(candidate))
+		{
+			*preset = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+EncoderStatus EncoderBackend::Encode(const I420Frame& frame, const EncodeParams& params, EncodedFrame* encoded)
+{
+	auto status = Submit(frame, params);
+	if (status != EncoderStatus::kOk)
+	{
+		return status;
+	}
+
+	return Retrieve(encoded, -1);
+}
@@ -0,0 +1,213 @@
+#include "encoder_control.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	// How early a frame may arrive and still count as on time, for producers whose frame
+	// intervals jitter around the one asked for
+	const int64_t kFrameToleranceUs = 1000;
+
+	// Enough digits for any bitrate, and few enough not to overflow an int
+	const size_t kMaxDigits = 9;
+}
+
+const char* const EncoderControl::kMessageType = "video-targets";
+
+EncoderControl::EncoderControl() :
+	pending_(false),
+	bitrate_bps_(0),
+	max_bitrate_bps_(0),
+	fps_(0),
+	next_frame_us_(0),
+	width_(0),
+	height_(0),
+	preset_set_(false),
+	preset_(EncoderPreset::kLowLatencyHighQuality),
+	adaptive_quantization_set_(false),
+	adaptive_quantization_(false)
+{
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+bool EncoderControl::ParseTargets(const char* body, size_t size, Targets* targets)
+{
+	int values[4] = { 0, 0, 0, 0 };
+	size_t count = 0;
+	size_t digits = 0;
+	for (size_t i = 0; i <= size; i++)
+	{
+		if (i == size || body[i] == ',')
+		{
+			if (digits == 0 || ++count > 4)
+			{
+				return false;
+			}
+
+			digits = 0;
+			continue;
+		}
+
+		if (body[i] < '0' || body[i] > '9' || ++digits > kMaxDigits)
+		{
+			return false;
+		}
+
+		values[count] = values[count] * 10 + (body[i] - '0');
+	}
+
+	if ((values[2] > 0) != (values[3] > 0))
+	{
+		return false;
+	}
+
+	targets->bitrate_bps = values[0];
+	targets->fps = values[1];
+	targets->width = values[2];
+	targets->height = values[3];
+	return true;
+}
+
+void EncoderControl::SetBitrate(int bitrate_bps, int max_bitrate_bps)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	bitrate_bps_ = bitrate_bps;
+	max_bitrate_bps_ = max_bitrate_bps;
+	pending_ = true;
+}
+
+void EncoderControl::SetFramerate(int fps)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	fps_ = fps;
+	pending_ = true;
+}
+
+void EncoderControl::SetResolution(int width, int height)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	width_ = width;
+	height_ = height;
+	pending_ = true;
+}
+
+void EncoderControl::SetPreset(EncoderPreset preset)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	preset_set_ = true;
+	preset_ = preset;
+	pending_ = true;
+}
+
+void EncoderControl::SetAdaptiveQuantization(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	adaptive_quantization_set_ = true;
+	adaptive_quantization_ = enabled;
+	pending_ = true;
+}
+
+bool EncoderControl::AdmitFrame(int64_t now_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (fps_ <= 0)
+	{
+		return true;
+	}
+
+	if (now_us + kFrameToleranceUs < next_frame_us_)
+	{
+		return false;
+	}
+
+	// after a pause the schedule restarts from now, rather than letting a burst through
+	auto interval_us = 1000000 / fps_;
+	next_frame_us_ = std::max(next_frame_us_, now_us - interval_us) + interval_us;
+	return true;
+}
+
+bool EncoderControl::resolution(int* width, int* height) const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (width_ <= 0 || height_ <= 0)
+	{
+		return false;
+	}
+
+	*width = width_;
+	*height = height_;
+	return true;
+}
+
+bool EncoderControl::pending() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return pending_;
+}
+
+EncoderStatus EncoderControl::Apply(EncoderBackend* encoder, int width, int height)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto config = encoder->config();
+	auto resized = width > 0 && height > 0 && (width != config.width || height != config.height);
+	if (!pending_ && !resized)
+	{
+		return EncoderStatus::kOk;
+	}
+
+	if (pending_)
+	{
+		config.bitrate_bps = bitrate_bps_ > 0 ? bitrate_bps_ : config.bitrate_bps;
+		config.max_bitrate_bps = bitrate_bps_ > 0 ? max_bitrate_bps_ : config.max_bitrate_bps;
+		config.fps = fps_ > 0 ? fps_ : config.fps;
+		config.preset = preset_set_ ? preset_ : config.preset;
+		config.adaptive_quantization = adaptive_quantization_set_ ? adaptive_quantization_ : config.adaptive_quantization;
+		if (width_ > 0 && height_ > 0)
+		{
+			config.width = width_;
+			config.height = height_;
+		}
+	}
+
+	// the frames are what the encoder has to match, whatever was asked for
+	if (width > 0 && height > 0)
+	{
+		config.width = width;
+		config.height = height;
+	}
+
+	auto status = encoder->Reconfigure(config);
+	if (status == EncoderStatus::kUnsupported)
+	{
+		if (encoder->pending() > 0)
+		{
+			return EncoderStatus::kBusy;
+		}
+
+		// the old maximum is no use if the new size is beyond it
+		config.max_width = 0;
+		config.max_height = 0;
+		encoder->Shutdown();
+		status = encoder->Initialize(config);
+		stats_.reinitialized += status == EncoderStatus::kOk ? 1 : 0;
+	}
+
+	pending_ = false;
+	if (status == EncoderStatus::kOk)
+	{
+		stats_.applied++;
+	}
+	else
+	{
+		stats_.failed++;
+	}
+
+	return status;
+}
+
+EncoderControl::Stats EncoderControl::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
@@ -0,0 +1,64 @@
+#include "encoder_factory.h"
+
+#include "nvenc_encoder.h"
+#include "openh264_encoder.h"
+
+namespace
+{
+	// the driver only encodes asynchronously on Windows, saving the retrieving thread from
+	// blocking in it
+#if defined(_WIN32)
+	const bool kAsyncEncode = true;
+#else
+	const bool kAsyncEncode = false;
+#endif
+}
+
+const char* EncoderBackendTypeName(EncoderBackendType type)
+{
+	switch (type)
+	{
+	case EncoderBackendType::kAuto:
+		return "auto";
+	case EncoderBackendType::kNvenc:
+		return "nvenc";
+	case EncoderBackendType::kSoftware:
+		return "software";
+	}
+
+	return "unknown";
+}
+
+bool ParseEncoderBackendType(const std::string& name, EncoderBackendType* type)
+{
+	for (auto candidate : { EncoderBackendType::kAuto, EncoderBackendType::kNvenc, EncoderBackendType::kSoftware })
+	{
+		if (name == EncoderBackendTypeName(candidate))
+		{
+			*type = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::unique_ptr<EncoderBackend> CreateEncoderBackend(EncoderBackendType type, void* device, NV_ENC_DEVICE_TYPE device_type)
+{
+	if (type != EncoderBackendType::kSoftware && device != nullptr)
+	{
+		NV_ENCODE_API_FUNCTION_LIST functions;
+		if (NvencEncoder::LoadFunctions(&functions))
+		{
+			return std::unique_ptr<EncoderBackend>(new NvencEncoder(functions, device, device_type, kAsyncEncode));
+		}
+	}
+
+	OpenH264Functions openh264;
+	if (type == EncoderBackendType::kNvenc || !OpenH264Encoder::LoadFunctions(&openh264))
+	{
+		return nullptr;
+	}
+
+	return std::unique_ptr<EncoderBackend>(new OpenH264Encoder(openh264));
+}
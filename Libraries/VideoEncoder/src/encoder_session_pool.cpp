@@ -0,0 +1,231 @@
+#include "encoder_session_pool.h"
+
+#include <algorithm>
+
+double EncoderSessionPool::Utilization::hardware_utilization() const
+{
+	return hardware_limit > 0 ? static_cast<double>(hardware_sessions) / hardware_limit : 0;
+}
+
+EncoderSessionPool::EncoderSessionPool(const Factory& hardware, const Factory& software, const Options& options) :
+	hardware_(hardware),
+	software_(software),
+	options_(options),
+	hardware_sessions_(0),
+	software_sessions_(0),
+	learned_limit_(0),
+	fallbacks_(0),
+	refused_(0),
+	limit_reached_(0)
+{
+}
+
+EncoderSessionPool::~EncoderSessionPool()
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	while (!peers_.empty())
+	{
+		ReleaseLocked(peers_.begin()->first);
+	}
+}
+
+EncoderSessionPool::Lease EncoderSessionPool::Acquire(int peer_id, const EncoderConfig& config, const std::string& share_key)
+{
+	Lease lease;
+	std::lock_guard<std::mutex> lock(lock_);
+	ReleaseLocked(peer_id);
+
+	std::shared_ptr<Session> session;
+	auto shared = share_key.empty() ? shared_.end() : shared_.find(share_key);
+	if (shared != shared_.end())
+	{
+		session = shared->second;
+		lease.shared = true;
+	}
+	else
+	{
+		session = Open(config, &lease.status);
+		if (!session)
+		{
+			return lease;
+		}
+
+		session->share_key = share_key;
+		if (!share_key.empty())
+		{
+			shared_[share_key] = session;
+		}
+	}
+
+	session->peers++;
+	peers_[peer_id] = session;
+	lease.encoder = session->encoder;
+	lease.hardware = session->hardware;
+	return lease;
+}
+
+void EncoderSessionPool::Release(int peer_id)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	ReleaseLocked(peer_id);
+}
+
+void EncoderSessionPool::Downgrade(int peer_id)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto peer = peers_.find(peer_id);
+	if (peer == peers_.end() || !peer->second->hardware)
+	{
+		return;
+	}
+
+	peer->second->hardware = false;
+	hardware_sessions_--;
+	software_sessions_++;
+	fallbacks_++;
+	limit_reached_++;
+	learned_limit_ = std::max(1, hardware_sessions_);
+}
+
+bool EncoderSessionPool::CanUpgrade(int peer_id) const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto peer = peers_.find(peer_id);
+	return peer != peers_.end() && !peer->second->hardware && HardwareAvailable();
+}
+
+EncoderSessionPool::Utilization EncoderSessionPool::utilization() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	Utilization utilization;
+	utilization.hardware_sessions = hardware_sessions_;
+	utilization.software_sessions = software_sessions_;
+	utilization.hardware_limit = options_.max_hardware_sessions > 0 && learned_limit_ > 0 ?
+		std::min(options_.max_hardware_sessions, learned_limit_) :
+		std::max(options_.max_hardware_sessions, learned_limit_);
+	utilization.peers = static_cast<int>(peers_.size());
+	utilization.shared_peers = 0;
+	for (const auto& session : shared_)
+	{
+		utilization.shared_peers += session.second->peers - 1;
+	}
+
+	utilization.fallbacks = fallbacks_;
+	utilization.refused = refused_;
+	utilization.limit_reached = limit_reached_;
+	return utilization;
+}
+
+bool EncoderSessionPool::HardwareAvailable() const
+{
+	auto accounting = !hardware_ && !software_;
+	if (!hardware_ && !accounting)
+	{
+		return false;
+	}
+
+	return (options_.max_hardware_sessions <= 0 || hardware_sessions_ < options_.max_hardware_sessions) &&
+		(learned_limit_ <= 0 || hardware_sessions_ < learned_limit_);
+}
+
+std::shared_ptr<EncoderSessionPool::Session> EncoderSessionPool::Open(const EncoderConfig& config, EncoderStatus* status)
+{
+	auto session = std::make_shared<Session>();
+	session->hardware = false;
+	session->peers = 0;
+
+	auto accounting = !hardware_ && !software_;
+	if (HardwareAvailable())
+	{
+		std::unique_ptr<EncoderBackend> encoder;
+		auto result = EncoderStatus::kOk;
+		if (hardware_)
+		{
+			// a factory returns null when there's no device to open a session on
+			encoder = hardware_();
+			result = encoder ? encoder->Initialize(config) : EncoderStatus::kUnsupported;
+		}
+
+		if (result == EncoderStatus::kOk)
+		{
+			session->encoder = std::move(encoder);
+			session->hardware = true;
+			hardware_sessions_++;
+			learned_limit_ = learned_limit_ > 0 ? std::max(learned_limit_, hardware_sessions_) : 0;
+			return session;
+		}
+
+		// sessions other processes hold count too, so the limit is what we'd reached
+		if (result == EncoderStatus::kSessionLimit)
+		{
+			limit_reached_++;
+			learned_limit_ = std::max(1, hardware_sessions_);
+		}
+	}
+
+	auto fallback = accounting || hardware_;
+	if (fallback && !options_.software_fallback)
+	{
+		refused_++;
+		*status = EncoderStatus::kSessionLimit;
+		return nullptr;
+	}
+
+	if (software_)
+	{
+		auto encoder = software_();
+		auto result = encoder ? encoder->Initialize(config) : EncoderStatus::kUnsupported;
+		if (result != EncoderStatus::kOk)
+		{
+			*status = result;
+			return nullptr;
+		}
+
+		session->encoder = std::move(encoder);
+	}
+	else if (!accounting)
+	{
+		refused_++;
+		*status = EncoderStatus::kSessionLimit;
+		return nullptr;
+	}
+
+	fallbacks_ += fallback ? 1 : 0;
+	software_sessions_++;
+	return session;
+}
+
+void EncoderSessionPool::ReleaseLocked(int peer_id)
+{
+	auto peer = peers_.find(peer_id);
+	if (peer == peers_.end())
+	{
+		return;
+	}
+
+	auto session = peer->second;
+	peers_.erase(peer);
+	if (--session->peers > 0)
+	{
+		return;
+	}
+
+	if (session->hardware)
+	{
+		hardware_sessions_--;
+	}
+	else
+	{
+		software_sessions_--;
+	}
+
+	if (!session->share_key.empty())
+	{
+		shared_.erase(session->share_key);
+	}
+
+	if (session->encoder)
+	{
+		session->encoder->Shutdown();
+	}
+}
@@ -0,0 +1,329 @@
+#include "encoder_sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <ostream>
+#include <stdio.h>
+
+#include "openh264_encoder.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::string Format(const char* format, double value)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), format, value);
+		return buffer;
+	}
+
+	// The luma score and the log of the bitrate for each measured result, by score
+	std::vector<std::pair<double, double>> RateDistortion(const std::vector<EncoderSweep::Result>& results, EncoderSweep::Distortion distortion)
+	{
+		std::vector<std::pair<double, double>> curve;
+		for (const auto& result : results)
+		{
+			if (result.measured && result.bitrate_bps > 0)
+			{
+				auto score = distortion == EncoderSweep::Distortion::kSsimY ? result.quality.ssim_y : result.quality.psnr_y;
+				curve.emplace_back(score, log(result.bitrate_bps));
+			}
+		}
+
+		std::sort(curve.begin(), curve.end());
+		return curve;
+	}
+
+	double LogRateAt(const std::vector<std::pair<double, double>>& curve, double score)
+	{
+		auto upper = std::lower_bound(curve.begin(), curve.end(), std::make_pair(score, -HUGE_VAL));
+		if (upper == curve.begin())
+		{
+			return upper->second;
+		}
+
+		if (upper == curve.end())
+		{
+			return curve.back().second;
+		}
+
+		auto lower = upper - 1;
+		auto span = upper->first - lower->first;
+		return span > 0 ? lower->second + (upper->second - lower->second) * (score - lower->first) / span : upper->second;
+	}
+}
+
+EncoderSweep::Options::Options() :
+	bitrates_bps(1, base.bitrate_bps),
+	presets(1, base.preset),
+	gop_lengths(1, base.gop_length),
+	adaptive_quantization(1, base.adaptive_quantization),
+	frames(0),
+	content_adaptive(false)
+{
+}
+
+EncoderSweep::Result::Result() :
+	status(EncoderStatus::kOk),
+	frames(0),
+	keyframes(0),
+	bytes(0),
+	content_adaptive(false),
+	content_switches(0),
+	bitrate_bps(0),
+	average_qp(-1),
+	encode_ms(0),
+	max_encode_ms(0),
+	measured(false),
+	min_psnr_y(0)
+{
+}
+
+EncoderSweep::EncoderSweep(FrameSource* source, const Factory& factory, const Options& options) :
+	source_(source),
+	factory_(factory),
+	options_(options),
+	meter_(options.quality)
+{
+}
+
+std::vector<EncoderConfig> EncoderSweep::Configs() const
+{
+	// the bitrate varies fastest, so each rate-distortion curve is a run of rows
+	std::vector<EncoderConfig> configs;
+	for (auto preset : options_.presets)
+	{
+		for (auto gop_length : options_.gop_lengths)
+		{
+			for (bool adaptive_quantization : options_.adaptive_quantization)
+			{
+				for (auto bitrate_bps : options_.bitrates_bps)
+				{
+					auto config = options_.base;
+					config.width = source_->width();
+					config.height = source_->height();
+					config.fps = source_->fps();
+					config.preset = preset;
+					config.gop_length = gop_length;
+					config.adaptive_quantization = adaptive_quantization;
+					config.bitrate_bps = bitrate_bps;
+					configs.push_back(config);
+				}
+			}
+		}
+	}
+
+	return configs;
+}
+
+EncoderSweep::Result EncoderSweep::Run(const EncoderConfig& config)
+{
+	Result result;
+	result.config = config;
+
+	auto encoder = factory_();
+	if (!encoder)
+	{
+		result.status = EncoderStatus::kUnsupported;
+		return result;
+	}
+
+	result.backend = encoder->name();
+	result.status = encoder->Initialize(config);
+	if (result.status != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	// the control applies the adapter's changes, as a session's would
+	EncoderControl control;
+	std::unique_ptr<ContentAdapter> adapter;
+	result.content_adaptive = options_.content_adaptive;
+	if (options_.content_adaptive)
+	{
+		adapter.reset(new ContentAdapter(&control, options_.content));
+		adapter->SetBitrate(config.bitrate_bps, config.max_bitrate_bps);
+	}
+
+	source_->Rewind();
+	OpenH264Decoder decoder;
+	result.measured = true;
+	result.min_psnr_y = kMaxPsnr;
+
+	int64_t total_qp = 0;
+	auto reported_qp = true;
+	double total_encode_ms = 0;
+	I420Frame frame;
+	I420Frame decoded;
+	while ((options_.frames <= 0 || result.frames < options_.frames) && source_->Read(&frame))
+	{
+		EncodeParams params;
+		params.timestamp_us = result.frames * 1000000LL / std::max(1, config.fps);
+
+		EncodedFrame encoded;
+		auto start = Clock::now();
+		auto status = EncoderStatus::kOk;
+		if (adapter)
+		{
+			adapter->OnFrame(frame);
+			status = control.Apply(encoder.get());
+		}
+
+		status = status == EncoderStatus::kOk ? encoder->Encode(frame, params, &encoded) : status;
+		auto encode_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		if (status != EncoderStatus::kOk)
+		{
+			result.status = status;
+			break;
+		}
+
+		result.frames++;
+		result.keyframes += encoded.keyframe ? 1 : 0;
+		result.bytes += encoded.data.size();
+		total_qp += encoded.qp;
+		reported_qp = reported_qp && encoded.qp >= 0;
+		total_encode_ms += encode_ms;
+		result.max_encode_ms = std::max(result.max_encode_ms, encode_ms);
+
+		// once a frame can't be decoded, none after it can be either
+		result.measured = result.measured && decoder.Decode(encoded.data.data(), encoded.data.size(), &decoded);
+		if (result.measured)
+		{
+			auto scores = meter_.Measure(frame, decoded);
+			result.quality.psnr_y += scores.psnr_y;
+			result.quality.psnr_u += scores.psnr_u;
+			result.quality.psnr_v += scores.psnr_v;
+			result.quality.psnr += scores.psnr;
+			result.quality.ssim_y += scores.ssim_y;
+			result.quality.ssim_u += scores.ssim_u;
+			result.quality.ssim_v += scores.ssim_v;
+			result.quality.ssim += scores.ssim;
+			result.quality.ms_ssim += scores.ms_ssim;
+			result.min_psnr_y = std::min(result.min_psnr_y, scores.psnr_y);
+		}
+	}
+
+	encoder->Shutdown();
+	result.content_switches = adapter ? static_cast<int>(adapter->stats().switches) : 0;
+
+	result.measured = result.measured && result.frames > 0;
+	if (!result.measured)
+	{
+		result.quality = QualityScores();
+		result.min_psnr_y = 0;
+	}
+
+	if (result.frames == 0)
+	{
+		return result;
+	}
+
+	double frames = result.frames;
+	result.bitrate_bps = result.bytes * 8.0 * config.fps / frames;
+	result.average_qp = reported_qp ? total_qp / frames : -1;
+	result.encode_ms = total_encode_ms / frames;
+	if (result.measured)
+	{
+		result.quality.psnr_y /= frames;
+		result.quality.psnr_u /= frames;
+		result.quality.psnr_v /= frames;
+		result.quality.psnr /= frames;
+		result.quality.ssim_y /= frames;
+		result.quality.ssim_u /= frames;
+		result.quality.ssim_v /= frames;
+		result.quality.ssim /= frames;
+		result.quality.ms_ssim /= frames;
+	}
+
+	return result;
+}
+
+std::vector<EncoderSweep::Result> EncoderSweep::RunAll(std::ostream* csv)
+{
+	if (csv)
+	{
+		WriteCsvHeader(*csv);
+	}
+
+	std::vector<Result> results;
+	for (const auto& config : Configs())
+	{
+		results.push_back(Run(config));
+		if (csv)
+		{
+			WriteCsvRow(*csv, results.back());
+			csv->flush();
+		}
+	}
+
+	return results;
+}
+
+bool EncoderSweep::BitrateSavings(const std::vector<Result>& reference, const std::vector<Result>& test, Distortion distortion, double* savings)
+{
+	auto reference_curve = RateDistortion(reference, distortion);
+	auto test_curve = RateDistortion(test, distortion);
+	if (reference_curve.empty() || test_curve.empty())
+	{
+		return false;
+	}
+
+	auto low = std::max(reference_curve.front().first, test_curve.front().first);
+	auto high = std::min(reference_curve.back().first, test_curve.back().first);
+	if (high <= low)
+	{
+		return false;
+	}
+
+	// the mean difference in log rate over the range, by the trapezoid rule
+	const int kSteps = 100;
+	double total = 0;
+	for (int i = 0; i <= kSteps; i++)
+	{
+		auto score = low + (high - low) * i / kSteps;
+		auto difference = LogRateAt(test_curve, score) - LogRateAt(reference_curve, score);
+		total += i == 0 || i == kSteps ? difference / 2 : difference;
+	}
+
+	*savings = 1 - exp(total / kSteps);
+	return true;
+}
+
+void EncoderSweep::WriteCsvHeader(std::ostream& csv)
+{
+	csv << "backend,width,height,fps,rate_control,preset,gop_length,adaptive_quantization,content_adaptive,target_kbps,"
+		"status,frames,keyframes,content_switches,bytes,kbps,average_qp,encode_ms,max_encode_ms,"
+		"psnr_y,psnr_u,psnr_v,psnr,ssim_y,ssim_u,ssim_v,ssim,ms_ssim,min_psnr_y\n";
+}
+
+void EncoderSweep::WriteCsvRow(std::ostream& csv, const Result& result)
+{
+	const auto& config = result.config;
+	csv << result.backend << ',' << config.width << ',' << config.height << ',' << config.fps << ',' <<
+		RateControlName(config.rate_control) << ',' << EncoderPresetName(config.preset) << ',' <<
+		config.gop_length << ',' << (config.adaptive_quantization ? 1 : 0) << ',' <<
+		(result.content_adaptive ? 1 : 0) << ',' << config.bitrate_bps / 1000 << ',' <<
+		EncoderStatusName(result.status) << ',' << result.frames << ',' << result.keyframes << ',' <<
+		result.content_switches << ',' << result.bytes << ',' <<
+		Format("%.1f", result.bitrate_bps / 1000) << ',' <<
+		(result.average_qp >= 0 ? Format("%.2f", result.average_qp) : std::string()) << ',' <<
+		Format("%.3f", result.encode_ms) << ',' << Format("%.3f", result.max_encode_ms);
+
+	// left empty rather than 0 when not measured, so they aren't mistaken for scores
+	const double scores[] =
+	{
+		result.quality.psnr_y, result.quality.psnr_u, result.quality.psnr_v, result.quality.psnr,
+		result.quality.ssim_y, result.quality.ssim_u, result.quality.ssim_v, result.quality.ssim,
+		result.quality.ms_ssim, result.min_psnr_y
+	};
+
+	for (size_t i = 0; i < sizeof(scores) / sizeof(scores[0]); i++)
+	{
+		auto ssim = i >= 4 && i < 9;
+		csv << ',' << (result.measured ? Format(ssim ? "%.5f" : "%.3f", scores[i]) : std::string());
+	}
+
+	csv << '\n';
+}
@@ -0,0 +1,361 @@
+#include "frame_source.h"
+
+#include <ctype.h>
+#include <istream>
+#include <sstream>
+#include <stdlib.h>
+
+namespace
+{
+	const char kY4mMagic[] = "YUV4MPEG2";
+	const char kY4mFrame[] = "FRAME";
+
+	// Bounds the header lines read, so a file that isn't YUV4MPEG2 isn't read whole
+	const size_t kMaxY4mLine = 1024;
+
+	bool ReadLine(std::istream& in, std::string* line)
+	{
+		line->clear();
+		char c;
+		while (in.get(c))
+		{
+			if (c == '\n')
+			{
+				return true;
+			}
+
+			if (line->size() == kMaxY4mLine)
+			{
+				return false;
+			}
+
+			line->push_back(c);
+		}
+
+		return false;
+	}
+
+	// A hash of the frame and position, so noise needs no state from one frame to the next
+	uint8_t Noise(uint32_t seed, int index, int plane, int x, int y)
+	{
+		auto value = seed ^ (static_cast<uint32_t>(index) * 0x9E3779B9u) ^ (static_cast<uint32_t>(plane) << 28) ^
+			(static_cast<uint32_t>(y) * 0x85EBCA6Bu) ^ (static_cast<uint32_t>(x) * 0xC2B2AE35u);
+		value ^= value >> 16;
+		value *= 0x7FEB352Du;
+		value ^= value >> 15;
+		value *= 0x846CA68Bu;
+		value ^= value >> 16;
+		return static_cast<uint8_t>(value);
+	}
+
+	// Whether a page of 8x16 character cells has ink at |x|, |y|, each glyph being a 3x4 grid
+	// of 2x3 pixel strokes that a hash picks
+	bool TextInk(uint32_t seed, int x, int y)
+	{
+		auto column = x / 8;
+		auto line = y / 16;
+		auto glyph_x = x % 8 - 1;
+		auto glyph_y = y % 16 - 3;
+		if (glyph_x < 0 || glyph_x >= 6 || glyph_y < 0 || glyph_y >= 12)
+		{
+			return false;
+		}
+
+		// a space every few cells, and a margin
+		auto glyph = Noise(seed, line, 3, column, 0) | Noise(seed, line, 3, column, 1) << 8;
+		if (column < 2 || (glyph & 0x7000) == 0)
+		{
+			return false;
+		}
+
+		return (glyph >> (glyph_x / 2 + glyph_y / 3 * 3) & 1) != 0;
+	}
+}
+
+const char* SyntheticPatternName(SyntheticPattern pattern)
+{
+	switch (pattern)
+	{
+	case SyntheticPattern::kMovingSquare:
+		return "moving-square";
+	case SyntheticPattern::kScrolling:
+		return "scrolling";
+	case SyntheticPattern::kNoise:
+		return "noise";
+	case SyntheticPattern::kText:
+		return "text";
+	}
+
+	return "unknown";
+}
+
+bool ParseSyntheticPattern(const std::string& name, SyntheticPattern* pattern)
+{
+	for (auto candidate : { SyntheticPattern::kMovingSquare, SyntheticPattern::kScrolling, SyntheticPattern::kNoise, SyntheticPattern::kText })
+	{
+		if (name == SyntheticPatternName(candidate))
+		{
+			*pattern = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, int frames, SyntheticPattern pattern, int fps, uint32_t seed) :
+	width_(width),
+	height_(height),
+	frames_(frames),
+	pattern_(pattern),
+	fps_(fps),
+	seed_(seed),
+	index_(0)
+{
+}
+
+int SyntheticFrameSource::width() const
+{
+	return width_;
+}
+
+int SyntheticFrameSource::height() const
+{
+	return height_;
+}
+
+int SyntheticFrameSource::fps() const
+{
+	return fps_;
+}
+
+bool SyntheticFrameSource::Read(I420Frame* frame)
+{
+	if (index_ >= frames_)
+	{
+		return false;
+	}
+
+	frame->Allocate(width_, height_);
+	auto scroll = pattern_ == SyntheticPattern::kScrolling ? index_ * 7 : 0;
+	auto square_x = (index_ * 4) % width_;
+	auto square_y = static_cast<int>(seed_ % 4) * height_ / 8;
+	for (int plane = 0; plane < 3; plane++)
+	{
+		auto data = frame->data(plane);
+		auto plane_width = frame->PlaneWidth(plane);
+		auto plane_height = frame->PlaneHeight(plane);
+		auto scale = plane == 0 ? 1 : 2;
+		for (int y = 0; y < plane_height; y++)
+		{
+			for (int x = 0; x < plane_width; x++)
+			{
+				int value;
+				if (pattern_ == SyntheticPattern::kText)
+				{
+					auto page_y = y * scale + index_ / (fps_ / 2 > 0 ? fps_ / 2 : 1) * 16;
+					value = plane == 0 ? (TextInk(seed_, x, page_y) ? 24 : 230) : 128;
+				}
+				else if (pattern_ == SyntheticPattern::kNoise)
+				{
+					value = plane == 0 ? 16 + Noise(seed_, index_, plane, x, y) * 219 / 255 : 128 + (Noise(seed_, index_, plane, x, y) & 31) - 16;
+				}
+				else
+				{
+					value = plane == 0 ? (x * 2 + y + scroll) % 200 + 20 : 128 + (plane == 1 ? x - y : y - x) % 32;
+					if (x * scale >= square_x && x * scale < square_x + 32 && y * scale >= square_y && y * scale < square_y + 32)
+					{
+						value = plane == 0 ? 235 : 90;
+					}
+				}
+
+				data[y * plane_width + x] = static_cast<uint8_t>(value);
+			}
+		}
+	}
+
+	index_++;
+	return true;
+}
+
+void SyntheticFrameSource::Rewind()
+{
+	index_ = 0;
+}
+
+SequenceFrameSource::SequenceFrameSource(std::vector<std::unique_ptr<FrameSource>> scenes) :
+	scenes_(std::move(scenes)),
+	scene_(0)
+{
+}
+
+int SequenceFrameSource::width() const
+{
+	return scenes_.empty() ? 0 : scenes_[0]->width();
+}
+
+int SequenceFrameSource::height() const
+{
+	return scenes_.empty() ? 0 : scenes_[0]->height();
+}
+
+int SequenceFrameSource::fps() const
+{
+	return scenes_.empty() ? 0 : scenes_[0]->fps();
+}
+
+bool SequenceFrameSource::Read(I420Frame* frame)
+{
+	for (; scene_ < scenes_.size(); scene_++)
+	{
+		auto& scene = *scenes_[scene_];
+		if (scene.width() == width() && scene.height() == height() && scene.Read(frame))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void SequenceFrameSource::Rewind()
+{
+	for (auto& scene : scenes_)
+	{
+		scene->Rewind();
+	}
+
+	scene_ = 0;
+}
+
+Y4mFrameSource::Y4mFrameSource() :
+	in_(nullptr),
+	width_(0),
+	height_(0),
+	fps_(0)
+{
+}
+
+bool Y4mFrameSource::Open(const std::string& path)
+{
+	std::unique_ptr<std::ifstream> file(new std::ifstream(path, std::ios::binary));
+	if (!file->is_open())
+	{
+		return false;
+	}
+
+	file_ = std::move(file);
+	in_ = file_.get();
+	return ReadHeader();
+}
+
+bool Y4mFrameSource::Open(std::istream* stream)
+{
+	file_.reset();
+	in_ = stream;
+	return ReadHeader();
+}
+
+int Y4mFrameSource::width() const
+{
+	return width_;
+}
+
+int Y4mFrameSource::height() const
+{
+	return height_;
+}
+
+int Y4mFrameSource::fps() const
+{
+	return fps_;
+}
+
+bool Y4mFrameSource::Read(I420Frame* frame)
+{
+	if (!in_ || width_ == 0)
+	{
+		return false;
+	}
+
+	// a frame header may carry parameters, which apply to that frame alone and are ignored
+	std::string line;
+	if (!ReadLine(*in_, &line) || line.compare(0, sizeof(kY4mFrame) - 1, kY4mFrame) != 0)
+	{
+		return false;
+	}
+
+	frame->Allocate(width_, height_);
+	in_->read(reinterpret_cast<char*>(frame->data(0)), frame->size());
+	return static_cast<size_t>(in_->gcount()) == frame->size();
+}
+
+void Y4mFrameSource::Rewind()
+{
+	if (in_)
+	{
+		in_->clear();
+		in_->seekg(first_frame_);
+	}
+}
+
+bool Y4mFrameSource::ReadHeader()
+{
+	width_ = 0;
+	height_ = 0;
+	fps_ = 0;
+
+	std::string line;
+	if (!ReadLine(*in_, &line) || line.compare(0, sizeof(kY4mMagic) - 1, kY4mMagic) != 0)
+	{
+		return false;
+	}
+
+	// parameters are a letter and a value each, separated by spaces
+	int width = 0;
+	int height = 0;
+	int fps = 30;
+	std::istringstream parameters(line.substr(sizeof(kY4mMagic) - 1));
+	std::string parameter;
+	while (parameters >> parameter)
+	{
+		auto value = parameter.substr(1);
+		switch (parameter[0])
+		{
+		case 'W':
+			width = atoi(value.c_str());
+			break;
+		case 'H':
+			height = atoi(value.c_str());
+			break;
+		case 'F':
+		{
+			auto colon = value.find(':');
+			auto numerator = atoi(value.c_str());
+			auto denominator = colon == std::string::npos ? 1 : atoi(value.c_str() + colon + 1);
+			fps = denominator > 0 ? (numerator + denominator / 2) / denominator : 0;
+			break;
+		}
+		case 'C':
+			// 420jpeg, 420mpeg2 and 420paldv only differ in where chroma is sited, but 420p10
+			// and the like have wider samples
+			if (value.compare(0, 3, "420") != 0 || (value.size() > 4 && value[3] == 'p' && isdigit(value[4])))
+			{
+				return false;
+			}
+
+			break;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || fps <= 0)
+	{
+		return false;
+	}
+
+	width_ = width;
+	height_ = height;
+	fps_ = fps;
+	first_frame_ = in_->tellg();
+	return true;
+}
@@ -0,0 +1,210 @@
+#include "loss_recovery.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	// More than any backend keeps as references, so the window always reaches back to the
+	// oldest frame a peer could recover to
+	const size_t kMaxSent = 64;
+}
+
+const char* const LossRecovery::kMessageType = "frame-loss";
+
+LossRecovery::LossRecovery(const Options& options) :
+	options_(options),
+	keyframe_requested_(false),
+	report_pending_(false),
+	report_us_(0),
+	recovered_to_us_(-1),
+	frames_since_recovery_(0)
+{
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+bool LossRecovery::ParseReport(const char* body, size_t size, int64_t* last_good_us)
+{
+	size_t i = 0;
+	auto negative = size > 0 && body[0] == '-';
+	i += negative ? 1 : 0;
+	if (i == size || size - i > 18)
+	{
+		return false;
+	}
+
+	int64_t value = 0;
+	for (; i < size; i++)
+	{
+		if (body[i] < '0' || body[i] > '9')
+		{
+			return false;
+		}
+
+		value = value * 10 + (body[i] - '0');
+	}
+
+	*last_good_us = negative ? -value : value;
+	return true;
+}
+
+void LossRecovery::OnLastGoodFrame(int64_t timestamp_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.reports++;
+	if (timestamp_us < 0)
+	{
+		keyframe_requested_ = true;
+		return;
+	}
+
+	QueueReport(timestamp_us);
+}
+
+void LossRecovery::OnFrameLost(int64_t timestamp_us)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.reports++;
+
+	// without the frame before it, or if it was an IDR, there's nothing to recover to
+	auto lost = Find(timestamp_us);
+	if (lost == sent_.end() || lost == sent_.begin() || lost->keyframe)
+	{
+		keyframe_requested_ = true;
+		return;
+	}
+
+	QueueReport((lost - 1)->timestamp_us);
+}
+
+void LossRecovery::RequestKeyframe()
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.reports++;
+	keyframe_requested_ = true;
+}
+
+void LossRecovery::Apply(EncoderBackend* encoder, EncodeParams* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (report_pending_ && !keyframe_requested_)
+	{
+		if (recovered_to_us_ >= 0 && report_us_ <= recovered_to_us_ && frames_since_recovery_ < options_.grace_frames)
+		{
+			stats_.ignored++;
+		}
+		else if (!Recover(encoder, report_us_))
+		{
+			keyframe_requested_ = true;
+		}
+	}
+
+	report_pending_ = false;
+	if (keyframe_requested_)
+	{
+		keyframe_requested_ = false;
+		params->force_idr = true;
+		recovered_to_us_ = params->timestamp_us;
+		frames_since_recovery_ = 0;
+		stats_.keyframes++;
+	}
+}
+
+void LossRecovery::OnSubmitted(const EncodeParams& params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (params.force_idr)
+	{
+		sent_.clear();
+	}
+
+	Sent sent;
+	sent.timestamp_us = params.timestamp_us;
+	sent.keyframe = params.force_idr;
+	sent.invalidated = false;
+	sent_.push_back(sent);
+	if (sent_.size() > kMaxSent)
+	{
+		sent_.pop_front();
+	}
+
+	frames_since_recovery_++;
+}
+
+void LossRecovery::OnEncoded(const EncodedFrame& frame)
+{
+	if (!frame.keyframe)
+	{
+		return;
+	}
+
+	// nothing before an IDR can be recovered to
+	std::lock_guard<std::mutex> lock(lock_);
+	auto sent = Find(frame.timestamp_us);
+	if (sent != sent_.end())
+	{
+		sent->keyframe = true;
+		sent_.erase(sent_.begin(), sent);
+	}
+}
+
+LossRecovery::Stats LossRecovery::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+bool LossRecovery::Recover(EncoderBackend* encoder, int64_t last_good_us)
+{
+	auto good = Find(last_good_us);
+	if (good == sent_.end())
+	{
+		return false;
+	}
+
+	// the frames after the last good one have pushed it out of the references, or an IDR has
+	auto after = sent_.end() - good - 1;
+	if (after >= encoder->caps().max_references ||
+		std::any_of(good + 1, sent_.end(), [](const Sent& sent) { return sent.keyframe; }))
+	{
+		return false;
+	}
+
+	for (auto sent = good + 1; sent != sent_.end(); ++sent)
+	{
+		if (sent->invalidated)
+		{
+			continue;
+		}
+
+		if (encoder->InvalidateFrame(sent->timestamp_us) != EncoderStatus::kOk)
+		{
+			return false;
+		}
+
+		sent->invalidated = true;
+		stats_.invalidated++;
+	}
+
+	recovered_to_us_ = last_good_us;
+	frames_since_recovery_ = 0;
+	stats_.recovered++;
+	return true;
+}
+
+void LossRecovery::QueueReport(int64_t last_good_us)
+{
+	report_us_ = report_pending_ ? std::min(report_us_, last_good_us) : last_good_us;
+	report_pending_ = true;
+}
+
+std::deque<LossRecovery::Sent>::iterator LossRecovery::Find(int64_t timestamp_us)
+{
+	// timestamps increase, so the frame is where it sorts
+	auto sent = std::lower_bound(sent_.begin(), sent_.end(), timestamp_us, [](const Sent& candidate, int64_t value)
+	{
+		return candidate.timestamp_us < value;
+	});
+
+	return sent != sent_.end() && sent->timestamp_us == timestamp_us ? sent : sent_.end();
+}
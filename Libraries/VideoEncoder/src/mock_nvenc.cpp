@@ -0,0 +1,931 @@
+#include "mock_nvenc.h"
+
+#include "completion_event.h"
+
+#include <algorithm>
+#include <set>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+	const uint8_t kStartCode[] = { 0, 0, 0, 1 };
+
+	// Baseline profile, level 3.1, and a matching picture parameter set
+	const uint8_t kSequenceParameterSet[] = { 0x67, 0x42, 0xC0, 0x1F, 0xDA, 0x01, 0x40, 0x16 };
+	const uint8_t kPictureParameterSet[] = { 0x68, 0xCE, 0x3C, 0x80 };
+
+	const uint8_t kIdrSlice = 0x65;
+	const uint8_t kSlice = 0x41;
+
+	// How much bigger an IDR is than the average picture
+	const uint32_t kKeyframeScale = 4;
+
+	// Emulation prevention never kicks in for a payload of this
+	const uint8_t kFiller = 0xAA;
+
+	void AppendNal(const uint8_t* nal, size_t size, std::vector<uint8_t>* out)
+	{
+		out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+		out->insert(out->end(), nal, nal + size);
+	}
+}
+
+struct MockNvenc::InputBuffer
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	NV_ENC_BUFFER_FORMAT format;
+	std::vector<uint8_t> data;
+};
+
+struct MockNvenc::Bitstream
+{
+	std::vector<uint8_t> data;
+	uint32_t capacity;
+
+	// Encoded and not yet unlocked
+	bool pending;
+
+	Clock::time_point ready_at;
+	uint32_t frame_index;
+	uint64_t timestamp;
+	bool keyframe;
+	uint32_t qp;
+
+	// Set when the picture is encoded, in asynchronous mode
+	void* event;
+};
+
+struct MockNvenc::Session
+{
+	MockNvenc* owner;
+	int index;
+	bool initialized;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t max_width;
+	uint32_t max_height;
+	uint32_t fps_num;
+	uint32_t fps_den;
+	NV_ENC_PARAMS_RC_MODE rate_control;
+	uint32_t bitrate;
+	uint32_t qp;
+	uint32_t gop_length;
+
+	bool force_idr;
+	uint32_t since_idr;
+	uint32_t in_flight;
+
+	bool async;
+	std::set<void*> events;
+
+	std::set<InputBuffer*> inputs;
+	std::set<Bitstream*> bitstreams;
+};
+
+MockNvenc::MockNvenc(const Options& options) :
+	options_(options),
+	next_session_(0),
+	stopping_(false)
+{
+	memset(&stats_, 0, sizeof(stats_));
+	engines_free_.assign(std::max(1, options_.engines), Clock::now());
+
+	memset(&functions_, 0, sizeof(functions_));
+	functions_.version = NV_ENCODE_API_FUNCTION_LIST_VER;
+	functions_.nvEncOpenEncodeSessionEx = &MockNvenc::OpenEncodeSessionEx;
+	functions_.nvEncGetEncodePresetConfig = &MockNvenc::GetEncodePresetConfig;
+	functions_.nvEncInitializeEncoder = &MockNvenc::InitializeEncoder;
+	functions_.nvEncCreateInputBuffer = &MockNvenc::CreateInputBuffer;
+	functions_.nvEncDestroyInputBuffer = &MockNvenc::DestroyInputBuffer;
+	functions_.nvEncCreateBitstreamBuffer = &MockNvenc::CreateBitstreamBuffer;
+	functions_.nvEncDestroyBitstreamBuffer = &MockNvenc::DestroyBitstreamBuffer;
+	functions_.nvEncLockInputBuffer = &MockNvenc::LockInputBuffer;
+	functions_.nvEncUnlockInputBuffer = &MockNvenc::UnlockInputBuffer;
+	functions_.nvEncEncodePicture = &MockNvenc::EncodePictureEntry;
+	functions_.nvEncLockBitstream = &MockNvenc::LockBitstreamEntry;
+	functions_.nvEncUnlockBitstream = &MockNvenc::UnlockBitstreamEntry;
+	functions_.nvEncDestroyEncoder = &MockNvenc::DestroyEncoder;
+	functions_.nvEncReconfigureEncoder = &MockNvenc::ReconfigureEncoder;
+	functions_.nvEncInvalidateRefFrames = &MockNvenc::InvalidateRefFramesEntry;
+	functions_.nvEncRegisterAsyncEvent = &MockNvenc::RegisterAsyncEvent;
+	functions_.nvEncUnregisterAsyncEvent = &MockNvenc::UnregisterAsyncEvent;
+}
+
+MockNvenc::~MockNvenc()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stopping_ = true;
+	}
+
+	signals_cv_.notify_all();
+	if (signaler_.joinable())
+	{
+		signaler_.join();
+	}
+
+	for (auto session : sessions_)
+	{
+		for (auto input : session->inputs)
+		{
+			delete input;
+		}
+
+		for (auto bitstream : session->bitstreams)
+		{
+			delete bitstream;
+		}
+
+		delete session;
+	}
+}
+
+const NV_ENCODE_API_FUNCTION_LIST& MockNvenc::functions() const
+{
+	return functions_;
+}
+
+void* MockNvenc::device()
+{
+	return this;
+}
+
+void MockNvenc::set_options(const Options& options)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	options_ = options;
+	engines_free_.resize(std::max(1, options_.engines), Clock::now());
+}
+
+void MockNvenc::FailNext(const std::string& function, NVENCSTATUS status, int count)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	failures_[function] = std::make_pair(status, count);
+}
+
+MockNvenc::Stats MockNvenc::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+std::vector<MockNvenc::Picture> MockNvenc::pictures() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return pictures_;
+}
+
+std::vector<uint64_t> MockNvenc::invalidated() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return invalidated_;
+}
+
+bool MockNvenc::Fail(const char* function, NVENCSTATUS* status)
+{
+	auto failure = failures_.find(function);
+	if (failure == failures_.end())
+	{
+		return false;
+	}
+
+	*status = failure->second.first;
+	if (--failure->second.second <= 0)
+	{
+		failures_.erase(failure);
+	}
+
+	stats_.failures++;
+	return true;
+}
+
+NVENCSTATUS MockNvenc::OpenSession(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS* params, void** encoder)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncOpenEncodeSessionEx", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS_VER || params->apiVersion != NVENCAPI_VERSION)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	if (options_.max_sessions > 0 && stats_.sessions_open >= options_.max_sessions)
+	{
+		return NV_ENC_ERR_OUT_OF_MEMORY;
+	}
+
+	auto session = new Session();
+	session->owner = this;
+	session->index = next_session_++;
+	session->initialized = false;
+	session->force_idr = false;
+	session->since_idr = 0;
+	session->in_flight = 0;
+	session->async = false;
+	sessions_.insert(session);
+
+	stats_.sessions_open++;
+	stats_.peak_sessions = std::max(stats_.peak_sessions, stats_.sessions_open);
+	*encoder = session;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::DestroySession(Session* session)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncDestroyEncoder", &status))
+	{
+		return status;
+	}
+
+	for (auto input : session->inputs)
+	{
+		delete input;
+	}
+
+	for (auto bitstream : session->bitstreams)
+	{
+		delete bitstream;
+	}
+
+	CancelSignals(session, nullptr);
+	stats_.async_events -= static_cast<int>(session->events.size());
+	sessions_.erase(session);
+	delete session;
+	stats_.sessions_open--;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::InitializeSession(Session* session, const NV_ENC_INITIALIZE_PARAMS* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncInitializeEncoder", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_INITIALIZE_PARAMS_VER ||
+		(params->encodeConfig != nullptr && params->encodeConfig->version != NV_ENC_CONFIG_VER))
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	if (params->encodeWidth == 0 || params->encodeHeight == 0 || params->frameRateNum == 0 ||
+		params->frameRateDen == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	session->async = params->enableEncodeAsync != 0;
+	session->width = params->encodeWidth;
+	session->height = params->encodeHeight;
+	session->max_width = std::max(params->maxEncodeWidth, params->encodeWidth);
+	session->max_height = std::max(params->maxEncodeHeight, params->encodeHeight);
+	session->fps_num = params->frameRateNum;
+	session->fps_den = params->frameRateDen;
+	session->rate_control = NV_ENC_PARAMS_RC_CBR;
+	session->bitrate = 5000000;
+	session->qp = 26;
+	session->gop_length = NVENC_INFINITE_GOPLENGTH;
+	if (params->encodeConfig != nullptr)
+	{
+		const auto& rc = params->encodeConfig->rcParams;
+		session->rate_control = rc.rateControlMode;
+		session->bitrate = rc.averageBitRate;
+		session->qp = rc.constQP.qpInterP;
+		session->gop_length = params->encodeConfig->gopLength;
+	}
+
+	session->initialized = true;
+	session->force_idr = true;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::EncodePicture(Session* session, NV_ENC_PIC_PARAMS* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncEncodePicture", &status))
+	{
+		return status;
+	}
+
+	if (!session->initialized)
+	{
+		return NV_ENC_ERR_ENCODER_NOT_INITIALIZED;
+	}
+
+	if (params->version != NV_ENC_PIC_PARAMS_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	auto input = static_cast<InputBuffer*>(params->inputBuffer);
+	auto bitstream = static_cast<Bitstream*>(params->outputBitstream);
+	if (session->inputs.count(input) == 0 || session->bitstreams.count(bitstream) == 0 || bitstream->pending ||
+		params->inputWidth != session->width || params->inputHeight != session->height ||
+		input->width < session->width || input->height < session->height ||
+		(session->async && session->events.count(params->completionEvent) == 0))
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	if (session->in_flight >= options_.max_in_flight)
+	{
+		stats_.busy++;
+		return NV_ENC_ERR_ENCODER_BUSY;
+	}
+
+	auto keyframe = session->force_idr || (params->encodePicFlags & NV_ENC_PIC_FLAG_FORCEIDR) != 0 ||
+		(session->gop_length != NVENC_INFINITE_GOPLENGTH && session->since_idr >= session->gop_length);
+
+	uint64_t size;
+	if (session->rate_control == NV_ENC_PARAMS_RC_CONSTQP)
+	{
+		size = (static_cast<uint64_t>(session->width) * session->height * 3 / 2 / 8) >> (session->qp / 6);
+	}
+	else
+	{
+		size = static_cast<uint64_t>(session->bitrate) * session->fps_den / session->fps_num / 8;
+	}
+
+	size = std::max<uint64_t>(size * (keyframe ? kKeyframeScale : 1), 16);
+
+	bitstream->data.clear();
+	if (keyframe || (params->encodePicFlags & NV_ENC_PIC_FLAG_OUTPUT_SPSPPS) != 0)
+	{
+		AppendNal(kSequenceParameterSet, sizeof(kSequenceParameterSet), &bitstream->data);
+		AppendNal(kPictureParameterSet, sizeof(kPictureParameterSet), &bitstream->data);
+	}
+
+	auto slice = keyframe ? kIdrSlice : kSlice;
+	AppendNal(&slice, 1, &bitstream->data);
+	if (bitstream->data.size() < size)
+	{
+		bitstream->data.resize(static_cast<size_t>(size), kFiller);
+	}
+
+	if (bitstream->data.size() > bitstream->capacity)
+	{
+		return NV_ENC_ERR_NOT_ENOUGH_BUFFER;
+	}
+
+	// the picture waits for the engine that frees up first
+	auto engine = std::min_element(engines_free_.begin(), engines_free_.end());
+	auto start = std::max(*engine, Clock::now());
+	*engine = start + std::chrono::microseconds(options_.encode_latency_us);
+
+	bitstream->pending = true;
+	bitstream->ready_at = *engine;
+	bitstream->frame_index = params->frameIdx;
+	bitstream->timestamp = params->inputTimeStamp;
+	bitstream->keyframe = keyframe;
+	bitstream->qp = session->rate_control == NV_ENC_PARAMS_RC_CONSTQP ? session->qp : 26;
+	bitstream->event = session->async ? params->completionEvent : nullptr;
+	if (bitstream->event != nullptr)
+	{
+		if (!signaler_.joinable())
+		{
+			signaler_ = std::thread(&MockNvenc::SignalLoop, this);
+		}
+
+		signals_.insert(std::make_pair(bitstream->ready_at, std::make_pair(session, bitstream->event)));
+		signals_cv_.notify_all();
+	}
+
+	session->force_idr = false;
+	session->since_idr = keyframe ? 1 : session->since_idr + 1;
+	session->in_flight++;
+
+	Picture picture;
+	picture.session = session->index;
+	picture.frame_index = params->frameIdx;
+	picture.timestamp = params->inputTimeStamp;
+	picture.keyframe = keyframe;
+	picture.width = session->width;
+	picture.height = session->height;
+	picture.size = static_cast<uint32_t>(bitstream->data.size());
+	pictures_.push_back(picture);
+
+	stats_.pictures++;
+	stats_.keyframes += keyframe ? 1 : 0;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::LockBitstream(Session* session, NV_ENC_LOCK_BITSTREAM* params)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	if (params->version != NV_ENC_LOCK_BITSTREAM_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	auto bitstream = static_cast<Bitstream*>(params->outputBitstream);
+	if (session->bitstreams.count(bitstream) == 0 || !bitstream->pending)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	// a scripted failure stands for the picture failing, which frees its buffer as unlocking would
+	NVENCSTATUS status;
+	if (Fail("nvEncLockBitstream", &status))
+	{
+		bitstream->pending = false;
+		session->in_flight--;
+		return status;
+	}
+
+	auto ready_at = bitstream->ready_at;
+	if (Clock::now() < ready_at)
+	{
+		stats_.early_locks += session->async ? 1 : 0;
+		if (params->doNotWait)
+		{
+			return NV_ENC_ERR_LOCK_BUSY;
+		}
+
+		lock.unlock();
+		std::this_thread::sleep_until(ready_at);
+		lock.lock();
+	}
+
+	params->bitstreamBufferPtr = bitstream->data.data();
+	params->bitstreamSizeInBytes = static_cast<uint32_t>(bitstream->data.size());
+	params->frameIdx = bitstream->frame_index;
+	params->outputTimeStamp = bitstream->timestamp;
+	params->pictureType = bitstream->keyframe ? NV_ENC_PIC_TYPE_IDR : NV_ENC_PIC_TYPE_P;
+	params->pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+	params->frameAvgQP = bitstream->qp;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::UnlockBitstream(Session* session, Bitstream* bitstream)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncUnlockBitstream", &status))
+	{
+		return status;
+	}
+
+	if (session->bitstreams.count(bitstream) == 0 || !bitstream->pending)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	bitstream->pending = false;
+	session->in_flight--;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::Reconfigure(Session* session, NV_ENC_RECONFIGURE_PARAMS* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncReconfigureEncoder", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_RECONFIGURE_PARAMS_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	const auto& init = params->reInitEncodeParams;
+	if (!session->initialized || init.encodeWidth == 0 || init.encodeHeight == 0 ||
+		init.encodeWidth > session->max_width || init.encodeHeight > session->max_height ||
+		init.frameRateNum == 0 || init.frameRateDen == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	// a new resolution needs new parameter sets, so the stream restarts with an IDR
+	auto resized = init.encodeWidth != session->width || init.encodeHeight != session->height;
+	session->width = init.encodeWidth;
+	session->height = init.encodeHeight;
+	session->fps_num = init.frameRateNum;
+	session->fps_den = init.frameRateDen;
+	if (init.encodeConfig != nullptr)
+	{
+		const auto& rc = init.encodeConfig->rcParams;
+		session->rate_control = rc.rateControlMode;
+		session->bitrate = rc.averageBitRate;
+		session->qp = rc.constQP.qpInterP;
+		session->gop_length = init.encodeConfig->gopLength;
+	}
+
+	session->force_idr = session->force_idr || resized || params->forceIDR || params->resetEncoder;
+	stats_.reconfigures++;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::InvalidateRefFrames(Session* session, uint64_t timestamp)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncInvalidateRefFrames", &status))
+	{
+		return status;
+	}
+
+	if (!session->initialized)
+	{
+		return NV_ENC_ERR_ENCODER_NOT_INITIALIZED;
+	}
+
+	invalidated_.push_back(timestamp);
+	stats_.invalidations++;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::RegisterEvent(Session* session, NV_ENC_EVENT_PARAMS* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	NVENCSTATUS status;
+	if (Fail("nvEncRegisterAsyncEvent", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_EVENT_PARAMS_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	if (params->completionEvent == nullptr || !session->events.insert(params->completionEvent).second)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	stats_.async_events++;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS MockNvenc::UnregisterEvent(Session* session, NV_ENC_EVENT_PARAMS* params)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (params->version != NV_ENC_EVENT_PARAMS_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	if (session->events.erase(params->completionEvent) == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	// the event may be destroyed as soon as it's unregistered
+	CancelSignals(session, params->completionEvent);
+	stats_.async_events--;
+	return NV_ENC_SUCCESS;
+}
+
+void MockNvenc::CancelSignals(Session* session, void* event)
+{
+	for (auto signal = signals_.begin(); signal != signals_.end();)
+	{
+		if (signal->second.first == session && (event == nullptr || signal->second.second == event))
+		{
+			signal = signals_.erase(signal);
+		}
+		else
+		{
+			++signal;
+		}
+	}
+}
+
+void MockNvenc::SignalLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (!stopping_)
+	{
+		if (signals_.empty())
+		{
+			signals_cv_.wait(lock);
+			continue;
+		}
+
+		auto next = signals_.begin();
+		if (Clock::now() < next->first)
+		{
+			signals_cv_.wait_until(lock, next->first);
+			continue;
+		}
+
+		// set under the lock, so an event can't be unregistered and destroyed while it's being set
+		CompletionEvent::Signal(next->second.second);
+		signals_.erase(next);
+	}
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::OpenEncodeSessionEx(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS* params, void** encoder)
+{
+	if (params == nullptr || encoder == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	if (params->device == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_DEVICE;
+	}
+
+	return static_cast<MockNvenc*>(params->device)->OpenSession(params, encoder);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::GetEncodePresetConfig(void* encoder, GUID, GUID, NV_ENC_PRESET_CONFIG* config)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || config == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(session->owner->lock_);
+		NVENCSTATUS status;
+		if (session->owner->Fail("nvEncGetEncodePresetConfig", &status))
+		{
+			return status;
+		}
+	}
+
+	if (config->version != NV_ENC_PRESET_CONFIG_VER || config->presetCfg.version != NV_ENC_CONFIG_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	config->presetCfg.profileGUID = NV_ENC_H264_PROFILE_BASELINE_GUID;
+	config->presetCfg.gopLength = NVENC_INFINITE_GOPLENGTH;
+	config->presetCfg.frameIntervalP = 1;
+	config->presetCfg.frameFieldMode = NV_ENC_PARAMS_FRAME_FIELD_MODE_FRAME;
+	config->presetCfg.rcParams.version = NV_ENC_RC_PARAMS_VER;
+	config->presetCfg.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR;
+	config->presetCfg.rcParams.averageBitRate = 5000000;
+	config->presetCfg.rcParams.constQP.qpInterP = 26;
+	config->presetCfg.rcParams.constQP.qpInterB = 26;
+	config->presetCfg.rcParams.constQP.qpIntra = 26;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::InitializeEncoder(void* encoder, NV_ENC_INITIALIZE_PARAMS* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->InitializeSession(session, params);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::CreateInputBuffer(void* encoder, NV_ENC_CREATE_INPUT_BUFFER* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	NVENCSTATUS status;
+	if (session->owner->Fail("nvEncCreateInputBuffer", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_CREATE_INPUT_BUFFER_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	if (params->width == 0 || params->height == 0 ||
+		(params->bufferFmt != NV_ENC_BUFFER_FORMAT_IYUV && params->bufferFmt != NV_ENC_BUFFER_FORMAT_NV12))
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	auto input = new InputBuffer();
+	input->width = params->width;
+	input->height = params->height;
+	input->pitch = (params->width + 31) & ~31u;
+	input->format = params->bufferFmt;
+	input->data.resize(static_cast<size_t>(input->pitch) * params->height * 3 / 2);
+	session->inputs.insert(input);
+
+	params->inputBuffer = input;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::DestroyInputBuffer(void* encoder, NV_ENC_INPUT_PTR buffer)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	auto input = static_cast<InputBuffer*>(buffer);
+	if (session->inputs.erase(input) == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	delete input;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::CreateBitstreamBuffer(void* encoder, NV_ENC_CREATE_BITSTREAM_BUFFER* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	NVENCSTATUS status;
+	if (session->owner->Fail("nvEncCreateBitstreamBuffer", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_CREATE_BITSTREAM_BUFFER_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	auto bitstream = new Bitstream();
+	bitstream->capacity = params->size;
+	bitstream->pending = false;
+	bitstream->event = nullptr;
+	bitstream->data.reserve(params->size);
+	session->bitstreams.insert(bitstream);
+
+	params->bitstreamBuffer = bitstream;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::DestroyBitstreamBuffer(void* encoder, NV_ENC_OUTPUT_PTR buffer)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	auto bitstream = static_cast<Bitstream*>(buffer);
+	if (session->bitstreams.erase(bitstream) == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	session->in_flight -= bitstream->pending ? 1 : 0;
+	delete bitstream;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::LockInputBuffer(void* encoder, NV_ENC_LOCK_INPUT_BUFFER* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	NVENCSTATUS status;
+	if (session->owner->Fail("nvEncLockInputBuffer", &status))
+	{
+		return status;
+	}
+
+	if (params->version != NV_ENC_LOCK_INPUT_BUFFER_VER)
+	{
+		return NV_ENC_ERR_INVALID_VERSION;
+	}
+
+	auto input = static_cast<InputBuffer*>(params->inputBuffer);
+	if (session->inputs.count(input) == 0)
+	{
+		return NV_ENC_ERR_INVALID_PARAM;
+	}
+
+	params->bufferDataPtr = input->data.data();
+	params->pitch = input->pitch;
+	return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::UnlockInputBuffer(void* encoder, NV_ENC_INPUT_PTR buffer)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	std::lock_guard<std::mutex> lock(session->owner->lock_);
+	return session->inputs.count(static_cast<InputBuffer*>(buffer)) != 0 ? NV_ENC_SUCCESS : NV_ENC_ERR_INVALID_PARAM;
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::EncodePictureEntry(void* encoder, NV_ENC_PIC_PARAMS* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->EncodePicture(session, params);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::LockBitstreamEntry(void* encoder, NV_ENC_LOCK_BITSTREAM* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->LockBitstream(session, params);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::UnlockBitstreamEntry(void* encoder, NV_ENC_OUTPUT_PTR buffer)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->UnlockBitstream(session, static_cast<Bitstream*>(buffer));
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::DestroyEncoder(void* encoder)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->DestroySession(session);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::ReconfigureEncoder(void* encoder, NV_ENC_RECONFIGURE_PARAMS* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->Reconfigure(session, params);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::InvalidateRefFramesEntry(void* encoder, uint64_t timestamp)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->InvalidateRefFrames(session, timestamp);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::RegisterAsyncEvent(void* encoder, NV_ENC_EVENT_PARAMS* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->RegisterEvent(session, params);
+}
+
+NVENCSTATUS NVENCAPI MockNvenc::UnregisterAsyncEvent(void* encoder, NV_ENC_EVENT_PARAMS* params)
+{
+	auto session = static_cast<Session*>(encoder);
+	if (session == nullptr || params == nullptr)
+	{
+		return NV_ENC_ERR_INVALID_PTR;
+	}
+
+	return session->owner->UnregisterEvent(session, params);
+}
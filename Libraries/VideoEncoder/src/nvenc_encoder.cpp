@@ -0,0 +1,652 @@
+#include "nvenc_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+	typedef NVENCSTATUS (NVENCAPI *CreateInstanceProc)(NV_ENCODE_API_FUNCTION_LIST*);
+
+	// Big enough for an IDR at any quantizer, as the SDK samples size theirs
+	const uint32_t kMinBitstreamSize = 2 * 1024 * 1024;
+
+	const int kMaxQueueDepth = 16;
+
+	// The most H.264 allows
+	const int kMaxReferences = 16;
+
+	// How often Retrieve polls a bitstream that isn't ready, when it has a timeout
+	const std::chrono::microseconds kPollInterval(500);
+
+	GUID PresetGuid(EncoderPreset preset)
+	{
+		switch (preset)
+		{
+		case EncoderPreset::kLowLatencyHighPerformance:
+			return NV_ENC_PRESET_LOW_LATENCY_HP_GUID;
+		case EncoderPreset::kHighQuality:
+			return NV_ENC_PRESET_HQ_GUID;
+		case EncoderPreset::kHighPerformance:
+			return NV_ENC_PRESET_HP_GUID;
+		case EncoderPreset::kLossless:
+			return NV_ENC_PRESET_LOSSLESS_HP_GUID;
+		default:
+			return NV_ENC_PRESET_LOW_LATENCY_HQ_GUID;
+		}
+	}
+}
+
+bool NvencEncoder::LoadFunctions(NV_ENCODE_API_FUNCTION_LIST* functions)
+{
+	// the library stays loaded for the life of the process, as the driver expects
+#if defined(_WIN32)
+#if defined(_WIN64)
+	static HMODULE library = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
+#else
+	static HMODULE library = LoadLibrary(TEXT("nvEncodeAPI.dll"));
+#endif
+	if (library == nullptr)
+	{
+		return false;
+	}
+
+	auto create_instance = reinterpret_cast<CreateInstanceProc>(GetProcAddress(library, "NvEncodeAPICreateInstance"));
+#else
+	static void* library = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
+	if (library == nullptr)
+	{
+		return false;
+	}
+
+	auto create_instance = reinterpret_cast<CreateInstanceProc>(dlsym(library, "NvEncodeAPICreateInstance"));
+#endif
+	if (create_instance == nullptr)
+	{
+		return false;
+	}
+
+	memset(functions, 0, sizeof(*functions));
+	functions->version = NV_ENCODE_API_FUNCTION_LIST_VER;
+	return create_instance(functions) == NV_ENC_SUCCESS;
+}
+
+EncoderStatus NvencEncoder::ToEncoderStatus(NVENCSTATUS status)
+{
+	switch (status)
+	{
+	case NV_ENC_SUCCESS:
+	case NV_ENC_ERR_NEED_MORE_INPUT:
+		return EncoderStatus::kOk;
+	case NV_ENC_ERR_ENCODER_BUSY:
+		return EncoderStatus::kBusy;
+	case NV_ENC_ERR_LOCK_BUSY:
+		return EncoderStatus::kTimeout;
+	case NV_ENC_ERR_INVALID_PARAM:
+	case NV_ENC_ERR_INVALID_PTR:
+	case NV_ENC_ERR_INVALID_VERSION:
+	case NV_ENC_ERR_NOT_ENOUGH_BUFFER:
+		return EncoderStatus::kInvalidParam;
+	case NV_ENC_ERR_UNSUPPORTED_PARAM:
+	case NV_ENC_ERR_UNSUPPORTED_DEVICE:
+	case NV_ENC_ERR_UNIMPLEMENTED:
+		return EncoderStatus::kUnsupported;
+	case NV_ENC_ERR_ENCODER_NOT_INITIALIZED:
+		return EncoderStatus::kNotInitialized;
+	default:
+		return EncoderStatus::kDeviceError;
+	}
+}
+
+NvencEncoder::NvencEncoder(const NV_ENCODE_API_FUNCTION_LIST& functions,
+	void* device,
+	NV_ENC_DEVICE_TYPE device_type,
+	bool async) :
+	functions_(functions),
+	device_(device),
+	device_type_(device_type),
+	async_(async),
+	async_session_(false),
+	encoder_(nullptr),
+	last_status_(NV_ENC_SUCCESS),
+	submitted_(0),
+	retrieved_(0)
+{
+}
+
+NvencEncoder::~NvencEncoder()
+{
+	Shutdown();
+}
+
+const char* NvencEncoder::name() const
+{
+	return "nvenc";
+}
+
+EncoderCaps NvencEncoder::caps() const
+{
+	EncoderCaps caps;
+	caps.hardware = true;
+	caps.max_width = 4096;
+	caps.max_height = 4096;
+	caps.max_queue_depth = kMaxQueueDepth;
+	caps.max_references = kMaxReferences;
+	return caps;
+}
+
+EncoderStatus NvencEncoder::Initialize(const EncoderConfig& config)
+{
+	Shutdown();
+	if (!IsValid(config))
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	auto sized = config;
+	sized.max_width = std::max(config.max_width, config.width);
+	sized.max_height = std::max(config.max_height, config.height);
+	if (sized.max_width > caps().max_width || sized.max_height > caps().max_height)
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS session_params;
+	memset(&session_params, 0, sizeof(session_params));
+	session_params.version = NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS_VER;
+	session_params.device = device_;
+	session_params.deviceType = device_type_;
+	session_params.apiVersion = NVENCAPI_VERSION;
+
+	auto status = functions_.nvEncOpenEncodeSessionEx(&session_params, &encoder_);
+	if (status != NV_ENC_SUCCESS)
+	{
+		// the driver runs out of sessions before it runs out of memory
+		encoder_ = nullptr;
+		Check(status);
+		return status == NV_ENC_ERR_OUT_OF_MEMORY ? EncoderStatus::kSessionLimit : ToEncoderStatus(status);
+	}
+
+	async_session_ = async_ && SupportsAsync();
+
+	NV_ENC_INITIALIZE_PARAMS init_params;
+	NV_ENC_CONFIG encode_config;
+	auto result = Configure(sized, &init_params, &encode_config);
+	if (result == EncoderStatus::kOk)
+	{
+		result = Check(functions_.nvEncInitializeEncoder(encoder_, &init_params));
+	}
+
+	auto bitstream_size = std::max<uint32_t>(kMinBitstreamSize, sized.max_width * sized.max_height * 2);
+	slots_.resize(sized.queue_depth);
+	for (auto& slot : slots_)
+	{
+		slot.input = nullptr;
+		slot.bitstream = nullptr;
+		if (result != EncoderStatus::kOk)
+		{
+			continue;
+		}
+
+		NV_ENC_CREATE_INPUT_BUFFER input;
+		memset(&input, 0, sizeof(input));
+		input.version = NV_ENC_CREATE_INPUT_BUFFER_VER;
+		input.width = sized.max_width;
+		input.height = sized.max_height;
+		input.memoryHeap = NV_ENC_MEMORY_HEAP_SYSMEM_CACHED;
+		input.bufferFmt = NV_ENC_BUFFER_FORMAT_IYUV;
+		result = Check(functions_.nvEncCreateInputBuffer(encoder_, &input));
+		slot.input = result == EncoderStatus::kOk ? input.inputBuffer : nullptr;
+		if (result != EncoderStatus::kOk)
+		{
+			continue;
+		}
+
+		NV_ENC_CREATE_BITSTREAM_BUFFER bitstream;
+		memset(&bitstream, 0, sizeof(bitstream));
+		bitstream.version = NV_ENC_CREATE_BITSTREAM_BUFFER_VER;
+		bitstream.size = bitstream_size;
+		bitstream.memoryHeap = NV_ENC_MEMORY_HEAP_SYSMEM_CACHED;
+		result = Check(functions_.nvEncCreateBitstreamBuffer(encoder_, &bitstream));
+		slot.bitstream = result == EncoderStatus::kOk ? bitstream.bitstreamBuffer : nullptr;
+		if (result != EncoderStatus::kOk || !async_session_)
+		{
+			continue;
+		}
+
+		std::unique_ptr<CompletionEvent> event(new CompletionEvent());
+		NV_ENC_EVENT_PARAMS event_params;
+		memset(&event_params, 0, sizeof(event_params));
+		event_params.version = NV_ENC_EVENT_PARAMS_VER;
+		event_params.completionEvent = event->handle();
+		result = Check(functions_.nvEncRegisterAsyncEvent(encoder_, &event_params));
+		if (result == EncoderStatus::kOk)
+		{
+			slot.event = std::move(event);
+		}
+	}
+
+	if (result != EncoderStatus::kOk)
+	{
+		Shutdown();
+		return result;
+	}
+
+	config_ = sized;
+	return EncoderStatus::kOk;
+}
+
+void NvencEncoder::Shutdown()
+{
+	if (encoder_ == nullptr)
+	{
+		return;
+	}
+
+	// frames still in flight are dropped along with their buffers
+	for (auto& slot : slots_)
+	{
+		if (slot.input != nullptr)
+		{
+			functions_.nvEncDestroyInputBuffer(encoder_, slot.input);
+		}
+
+		if (slot.bitstream != nullptr)
+		{
+			functions_.nvEncDestroyBitstreamBuffer(encoder_, slot.bitstream);
+		}
+
+		if (slot.event)
+		{
+			NV_ENC_EVENT_PARAMS event_params;
+			memset(&event_params, 0, sizeof(event_params));
+			event_params.version = NV_ENC_EVENT_PARAMS_VER;
+			event_params.completionEvent = slot.event->handle();
+			functions_.nvEncUnregisterAsyncEvent(encoder_, &event_params);
+		}
+	}
+
+	// the events outlive the session, so a picture still encoding can't set one that's gone
+	functions_.nvEncDestroyEncoder(encoder_);
+	encoder_ = nullptr;
+	slots_.clear();
+
+	std::lock_guard<std::mutex> lock(lock_);
+	submitted_ = 0;
+	retrieved_ = 0;
+}
+
+EncoderStatus NvencEncoder::Reconfigure(const EncoderConfig& config)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	if (!IsValid(config))
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	if (config.preset != config_.preset || config.queue_depth != config_.queue_depth ||
+		config.width > config_.max_width || config.height > config_.max_height)
+	{
+		return EncoderStatus::kUnsupported;
+	}
+
+	auto sized = config;
+	sized.max_width = config_.max_width;
+	sized.max_height = config_.max_height;
+
+	NV_ENC_RECONFIGURE_PARAMS params;
+	NV_ENC_CONFIG encode_config;
+	memset(&params, 0, sizeof(params));
+	params.version = NV_ENC_RECONFIGURE_PARAMS_VER;
+	auto result = Configure(sized, &params.reInitEncodeParams, &encode_config);
+	if (result != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	// the parameter sets change with the resolution, so the stream has to restart from an IDR,
+	// but a new bitrate or framerate carries on from the last frame
+	auto resized = sized.width != config_.width || sized.height != config_.height;
+	params.resetEncoder = resized ? 1 : 0;
+	params.forceIDR = resized ? 1 : 0;
+
+	result = Check(functions_.nvEncReconfigureEncoder(encoder_, &params));
+	if (result == EncoderStatus::kOk)
+	{
+		config_ = sized;
+	}
+
+	return result;
+}
+
+EncoderStatus NvencEncoder::Submit(const I420Frame& frame, const EncodeParams& params)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	if (frame.width() != config_.width || frame.height() != config_.height)
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	uint32_t frame_number;
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		if (submitted_ - retrieved_ >= slots_.size())
+		{
+			return EncoderStatus::kBusy;
+		}
+
+		frame_number = submitted_;
+	}
+
+	auto& slot = slots_[frame_number % slots_.size()];
+
+	NV_ENC_LOCK_INPUT_BUFFER input;
+	memset(&input, 0, sizeof(input));
+	input.version = NV_ENC_LOCK_INPUT_BUFFER_VER;
+	input.inputBuffer = slot.input;
+	auto result = Check(functions_.nvEncLockInputBuffer(encoder_, &input));
+	if (result != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	// IYUV is three planes, with the chroma planes at half the luma pitch
+	auto destination = static_cast<uint8_t*>(input.bufferDataPtr);
+	for (int plane = 0; plane < 3; plane++)
+	{
+		auto pitch = plane == 0 ? input.pitch : input.pitch / 2;
+		auto source = frame.data(plane);
+		for (int y = 0; y < frame.PlaneHeight(plane); y++)
+		{
+			memcpy(destination + y * pitch, source + y * frame.PlaneWidth(plane), frame.PlaneWidth(plane));
+		}
+
+		destination += pitch * frame.PlaneHeight(plane);
+	}
+
+	result = Check(functions_.nvEncUnlockInputBuffer(encoder_, slot.input));
+	if (result != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	NV_ENC_PIC_PARAMS picture;
+	memset(&picture, 0, sizeof(picture));
+	picture.version = NV_ENC_PIC_PARAMS_VER;
+	picture.inputBuffer = slot.input;
+	picture.outputBitstream = slot.bitstream;
+	picture.bufferFmt = NV_ENC_BUFFER_FORMAT_IYUV;
+	picture.inputWidth = config_.width;
+	picture.inputHeight = config_.height;
+	picture.inputPitch = input.pitch;
+	picture.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+	picture.frameIdx = frame_number;
+	picture.inputTimeStamp = static_cast<uint64_t>(params.timestamp_us);
+	if (slot.event)
+	{
+		slot.event->Reset();
+		picture.completionEvent = slot.event->handle();
+	}
+
+	if (params.force_idr)
+	{
+		picture.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+	}
+
+	result = Check(functions_.nvEncEncodePicture(encoder_, &picture));
+	if (result != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	slot.frame_number = frame_number;
+	slot.timestamp_us = params.timestamp_us;
+	slot.width = config_.width;
+	slot.height = config_.height;
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		submitted_++;
+	}
+
+	submitted_cv_.notify_all();
+	return EncoderStatus::kOk;
+}
+
+EncoderStatus NvencEncoder::InvalidateFrame(int64_t timestamp_us)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	// matched against the inputTimeStamp each picture was submitted with
+	return Check(functions_.nvEncInvalidateRefFrames(encoder_, static_cast<uint64_t>(timestamp_us)));
+}
+
+EncoderStatus NvencEncoder::Retrieve(EncodedFrame* frame, int timeout_ms)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+	uint32_t frame_number;
+	{
+		std::unique_lock<std::mutex> lock(lock_);
+		auto submitted = [this]() { return submitted_ != retrieved_; };
+		if (timeout_ms < 0)
+		{
+			submitted_cv_.wait(lock, submitted);
+		}
+		else if (!submitted_cv_.wait_until(lock, deadline, submitted))
+		{
+			return EncoderStatus::kTimeout;
+		}
+
+		frame_number = retrieved_;
+	}
+
+	auto& slot = slots_[frame_number % slots_.size()];
+
+	// an asynchronous session's picture is done once its event is set, and locking it won't wait
+	if (slot.event)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if (!slot.event->Wait(timeout_ms < 0 ? -1 : std::max(0, static_cast<int>(remaining.count()))))
+		{
+			return EncoderStatus::kTimeout;
+		}
+	}
+
+	NV_ENC_LOCK_BITSTREAM bitstream;
+	memset(&bitstream, 0, sizeof(bitstream));
+	bitstream.version = NV_ENC_LOCK_BITSTREAM_VER;
+	bitstream.outputBitstream = slot.bitstream;
+	bitstream.doNotWait = timeout_ms >= 0 && !slot.event;
+
+	auto status = functions_.nvEncLockBitstream(encoder_, &bitstream);
+	while (status == NV_ENC_ERR_LOCK_BUSY && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(kPollInterval);
+		status = functions_.nvEncLockBitstream(encoder_, &bitstream);
+	}
+
+	if (status == NV_ENC_ERR_LOCK_BUSY)
+	{
+		return EncoderStatus::kTimeout;
+	}
+
+	auto result = Check(status);
+	if (result != EncoderStatus::kOk)
+	{
+		// the picture is lost, and its slot goes to the next one submitted
+		std::lock_guard<std::mutex> lock(lock_);
+		retrieved_++;
+		return result;
+	}
+
+	auto data = static_cast<const uint8_t*>(bitstream.bitstreamBufferPtr);
+	frame->data.assign(data, data + bitstream.bitstreamSizeInBytes);
+	frame->timestamp_us = slot.timestamp_us;
+	frame->frame_number = slot.frame_number;
+	frame->keyframe = bitstream.pictureType == NV_ENC_PIC_TYPE_IDR || bitstream.pictureType == NV_ENC_PIC_TYPE_I;
+	frame->width = slot.width;
+	frame->height = slot.height;
+	frame->qp = static_cast<int>(bitstream.frameAvgQP);
+
+	result = Check(functions_.nvEncUnlockBitstream(encoder_, slot.bitstream));
+
+	// the slot is free even if unlocking failed, as its picture is done either way
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		retrieved_++;
+	}
+
+	return result;
+}
+
+size_t NvencEncoder::pending() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return submitted_ - retrieved_;
+}
+
+const EncoderConfig& NvencEncoder::config() const
+{
+	return config_;
+}
+
+NVENCSTATUS NvencEncoder::last_status() const
+{
+	return last_status_;
+}
+
+bool NvencEncoder::async() const
+{
+	return async_session_;
+}
+
+EncoderStatus NvencEncoder::Check(NVENCSTATUS status)
+{
+	if (status != NV_ENC_SUCCESS)
+	{
+		last_status_ = status;
+	}
+
+	return ToEncoderStatus(status);
+}
+
+bool NvencEncoder::IsValid(const EncoderConfig& config) const
+{
+	return config.width > 0 && config.height > 0 && config.fps > 0 && config.queue_depth > 0 &&
+		config.queue_depth <= kMaxQueueDepth && config.width <= caps().max_width && config.height <= caps().max_height &&
+		(config.rate_control == RateControl::kConstantQp || config.bitrate_bps > 0);
+}
+
+bool NvencEncoder::SupportsAsync()
+{
+	if (functions_.nvEncGetEncodeCaps == nullptr)
+	{
+		return true;
+	}
+
+	NV_ENC_CAPS_PARAM caps_param;
+	memset(&caps_param, 0, sizeof(caps_param));
+	caps_param.version = NV_ENC_CAPS_PARAM_VER;
+	caps_param.capsToQuery = NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT;
+	int supported = 0;
+	return functions_.nvEncGetEncodeCaps(encoder_, NV_ENC_CODEC_H264_GUID, &caps_param, &supported) == NV_ENC_SUCCESS &&
+		supported != 0;
+}
+
+EncoderStatus NvencEncoder::Configure(const EncoderConfig& config, NV_ENC_INITIALIZE_PARAMS* params, NV_ENC_CONFIG* encode_config)
+{
+	auto preset = PresetGuid(config.preset);
+
+	NV_ENC_PRESET_CONFIG preset_config;
+	memset(&preset_config, 0, sizeof(preset_config));
+	preset_config.version = NV_ENC_PRESET_CONFIG_VER;
+	preset_config.presetCfg.version = NV_ENC_CONFIG_VER;
+	auto result = Check(functions_.nvEncGetEncodePresetConfig(encoder_, NV_ENC_CODEC_H264_GUID, preset, &preset_config));
+	if (result != EncoderStatus::kOk)
+	{
+		return result;
+	}
+
+	*encode_config = preset_config.presetCfg;
+	encode_config->version = NV_ENC_CONFIG_VER;
+
+	// no B frames, since each would hold the frame before it back
+	auto gop_length = config.gop_length > 0 ? static_cast<uint32_t>(config.gop_length) : NVENC_INFINITE_GOPLENGTH;
+	encode_config->gopLength = gop_length;
+	encode_config->frameIntervalP = 1;
+	encode_config->encodeCodecConfig.h264Config.idrPeriod = gop_length;
+	encode_config->encodeCodecConfig.h264Config.repeatSPSPPS = 1;
+
+	// the whole DPB, so a lost frame can be recovered from by invalidating the frames after the
+	// last good one rather than with an IDR
+	encode_config->encodeCodecConfig.h264Config.maxNumRefFrames = kMaxReferences;
+
+	auto& rc = encode_config->rcParams;
+	rc.enableAQ = config.adaptive_quantization ? 1 : 0;
+	switch (config.preset == EncoderPreset::kLossless ? RateControl::kConstantQp : config.rate_control)
+	{
+	case RateControl::kConstantQp:
+	{
+		auto qp = config.preset == EncoderPreset::kLossless ? 0u : static_cast<uint32_t>(config.qp);
+		rc.rateControlMode = NV_ENC_PARAMS_RC_CONSTQP;
+		rc.constQP.qpIntra = qp;
+		rc.constQP.qpInterP = qp;
+		rc.constQP.qpInterB = qp;
+		break;
+	}
+
+	case RateControl::kCbr:
+		// a buffer of one frame keeps every frame close to the average, as streaming wants
+		rc.rateControlMode = NV_ENC_PARAMS_RC_CBR;
+		rc.averageBitRate = config.bitrate_bps;
+		rc.maxBitRate = config.bitrate_bps;
+		rc.vbvBufferSize = config.bitrate_bps / config.fps;
+		rc.vbvInitialDelay = rc.vbvBufferSize;
+		break;
+
+	case RateControl::kVbr:
+		rc.rateControlMode = NV_ENC_PARAMS_RC_VBR;
+		rc.averageBitRate = config.bitrate_bps;
+		rc.maxBitRate = config.max_bitrate_bps > 0 ? config.max_bitrate_bps : config.bitrate_bps;
+		break;
+	}
+
+	memset(params, 0, sizeof(*params));
+	params->version = NV_ENC_INITIALIZE_PARAMS_VER;
+	params->encodeGUID = NV_ENC_CODEC_H264_GUID;
+	params->presetGUID = preset;
+	params->encodeWidth = config.width;
+	params->encodeHeight = config.height;
+	params->darWidth = config.width;
+	params->darHeight = config.height;
+	params->maxEncodeWidth = config.max_width;
+	params->maxEncodeHeight = config.max_height;
+	params->frameRateNum = config.fps;
+	params->frameRateDen = 1;
+	params->enablePTD = 1;
+	params->enableEncodeAsync = async_session_ ? 1 : 0;
+	params->encodeConfig = encode_config;
+	return EncoderStatus::kOk;
+}
@@ -0,0 +1,608 @@
+#include "openh264_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "third_party/openh264/src/codec/api/svc/codec_api.h"
+#include "third_party/openh264/src/codec/api/svc/codec_app_def.h"
+#include "third_party/openh264/src/codec/api/svc/codec_def.h"
+#include "third_party/openh264/src/codec/api/svc/codec_ver.h"
+
+namespace
+{
+	typedef void (*GetVersionProc)(OpenH264Version*);
+
+	const int kMaxQueueDepth = 64;
+
+	// Level 5.2's largest frame, 4096x2304, in either orientation
+	const int kMaxDimension = 4096;
+
+	const int kMaxQp = 51;
+
+	// Frames a peer can lose and still be recovered by invalidating them, which is how long a
+	// long-term reference waits to be acknowledged. Marking one every kLtrMarkPeriod frames
+	// keeps one within reach of any loss.
+	const int kMaxReferences = 16;
+	const int kLtrMarkPeriod = 8;
+	const int kLtrCount = 2;
+
+	// frame_num wraps at 2^15, the most OpenH264 writes log2_max_frame_num for
+	const int kMaxFrameNum = 1 << 15;
+
+	ECOMPLEXITY_MODE Complexity(EncoderPreset preset)
+	{
+		switch (preset)
+		{
+		case EncoderPreset::kHighQuality:
+			return HIGH_COMPLEXITY;
+		case EncoderPreset::kLowLatencyHighPerformance:
+		case EncoderPreset::kHighPerformance:
+			return LOW_COMPLEXITY;
+		default:
+			return MEDIUM_COMPLEXITY;
+		}
+	}
+
+	RC_MODES RateControlMode(RateControl rate_control)
+	{
+		switch (rate_control)
+		{
+		case RateControl::kConstantQp:
+			return RC_OFF_MODE;
+		case RateControl::kVbr:
+			return RC_QUALITY_MODE;
+		default:
+			return RC_BITRATE_MODE;
+		}
+	}
+
+	template<typename Proc>
+	bool Resolve(void* library, const char* name, Proc* proc)
+	{
+#if defined(_WIN32)
+		*proc = reinterpret_cast<Proc>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+		*proc = reinterpret_cast<Proc>(dlsym(library, name));
+#endif
+		return *proc != nullptr;
+	}
+}
+
+bool OpenH264Encoder::LoadFunctions(OpenH264Functions* functions)
+{
+	// the library stays loaded for the life of the process, like the NVENC driver
+#if defined(_WIN32)
+	static void* library = LoadLibrary(TEXT("openh264.dll"));
+#else
+	static void* library = dlopen("libopenh264.so", RTLD_LAZY);
+#endif
+	if (library == nullptr)
+	{
+		return false;
+	}
+
+	// the interfaces are only binary compatible within a major version
+	GetVersionProc get_version;
+	if (!Resolve(library, "WelsGetCodecVersionEx", &get_version))
+	{
+		return false;
+	}
+
+	OpenH264Version version;
+	get_version(&version);
+	if (version.uMajor != OPENH264_MAJOR)
+	{
+		return false;
+	}
+
+	OpenH264Functions loaded;
+	if (!Resolve(library, "WelsCreateSVCEncoder", &loaded.create_encoder) ||
+		!Resolve(library, "WelsDestroySVCEncoder", &loaded.destroy_encoder) ||
+		!Resolve(library, "WelsCreateDecoder", &loaded.create_decoder) ||
+		!Resolve(library, "WelsDestroyDecoder", &loaded.destroy_decoder))
+	{
+		return false;
+	}
+
+	*functions = loaded;
+	return true;
+}
+
+OpenH264Encoder::OpenH264Encoder(const OpenH264Functions& functions) :
+	functions_(functions),
+	encoder_(nullptr),
+	frame_number_(0),
+	idr_count_(0),
+	next_frame_num_(0),
+	recover_to_us_(-1)
+{
+}
+
+OpenH264Encoder::~OpenH264Encoder()
+{
+	Shutdown();
+}
+
+const char* OpenH264Encoder::name() const
+{
+	return "openh264";
+}
+
+EncoderCaps OpenH264Encoder::caps() const
+{
+	EncoderCaps caps;
+	caps.hardware = false;
+	caps.max_width = kMaxDimension;
+	caps.max_height = kMaxDimension;
+	caps.max_queue_depth = kMaxQueueDepth;
+	caps.max_references = kMaxReferences;
+	return caps;
+}
+
+EncoderStatus OpenH264Encoder::Initialize(const EncoderConfig& config)
+{
+	Shutdown();
+	if (!IsValid(config))
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	// OpenH264 has no lossless mode
+	if (config.preset == EncoderPreset::kLossless)
+	{
+		return EncoderStatus::kUnsupported;
+	}
+
+	auto sized = config;
+	sized.max_width = std::max(config.max_width, config.width);
+	sized.max_height = std::max(config.max_height, config.height);
+	if (sized.max_width > caps().max_width || sized.max_height > caps().max_height)
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	ISVCEncoder* encoder = nullptr;
+	if (functions_.create_encoder == nullptr || functions_.create_encoder(&encoder) != 0 || encoder == nullptr)
+	{
+		return EncoderStatus::kDeviceError;
+	}
+
+	// it warns on stdout of every setting it would pick differently, frame skipping included
+	int trace_level = WELS_LOG_ERROR;
+	encoder->SetOption(ENCODER_OPTION_TRACE_LEVEL, &trace_level);
+
+	SEncParamExt params;
+	encoder->GetDefaultParams(&params);
+	Configure(sized, &params);
+	if (encoder->InitializeExt(&params) != cmResultSuccess)
+	{
+		functions_.destroy_encoder(encoder);
+		return EncoderStatus::kInvalidParam;
+	}
+
+	int format = videoFormatI420;
+	encoder->SetOption(ENCODER_OPTION_DATAFORMAT, &format);
+
+	config_ = sized;
+	frame_number_ = 0;
+	references_.clear();
+	idr_count_ = 0;
+	next_frame_num_ = 0;
+	recover_to_us_ = -1;
+
+	std::lock_guard<std::mutex> lock(lock_);
+	encoder_ = encoder;
+	return EncoderStatus::kOk;
+}
+
+void OpenH264Encoder::Shutdown()
+{
+	ISVCEncoder* encoder;
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		encoder = encoder_;
+		encoder_ = nullptr;
+		output_.clear();
+		ready_.notify_all();
+	}
+
+	if (encoder != nullptr)
+	{
+		encoder->Uninitialize();
+		functions_.destroy_encoder(encoder);
+	}
+}
+
+EncoderStatus OpenH264Encoder::Reconfigure(const EncoderConfig& config)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	if (!IsValid(config))
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	if (config.preset == EncoderPreset::kLossless || config.queue_depth != config_.queue_depth ||
+		config.width > config_.max_width || config.height > config_.max_height)
+	{
+		return EncoderStatus::kUnsupported;
+	}
+
+	auto previous = config_;
+	auto updated = config;
+	updated.max_width = previous.max_width;
+	updated.max_height = previous.max_height;
+
+	if (updated.width != previous.width || updated.height != previous.height || updated.preset != previous.preset ||
+		updated.rate_control != previous.rate_control || updated.qp != previous.qp ||
+		updated.gop_length != previous.gop_length || updated.adaptive_quantization != previous.adaptive_quantization ||
+		(updated.max_bitrate_bps == 0 && previous.max_bitrate_bps != 0))
+	{
+		// the whole configuration goes in at once, and OpenH264 only starts again with an IDR
+		// if the size changed. It's also the only way to lift a maximum bitrate.
+		SEncParamExt params;
+		encoder_->GetDefaultParams(&params);
+		Configure(updated, &params);
+		if (encoder_->SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &params) != cmResultSuccess)
+		{
+			return EncoderStatus::kInvalidParam;
+		}
+	}
+	else
+	{
+		// the rest is changed in place, so rate control carries on from where it is
+		if (updated.fps != previous.fps)
+		{
+			float fps = static_cast<float>(updated.fps);
+			encoder_->SetOption(ENCODER_OPTION_FRAME_RATE, &fps);
+		}
+
+		if (updated.bitrate_bps != previous.bitrate_bps || updated.max_bitrate_bps != previous.max_bitrate_bps)
+		{
+			SBitrateInfo bitrate;
+			bitrate.iLayer = SPATIAL_LAYER_ALL;
+			if (updated.max_bitrate_bps > 0)
+			{
+				bitrate.iBitrate = updated.max_bitrate_bps;
+				encoder_->SetOption(ENCODER_OPTION_MAX_BITRATE, &bitrate);
+			}
+
+			bitrate.iBitrate = updated.bitrate_bps;
+			encoder_->SetOption(ENCODER_OPTION_BITRATE, &bitrate);
+		}
+	}
+
+	config_ = updated;
+	return EncoderStatus::kOk;
+}
+
+EncoderStatus OpenH264Encoder::Submit(const I420Frame& frame, const EncodeParams& params)
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		if (encoder_ == nullptr)
+		{
+			return EncoderStatus::kNotInitialized;
+		}
+
+		if (output_.size() >= static_cast<size_t>(config_.queue_depth))
+		{
+			return EncoderStatus::kBusy;
+		}
+	}
+
+	if (frame.width() != config_.width || frame.height() != config_.height)
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	// the frames after the last good one are no longer references, so the next predicts from the
+	// newest long-term reference at or before it, unless an IDR has come since
+	auto last_good = std::find_if(references_.begin(), references_.end(), [this](const Reference& reference)
+	{
+		return reference.timestamp_us == recover_to_us_;
+	});
+
+	if (params.force_idr)
+	{
+		encoder_->ForceIntraFrame(true);
+	}
+	else if (recover_to_us_ >= 0 && last_good != references_.end())
+	{
+		SLTRRecoverRequest request;
+		memset(&request, 0, sizeof(request));
+		request.uiFeedbackType = LTR_RECOVERY_REQUEST;
+		request.uiIDRPicId = idr_count_;
+		request.iLastCorrectFrameNum = last_good->frame_num;
+		request.iCurrentFrameNum = references_.back().frame_num;
+		request.iLayerId = 0;
+		encoder_->SetOption(ENCODER_LTR_RECOVERY_REQUEST, &request);
+		references_.erase(last_good + 1, references_.end());
+	}
+
+	recover_to_us_ = -1;
+
+	SSourcePicture picture;
+	memset(&picture, 0, sizeof(picture));
+	picture.iColorFormat = videoFormatI420;
+	picture.iPicWidth = frame.width();
+	picture.iPicHeight = frame.height();
+	for (int plane = 0; plane < 3; plane++)
+	{
+		picture.iStride[plane] = frame.PlaneWidth(plane);
+		picture.pData[plane] = const_cast<uint8_t*>(frame.data(plane));
+	}
+
+	// rate control paces itself by these, so they follow the configured framerate whatever
+	// the caller's timestamps are
+	picture.uiTimeStamp = static_cast<long long>(frame_number_) * 1000 / config_.fps;
+
+	SFrameBSInfo info;
+	memset(&info, 0, sizeof(info));
+	if (encoder_->EncodeFrame(&picture, &info) != cmResultSuccess)
+	{
+		return EncoderStatus::kDeviceError;
+	}
+
+	EncodedFrame encoded;
+	encoded.timestamp_us = params.timestamp_us;
+	encoded.frame_number = frame_number_++;
+	encoded.keyframe = info.eFrameType == videoFrameTypeIDR;
+	encoded.width = config_.width;
+	encoded.height = config_.height;
+	Sent(params.timestamp_us, encoded.keyframe);
+
+	// each layer's NAL units are Annex B already, start codes and all
+	encoded.data.reserve(info.iFrameSizeInBytes);
+	for (int layer = 0; layer < info.iLayerNum; layer++)
+	{
+		const auto& layer_info = info.sLayerInfo[layer];
+		size_t size = 0;
+		for (int nal = 0; nal < layer_info.iNalCount; nal++)
+		{
+			size += layer_info.pNalLengthInByte[nal];
+		}
+
+		encoded.data.insert(encoded.data.end(), layer_info.pBsBuf, layer_info.pBsBuf + size);
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	output_.push_back(std::move(encoded));
+	ready_.notify_all();
+	return EncoderStatus::kOk;
+}
+
+EncoderStatus OpenH264Encoder::InvalidateFrame(int64_t timestamp_us)
+{
+	if (encoder_ == nullptr)
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	// the frame before it has to be one still kept, which no acknowledged reference is newer than
+	auto reference = std::find_if(references_.begin(), references_.end(), [timestamp_us](const Reference& candidate)
+	{
+		return candidate.timestamp_us == timestamp_us;
+	});
+
+	if (reference == references_.end() || reference == references_.begin())
+	{
+		return EncoderStatus::kInvalidParam;
+	}
+
+	auto last_good_us = (reference - 1)->timestamp_us;
+	recover_to_us_ = recover_to_us_ < 0 ? last_good_us : std::min(recover_to_us_, last_good_us);
+	return EncoderStatus::kOk;
+}
+
+EncoderStatus OpenH264Encoder::Retrieve(EncodedFrame* frame, int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	auto ready = [this]() { return encoder_ == nullptr || !output_.empty(); };
+	if (timeout_ms < 0)
+	{
+		ready_.wait(lock, ready);
+	}
+	else if (!ready_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready))
+	{
+		return EncoderStatus::kTimeout;
+	}
+
+	if (output_.empty())
+	{
+		return EncoderStatus::kNotInitialized;
+	}
+
+	*frame = std::move(output_.front());
+	output_.pop_front();
+	return EncoderStatus::kOk;
+}
+
+size_t OpenH264Encoder::pending() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return output_.size();
+}
+
+const EncoderConfig& OpenH264Encoder::config() const
+{
+	return config_;
+}
+
+bool OpenH264Encoder::IsValid(const EncoderConfig& config) const
+{
+	auto limits = caps();
+	return config.width > 0 && config.height > 0 && config.width <= limits.max_width &&
+		config.height <= limits.max_height && config.fps > 0 && config.queue_depth > 0 &&
+		config.queue_depth <= limits.max_queue_depth && config.qp >= 0 && config.qp <= kMaxQp &&
+		(config.rate_control == RateControl::kConstantQp || config.bitrate_bps > 0);
+}
+
+void OpenH264Encoder::Sent(int64_t timestamp_us, bool keyframe)
+{
+	if (keyframe)
+	{
+		references_.clear();
+		idr_count_++;
+		next_frame_num_ = 0;
+	}
+
+	Reference reference;
+	reference.timestamp_us = timestamp_us;
+	reference.frame_num = next_frame_num_;
+	references_.push_back(reference);
+	next_frame_num_ = (next_frame_num_ + 1) % kMaxFrameNum;
+
+	// OpenH264 waits for a long-term reference to be acknowledged before it marks the next, and
+	// only uses acknowledged ones to recover. Acknowledging each frame once it's too old to be
+	// recovered past, rather than as it's sent, means none a peer lost is ever used.
+	if (references_.size() > static_cast<size_t>(kMaxReferences))
+	{
+		SLTRMarkingFeedback feedback;
+		memset(&feedback, 0, sizeof(feedback));
+		feedback.uiFeedbackType = LTR_MARKING_SUCCESS;
+		feedback.uiIDRPicId = idr_count_;
+		feedback.iLTRFrameNum = references_.front().frame_num;
+		feedback.iLayerId = 0;
+		encoder_->SetOption(ENCODER_LTR_MARKING_FEEDBACK, &feedback);
+		references_.pop_front();
+	}
+}
+
+void OpenH264Encoder::Configure(const EncoderConfig& config, TagEncParamExt* params) const
+{
+	params->iUsageType = CAMERA_VIDEO_REAL_TIME;
+	params->iPicWidth = config.width;
+	params->iPicHeight = config.height;
+	params->iTargetBitrate = config.bitrate_bps;
+	params->iMaxBitrate = config.max_bitrate_bps;
+	params->iRCMode = RateControlMode(config.rate_control);
+	params->fMaxFrameRate = static_cast<float>(config.fps);
+	params->iComplexityMode = Complexity(config.preset);
+	params->uiIntraPeriod = config.gop_length;
+	params->bEnableAdaptiveQuant = config.adaptive_quantization;
+
+	// every frame is sent, one slice each, as webrtc's encoder has it, and keyframes come only
+	// when they're asked for or the GOP ends, as they do from NVENC
+	params->bEnableFrameSkip = false;
+	params->bEnableSceneChangeDetect = false;
+	params->iMultipleThreadIdc = 1;
+	params->iEntropyCodingModeFlag = 0;
+	params->iTemporalLayerNum = 1;
+	params->iSpatialLayerNum = 1;
+	params->eSpsPpsIdStrategy = CONSTANT_ID;
+	params->bEnableLongTermReference = true;
+	params->iLTRRefNum = kLtrCount;
+	params->iLtrMarkPeriod = kLtrMarkPeriod;
+
+	auto& layer = params->sSpatialLayers[0];
+	layer.iVideoWidth = config.width;
+	layer.iVideoHeight = config.height;
+	layer.fFrameRate = params->fMaxFrameRate;
+	layer.iSpatialBitrate = config.bitrate_bps;
+	layer.iMaxSpatialBitrate = config.max_bitrate_bps;
+	layer.uiProfileIdc = PRO_BASELINE;
+	layer.sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
+
+	if (config.rate_control == RateControl::kConstantQp)
+	{
+		layer.iDLayerQp = config.qp;
+		params->iMinQp = config.qp;
+		params->iMaxQp = config.qp;
+	}
+}
+
+OpenH264Decoder::OpenH264Decoder() :
+	functions_(),
+	decoder_(nullptr)
+{
+	if (OpenH264Encoder::LoadFunctions(&functions_))
+	{
+		Create();
+	}
+}
+
+OpenH264Decoder::OpenH264Decoder(const OpenH264Functions& functions) :
+	functions_(functions),
+	decoder_(nullptr)
+{
+	Create();
+}
+
+OpenH264Decoder::~OpenH264Decoder()
+{
+	if (decoder_ != nullptr)
+	{
+		decoder_->Uninitialize();
+		functions_.destroy_decoder(decoder_);
+	}
+}
+
+void OpenH264Decoder::Create()
+{
+	ISVCDecoder* decoder = nullptr;
+	if (functions_.create_decoder == nullptr || functions_.create_decoder(&decoder) != 0 || decoder == nullptr)
+	{
+		return;
+	}
+
+	SDecodingParam params;
+	memset(&params, 0, sizeof(params));
+	params.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+	if (decoder->Initialize(&params) != cmResultSuccess)
+	{
+		functions_.destroy_decoder(decoder);
+		return;
+	}
+
+	// a frame it can't decode is Decode's to report, not the decoder's to print
+	int trace_level = WELS_LOG_QUIET;
+	decoder->SetOption(DECODER_OPTION_TRACE_LEVEL, &trace_level);
+
+	// it conceals what it couldn't decode and carries on, as a peer's decoder does, rather than
+	// refusing everything until the next IDR, so a frame recovered to without one decodes
+	int concealment = ERROR_CON_SLICE_COPY;
+	decoder->SetOption(DECODER_OPTION_ERROR_CON_IDC, &concealment);
+	decoder_ = decoder;
+}
+
+bool OpenH264Decoder::Decode(const uint8_t* data, size_t size, I420Frame* frame)
+{
+	if (decoder_ == nullptr)
+	{
+		return false;
+	}
+
+	uint8_t* planes[3] = { nullptr, nullptr, nullptr };
+	SBufferInfo info;
+	memset(&info, 0, sizeof(info));
+	auto state = decoder_->DecodeFrameNoDelay(data, static_cast<int>(size), planes, &info);
+	if (state != dsErrorFree || info.iBufferStatus != 1)
+	{
+		return false;
+	}
+
+	const auto& buffer = info.UsrData.sSystemBuffer;
+	frame->Allocate(buffer.iWidth, buffer.iHeight);
+	for (int plane = 0; plane < 3; plane++)
+	{
+		auto stride = buffer.iStride[plane == 0 ? 0 : 1];
+		auto width = frame->PlaneWidth(plane);
+		for (int y = 0; y < frame->PlaneHeight(plane); y++)
+		{
+			memcpy(frame->data(plane) + y * width, info.pDst[plane] + y * stride, width);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,634 @@
+#include "quality_metrics.h"
+
+#include <algorithm>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUALITY_METRICS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const int kSsimWindow = 8;
+
+	// Windows are 4 samples apart, so each is four of these blocks
+	const int kBlockSize = 4;
+
+	// SSIM's stabilizers, (0.01 * 255)^2 and (0.03 * 255)^2
+	const double kSsimC1 = 6.5025;
+	const double kSsimC2 = 58.5225;
+
+	const int kMsSsimScales = 5;
+	const double kMsSsimWeights[kMsSsimScales] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+
+	// Rows of windows in a band, which at 64 rows of samples keeps a band's rows in L2 while
+	// still splitting 1080p luma 17 ways
+	const int kBandWindowRows = 16;
+	const int kBandRows = kBandWindowRows * kBlockSize;
+
+	struct Plane
+	{
+		const uint8_t* a;
+		int a_stride;
+		const uint8_t* b;
+		int b_stride;
+		int width;
+		int height;
+	};
+
+	// SSIM and its contrast-structure term for a window of |n| samples, from the window's sums
+	double SsimTerms(uint64_t sum_a, uint64_t sum_b, uint64_t sum_aa, uint64_t sum_bb, uint64_t sum_ab, int64_t n, double* cs)
+	{
+		// the variances scaled by n^2 are exact in integers, where subtracting the squared means
+		// in floating point could cancel to noise
+		double n2 = static_cast<double>(n) * n;
+		auto mean_a = static_cast<double>(sum_a) / n;
+		auto mean_b = static_cast<double>(sum_b) / n;
+		auto variance_a = (n * static_cast<int64_t>(sum_aa) - static_cast<int64_t>(sum_a * sum_a)) / n2;
+		auto variance_b = (n * static_cast<int64_t>(sum_bb) - static_cast<int64_t>(sum_b * sum_b)) / n2;
+		auto covariance = (n * static_cast<int64_t>(sum_ab) - static_cast<int64_t>(sum_a * sum_b)) / n2;
+
+		*cs = (2 * covariance + kSsimC2) / (variance_a + variance_b + kSsimC2);
+		return (2 * mean_a * mean_b + kSsimC1) / (mean_a * mean_a + mean_b * mean_b + kSsimC1) * *cs;
+	}
+
+	// Scores a whole plane as one window
+	double WholePlaneSsim(const Plane& plane, double* cs)
+	{
+		uint64_t sum_a = 0;
+		uint64_t sum_b = 0;
+		uint64_t sum_aa = 0;
+		uint64_t sum_bb = 0;
+		uint64_t sum_ab = 0;
+		for (int y = 0; y < plane.height; y++)
+		{
+			for (int x = 0; x < plane.width; x++)
+			{
+				uint32_t va = plane.a[y * plane.a_stride + x];
+				uint32_t vb = plane.b[y * plane.b_stride + x];
+				sum_a += va;
+				sum_b += vb;
+				sum_aa += va * va;
+				sum_bb += vb * vb;
+				sum_ab += va * vb;
+			}
+		}
+
+		return SsimTerms(sum_a, sum_b, sum_aa, sum_bb, sum_ab, static_cast<int64_t>(plane.width) * plane.height, cs);
+	}
+
+	bool HasWindows(const Plane& plane)
+	{
+		return plane.width >= kSsimWindow && plane.height >= kSsimWindow;
+	}
+
+	int WindowRows(const Plane& plane)
+	{
+		return plane.height / kBlockSize - 1;
+	}
+
+	int WindowColumns(const Plane& plane)
+	{
+		return plane.width / kBlockSize - 1;
+	}
+
+#ifdef QUALITY_METRICS_SSE2
+	uint32_t HorizontalSum(__m128i sums)
+	{
+		sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+		sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(sums));
+	}
+
+	// Adds the lanes of |lo|, which are two per block of blocks 0 and 1, and of |hi|, for blocks 2
+	// and 3, giving one lane per block
+	__m128i PerBlock(__m128i lo, __m128i hi)
+	{
+		auto even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+		auto odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+		return _mm_add_epi32(even, odd);
+	}
+#endif
+
+	uint32_t RowSquaredError(const uint8_t* a, const uint8_t* b, int width, bool simd)
+	{
+		// a row's error fits in 32 bits for any width up to 66000
+		uint32_t error = 0;
+		int x = 0;
+#ifdef QUALITY_METRICS_SSE2
+		if (simd)
+		{
+			const auto zero = _mm_setzero_si128();
+			auto sums = zero;
+			for (; x + 16 <= width; x += 16)
+			{
+				auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+				auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+				auto lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+				auto hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+				sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+			}
+
+			error = HorizontalSum(sums);
+		}
+#endif
+
+		for (; x < width; x++)
+		{
+			int difference = a[x] - b[x];
+			error += difference * difference;
+		}
+
+		return error;
+	}
+
+	uint64_t SquaredErrorRows(const Plane& plane, int first_row, int end_row, bool simd)
+	{
+		uint64_t error = 0;
+		for (int y = first_row; y < end_row; y++)
+		{
+			error += RowSquaredError(plane.a + y * plane.a_stride, plane.b + y * plane.b_stride, plane.width, simd);
+		}
+
+		return error;
+	}
+
+	// The sums of each 4x4 block along a strip of 4 rows
+	struct BlockSums
+	{
+		std::vector<uint32_t> a;
+		std::vector<uint32_t> b;
+		std::vector<uint32_t> aa;
+		std::vector<uint32_t> bb;
+		std::vector<uint32_t> ab;
+
+		explicit BlockSums(int blocks) : a(blocks), b(blocks), aa(blocks), bb(blocks), ab(blocks) {}
+	};
+
+	void SumBlocks(const Plane& plane, int block_row, bool simd, BlockSums* sums)
+	{
+		auto a = plane.a + block_row * kBlockSize * plane.a_stride;
+		auto b = plane.b + block_row * kBlockSize * plane.b_stride;
+		int blocks = static_cast<int>(sums->a.size());
+		int block = 0;
+#ifdef QUALITY_METRICS_SSE2
+		if (simd)
+		{
+			// four blocks at a time, widened to 16 bits, whose products madd sums in pairs
+			const auto zero = _mm_setzero_si128();
+			const auto ones = _mm_set1_epi16(1);
+			for (; block + 4 <= blocks; block += 4)
+			{
+				auto sum_a_lo = zero;
+				auto sum_a_hi = zero;
+				auto sum_b_lo = zero;
+				auto sum_b_hi = zero;
+				auto sum_aa_lo = zero;
+				auto sum_aa_hi = zero;
+				auto sum_bb_lo = zero;
+				auto sum_bb_hi = zero;
+				auto sum_ab_lo = zero;
+				auto sum_ab_hi = zero;
+				for (int y = 0; y < kBlockSize; y++)
+				{
+					auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + y * plane.a_stride + block * kBlockSize));
+					auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + y * plane.b_stride + block * kBlockSize));
+					auto a_lo = _mm_unpacklo_epi8(va, zero);
+					auto a_hi = _mm_unpackhi_epi8(va, zero);
+					auto b_lo = _mm_unpacklo_epi8(vb, zero);
+					auto b_hi = _mm_unpackhi_epi8(vb, zero);
+					sum_a_lo = _mm_add_epi16(sum_a_lo, a_lo);
+					sum_a_hi = _mm_add_epi16(sum_a_hi, a_hi);
+					sum_b_lo = _mm_add_epi16(sum_b_lo, b_lo);
+					sum_b_hi = _mm_add_epi16(sum_b_hi, b_hi);
+					sum_aa_lo = _mm_add_epi32(sum_aa_lo, _mm_madd_epi16(a_lo, a_lo));
+					sum_aa_hi = _mm_add_epi32(sum_aa_hi, _mm_madd_epi16(a_hi, a_hi));
+					sum_bb_lo = _mm_add_epi32(sum_bb_lo, _mm_madd_epi16(b_lo, b_lo));
+					sum_bb_hi = _mm_add_epi32(sum_bb_hi, _mm_madd_epi16(b_hi, b_hi));
+					sum_ab_lo = _mm_add_epi32(sum_ab_lo, _mm_madd_epi16(a_lo, b_lo));
+					sum_ab_hi = _mm_add_epi32(sum_ab_hi, _mm_madd_epi16(a_hi, b_hi));
+				}
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&sums->a[block]),
+					PerBlock(_mm_madd_epi16(sum_a_lo, ones), _mm_madd_epi16(sum_a_hi, ones)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&sums->b[block]),
+					PerBlock(_mm_madd_epi16(sum_b_lo, ones), _mm_madd_epi16(sum_b_hi, ones)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&sums->aa[block]), PerBlock(sum_aa_lo, sum_aa_hi));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&sums->bb[block]), PerBlock(sum_bb_lo, sum_bb_hi));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&sums->ab[block]), PerBlock(sum_ab_lo, sum_ab_hi));
+			}
+		}
+#endif
+
+		for (; block < blocks; block++)
+		{
+			uint32_t sum_a = 0;
+			uint32_t sum_b = 0;
+			uint32_t sum_aa = 0;
+			uint32_t sum_bb = 0;
+			uint32_t sum_ab = 0;
+			for (int y = 0; y < kBlockSize; y++)
+			{
+				for (int x = block * kBlockSize; x < (block + 1) * kBlockSize; x++)
+				{
+					uint32_t va = a[y * plane.a_stride + x];
+					uint32_t vb = b[y * plane.b_stride + x];
+					sum_a += va;
+					sum_b += vb;
+					sum_aa += va * va;
+					sum_bb += vb * vb;
+					sum_ab += va * vb;
+				}
+			}
+
+			sums->a[block] = sum_a;
+			sums->b[block] = sum_b;
+			sums->aa[block] = sum_aa;
+			sums->bb[block] = sum_bb;
+			sums->ab[block] = sum_ab;
+		}
+	}
+
+	// Sums SSIM and its contrast-structure term over each row of windows from |first_row| to
+	// |end_row|, into |ssim| and |cs| at the row's index
+	void SsimRows(const Plane& plane, int first_row, int end_row, bool simd, double* ssim, double* cs)
+	{
+		auto columns = WindowColumns(plane);
+		BlockSums above(columns + 1);
+		BlockSums below(columns + 1);
+		SumBlocks(plane, first_row, simd, &above);
+		for (int row = first_row; row < end_row; row++)
+		{
+			SumBlocks(plane, row + 1, simd, &below);
+			double row_ssim = 0;
+			double row_cs = 0;
+			for (int x = 0; x < columns; x++)
+			{
+				double window_cs;
+				row_ssim += SsimTerms(
+					above.a[x] + above.a[x + 1] + below.a[x] + below.a[x + 1],
+					above.b[x] + above.b[x + 1] + below.b[x] + below.b[x + 1],
+					above.aa[x] + above.aa[x + 1] + below.aa[x] + below.aa[x + 1],
+					above.bb[x] + above.bb[x + 1] + below.bb[x] + below.bb[x + 1],
+					above.ab[x] + above.ab[x + 1] + below.ab[x] + below.ab[x + 1],
+					kSsimWindow * kSsimWindow,
+					&window_cs);
+				row_cs += window_cs;
+			}
+
+			ssim[row] = row_ssim;
+			cs[row] = row_cs;
+			std::swap(above, below);
+		}
+	}
+
+	// The mean SSIM and contrast-structure term of |plane|, summing its rows in order
+	double MeanSsim(const Plane& plane, const std::vector<double>& ssim_rows, const std::vector<double>& cs_rows, double* cs)
+	{
+		double ssim = 0;
+		*cs = 0;
+		for (size_t row = 0; row < ssim_rows.size(); row++)
+		{
+			ssim += ssim_rows[row];
+			*cs += cs_rows[row];
+		}
+
+		double windows = static_cast<double>(ssim_rows.size()) * WindowColumns(plane);
+		*cs /= windows;
+		return ssim / windows;
+	}
+
+	double MeanSsim(const Plane& plane, bool simd, double* cs)
+	{
+		if (!HasWindows(plane))
+		{
+			return WholePlaneSsim(plane, cs);
+		}
+
+		std::vector<double> ssim_rows(WindowRows(plane));
+		std::vector<double> cs_rows(ssim_rows.size());
+		SsimRows(plane, 0, WindowRows(plane), simd, ssim_rows.data(), cs_rows.data());
+		return MeanSsim(plane, ssim_rows, cs_rows, cs);
+	}
+
+	// Halves a plane's size, averaging each 2x2 block
+	void Downsample(const uint8_t* in, int stride, int width, int height, std::vector<uint8_t>* out)
+	{
+		auto out_width = width / 2;
+		out->resize(static_cast<size_t>(out_width) * (height / 2));
+		for (int y = 0; y < height / 2; y++)
+		{
+			auto top = in + 2 * y * stride;
+			auto bottom = top + stride;
+			auto row = out->data() + y * out_width;
+			for (int x = 0; x < out_width; x++)
+			{
+				row[x] = static_cast<uint8_t>((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+			}
+		}
+	}
+
+	// SSIM and its contrast-structure term at each of MS-SSIM's scales after the first that's
+	// at least a window in size
+	std::vector<std::pair<double, double>> CoarserScales(const Plane& plane, bool simd)
+	{
+		std::vector<std::pair<double, double>> scales;
+		std::vector<uint8_t> a;
+		std::vector<uint8_t> b;
+		auto scale = plane;
+		for (int i = 1; i < kMsSsimScales && scale.width / 2 >= kSsimWindow && scale.height / 2 >= kSsimWindow; i++)
+		{
+			std::vector<uint8_t> smaller_a;
+			std::vector<uint8_t> smaller_b;
+			Downsample(scale.a, scale.a_stride, scale.width, scale.height, &smaller_a);
+			Downsample(scale.b, scale.b_stride, scale.width, scale.height, &smaller_b);
+			a.swap(smaller_a);
+			b.swap(smaller_b);
+			scale.width /= 2;
+			scale.height /= 2;
+			scale.a = a.data();
+			scale.a_stride = scale.width;
+			scale.b = b.data();
+			scale.b_stride = scale.width;
+
+			double cs;
+			auto ssim = MeanSsim(scale, simd, &cs);
+			scales.push_back(std::make_pair(ssim, cs));
+		}
+
+		return scales;
+	}
+
+	// Combines the first scale's SSIM and contrast-structure term with the coarser scales'
+	double MsSsim(double ssim, double cs, const std::vector<std::pair<double, double>>& coarser)
+	{
+		// every scale but the last contributes contrast and structure, and the last luminance too
+		auto scales = coarser.size() + 1;
+		double weights = 0;
+		double product = 1;
+		for (size_t i = 0; i < scales; i++)
+		{
+			auto term = i == 0 ? (scales == 1 ? ssim : cs) : (i + 1 == scales ? coarser[i - 1].first : coarser[i - 1].second);
+			product *= pow(std::max(0.0, term), kMsSsimWeights[i]);
+			weights += kMsSsimWeights[i];
+		}
+
+		return pow(product, 1 / weights);
+	}
+
+	// Everything measured of one plane, filled in by the tasks that measure it
+	struct PlaneMeasurement
+	{
+		Plane plane;
+		std::vector<uint64_t> band_errors;
+		std::vector<double> ssim_rows;
+		std::vector<double> cs_rows;
+
+		// For planes too small for windows
+		double whole_ssim;
+		double whole_cs;
+
+		std::vector<std::pair<double, double>> coarser;
+	};
+
+	void AddTasks(PlaneMeasurement* measurement, bool simd, bool ms_ssim, std::vector<std::function<void()>>* tasks)
+	{
+		const auto& plane = measurement->plane;
+		auto bands = (plane.height + kBandRows - 1) / kBandRows;
+		auto window_rows = HasWindows(plane) ? WindowRows(plane) : 0;
+		measurement->band_errors.assign(bands, 0);
+		measurement->ssim_rows.assign(window_rows, 0);
+		measurement->cs_rows.assign(window_rows, 0);
+		for (int band = 0; band < bands; band++)
+		{
+			tasks->push_back([measurement, band, window_rows, simd]()
+			{
+				const auto& plane = measurement->plane;
+				auto end_row = std::min(plane.height, (band + 1) * kBandRows);
+				measurement->band_errors[band] = SquaredErrorRows(plane, band * kBandRows, end_row, simd);
+
+				auto first_window_row = std::min(window_rows, band * kBandWindowRows);
+				auto end_window_row = std::min(window_rows, (band + 1) * kBandWindowRows);
+				SsimRows(plane, first_window_row, end_window_row, simd, measurement->ssim_rows.data(), measurement->cs_rows.data());
+			});
+		}
+
+		if (!HasWindows(plane))
+		{
+			tasks->push_back([measurement]()
+			{
+				measurement->whole_ssim = WholePlaneSsim(measurement->plane, &measurement->whole_cs);
+			});
+		}
+		else if (ms_ssim)
+		{
+			tasks->push_back([measurement, simd]()
+			{
+				measurement->coarser = CoarserScales(measurement->plane, simd);
+			});
+		}
+	}
+
+	QualityScores Measure(const I420Frame& reference, const I420Frame& distorted, bool simd, bool ms_ssim,
+		const std::function<void(std::vector<std::function<void()>>&)>& run)
+	{
+		PlaneMeasurement planes[3];
+		std::vector<std::function<void()>> tasks;
+		for (int i = 0; i < 3; i++)
+		{
+			auto width = reference.PlaneWidth(i);
+			Plane plane = { reference.data(i), width, distorted.data(i), width, width, reference.PlaneHeight(i) };
+			planes[i].plane = plane;
+			AddTasks(&planes[i], simd, ms_ssim && i == 0, &tasks);
+		}
+
+		run(tasks);
+
+		QualityScores scores;
+		double* psnr[] = { &scores.psnr_y, &scores.psnr_u, &scores.psnr_v };
+		double* ssim[] = { &scores.ssim_y, &scores.ssim_u, &scores.ssim_v };
+		uint64_t total_error = 0;
+		uint64_t total_samples = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const auto& measurement = planes[i];
+			uint64_t error = 0;
+			for (auto band_error : measurement.band_errors)
+			{
+				error += band_error;
+			}
+
+			uint64_t samples = static_cast<uint64_t>(measurement.plane.width) * measurement.plane.height;
+			*psnr[i] = PsnrFromSquaredError(error, samples);
+
+			double cs;
+			if (HasWindows(measurement.plane))
+			{
+				*ssim[i] = MeanSsim(measurement.plane, measurement.ssim_rows, measurement.cs_rows, &cs);
+			}
+			else
+			{
+				*ssim[i] = measurement.whole_ssim;
+				cs = measurement.whole_cs;
+			}
+
+			if (i == 0 && ms_ssim)
+			{
+				scores.ms_ssim = MsSsim(*ssim[i], cs, measurement.coarser);
+			}
+
+			total_error += error;
+			total_samples += samples;
+			scores.ssim += *ssim[i] * samples;
+		}
+
+		scores.psnr = PsnrFromSquaredError(total_error, total_samples);
+		scores.ssim /= total_samples;
+		return scores;
+	}
+
+	void RunInline(std::vector<std::function<void()>>& tasks)
+	{
+		for (auto& task : tasks)
+		{
+			task();
+		}
+	}
+
+#ifdef QUALITY_METRICS_SSE2
+	const bool kSimd = true;
+#else
+	const bool kSimd = false;
+#endif
+}
+
+uint64_t PlaneSquaredError(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride, int width, int height)
+{
+	Plane plane = { a, a_stride, b, b_stride, width, height };
+	return SquaredErrorRows(plane, 0, height, kSimd);
+}
+
+double PsnrFromSquaredError(uint64_t squared_error, uint64_t samples)
+{
+	if (squared_error == 0)
+	{
+		return kMaxPsnr;
+	}
+
+	return std::min(kMaxPsnr, 10 * log10(255.0 * 255.0 * samples / squared_error));
+}
+
+double PlaneSsim(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride, int width, int height)
+{
+	Plane plane = { a, a_stride, b, b_stride, width, height };
+	double cs;
+	return MeanSsim(plane, kSimd, &cs);
+}
+
+double PlaneMsSsim(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride, int width, int height)
+{
+	Plane plane = { a, a_stride, b, b_stride, width, height };
+	double cs;
+	auto ssim = MeanSsim(plane, kSimd, &cs);
+	return MsSsim(ssim, cs, HasWindows(plane) ? CoarserScales(plane, kSimd) : std::vector<std::pair<double, double>>());
+}
+
+QualityScores MeasureQuality(const I420Frame& reference, const I420Frame& distorted)
+{
+	return Measure(reference, distorted, kSimd, true, RunInline);
+}
+
+QualityMeter::QualityMeter(const Options& options) :
+	options_(options),
+	tasks_(nullptr),
+	next_task_(0),
+	unfinished_(0),
+	stopping_(false)
+{
+	options_.simd = options_.simd && kSimd;
+	auto threads = options_.threads > 0 ? options_.threads : static_cast<int>(std::thread::hardware_concurrency());
+	options_.threads = std::max(1, threads);
+	for (int i = 1; i < options_.threads; i++)
+	{
+		workers_.push_back(std::thread(&QualityMeter::WorkerLoop, this));
+	}
+}
+
+QualityMeter::~QualityMeter()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stopping_ = true;
+	}
+
+	work_.notify_all();
+	for (auto& worker : workers_)
+	{
+		worker.join();
+	}
+}
+
+QualityScores QualityMeter::Measure(const I420Frame& reference, const I420Frame& distorted)
+{
+	std::lock_guard<std::mutex> measuring(measure_lock_);
+	return ::Measure(reference, distorted, options_.simd, options_.ms_ssim, [this](std::vector<Task>& tasks)
+	{
+		Run(tasks);
+	});
+}
+
+int QualityMeter::threads() const
+{
+	return options_.threads;
+}
+
+void QualityMeter::Run(std::vector<Task>& tasks)
+{
+	if (workers_.empty())
+	{
+		RunInline(tasks);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(lock_);
+	tasks_ = &tasks;
+	next_task_ = 0;
+	unfinished_ = tasks.size();
+	work_.notify_all();
+
+	// the caller takes tasks too, rather than sitting idle
+	while (next_task_ < tasks.size())
+	{
+		auto& task = tasks[next_task_++];
+		lock.unlock();
+		task();
+		lock.lock();
+		unfinished_--;
+	}
+
+	done_.wait(lock, [this]() { return unfinished_ == 0; });
+	tasks_ = nullptr;
+}
+
+void QualityMeter::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		work_.wait(lock, [this]() { return stopping_ || (tasks_ && next_task_ < tasks_->size()); });
+		if (stopping_)
+		{
+			return;
+		}
+
+		auto& task = (*tasks_)[next_task_++];
+		lock.unlock();
+		task();
+		lock.lock();
+		if (--unfinished_ == 0)
+		{
+			done_.notify_all();
+		}
+	}
+}
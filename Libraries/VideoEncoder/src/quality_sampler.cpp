@@ -0,0 +1,142 @@
+#include "quality_sampler.h"
+
+#include <algorithm>
+
+#include "openh264_encoder.h"
+
+QualitySampler::QualitySampler(const Decoder& decoder, const Options& options) :
+	decoder_(decoder),
+	options_(options),
+	meter_(options.meter),
+	submitted_(0),
+	scoring_(false),
+	stopping_(false)
+{
+	stats_ = Stats();
+	stats_.min_psnr_y = kMaxPsnr;
+	options_.interval = std::max(1, options_.interval);
+	options_.max_pending = std::max<size_t>(1, options_.max_pending);
+
+	if (!decoder_)
+	{
+		auto openh264 = std::make_shared<OpenH264Decoder>();
+		decoder_ = [openh264](const EncodedFrame& frame, I420Frame* decoded)
+		{
+			return openh264->Decode(frame.data.data(), frame.data.size(), decoded);
+		};
+	}
+
+	thread_ = std::thread(&QualitySampler::ScoreLoop, this);
+}
+
+QualitySampler::~QualitySampler()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stopping_ = true;
+	}
+
+	changed_.notify_all();
+	thread_.join();
+}
+
+void QualitySampler::OnSubmitted(const I420Frame& frame, const EncodeParams& params)
+{
+	if (submitted_++ % options_.interval != 0)
+	{
+		return;
+	}
+
+	std::unique_ptr<Sample> sample(new Sample());
+	sample->timestamp_us = params.timestamp_us;
+	sample->reference = frame;
+
+	std::lock_guard<std::mutex> lock(lock_);
+	kept_.push_back(std::move(sample));
+	stats_.sampled++;
+}
+
+void QualitySampler::OnEncoded(const EncodedFrame& frame)
+{
+	auto decoded = decoder_(frame, &decoded_);
+
+	std::lock_guard<std::mutex> lock(lock_);
+	stats_.undecodable += decoded ? 0 : 1;
+
+	// frames kept before this one weren't encoded
+	while (!kept_.empty() && kept_.front()->timestamp_us < frame.timestamp_us)
+	{
+		kept_.pop_front();
+		stats_.skipped++;
+	}
+
+	if (kept_.empty() || kept_.front()->timestamp_us != frame.timestamp_us)
+	{
+		return;
+	}
+
+	auto sample = std::move(kept_.front());
+	kept_.pop_front();
+	if (!decoded || pending_.size() >= options_.max_pending)
+	{
+		stats_.skipped++;
+		return;
+	}
+
+	sample->decoded = decoded_;
+	pending_.push_back(std::move(sample));
+	changed_.notify_all();
+}
+
+void QualitySampler::Flush()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	changed_.wait(lock, [this]() { return pending_.empty() && !scoring_; });
+}
+
+QualitySampler::Stats QualitySampler::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	auto stats = stats_;
+	stats.min_psnr_y = stats.scored > 0 ? stats.min_psnr_y : 0;
+	return stats;
+}
+
+void QualitySampler::ScoreLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		changed_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+		if (stopping_)
+		{
+			return;
+		}
+
+		auto sample = std::move(pending_.front());
+		pending_.pop_front();
+		scoring_ = true;
+
+		lock.unlock();
+		auto scores = meter_.Measure(sample->reference, sample->decoded);
+		lock.lock();
+
+		// running means, so the totals don't need keeping
+		stats_.scored++;
+		double weight = 1.0 / stats_.scored;
+		auto& mean = stats_.mean;
+		mean.psnr_y += (scores.psnr_y - mean.psnr_y) * weight;
+		mean.psnr_u += (scores.psnr_u - mean.psnr_u) * weight;
+		mean.psnr_v += (scores.psnr_v - mean.psnr_v) * weight;
+		mean.psnr += (scores.psnr - mean.psnr) * weight;
+		mean.ssim_y += (scores.ssim_y - mean.ssim_y) * weight;
+		mean.ssim_u += (scores.ssim_u - mean.ssim_u) * weight;
+		mean.ssim_v += (scores.ssim_v - mean.ssim_v) * weight;
+		mean.ssim += (scores.ssim - mean.ssim) * weight;
+		mean.ms_ssim += (scores.ms_ssim - mean.ms_ssim) * weight;
+		stats_.last = scores;
+		stats_.min_psnr_y = std::min(stats_.min_psnr_y, scores.psnr_y);
+		scoring_ = false;
+		changed_.notify_all();
+	}
+}
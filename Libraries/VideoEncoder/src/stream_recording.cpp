@@ -0,0 +1,817 @@
+#include "stream_recording.h"
+
+#include <algorithm>
+#include <ostream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char kMagic[] = { '3', 'D', 'S', 'R' };
+	const char kRecordMagic[] = { 'F', 'R', 'M', '1' };
+
+	const uint8_t kVersion = 1;
+
+	const size_t kRecordHeaderSize = 40;
+	const size_t kIndexEntrySize = 8 + kRecordHeaderSize;
+
+	const uint32_t kKeyframeFlag = 1;
+
+	void WriteUint16(uint8_t* data, uint16_t value)
+	{
+		data[0] = static_cast<uint8_t>(value);
+		data[1] = static_cast<uint8_t>(value >> 8);
+	}
+
+	void WriteUint32(uint8_t* data, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			data[i] = static_cast<uint8_t>(value >> (i * 8));
+		}
+	}
+
+	void WriteUint64(uint8_t* data, uint64_t value)
+	{
+		WriteUint32(data, static_cast<uint32_t>(value));
+		WriteUint32(data + 4, static_cast<uint32_t>(value >> 32));
+	}
+
+	uint16_t ReadUint16(const uint8_t* data)
+	{
+		return static_cast<uint16_t>(data[0] | data[1] << 8);
+	}
+
+	uint32_t ReadUint32(const uint8_t* data)
+	{
+		return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+			static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+	}
+
+	uint64_t ReadUint64(const uint8_t* data)
+	{
+		return ReadUint32(data) | static_cast<uint64_t>(ReadUint32(data + 4)) << 32;
+	}
+
+	uint64_t RoundUp(uint64_t value)
+	{
+		return (value + StreamRecorder::kBlockSize - 1) / StreamRecorder::kBlockSize * StreamRecorder::kBlockSize;
+	}
+}
+
+/// <summary>
+/// A block aligned buffer, as unbuffered writes need
+/// </summary>
+class StreamRecorder::Buffer
+{
+public:
+	explicit Buffer(size_t capacity) :
+		data_(nullptr),
+		capacity_(capacity)
+	{
+#ifdef _WIN32
+		data_ = static_cast<uint8_t*>(_aligned_malloc(capacity, kBlockSize));
+#else
+		void* data = nullptr;
+		data_ = posix_memalign(&data, kBlockSize, capacity) == 0 ? static_cast<uint8_t*>(data) : nullptr;
+#endif
+	}
+
+	~Buffer()
+	{
+#ifdef _WIN32
+		_aligned_free(data_);
+#else
+		free(data_);
+#endif
+	}
+
+	uint8_t* data() const { return data_; }
+
+	size_t capacity() const { return capacity_; }
+
+private:
+	uint8_t* data_;
+	size_t capacity_;
+};
+
+/// <summary>
+/// A file written at offsets, without the OS cache where it can be
+/// </summary>
+class StreamRecorder::File
+{
+public:
+	static std::unique_ptr<File> Create(const std::string& path, bool direct)
+	{
+		std::unique_ptr<File> file(new File());
+#ifdef _WIN32
+		auto flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+		file->handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr);
+		if (file->handle_ == INVALID_HANDLE_VALUE)
+		{
+			return nullptr;
+		}
+#else
+		auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+		// file systems like tmpfs refuse O_DIRECT, and are written through the cache instead
+		file->fd_ = direct ? open(path.c_str(), flags | O_DIRECT, 0644) : -1;
+		direct = file->fd_ >= 0;
+#else
+		direct = false;
+#endif
+		if (file->fd_ < 0)
+		{
+			file->fd_ = open(path.c_str(), flags, 0644);
+		}
+
+		if (file->fd_ < 0)
+		{
+			return nullptr;
+		}
+#endif
+		file->direct_ = direct;
+		return file;
+	}
+
+	~File()
+	{
+#ifdef _WIN32
+		CloseHandle(handle_);
+#else
+		close(fd_);
+#endif
+	}
+
+	// |data|, |size| and |offset| must be whole blocks if the file is direct
+	bool WriteAt(uint64_t offset, const uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+#ifdef _WIN32
+			OVERLAPPED position = {};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD written = 0;
+			auto chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+			if (!WriteFile(handle_, data, chunk, &written, &position) || written == 0)
+			{
+				return false;
+			}
+#else
+			auto written = pwrite(fd_, data, size, static_cast<off_t>(offset));
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if (written <= 0)
+			{
+				return false;
+			}
+#endif
+			data += written;
+			size -= written;
+			offset += written;
+		}
+
+		return true;
+	}
+
+	bool direct() const { return direct_; }
+
+private:
+	File() :
+#ifdef _WIN32
+		handle_(INVALID_HANDLE_VALUE),
+#else
+		fd_(-1),
+#endif
+		direct_(false)
+	{
+	}
+
+#ifdef _WIN32
+	HANDLE handle_;
+#else
+	int fd_;
+#endif
+	bool direct_;
+};
+
+StreamRecorder::StreamRecorder() :
+	width_(0),
+	height_(0),
+	fps_(0),
+	writing_(false),
+	stopping_(false),
+	dropping_(false)
+{
+	stats_ = Stats();
+}
+
+StreamRecorder::~StreamRecorder()
+{
+	Close();
+}
+
+bool StreamRecorder::Open(const std::string& path, int width, int height, int fps, const Options& options)
+{
+	Close();
+
+	auto file = File::Create(path, options.direct);
+	if (!file)
+	{
+		return false;
+	}
+
+	// the header's written now too, so a recording that's never closed can still be read
+	Buffer header(kBlockSize);
+	if (header.data() == nullptr)
+	{
+		return false;
+	}
+
+	memset(header.data(), 0, kBlockSize);
+	memcpy(header.data(), kMagic, sizeof(kMagic));
+	header.data()[4] = kVersion;
+	WriteUint32(header.data() + 8, static_cast<uint32_t>(width));
+	WriteUint32(header.data() + 12, static_cast<uint32_t>(height));
+	WriteUint32(header.data() + 16, static_cast<uint32_t>(fps));
+	WriteUint64(header.data() + 24, kBlockSize);
+	if (!file->WriteAt(0, header.data(), kBlockSize))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	file_ = std::move(file);
+	options_ = options;
+	options_.batch_bytes = static_cast<size_t>(std::max<uint64_t>(kBlockSize, RoundUp(options.batch_bytes)));
+	options_.max_batches = std::max<size_t>(1, options.max_batches);
+	width_ = width;
+	height_ = height;
+	fps_ = fps;
+	writing_ = false;
+	stopping_ = false;
+	dropping_ = false;
+	index_.clear();
+	keyframes_.clear();
+	stats_ = Stats();
+	stats_.direct = file_->direct();
+
+	// one batch being filled, and as many again as may be waiting
+	free_.clear();
+	queued_.clear();
+	for (size_t i = 0; i <= options_.max_batches; i++)
+	{
+		std::unique_ptr<Buffer> buffer(new Buffer(options_.batch_bytes));
+		if (buffer->data() == nullptr)
+		{
+			file_.reset();
+			return false;
+		}
+
+		free_.push_back(std::move(buffer));
+	}
+
+	current_.reset(new Batch());
+	current_->buffer = std::move(free_.back());
+	free_.pop_back();
+	current_->size = 0;
+	current_->offset = kBlockSize;
+
+	thread_ = std::thread(&StreamRecorder::WriteLoop, this);
+	return true;
+}
+
+bool StreamRecorder::Close()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	if (!file_)
+	{
+		return false;
+	}
+
+	auto finished = Finish(lock);
+	stopping_ = true;
+	changed_.notify_all();
+	lock.unlock();
+
+	thread_.join();
+
+	lock.lock();
+	file_.reset();
+	current_.reset();
+	free_.clear();
+	return finished;
+}
+
+bool StreamRecorder::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return file_ != nullptr;
+}
+
+void StreamRecorder::Write(const EncodedFrame& frame, int64_t prediction_timestamp, const std::string& metadata)
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	if (!file_ || !current_)
+	{
+		return;
+	}
+
+	// a frame predicted from one that was dropped can't be decoded either
+	dropping_ = dropping_ && !frame.keyframe;
+	auto size = kRecordHeaderSize + frame.data.size() + metadata.size();
+	auto room = current_->buffer->capacity() - current_->size + free_.size() * options_.batch_bytes;
+	if (dropping_ || stats_.write_errors > 0 || size > room)
+	{
+		dropping_ = true;
+		stats_.dropped++;
+		return;
+	}
+
+	record_.resize(kRecordHeaderSize);
+	auto header = record_.data();
+	memcpy(header, kRecordMagic, sizeof(kRecordMagic));
+	WriteUint32(header + 4, static_cast<uint32_t>(frame.data.size()));
+	WriteUint32(header + 8, static_cast<uint32_t>(metadata.size()));
+	WriteUint32(header + 12, frame.keyframe ? kKeyframeFlag : 0);
+	WriteUint64(header + 16, static_cast<uint64_t>(frame.timestamp_us));
+	WriteUint64(header + 24, static_cast<uint64_t>(prediction_timestamp));
+	WriteUint16(header + 32, static_cast<uint16_t>(frame.width));
+	WriteUint16(header + 34, static_cast<uint16_t>(frame.height));
+	header[36] = static_cast<uint8_t>(static_cast<int8_t>(std::max(-1, std::min(127, frame.qp))));
+	memset(header + 37, 0, 3);
+
+	// the index entry is the record's offset and a copy of its header
+	auto entry = index_.size();
+	index_.resize(entry + kIndexEntrySize);
+	WriteUint64(index_.data() + entry, current_->offset + current_->size);
+	memcpy(index_.data() + entry + 8, header, kRecordHeaderSize);
+
+	Append(header, kRecordHeaderSize);
+	Append(frame.data.data(), frame.data.size());
+	Append(reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size());
+
+	if (frame.keyframe)
+	{
+		keyframes_.push_back(static_cast<uint32_t>(stats_.frames));
+		stats_.keyframes++;
+	}
+
+	stats_.frames++;
+	stats_.bytes += size;
+}
+
+StreamRecorder::Stats StreamRecorder::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+void StreamRecorder::WriteLoop()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	while (true)
+	{
+		changed_.wait(lock, [this]() { return stopping_ || !queued_.empty(); });
+		if (queued_.empty())
+		{
+			return;
+		}
+
+		auto batch = std::move(queued_.front());
+		queued_.pop_front();
+		writing_ = true;
+
+		lock.unlock();
+		auto written = file_->WriteAt(batch->offset, batch->buffer->data(), batch->size);
+		lock.lock();
+
+		stats_.batches++;
+		stats_.write_errors += written ? 0 : 1;
+		free_.push_back(std::move(batch->buffer));
+		writing_ = false;
+		changed_.notify_all();
+	}
+}
+
+bool StreamRecorder::Append(const uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+		if (current_->size == current_->buffer->capacity() && !Rotate())
+		{
+			return false;
+		}
+
+		auto chunk = std::min(size, current_->buffer->capacity() - current_->size);
+		memcpy(current_->buffer->data() + current_->size, data, chunk);
+		current_->size += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+
+	return true;
+}
+
+bool StreamRecorder::Rotate()
+{
+	if (free_.empty())
+	{
+		return false;
+	}
+
+	std::unique_ptr<Batch> next(new Batch());
+	next->buffer = std::move(free_.back());
+	free_.pop_back();
+	next->size = 0;
+	next->offset = current_->offset + current_->size;
+
+	queued_.push_back(std::move(current_));
+	current_ = std::move(next);
+	changed_.notify_all();
+	return true;
+}
+
+bool StreamRecorder::Finish(std::unique_lock<std::mutex>& lock)
+{
+	// the last batch is padded out to a whole block, which readers stop at
+	auto data_end = current_->offset + current_->size;
+	auto padded = static_cast<size_t>(RoundUp(current_->size));
+	memset(current_->buffer->data() + current_->size, 0, padded - current_->size);
+	current_->size = padded;
+	if (padded > 0)
+	{
+		queued_.push_back(std::move(current_));
+		changed_.notify_all();
+	}
+
+	current_.reset();
+	changed_.wait(lock, [this]() { return queued_.empty() && !writing_; });
+
+	auto index_offset = RoundUp(data_end);
+	auto keyframe_offset = index_offset + index_.size();
+	auto index_size = index_.size() + keyframes_.size() * 4;
+	Buffer index(static_cast<size_t>(RoundUp(std::max<size_t>(index_size, 1))));
+	Buffer header(kBlockSize);
+	if (index.data() == nullptr || header.data() == nullptr)
+	{
+		return false;
+	}
+
+	memset(index.data(), 0, index.capacity());
+	if (!index_.empty())
+	{
+		memcpy(index.data(), index_.data(), index_.size());
+	}
+
+	for (size_t i = 0; i < keyframes_.size(); i++)
+	{
+		WriteUint32(index.data() + index_.size() + i * 4, keyframes_[i]);
+	}
+
+	memset(header.data(), 0, kBlockSize);
+	memcpy(header.data(), kMagic, sizeof(kMagic));
+	header.data()[4] = kVersion;
+	WriteUint32(header.data() + 8, static_cast<uint32_t>(width_));
+	WriteUint32(header.data() + 12, static_cast<uint32_t>(height_));
+	WriteUint32(header.data() + 16, static_cast<uint32_t>(fps_));
+	WriteUint64(header.data() + 24, kBlockSize);
+	WriteUint64(header.data() + 32, data_end - kBlockSize);
+	WriteUint64(header.data() + 40, index_offset);
+	WriteUint64(header.data() + 48, keyframe_offset);
+	WriteUint32(header.data() + 56, static_cast<uint32_t>(stats_.frames));
+	WriteUint32(header.data() + 60, static_cast<uint32_t>(keyframes_.size()));
+
+	// the header goes last, so a recording is only indexed once its index is all there
+	auto written = stats_.write_errors == 0 &&
+		file_->WriteAt(index_offset, index.data(), index.capacity()) &&
+		file_->WriteAt(0, header.data(), kBlockSize);
+	stats_.write_errors += written ? 0 : 1;
+	return written;
+}
+
+/// <summary>
+/// A file mapped read-only into memory
+/// </summary>
+class StreamRecording::Mapping
+{
+public:
+	static std::unique_ptr<Mapping> Open(const std::string& path)
+	{
+		std::unique_ptr<Mapping> mapping(new Mapping());
+#ifdef _WIN32
+		mapping->file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER size;
+		if (mapping->file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapping->file_, &size) || size.QuadPart == 0)
+		{
+			return nullptr;
+		}
+
+		mapping->mapping_ = CreateFileMappingA(mapping->file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping->mapping_ == nullptr)
+		{
+			return nullptr;
+		}
+
+		mapping->data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping->mapping_, FILE_MAP_READ, 0, 0, 0));
+		mapping->size_ = static_cast<size_t>(size.QuadPart);
+#else
+		auto fd = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+
+			return nullptr;
+		}
+
+		auto data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		mapping->data_ = static_cast<const uint8_t*>(data);
+		mapping->size_ = static_cast<size_t>(status.st_size);
+#endif
+		return mapping->data_ != nullptr ? std::move(mapping) : nullptr;
+	}
+
+	~Mapping()
+	{
+#ifdef _WIN32
+		if (data_ != nullptr)
+		{
+			UnmapViewOfFile(data_);
+		}
+
+		if (mapping_ != nullptr)
+		{
+			CloseHandle(mapping_);
+		}
+
+		if (file_ != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file_);
+		}
+#else
+		if (data_ != nullptr)
+		{
+			munmap(const_cast<uint8_t*>(data_), size_);
+		}
+#endif
+	}
+
+	const uint8_t* data() const { return data_; }
+
+	size_t size() const { return size_; }
+
+private:
+	Mapping() :
+#ifdef _WIN32
+		file_(INVALID_HANDLE_VALUE),
+		mapping_(nullptr),
+#endif
+		data_(nullptr),
+		size_(0)
+	{
+	}
+
+#ifdef _WIN32
+	HANDLE file_;
+	HANDLE mapping_;
+#endif
+	const uint8_t* data_;
+	size_t size_;
+};
+
+StreamRecording::StreamRecording() :
+	data_(nullptr),
+	size_(0),
+	width_(0),
+	height_(0),
+	fps_(0),
+	recovered_(false)
+{
+}
+
+StreamRecording::~StreamRecording()
+{
+}
+
+bool StreamRecording::Open(const std::string& path)
+{
+	Close();
+	mapping_ = Mapping::Open(path);
+	if (!mapping_)
+	{
+		return false;
+	}
+
+	data_ = mapping_->data();
+	size_ = mapping_->size();
+	if (!Parse())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool StreamRecording::Open(const uint8_t* data, size_t size)
+{
+	Close();
+	data_ = data;
+	size_ = size;
+	if (!Parse())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void StreamRecording::Close()
+{
+	frames_.clear();
+	keyframes_.clear();
+	mapping_.reset();
+	data_ = nullptr;
+	size_ = 0;
+	width_ = 0;
+	height_ = 0;
+	fps_ = 0;
+	recovered_ = false;
+}
+
+int StreamRecording::width() const
+{
+	return width_;
+}
+
+int StreamRecording::height() const
+{
+	return height_;
+}
+
+int StreamRecording::fps() const
+{
+	return fps_;
+}
+
+size_t StreamRecording::frames() const
+{
+	return frames_.size();
+}
+
+const RecordedFrame& StreamRecording::frame(size_t index) const
+{
+	return frames_[index];
+}
+
+const std::vector<uint32_t>& StreamRecording::keyframes() const
+{
+	return keyframes_;
+}
+
+bool StreamRecording::Seek(int64_t timestamp_us, size_t* index) const
+{
+	if (keyframes_.empty())
+	{
+		return false;
+	}
+
+	auto after = std::upper_bound(keyframes_.begin(), keyframes_.end(), timestamp_us, [this](int64_t value, uint32_t keyframe)
+	{
+		return value < frames_[keyframe].timestamp_us;
+	});
+
+	*index = after == keyframes_.begin() ? keyframes_.front() : *(after - 1);
+	return true;
+}
+
+bool StreamRecording::recovered() const
+{
+	return recovered_;
+}
+
+bool StreamRecording::WriteElementaryStream(std::ostream& out) const
+{
+	for (const auto& frame : frames_)
+	{
+		out.write(reinterpret_cast<const char*>(frame.data), frame.size);
+	}
+
+	return out.good();
+}
+
+bool StreamRecording::Parse()
+{
+	if (size_ < StreamRecorder::kBlockSize || memcmp(data_, kMagic, sizeof(kMagic)) != 0 || data_[4] != kVersion)
+	{
+		return false;
+	}
+
+	width_ = static_cast<int>(ReadUint32(data_ + 8));
+	height_ = static_cast<int>(ReadUint32(data_ + 12));
+	fps_ = static_cast<int>(ReadUint32(data_ + 16));
+	auto data_offset = ReadUint64(data_ + 24);
+	auto index_offset = ReadUint64(data_ + 40);
+	auto keyframe_offset = ReadUint64(data_ + 48);
+	uint64_t frames = ReadUint32(data_ + 56);
+	uint64_t keyframes = ReadUint32(data_ + 60);
+
+	auto indexed = index_offset != 0 && index_offset <= size_ && frames <= (size_ - index_offset) / kIndexEntrySize &&
+		keyframe_offset <= size_ && keyframes <= (size_ - keyframe_offset) / 4;
+	if (indexed)
+	{
+		frames_.resize(static_cast<size_t>(frames));
+		for (size_t i = 0; i < frames_.size(); i++)
+		{
+			auto entry = data_ + index_offset + i * kIndexEntrySize;
+			if (!ReadRecord(ReadUint64(entry), entry + 8, &frames_[i]))
+			{
+				return false;
+			}
+		}
+
+		for (uint64_t i = 0; i < keyframes; i++)
+		{
+			auto keyframe = ReadUint32(data_ + keyframe_offset + i * 4);
+			if (keyframe >= frames || !frames_[keyframe].keyframe)
+			{
+				return false;
+			}
+
+			keyframes_.push_back(keyframe);
+		}
+
+		return true;
+	}
+
+	// never closed, so the records are read up to the first that isn't whole
+	recovered_ = true;
+	auto offset = data_offset;
+	RecordedFrame frame;
+	while (offset <= size_ && kRecordHeaderSize <= size_ - offset && ReadRecord(offset, data_ + offset, &frame))
+	{
+		if (frame.keyframe)
+		{
+			keyframes_.push_back(static_cast<uint32_t>(frames_.size()));
+		}
+
+		frames_.push_back(frame);
+		offset += kRecordHeaderSize + frame.size + frame.metadata_size;
+	}
+
+	return true;
+}
+
+bool StreamRecording::ReadRecord(uint64_t offset, const uint8_t* header, RecordedFrame* frame) const
+{
+	if (memcmp(header, kRecordMagic, sizeof(kRecordMagic)) != 0)
+	{
+		return false;
+	}
+
+	uint64_t size = ReadUint32(header + 4);
+	uint64_t metadata_size = ReadUint32(header + 8);
+	if (offset > size_ || kRecordHeaderSize + size + metadata_size > size_ - offset)
+	{
+		return false;
+	}
+
+	auto data = data_ + offset + kRecordHeaderSize;
+	frame->data = data;
+	frame->size = static_cast<size_t>(size);
+	frame->metadata = data + size;
+	frame->metadata_size = static_cast<size_t>(metadata_size);
+	frame->keyframe = (ReadUint32(header + 12) & kKeyframeFlag) != 0;
+	frame->timestamp_us = static_cast<int64_t>(ReadUint64(header + 16));
+	frame->prediction_timestamp = static_cast<int64_t>(ReadUint64(header + 24));
+	frame->width = ReadUint16(header + 32);
+	frame->height = ReadUint16(header + 34);
+	frame->qp = static_cast<int8_t>(header[36]);
+	return true;
+}
@@ -0,0 +1,157 @@
+#include "stream_replayer.h"
+
+#include <algorithm>
+
+namespace
+{
+	const int kDefaultFps = 30;
+}
+
+StreamReplayer::StreamReplayer(const StreamRecording* recording, const Deliver& deliver, const Options& options) :
+	recording_(recording),
+	deliver_(deliver),
+	options_(options),
+	running_(false),
+	stopping_(false),
+	keyframe_requested_(false)
+{
+	stats_ = Stats();
+}
+
+StreamReplayer::~StreamReplayer()
+{
+	Stop();
+}
+
+bool StreamReplayer::Start()
+{
+	Stop();
+	if (recording_->keyframes().empty())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	running_ = true;
+	keyframe_requested_ = false;
+	thread_ = std::thread(&StreamReplayer::PlayLoop, this);
+	return true;
+}
+
+void StreamReplayer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stopping_ = true;
+		changed_.notify_all();
+	}
+
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+
+	std::lock_guard<std::mutex> lock(lock_);
+	stopping_ = false;
+}
+
+bool StreamReplayer::IsRunning() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return running_;
+}
+
+void StreamReplayer::Wait()
+{
+	std::unique_lock<std::mutex> lock(lock_);
+	changed_.wait(lock, [this]() { return !running_; });
+}
+
+void StreamReplayer::RequestKeyframe()
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	keyframe_requested_ = true;
+	stats_.keyframe_requests++;
+}
+
+StreamReplayer::Stats StreamReplayer::stats() const
+{
+	std::lock_guard<std::mutex> lock(lock_);
+	return stats_;
+}
+
+void StreamReplayer::PlayLoop()
+{
+	auto fps = recording_->fps() > 0 ? recording_->fps() : kDefaultFps;
+	int64_t interval_us = 1000000 / fps;
+	size_t index = recording_->keyframes().front();
+	int64_t timestamp_us = 0;
+	auto start = Clock::now();
+
+	std::unique_lock<std::mutex> lock(lock_);
+	while (!stopping_)
+	{
+		if (options_.speed > 0)
+		{
+			auto due = start + std::chrono::microseconds(static_cast<int64_t>(timestamp_us / options_.speed));
+			if (changed_.wait_until(lock, due, [this]() { return stopping_; }))
+			{
+				break;
+			}
+
+			auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due).count();
+			stats_.max_lateness_us = std::max(stats_.max_lateness_us, static_cast<int64_t>(lateness));
+		}
+
+		if (keyframe_requested_)
+		{
+			keyframe_requested_ = false;
+			if (!recording_->frame(index).keyframe)
+			{
+				index = NextKeyframe(index);
+			}
+		}
+
+		const auto& frame = recording_->frame(index);
+		stats_.frames++;
+		stats_.keyframes += frame.keyframe ? 1 : 0;
+
+		lock.unlock();
+		deliver_(frame, timestamp_us);
+		lock.lock();
+
+		// the next frame follows at its recorded interval, or a frame's worth later if it has none
+		if (index + 1 < recording_->frames())
+		{
+			auto step = recording_->frame(index + 1).timestamp_us - frame.timestamp_us;
+			timestamp_us += step > 0 ? step : interval_us;
+			index++;
+		}
+		else if (options_.loop)
+		{
+			timestamp_us += interval_us;
+			index = recording_->keyframes().front();
+			stats_.loops++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	running_ = false;
+	changed_.notify_all();
+}
+
+size_t StreamReplayer::NextKeyframe(size_t index)
+{
+	const auto& keyframes = recording_->keyframes();
+	auto next = std::upper_bound(keyframes.begin(), keyframes.end(), static_cast<uint32_t>(index));
+	if (next == keyframes.end())
+	{
+		stats_.loops++;
+		return keyframes.front();
+	}
+
+	return *next;
+}
@@ -0,0 +1,65 @@
+#include "video_frame.h"
+
+I420Frame::I420Frame() :
+	width_(0),
+	height_(0)
+{
+	offsets_[0] = offsets_[1] = offsets_[2] = 0;
+}
+
+I420Frame::I420Frame(int width, int height) :
+	I420Frame()
+{
+	Allocate(width, height);
+}
+
+void I420Frame::Allocate(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+
+	offsets_[0] = 0;
+	offsets_[1] = offsets_[0] + static_cast<size_t>(PlaneWidth(0)) * PlaneHeight(0);
+	offsets_[2] = offsets_[1] + static_cast<size_t>(PlaneWidth(1)) * PlaneHeight(1);
+	buffer_.resize(offsets_[2] + static_cast<size_t>(PlaneWidth(2)) * PlaneHeight(2));
+}
+
+int I420Frame::width() const
+{
+	return width_;
+}
+
+int I420Frame::height() const
+{
+	return height_;
+}
+
+int I420Frame::PlaneWidth(int plane) const
+{
+	return plane == 0 ? width_ : (width_ + 1) / 2;
+}
+
+int I420Frame::PlaneHeight(int plane) const
+{
+	return plane == 0 ? height_ : (height_ + 1) / 2;
+}
+
+uint8_t* I420Frame::data(int plane)
+{
+	return buffer_.data() + offsets_[plane];
+}
+
+const uint8_t* I420Frame::data(int plane) const
+{
+	return buffer_.data() + offsets_[plane];
+}
+
+size_t I420Frame::size() const
+{
+	return buffer_.size();
+}
+
+bool I420Frame::empty() const
+{
+	return buffer_.empty();
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "webrtc/modules/include/module_common_types.h"
+#include "webrtc/modules/video_coding/include/video_codec_interface.h"
+
+// from VideoEncoder
+#include "encoder_factory.h"
+#include "encoder_session_pool.h"
+#include "loss_recovery.h"
+
+namespace StreamingToolkit
+{
+	class LossReportRouter;
+
+	// Resolves kAuto to NVENC if webrtc's H.264 encoder can open a session on this machine, and to
+	// software otherwise. Other types are returned as they are.
+	EncoderBackendType ResolveEncoderBackend(EncoderBackendType type);
+
+	// Encodes webrtc's frames with a VideoEncoder library backend, for streams that aren't encoded
+	// by webrtc's own H.264 encoder, which only drives NVENC.
+	//
+	// Frames are converted to I420 and encoded one at a time on webrtc's encoder thread, so the
+	// backend's queue is never more than a frame deep. Frames a capturer sends for webrtc's NVENC
+	// encoder, which a PooledVideoEncoder that fell back to software passes on, are converted
+	// from the RGBA buffer they carry instead. A new resolution reconfigures the session,
+	// or starts it again if the backend can't change size in place.
+	//
+	// A peer's loss is recovered from with a LossRecovery, which invalidates the frames after the
+	// last one the peer decoded when it reports it, and answers the keyframes webrtc asks for on
+	// its PLI or FIR with an IDR.
+	class BackendVideoEncoder : public webrtc::VideoEncoder
+	{
+	public:
+		// Takes |encoder|, registering with |loss_reports|, if set, for the reports of the peer
+		// whose video it encodes
+		explicit BackendVideoEncoder(std::unique_ptr<EncoderBackend> encoder,
+			std::shared_ptr<LossReportRouter> loss_reports = nullptr);
+
+		~BackendVideoEncoder();
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+			int32_t number_of_cores,
+			size_t max_payload_size) override;
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+
+		int32_t Release() override;
+
+		int32_t Encode(const webrtc::VideoFrame& frame,
+			const webrtc::CodecSpecificInfo* codec_specific_info,
+			const std::vector<webrtc::FrameType>* frame_types) override;
+
+		int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+
+		int32_t SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate) override;
+
+		const char* ImplementationName() const override;
+
+		// Whether one of the frames sent recently had |prediction_timestamp|
+		bool HasSent(int64_t prediction_timestamp) const;
+
+		// The peer decoded the frame with |prediction_timestamp| and lost one after it, returning
+		// false if it isn't one sent recently
+		bool OnLastGoodFrame(int64_t prediction_timestamp);
+
+		// Asks for an IDR, for a peer with nothing to predict from
+		void RequestKeyframe();
+
+	private:
+		// Applies |config| to the running session, starting it again if it has to
+		bool Apply(const EncoderConfig& config);
+
+		std::unique_ptr<EncoderBackend> encoder_;
+		std::shared_ptr<LossReportRouter> loss_reports_;
+		webrtc::EncodedImageCallback* callback_;
+		bool initialized_;
+
+		LossRecovery recovery_;
+
+		// The prediction timestamp of each recent frame, which the peer names frames by, and the
+		// timestamp it was encoded with, which the recovery does
+		mutable std::mutex sent_lock_;
+		std::deque<std::pair<int64_t, int64_t>> sent_;
+
+		// Reused for every frame, so encoding doesn't allocate once the sizes settle
+		I420Frame input_;
+		EncodedFrame output_;
+
+		// Where each NAL unit of the frame being sent starts, for the packetizer
+		webrtc::RTPFragmentationHeader fragmentation_;
+	};
+
+	// Encodes with webrtc's H.264 encoder, which drives NVENC, while |sessions| has a hardware
+	// session for it, and in software otherwise.
+	//
+	// The pool is only told of the sessions webrtc's encoder opens, so with no limit configured
+	// it learns the limit when the device refuses one: the encoder that was refused is counted
+	// as software and carries on in software, as every one after it does until a session closes.
+	class PooledVideoEncoder : public webrtc::VideoEncoder
+	{
+	public:
+		typedef std::function<webrtc::VideoEncoder*()> Factory;
+
+		// Acquires a session of |sessions| as |session_id|, encoding with what |hardware| makes if
+		// it's on hardware and |software| if not. |software| returns null if there's no software
+		// encoder, when the hardware one is tried whatever the limit.
+		PooledVideoEncoder(const Factory& hardware,
+			const Factory& software,
+			std::shared_ptr<EncoderSessionPool> sessions,
+			int session_id);
+
+		~PooledVideoEncoder();
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+			int32_t number_of_cores,
+			size_t max_payload_size) override;
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+
+		int32_t Release() override;
+
+		int32_t Encode(const webrtc::VideoFrame& frame,
+			const webrtc::CodecSpecificInfo* codec_specific_info,
+			const std::vector<webrtc::FrameType>* frame_types) override;
+
+		int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+
+		int32_t SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate) override;
+
+		ScalingSettings GetScalingSettings() const override;
+
+		bool SupportsNativeHandle() const override;
+
+		const char* ImplementationName() const override;
+
+	private:
+		Factory software_;
+		std::shared_ptr<EncoderSessionPool> sessions_;
+		int session_id_;
+		bool hardware_;
+		std::unique_ptr<webrtc::VideoEncoder> encoder_;
+		webrtc::EncodedImageCallback* callback_;
+	};
+
+	// Hands each peer's loss reports to the BackendVideoEncoder encoding its video.
+	//
+	// webrtc creates encoders without saying which peer connection they're for, so a peer is
+	// matched to the encoder that sent the frame its first report names, by prediction timestamp,
+	// and its later reports go to that encoder. Peers' frames can share prediction timestamps,
+	// in which case each encoder that sent it is asked for an IDR rather than guessing. Reports
+	// come from the signaling thread and encoders come and go on webrtc's.
+	class LossReportRouter
+	{
+	public:
+		void Add(BackendVideoEncoder* encoder);
+
+		void Remove(BackendVideoEncoder* encoder);
+
+		// The body of a LossRecovery::kMessageType message from |peer_id|, the prediction timestamp
+		// of the last frame it decoded or -1
+		void OnLastGoodFrame(int peer_id, int64_t prediction_timestamp);
+
+	private:
+		std::mutex lock_;
+		std::vector<BackendVideoEncoder*> encoders_;
+		std::map<int, BackendVideoEncoder*> peers_;
+	};
+}
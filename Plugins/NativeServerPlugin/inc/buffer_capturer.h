@@ -12,6 +12,7 @@
 
 #include <string.h>
 #include <memory>
+#include <string>
 #include <vector>
 #include <thread>
 #include <chrono>
@@ -28,6 +29,13 @@
 
 #include "libyuv/convert.h"
 
+// from InputProtocol
+#include "frame_metadata.h"
+
+// from VideoEncoder
+#include "encoder_control.h"
+#include "encoder_factory.h"
+
 using namespace webrtc;
 
 namespace StreamingToolkit
@@ -70,14 +78,56 @@ namespace StreamingToolkit
 
 		sigslot::signal1<BufferCapturer*> SignalDestroyed;
 
+		// Emitted on the sending thread when a frame carrying metadata is sent, for the metadata to
+		// follow it over the data channel.
+		sigslot::signal1<BufferCapturer*, sigslot::multi_threaded_local> SignalFrameMetadata;
+
+		// Metadata waiting for the data channel.
+		FrameMetadataQueue& frame_metadata() { return frame_metadata_; }
+
+		// Emitted on the sending thread with the prediction timestamp of each frame that has one, as
+		// it goes to the encoder.
+		sigslot::signal2<BufferCapturer*, int64_t, sigslot::multi_threaded_local> SignalFrameSent;
+
+		// Gives frames sent without a prediction timestamp one from our clock, in milliseconds, so
+		// the client can tell them apart, as it must to measure their latency.
+		void SetStampFrames(bool stamp_frames);
+
+		// Sends textures for webrtc's NVENC encoder if |backend| is kNvenc, and I420 frames for any
+		// other. Defaults to NVENC where the device supports it.
+		void SetEncoderBackend(EncoderBackendType backend);
+
+		// Drops frames sent faster than the framerate |control| asks for, or none if null.
+		void SetEncoderControl(EncoderControl* control);
+
+		// Keeps the metadata of frames sent in |inputs| too, for the stream recording, or not if null.
+		void SetFrameInputs(std::shared_ptr<FrameInputs> inputs);
+
 	protected:
 		virtual void SendFrame(webrtc::VideoFrame video_frame);
 
+		// Sends a frame with |metadata|, which the client receives keyed by the frame's prediction
+		// timestamp. Frames without a prediction timestamp can't carry metadata.
+		void SendFrame(webrtc::VideoFrame video_frame, const std::string& metadata);
+
+		// Whether the capturer is running and the framerate asked for leaves room for another frame.
+		bool AdmitFrame();
+
+		// Stamps |video_frame| if it has no prediction timestamp and we're asked to.
+		void StampFrame(webrtc::VideoFrame* video_frame);
+
+		void DeliverFrame(webrtc::VideoFrame video_frame);
+
 		Clock* const clock_;
 		bool use_software_encoder_;
 		bool running_;
 		rtc::VideoSinkInterface<VideoFrame>* sink_;
 		SinkWantsObserver* sink_wants_observer_;
+		EncoderControl* encoder_control_;
 		rtc::CriticalSection lock_;
+		FrameMetadataQueue frame_metadata_;
+		std::shared_ptr<FrameInputs> frame_inputs_;
+		bool stamp_frames_;
+		int64_t last_stamp_;
 	};
 }
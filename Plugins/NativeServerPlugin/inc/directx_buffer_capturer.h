@@ -31,9 +31,11 @@ namespace StreamingToolkit
 
 		virtual ~DirectXBufferCapturer() {}
 
-		void SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp = -1);
+		void SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp = -1,
+			const std::string& metadata = std::string());
 
-		void SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp = -1);
+		void SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp = -1,
+			const std::string& metadata = std::string());
 
 	private:
 		void UpdateStagingBuffer(ID3D11Texture2D* frame_buffer);
@@ -15,9 +15,12 @@ public:
 		const function<void(const string&)>& send_func,
 		ID3D11Device* d3d_device);
 
-	void SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp = -1);
+	// |metadata|, if any, reaches the client with the frame, by its prediction timestamp
+	void SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp = -1,
+		const string& metadata = string());
 
-	void SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp = -1);
+	void SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp = -1,
+		const string& metadata = string());
 
 protected:
 	// Provide the same buffer capturer for each single video track
@@ -7,10 +7,17 @@
 #include <atomic>
 #include <wrl\client.h>
 
+#include "backend_video_encoder.h"
 #include "peer_conductor.h"
 #include "main_window.h"
 #include "peer_connection_client.h"
 
+// from InputProtocol
+#include "input_coalescer.h"
+#include "input_dispatcher.h"
+#include "input_log.h"
+#include "input_replayer.h"
+
 #include "webrtc/rtc_base/sigslot.h"
 
 using namespace Microsoft::WRL;
@@ -36,8 +43,25 @@ public:
 
 	void SetMainWindow(MainWindow* main_window);
 
+	// Handles any data channel message the input dispatcher has no handler for
 	void SetDataChannelMessageHandler(const function<void(int, const string&)>& data_channel_handler);
 
+	// Routes data channel messages to handlers registered by message type
+	InputDispatcher& Dispatcher();
+
+	// Collapses bursts of data channel messages that supersede each other, before they're routed
+	InputCoalescer& Coalescer();
+
+	// Records every data channel message received, when opened
+	InputLogWriter& InputLog();
+
+	// Decides which peers' encoders get a hardware encode session, and reports how many are in use
+	EncoderSessionPool& EncoderSessions();
+
+	// Feeds a recorded session to the input pipeline on this thread, as if from its synthetic
+	// peers, replacing any replay in progress
+	void StartInputReplay(unique_ptr<InputReplayer> replayer);
+
 	virtual void OnSignedIn() override;
 
 	virtual void OnDisconnected() override;
@@ -80,12 +104,23 @@ public:
 	// Handles message received via data channel
 	void HandleDataChannelMessage(int peer_id, const string& message);
 
+	// Routes the coalesced messages that are due
+	void DrainInput();
+
+	// Delivers the replayed messages that are due
+	void ReplayInput();
+
 	// Handles connection event from the signalling_client_
 	void HandleSignalConnect();
 
+	// Tells the peers, on this thread, that the frame with |prediction_timestamp| left the encoder
+	void OnFrameEncoded(int64_t prediction_timestamp);
+
 protected:
+	// Uses the plugin's own peer connection factory, recording and timing the encoder as the config
+	// asks, unless given |peer_factory|
 	MultiPeerConductor(shared_ptr<FullServerConfig> config,
-		scoped_refptr<PeerConnectionFactoryInterface> peer_factory = webrtc::CreatePeerConnectionFactory());
+		scoped_refptr<PeerConnectionFactoryInterface> peer_factory = nullptr);
 	~MultiPeerConductor();
 
 	struct MessageEntry
@@ -98,6 +133,9 @@ protected:
 	// Handles creation of a new peer entry in connected_peers_ if needed
 	virtual scoped_refptr<PeerConductor> SafeAllocatePeerMapEntry(int peer_id) = 0;
 
+	// Routes a data channel message to its handler, or to data_channel_handler_
+	void DispatchDataChannelMessage(int peer_id, const char* data, size_t size);
+
 	int max_capacity_;
 	int cur_capacity_;
 	PeerConnectionClient signalling_client_;
@@ -108,5 +146,25 @@ protected:
 	queue<MessageEntry> message_queue_;
 	atomic_bool should_process_queue_;
 	function<void(int, const string&)> data_channel_handler_;
+	InputDispatcher input_dispatcher_;
+	InputCoalescer input_coalescer_;
+	atomic_bool input_drain_posted_;
+	InputLogWriter input_log_;
+	unique_ptr<InputReplayer> input_replayer_;
+	int64_t input_replay_start_us_;
 	MainWindow* main_window_;
+	shared_ptr<EncoderSessionPool> encoder_sessions_;
+
+	// What every peer is encoded with, kAuto resolved for this machine
+	EncoderBackendType encoder_backend_;
+
+	// Hands the peers' loss reports to the encoders of ours that can recover from them
+	shared_ptr<LossReportRouter> loss_reports_;
+
+	// The peers' poses and frame metadata, for the encoders to record with each frame, or null if
+	// the video isn't recorded
+	shared_ptr<FrameInputs> frame_inputs_;
+
+	// Where the peers are handled, which encoders report to
+	Thread* thread_;
 };
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "webrtc/api/peerconnectioninterface.h"
+#include "webrtc/media/engine/webrtcvideoencoderfactory.h"
+#include "webrtc/modules/include/module_common_types.h"
+#include "webrtc/modules/video_coding/include/video_codec_interface.h"
+
+namespace StreamingToolkit
+{
+	// An H.264 "encoder" that sends the bitstream ReplayBufferCapturer's frames already carry,
+	// so webrtc packetizes, paces and protects a recording as it would a live stream.
+	//
+	// The bitstream can't change, so target bitrates and resolutions are ignored, and a keyframe
+	// asked for is the recording's next one. Frames without a recorded bitstream, such as the
+	// black frames sent while a track is muted, are dropped.
+	class PassthroughVideoEncoder : public webrtc::VideoEncoder
+	{
+	public:
+		PassthroughVideoEncoder();
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+			int32_t number_of_cores,
+			size_t max_payload_size) override;
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+
+		int32_t Release() override;
+
+		int32_t Encode(const webrtc::VideoFrame& frame,
+			const webrtc::CodecSpecificInfo* codec_specific_info,
+			const std::vector<webrtc::FrameType>* frame_types) override;
+
+		int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+
+		int32_t SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate) override;
+
+		const char* ImplementationName() const override;
+
+	private:
+		webrtc::EncodedImageCallback* callback_;
+
+		// Where each NAL unit of the frame being sent starts, for the packetizer
+		webrtc::RTPFragmentationHeader fragmentation_;
+	};
+
+	// Makes a PassthroughVideoEncoder for every H.264 stream.
+	class PassthroughEncoderFactory : public cricket::WebRtcVideoEncoderFactory
+	{
+	public:
+		PassthroughEncoderFactory();
+
+		webrtc::VideoEncoder* CreateVideoEncoder(const cricket::VideoCodec& codec) override;
+
+		const std::vector<cricket::VideoCodec>& supported_codecs() const override;
+
+		void DestroyVideoEncoder(webrtc::VideoEncoder* encoder) override;
+
+	private:
+		std::vector<cricket::VideoCodec> codecs_;
+	};
+
+	// A peer connection factory whose video tracks send replayed bitstreams as they are, for
+	// peers given a ReplayBufferCapturer.
+	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreatePassthroughPeerConnectionFactory();
+}
@@ -10,6 +10,16 @@
 // from ConfigParser
 #include "structs.h"
 
+// from SignalingClient
+#include "signaling_codec.h"
+
+// from InputProtocol
+#include "input_channels.h"
+#include "latency_recorder.h"
+
+// from VideoEncoder
+#include "encoder_control.h"
+
 #include "webrtc/rtc_base/sigslot.h"
 #include "webrtc/rtc_base/json.h"
 #include "webrtc/api/mediastreaminterface.h"
@@ -25,7 +35,8 @@ using namespace sigslot;
 // Abstract PeerConductor
 class PeerConductor : public PeerConnectionObserver,
 	public CreateSessionDescriptionObserver,
-	public DataChannelObserver
+	public DataChannelObserver,
+	public has_slots<multi_threaded_local>
 {
 public:
 	PeerConductor(int id,
@@ -82,6 +93,9 @@ public:
 	// Emitted when a message is received via data channel
 	signal2<int, const string&> SignalDataChannelMessage;
 
+	// Sends a message to the peer, on the reliable or unreliable data channel by its type
+	bool SendDataChannelMessage(const string& message);
+
 	//  A data buffer was successfully received.
 	virtual void OnMessage(const DataBuffer& buffer) override;
 
@@ -99,13 +113,59 @@ public:
 
 	const vector<scoped_refptr<webrtc::MediaStreamInterface>> Streams() const;
 
+	// Retargets the video without renegotiating, 0 leaving a value as it is, as the peer asks
+	// with an EncoderControl::kMessageType message. The bitrate caps the peer connection's
+	// bandwidth estimate, the capturer drops frames beyond the framerate, and renderers read the
+	// resolution from encoder_control.
+	void SetVideoTargets(int bitrate_bps, int fps = 0, int width = 0, int height = 0);
+
+	// The targets last set, for the renderer to size the peer's frames by
+	EncoderControl& encoder_control();
+
+	// The backend the peer connection factory encodes with, which the peer's capturer sends
+	// frames for
+	void SetEncoderBackend(EncoderBackendType encoder_backend);
+
+	// Where the metadata of the peer's frames is kept for the stream recording, if one is made
+	void SetFrameInputs(shared_ptr<FrameInputs> frame_inputs);
+
+	// Notes that one of the peer's messages was handed to its handler, ie. to the renderer for
+	// input, when tracking latency
+	void OnInputDispatched(const char* data, size_t size);
+
+	// Reports the latency of the input the frame with |prediction_timestamp| shows to the peer, when
+	// tracking latency and the frame is one of ours
+	void OnFrameEncoded(int64_t prediction_timestamp, int64_t time_us);
+
 protected:
 	// Allocates a buffer capturer for a single video track
 	virtual unique_ptr<cricket::VideoCapturer> AllocateVideoCapturer() = 0;
 
+	// Sends the metadata attached to |capturer|'s frames over the data channel, and keeps it for
+	// the stream recording
+	void ForwardFrameMetadata(BufferCapturer* capturer);
+
+	// Paces |capturer|'s frames to the framerate set with SetVideoTargets
+	void PaceFrames(BufferCapturer* capturer);
+
+	// Follows the peer's input into |capturer|'s frames, when the config asks to track latency
+	void TrackLatency(BufferCapturer* capturer);
+
+	// Has |capturer| send frames for the encoder backend. The peer connection factory counts NVENC
+	// sessions against the hardware limit, and encodes the streams past it in software from the
+	// same frames.
+	void UseEncoderBackend(BufferCapturer* capturer);
+
 	scoped_refptr<PeerConnectionInterface> peer_connection_;
 
 private:
+	// Receives a data channel's messages, and sends on it once it's open
+	void AddDataChannel(scoped_refptr<DataChannelInterface> channel);
+
+	void OnFrameMetadata(BufferCapturer* capturer);
+
+	void OnFrameSent(BufferCapturer* capturer, int64_t prediction_timestamp);
+
 	int id_;
 	string name_;
 	shared_ptr<WebRTCConfig> webrtc_config_;
@@ -113,22 +173,22 @@ private:
 	function<void(const string&)> send_func_;
 	vector<scoped_refptr<webrtc::MediaStreamInterface>> peer_streams_;
 
-	// Names used for a IceCandidate JSON object.
-	const char* kCandidateSdpMidName = "sdpMid";
-	const char* kCandidateSdpMlineIndexName = "sdpMLineIndex";
-	const char* kCandidateSdpName = "candidate";
+	// The reliable control and unreliable input channels, either of which an older peer may not open
+	scoped_refptr<DataChannelInterface> data_channels_[InputChannels::CHANNEL_COUNT];
+	InputChannels input_channels_;
+
+	EncoderControl encoder_control_;
+	EncoderBackendType encoder_backend_;
+	shared_ptr<FrameInputs> frame_inputs_;
+
+	// Times the peer's input on its way to the encoder, if webrtc_config_ asks to track latency
+	ServerLatencyTracker latency_tracker_;
+
+	// The format we encode signaling messages in, which follows whatever the peer last sent us
+	SignalingCodec::Format signaling_format_;
 
 	// Names used for stream labels.
 	const char* kAudioLabel = "audio_label";
 	const char* kVideoLabel = "video_label";
 	const char* kStreamLabel = "stream_label";
-
-	// Names used for a SessionDescription JSON object.
-	const char* kSessionDescriptionTypeName = "type";
-	const char* kSessionDescriptionSdpName = "sdp";
-
-	// Credentials for Turn Server.
-	const char* kTurnServerUri = "uri";
-	const char* kTurnServerUsername = "username";
-	const char* kTurnServerPassword = "password";
 };
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "webrtc/api/peerconnectioninterface.h"
+#include "webrtc/media/engine/webrtcvideoencoderfactory.h"
+#include "webrtc/modules/video_coding/include/video_codec_interface.h"
+
+// from InputProtocol
+#include "frame_metadata.h"
+
+// from VideoEncoder
+#include "encoder_factory.h"
+#include "encoder_session_pool.h"
+#include "stream_recording.h"
+
+namespace StreamingToolkit
+{
+	class LossReportRouter;
+
+	// Wraps an H.264 encoder, writing each image it encodes to a StreamRecorder on its way
+	// to the packetizer, so a live session can be replayed later with ReplayMultiPeerConductor.
+	//
+	// The recording is opened at the first size the encoder is set up with and closed when the
+	// encoder is destroyed. The input pose and metadata of each frame travel beside the video
+	// rather than through the encoder, so they're taken from |inputs| by prediction timestamp and
+	// recorded with the image, as a FrameInputs record.
+	//
+	// An observer can also be told the prediction timestamp of each image as it leaves the encoder,
+	// which is how the server times its frames' encode when tracking latency.
+	class RecordingVideoEncoder : public webrtc::VideoEncoder, public webrtc::EncodedImageCallback
+	{
+	public:
+		// Called on the encoder's thread with the prediction timestamp of each image encoded
+		typedef std::function<void(int64_t prediction_timestamp)> EncodeObserver;
+
+		// Takes |encoder|, recording what it encodes to |path|, with what |inputs| holds for each
+		// image, if |recorder| isn't null and telling |observer|, if set, of every image with a
+		// prediction timestamp.
+		RecordingVideoEncoder(webrtc::VideoEncoder* encoder,
+			std::shared_ptr<StreamRecorder> recorder,
+			const std::string& path,
+			const EncodeObserver& observer = nullptr,
+			std::shared_ptr<FrameInputs> inputs = nullptr);
+
+		~RecordingVideoEncoder();
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+			int32_t number_of_cores,
+			size_t max_payload_size) override;
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override;
+
+		int32_t Release() override;
+
+		int32_t Encode(const webrtc::VideoFrame& frame,
+			const webrtc::CodecSpecificInfo* codec_specific_info,
+			const std::vector<webrtc::FrameType>* frame_types) override;
+
+		int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override;
+
+		int32_t SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate) override;
+
+		ScalingSettings GetScalingSettings() const override;
+
+		bool SupportsNativeHandle() const override;
+
+		const char* ImplementationName() const override;
+
+		Result OnEncodedImage(const webrtc::EncodedImage& image,
+			const webrtc::CodecSpecificInfo* codec_specific_info,
+			const webrtc::RTPFragmentationHeader* fragmentation) override;
+
+	private:
+		std::unique_ptr<webrtc::VideoEncoder> encoder_;
+		std::shared_ptr<StreamRecorder> recorder_;
+		std::string path_;
+		EncodeObserver observer_;
+		std::shared_ptr<FrameInputs> inputs_;
+		webrtc::EncodedImageCallback* callback_;
+
+		// Reused for every image, so recording doesn't allocate once the bitstream stops growing
+		EncodedFrame frame_;
+	};
+
+	// Makes an H.264 encoder for every stream, recording each to a path of its own, with the pose
+	// and metadata |inputs| holds for its frames. The first stream created is recorded to |path|
+	// and each later one to |path| with its stream number before the extension, eg. session-1.3dsr,
+	// so no recording is replaced when a peer leaves and another joins.
+	//
+	// Streams are encoded by webrtc's own encoder, which drives NVENC, unless the backend is
+	// kSoftware, when they're encoded by the VideoEncoder library's OpenH264 backend, which
+	// registers with |loss_reports| to recover peers from their loss reports. With |sessions|,
+	// NVENC streams past the hardware limit are encoded with OpenH264 too.
+	class RecordingEncoderFactory : public cricket::WebRtcVideoEncoderFactory
+	{
+	public:
+		RecordingEncoderFactory(const std::string& path,
+			const RecordingVideoEncoder::EncodeObserver& observer,
+			EncoderBackendType backend = EncoderBackendType::kNvenc,
+			std::shared_ptr<LossReportRouter> loss_reports = nullptr,
+			std::shared_ptr<EncoderSessionPool> sessions = nullptr,
+			std::shared_ptr<FrameInputs> inputs = nullptr);
+
+		webrtc::VideoEncoder* CreateVideoEncoder(const cricket::VideoCodec& codec) override;
+
+		const std::vector<cricket::VideoCodec>& supported_codecs() const override;
+
+		void DestroyVideoEncoder(webrtc::VideoEncoder* encoder) override;
+
+	private:
+		std::string path_;
+		RecordingVideoEncoder::EncodeObserver observer_;
+		EncoderBackendType backend_;
+		std::shared_ptr<LossReportRouter> loss_reports_;
+		std::shared_ptr<EncoderSessionPool> sessions_;
+		std::shared_ptr<FrameInputs> inputs_;
+
+		// The next encoder's stream, which its session is acquired as and its recording named by
+		int next_stream_id_;
+
+		std::vector<cricket::VideoCodec> codecs_;
+	};
+
+	// A peer connection factory encoding with |backend|, recording each peer's video to a path
+	// named after |path| with what |inputs| holds for its frames, and telling |observer| of every
+	// image encoded, or webrtc's default factory if it would only be encoding with NVENC without a
+	// limit. Loss reports routed through |loss_reports| reach its own encoders, and NVENC streams
+	// are counted against |sessions|.
+	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreateRecordingPeerConnectionFactory(const std::string& path,
+		const RecordingVideoEncoder::EncodeObserver& observer = nullptr,
+		EncoderBackendType backend = EncoderBackendType::kNvenc,
+		std::shared_ptr<LossReportRouter> loss_reports = nullptr,
+		std::shared_ptr<EncoderSessionPool> sessions = nullptr,
+		std::shared_ptr<FrameInputs> inputs = nullptr);
+}
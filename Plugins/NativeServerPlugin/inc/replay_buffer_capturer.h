@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+
+#include "buffer_capturer.h"
+
+// from VideoEncoder
+#include "stream_recording.h"
+#include "stream_replayer.h"
+
+namespace StreamingToolkit
+{
+	// A native frame buffer carrying a recorded frame's bitstream through to
+	// PassthroughVideoEncoder in place of pixels.
+	class RecordedFrameBuffer : public webrtc::VideoFrameBuffer
+	{
+	public:
+		RecordedFrameBuffer(const RecordedFrame& frame,
+			std::shared_ptr<StreamRecording> recording,
+			std::weak_ptr<StreamReplayer> replayer);
+
+		Type type() const override;
+		int width() const override;
+		int height() const override;
+
+		// A black frame, for anything that asks for pixels. The bitstream is never decoded.
+		rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+		// Points into the recording, which the buffer keeps open.
+		const RecordedFrame& frame() const;
+
+		// Asks the replayer, if it's still playing, for a keyframe next.
+		void RequestKeyframe();
+
+	private:
+		RecordedFrame frame_;
+		std::shared_ptr<StreamRecording> recording_;
+		std::weak_ptr<StreamReplayer> replayer_;
+	};
+
+	// Buffer capturer that replays a recording's bitstream at its recorded pace, for a peer
+	// connection factory made with CreatePassthroughPeerConnectionFactory to send unchanged.
+	// Nothing is rendered or encoded, so one machine can stream to many more peers.
+	class ReplayBufferCapturer : public BufferCapturer
+	{
+	public:
+		// |recording| can be shared by every peer's capturer.
+		explicit ReplayBufferCapturer(std::shared_ptr<StreamRecording> recording);
+
+		~ReplayBufferCapturer();
+
+		cricket::CaptureState Start(const cricket::VideoFormat& capture_format) override;
+		void Stop() override;
+
+		StreamReplayer::Stats stats() const;
+
+	private:
+		void OnReplayedFrame(const RecordedFrame& frame, int64_t timestamp_us);
+
+		std::shared_ptr<StreamRecording> recording_;
+		std::shared_ptr<StreamReplayer> replayer_;
+	};
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pch.h"
+
+#include "multi_peer_conductor.h"
+#include "replay_peer_conductor.h"
+
+// Streams the recording at the server config's replayPath to every peer, without rendering or
+// encoding, to load test the network and signaling paths with many peers on one machine.
+class ReplayMultiPeerConductor : public MultiPeerConductor
+{
+public:
+	ReplayMultiPeerConductor(shared_ptr<FullServerConfig> config);
+
+	// Whether the recording could be read
+	bool IsReplaying() const;
+
+private:
+	// Handles creation of a new peer entry in connected_peers_ if needed
+	scoped_refptr<PeerConductor> SafeAllocatePeerMapEntry(int peer_id) override;
+
+	// Shared by every peer's capturer
+	shared_ptr<StreamRecording> recording_;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pch.h"
+#include "peer_conductor.h"
+#include "replay_buffer_capturer.h"
+
+// A PeerConductor using a ReplayBufferCapturer
+class ReplayPeerConductor : public PeerConductor
+{
+public:
+	ReplayPeerConductor(int id,
+		const string& name,
+		shared_ptr<WebRTCConfig> webrtc_config,
+		scoped_refptr<PeerConnectionFactoryInterface> peer_factory,
+		const function<void(const string&)>& send_func,
+		shared_ptr<StreamRecording> recording);
+
+protected:
+	// Provide a capturer replaying the recording from its start for each single video track
+	virtual unique_ptr<cricket::VideoCapturer> AllocateVideoCapturer() override;
+
+private:
+	shared_ptr<StreamRecording> recording_;
+};
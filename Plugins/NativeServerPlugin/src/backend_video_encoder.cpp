@@ -0,0 +1,464 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "backend_video_encoder.h"
+
+#include "libyuv/convert.h"
+#include "libyuv/planar_functions.h"
+#include "webrtc/common_video/h264/h264_common.h"
+#include "webrtc/modules/video_coding/codecs/h264/h264_encoder_impl.h"
+
+namespace
+{
+	// As many frames as LossRecovery keeps, so any it can recover to is found
+	const size_t kSentFrames = 64;
+}
+
+namespace StreamingToolkit
+{
+	EncoderBackendType ResolveEncoderBackend(EncoderBackendType type)
+	{
+		if (type != EncoderBackendType::kAuto)
+		{
+			return type;
+		}
+
+		return webrtc::H264EncoderImpl::CheckDeviceNVENCCapability() == NVENCSTATUS::NV_ENC_SUCCESS ?
+			EncoderBackendType::kNvenc : EncoderBackendType::kSoftware;
+	}
+
+	BackendVideoEncoder::BackendVideoEncoder(std::unique_ptr<EncoderBackend> encoder,
+		std::shared_ptr<LossReportRouter> loss_reports) :
+		encoder_(std::move(encoder)),
+		loss_reports_(loss_reports),
+		callback_(nullptr),
+		initialized_(false)
+	{
+		if (loss_reports_)
+		{
+			loss_reports_->Add(this);
+		}
+	}
+
+	BackendVideoEncoder::~BackendVideoEncoder()
+	{
+		if (loss_reports_)
+		{
+			loss_reports_->Remove(this);
+		}
+
+		Release();
+	}
+
+	int32_t BackendVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings,
+		int32_t number_of_cores,
+		size_t max_payload_size)
+	{
+		if (!codec_settings || codec_settings->codecType != webrtc::kVideoCodecH264 ||
+			codec_settings->width == 0 || codec_settings->height == 0)
+		{
+			return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+		}
+
+		EncoderConfig config;
+		config.width = codec_settings->width;
+		config.height = codec_settings->height;
+		config.fps = std::max(1, static_cast<int>(codec_settings->maxFramerate));
+		config.bitrate_bps = codec_settings->startBitrate * 1000;
+		config.max_bitrate_bps = codec_settings->maxBitrate * 1000;
+
+		// frames are encoded as they're sent, so there's never more than one in flight
+		config.queue_depth = 1;
+
+		Release();
+		auto status = encoder_->Initialize(config);
+		if (status != EncoderStatus::kOk)
+		{
+			LOG(LS_ERROR) << "Can't start " << encoder_->name() << " at " << config.width << "x" << config.height <<
+				": " << EncoderStatusName(status);
+			return WEBRTC_VIDEO_CODEC_ERROR;
+		}
+
+		initialized_ = true;
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t BackendVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback)
+	{
+		callback_ = callback;
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t BackendVideoEncoder::Release()
+	{
+		if (initialized_)
+		{
+			encoder_->Shutdown();
+			initialized_ = false;
+		}
+
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t BackendVideoEncoder::Encode(const webrtc::VideoFrame& frame,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const std::vector<webrtc::FrameType>* frame_types)
+	{
+		if (!initialized_ || !callback_)
+		{
+			return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+		}
+
+		if (frame.width() != encoder_->config().width || frame.height() != encoder_->config().height)
+		{
+			auto config = encoder_->config();
+			config.width = frame.width();
+			config.height = frame.height();
+			if (!Apply(config))
+			{
+				return WEBRTC_VIDEO_CODEC_ERROR;
+			}
+		}
+
+		input_.Allocate(frame.width(), frame.height());
+		if (frame.frame_buffer())
+		{
+			// a capturer sending for NVENC leaves the I420 buffer empty
+			libyuv::ABGRToI420(frame.frame_buffer(), frame.width() * 4,
+				input_.data(0), input_.PlaneWidth(0),
+				input_.data(1), input_.PlaneWidth(1),
+				input_.data(2), input_.PlaneWidth(2),
+				input_.width(), input_.height());
+		}
+		else
+		{
+			auto buffer = frame.video_frame_buffer()->ToI420();
+			libyuv::I420Copy(buffer->DataY(), buffer->StrideY(),
+				buffer->DataU(), buffer->StrideU(),
+				buffer->DataV(), buffer->StrideV(),
+				input_.data(0), input_.PlaneWidth(0),
+				input_.data(1), input_.PlaneWidth(1),
+				input_.data(2), input_.PlaneWidth(2),
+				input_.width(), input_.height());
+		}
+
+		// webrtc asks for a keyframe when the peer sends a PLI or FIR
+		if (frame_types &&
+			std::find(frame_types->begin(), frame_types->end(), webrtc::kVideoFrameKey) != frame_types->end())
+		{
+			recovery_.RequestKeyframe();
+		}
+
+		EncodeParams params;
+		params.timestamp_us = frame.timestamp_us();
+		params.prediction_timestamp = frame.prediction_timestamp();
+		params.force_idr = false;
+		recovery_.Apply(encoder_.get(), &params);
+
+		auto status = encoder_->Encode(input_, params, &output_);
+		if (status != EncoderStatus::kOk)
+		{
+			LOG(LS_ERROR) << encoder_->name() << " didn't encode a frame: " << EncoderStatusName(status);
+			return WEBRTC_VIDEO_CODEC_ERROR;
+		}
+
+		recovery_.OnSubmitted(params);
+		recovery_.OnEncoded(output_);
+		if (params.prediction_timestamp >= 0)
+		{
+			std::lock_guard<std::mutex> lock(sent_lock_);
+			sent_.push_back(std::make_pair(params.prediction_timestamp, params.timestamp_us));
+			if (sent_.size() > kSentFrames)
+			{
+				sent_.pop_front();
+			}
+		}
+
+		// a frame the rate control skipped has no bitstream to send
+		if (output_.data.empty())
+		{
+			return WEBRTC_VIDEO_CODEC_OK;
+		}
+
+		auto nalus = webrtc::H264::FindNaluIndices(output_.data.data(), output_.data.size());
+		fragmentation_.VerifyAndAllocateFragmentationHeader(nalus.size());
+		for (size_t i = 0; i < nalus.size(); i++)
+		{
+			fragmentation_.fragmentationOffset[i] = nalus[i].payload_start_offset;
+			fragmentation_.fragmentationLength[i] = nalus[i].payload_size;
+			fragmentation_.fragmentationPlType[i] = 0;
+			fragmentation_.fragmentationTimeDiff[i] = 0;
+		}
+
+		webrtc::EncodedImage image(output_.data.data(), output_.data.size(), output_.data.size());
+		image._encodedWidth = output_.width;
+		image._encodedHeight = output_.height;
+		image._timeStamp = frame.timestamp();
+		image.ntp_time_ms_ = frame.ntp_time_ms();
+		image.capture_time_ms_ = frame.render_time_ms();
+		image.rotation_ = frame.rotation();
+		image._frameType = output_.keyframe ? webrtc::kVideoFrameKey : webrtc::kVideoFrameDelta;
+		image._completeFrame = true;
+		image.qp_ = output_.qp;
+		image.prediction_timestamp_ = frame.prediction_timestamp();
+
+		webrtc::CodecSpecificInfo info;
+		info.codecType = webrtc::kVideoCodecH264;
+		info.codecSpecific.H264.packetization_mode = webrtc::H264PacketizationMode::NonInterleaved;
+
+		auto result = callback_->OnEncodedImage(image, &info, &fragmentation_);
+		return result.error == webrtc::EncodedImageCallback::Result::OK ?
+			WEBRTC_VIDEO_CODEC_OK : WEBRTC_VIDEO_CODEC_ERROR;
+	}
+
+	int32_t BackendVideoEncoder::SetChannelParameters(uint32_t packet_loss, int64_t rtt)
+	{
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t BackendVideoEncoder::SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate)
+	{
+		if (!initialized_ || allocation.get_sum_bps() == 0)
+		{
+			return WEBRTC_VIDEO_CODEC_OK;
+		}
+
+		auto config = encoder_->config();
+		config.bitrate_bps = allocation.get_sum_bps();
+		config.fps = std::max(1, static_cast<int>(framerate));
+		if (config.max_bitrate_bps > 0)
+		{
+			config.max_bitrate_bps = std::max(config.max_bitrate_bps, config.bitrate_bps);
+		}
+
+		return Apply(config) ? WEBRTC_VIDEO_CODEC_OK : WEBRTC_VIDEO_CODEC_ERROR;
+	}
+
+	const char* BackendVideoEncoder::ImplementationName() const
+	{
+		return encoder_->name();
+	}
+
+	bool BackendVideoEncoder::HasSent(int64_t prediction_timestamp) const
+	{
+		std::lock_guard<std::mutex> lock(sent_lock_);
+		return std::any_of(sent_.begin(), sent_.end(), [prediction_timestamp](const std::pair<int64_t, int64_t>& sent)
+		{
+			return sent.first == prediction_timestamp;
+		});
+	}
+
+	bool BackendVideoEncoder::OnLastGoodFrame(int64_t prediction_timestamp)
+	{
+		int64_t timestamp_us = -1;
+		{
+			std::lock_guard<std::mutex> lock(sent_lock_);
+			for (const auto& sent : sent_)
+			{
+				if (sent.first == prediction_timestamp)
+				{
+					timestamp_us = sent.second;
+				}
+			}
+		}
+
+		if (timestamp_us < 0)
+		{
+			return false;
+		}
+
+		recovery_.OnLastGoodFrame(timestamp_us);
+		return true;
+	}
+
+	void BackendVideoEncoder::RequestKeyframe()
+	{
+		recovery_.RequestKeyframe();
+	}
+
+	bool BackendVideoEncoder::Apply(const EncoderConfig& config)
+	{
+		auto status = encoder_->Reconfigure(config);
+		if (status == EncoderStatus::kUnsupported)
+		{
+			encoder_->Shutdown();
+			status = encoder_->Initialize(config);
+			initialized_ = status == EncoderStatus::kOk;
+		}
+
+		if (status != EncoderStatus::kOk)
+		{
+			LOG(LS_ERROR) << "Can't change " << encoder_->name() << " to " << config.width << "x" << config.height <<
+				" at " << config.bitrate_bps << " bps: " << EncoderStatusName(status);
+			return false;
+		}
+
+		return true;
+	}
+
+	PooledVideoEncoder::PooledVideoEncoder(const Factory& hardware,
+		const Factory& software,
+		std::shared_ptr<EncoderSessionPool> sessions,
+		int session_id) :
+		software_(software),
+		sessions_(sessions),
+		session_id_(session_id),
+		hardware_(sessions->Acquire(session_id, EncoderConfig()).hardware),
+		callback_(nullptr)
+	{
+		auto utilization = sessions_->utilization();
+		LOG(INFO) << "Hardware encode sessions in use: " << utilization.hardware_sessions << "/" <<
+			utilization.hardware_limit << ", past the limit: " << utilization.software_sessions;
+
+		if (!hardware_)
+		{
+			encoder_.reset(software_());
+			if (!encoder_)
+			{
+				LOG(LS_ERROR) << "No hardware encode session left and no software encoder, so NVENC is tried anyway";
+			}
+		}
+
+		if (!encoder_)
+		{
+			encoder_.reset(hardware());
+		}
+	}
+
+	PooledVideoEncoder::~PooledVideoEncoder()
+	{
+		encoder_.reset();
+		sessions_->Release(session_id_);
+	}
+
+	int32_t PooledVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings,
+		int32_t number_of_cores,
+		size_t max_payload_size)
+	{
+		auto result = encoder_->InitEncode(codec_settings, number_of_cores, max_payload_size);
+		if (result == WEBRTC_VIDEO_CODEC_OK || !hardware_)
+		{
+			return result;
+		}
+
+		// the device allows fewer sessions than were configured, or other processes hold some
+		std::unique_ptr<webrtc::VideoEncoder> software(software_());
+		if (!software)
+		{
+			return result;
+		}
+
+		LOG(LS_WARNING) << "The device refused a hardware encode session, so the stream is encoded in software";
+		encoder_->Release();
+		encoder_ = std::move(software);
+		hardware_ = false;
+		sessions_->Downgrade(session_id_);
+		if (callback_)
+		{
+			encoder_->RegisterEncodeCompleteCallback(callback_);
+		}
+
+		return encoder_->InitEncode(codec_settings, number_of_cores, max_payload_size);
+	}
+
+	int32_t PooledVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback)
+	{
+		callback_ = callback;
+		return encoder_->RegisterEncodeCompleteCallback(callback);
+	}
+
+	int32_t PooledVideoEncoder::Release()
+	{
+		return encoder_->Release();
+	}
+
+	int32_t PooledVideoEncoder::Encode(const webrtc::VideoFrame& frame,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const std::vector<webrtc::FrameType>* frame_types)
+	{
+		return encoder_->Encode(frame, codec_specific_info, frame_types);
+	}
+
+	int32_t PooledVideoEncoder::SetChannelParameters(uint32_t packet_loss, int64_t rtt)
+	{
+		return encoder_->SetChannelParameters(packet_loss, rtt);
+	}
+
+	int32_t PooledVideoEncoder::SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate)
+	{
+		return encoder_->SetRateAllocation(allocation, framerate);
+	}
+
+	webrtc::VideoEncoder::ScalingSettings PooledVideoEncoder::GetScalingSettings() const
+	{
+		return encoder_->GetScalingSettings();
+	}
+
+	bool PooledVideoEncoder::SupportsNativeHandle() const
+	{
+		return encoder_->SupportsNativeHandle();
+	}
+
+	const char* PooledVideoEncoder::ImplementationName() const
+	{
+		return encoder_->ImplementationName();
+	}
+
+	void LossReportRouter::Add(BackendVideoEncoder* encoder)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		encoders_.push_back(encoder);
+	}
+
+	void LossReportRouter::Remove(BackendVideoEncoder* encoder)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		encoders_.erase(std::remove(encoders_.begin(), encoders_.end(), encoder), encoders_.end());
+		for (auto peer = peers_.begin(); peer != peers_.end();)
+		{
+			peer = peer->second == encoder ? peers_.erase(peer) : std::next(peer);
+		}
+	}
+
+	void LossReportRouter::OnLastGoodFrame(int peer_id, int64_t prediction_timestamp)
+	{
+		// encoders only leave under the lock, so none is destroyed while it's handed a report
+		std::lock_guard<std::mutex> lock(lock_);
+		auto peer = peers_.find(peer_id);
+		if (prediction_timestamp < 0)
+		{
+			// a peer we haven't matched yet has its PLI to ask for the IDR
+			if (peer != peers_.end())
+			{
+				peer->second->RequestKeyframe();
+			}
+
+			return;
+		}
+
+		if (peer != peers_.end() && peer->second->OnLastGoodFrame(prediction_timestamp))
+		{
+			return;
+		}
+
+		std::vector<BackendVideoEncoder*> senders;
+		std::copy_if(encoders_.begin(), encoders_.end(), std::back_inserter(senders), [prediction_timestamp](BackendVideoEncoder* encoder)
+		{
+			return encoder->HasSent(prediction_timestamp);
+		});
+
+		if (senders.size() == 1)
+		{
+			peers_[peer_id] = senders.front();
+			senders.front()->OnLastGoodFrame(prediction_timestamp);
+			return;
+		}
+
+		for (auto sender : senders)
+		{
+			sender->RequestKeyframe();
+		}
+	}
+}
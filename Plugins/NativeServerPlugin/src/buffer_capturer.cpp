@@ -2,8 +2,8 @@
 
 #include <fstream>
 
+#include "backend_video_encoder.h"
 #include "buffer_capturer.h"
-#include "webrtc/modules/video_coding/codecs/h264/h264_encoder_impl.h"
 
 namespace StreamingToolkit
 {
@@ -11,9 +11,12 @@ namespace StreamingToolkit
 		clock_(webrtc::Clock::GetRealTimeClock()),
 		running_(false),
 		sink_(nullptr),
-		sink_wants_observer_(nullptr)
+		sink_wants_observer_(nullptr),
+		encoder_control_(nullptr),
+		stamp_frames_(false),
+		last_stamp_(-1)
 	{
-		use_software_encoder_ = webrtc::H264EncoderImpl::CheckDeviceNVENCCapability() != NVENCSTATUS::NV_ENC_SUCCESS;
+		SetEncoderBackend(ResolveEncoderBackend(EncoderBackendType::kAuto));
 		set_enable_video_adapter(false);
 		SetCaptureFormat(NULL);
 	}
@@ -39,6 +42,30 @@ namespace StreamingToolkit
 		sink_wants_observer_ = observer;
 	}
 
+	void BufferCapturer::SetEncoderControl(EncoderControl* control)
+	{
+		rtc::CritScope cs(&lock_);
+		encoder_control_ = control;
+	}
+
+	void BufferCapturer::SetFrameInputs(std::shared_ptr<FrameInputs> inputs)
+	{
+		rtc::CritScope cs(&lock_);
+		frame_inputs_ = inputs;
+	}
+
+	void BufferCapturer::SetEncoderBackend(EncoderBackendType backend)
+	{
+		rtc::CritScope cs(&lock_);
+		use_software_encoder_ = backend != EncoderBackendType::kNvenc;
+	}
+
+	void BufferCapturer::SetStampFrames(bool stamp_frames)
+	{
+		rtc::CritScope cs(&lock_);
+		stamp_frames_ = stamp_frames;
+	}
+
 	void BufferCapturer::AddOrUpdateSink(
 		rtc::VideoSinkInterface<VideoFrame>* sink,
 		const rtc::VideoSinkWants& wants) 
@@ -77,13 +104,78 @@ namespace StreamingToolkit
 	}
 
 	void BufferCapturer::SendFrame(webrtc::VideoFrame video_frame)
+	{
+		if (AdmitFrame())
+		{
+			StampFrame(&video_frame);
+			DeliverFrame(video_frame);
+		}
+	}
+
+	void BufferCapturer::SendFrame(webrtc::VideoFrame video_frame, const std::string& metadata)
+	{
+		if (!AdmitFrame())
+		{
+			return;
+		}
+
+		StampFrame(&video_frame);
+
+		// Queues the metadata first, so it usually reaches the client ahead of the frame.
+		if (!metadata.empty() && video_frame.prediction_timestamp() >= 0)
+		{
+			std::shared_ptr<FrameInputs> inputs;
+			{
+				rtc::CritScope cs(&lock_);
+				inputs = frame_inputs_;
+			}
+
+			// kept before the frame is sent, so it's there when the frame leaves the encoder
+			if (inputs)
+			{
+				inputs->AddMetadata(video_frame.prediction_timestamp(), metadata);
+			}
+
+			frame_metadata_.Push(video_frame.prediction_timestamp(), metadata);
+			SignalFrameMetadata(this);
+		}
+
+		DeliverFrame(video_frame);
+	}
+
+	bool BufferCapturer::AdmitFrame()
 	{
 		// The video capturer hasn't started since there is no active connection.
 		if (!running_)
+		{
+			return false;
+		}
+
+		rtc::CritScope cs(&lock_);
+		return !encoder_control_ || encoder_control_->AdmitFrame(rtc::TimeMicros());
+	}
+
+	void BufferCapturer::StampFrame(webrtc::VideoFrame* video_frame)
+	{
+		rtc::CritScope cs(&lock_);
+		if (!stamp_frames_ || video_frame->prediction_timestamp() >= 0)
 		{
 			return;
 		}
 
+		// frames sent within a millisecond of each other still get their own stamp
+		auto now = rtc::TimeMillis();
+		last_stamp_ = now > last_stamp_ ? now : last_stamp_ + 1;
+		video_frame->set_prediction_timestamp(last_stamp_);
+	}
+
+	void BufferCapturer::DeliverFrame(webrtc::VideoFrame video_frame)
+	{
+		if (video_frame.prediction_timestamp() >= 0)
+		{
+			SignalFrameSent(this, video_frame.prediction_timestamp());
+		}
+
 		if (sink_)
 		{
 			sink_->OnFrame(video_frame);
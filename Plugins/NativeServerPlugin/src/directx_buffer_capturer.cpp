@@ -21,7 +21,8 @@ DirectXBufferCapturer::DirectXBufferCapturer(ID3D11Device* d3d_device) :
 #endif // MULTITHREAD_PROTECTION
 }
 
-void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp)
+void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp,
+	const std::string& metadata)
 {
 	// The video capturer hasn't started since there is no active connection.
 	if (!running_)
@@ -84,10 +85,11 @@ void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* frame_buffer, int64_t pre
 	}
 
 	// Sending video frame.
-	BufferCapturer::SendFrame(frame);
+	BufferCapturer::SendFrame(frame, metadata);
 }
 
-void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp)
+void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp,
+	const std::string& metadata)
 {
 	// The video capturer hasn't started since there is no active connection.
 	if (!running_)
@@ -150,7 +152,7 @@ void DirectXBufferCapturer::SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11
 	}
 
 	// Sending video frame.
-	BufferCapturer::SendFrame(frame);
+	BufferCapturer::SendFrame(frame, metadata);
 }
 
 void DirectXBufferCapturer::UpdateStagingBuffer(ID3D11Texture2D* frame_buffer)
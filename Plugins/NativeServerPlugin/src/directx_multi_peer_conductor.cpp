@@ -27,6 +27,8 @@ scoped_refptr<PeerConductor> DirectXMultiPeerConductor::SafeAllocatePeerMapEntry
 
 		connected_peers_[peer_id]->SignalIceConnectionChange.connect((MultiPeerConductor*)this, &MultiPeerConductor::OnIceConnectionChange);
 		connected_peers_[peer_id]->SignalDataChannelMessage.connect((MultiPeerConductor*)this, &MultiPeerConductor::HandleDataChannelMessage);
+		connected_peers_[peer_id]->SetEncoderBackend(encoder_backend_);
+		connected_peers_[peer_id]->SetFrameInputs(frame_inputs_);
 	}
 
 	return connected_peers_[peer_id];
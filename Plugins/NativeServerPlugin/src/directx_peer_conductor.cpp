@@ -17,19 +17,21 @@ DirectXPeerConductor::DirectXPeerConductor(int id,
 {
 }
 
-void DirectXPeerConductor::SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp)
+void DirectXPeerConductor::SendFrame(ID3D11Texture2D* frame_buffer, int64_t prediction_time_stamp,
+	const string& metadata)
 {
 	if (capturer_)
 	{
-		capturer_->SendFrame(frame_buffer, prediction_time_stamp);
+		capturer_->SendFrame(frame_buffer, prediction_time_stamp, metadata);
 	}
 }
 
-void DirectXPeerConductor::SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp)
+void DirectXPeerConductor::SendFrame(ID3D11Texture2D* left_frame_buffer, ID3D11Texture2D* right_frame_buffer, int64_t prediction_time_stamp,
+	const string& metadata)
 {
 	if (capturer_)
 	{
-		capturer_->SendFrame(left_frame_buffer, right_frame_buffer, prediction_time_stamp);
+		capturer_->SendFrame(left_frame_buffer, right_frame_buffer, prediction_time_stamp, metadata);
 	}
 }
 
@@ -37,5 +39,9 @@ unique_ptr<cricket::VideoCapturer> DirectXPeerConductor::AllocateVideoCapturer()
 {
 	unique_ptr<DirectXBufferCapturer> owned_ptr(new DirectXBufferCapturer(d3d_device_));
 	capturer_ = owned_ptr.get();
+	ForwardFrameMetadata(capturer_);
+	PaceFrames(capturer_);
+	TrackLatency(capturer_);
+	UseEncoderBackend(capturer_);
 	return owned_ptr;
 }
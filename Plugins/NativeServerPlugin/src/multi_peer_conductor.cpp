@@ -1,14 +1,54 @@
 #include "pch.h"
 
+#include "backend_video_encoder.h"
 #include "defaults.h"
 #include "multi_peer_conductor.h"
+#include "recording_video_encoder.h"
+
+#include "webrtc/rtc_base/timeutils.h"
+
+namespace
+{
+	// Message ids posted to ourselves. The signalling message queue uses 0.
+	const uint32_t kDrainInputMessage = 1;
+	const uint32_t kReplayInputMessage = 2;
+	const uint32_t kFrameEncodedMessage = 3;
+
+	// The prediction timestamp of an encoded frame, and when it was encoded
+	typedef TypedMessageData<pair<int64_t, int64_t>> FrameEncodedData;
+
+	EncoderSessionPool::Options EncoderSessionOptions(const FullServerConfig& config)
+	{
+		EncoderSessionPool::Options options;
+		options.max_hardware_sessions = config.server_config->server_config.hardware_encoder_sessions;
+		return options;
+	}
+
+	EncoderBackendType ConfiguredEncoderBackend(const FullServerConfig& config)
+	{
+		const auto& name = config.server_config->server_config.encoder_backend;
+		auto type = EncoderBackendType::kAuto;
+		if (!name.empty() && !ParseEncoderBackendType(name, &type))
+		{
+			LOG(LS_ERROR) << "Unknown encoder backend " << name << ", so the default is used";
+		}
+
+		return ResolveEncoderBackend(type);
+	}
+}
 
 MultiPeerConductor::MultiPeerConductor(shared_ptr<FullServerConfig> config,
 	scoped_refptr<PeerConnectionFactoryInterface> peer_factory) :
 	config_(config),
 	main_window_(nullptr),
 	max_capacity_(-1),
-	cur_capacity_(-1)
+	cur_capacity_(-1),
+	input_drain_posted_(false),
+	input_replay_start_us_(0),
+	encoder_sessions_(make_shared<EncoderSessionPool>(nullptr, nullptr, EncoderSessionOptions(*config))),
+	encoder_backend_(ConfiguredEncoderBackend(*config)),
+	loss_reports_(make_shared<LossReportRouter>()),
+	thread_(rtc::Thread::Current())
 {
 	signalling_client_.RegisterObserver(this);
 	signalling_client_.SignalConnected.connect(this, &MultiPeerConductor::HandleSignalConnect);
@@ -18,13 +58,70 @@ MultiPeerConductor::MultiPeerConductor(shared_ptr<FullServerConfig> config,
 		signalling_client_.SetHeartbeatMs(config_->webrtc_config->heartbeat);
 	}
 
+	// optionally share keep-alive connections to the signaling server between our requests, rather
+	// than paying for a tcp connect and tls handshake per request
+	if (config_->webrtc_config->reuse_connections)
+	{
+		signalling_client_.SetConnectionPool(std::make_shared<ConnectionPool>());
+	}
+
 	if (config_->server_config->server_config.system_capacity > 0)
 	{
 		max_capacity_ = config_->server_config->server_config.system_capacity;
 		cur_capacity_ = max_capacity_;
 	}
 
+	if (!config_->server_config->server_config.input_log_path.empty() &&
+		!input_log_.Open(config_->server_config->server_config.input_log_path))
+	{
+		LOG(LS_ERROR) << "Can't record input to " << config_->server_config->server_config.input_log_path;
+	}
+
 	peer_factory_ = peer_factory;
+	if (!peer_factory_)
+	{
+		RecordingVideoEncoder::EncodeObserver observer;
+		if (config_->webrtc_config->track_latency)
+		{
+			observer = [this](int64_t prediction_timestamp) { OnFrameEncoded(prediction_timestamp); };
+		}
+
+		const auto& record_path = config_->server_config->server_config.record_path;
+		if (!record_path.empty())
+		{
+			frame_inputs_ = make_shared<FrameInputs>();
+		}
+
+		peer_factory_ = CreateRecordingPeerConnectionFactory(record_path,
+			observer,
+			encoder_backend_,
+			loss_reports_,
+			encoder_sessions_,
+			frame_inputs_);
+	}
+
+	// peers report the last frame they decoded when they lose one, for an encoder of ours to
+	// recover from. webrtc's own answers their RTCP feedback instead.
+	input_dispatcher_.Register(LossRecovery::kMessageType, [this](const InputMessage& message)
+	{
+		int64_t last_good;
+		if (LossRecovery::ParseReport(message.body.data, message.body.size, &last_good))
+		{
+			loss_reports_->OnLastGoodFrame(message.peer_id, last_good);
+		}
+	});
+
+	// peers ask for a bitrate, framerate or size to suit their link and display
+	input_dispatcher_.Register(EncoderControl::kMessageType, [this](const InputMessage& message)
+	{
+		EncoderControl::Targets targets;
+		auto peer = connected_peers_.find(message.peer_id);
+		if (peer != connected_peers_.end() &&
+			EncoderControl::ParseTargets(message.body.data, message.body.size, &targets))
+		{
+			peer->second->SetVideoTargets(targets.bitrate_bps, targets.fps, targets.width, targets.height);
+		}
+	});
 }
 
 MultiPeerConductor::~MultiPeerConductor()
@@ -43,6 +140,19 @@ PeerConnectionClient& MultiPeerConductor::PeerConnection()
 
 void MultiPeerConductor::ConnectSignallingAsync(const string& client_name)
 {
+	// with several servers configured, the client picks the fastest and fails over between them
+	if (config_->webrtc_config->servers.size() > 1)
+	{
+		vector<SignalingEndpoint> endpoints;
+		for (const auto& server : config_->webrtc_config->servers)
+		{
+			endpoints.push_back(SignalingEndpoint(server.uri, server.port));
+		}
+
+		signalling_client_.Connect(endpoints, client_name);
+		return;
+	}
+
 	signalling_client_.Connect(config_->webrtc_config->server_uri,
 		config_->webrtc_config->port,
 		client_name);
@@ -58,6 +168,33 @@ void MultiPeerConductor::SetDataChannelMessageHandler(const function<void(int, c
 	data_channel_handler_ = data_channel_handler;
 }
 
+InputDispatcher& MultiPeerConductor::Dispatcher()
+{
+	return input_dispatcher_;
+}
+
+InputCoalescer& MultiPeerConductor::Coalescer()
+{
+	return input_coalescer_;
+}
+
+InputLogWriter& MultiPeerConductor::InputLog()
+{
+	return input_log_;
+}
+
+EncoderSessionPool& MultiPeerConductor::EncoderSessions()
+{
+	return *encoder_sessions_;
+}
+
+void MultiPeerConductor::StartInputReplay(unique_ptr<InputReplayer> replayer)
+{
+	input_replayer_ = std::move(replayer);
+	input_replay_start_us_ = rtc::TimeMicros();
+	rtc::Thread::Current()->Post(RTC_FROM_HERE, this, kReplayInputMessage);
+}
+
 void MultiPeerConductor::OnIceConnectionChange(int peer_id, PeerConnectionInterface::IceConnectionState new_state)
 {
 	// if we already know what state you're in, and it hasn't changed, don't do anything
@@ -101,9 +238,102 @@ void MultiPeerConductor::OnIceConnectionChange(int peer_id, PeerConnectionInterf
 
 void MultiPeerConductor::HandleDataChannelMessage(int peer_id, const string& message)
 {
+	// recorded before coalescing, so a replay sees the bursts the network delivered
+	input_log_.Write(peer_id, rtc::TimeMicros(), message.data(), message.size());
+
+	if (!input_coalescer_.Push(peer_id, message.data(), message.size()))
+	{
+		DispatchDataChannelMessage(peer_id, message.data(), message.size());
+		return;
+	}
+
+	// messages already waiting in this thread's queue are handled before the drain, so a burst
+	// of them is collapsed to the newest
+	if (!input_drain_posted_.exchange(true))
+	{
+		rtc::Thread::Current()->Post(RTC_FROM_HERE, this, kDrainInputMessage);
+	}
+}
+
+void MultiPeerConductor::DrainInput()
+{
+	input_drain_posted_.store(false);
+
+	auto now = rtc::TimeMillis();
+	input_coalescer_.Drain(now, [this](int peer_id, const char* data, size_t size)
+	{
+		DispatchDataChannelMessage(peer_id, data, size);
+	});
+
+	// rate limited messages wait out their interval
+	auto next = input_coalescer_.NextDue();
+	if (next >= 0 && !input_drain_posted_.exchange(true))
+	{
+		rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE,
+			static_cast<int>(next > now ? next - now : 0), this, kDrainInputMessage);
+	}
+}
+
+void MultiPeerConductor::ReplayInput()
+{
+	if (!input_replayer_)
+	{
+		return;
+	}
+
+	// unpaced replays deliver one instant of session time per message, so the coalescer still
+	// sees the bursts that were recorded
+	auto speed = input_replayer_->options().speed;
+	auto session_us = speed > 0 ?
+		static_cast<int64_t>((rtc::TimeMicros() - input_replay_start_us_) * speed) :
+		input_replayer_->NextDue();
+
+	input_replayer_->Advance(session_us, [this](int peer_id, const char* data, size_t size)
+	{
+		HandleDataChannelMessage(peer_id, string(data, size));
+	});
+
+	auto next = input_replayer_->NextDue();
+	if (next < 0)
+	{
+		input_replayer_.reset();
+		return;
+	}
+
+	auto delay_ms = speed > 0 ? static_cast<int>((next - session_us) / speed / 1000) : 0;
+	rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, delay_ms, this, kReplayInputMessage);
+}
+
+void MultiPeerConductor::OnFrameEncoded(int64_t prediction_timestamp)
+{
+	thread_->Post(RTC_FROM_HERE, this, kFrameEncodedMessage,
+		new FrameEncodedData(make_pair(prediction_timestamp, rtc::TimeMicros())));
+}
+
+void MultiPeerConductor::DispatchDataChannelMessage(int peer_id, const char* data, size_t size)
+{
+	// the input reaches the renderer now, whichever handler takes it
+	auto peer = connected_peers_.find(peer_id);
+	if (peer != connected_peers_.end())
+	{
+		peer->second->OnInputDispatched(data, size);
+	}
+
+	// the pose a frame is rendered for is recorded with it
+	CameraTransform pose;
+	if (frame_inputs_ && InputMessageCodec::Decode(data, size, &pose))
+	{
+		frame_inputs_->AddPose(pose);
+	}
+
+	if (input_dispatcher_.Dispatch(peer_id, data, size))
+	{
+		return;
+	}
+
 	if (data_channel_handler_)
 	{
-		data_channel_handler_(peer_id, message);
+		data_channel_handler_(peer_id, string(data, size));
 	}
 }
 
@@ -149,6 +379,7 @@ void MultiPeerConductor::OnPeerConnected(int id, const string& name)
 void MultiPeerConductor::OnPeerDisconnected(int peer_id)
 {
 	connected_peers_.erase(peer_id);
+	input_coalescer_.RemovePeer(peer_id);
 }
 
 void MultiPeerConductor::OnMessageFromPeer(int peer_id, const string& message)
@@ -165,6 +396,31 @@ void MultiPeerConductor::OnServerConnectionFailure() {}
 
 void MultiPeerConductor::OnMessage(Message* msg)
 {
+	if (msg->message_id == kDrainInputMessage)
+	{
+		DrainInput();
+		return;
+	}
+
+	if (msg->message_id == kReplayInputMessage)
+	{
+		ReplayInput();
+		return;
+	}
+
+	// peers only report frames they sent, though a peer whose frames share a timestamp with
+	// another's may report the other's encode
+	if (msg->message_id == kFrameEncodedMessage)
+	{
+		unique_ptr<FrameEncodedData> data(static_cast<FrameEncodedData*>(msg->pdata));
+		for (auto& peer : connected_peers_)
+		{
+			peer.second->OnFrameEncoded(data->data().first, data->data().second);
+		}
+
+		return;
+	}
+
 	if (!should_process_queue_.load() ||
 		message_queue_.size() == 0)
 	{
@@ -222,6 +478,8 @@ void MultiPeerConductor::UIThreadCallback(int msg_id, void* data) {}
 
 void MultiPeerConductor::Close()
 {
+	input_replayer_.reset();
+	input_log_.Close();
 	peer_factory_ = NULL;
 	connected_peers_.clear();
 }
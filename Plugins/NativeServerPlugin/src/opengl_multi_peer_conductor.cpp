@@ -25,6 +25,7 @@ scoped_refptr<PeerConductor> OpenGLMultiPeerConductor::SafeAllocatePeerMapEntry(
 
 		connected_peers_[peer_id]->SignalIceConnectionChange.connect((MultiPeerConductor*)this, &OpenGLMultiPeerConductor::OnIceConnectionChange);
 		connected_peers_[peer_id]->SignalDataChannelMessage.connect((MultiPeerConductor*)this, &OpenGLMultiPeerConductor::HandleDataChannelMessage);
+		connected_peers_[peer_id]->SetEncoderBackend(encoder_backend_);
 	}
 
 	return connected_peers_[peer_id];
@@ -27,5 +27,8 @@ unique_ptr<cricket::VideoCapturer> OpenGLPeerConductor::AllocateVideoCapturer()
 {
 	unique_ptr<OpenGLBufferCapturer> owned_ptr(new OpenGLBufferCapturer());
 	capturer_ = owned_ptr.get();
+	PaceFrames(capturer_);
+	TrackLatency(capturer_);
+	UseEncoderBackend(capturer_);
 	return owned_ptr;
 }
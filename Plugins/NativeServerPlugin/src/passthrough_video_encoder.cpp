@@ -0,0 +1,149 @@
+#include "pch.h"
+
+#include <algorithm>
+
+#include "passthrough_video_encoder.h"
+#include "replay_buffer_capturer.h"
+
+#include "webrtc/common_video/h264/h264_common.h"
+#include "webrtc/media/base/mediaconstants.h"
+
+namespace StreamingToolkit
+{
+	PassthroughVideoEncoder::PassthroughVideoEncoder() :
+		callback_(nullptr)
+	{
+	}
+
+	int32_t PassthroughVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings,
+		int32_t number_of_cores,
+		size_t max_payload_size)
+	{
+		if (!codec_settings || codec_settings->codecType != webrtc::kVideoCodecH264)
+		{
+			return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+		}
+
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t PassthroughVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback)
+	{
+		callback_ = callback;
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t PassthroughVideoEncoder::Release()
+	{
+		callback_ = nullptr;
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t PassthroughVideoEncoder::Encode(const webrtc::VideoFrame& frame,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const std::vector<webrtc::FrameType>* frame_types)
+	{
+		if (!callback_)
+		{
+			return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+		}
+
+		// Only ReplayBufferCapturer's frames carry a bitstream.
+		auto buffer = frame.video_frame_buffer();
+		if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative)
+		{
+			return WEBRTC_VIDEO_CODEC_OK;
+		}
+
+		auto recorded = static_cast<RecordedFrameBuffer*>(buffer.get());
+		const auto& source = recorded->frame();
+		if (!source.keyframe && frame_types &&
+			std::find(frame_types->begin(), frame_types->end(), webrtc::kVideoFrameKey) != frame_types->end())
+		{
+			recorded->RequestKeyframe();
+		}
+
+		auto nalus = webrtc::H264::FindNaluIndices(source.data, source.size);
+		fragmentation_.VerifyAndAllocateFragmentationHeader(nalus.size());
+		for (size_t i = 0; i < nalus.size(); i++)
+		{
+			fragmentation_.fragmentationOffset[i] = nalus[i].payload_start_offset;
+			fragmentation_.fragmentationLength[i] = nalus[i].payload_size;
+			fragmentation_.fragmentationPlType[i] = 0;
+			fragmentation_.fragmentationTimeDiff[i] = 0;
+		}
+
+		// The image points into the recording, which the frame keeps open until we return.
+		webrtc::EncodedImage image(const_cast<uint8_t*>(source.data), source.size, source.size);
+		image._encodedWidth = source.width;
+		image._encodedHeight = source.height;
+		image._timeStamp = frame.timestamp();
+		image.ntp_time_ms_ = frame.ntp_time_ms();
+		image.capture_time_ms_ = frame.render_time_ms();
+		image.rotation_ = frame.rotation();
+		image._frameType = source.keyframe ? webrtc::kVideoFrameKey : webrtc::kVideoFrameDelta;
+		image._completeFrame = true;
+		image.qp_ = source.qp;
+		image.prediction_timestamp_ = frame.prediction_timestamp();
+
+		webrtc::CodecSpecificInfo info;
+		info.codecType = webrtc::kVideoCodecH264;
+		info.codecSpecific.H264.packetization_mode = webrtc::H264PacketizationMode::NonInterleaved;
+
+		auto result = callback_->OnEncodedImage(image, &info, &fragmentation_);
+		return result.error == webrtc::EncodedImageCallback::Result::OK ?
+			WEBRTC_VIDEO_CODEC_OK : WEBRTC_VIDEO_CODEC_ERROR;
+	}
+
+	int32_t PassthroughVideoEncoder::SetChannelParameters(uint32_t packet_loss, int64_t rtt)
+	{
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t PassthroughVideoEncoder::SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate)
+	{
+		// the recording was encoded at whatever rate it was
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	const char* PassthroughVideoEncoder::ImplementationName() const
+	{
+		return "Passthrough";
+	}
+
+	PassthroughEncoderFactory::PassthroughEncoderFactory()
+	{
+		// Constrained baseline with non-interleaved packetization, which every peer can decode.
+		cricket::VideoCodec codec(cricket::kH264CodecName);
+		codec.SetParam(cricket::kH264FmtpProfileLevelId, "42e01f");
+		codec.SetParam(cricket::kH264FmtpLevelAsymmetryAllowed, "1");
+		codec.SetParam(cricket::kH264FmtpPacketizationMode, "1");
+		codecs_.push_back(codec);
+	}
+
+	webrtc::VideoEncoder* PassthroughEncoderFactory::CreateVideoEncoder(const cricket::VideoCodec& codec)
+	{
+		return cricket::CodecNamesEq(codec.name, cricket::kH264CodecName) ? new PassthroughVideoEncoder() : nullptr;
+	}
+
+	const std::vector<cricket::VideoCodec>& PassthroughEncoderFactory::supported_codecs() const
+	{
+		return codecs_;
+	}
+
+	void PassthroughEncoderFactory::DestroyVideoEncoder(webrtc::VideoEncoder* encoder)
+	{
+		delete encoder;
+	}
+
+	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreatePassthroughPeerConnectionFactory()
+	{
+		// The factory starts its own network and worker threads, and takes the encoder factory.
+		return webrtc::CreatePeerConnectionFactory(nullptr,
+			nullptr,
+			nullptr,
+			nullptr,
+			new PassthroughEncoderFactory(),
+			nullptr);
+	}
+}
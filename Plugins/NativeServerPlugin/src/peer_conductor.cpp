@@ -1,7 +1,13 @@
 #include "pch.h"
 
+#include "backend_video_encoder.h"
 #include "peer_conductor.h"
 
+// from InputProtocol
+#include "input_message_codec.h"
+
+#include "webrtc/rtc_base/timeutils.h"
+
 namespace 
 {
 	// Mock (does nothing) SetSessionDescriptionObserver
@@ -38,7 +44,9 @@ PeerConductor::PeerConductor(int id,
 	name_(name),
 	webrtc_config_(webrtc_config),
 	peer_factory_(peer_factory),
-	send_func_(send_func)
+	send_func_(send_func),
+	encoder_backend_(EncoderBackendType::kAuto),
+	signaling_format_(SignalingCodec::JSON)
 {
 }
 
@@ -46,6 +54,16 @@ PeerConductor::~PeerConductor()
 {
 	LOG(INFO) << "dtor";
 
+	for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+	{
+		if (data_channels_[i])
+		{
+			input_channels_.Detach(static_cast<InputChannels::Channel>(i));
+			data_channels_[i]->UnregisterObserver();
+			data_channels_[i] = NULL;
+		}
+	}
+
 	peer_connection_ = NULL;
 	peer_streams_.clear();
 	peer_factory_ = NULL;
@@ -65,17 +83,15 @@ void PeerConductor::OnSuccess(SessionDescriptionInterface* desc)
 	string sdp;
 	if (desc->ToString(&sdp))
 	{
-		Json::StyledWriter writer;
-		Json::Value jmessage;
-		jmessage[kSessionDescriptionTypeName] = desc->type();
-		jmessage[kSessionDescriptionSdpName] = sdp;
-		jmessage[kTurnServerUri] = webrtc_config_->turn_server.uri;
-		jmessage[kTurnServerUsername] = webrtc_config_->turn_server.username;
-		jmessage[kTurnServerPassword] = webrtc_config_->turn_server.password;
-
-		string message = writer.write(jmessage);
-
-		send_func_(message);
+		SignalingMessage message;
+		message.kind = SignalingMessage::SESSION_DESCRIPTION;
+		message.type = desc->type();
+		message.sdp = sdp;
+		message.turn_uri = webrtc_config_->turn_server.uri;
+		message.turn_username = webrtc_config_->turn_server.username;
+		message.turn_password = webrtc_config_->turn_server.password;
+
+		send_func_(SignalingCodec::Encode(message, signaling_format_));
 	}
 }
 
@@ -100,24 +116,18 @@ void PeerConductor::OnIceGatheringChange(
 
 void PeerConductor::OnIceCandidate(const IceCandidateInterface* candidate)
 {
-	Json::StyledWriter writer;
-	Json::Value jmessage;
+	SignalingMessage message;
+	message.kind = SignalingMessage::ICE_CANDIDATE;
+	message.sdp_mid = candidate->sdp_mid();
+	message.sdp_mline_index = candidate->sdp_mline_index();
 
-	jmessage[kCandidateSdpMidName] = candidate->sdp_mid();
-	jmessage[kCandidateSdpMlineIndexName] = candidate->sdp_mline_index();
-
-	string sdp;
-	if (!candidate->ToString(&sdp))
+	if (!candidate->ToString(&message.candidate))
 	{
 		LOG(LS_ERROR) << "Failed to serialize candidate";
 		return;
 	}
 
-	jmessage[kCandidateSdpName] = sdp;
-
-	string message = writer.write(jmessage);
-
-	send_func_(message);
+	send_func_(SignalingCodec::Encode(message, signaling_format_));
 }
 
 void PeerConductor::OnAddStream(
@@ -134,17 +144,130 @@ void PeerConductor::OnRemoveStream(
 
 void PeerConductor::OnDataChannel(
 	rtc::scoped_refptr<webrtc::DataChannelInterface> channel)
+{
+	AddDataChannel(channel);
+}
+
+void PeerConductor::AddDataChannel(scoped_refptr<DataChannelInterface> channel)
 {
 	channel->RegisterObserver(this);
+
+	// channels we don't know the label of are used by how they were negotiated
+	InputChannels::Channel type;
+	if (!InputChannels::FromLabel(channel->label(), &type))
+	{
+		type = channel->reliable() ? InputChannels::RELIABLE : InputChannels::UNRELIABLE;
+	}
+
+	if (data_channels_[type])
+	{
+		LOG(WARNING) << "Ignoring data channel " << channel->label() << " for sending, we already have one";
+		return;
+	}
+
+	data_channels_[type] = channel;
+	OnStateChange();
+}
+
+bool PeerConductor::SendDataChannelMessage(const string& message)
+{
+	return input_channels_.Send(message);
+}
+
+void PeerConductor::ForwardFrameMetadata(BufferCapturer* capturer)
+{
+	capturer->SignalFrameMetadata.connect(this, &PeerConductor::OnFrameMetadata);
+	capturer->SetFrameInputs(frame_inputs_);
+}
+
+void PeerConductor::PaceFrames(BufferCapturer* capturer)
+{
+	capturer->SetEncoderControl(&encoder_control_);
+}
+
+void PeerConductor::TrackLatency(BufferCapturer* capturer)
+{
+	if (!webrtc_config_->track_latency)
+	{
+		return;
+	}
+
+	capturer->SetStampFrames(true);
+	capturer->SignalFrameSent.connect(this, &PeerConductor::OnFrameSent);
+}
+
+void PeerConductor::OnInputDispatched(const char* data, size_t size)
+{
+	uint32_t sequence;
+	if (webrtc_config_->track_latency && InputMessageCodec::DecodeSequence(data, size, &sequence))
+	{
+		latency_tracker_.RenderStarted(sequence, rtc::TimeMicros());
+	}
+}
+
+void PeerConductor::OnFrameSent(BufferCapturer* capturer, int64_t prediction_timestamp)
+{
+	latency_tracker_.FrameSent(prediction_timestamp);
+}
+
+void PeerConductor::OnFrameEncoded(int64_t prediction_timestamp, int64_t time_us)
+{
+	ServerLatency latency;
+	if (webrtc_config_->track_latency && latency_tracker_.EncodeDone(prediction_timestamp, time_us, &latency))
+	{
+		SendDataChannelMessage(LatencyReport::Encode(latency));
+	}
+}
+
+void PeerConductor::UseEncoderBackend(BufferCapturer* capturer)
+{
+	capturer->SetEncoderBackend(ResolveEncoderBackend(encoder_backend_));
+}
+
+void PeerConductor::OnFrameMetadata(BufferCapturer* capturer)
+{
+	// anything the channel won't take yet stays queued, within the queue's bounds, for the next frame
+	capturer->frame_metadata().Drain([this](const string& message)
+	{
+		return SendDataChannelMessage(message);
+	});
 }
 
 void PeerConductor::OnMessage(const DataBuffer& buffer)
 {
+	uint32_t sequence;
+	if (webrtc_config_->track_latency &&
+		InputMessageCodec::DecodeSequence((const char*)buffer.data.data(), buffer.data.size(), &sequence))
+	{
+		latency_tracker_.Received(sequence, rtc::TimeMicros());
+	}
+
 	std::string message((const char*)buffer.data.data(), buffer.data.size());
 	SignalDataChannelMessage.emit(Id(), message);
 }
 
-void PeerConductor::OnStateChange() {}
+void PeerConductor::OnStateChange()
+{
+	// we aren't told which channel changed, so check them all
+	for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+	{
+		auto type = static_cast<InputChannels::Channel>(i);
+		DataChannelInterface* channel = data_channels_[i].get();
+		bool open = channel && channel->state() == DataChannelInterface::kOpen;
+		if (open && !input_channels_.IsAttached(type))
+		{
+			input_channels_.Attach(type, [channel](const char* data, size_t size)
+			{
+				return channel->Send(DataBuffer(rtc::CopyOnWriteBuffer(data, size),
+					InputMessageCodec::IsBinary(data, size)));
+			});
+		}
+		else if (!open && input_channels_.IsAttached(type))
+		{
+			input_channels_.Detach(type);
+		}
+	}
+}
 
 void PeerConductor::AllocatePeerConnection(bool create_offer)
 {
@@ -221,11 +344,21 @@ void PeerConductor::AllocatePeerConnection(bool create_offer)
 	// create offer if required
 	if (create_offer)
 	{
-		webrtc::DataChannelInit data_channel_config;
-		data_channel_config.ordered = false;
-		data_channel_config.maxRetransmits = 0;
-		auto channel = peer_connection_->CreateDataChannel("inputDataChannel", &data_channel_config);
-		channel->RegisterObserver(this);
+		// poses go on an unreliable channel so they never wait behind a retransmit, and control
+		// on a reliable one so it's never lost
+		for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+		{
+			auto type = static_cast<InputChannels::Channel>(i);
+			webrtc::DataChannelInit data_channel_config;
+			data_channel_config.ordered = InputChannels::IsOrdered(type);
+			data_channel_config.maxRetransmits = InputChannels::MaxRetransmits(type);
+			auto channel = peer_connection_->CreateDataChannel(InputChannels::Label(type), &data_channel_config);
+			if (channel)
+			{
+				AddDataChannel(channel);
+			}
+		}
+
 		peer_connection_->CreateOffer(this, NULL);
 	}
 }
@@ -239,36 +372,27 @@ bool PeerConductor::HandlePeerMessage(const string& message)
 		AllocatePeerConnection();
 	}
 
-	Json::Reader reader;
-	Json::Value jmessage;
-	if (!reader.parse(message, jmessage))
+	SignalingMessage decoded;
+	if (!SignalingCodec::Decode(message, &decoded))
 	{
 		LOG(WARNING) << "Received unknown message. " << message;
 		return false;
 	}
 
-	string type;
-	string json_object;
+	// answer in whichever format the peer speaks
+	signaling_format_ = SignalingCodec::Detect(message);
 
-	rtc::GetStringFromJsonObject(jmessage, kSessionDescriptionTypeName, &type);
-	if (!type.empty())
+	if (decoded.kind == SignalingMessage::SESSION_DESCRIPTION)
 	{
-		if (type == "offer-loopback")
+		if (decoded.type == "offer-loopback")
 		{
 			//TODO(bengreenier): reimplement
 			return false;
 		}
 
-		std::string sdp;
-		if (!rtc::GetStringFromJsonObject(jmessage, kSessionDescriptionSdpName, &sdp))
-		{
-			LOG(WARNING) << "Can't parse received session description message.";
-			return false;
-		}
-
 		webrtc::SdpParseError error;
 		webrtc::SessionDescriptionInterface* session_description(
-			webrtc::CreateSessionDescription(type, sdp, &error));
+			webrtc::CreateSessionDescription(decoded.type, decoded.sdp, &error));
 
 		if (!session_description)
 		{
@@ -290,20 +414,9 @@ bool PeerConductor::HandlePeerMessage(const string& message)
 	}
 	else
 	{
-		std::string sdp_mid;
-		int sdp_mlineindex = 0;
-		std::string sdp;
-		if (!rtc::GetStringFromJsonObject(jmessage, kCandidateSdpMidName, &sdp_mid) ||
-			!rtc::GetIntFromJsonObject(jmessage, kCandidateSdpMlineIndexName, &sdp_mlineindex) ||
-			!rtc::GetStringFromJsonObject(jmessage, kCandidateSdpName, &sdp))
-		{
-			LOG(WARNING) << "Can't parse received message.";
-			return false;
-		}
-
 		webrtc::SdpParseError error;
 		std::unique_ptr<webrtc::IceCandidateInterface> candidate(
-			webrtc::CreateIceCandidate(sdp_mid, sdp_mlineindex, sdp, &error));
+			webrtc::CreateIceCandidate(decoded.sdp_mid, decoded.sdp_mline_index, decoded.candidate, &error));
 
 		if (!candidate.get())
 		{
@@ -325,6 +438,48 @@ bool PeerConductor::HandlePeerMessage(const string& message)
 	return true;
 }
 
+void PeerConductor::SetVideoTargets(int bitrate_bps, int fps, int width, int height)
+{
+	if (bitrate_bps > 0)
+	{
+		encoder_control_.SetBitrate(bitrate_bps);
+
+		// the encoder follows the bandwidth estimate, so capping that caps the bitrate
+		if (peer_connection_)
+		{
+			PeerConnectionInterface::BitrateParameters bitrate;
+			bitrate.current_bitrate_bps = rtc::Optional<int>(bitrate_bps);
+			bitrate.max_bitrate_bps = rtc::Optional<int>(bitrate_bps);
+			peer_connection_->SetBitrate(bitrate);
+		}
+	}
+
+	if (fps > 0)
+	{
+		encoder_control_.SetFramerate(fps);
+	}
+
+	if (width > 0 && height > 0)
+	{
+		encoder_control_.SetResolution(width, height);
+	}
+}
+
+EncoderControl& PeerConductor::encoder_control()
+{
+	return encoder_control_;
+}
+
+void PeerConductor::SetEncoderBackend(EncoderBackendType encoder_backend)
+{
+	encoder_backend_ = encoder_backend;
+}
+
+void PeerConductor::SetFrameInputs(shared_ptr<FrameInputs> frame_inputs)
+{
+	frame_inputs_ = frame_inputs;
+}
+
 const bool PeerConductor::IsConnected() const
 {
 	return peer_connection_ != NULL;
@@ -0,0 +1,257 @@
+#include "pch.h"
+
+#include "backend_video_encoder.h"
+#include "recording_video_encoder.h"
+
+#include "webrtc/media/base/mediaconstants.h"
+#include "webrtc/modules/video_coding/codecs/h264/include/h264.h"
+#include "webrtc/rtc_base/timeutils.h"
+
+namespace StreamingToolkit
+{
+	namespace
+	{
+		// |path| for the first stream, and |path| with the stream's number before the extension
+		// for the rest
+		std::string StreamRecordingPath(const std::string& path, int stream_id)
+		{
+			if (stream_id == 0)
+			{
+				return path;
+			}
+
+			auto name = path.find_last_of("/\\");
+			auto extension = path.rfind('.');
+			if (extension == std::string::npos || (name != std::string::npos && extension < name))
+			{
+				extension = path.size();
+			}
+
+			return path.substr(0, extension) + "-" + std::to_string(stream_id) + path.substr(extension);
+		}
+	}
+
+	RecordingVideoEncoder::RecordingVideoEncoder(webrtc::VideoEncoder* encoder,
+		std::shared_ptr<StreamRecorder> recorder,
+		const std::string& path,
+		const EncodeObserver& observer,
+		std::shared_ptr<FrameInputs> inputs) :
+		encoder_(encoder),
+		recorder_(recorder),
+		path_(path),
+		observer_(observer),
+		inputs_(inputs),
+		callback_(nullptr)
+	{
+	}
+
+	RecordingVideoEncoder::~RecordingVideoEncoder()
+	{
+		if (recorder_ && recorder_->IsOpen())
+		{
+			auto stats = recorder_->stats();
+			if (!recorder_->Close())
+			{
+				LOG(LS_ERROR) << "Can't finish recording " << path_;
+			}
+
+			LOG(LS_INFO) << "Recorded " << stats.frames << " frames to " << path_ << ", dropping " << stats.dropped;
+		}
+	}
+
+	int32_t RecordingVideoEncoder::InitEncode(const webrtc::VideoCodec* codec_settings,
+		int32_t number_of_cores,
+		size_t max_payload_size)
+	{
+		auto result = encoder_->InitEncode(codec_settings, number_of_cores, max_payload_size);
+
+		// the recording stays open when the encoder is set up again, as it is for a new size
+		if (result == WEBRTC_VIDEO_CODEC_OK && recorder_ && !recorder_->IsOpen())
+		{
+			if (!recorder_->Open(path_, codec_settings->width, codec_settings->height, codec_settings->maxFramerate))
+			{
+				LOG(LS_ERROR) << "Can't record to " << path_;
+				recorder_.reset();
+			}
+		}
+
+		return result;
+	}
+
+	int32_t RecordingVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback)
+	{
+		callback_ = callback;
+		return encoder_->RegisterEncodeCompleteCallback(callback ? this : nullptr);
+	}
+
+	int32_t RecordingVideoEncoder::Release()
+	{
+		return encoder_->Release();
+	}
+
+	int32_t RecordingVideoEncoder::Encode(const webrtc::VideoFrame& frame,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const std::vector<webrtc::FrameType>* frame_types)
+	{
+		return encoder_->Encode(frame, codec_specific_info, frame_types);
+	}
+
+	int32_t RecordingVideoEncoder::SetChannelParameters(uint32_t packet_loss, int64_t rtt)
+	{
+		return encoder_->SetChannelParameters(packet_loss, rtt);
+	}
+
+	int32_t RecordingVideoEncoder::SetRateAllocation(const webrtc::BitrateAllocation& allocation, uint32_t framerate)
+	{
+		return encoder_->SetRateAllocation(allocation, framerate);
+	}
+
+	webrtc::VideoEncoder::ScalingSettings RecordingVideoEncoder::GetScalingSettings() const
+	{
+		return encoder_->GetScalingSettings();
+	}
+
+	bool RecordingVideoEncoder::SupportsNativeHandle() const
+	{
+		return encoder_->SupportsNativeHandle();
+	}
+
+	const char* RecordingVideoEncoder::ImplementationName() const
+	{
+		return encoder_->ImplementationName();
+	}
+
+	webrtc::EncodedImageCallback::Result RecordingVideoEncoder::OnEncodedImage(const webrtc::EncodedImage& image,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const webrtc::RTPFragmentationHeader* fragmentation)
+	{
+		if (recorder_ && recorder_->IsOpen())
+		{
+			frame_.data.assign(image._buffer, image._buffer + image._length);
+			frame_.timestamp_us = image.capture_time_ms_ * rtc::kNumMicrosecsPerMillisec;
+			frame_.keyframe = image._frameType == webrtc::kVideoFrameKey;
+			frame_.width = image._encodedWidth;
+			frame_.height = image._encodedHeight;
+			frame_.qp = image.qp_;
+
+			std::string inputs;
+			if (inputs_ && image.prediction_timestamp_ >= 0)
+			{
+				inputs = inputs_->Take(image.prediction_timestamp_);
+			}
+
+			recorder_->Write(frame_, image.prediction_timestamp_, inputs);
+			frame_.frame_number++;
+		}
+
+		if (observer_ && image.prediction_timestamp_ >= 0)
+		{
+			observer_(image.prediction_timestamp_);
+		}
+
+		return callback_->OnEncodedImage(image, codec_specific_info, fragmentation);
+	}
+
+	RecordingEncoderFactory::RecordingEncoderFactory(const std::string& path,
+		const RecordingVideoEncoder::EncodeObserver& observer,
+		EncoderBackendType backend,
+		std::shared_ptr<LossReportRouter> loss_reports,
+		std::shared_ptr<EncoderSessionPool> sessions,
+		std::shared_ptr<FrameInputs> inputs) :
+		path_(path),
+		observer_(observer),
+		backend_(backend),
+		loss_reports_(loss_reports),
+		sessions_(sessions),
+		inputs_(inputs),
+		next_stream_id_(0)
+	{
+		// The profile PassthroughEncoderFactory sends, so the recording can be replayed to any peer.
+		cricket::VideoCodec codec(cricket::kH264CodecName);
+		codec.SetParam(cricket::kH264FmtpProfileLevelId, "42e01f");
+		codec.SetParam(cricket::kH264FmtpLevelAsymmetryAllowed, "1");
+		codec.SetParam(cricket::kH264FmtpPacketizationMode, "1");
+		codecs_.push_back(codec);
+	}
+
+	webrtc::VideoEncoder* RecordingEncoderFactory::CreateVideoEncoder(const cricket::VideoCodec& codec)
+	{
+		if (!cricket::CodecNamesEq(codec.name, cricket::kH264CodecName))
+		{
+			return nullptr;
+		}
+
+		auto stream_id = next_stream_id_++;
+		std::shared_ptr<StreamRecorder> recorder;
+		std::string path;
+		if (!path_.empty())
+		{
+			recorder = std::make_shared<StreamRecorder>();
+			path = StreamRecordingPath(path_, stream_id);
+		}
+
+		auto loss_reports = loss_reports_;
+		auto software = [loss_reports]() -> webrtc::VideoEncoder*
+		{
+			auto backend = CreateEncoderBackend(EncoderBackendType::kSoftware);
+			return backend ? new BackendVideoEncoder(std::move(backend), loss_reports) : nullptr;
+		};
+
+		auto hardware = [codec]() -> webrtc::VideoEncoder*
+		{
+			return webrtc::H264Encoder::Create(codec);
+		};
+
+		webrtc::VideoEncoder* encoder = nullptr;
+		if (backend_ == EncoderBackendType::kSoftware)
+		{
+			encoder = software();
+			if (!encoder)
+			{
+				LOG(LS_ERROR) << "Can't load OpenH264, so the stream is given webrtc's H.264 encoder";
+			}
+		}
+		else if (sessions_)
+		{
+			encoder = new PooledVideoEncoder(hardware, software, sessions_, stream_id);
+		}
+
+		if (!encoder)
+		{
+			encoder = hardware();
+		}
+
+		return new RecordingVideoEncoder(encoder, recorder, path, observer_, inputs_);
+	}
+
+	const std::vector<cricket::VideoCodec>& RecordingEncoderFactory::supported_codecs() const
+	{
+		return codecs_;
+	}
+
+	void RecordingEncoderFactory::DestroyVideoEncoder(webrtc::VideoEncoder* encoder)
+	{
+		delete encoder;
+	}
+
+	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreateRecordingPeerConnectionFactory(const std::string& path,
+		const RecordingVideoEncoder::EncodeObserver& observer,
+		EncoderBackendType backend,
+		std::shared_ptr<LossReportRouter> loss_reports,
+		std::shared_ptr<EncoderSessionPool> sessions,
+		std::shared_ptr<FrameInputs> inputs)
+	{
+		if (path.empty() && !observer && backend == EncoderBackendType::kNvenc && !sessions)
+		{
+			return webrtc::CreatePeerConnectionFactory();
+		}
+
+		// The factory starts its own network and worker threads, and takes the encoder factory.
+		return webrtc::CreatePeerConnectionFactory(nullptr,
+			nullptr,
+			nullptr,
+			nullptr,
+			new RecordingEncoderFactory(path, observer, backend, loss_reports, sessions, inputs),
+			nullptr);
+	}
+}
@@ -0,0 +1,111 @@
+#include "pch.h"
+
+#include "replay_buffer_capturer.h"
+
+namespace StreamingToolkit
+{
+	RecordedFrameBuffer::RecordedFrameBuffer(const RecordedFrame& frame,
+		std::shared_ptr<StreamRecording> recording,
+		std::weak_ptr<StreamReplayer> replayer) :
+		frame_(frame),
+		recording_(recording),
+		replayer_(replayer)
+	{
+	}
+
+	webrtc::VideoFrameBuffer::Type RecordedFrameBuffer::type() const
+	{
+		return Type::kNative;
+	}
+
+	int RecordedFrameBuffer::width() const
+	{
+		return frame_.width;
+	}
+
+	int RecordedFrameBuffer::height() const
+	{
+		return frame_.height;
+	}
+
+	rtc::scoped_refptr<webrtc::I420BufferInterface> RecordedFrameBuffer::ToI420()
+	{
+		auto buffer = webrtc::I420Buffer::Create(frame_.width, frame_.height);
+		webrtc::I420Buffer::SetBlack(buffer);
+		return buffer;
+	}
+
+	const RecordedFrame& RecordedFrameBuffer::frame() const
+	{
+		return frame_;
+	}
+
+	void RecordedFrameBuffer::RequestKeyframe()
+	{
+		auto replayer = replayer_.lock();
+		if (replayer)
+		{
+			replayer->RequestKeyframe();
+		}
+	}
+
+	ReplayBufferCapturer::ReplayBufferCapturer(std::shared_ptr<StreamRecording> recording) :
+		recording_(recording)
+	{
+		replayer_ = std::make_shared<StreamReplayer>(recording_.get(),
+			[this](const RecordedFrame& frame, int64_t timestamp_us)
+			{
+				OnReplayedFrame(frame, timestamp_us);
+			});
+	}
+
+	ReplayBufferCapturer::~ReplayBufferCapturer()
+	{
+		replayer_->Stop();
+	}
+
+	cricket::CaptureState ReplayBufferCapturer::Start(const cricket::VideoFormat& format)
+	{
+		if (!replayer_->Start())
+		{
+			LOG(LS_ERROR) << "Nothing to replay: the recording has no keyframes";
+			return cricket::CS_FAILED;
+		}
+
+		return BufferCapturer::Start(format);
+	}
+
+	void ReplayBufferCapturer::Stop()
+	{
+		replayer_->Stop();
+		BufferCapturer::Stop();
+	}
+
+	StreamReplayer::Stats ReplayBufferCapturer::stats() const
+	{
+		return replayer_->stats();
+	}
+
+	void ReplayBufferCapturer::OnReplayedFrame(const RecordedFrame& frame, int64_t timestamp_us)
+	{
+		rtc::scoped_refptr<RecordedFrameBuffer> buffer(
+			new rtc::RefCountedObject<RecordedFrameBuffer>(frame, recording_, replayer_));
+
+		auto video_frame = webrtc::VideoFrame(buffer, kVideoRotation_0, timestamp_us);
+		video_frame.set_ntp_time_ms(clock_->CurrentNtpInMilliseconds());
+		video_frame.set_prediction_timestamp(frame.prediction_timestamp);
+
+		// Sending the recorded frame, with the metadata it was recorded with. Recordings from
+		// elsewhere may hold anything, which is sent as it is.
+		auto data = reinterpret_cast<const char*>(frame.metadata);
+		CameraTransform pose;
+		bool has_pose;
+		std::string metadata;
+		if (!FrameInputs::Split(data, frame.metadata_size, &pose, &has_pose, &metadata))
+		{
+			metadata.assign(data, frame.metadata_size);
+		}
+
+		BufferCapturer::SendFrame(video_frame, metadata);
+	}
+}
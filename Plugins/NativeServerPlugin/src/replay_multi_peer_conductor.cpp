@@ -0,0 +1,47 @@
+#include "pch.h"
+
+#include "passthrough_video_encoder.h"
+#include "replay_multi_peer_conductor.h"
+
+ReplayMultiPeerConductor::ReplayMultiPeerConductor(shared_ptr<FullServerConfig> config) :
+	MultiPeerConductor(config, CreatePassthroughPeerConnectionFactory()),
+	recording_(make_shared<StreamRecording>())
+{
+	const auto& path = config_->server_config->server_config.replay_path;
+	if (!recording_->Open(path))
+	{
+		LOG(LS_ERROR) << "Can't replay " << path;
+	}
+	else if (recording_->recovered())
+	{
+		LOG(LS_WARNING) << path << " wasn't closed, replaying the " << recording_->frames() << " frames recovered";
+	}
+}
+
+bool ReplayMultiPeerConductor::IsReplaying() const
+{
+	return recording_->frames() > 0;
+}
+
+scoped_refptr<PeerConductor> ReplayMultiPeerConductor::SafeAllocatePeerMapEntry(int peer_id)
+{
+	if (connected_peers_.find(peer_id) == connected_peers_.end())
+	{
+		string peer_name = signalling_client_.peers().at(peer_id);
+		connected_peers_[peer_id] = new RefCountedObject<ReplayPeerConductor>(peer_id,
+			peer_name,
+			config_->webrtc_config,
+			peer_factory_,
+			[&, peer_id](const string& message)
+			{
+				message_queue_.push(MessageEntry(peer_id, message));
+				rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, 500, this, 0);
+			},
+			recording_);
+
+		connected_peers_[peer_id]->SignalIceConnectionChange.connect((MultiPeerConductor*)this, &MultiPeerConductor::OnIceConnectionChange);
+		connected_peers_[peer_id]->SignalDataChannelMessage.connect((MultiPeerConductor*)this, &MultiPeerConductor::HandleDataChannelMessage);
+	}
+
+	return connected_peers_[peer_id];
+}
@@ -0,0 +1,26 @@
+#include "pch.h"
+#include "replay_peer_conductor.h"
+
+ReplayPeerConductor::ReplayPeerConductor(int id,
+	const string& name,
+	shared_ptr<WebRTCConfig> webrtc_config,
+	scoped_refptr<PeerConnectionFactoryInterface> peer_factory,
+	const function<void(const string&)>& send_func,
+	shared_ptr<StreamRecording> recording) : PeerConductor(
+		id,
+		name,
+		webrtc_config,
+		peer_factory,
+		send_func
+	),
+	recording_(recording)
+{
+}
+
+unique_ptr<cricket::VideoCapturer> ReplayPeerConductor::AllocateVideoCapturer()
+{
+	// recorded frames are sent as they are, so they're neither paced nor given an encoder
+	unique_ptr<ReplayBufferCapturer> owned_ptr(new ReplayBufferCapturer(recording_));
+	ForwardFrameMetadata(owned_ptr.get());
+	return owned_ptr;
+}
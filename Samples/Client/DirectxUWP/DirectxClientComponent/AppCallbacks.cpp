@@ -1,7 +1,5 @@
 ﻿#include "pch.h"
 
-#include <algorithm>
-
 #include "AppCallbacks.h"
 #include "DirectXHelper.h"
 
@@ -21,12 +19,22 @@ int g_latencyCounter = 0;
 int g_latency = 0;
 #endif // SHOW_DEBUG_INFO
 
+namespace
+{
+	// Frames the server hasn't rendered yet. It skips some when it coalesces input, so
+	// those are dropped after a second, in 100ns ticks.
+	const size_t kMaxPendingFrames = 128;
+	const int64_t kMaxPendingFrameAge = 10000000;
+}
+
 AppCallbacks::AppCallbacks(SendInputDataHandler^ sendInputDataHandler) :
 	m_videoRenderer(nullptr),
 	m_holographicSpace(nullptr),
 	m_sentStereoMode(false),
-	m_sendInputDataHandler(sendInputDataHandler)
+	m_sendInputDataHandler(sendInputDataHandler),
+	m_holographicFrames(kMaxPendingFrames, kMaxPendingFrameAge)
 {
+	memset(m_framePredictionTimestamp, 0, sizeof(m_framePredictionTimestamp));
 }
 
 AppCallbacks::~AppCallbacks()
@@ -96,45 +104,32 @@ void AppCallbacks::SetMediaStreamSource(Windows::Media::Core::IMediaStreamSource
 			[&](MEPlayer^ mc, int width, int height, Microsoft::WRL::ComPtr<ID3D11Texture2D> texture, int timestampId)
 		{
 			auto lock = m_lock.Lock();
-			if (!m_framePredictionTimestamp.empty())
-			{
-				int64_t predictionTimestamp = m_framePredictionTimestamp[timestampId];
-				std::vector<HolographicFrame^>::iterator it = std::find_if(
-					m_holographicFrames.begin(),
-					m_holographicFrames.end(),
-					[&](HolographicFrame^ frame)
-					{
-						return frame->CurrentPrediction->Timestamp->TargetTime.UniversalTime ==
-							predictionTimestamp;
-					});
-
-				if (it != m_holographicFrames.end())
-				{
-					m_deviceResources->GetD3DDeviceContext()->CopyResource(
-						m_videoRenderer->GetVideoFrame(), texture.Get());
+			int64_t predictionTimestamp = m_framePredictionTimestamp[timestampId & 0xFF];
+			HolographicFrame^ frame;
 
-					HolographicFrame^ frame = *it;
+			// a frame the server predicted, as our pose was late, carries the last one it had
+			if (m_holographicFrames.TakeNearest(predictionTimestamp, &frame))
+			{
+				m_deviceResources->GetD3DDeviceContext()->CopyResource(
+					m_videoRenderer->GetVideoFrame(), texture.Get());
 
 #ifdef SHOW_DEBUG_INFO
-					if (++g_latencyCounter % 60)
-					{
-						g_totalDelayTime += (g_currentTimestamp - predictionTimestamp) / 10000;
-					}
-					else
-					{
-						g_latency = g_totalDelayTime / 60;
-						g_totalDelayTime = 0;
-					}
-
-					if (m_main->Render(frame, m_player->GetFrameRate(), g_latency))
+				if (++g_latencyCounter % 60)
+				{
+					g_totalDelayTime += (g_currentTimestamp - predictionTimestamp) / 10000;
+				}
+				else
+				{
+					g_latency = g_totalDelayTime / 60;
+					g_totalDelayTime = 0;
+				}
+
+				if (m_main->Render(frame, m_player->GetFrameRate(), g_latency))
 #else // SHOW_DEBUG_INFO
-					if (m_main->Render(frame))
+				if (m_main->Render(frame))
 #endif // SHOW_DEBUG_INFO
-					{
-						m_deviceResources->Present(frame);
-					}
-
-					m_holographicFrames.erase(it);
+				{
+					m_deviceResources->Present(frame);
 				}
 			}
 		});
@@ -147,7 +142,7 @@ void AppCallbacks::SetMediaStreamSource(Windows::Media::Core::IMediaStreamSource
 void AppCallbacks::OnPredictionTimestamp(int id, int64_t timestamp)
 {
 	auto lock = m_lock.Lock();
-	m_framePredictionTimestamp[id] = timestamp;
+	m_framePredictionTimestamp[id & 0xFF] = timestamp;
 }
 
 uint32 AppCallbacks::FpsReport()
@@ -176,7 +171,10 @@ void AppCallbacks::SendInputData()
 
 	// Creates a new frame for input data.
 	HolographicFrame^ newFrame = m_main->Update();
-	m_holographicFrames.push_back(newFrame);
+	{
+		auto lock = m_lock.Lock();
+		m_holographicFrames.Insert(newFrame->CurrentPrediction->Timestamp->TargetTime.UniversalTime, newFrame);
+	}
 
 	// Gets the current camera transformation.
 	XMFLOAT4X4 leftProjectionMatrix;
@@ -6,6 +6,9 @@
 #include "HolographicAppMain.h"
 #include "MediaEnginePlayer.h"
 
+// from InputProtocol
+#include "frame_correlator.h"
+
 using namespace Microsoft::WRL;
 using namespace Platform;
 using namespace Platform::Collections;
@@ -50,9 +53,11 @@ namespace DirectXClientComponent
 		bool													m_sentStereoMode;
 		ComPtr<ABI::Windows::Media::Core::IMediaStreamSource>	m_mediaSource;
 		
-		// Frame prediction
-		std::vector<HolographicFrame^>							m_holographicFrames;
-		std::map<int, int64_t>									m_framePredictionTimestamp;
+		// Frame prediction, the frames sent to the server by prediction timestamp
+		FrameCorrelator<HolographicFrame^>						m_holographicFrames;
+
+		// The prediction timestamp of each video frame, by the low byte of its id
+		int64_t													m_framePredictionTimestamp[256];
 
 		// The holographic space the app will use for rendering.
 		Windows::Graphics::Holographic::HolographicSpace^		m_holographicSpace;
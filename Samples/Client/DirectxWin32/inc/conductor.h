@@ -12,10 +12,13 @@
 #define WEBRTC_CONDUCTOR_H_
 
 #include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "peer_connection_client.h"
 #include "main_window.h"
@@ -23,6 +26,12 @@
 #include "config_parser.h"
 #include "webrtc/api/mediastreaminterface.h"
 #include "webrtc/api/peerconnectioninterface.h"
+#include "webrtc/rtc_base/sigslot.h"
+
+// from InputProtocol
+#include "frame_metadata.h"
+#include "input_channels.h"
+#include "latency_recorder.h"
 
  // For unit tests.
 FOWARD_DECLARE(EndToEndTests, SingleClientToServer);
@@ -46,7 +55,9 @@ class Conductor : public webrtc::PeerConnectionObserver,
 	public webrtc::CreateSessionDescriptionObserver,
     public PeerConnectionClientObserver,
 	public MainWindowCallback,
-	public DataChannelCallback
+	public DataChannelCallback,
+	public rtc::VideoSinkInterface<webrtc::VideoFrame>,
+	public sigslot::has_slots<>
 {
 public:
 	enum CallbackID 
@@ -73,7 +84,34 @@ public:
 
 	virtual void Close();
 
+	// Notes that the frame with |prediction_timestamp| reached the screen, when tracking latency
+	void OnFramePresented(int64_t prediction_timestamp);
+
+	// Receives each decoded frame of the remote video, in order, with the metadata the server
+	// sent for it, or nullptr if it sent none
+	typedef std::function<void(const webrtc::VideoFrame& frame, const std::string* metadata)> FrameMetadataCallback;
+
+	// Pairs the remote video's frames with their metadata from the data channel, holding a frame
+	// up to |max_wait_ms| for metadata that hasn't arrived. Called on the thread decoding video,
+	// or the signaling thread when the metadata is what arrived last. Set before connecting.
+	void SetFrameMetadataCallback(const FrameMetadataCallback& callback, int64_t max_wait_ms = 50);
+
 protected:
+	// Hands a data channel's state changes and messages back to the conductor
+	class ChannelObserver : public webrtc::DataChannelObserver
+	{
+	public:
+		ChannelObserver(Conductor* conductor, InputChannels::Channel channel);
+
+		void OnStateChange() override;
+
+		void OnMessage(const webrtc::DataBuffer& buffer) override;
+
+	private:
+		Conductor* conductor_;
+		InputChannels::Channel channel_;
+	};
+
 	~Conductor();
 
 	bool InitializePeerConnection();
@@ -149,6 +187,9 @@ protected:
 	// DataChannelCallback implementation.
 	bool SendInputData(const std::string& message) override;
 
+	// VideoSinkInterface implementation, for the remote video as it's decoded.
+	void OnFrame(const webrtc::VideoFrame& frame) override;
+
 	// CreateSessionDescriptionObserver implementation.
 	void OnSuccess(webrtc::SessionDescriptionInterface* desc) override;
 
@@ -158,6 +199,24 @@ protected:
 	// Send a message to the remote peer.
 	void SendMessage(const std::string& json_object);
 
+	// Sends input on |channel| once it's open, by its label.
+	void AddDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel);
+
+	// Attaches the channel for |type| to input_channels_ while it's open, and detaches it otherwise.
+	void OnDataChannelStateChange(InputChannels::Channel type);
+
+	// Handles a message from the server on one of the data channels.
+	void OnDataChannelMessage(const webrtc::DataBuffer& buffer);
+
+	// Watches the remote video for decoded frames, if anything needs them.
+	void AddRemoteTrackSink(webrtc::VideoTrackInterface* track);
+
+	// Hands frame_metadata_callback_ the frames the joiner let go of.
+	void DeliverJoinedFrames();
+
+	// Starts joining afresh, with frame_metadata_lock_ held.
+	void ResetFrameMetadataJoiner();
+
 	int peer_id_;
 	bool loopback_;
 	rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
@@ -165,13 +224,39 @@ protected:
 		peer_connection_factory_;
 
 	PeerConnectionClient* client_;
-	rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel_;
+	rtc::scoped_refptr<webrtc::DataChannelInterface> data_channels_[InputChannels::CHANNEL_COUNT];
+	std::unique_ptr<ChannelObserver> channel_observers_[InputChannels::CHANNEL_COUNT];
+	InputChannels input_channels_;
 	MainWindow* main_window_;
 	StreamingToolkit::WebRTCConfig* webrtc_config_;
 	std::deque<std::string*> pending_messages_;
 	std::map<std::string, rtc::scoped_refptr<webrtc::MediaStreamInterface>>
 		active_streams_;
 
+	// The remote video, watched for decoded frames when tracking latency or joining metadata
+	rtc::scoped_refptr<webrtc::VideoTrackInterface> remote_track_;
+
+	struct JoinedFrame
+	{
+		webrtc::VideoFrame frame;
+		bool has_metadata;
+		std::string metadata;
+	};
+
+	// Joins frames with their metadata, if there's a frame_metadata_callback_, collecting them in
+	// joined_frames_ so the callback isn't called with the lock held
+	std::mutex frame_metadata_lock_;
+	std::unique_ptr<FrameMetadataJoiner<webrtc::VideoFrame>> frame_metadata_joiner_;
+	std::vector<JoinedFrame> joined_frames_;
+
+	// Held while delivering, so frames reach the callback in order from either thread
+	std::mutex frame_delivery_lock_;
+	FrameMetadataCallback frame_metadata_callback_;
+	int64_t frame_metadata_max_wait_ms_;
+
+	// Measures motion to photon latency, if webrtc_config_ asks to track it
+	std::unique_ptr<ClientLatencyTracker> latency_tracker_;
+
 	std::string server_;
 	std::string turn_username_;
 	std::string turn_password_;
@@ -45,6 +45,9 @@ protected:
 private:
 	DataChannelCallback* data_channel_callback_;
 
+	// Numbers camera inputs, so the latency of each can be followed to the frame showing it
+	uint32_t camera_sequence_;
+
 	// For unit tests.
 	FRIEND_TEST(EndToEndTests, SingleClientToServer);
 	FRIEND_TEST(EndToEndTests, DISABLED_SingleClientToServer);
@@ -21,6 +21,7 @@
 #include "webrtc/rtc_base/checks.h"
 #include "webrtc/rtc_base/json.h"
 #include "webrtc/rtc_base/logging.h"
+#include "webrtc/rtc_base/timeutils.h"
 #include "webrtc/media/engine/webrtcvideocapturerfactory.h"
 #include "webrtc/modules/video_capture/video_capture_factory.h"
 #include "webrtc/media/base/fakevideocapturer.h"
@@ -39,9 +40,6 @@ const char kTurnServerUri[] = "uri";
 const char kTurnServerUsername[] = "username";
 const char kTurnServerPassword[] = "password";
 
-// Names used for data channels
-const char kInputDataChannelName[] = "inputDataChannel";
-
 #define DTLS_ON  true
 #define DTLS_OFF false
 
@@ -75,10 +73,16 @@ Conductor::Conductor(PeerConnectionClient* client, MainWindow* main_window, WebR
 	loopback_(false),
 	client_(client),
 	main_window_(main_window),
-	webrtc_config_(webrtc_config)
+	webrtc_config_(webrtc_config),
+	frame_metadata_max_wait_ms_(50)
 {
 	client_->RegisterObserver(this);
 	main_window->RegisterObserver(this);
+
+	if (webrtc_config_->track_latency)
+	{
+		latency_tracker_.reset(new ClientLatencyTracker());
+	}
 }
 
 Conductor::~Conductor()
@@ -224,6 +228,36 @@ bool Conductor::CreatePeerConnection(bool dtls)
 
 void Conductor::DeletePeerConnection()
 {
+	for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+	{
+		input_channels_.Detach(static_cast<InputChannels::Channel>(i));
+		if (data_channels_[i])
+		{
+			data_channels_[i]->UnregisterObserver();
+		}
+
+		data_channels_[i] = nullptr;
+		channel_observers_[i].reset();
+	}
+
+	if (remote_track_)
+	{
+		remote_track_->RemoveSink(this);
+		remote_track_ = nullptr;
+	}
+
+	// frames still waiting for metadata belonged to this call
+	if (frame_metadata_callback_)
+	{
+		std::lock_guard<std::mutex> lock(frame_metadata_lock_);
+		ResetFrameMetadataJoiner();
+	}
+
+	if (latency_tracker_ && latency_tracker_->recorder().completed() > 0)
+	{
+		LOG(INFO) << "Motion to photon latency, by stage:\n" << latency_tracker_->recorder().Report();
+	}
+
 	peer_connection_ = NULL;
 	active_streams_.clear();
 	main_window_->StopLocalRenderer();
@@ -265,7 +299,164 @@ void Conductor::OnRemoveStream(rtc::scoped_refptr<webrtc::MediaStreamInterface>
 
 void Conductor::OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel)
 {
-	data_channel_ = channel;
+	AddDataChannel(channel);
+}
+
+void Conductor::AddDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel)
+{
+	if (!channel)
+	{
+		return;
+	}
+
+	// older servers only know the input channel, and custom ones may use their own labels
+	InputChannels::Channel type;
+	if (!InputChannels::FromLabel(channel->label(), &type))
+	{
+		type = channel->reliable() ? InputChannels::RELIABLE : InputChannels::UNRELIABLE;
+	}
+
+	if (data_channels_[type])
+	{
+		LOG(WARNING) << "Ignoring data channel " << channel->label() <<
+			", " << InputChannels::Label(type) << " is already open";
+
+		return;
+	}
+
+	// channels we create are still connecting, so they're only attached once they open, as
+	// input meant for one is sent on the other until then
+	data_channels_[type] = channel;
+	channel_observers_[type].reset(new ChannelObserver(this, type));
+	channel->RegisterObserver(channel_observers_[type].get());
+	OnDataChannelStateChange(type);
+}
+
+void Conductor::OnDataChannelStateChange(InputChannels::Channel type)
+{
+	rtc::scoped_refptr<webrtc::DataChannelInterface> channel = data_channels_[type];
+	bool open = channel && channel->state() == webrtc::DataChannelInterface::kOpen;
+	if (open && !input_channels_.IsAttached(type))
+	{
+		input_channels_.Attach(type, [channel](const char* data, size_t size)
+		{
+			return channel->Send(webrtc::DataBuffer(rtc::CopyOnWriteBuffer(data, size), false));
+		});
+	}
+	else if (!open && input_channels_.IsAttached(type))
+	{
+		input_channels_.Detach(type);
+	}
+}
+
+void Conductor::OnDataChannelMessage(const webrtc::DataBuffer& buffer)
+{
+	auto data = reinterpret_cast<const char*>(buffer.data.data());
+	ServerLatency latency;
+	if (latency_tracker_ && LatencyReport::Decode(data, buffer.data.size(), &latency))
+	{
+		latency_tracker_->AddReport(latency);
+		return;
+	}
+
+	if (frame_metadata_callback_ && FrameMetadata::IsFrameMetadata(data, buffer.data.size()))
+	{
+		{
+			std::lock_guard<std::mutex> lock(frame_metadata_lock_);
+			frame_metadata_joiner_->AddMetadataMessage(data, buffer.data.size(), rtc::TimeMillis());
+		}
+
+		DeliverJoinedFrames();
+	}
+}
+
+void Conductor::SetFrameMetadataCallback(const FrameMetadataCallback& callback, int64_t max_wait_ms)
+{
+	std::lock_guard<std::mutex> lock(frame_metadata_lock_);
+	frame_metadata_callback_ = callback;
+	frame_metadata_max_wait_ms_ = max_wait_ms;
+	ResetFrameMetadataJoiner();
+}
+
+void Conductor::ResetFrameMetadataJoiner()
+{
+	FrameMetadataJoiner<webrtc::VideoFrame>::Options options;
+	options.max_wait = frame_metadata_max_wait_ms_;
+
+	joined_frames_.clear();
+	frame_metadata_joiner_.reset(new FrameMetadataJoiner<webrtc::VideoFrame>(
+		[this](const webrtc::VideoFrame& frame, const std::string* metadata)
+		{
+			JoinedFrame joined = { frame, metadata != nullptr, metadata ? *metadata : std::string() };
+			joined_frames_.push_back(joined);
+		},
+		options));
+}
+
+void Conductor::DeliverJoinedFrames()
+{
+	std::lock_guard<std::mutex> delivery_lock(frame_delivery_lock_);
+	std::vector<JoinedFrame> joined;
+	{
+		std::lock_guard<std::mutex> lock(frame_metadata_lock_);
+		joined.swap(joined_frames_);
+	}
+
+	for (const auto& frame : joined)
+	{
+		frame_metadata_callback_(frame.frame, frame.has_metadata ? &frame.metadata : nullptr);
+	}
+}
+
+void Conductor::AddRemoteTrackSink(webrtc::VideoTrackInterface* track)
+{
+	if (latency_tracker_ || frame_metadata_callback_)
+	{
+		remote_track_ = track;
+		remote_track_->AddOrUpdateSink(this, rtc::VideoSinkWants());
+	}
+}
+
+Conductor::ChannelObserver::ChannelObserver(Conductor* conductor, InputChannels::Channel channel) :
+	conductor_(conductor),
+	channel_(channel)
+{
+}
+
+void Conductor::ChannelObserver::OnStateChange()
+{
+	conductor_->OnDataChannelStateChange(channel_);
+}
+
+void Conductor::ChannelObserver::OnMessage(const webrtc::DataBuffer& buffer)
+{
+	conductor_->OnDataChannelMessage(buffer);
+}
+
+void Conductor::OnFrame(const webrtc::VideoFrame& frame)
+{
+	if (latency_tracker_)
+	{
+		latency_tracker_->FrameDecoded(frame.prediction_timestamp(), rtc::TimeMicros());
+	}
+
+	if (frame_metadata_callback_)
+	{
+		{
+			std::lock_guard<std::mutex> lock(frame_metadata_lock_);
+			frame_metadata_joiner_->AddFrame(frame.prediction_timestamp(), frame, rtc::TimeMillis());
+		}
+
+		DeliverJoinedFrames();
+	}
+}
+
+void Conductor::OnFramePresented(int64_t prediction_timestamp)
+{
+	if (latency_tracker_)
+	{
+		latency_tracker_->FramePresented(prediction_timestamp, rtc::TimeMicros());
+	}
 }
 
 void Conductor::OnIceCandidate(const webrtc::IceCandidateInterface* candidate)
@@ -564,10 +755,15 @@ void Conductor::ConnectToPeer(int peer_id)
 	if (InitializePeerConnection())
 	{
 		peer_id_ = peer_id;
-		webrtc::DataChannelInit config;
-		config.ordered = false;
-		config.maxRetransmits = 0;
-		data_channel_ = peer_connection_->CreateDataChannel(kInputDataChannelName, &config);
+		for (int i = 0; i < InputChannels::CHANNEL_COUNT; i++)
+		{
+			auto channel = static_cast<InputChannels::Channel>(i);
+			webrtc::DataChannelInit config;
+			config.ordered = InputChannels::IsOrdered(channel);
+			config.maxRetransmits = InputChannels::MaxRetransmits(channel);
+			AddDataChannel(peer_connection_->CreateDataChannel(InputChannels::Label(channel), &config));
+		}
+
 		peer_connection_->CreateOffer(this, NULL);
 	}
 	else
@@ -626,14 +822,13 @@ void Conductor::DisconnectFromCurrentPeer()
 
 bool Conductor::SendInputData(const std::string& message)
 {
-	if (data_channel_ && data_channel_->state() == webrtc::DataChannelInterface::kOpen)
+	uint32_t sequence;
+	if (latency_tracker_ && InputMessageCodec::DecodeSequence(message.data(), message.size(), &sequence))
 	{
-		webrtc::DataBuffer buffer(message);
-		data_channel_->Send(buffer);
-		return true;
+		latency_tracker_->InputSent(sequence, rtc::TimeMicros());
 	}
-	
-	return false;
+
+	return input_channels_.Send(message);
 }
 
 void Conductor::UIThreadCallback(int msg_id, void* data)
@@ -711,6 +906,7 @@ void Conductor::UIThreadCallback(int msg_id, void* data)
 			{
 				webrtc::VideoTrackInterface* track = tracks[0];
 				main_window_->StartRemoteRenderer(track);
+				AddRemoteTrackSink(track);
 			}
 
 			stream->Release();
@@ -10,7 +10,8 @@ const char kKeyboardEventMsgType[]				= "keyboard-event";
 const char kMouseEventMsgType[]					= "mouse-event";
 
 DataChannelHandler::DataChannelHandler(DataChannelCallback* data_channel_callback) :
-	data_channel_callback_(data_channel_callback)
+	data_channel_callback_(data_channel_callback),
+	camera_sequence_(0)
 {
 }
 
@@ -33,6 +34,7 @@ bool DataChannelHandler::SendCameraInput(
 	Json::Value jmessage;
 	jmessage["type"] = kCameraTransformLookAtMsgType;
 	jmessage["body"] = buffer;
+	jmessage["sequence"] = ++camera_sequence_;
 
 	return data_channel_callback_->SendInputData(writer.write(jmessage));
 }
@@ -48,6 +50,7 @@ bool DataChannelHandler::SendCameraInput(
 	Json::Value jmessage;
 	jmessage["type"] = kCameraTransformMsgType;
 	jmessage["body"] = buffer;
+	jmessage["sequence"] = ++camera_sequence_;
 
 	return data_channel_callback_->SendInputData(writer.write(jmessage));
 }
@@ -8,6 +8,7 @@
 
 #include "webrtc.h"
 #include "third_party/jsoncpp/source/include/json/json.h"
+#include "webrtc/rtc_base/logging.h"
 
 #include "client_main_window.h"
 #include "win32_data_channel_handler.h"
@@ -98,8 +99,18 @@ int WINAPI wWinMain(
 
 	Win32DataChannelHandler dcHandler(conductor.get());
 
+	// servers may attach data to their frames, which an app would use to draw over them
+	conductor->SetFrameMetadataCallback([](const webrtc::VideoFrame& frame, const std::string* metadata)
+	{
+		if (metadata)
+		{
+			LOG(LS_VERBOSE) << "Frame " << frame.prediction_timestamp() << " metadata: " << *metadata;
+		}
+	});
+
 	wnd.SignalClientWindowMessage.connect(&dcHandler, &Win32DataChannelHandler::ProcessMessage);
 	wnd.SignalDataChannelMessage.connect(&dcHandler, &Win32DataChannelHandler::ProcessMessage);
+	wnd.SignalFramePresented.connect(conductor.get(), &Conductor::OnFramePresented);
 
 	// set our client heartbeat interval
 	client.SetHeartbeatMs(webrtcConfig->heartbeat);
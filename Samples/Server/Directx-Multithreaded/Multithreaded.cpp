@@ -19,6 +19,10 @@
 #include "test_runner.h"
 #else // TEST_RUNNER
 #include "config_parser.h"
+#include "input_dispatcher.h"
+#include "input_message_codec.h"
+#include "latest_mailbox.h"
+#include "pose_predictor.h"
 #include "directx_multi_peer_conductor.h"
 #include "server_main_window.h"
 #include "server_renderer.h"
@@ -436,6 +440,12 @@ struct RemotePeerData
 	// The timestamp used for frame synchronization in stereo mode
 	int64_t							lastTimestamp;
 
+	// The newest camera transform from the network thread, not yet applied
+	PoseMailbox						poseMailbox;
+
+	// The camera transforms applied recently, to predict from when input is late
+	PosePredictor					posePredictor;
+
 	// The render texture which we use to render
 	ComPtr<ID3D11Texture2D>			renderTexture;
 
@@ -448,6 +458,10 @@ struct RemotePeerData
 	// The depth stencil view of the depth stencil texture
 	ComPtr<ID3D11DepthStencilView>	depthStencilView;
 
+	// The size rendered at, per eye in stereo
+	int								width;
+	int								height;
+
 	// Used for FPS limiter.
 	ULONGLONG						tick;
 
@@ -516,10 +530,54 @@ inline bool IsRenderDeferred()
 
 #ifndef TEST_RUNNER
 
+// Applies the newest camera transform published by the network thread, if there is one.
+// Otherwise, when the peer's input is more than a frame late, applies a predicted transform
+// so the stream keeps moving. A prediction keeps the newest timestamp the peer sent, which the
+// client matches to the next frame it's waiting on.
+void ApplyLatestPose(RemotePeerData* peerData, int interval)
+{
+	int64_t now = GetTickCount64();
+	CameraTransform transform;
+	if (peerData->poseMailbox.Consume(&transform))
+	{
+		if (transform.kind == CameraTransform::STEREO_PREDICTION &&
+			transform.timestamp == peerData->lastTimestamp)
+		{
+			return;
+		}
+
+		peerData->posePredictor.Add(transform, now);
+	}
+	else
+	{
+		auto lastReceived = peerData->posePredictor.LastReceived();
+		if (lastReceived < 0 || now - lastReceived < interval ||
+			now - static_cast<int64_t>(peerData->tick) < interval ||
+			!peerData->posePredictor.Predict(now, &transform))
+		{
+			return;
+		}
+	}
+
+	peerData->tick = now;
+	if (transform.kind == CameraTransform::STEREO_PREDICTION)
+	{
+		peerData->lastTimestamp = transform.timestamp;
+	}
+
+	peerData->projectionMatrixLeft = DirectX::XMFLOAT4X4(transform.projection_left);
+	peerData->viewMatrixLeft = DirectX::XMFLOAT4X4(transform.view_left);
+	peerData->projectionMatrixRight = DirectX::XMFLOAT4X4(transform.projection_right);
+	peerData->viewMatrixRight = DirectX::XMFLOAT4X4(transform.view_right);
+	peerData->isNew = true;
+}
+
 void InitializeRenderTexture(RemotePeerData* peerData, int width, int height, bool isStereo)
 {
 	int texWidth = isStereo ? width << 1 : width;
 	int texHeight = height;
+	peerData->width = width;
+	peerData->height = height;
 
 	// Creates the render texture.
 	D3D11_TEXTURE2D_DESC texDesc = { 0 };
@@ -563,6 +621,14 @@ void InitializeDepthStencilTexture(RemotePeerData* peerData, int width, int heig
 	DXUTGetD3D11Device()->CreateDepthStencilView(peerData->depthStencilTexture.Get(), &descDSV, &peerData->depthStencilView);
 }
 
+// Points the cameras at a render target of |width| by |height|, per eye in stereo
+void SetRenderViewport(int width, int height)
+{
+	auto viewports = g_CameraResources.GetViewport();
+	viewports[0] = CD3D11_VIEWPORT(0.0f, 0.0f, (float)width, (float)height);
+	viewports[1] = CD3D11_VIEWPORT((float)width, 0.0f, (float)width, (float)height);
+}
+
 bool AppMain(BOOL stopping)
 {
 	auto fullServerConfig = GlobalObject<FullServerConfig>::Get();
@@ -620,201 +686,107 @@ bool AppMain(BOOL stopping)
 	// Registers the handler.
 	wnd.RegisterObserver(&cond);
 
-	// Handles data channel messages.
-	std::function<void(int, const string&)> dataChannelMessageHandler([&](
-		int peerId,
-		const std::string& message)
+	// Finds the data for a remote peer, which the main loop creates once the peer is connected.
+	auto findPeerData = [&](int peerId)
+	{
+		auto it = g_remotePeersData.find(peerId);
+		return it == g_remotePeersData.end() ? std::shared_ptr<RemotePeerData>() : it->second;
+	};
+
+	// Creates the render targets once the peer says whether it renders in stereo. This creates
+	// device resources, so it's queued for the main loop.
+	cond.Dispatcher().Register("stereo-rendering", [&](const InputMessage& message)
 	{
-		// Returns if the remote peer data hasn't been initialized.
-		if (g_remotePeersData.find(peerId) == g_remotePeersData.end())
+		auto peerData = findPeerData(message.peer_id);
+		if (!peerData || peerData->renderTexture)
 		{
 			return;
 		}
 
-		char type[256];
-		char body[1024];
-		Json::Reader reader;
-		Json::Value msg = NULL;
-		reader.parse(message, msg, false);
-		std::shared_ptr<RemotePeerData> peerData = g_remotePeersData[peerId];
-		if (msg.isMember("type") && msg.isMember("body"))
+		peerData->isStereo = atoi(message.body.ToString().c_str()) == 1;
+		InitializeRenderTexture(
+			peerData.get(),
+			fullServerConfig->server_config->server_config.width,
+			fullServerConfig->server_config->server_config.height,
+			peerData->isStereo);
+
+		InitializeDepthStencilTexture(
+			peerData.get(),
+			fullServerConfig->server_config->server_config.width,
+			fullServerConfig->server_config->server_config.height,
+			peerData->isStereo);
+
+		DXUTSetNoSwapChainPresent(true);
+		if (!peerData->isStereo)
 		{
-			strcpy(type, msg.get("type", "").asCString());
-			strcpy(body, msg.get("body", "").asCString());
-			std::istringstream datastream(body);
-			std::string token;
-			if (strcmp(type, "stereo-rendering") == 0 && !peerData->renderTexture)
-			{
-				getline(datastream, token, ',');
-				peerData->isStereo = stoi(token) == 1;
-				InitializeRenderTexture(
-					peerData.get(),
-					fullServerConfig->server_config->server_config.width,
-					fullServerConfig->server_config->server_config.height,
-					peerData->isStereo);
-
-				InitializeDepthStencilTexture(
-					peerData.get(),
-					fullServerConfig->server_config->server_config.width,
-					fullServerConfig->server_config->server_config.height,
-					peerData->isStereo);
-
-				DXUTSetNoSwapChainPresent(true);
-				if (!peerData->isStereo)
-				{
-					peerData->eyeVector = s_vDefaultEye;
-					peerData->lookAtVector = s_vDefaultLookAt;
-					peerData->upVector = s_vDefaultUp;
-					peerData->tick = GetTickCount64();
-				}
-			}
-			else if (strcmp(type, "camera-transform-lookat") == 0)
-			{
-				// Eye point.
-				getline(datastream, token, ',');
-				float eyeX = stof(token);
-				getline(datastream, token, ',');
-				float eyeY = stof(token);
-				getline(datastream, token, ',');
-				float eyeZ = stof(token);
-
-				// Focus point.
-				getline(datastream, token, ',');
-				float focusX = stof(token);
-				getline(datastream, token, ',');
-				float focusY = stof(token);
-				getline(datastream, token, ',');
-				float focusZ = stof(token);
-
-				// Up vector.
-				getline(datastream, token, ',');
-				float upX = stof(token);
-				getline(datastream, token, ',');
-				float upY = stof(token);
-				getline(datastream, token, ',');
-				float upZ = stof(token);
-
-				peerData->lookAtVector = { focusX, focusY, focusZ, 0.f };
-				peerData->upVector = { upX, upY, upZ, 0.f };
-				peerData->eyeVector = { eyeX, eyeY, eyeZ, 0.f };
-				peerData->isNew = true;
-			}
-			else if (strcmp(type, "camera-transform-stereo") == 0)
-			{
-				// Parses the left projection matrix.
-				DirectX::XMFLOAT4X4 projectionMatrixLeft;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						projectionMatrixLeft.m[i][j] = stof(token);
-					}
-				}
-
-				// Parses the left view matrix.
-				DirectX::XMFLOAT4X4 viewMatrixLeft;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						viewMatrixLeft.m[i][j] = stof(token);
-					}
-				}
-
-				// Parses the right projection matrix.
-				DirectX::XMFLOAT4X4 projectionMatrixRight;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						projectionMatrixRight.m[i][j] = stof(token);
-					}
-				}
-
-				// Parses the right view matrix.
-				DirectX::XMFLOAT4X4 viewMatrixRight;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						viewMatrixRight.m[i][j] = stof(token);
-					}
-				}
-
-				peerData->projectionMatrixLeft = projectionMatrixLeft;
-				peerData->viewMatrixLeft = viewMatrixLeft;
-				peerData->projectionMatrixRight = projectionMatrixRight;
-				peerData->viewMatrixRight = viewMatrixRight;
-				peerData->isNew = true;
-			}
-			else if (strcmp(type, "camera-transform-stereo-prediction") == 0)
-			{
-				// Parses the left projection matrix.
-				DirectX::XMFLOAT4X4 projectionMatrixLeft;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						projectionMatrixLeft.m[i][j] = stof(token);
-					}
-				}
-
-				// Parses the left view matrix.
-				DirectX::XMFLOAT4X4 viewMatrixLeft;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						viewMatrixLeft.m[i][j] = stof(token);
-					}
-				}
-
-				// Parses the right projection matrix.
-				DirectX::XMFLOAT4X4 projectionMatrixRight;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						projectionMatrixRight.m[i][j] = stof(token);
-					}
-				}
+			peerData->eyeVector = s_vDefaultEye;
+			peerData->lookAtVector = s_vDefaultLookAt;
+			peerData->upVector = s_vDefaultUp;
+			peerData->tick = GetTickCount64();
+		}
+	}, InputDispatcher::QUEUED);
 
-				// Parses the right view matrix.
-				DirectX::XMFLOAT4X4 viewMatrixRight;
-				for (int i = 0; i < 4; i++)
-				{
-					for (int j = 0; j < 4; j++)
-					{
-						getline(datastream, token, ',');
-						viewMatrixRight.m[i][j] = stof(token);
-					}
-				}
+	// Handles the camera of a non-stereo peer, on the main loop which reads it.
+	cond.Dispatcher().Register("camera-transform-lookat", [&](const InputMessage& message)
+	{
+		auto peerData = findPeerData(message.peer_id);
+		if (!peerData)
+		{
+			return;
+		}
 
-				// Parses the prediction timestamp.
-				getline(datastream, token, ',');
-				int64_t timestamp = stoll(token);
-				if (timestamp != peerData->lastTimestamp)
-				{
-					peerData->lastTimestamp = timestamp;
-					peerData->projectionMatrixLeft = projectionMatrixLeft;
-					peerData->viewMatrixLeft = viewMatrixLeft;
-					peerData->projectionMatrixRight = projectionMatrixRight;
-					peerData->viewMatrixRight = viewMatrixRight;
-					peerData->isNew = true;
-				}
-			}
+		std::istringstream datastream(message.body.ToString());
+		std::string token;
+
+		// Eye point.
+		getline(datastream, token, ',');
+		float eyeX = stof(token);
+		getline(datastream, token, ',');
+		float eyeY = stof(token);
+		getline(datastream, token, ',');
+		float eyeZ = stof(token);
+
+		// Focus point.
+		getline(datastream, token, ',');
+		float focusX = stof(token);
+		getline(datastream, token, ',');
+		float focusY = stof(token);
+		getline(datastream, token, ',');
+		float focusZ = stof(token);
+
+		// Up vector.
+		getline(datastream, token, ',');
+		float upX = stof(token);
+		getline(datastream, token, ',');
+		float upY = stof(token);
+		getline(datastream, token, ',');
+		float upZ = stof(token);
+
+		peerData->lookAtVector = { focusX, focusY, focusZ, 0.f };
+		peerData->upVector = { upX, upY, upZ, 0.f };
+		peerData->eyeVector = { eyeX, eyeY, eyeZ, 0.f };
+		peerData->isNew = true;
+	}, InputDispatcher::QUEUED);
+
+	// Handles the camera of a stereo peer, which arrives every frame in binary or json. It's
+	// posted to the peer's mailbox, so the main loop only ever sees complete transforms.
+	auto cameraTransformHandler = [&](const InputMessage& message)
+	{
+		auto peerData = findPeerData(message.peer_id);
+		CameraTransform transform;
+		if (peerData && InputMessageCodec::Decode(message.data.data, message.data.size, &transform))
+		{
+			peerData->poseMailbox.Publish(transform);
 		}
-	});
+	};
 
-	// Sets data channel message handler.
-	cond.SetDataChannelMessageHandler(dataChannelMessageHandler);
+	cond.Dispatcher().Register(InputMessageCodec::TypeName(CameraTransform::STEREO), cameraTransformHandler);
+	cond.Dispatcher().Register(InputMessageCodec::TypeName(CameraTransform::STEREO_PREDICTION), cameraTransformHandler);
+
+	// Only the newest camera matters, so bursts of them are collapsed before they're parsed.
+	cond.Coalescer().Coalesce("camera-transform-lookat");
+	cond.Coalescer().Coalesce(InputMessageCodec::TypeName(CameraTransform::STEREO));
+	cond.Coalescer().Coalesce(InputMessageCodec::TypeName(CameraTransform::STEREO_PREDICTION));
 
 	// For system service, automatically connect to the signaling server.
 	if (fullServerConfig->server_config->server_config.system_service)
@@ -838,6 +810,9 @@ bool AppMain(BOOL stopping)
 		}
 		else
 		{
+			// Runs the input handlers queued for the main loop.
+			cond.Dispatcher().ProcessQueued();
+
 			for each (auto pair in cond.Peers())
 			{
 				auto peer = (DirectXPeerConductor*)pair.second.get();
@@ -884,6 +859,17 @@ bool AppMain(BOOL stopping)
 				}
 				else
 				{
+					// Renders at the size the peer last asked for, recreating the targets when it changes.
+					int width, height;
+					if (peer->encoder_control().resolution(&width, &height) &&
+						(width != peerData->width || height != peerData->height))
+					{
+						InitializeRenderTexture(peerData.get(), width, height, peerData->isStereo);
+						InitializeDepthStencilTexture(peerData.get(), width, height, peerData->isStereo);
+					}
+
+					SetRenderViewport(peerData->width, peerData->height);
+					ApplyLatestPose(peerData.get(), 1000 / nvEncConfig->capture_fps);
 					g_CameraResources.SetStereo(peerData->isStereo);
 					DXUTSetD3D11RenderTargetView(peerData->renderTargetView.Get());
 					DXUTSetD3D11DepthStencilView(peerData->depthStencilView.Get());
@@ -906,7 +892,7 @@ bool AppMain(BOOL stopping)
 						}
 					}
 					// In stereo rendering mode, we only update frame whenever
-					// receiving any input data.
+					// receiving any input data, or predicting it when it's late.
 					else if (peerData->isNew)
 					{
 						XMFLOAT4X4 id;
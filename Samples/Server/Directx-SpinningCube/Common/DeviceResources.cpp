@@ -232,3 +232,10 @@ void DeviceResources::SetStereo(bool enabled)
 	m_outputSize.cx = enabled ? m_outputSize.cx << 1 : m_outputSize.cx >> 1;
 	m_isStereo = enabled;
 }
+
+// Sets the viewports for a render target other than the swap chain's.
+void DeviceResources::SetViewport(int width, int height)
+{
+	m_screenViewport[0] = CD3D11_VIEWPORT(0.0f, 0.0f, (FLOAT)width, (FLOAT)height);
+	m_screenViewport[1] = CD3D11_VIEWPORT((FLOAT)width, 0.0f, (FLOAT)width, (FLOAT)height);
+}
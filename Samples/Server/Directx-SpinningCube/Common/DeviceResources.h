@@ -15,6 +15,9 @@ namespace DX
 		void										Present();
 		void										SetStereo(bool enabled);
 
+		// Points the viewports at a render target of |width| by |height|, per eye in stereo.
+		void										SetViewport(int width, int height);
+
 		// The size of the render target, in pixels.
 		SIZE										GetOutputSize() const;
 
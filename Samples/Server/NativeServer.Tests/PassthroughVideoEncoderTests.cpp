@@ -0,0 +1,185 @@
+#include <gtest\gtest.h>
+#include <memory>
+#include <vector>
+
+#include "passthrough_video_encoder.h"
+#include "replay_buffer_capturer.h"
+
+using namespace ::testing;
+using namespace StreamingToolkit;
+
+namespace
+{
+	// An SPS, a PPS and an IDR slice, each after a 4 byte start code, as an encoder writes a keyframe
+	const uint8_t kKeyframe[] =
+	{
+		0, 0, 0, 1, 0x67, 0x42, 0xe0, 0x1f, 0x8d,
+		0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80,
+		0, 0, 0, 1, 0x65, 0x88, 0x84, 0x00, 0x33, 0xff
+	};
+
+	// A single P slice after a 3 byte start code
+	const uint8_t kDeltaFrame[] = { 0, 0, 1, 0x41, 0x9a, 0x02, 0x04 };
+
+	RecordedFrame MakeRecordedFrame(const uint8_t* data, size_t size, bool keyframe)
+	{
+		RecordedFrame frame = { 0 };
+		frame.data = data;
+		frame.size = size;
+		frame.prediction_timestamp = 1234;
+		frame.keyframe = keyframe;
+		frame.width = 320;
+		frame.height = 240;
+		frame.qp = 30;
+		return frame;
+	}
+}
+
+// Keeps what the encoder last sent, as the packetizer would see it
+class EncodedImageCallbackFixture : public webrtc::EncodedImageCallback
+{
+public:
+	EncodedImageCallbackFixture() :
+		images(0),
+		data(nullptr),
+		size(0),
+		frame_type(webrtc::kEmptyFrame),
+		prediction_timestamp(-1),
+		packetization_mode(webrtc::H264PacketizationMode::SingleNalUnit)
+	{
+	}
+
+	Result OnEncodedImage(const webrtc::EncodedImage& image,
+		const webrtc::CodecSpecificInfo* codec_specific_info,
+		const webrtc::RTPFragmentationHeader* fragmentation) override
+	{
+		images++;
+		data = image._buffer;
+		size = image._length;
+		frame_type = image._frameType;
+		prediction_timestamp = image.prediction_timestamp_;
+		packetization_mode = codec_specific_info->codecSpecific.H264.packetization_mode;
+
+		offsets.clear();
+		lengths.clear();
+		for (size_t i = 0; i < fragmentation->fragmentationVectorSize; i++)
+		{
+			offsets.push_back(fragmentation->fragmentationOffset[i]);
+			lengths.push_back(fragmentation->fragmentationLength[i]);
+		}
+
+		return Result(Result::OK);
+	}
+
+	int images;
+	const uint8_t* data;
+	size_t size;
+	webrtc::FrameType frame_type;
+	int64_t prediction_timestamp;
+	webrtc::H264PacketizationMode packetization_mode;
+	std::vector<size_t> offsets;
+	std::vector<size_t> lengths;
+};
+
+class PassthroughVideoEncoderTests : public Test
+{
+protected:
+	PassthroughVideoEncoderTests() :
+		recording_(std::make_shared<StreamRecording>()),
+		replayer_(std::make_shared<StreamReplayer>(recording_.get(), [](const RecordedFrame&, int64_t) {}))
+	{
+		webrtc::VideoCodec codec;
+		codec.codecType = webrtc::kVideoCodecH264;
+		EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_.InitEncode(&codec, 1, 1200));
+		EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_.RegisterEncodeCompleteCallback(&callback_));
+	}
+
+	// A frame as ReplayBufferCapturer sends it, carrying the recorded bitstream
+	webrtc::VideoFrame MakeFrame(const RecordedFrame& recorded)
+	{
+		rtc::scoped_refptr<RecordedFrameBuffer> buffer(
+			new rtc::RefCountedObject<RecordedFrameBuffer>(recorded, recording_, replayer_));
+
+		webrtc::VideoFrame frame(buffer, webrtc::kVideoRotation_0, 0);
+		frame.set_prediction_timestamp(recorded.prediction_timestamp);
+		return frame;
+	}
+
+	int32_t Encode(const RecordedFrame& recorded, webrtc::FrameType type)
+	{
+		std::vector<webrtc::FrameType> frame_types(1, type);
+		return encoder_.Encode(MakeFrame(recorded), nullptr, &frame_types);
+	}
+
+	std::shared_ptr<StreamRecording> recording_;
+	std::shared_ptr<StreamReplayer> replayer_;
+	EncodedImageCallbackFixture callback_;
+	PassthroughVideoEncoder encoder_;
+};
+
+TEST_F(PassthroughVideoEncoderTests, PassthroughVideoEncoder_Encode_FragmentsByNalUnit)
+{
+	ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, Encode(MakeRecordedFrame(kKeyframe, sizeof(kKeyframe), true), webrtc::kVideoFrameKey));
+
+	// the recorded bitstream is sent as it is, with a fragment per nal unit after its start code
+	ASSERT_EQ(1, callback_.images);
+	EXPECT_EQ(kKeyframe, callback_.data);
+	EXPECT_EQ(sizeof(kKeyframe), callback_.size);
+	EXPECT_EQ(webrtc::kVideoFrameKey, callback_.frame_type);
+	EXPECT_EQ(1234, callback_.prediction_timestamp);
+	EXPECT_EQ(webrtc::H264PacketizationMode::NonInterleaved, callback_.packetization_mode);
+	EXPECT_EQ(std::vector<size_t>({ 4, 13, 21 }), callback_.offsets);
+	EXPECT_EQ(std::vector<size_t>({ 5, 4, 6 }), callback_.lengths);
+
+	// the header is reused for the next frame, which has fewer units and a shorter start code
+	ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, Encode(MakeRecordedFrame(kDeltaFrame, sizeof(kDeltaFrame), false), webrtc::kVideoFrameDelta));
+	ASSERT_EQ(2, callback_.images);
+	EXPECT_EQ(webrtc::kVideoFrameDelta, callback_.frame_type);
+	EXPECT_EQ(std::vector<size_t>({ 3 }), callback_.offsets);
+	EXPECT_EQ(std::vector<size_t>({ 4 }), callback_.lengths);
+}
+
+TEST_F(PassthroughVideoEncoderTests, PassthroughVideoEncoder_Encode_KeyframeRequest)
+{
+	// a keyframe asked for on a delta frame is the replayer's next one, and this frame is still sent
+	ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, Encode(MakeRecordedFrame(kDeltaFrame, sizeof(kDeltaFrame), false), webrtc::kVideoFrameKey));
+	EXPECT_EQ(1u, replayer_->stats().keyframe_requests);
+	EXPECT_EQ(1, callback_.images);
+	EXPECT_EQ(webrtc::kVideoFrameDelta, callback_.frame_type);
+
+	// nothing is asked of the replayer when the frame is a keyframe already, or none is wanted
+	ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, Encode(MakeRecordedFrame(kKeyframe, sizeof(kKeyframe), true), webrtc::kVideoFrameKey));
+	ASSERT_EQ(WEBRTC_VIDEO_CODEC_OK, Encode(MakeRecordedFrame(kDeltaFrame, sizeof(kDeltaFrame), false), webrtc::kVideoFrameDelta));
+	EXPECT_EQ(1u, replayer_->stats().keyframe_requests);
+	EXPECT_EQ(3, callback_.images);
+
+	// or when the replayer has gone
+	auto frame = MakeFrame(MakeRecordedFrame(kDeltaFrame, sizeof(kDeltaFrame), false));
+	replayer_.reset();
+	std::vector<webrtc::FrameType> frame_types(1, webrtc::kVideoFrameKey);
+	EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_.Encode(frame, nullptr, &frame_types));
+	EXPECT_EQ(4, callback_.images);
+}
+
+TEST_F(PassthroughVideoEncoderTests, PassthroughVideoEncoder_Encode_DropsFramesWithoutBitstream)
+{
+	// such as the black frames sent while a track is muted
+	auto black = webrtc::I420Buffer::Create(320, 240);
+	webrtc::I420Buffer::SetBlack(black);
+	webrtc::VideoFrame frame(black, webrtc::kVideoRotation_0, 0);
+	EXPECT_EQ(WEBRTC_VIDEO_CODEC_OK, encoder_.Encode(frame, nullptr, nullptr));
+	EXPECT_EQ(0, callback_.images);
+
+	// and nothing can be sent before a callback is registered
+	PassthroughVideoEncoder unregistered;
+	EXPECT_EQ(WEBRTC_VIDEO_CODEC_UNINITIALIZED,
+		unregistered.Encode(MakeFrame(MakeRecordedFrame(kKeyframe, sizeof(kKeyframe), true)), nullptr, nullptr));
+}
+
+TEST_F(PassthroughVideoEncoderTests, PassthroughVideoEncoder_InitEncode_OnlyH264)
+{
+	webrtc::VideoCodec codec;
+	codec.codecType = webrtc::kVideoCodecVP8;
+	EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERR_PARAMETER, encoder_.InitEncode(&codec, 1, 1200));
+	EXPECT_EQ(WEBRTC_VIDEO_CODEC_ERR_PARAMETER, encoder_.InitEncode(nullptr, 1, 1200));
+}
@@ -290,7 +290,7 @@ TEST(PeerConductorTests, PeerConductor_Alloc_Success)
 TEST(PeerConductorTests, PeerConductor_SDPGeneration_Success)
 {
 	auto expectedContents = std::string("test message contents");
-	auto expectedSdp = "{\n   \"password\" : \"\",\n   \"sdp\" : \"" + expectedContents + "\",\n   \"type\" : \"\",\n   \"uri\" : \"\",\n   \"username\" : \"\"\n}\n";
+	auto expectedSdp = "{\"type\":\"\",\"sdp\":\"" + expectedContents + "\",\"uri\":\"\",\"username\":\"\",\"password\":\"\"}";
 	auto wasSendFuncCalled = false;
 	auto mockSendFunc = [&](const std::string& message)
 	{
@@ -322,7 +322,7 @@ TEST(PeerConductorTests, PeerConductor_SDPGeneration_Success)
 TEST(PeerConductorTests, PeerConductor_ICEGeneration_Success)
 {
 	auto expectedContents = std::string("test message contents");
-	auto expectedIce = "{\n   \"candidate\" : \"" + expectedContents + "\",\n   \"sdpMLineIndex\" : 0,\n   \"sdpMid\" : \"\"\n}\n";
+	auto expectedIce = "{\"sdpMid\":\"\",\"sdpMLineIndex\":0,\"candidate\":\"" + expectedContents + "\"}";
 	auto wasSendFuncCalled = false;
 	auto mockSendFunc = [&](const std::string& message)
 	{
@@ -385,6 +385,46 @@ TEST(PeerConductorTests, PeerConductor_HandleMessage_CreateOffer)
 	ASSERT_TRUE(fixture->HandlePeerMessage(expectedIce));
 }
 
+TEST(PeerConductorTests, PeerConductor_HandleMessage_Binary)
+{
+	SignalingMessage message;
+	message.kind = SignalingMessage::ICE_CANDIDATE;
+	message.candidate = "candidate:4029998969 1 udp 41361151 40.69.184.50 50017 typ relay raddr 0.0.0.0 rport 0 generation 0 ufrag fKSq network-id 1 network-cost 50";
+	auto expectedContents = std::string("test message contents");
+	auto wasSendFuncCalled = false;
+	auto mockSendFunc = [&](const std::string& sent)
+	{
+		wasSendFuncCalled = true;
+		ASSERT_EQ(SignalingCodec::Detect(sent), SignalingCodec::BINARY);
+	};
+	auto factoryFixture = new rtc::RefCountedObject<PeerConnectionFactoryInterfaceFixture>();
+	auto connFixture = new rtc::RefCountedObject<PeerConnectionInterfaceFixture>();
+	auto fixture = new rtc::RefCountedObject<PeerConductorFixture>(factoryFixture, mockSendFunc);
+
+	fixture->Test_SetPeerConnection(connFixture);
+
+	EXPECT_CALL(*connFixture, AddIceCandidate(_))
+		.Times(Exactly(1))
+		.WillOnce(Return(true));
+
+	// simulate handing a binary msg
+	ASSERT_TRUE(fixture->HandlePeerMessage(SignalingCodec::Encode(message, SignalingCodec::BINARY)));
+
+	IceCandidateInterfaceFixture ice;
+
+	EXPECT_CALL(ice, ToString(_))
+		.Times(Exactly(1))
+		.WillOnce(Invoke([&](std::string* s) {
+			s->assign(expectedContents);
+			return true;
+		}));
+
+	// our own candidates are now sent in the format the peer used
+	fixture->OnIceCandidate(&ice);
+
+	ASSERT_TRUE(wasSendFuncCalled);
+}
+
 TEST(PeerConductorTests, PeerConductor_MultiPeer_Alloc_Success)
 {
 	auto factoryFixture = new rtc::RefCountedObject<PeerConnectionFactoryInterfaceFixture>();
@@ -0,0 +1,383 @@
+// Sweeps encoder parameters over synthetic or recorded frames without a GPU or a window, and
+// writes what each config achieved to a CSV, eg.
+//
+//   EncoderSweep --input session.y4m --bitrates 1000:1000:8000 --gops 0,60 --aq 0,1 --output sweep.csv
+//
+// or, to see what adapting to the content saves on a mix of scenes,
+//
+//   EncoderSweep --pattern text,moving-square,scrolling --bitrates 500:500:3000 --adaptive 0,1
+//
+// Each row names the backend that encoded it, nvenc or openh264.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <d3d11.h>
+#include <wrl/client.h>
+#endif
+
+#include "encoder_factory.h"
+#include "encoder_sweep.h"
+#include "frame_source.h"
+
+namespace
+{
+	const char kUsage[] =
+		"Usage: EncoderSweep [options]\n"
+		"  --input <file.y4m>         recorded 4:2:0 frames to encode, instead of a synthetic pattern\n"
+		"  --pattern <list>           moving-square, scrolling, noise or text, a list playing each in turn\n"
+		"                             for an equal share of the frames (scrolling)\n"
+		"  --size <width>x<height>    of the synthetic frames (1280x720)\n"
+		"  --fps <n>                  of the synthetic frames (60)\n"
+		"  --frames <n>               to encode per config, 0 for all the input has (300)\n"
+		"  --backend <name>           nvenc, software (OpenH264) or auto, NVENC if the driver loads (auto)\n"
+		"  --rate-control <name>      cbr, vbr or cqp (cbr)\n"
+		"  --bitrates <kbps list>     eg. 1000,2000 or 1000:500:4000 for a range (5000)\n"
+		"  --presets <list>           low-latency-hq, low-latency-hp, hq, hp, lossless (low-latency-hq)\n"
+		"  --gops <list>              frames between IDRs, 0 for none (0)\n"
+		"  --aq <list>                adaptive quantization, 0 or 1 (0)\n"
+		"  --adaptive <list>          adapt to the content, 0 or 1, printing the bits saved when both (0)\n"
+		"  --output <file.csv>        (encoder_sweep.csv)\n";
+
+	std::vector<std::string> Split(const std::string& value, char separator)
+	{
+		std::vector<std::string> parts;
+		std::istringstream in(value);
+		std::string part;
+		while (std::getline(in, part, separator))
+		{
+			parts.push_back(part);
+		}
+
+		return parts;
+	}
+
+	// Parses "a,b,c", or "first:step:last" when |ranges|, returning false if any isn't a number
+	bool ParseInts(const std::string& value, bool ranges, std::vector<int>* values)
+	{
+		values->clear();
+		for (const auto& item : Split(value, ','))
+		{
+			auto range = Split(item, ':');
+			std::vector<int> bounds;
+			for (const auto& bound : range)
+			{
+				char* end = nullptr;
+				auto number = strtol(bound.c_str(), &end, 10);
+				if (bound.empty() || *end != '\0')
+				{
+					return false;
+				}
+
+				bounds.push_back(static_cast<int>(number));
+			}
+
+			if (bounds.size() == 1)
+			{
+				values->push_back(bounds[0]);
+			}
+			else if (ranges && bounds.size() == 3 && bounds[1] > 0 && bounds[0] <= bounds[2])
+			{
+				for (auto number = bounds[0]; number <= bounds[2]; number += bounds[1])
+				{
+					values->push_back(number);
+				}
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return !values->empty();
+	}
+
+	bool ParseSize(const std::string& value, int* width, int* height)
+	{
+		auto parts = Split(value, 'x');
+		if (parts.size() != 2)
+		{
+			return false;
+		}
+
+		*width = atoi(parts[0].c_str());
+		*height = atoi(parts[1].c_str());
+		return *width > 0 && *height > 0;
+	}
+
+	bool ParseRateControl(const std::string& name, RateControl* rate_control)
+	{
+		for (auto candidate : { RateControl::kCbr, RateControl::kVbr, RateControl::kConstantQp })
+		{
+			if (name == RateControlName(candidate))
+			{
+				*rate_control = candidate;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string input;
+	std::vector<SyntheticPattern> patterns(1, SyntheticPattern::kScrolling);
+	std::vector<int> adaptive(1, 0);
+	int width = 1280;
+	int height = 720;
+	int fps = 60;
+	int frames = 300;
+	auto backend = EncoderBackendType::kAuto;
+	std::string output = "encoder_sweep.csv";
+	EncoderSweep::Options options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string name = argv[i];
+		if (name == "--help" || name == "-h")
+		{
+			std::cout << kUsage;
+			return 0;
+		}
+
+		if (i + 1 == argc)
+		{
+			std::cerr << "Missing a value for " << name << "\n" << kUsage;
+			return 1;
+		}
+
+		std::string value = argv[++i];
+		std::vector<int> numbers;
+		auto valid = true;
+		if (name == "--input")
+		{
+			input = value;
+		}
+		else if (name == "--pattern")
+		{
+			patterns.clear();
+			for (const auto& pattern_name : Split(value, ','))
+			{
+				SyntheticPattern pattern;
+				valid = valid && ParseSyntheticPattern(pattern_name, &pattern);
+				patterns.push_back(pattern);
+			}
+
+			valid = valid && !patterns.empty();
+		}
+		else if (name == "--size")
+		{
+			valid = ParseSize(value, &width, &height);
+		}
+		else if (name == "--fps")
+		{
+			fps = atoi(value.c_str());
+			valid = fps > 0;
+		}
+		else if (name == "--frames")
+		{
+			frames = atoi(value.c_str());
+			valid = frames >= 0;
+		}
+		else if (name == "--backend")
+		{
+			valid = ParseEncoderBackendType(value, &backend);
+		}
+		else if (name == "--rate-control")
+		{
+			valid = ParseRateControl(value, &options.base.rate_control);
+		}
+		else if (name == "--bitrates")
+		{
+			valid = ParseInts(value, true, &numbers);
+			options.bitrates_bps.clear();
+			for (auto kbps : numbers)
+			{
+				options.bitrates_bps.push_back(kbps * 1000);
+			}
+		}
+		else if (name == "--presets")
+		{
+			options.presets.clear();
+			for (const auto& preset_name : Split(value, ','))
+			{
+				EncoderPreset preset;
+				valid = valid && ParseEncoderPreset(preset_name, &preset);
+				options.presets.push_back(preset);
+			}
+		}
+		else if (name == "--gops")
+		{
+			valid = ParseInts(value, true, &options.gop_lengths);
+		}
+		else if (name == "--aq")
+		{
+			valid = ParseInts(value, false, &numbers);
+			options.adaptive_quantization.assign(numbers.begin(), numbers.end());
+		}
+		else if (name == "--adaptive")
+		{
+			valid = ParseInts(value, false, &adaptive);
+		}
+		else if (name == "--output")
+		{
+			output = value;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << name << "\n" << kUsage;
+			return 1;
+		}
+
+		if (!valid)
+		{
+			std::cerr << "Invalid value for " << name << ": " << value << "\n";
+			return 1;
+		}
+	}
+
+	std::unique_ptr<FrameSource> source;
+	if (input.empty())
+	{
+		auto total = frames > 0 ? frames : 300;
+		auto scene_frames = std::max(1, total / static_cast<int>(patterns.size()));
+		std::vector<std::unique_ptr<FrameSource>> scenes;
+		for (auto pattern : patterns)
+		{
+			scenes.emplace_back(new SyntheticFrameSource(width, height, scene_frames, pattern, fps));
+		}
+
+		source.reset(new SequenceFrameSource(std::move(scenes)));
+	}
+	else
+	{
+		std::unique_ptr<Y4mFrameSource> recording(new Y4mFrameSource());
+		if (!recording->Open(input))
+		{
+			std::cerr << "Can't read " << input << " as 4:2:0 YUV4MPEG2\n";
+			return 1;
+		}
+
+		source = std::move(recording);
+	}
+
+	std::ofstream csv(output, std::ios::trunc);
+	if (!csv.is_open())
+	{
+		std::cerr << "Can't create " << output << "\n";
+		return 1;
+	}
+
+	// NVENC sessions open on a D3D11 device, which is never rendered to, so the sweep needs no window
+	void* device = nullptr;
+#if defined(_WIN32)
+	Microsoft::WRL::ComPtr<ID3D11Device> d3d_device;
+	if (backend != EncoderBackendType::kSoftware &&
+		SUCCEEDED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0,
+			D3D11_SDK_VERSION, &d3d_device, nullptr, nullptr)))
+	{
+		device = d3d_device.Get();
+	}
+#endif
+
+	options.frames = frames;
+	auto factory = [backend, device]() { return CreateEncoderBackend(backend, device, NV_ENC_DEVICE_TYPE_DIRECTX); };
+	auto probe = factory();
+	if (!probe)
+	{
+		std::cerr << "No " << EncoderBackendTypeName(backend) << " encoder; NVENC needs an NVIDIA GPU and driver, " <<
+			"and OpenH264's library has to be beside EncoderSweep\n";
+		return 1;
+	}
+
+	std::cout << "Encoding with " << probe->name() << std::endl;
+	probe.reset();
+
+	std::vector<std::unique_ptr<EncoderSweep>> sweeps;
+	for (auto content_adaptive : adaptive)
+	{
+		options.content_adaptive = content_adaptive != 0;
+		sweeps.emplace_back(new EncoderSweep(source.get(), factory, options));
+	}
+
+	auto configs = sweeps[0]->Configs();
+	auto runs = configs.size() * sweeps.size();
+	std::cout << "Sweeping " << runs << " configs over " << source->width() << "x" <<
+		source->height() << " at " << source->fps() << "fps to " << output << std::endl;
+
+	EncoderSweep::WriteCsvHeader(csv);
+	auto failed = 0;
+	size_t run = 0;
+
+	// each sweep's results along the current rate-distortion curve
+	std::vector<std::vector<EncoderSweep::Result>> curves(sweeps.size());
+	for (size_t i = 0; i < configs.size(); i++)
+	{
+		for (size_t j = 0; j < sweeps.size(); j++)
+		{
+			auto result = sweeps[j]->Run(configs[i]);
+			EncoderSweep::WriteCsvRow(csv, result);
+			csv.flush();
+			curves[j].push_back(result);
+
+			std::cout << "[" << ++run << "/" << runs << "] " << EncoderPresetName(configs[i].preset) <<
+				" gop " << configs[i].gop_length << " aq " << configs[i].adaptive_quantization <<
+				(result.content_adaptive ? " adaptive" : "") << " at " << configs[i].bitrate_bps / 1000 << " kbps: ";
+			if (result.status != EncoderStatus::kOk)
+			{
+				failed++;
+				std::cout << EncoderStatusName(result.status) << std::endl;
+				continue;
+			}
+
+			std::cout << static_cast<int>(result.bitrate_bps / 1000) << " kbps, " << result.encode_ms << " ms/frame";
+			if (result.measured)
+			{
+				std::cout << ", " << result.quality.psnr << " dB, ssim " << result.quality.ssim << ", ms-ssim " << result.quality.ms_ssim;
+			}
+
+			if (result.content_adaptive)
+			{
+				std::cout << ", " << result.content_switches << " switches";
+			}
+
+			std::cout << std::endl;
+		}
+
+		// the bitrate varies fastest, so a curve ends where the bitrates do
+		if (curves[0].size() < options.bitrates_bps.size())
+		{
+			continue;
+		}
+
+		for (size_t j = 1; j < sweeps.size(); j++)
+		{
+			for (auto distortion : { EncoderSweep::Distortion::kPsnrY, EncoderSweep::Distortion::kSsimY })
+			{
+				double savings;
+				if (EncoderSweep::BitrateSavings(curves[0], curves[j], distortion, &savings))
+				{
+					std::cout << (curves[j][0].content_adaptive ? "Adapting to the content" : "Not adapting") << " saves " <<
+						savings * 100 << "% of the bits at equal luma " <<
+						(distortion == EncoderSweep::Distortion::kSsimY ? "SSIM" : "PSNR") << std::endl;
+				}
+			}
+		}
+
+		for (auto& curve : curves)
+		{
+			curve.clear();
+		}
+	}
+
+	return failed == 0 ? 0 : 2;
+}
@@ -4,21 +4,80 @@
 #pragma warning(disable : 4100)
 
 #include "pch.h"
-#include "nvFileIO.h"
-#include "nvUtils.h"
 #include "VideoTestRunner.h"
+#include <algorithm>
 #include <string>
 
 using namespace StreamingToolkit;
 
+namespace
+{
+	// Converts a frame of 8-bit RGBA, or BGRA if |bgra|, to BT.601 I420.
+	void RgbaToI420(const uint8_t* rgba, int stride, bool bgra, I420Frame* frame)
+	{
+		const int red = bgra ? 2 : 0;
+		const int blue = bgra ? 0 : 2;
+		for (int y = 0; y < frame->height(); y++)
+		{
+			const uint8_t* row = rgba + y * stride;
+			uint8_t* luma = frame->data(0) + y * frame->PlaneWidth(0);
+			for (int x = 0; x < frame->width(); x++)
+			{
+				const uint8_t* pixel = row + x * 4;
+				luma[x] = static_cast<uint8_t>(((66 * pixel[red] + 129 * pixel[1] + 25 * pixel[blue] + 128) >> 8) + 16);
+			}
+		}
+
+		// each chroma sample is the average of the pixels it covers
+		for (int y = 0; y < frame->PlaneHeight(1); y++)
+		{
+			uint8_t* u = frame->data(1) + y * frame->PlaneWidth(1);
+			uint8_t* v = frame->data(2) + y * frame->PlaneWidth(2);
+			for (int x = 0; x < frame->PlaneWidth(1); x++)
+			{
+				int r = 0, g = 0, b = 0, count = 0;
+				for (int dy = 0; dy < 2 && y * 2 + dy < frame->height(); dy++)
+				{
+					for (int dx = 0; dx < 2 && x * 2 + dx < frame->width(); dx++)
+					{
+						const uint8_t* pixel = rgba + (y * 2 + dy) * stride + (x * 2 + dx) * 4;
+						r += pixel[red];
+						g += pixel[1];
+						b += pixel[blue];
+						count++;
+					}
+				}
+
+				r /= count;
+				g /= count;
+				b /= count;
+				u[x] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				v[x] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+	}
+}
+
 // Constructor for VideoTestRunner.
-VideoTestRunner::VideoTestRunner(ID3D11Device* device, ID3D11DeviceContext* context) :
+VideoTestRunner::VideoTestRunner(ID3D11Device* device, ID3D11DeviceContext* context, EncoderBackendType backend) :
 	m_d3dDevice(device),
 	m_d3dContext(context),
-	m_initialized(false),
-	m_encoderCreated(false)
+	m_swapChain(nullptr),
+	m_backendType(backend),
+	m_encoderCreated(false),
+	m_output(nullptr),
+	m_stagingTexture(nullptr),
+	m_format(DXGI_FORMAT_UNKNOWN),
+	m_startFrameIdx(0),
+	m_endFrameIdx(0),
+	m_lastTest(false),
+	m_testSuiteComplete(false),
+	m_testRunComplete(false),
+	m_currentSuite(0),
+	m_currentFrame(0),
+	m_initialized(false)
 {
-	if (!m_initialized) 
+	if (!m_initialized)
 	{
 		m_initialized = true;
 
@@ -30,59 +89,60 @@ VideoTestRunner::VideoTestRunner(ID3D11Device* device, ID3D11DeviceContext* cont
 		multithread->Release();
 #endif // MULTITHREAD_PROTECTION
 
-		m_pNvHWEncoder = new CNvHWEncoder();
+		m_encoder = CreateEncoderBackend(m_backendType, m_d3dDevice, NV_ENC_DEVICE_TYPE_DIRECTX);
+		if (!m_encoder)
+		{
+			fprintf(stderr, "No %s encoder, so there's nothing to test\n", EncoderBackendTypeName(m_backendType));
+		}
+
 		m_encoderCreated = false;
 		m_lastTest = false;
 	}
-	else 
-	{
-		return;
-	}
 }
 
 // Destructor for VideoHelper.
 VideoTestRunner::~VideoTestRunner()
 {
-	if (m_pNvHWEncoder)
+	if (m_encoder)
 	{
 		m_initialized = false;
 		Deinitialize();
-		delete m_pNvHWEncoder;
-		m_pNvHWEncoder = NULL;
 	}
 }
 
 // Cleanup resources.
-NVENCSTATUS VideoTestRunner::Deinitialize()
+void VideoTestRunner::Deinitialize()
 {
-	NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
 	FlushEncoder();
 	ReleaseIOBuffers();
-	nvStatus = m_pNvHWEncoder->NvEncDestroyEncoder();
-	return nvStatus;
+	m_encoder->Shutdown();
+	if (m_output)
+	{
+		fclose(m_output);
+		m_output = nullptr;
+	}
 }
 
-void VideoTestRunner::StartTestRunner(IDXGISwapChain* swapChain) 
+void VideoTestRunner::StartTestRunner(IDXGISwapChain* swapChain)
 {
-	//Simple check to allow TestRunner to act as singleton for multithreaded renderers
-	//if (m_initialized)
-	//{
-	//	return;
-	//}
-
 	m_initialized = true;
 	m_testSuiteComplete = false;
-	m_testRunComplete = false;
+	m_testRunComplete = !m_encoder;
 	m_currentSuite = 0;
 	m_swapChain = swapChain;
 
-	memset(&m_encodeConfig, 0, sizeof(EncodeConfig));
-	memset(&m_minEncodeConfig, 0, sizeof(EncodeConfig));
-	memset(&m_stepEncodeConfig, 0, sizeof(EncodeConfig));
-	memset(&m_maxEncodeConfig, 0, sizeof(EncodeConfig));
+	m_encodeConfig = EncoderConfig();
+	m_minEncodeConfig = EncoderConfig();
+	m_stepEncodeConfig = EncoderConfig();
+	m_maxEncodeConfig = EncoderConfig();
 
 	m_currentFrame = 0;
 	m_lastTest = false;
+	if (m_testRunComplete)
+	{
+		return;
+	}
+
 	GetDefaultEncodeConfig();
 	m_minEncodeConfig = m_encodeConfig;
 
@@ -91,58 +151,39 @@ void VideoTestRunner::StartTestRunner(IDXGISwapChain* swapChain)
 
 void VideoTestRunner::InitializeTest()
 {
-	m_encodeConfig.outputFileName = m_fileName;
 	if (!m_encoderCreated)
 	{
-		InitializeEncoder();
+		m_encoderCreated = InitializeEncoder();
 	}
-
-	m_encoderCreated = true;
 }
 
-NVENCSTATUS VideoTestRunner::InitializeEncoder()
+bool VideoTestRunner::InitializeEncoder()
 {
-	if (m_encodeConfig.outputFileName)
+	auto status = m_encoder->Initialize(m_encodeConfig);
+	if (status != EncoderStatus::kOk)
 	{
-		m_encodeConfig.fOutput = fopen(m_encodeConfig.outputFileName, "wb");
-		if (m_encodeConfig.fOutput == NULL)
-		{
-			PRINTERR("Failed to create \"%s\"\n", m_encodeConfig.outputFileName);
-		}
+		// the test's file is still written, empty, so the run moves on to the next config
+		fprintf(stderr, "%s can't encode %s: %s\n", m_encoder->name(), m_fileName.c_str(), EncoderStatusName(status));
 	}
 
-	//NV_ENC_H264_PROFILE_HIGH_444_GUID
-	SetEncodeProfile(1);
-
-	m_pNvHWEncoder->Initialize((void*)m_d3dDevice, NV_ENC_DEVICE_TYPE_DIRECTX);
-
-	m_encodeConfig.presetGUID = m_pNvHWEncoder->GetPresetGUID(m_encodeConfig.encoderPreset, m_encodeConfig.codec);
-
-	//H264 level sets maximum bitrate limits.  4.1 supported by almost all mobile devices.
-	m_pNvHWEncoder->m_stEncodeConfig.encodeCodecConfig.h264Config.level = NV_ENC_LEVEL_H264_41;
-
-	//Specific mandatory settings for LOSSLESS encoding presets
-	if (m_encodeConfig.presetGUID == NV_ENC_PRESET_LOSSLESS_DEFAULT_GUID ||
-		m_encodeConfig.presetGUID == NV_ENC_PRESET_LOSSLESS_HP_GUID)
+	m_output = fopen(m_fileName.c_str(), "wb");
+	if (m_output == NULL)
 	{
-		m_encodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
-		m_pNvHWEncoder->m_stEncodeConfig.profileGUID = NV_ENC_H264_PROFILE_HIGH_444_GUID;
-		m_pNvHWEncoder->m_stEncodeConfig.encodeCodecConfig.h264Config.qpPrimeYZeroTransformBypassFlag = 1;
+		fprintf(stderr, "Failed to create \"%s\"\n", m_fileName.c_str());
 	}
 
-	// Creates the encoder.
-	m_pNvHWEncoder->CreateEncoder(&m_encodeConfig);
-
-	m_uEncodeBufferCount = m_encodeConfig.numB + 4;
-
-	AllocateIOBuffers();
+	if (status != EncoderStatus::kOk || !AllocateIOBuffers())
+	{
+		m_encoder->Shutdown();
+		return false;
+	}
 
-	return NV_ENC_SUCCESS;
+	return true;
 }
 
 void VideoTestRunner::GetDefaultEncodeConfig()
 {
-	m_encodeConfig.outputFileName = m_fileName = "lossless.h264";
+	m_fileName = std::string(m_encoder->name()) + "-lossless.h264";
 
 	// Gets the swap chain desc.
 	DXGI_SWAP_CHAIN_DESC swapChainDesc;
@@ -150,289 +191,157 @@ void VideoTestRunner::GetDefaultEncodeConfig()
 	m_encodeConfig.width = swapChainDesc.BufferDesc.Width;
 	m_encodeConfig.height = swapChainDesc.BufferDesc.Height;
 
-	//Unused by nvEncode.
-	m_encodeConfig.endFrameIdx = INT_MAX;
-	m_encodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
-	m_encodeConfig.encoderPreset = "lossless";
+	m_encodeConfig.rate_control = RateControl::kConstantQp;
+	m_encodeConfig.preset = EncoderPreset::kLossless;
 
 	//Infinite needed for low latency encoding.
-	m_encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
+	m_encodeConfig.gop_length = 0;
 
-	//Unused by nvEncode.
-	m_encodeConfig.startFrameIdx = 0;
+	m_startFrameIdx = 0;
 #ifdef _DEBUG
-	m_encodeConfig.endFrameIdx = 300;
+	m_endFrameIdx = 300;
 #else // _DEBUG
-	m_encodeConfig.endFrameIdx = 1000;
+	m_endFrameIdx = 1000;
 #endif // _DEBUG
 
-	//DeviceType 1 = Force CUDA.
-	m_encodeConfig.deviceType = 0;
-
-	//Only supported codec for WebRTC.
-	m_encodeConfig.codec = NV_ENC_H264;
 	m_encodeConfig.fps = 60;
 
 	//In bits per second - ignored for lossless presets.
-	m_encodeConfig.bitrate = 1032517;
+	m_encodeConfig.bitrate_bps = 1032517;
 
 	//Quantization Parameter - must be 0 for lossless.
 	m_encodeConfig.qp = 0;
-
-	//Must be set to frame.
-	m_encodeConfig.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
-
-	//Initial QP factors for bitrate spinup.
-	m_encodeConfig.i_quant_factor = DEFAULT_I_QFACTOR;
-	m_encodeConfig.b_quant_factor = DEFAULT_B_QFACTOR;
-	m_encodeConfig.i_quant_offset = DEFAULT_I_QOFFSET;
-	m_encodeConfig.b_quant_offset = DEFAULT_B_QOFFSET;
-	m_encodeConfig.intraRefreshEnableFlag = true;
-	m_encodeConfig.intraRefreshPeriod = 30;
-	m_encodeConfig.intraRefreshDuration = 3;
-
-	// Enable temporal Adaptive Quantization
-	// Shifts quantization matrix based on complexity of frame over time
-	m_encodeConfig.enableTemporalAQ = false;
-
-	//Need this to be able to recover from stream drops
-	//Client needs to send back a last good timestamp, and we call
-	//NvEncInvalidateRefFrames(encoder,timestamp) to reissue I frame
-	m_encodeConfig.invalidateRefFramesEnableFlag = true;
 }
 
 // Captures frame buffer from the swap chain.
 void VideoTestRunner::Capture()
 {
-	// Try to process the pending input buffers.
-	NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
-	EncodeBuffer* pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
-
-	if (!pEncodeBuffer)
-	{
-		pEncodeBuffer = m_EncodeBufferQueue.GetPending();
-		m_pNvHWEncoder->ProcessOutput(pEncodeBuffer);
-
-		// UnMap the input buffer after frame done
-		if (pEncodeBuffer->stInputBfr.hInputSurface)
-		{
-			nvStatus = m_pNvHWEncoder->NvEncUnmapInputResource(pEncodeBuffer->stInputBfr.hInputSurface);
-			pEncodeBuffer->stInputBfr.hInputSurface = NULL;
-		}
-
-		pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
-	}
-
 	ID3D11Texture2D* frameBuffer = nullptr;
 	HRESULT hr = m_swapChain->GetBuffer(0,
 		__uuidof(ID3D11Texture2D),
 		reinterpret_cast<void**>(&frameBuffer));
 
-	// Copies the frame buffer to the encode input buffer.
-	m_d3dContext->CopyResource(pEncodeBuffer->stInputBfr.pARGBSurface, frameBuffer);
+	if (FAILED(hr))
+	{
+		return;
+	}
+
+	// Copies the frame buffer to where it can be read back.
+	m_d3dContext->CopyResource(m_stagingTexture, frameBuffer);
 	frameBuffer->Release();
-	nvStatus = m_pNvHWEncoder->NvEncMapInputResource(pEncodeBuffer->stInputBfr.nvRegisteredResource, &pEncodeBuffer->stInputBfr.hInputSurface);
-	if (nvStatus != NV_ENC_SUCCESS)
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	hr = m_d3dContext->Map(m_stagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
+	if (FAILED(hr))
 	{
-		PRINTERR("Failed to Map input buffer %p\n", pEncodeBuffer->stInputBfr.hInputSurface);
+		fprintf(stderr, "Failed to read back frame %d\n", m_currentFrame);
 		return;
 	}
 
-	// Encoding.
-	if (SUCCEEDED(hr))
+	RgbaToI420(static_cast<const uint8_t*>(mapped.pData),
+		mapped.RowPitch,
+		m_format == DXGI_FORMAT_B8G8R8A8_UNORM,
+		&m_frame);
+
+	m_d3dContext->Unmap(m_stagingTexture, 0);
+
+	// Makes room for the frame, writing whatever's finished encoding.
+	if (m_encoder->pending() >= static_cast<size_t>(m_encodeConfig.queue_depth))
 	{
-		nvStatus = m_pNvHWEncoder->NvEncEncodeFrame(pEncodeBuffer, NULL, m_encodeConfig.width, m_encodeConfig.height);
-		if (nvStatus != NV_ENC_SUCCESS  && nvStatus != NV_ENC_ERR_NEED_MORE_INPUT)
-		{
-			return;
-		}
+		WriteOutput(-1);
+	}
+
+	EncodeParams params;
+	params.timestamp_us = m_currentFrame * 1000000LL / m_encodeConfig.fps;
+	auto status = m_encoder->Submit(m_frame, params);
+	if (status != EncoderStatus::kOk)
+	{
+		fprintf(stderr, "Failed to encode frame %d: %s\n", m_currentFrame, EncoderStatusName(status));
 	}
 }
 
-NVENCSTATUS VideoTestRunner::AllocateIOBuffers()
+bool VideoTestRunner::AllocateIOBuffers()
 {
-	ID3D11Texture2D* pVPSurfaces[16];
-
 	// Gets the swap chain desc.
 	DXGI_SWAP_CHAIN_DESC swapChainDesc;
 	m_swapChain->GetDesc(&swapChainDesc);
 
-	// Initializes the encode buffer queue.
-	m_EncodeBufferQueue.Initialize(m_stEncodeBuffer, m_uEncodeBufferCount);
-
 	// Finds the suitable format for buffer.
-	DXGI_FORMAT format = swapChainDesc.BufferDesc.Format;
-	if (format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+	m_format = swapChainDesc.BufferDesc.Format;
+	if (m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
 	{
-		format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		m_format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	}
-	else if (format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
+	else if (m_format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
 	{
-		format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		m_format = DXGI_FORMAT_B8G8R8A8_UNORM;
 	}
 
-	for (uint32_t i = 0; i < m_uEncodeBufferCount; i++)
+	if (m_format != DXGI_FORMAT_R8G8B8A8_UNORM && m_format != DXGI_FORMAT_B8G8R8A8_UNORM)
 	{
-		// Initializes the input buffer, backed by ID3D11Texture2D*.
-		D3D11_TEXTURE2D_DESC desc = { 0 };
-		desc.ArraySize = 1;
-		desc.Format = format;
-		desc.Width = m_encodeConfig.width;
-		desc.Height = m_encodeConfig.height;
-		desc.MipLevels = 1;
-		desc.SampleDesc.Count = 1;
-		desc.Usage = D3D11_USAGE_DEFAULT;
-		m_d3dDevice->CreateTexture2D(&desc, nullptr, &pVPSurfaces[i]);
-
-		// Registers the input buffer with NvEnc.
-		CHECK_NV_FAILED(m_pNvHWEncoder->NvEncRegisterResource(
-			NV_ENC_INPUT_RESOURCE_TYPE_DIRECTX,
-			(void*)pVPSurfaces[i],
-			m_encodeConfig.width,
-			m_encodeConfig.height,
-			m_stEncodeBuffer[i].stInputBfr.uARGBStride,
-			&m_stEncodeBuffer[i].stInputBfr.nvRegisteredResource));
-
-		// Maps the buffer format to the relevant NvEnc encoder format
-		switch (format)
-		{
-		case DXGI_FORMAT_B8G8R8A8_UNORM:
-			m_stEncodeBuffer[i].stInputBfr.bufferFmt = NV_ENC_BUFFER_FORMAT_ARGB;
-			break;
-
-		case DXGI_FORMAT_R10G10B10A2_UNORM:
-			if (m_pNvHWEncoder->m_stEncodeConfig.encodeCodecConfig.h264Config.qpPrimeYZeroTransformBypassFlag == 1)
-				m_stEncodeBuffer[i].stInputBfr.bufferFmt = NV_ENC_BUFFER_FORMAT_YUV444_10BIT;
-			else
-				m_stEncodeBuffer[i].stInputBfr.bufferFmt = NV_ENC_BUFFER_FORMAT_YUV420_10BIT;
-			break;
-
-		default:
-			m_stEncodeBuffer[i].stInputBfr.bufferFmt = NV_ENC_BUFFER_FORMAT_ABGR;
-			break;
-		}
-
-		m_stEncodeBuffer[i].stInputBfr.dwWidth = m_encodeConfig.width;
-		m_stEncodeBuffer[i].stInputBfr.dwHeight = m_encodeConfig.height;
-		m_stEncodeBuffer[i].stInputBfr.pARGBSurface = pVPSurfaces[i];
-
-		// Initializes the output buffer.
-		CHECK_NV_FAILED(m_pNvHWEncoder->NvEncCreateBitstreamBuffer(BITSTREAM_BUFFER_SIZE, &m_stEncodeBuffer[i].stOutputBfr.hBitstreamBuffer));
-		m_stEncodeBuffer[i].stOutputBfr.dwBitstreamBufferSize = BITSTREAM_BUFFER_SIZE;
-
-		// Registers for the output event.
-		CHECK_NV_FAILED(m_pNvHWEncoder->NvEncRegisterAsyncEvent(&m_stEncodeBuffer[i].stOutputBfr.hOutputEvent));
-		m_stEncodeBuffer[i].stOutputBfr.bWaitOnEvent = true;
+		fprintf(stderr, "Only 8-bit RGBA and BGRA swap chains can be encoded\n");
+		return false;
 	}
 
-	m_stEOSOutputBfr.bEOSFlag = TRUE;
-
-	// Registers for the output event.
-	CHECK_NV_FAILED(m_pNvHWEncoder->NvEncRegisterAsyncEvent(&m_stEOSOutputBfr.hOutputEvent));
-
-	return NV_ENC_SUCCESS;
-}
-
-NVENCSTATUS VideoTestRunner::SetEncodeProfile(int profileIndex)
-{
-	GUID choice;
-	switch (profileIndex)
+	// Initializes the read back buffer, which the CPU converts to I420.
+	D3D11_TEXTURE2D_DESC desc = { 0 };
+	desc.ArraySize = 1;
+	desc.Format = m_format;
+	desc.Width = m_encodeConfig.width;
+	desc.Height = m_encodeConfig.height;
+	desc.MipLevels = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	if (FAILED(m_d3dDevice->CreateTexture2D(&desc, nullptr, &m_stagingTexture)))
 	{
-		//Main should be used for most cases
-		case 1:
-			choice = NV_ENC_H264_PROFILE_MAIN_GUID;
-			break;
-
-			//High 444 is only for lossless encode profile
-		case 2:
-			choice = NV_ENC_PRESET_LOW_LATENCY_HQ_GUID;
-			break;
-
-			//Enables stereo frame packing
-		case 3:
-			choice = NV_ENC_H264_PROFILE_STEREO_GUID;
-			break;
-
-			//Fallback to auto, avoid this.
-		case 0:
-		default: choice = NV_ENC_CODEC_PROFILE_AUTOSELECT_GUID;
-			break;
+		return false;
 	}
 
-	m_pNvHWEncoder->m_stEncodeConfig.profileGUID = choice;
-	return NV_ENC_SUCCESS;
+	m_frame.Allocate(m_encodeConfig.width, m_encodeConfig.height);
+	return true;
 }
 
-NVENCSTATUS VideoTestRunner::ReleaseIOBuffers()
+void VideoTestRunner::ReleaseIOBuffers()
 {
-	for (uint32_t i = 0; i < m_uEncodeBufferCount; i++)
-	{
-		SAFE_RELEASE(m_stEncodeBuffer[i].stInputBfr.pARGBSurface);
-
-		m_pNvHWEncoder->NvEncDestroyBitstreamBuffer(m_stEncodeBuffer[i].stOutputBfr.hBitstreamBuffer);
-		m_stEncodeBuffer[i].stOutputBfr.hBitstreamBuffer = NULL;
-
-		m_pNvHWEncoder->NvEncUnregisterAsyncEvent(m_stEncodeBuffer[i].stOutputBfr.hOutputEvent);
-		CloseHandle(m_stEncodeBuffer[i].stOutputBfr.hOutputEvent);
-		m_stEncodeBuffer[i].stOutputBfr.hOutputEvent = NULL;
-	}
-
-	if (m_stEOSOutputBfr.hOutputEvent)
-	{
-		m_pNvHWEncoder->NvEncUnregisterAsyncEvent(m_stEOSOutputBfr.hOutputEvent);
-		CloseHandle(m_stEOSOutputBfr.hOutputEvent);
-		m_stEOSOutputBfr.hOutputEvent = NULL;
-	}
-
-	return NV_ENC_SUCCESS;
+	SAFE_RELEASE(m_stagingTexture);
 }
 
-NVENCSTATUS VideoTestRunner::FlushEncoder()
+void VideoTestRunner::WriteOutput(int timeout_ms)
 {
-	NVENCSTATUS nvStatus = m_pNvHWEncoder->NvEncFlushEncoderQueue(m_stEOSOutputBfr.hOutputEvent);
-	if (nvStatus != NV_ENC_SUCCESS)
+	auto status = m_encoder->Retrieve(&m_encodedFrame, timeout_ms);
+	if (status == EncoderStatus::kOk && m_output)
 	{
-		assert(0);
-		return nvStatus;
+		fwrite(m_encodedFrame.data.data(), 1, m_encodedFrame.data.size(), m_output);
 	}
-
-	EncodeBuffer *pEncodeBuffer = m_EncodeBufferQueue.GetPending();
-	while (pEncodeBuffer)
+	else if (status != EncoderStatus::kOk && status != EncoderStatus::kTimeout)
 	{
-		m_pNvHWEncoder->ProcessOutput(pEncodeBuffer);
-		pEncodeBuffer = m_EncodeBufferQueue.GetPending();
-
-		// UnMap the input buffer after frame is done.
-		if (pEncodeBuffer && pEncodeBuffer->stInputBfr.hInputSurface)
-		{
-			nvStatus = m_pNvHWEncoder->NvEncUnmapInputResource(pEncodeBuffer->stInputBfr.hInputSurface);
-			pEncodeBuffer->stInputBfr.hInputSurface = NULL;
-		}
+		fprintf(stderr, "Lost a frame of %s: %s\n", m_fileName.c_str(), EncoderStatusName(status));
 	}
+}
 
-	if (WaitForSingleObject(m_stEOSOutputBfr.hOutputEvent, 500) != WAIT_OBJECT_0)
+void VideoTestRunner::FlushEncoder()
+{
+	while (m_encoder->pending() > 0)
 	{
-		assert(0);
-		nvStatus = NV_ENC_ERR_GENERIC;
+		WriteOutput(-1);
 	}
-
-	return nvStatus;
 }
 
-void VideoTestRunner::TestCapture() 
+void VideoTestRunner::TestCapture()
 {
-	if (m_encoderCreated) 
+	if (m_encoderCreated)
 	{
-		if (m_currentFrame >= m_encodeConfig.startFrameIdx)
+		if (m_currentFrame >= m_startFrameIdx)
 		{
-			if (m_currentFrame < m_encodeConfig.endFrameIdx) 
+			if (m_currentFrame < m_endFrameIdx)
 			{
 				Capture();
 			}
-			else 
+			else
 			{
 				m_currentFrame = 0;
-				if (m_lastTest) 
+				if (m_lastTest)
 				{
 					IncrementTestSuite();
 					return;
@@ -447,99 +356,94 @@ void VideoTestRunner::TestCapture()
 	}
 }
 
-void VideoTestRunner::IncrementTest() 
+void VideoTestRunner::IncrementTest()
 {
-	if (!access(m_fileName, 0) == 0) 
+	if (!access(m_fileName.c_str(), 0) == 0)
 	{
-		if (m_encoderCreated) 
+		if (m_encoderCreated)
 		{
 			Deinitialize();
 			m_encoderCreated = false;
 		}
 
 		InitializeTest();
+		if (!m_encoderCreated)
+		{
+			// nothing to capture for a config the backend refused, whose empty file marks it done
+			bool skipped = m_output != nullptr;
+			Deinitialize();
+			if (!skipped)
+			{
+				m_testRunComplete = true;
+				return;
+			}
+
+			IncrementTest();
+		}
+
 		return;
 	}
 
-	if (m_lastTest) 
+	if (m_lastTest)
 	{
 		return;
 	}
 
 	//Test to see if we are incrementing from lossless to the runner iterations
-	if (strcmp(m_fileName,"lossless.h264") == 0) 
+	if (m_fileName == std::string(m_encoder->name()) + "-lossless.h264")
 	{
 		//Need to reset to runner config
 		m_encodeConfig = m_minEncodeConfig;
 	}
 
-	m_fileName = new char[255];
-	if (m_encodeConfig.rcMode == NV_ENC_PARAMS_RC_CONSTQP) 
+	m_fileName = std::string(m_encoder->name()) + "-";
+	if (m_encodeConfig.rate_control != RateControl::kConstantQp)
 	{
-		strcpy(m_fileName, m_encodeConfig.encoderPreset);
+		m_fileName += std::to_string(m_encodeConfig.bitrate_bps / 1000) + "kbps-";
 	}
-	else 
-	{
-		strcpy(m_fileName, std::to_string(m_encodeConfig.bitrate / 1000).c_str());
-		strcat(m_fileName, "kbps-");
-		strcat(m_fileName, m_encodeConfig.encoderPreset);
-	}
-	
-	switch (m_encodeConfig.rcMode) 
+
+	m_fileName += EncoderPresetName(m_encodeConfig.preset);
+	m_fileName += std::string("-") + RateControlName(m_encodeConfig.rate_control);
+	if (m_encodeConfig.rate_control != RateControl::kCbr)
 	{
-		case NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ:  strcat(m_fileName, "-CBRLLHQ.h264"); break;
-		case NV_ENC_PARAMS_RC_CBR:				strcat(m_fileName, "-CBR.h264"); break;
-		case NV_ENC_PARAMS_RC_CONSTQP:			
-			strcat(m_fileName, "-CONSTQP");
-			strcat(m_fileName, std::to_string(m_encodeConfig.qp).c_str());
-			strcat(m_fileName, ".h264");
-			break; 
-		case NV_ENC_PARAMS_RC_CBR_HQ:			strcat(m_fileName, "-CBRHQ.h264"); break;
-		case NV_ENC_PARAMS_RC_VBR_HQ:
-			strcat(m_fileName, "-VBRHQQP");
-			strcat(m_fileName, std::to_string(m_encodeConfig.qp).c_str());
-			strcat(m_fileName, ".h264");
-			break;
-		case NV_ENC_PARAMS_RC_VBR:				
-			strcat(m_fileName, "-VBRQP");
-			strcat(m_fileName, std::to_string(m_encodeConfig.qp).c_str());
-			strcat(m_fileName, ".h264");
-			break;
+		m_fileName += "-qp" + std::to_string(m_encodeConfig.qp);
 	}
 
-	if (m_encodeConfig.rcMode == NV_ENC_PARAMS_RC_CONSTQP) 
+	m_fileName += ".h264";
+
+	if (m_encodeConfig.rate_control == RateControl::kConstantQp)
 	{
-		if (m_encodeConfig.qp + 1 <= 36) 
+		if (m_encodeConfig.qp + 1 <= 36)
 		{
 			m_encodeConfig.qp++;
 			IncrementTest();
 			return;
 		}
-		else 
+		else
 		{
 			m_encodeConfig.qp = 36;
 			m_lastTest = true;
 			IncrementTest();
 		}
 	}
-	else 
+	else
 	{
-		if (m_encodeConfig.bitrate + m_stepEncodeConfig.bitrate <= m_maxEncodeConfig.bitrate) 
+		if (m_encodeConfig.bitrate_bps + m_stepEncodeConfig.bitrate_bps <= m_maxEncodeConfig.bitrate_bps)
 		{
-			m_encodeConfig.bitrate += m_stepEncodeConfig.bitrate;
+			m_encodeConfig.bitrate_bps += m_stepEncodeConfig.bitrate_bps;
 			IncrementTest();
 			return;
 		}
-		else 
+		else
 		{
-			m_encodeConfig.bitrate = m_maxEncodeConfig.bitrate;
+			m_encodeConfig.bitrate_bps = m_maxEncodeConfig.bitrate_bps;
 			m_lastTest = true;
 			IncrementTest();
 		}
 	}
 }
 
-void VideoTestRunner::IncrementTestSuite() 
+void VideoTestRunner::IncrementTestSuite()
 {
 	if (m_testRunComplete)
 	{
@@ -548,35 +452,32 @@ void VideoTestRunner::IncrementTestSuite()
 
 	m_currentFrame = 0;
 	m_lastTest = false;
-	m_minEncodeConfig.bitrate = 2500000;
-	m_stepEncodeConfig.bitrate = 250000;
-	m_maxEncodeConfig.bitrate = 10000000;
+	m_minEncodeConfig.bitrate_bps = 2500000;
+	m_stepEncodeConfig.bitrate_bps = 250000;
+	m_maxEncodeConfig.bitrate_bps = 10000000;
 
-	switch (m_currentSuite) 
+	switch (m_currentSuite)
 	{
-		case 0:
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
-			m_minEncodeConfig.encoderPreset = "losslessHP";
-		case 1: //Lowlatency CBR
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ;
-			m_minEncodeConfig.encoderPreset = "lowLatencyHQ";
+		case 0: //Lowlatency CBR
+			m_minEncodeConfig.rate_control = RateControl::kCbr;
+			m_minEncodeConfig.preset = EncoderPreset::kLowLatencyHighQuality;
 			break;
-		case 2: //VBR HQ
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_VBR_HQ;
-			m_minEncodeConfig.encoderPreset = "hq";
+		case 1: //Lowlatency HP CBR
+			m_minEncodeConfig.rate_control = RateControl::kCbr;
+			m_minEncodeConfig.preset = EncoderPreset::kLowLatencyHighPerformance;
 			break;
-		case 3: //VBR
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_VBR;
-			m_minEncodeConfig.encoderPreset = "hq";
+		case 2: //VBR HQ
+			m_minEncodeConfig.rate_control = RateControl::kVbr;
+			m_minEncodeConfig.preset = EncoderPreset::kHighQuality;
 			break;
-		case 4: //VBR BluRay
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_VBR_HQ;
-			m_minEncodeConfig.encoderPreset = "bluray";
+		case 3: //VBR HP
+			m_minEncodeConfig.rate_control = RateControl::kVbr;
+			m_minEncodeConfig.preset = EncoderPreset::kHighPerformance;
 			break;
-		case 5: //Constant quality QP
+		case 4: //Constant quality QP
 			m_minEncodeConfig.qp = 21;
-			m_minEncodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
-			m_minEncodeConfig.encoderPreset = "lossless";
+			m_minEncodeConfig.rate_control = RateControl::kConstantQp;
+			m_minEncodeConfig.preset = EncoderPreset::kHighQuality;
 			break;
 		default:
 			m_testRunComplete = true;
@@ -588,12 +489,12 @@ void VideoTestRunner::IncrementTestSuite()
 	IncrementTest();
 }
 
-bool VideoTestRunner::IsNewTest() 
+bool VideoTestRunner::IsNewTest()
 {
 	return m_currentFrame == 0 ? true : false;
 }
 
-bool VideoTestRunner::TestsComplete() 
+bool VideoTestRunner::TestsComplete()
 {
 	return m_testRunComplete;
 }